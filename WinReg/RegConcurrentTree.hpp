@@ -0,0 +1,1134 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGCONCURRENTTREE_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGCONCURRENTTREE_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegConcurrentTree: a thread-safe in-memory registry store, for many threads
+// reading and writing different keys at the same time, and
+// RegConcurrentTreeBackend, to use it as the registry of RegKey.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegEpoch.hpp"     // details::EpochGuard, details::EpochRetiredList
+#include "RegMemoryBackend.hpp" // RegMemoryBackend
+#include "RegTree.hpp"      // RegTree
+
+#include <atomic>           // std::atomic
+#include <functional>       // std::function, std::hash
+#include <memory>           // std::shared_ptr, std::unique_ptr
+#include <mutex>            // std::mutex, std::lock_guard
+#include <shared_mutex>     // std::shared_mutex, std::shared_lock
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <utility>          // std::move
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// A thread-safe in-memory registry store, for many threads reading and
+// writing different keys at the same time (e.g. a stand-in for the registry
+// in multi-threaded tests).
+//
+// In a RegVersionedTree every writer publishes a new version of the whole
+// tree, so concurrent writers conflict with each other. Here keys are
+// independent objects instead:
+//
+// - Keys are found by their case-folded path in a hash table split into
+//   shards. Each shard has hash chains of immutable entries, that lookups
+//   follow without locks; the writers of a shard (creating or deleting keys)
+//   are serialized by its mutex, and unlink the entries atomically.
+//
+// - The values of a key are an immutable vector sorted by case-folded name,
+//   replaced on each write (copy-on-write) by swapping an atomic pointer.
+//
+// - So ContainsKey, FindValue and EnumValues never lock nor wait: they run
+//   within an EpochGuard (see RegEpoch.hpp), and the entries, the bucket
+//   arrays and the value vectors unpublished by the writers are deleted
+//   only once no lookup can be using them.
+//
+// - Each key has a reader-writer lock: the writers of its values and subkeys
+//   hold it exclusively, while subkey enumeration holds it shared, so it
+//   returns a consistent list even while subkeys are being added.
+//
+// Lookups skip the keys that are being deleted (i.e. already detached from
+// their parent, but not yet removed from their shard).
+//
+// Key locks are taken from ancestors to descendants, and shard locks last
+// (one at a time), so operations on different keys cannot deadlock.
+// There is no snapshot of the whole store: ToTree copies it key by key.
+//------------------------------------------------------------------------------
+class RegConcurrentTree
+{
+public:
+
+    static constexpr size_t kDefaultShardCount = 64;
+
+    // Initialize a store containing just an empty root key
+    explicit RegConcurrentTree(size_t shardCount = kDefaultShardCount);
+
+    // No lookup can be active anymore
+    ~RegConcurrentTree();
+
+    // Ban copy and move (the object is shared among threads)
+    RegConcurrentTree(const RegConcurrentTree&) = delete;
+    RegConcurrentTree& operator=(const RegConcurrentTree&) = delete;
+    RegConcurrentTree(RegConcurrentTree&&) = delete;
+    RegConcurrentTree& operator=(RegConcurrentTree&&) = delete;
+
+
+    //
+    // Queries
+    //
+
+    // Does the store contain the key at the given path?
+    [[nodiscard]] bool ContainsKey(std::wstring_view keyPath) const;
+
+    // Return the value under the given key, or nullptr if not found
+    [[nodiscard]] RegTree::ValuePtr FindValue(std::wstring_view keyPath,
+                                              std::wstring_view valueName) const;
+
+    // Return the names of the direct subkeys, sorted by case-folded name.
+    // Throw RegException if the key doesn't exist.
+    [[nodiscard]] std::vector<std::wstring> EnumSubKeys(std::wstring_view keyPath) const;
+    [[nodiscard]] RegExpected<std::vector<std::wstring>> TryEnumSubKeys(std::wstring_view keyPath) const;
+
+    // Return the values of the key, sorted by case-folded name.
+    // Throw RegException if the key doesn't exist.
+    [[nodiscard]] std::vector<RegTree::ValuePtr> EnumValues(std::wstring_view keyPath) const;
+    [[nodiscard]] RegExpected<std::vector<RegTree::ValuePtr>> TryEnumValues(std::wstring_view keyPath) const;
+
+    // Return the number of keys, root included
+    [[nodiscard]] size_t KeyCount() const;
+
+    // Copy the content of the store into a RegTree
+    [[nodiscard]] RegTree ToTree() const;
+
+
+    //
+    // Updates
+    //
+
+    // Create the key at the given path, with any missing parent key;
+    // return true if any key was created
+    bool CreateKey(std::wstring_view keyPath);
+
+    // Set a value under the given key, creating any missing key
+    void SetValue(std::wstring_view keyPath,
+                  std::wstring_view valueName,
+                  DWORD type,
+                  std::vector<BYTE> data);
+
+    // Delete a value; return false if it doesn't exist
+    bool DeleteValue(std::wstring_view keyPath, std::wstring_view valueName);
+
+    // Delete a key and all its subtree; return false if it doesn't exist.
+    // The root key cannot be deleted.
+    bool DeleteTree(std::wstring_view keyPath);
+
+    // Rename a key, keeping it under the same parent: the subtree is copied
+    // under the new name while it's locked, then deleted. Lookups may miss
+    // both keys meanwhile. Return false if the key doesn't exist or is the
+    // root, or if the new name is taken by another key.
+    bool RenameKey(std::wstring_view keyPath, std::wstring_view newKeyName);
+
+
+    //
+    // Change notifications
+    //
+
+    // Called after each update that changed the store, on the updating
+    // thread and with no lock held, with the path of the changed key as passed
+    // to the update; deletedSubtree is true when the key and its subtree
+    // were deleted.
+    using ChangeHandler = std::function<void(std::wstring_view keyPath, bool deletedSubtree)>;
+
+    // Set (or clear, with an empty handler) the change handler.
+    // Safe to call while other threads update the store: an update that
+    // is completing meanwhile may still call the previous handler.
+    void SetChangeHandler(ChangeHandler handler);
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    struct KeyNode;
+    using KeyNodePtr = std::shared_ptr<KeyNode>;
+    using ValueVector = std::vector<RegTree::ValuePtr>;
+
+    struct KeyNode
+    {
+        std::wstring Name;
+        std::wstring FoldedPath;
+
+        // Protects SubKeys, serializes the writers of Values and Deleted
+        mutable std::shared_mutex Mutex;
+
+        std::vector<KeyNodePtr> SubKeys;    // sorted by case-folded name
+
+        // Written with Mutex held; lookups read it without the lock
+        std::atomic<bool> Deleted{ false };
+
+        // Replaced by the writers (holding Mutex); the replaced vectors
+        // are retired, as lookups may still be reading them
+        std::atomic<const ValueVector*> Values{ nullptr };
+
+        KeyNode()
+            : Values{ new ValueVector }
+        {}
+
+        ~KeyNode()
+        {
+            delete Values.load();
+        }
+
+        KeyNode(const KeyNode&) = delete;
+        KeyNode& operator=(const KeyNode&) = delete;
+    };
+
+    // A key in the hash chain of a shard: only Next changes, with the
+    // shard mutex held
+    struct ShardEntry
+    {
+        std::wstring             FoldedPath;
+        KeyNodePtr               Node;
+        std::atomic<ShardEntry*> Next{ nullptr };
+    };
+
+    // The heads of the hash chains of a shard; replaced by a larger array
+    // (with new entries) when the chains get long
+    struct ShardBuckets
+    {
+        explicit ShardBuckets(size_t bucketCount)
+            : Count{ bucketCount }
+            , Heads{ std::make_unique<std::atomic<ShardEntry*>[]>(bucketCount) }
+        {}
+
+        size_t                                      Count;
+        std::unique_ptr<std::atomic<ShardEntry*>[]> Heads;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex          Mutex;      // serializes the writers of the shard
+        std::atomic<ShardBuckets*>  Buckets{ nullptr };
+        size_t                      KeyCount{ 0 };  // protected by Mutex
+    };
+
+    static constexpr size_t kInitialBucketCount = 8;
+
+    // Return the shard of a case-folded path, and the hash of the path
+    [[nodiscard]] Shard& ShardOf(const std::wstring& foldedPath, size_t& hash) const noexcept;
+
+    // Return the entry of the given case-folded path, or nullptr if not found.
+    // Must be called within an EpochGuard, that keeps the entry alive.
+    [[nodiscard]] const ShardEntry* FindEntry(const std::wstring& foldedPath) const;
+
+    // Return the node at the given case-folded path, or nullptr if not found
+    [[nodiscard]] KeyNodePtr FindNode(const std::wstring& foldedPath) const;
+
+    // Add the node to its shard, replacing any entry with the same path
+    // (left by a subtree being detached)
+    void RegisterNode(const KeyNodePtr& node);
+
+    // Remove the node from its shard (if the entry of its path is still its own)
+    void UnregisterNode(const KeyNode* node);
+
+    // Return the node at the path made of the first componentCount components,
+    // creating it (and its missing parents) if needed; created is set to true
+    // if any key was created. The node may have been deleted meanwhile:
+    // callers check KeyNode::Deleted under its lock.
+    [[nodiscard]] KeyNodePtr CreateNode(const std::vector<std::wstring_view>& pathComponents,
+                                        size_t componentCount,
+                                        bool& created);
+
+    // Replace the values of a node. Must be called with the node lock held exclusively.
+    void StoreValues(KeyNode& node, const ValueVector* values);
+
+    // Call the change handler, if any
+    void NotifyChange(std::wstring_view keyPath, bool deletedSubtree) const;
+
+    // Mark a subtree unlinked from its parent as deleted, and remove its keys
+    // from the shards. Must be called with the lock of the former parent held.
+    void DetachSubtree(const KeyNodePtr& node);
+
+    std::unique_ptr<Shard[]> m_shards;
+    size_t                   m_shardCount;
+    KeyNodePtr               m_root;
+
+    // The entries, bucket arrays and value vectors replaced by the writers,
+    // waiting for the lookups that may use them
+    mutable details::EpochRetiredList m_retired;
+
+    // Protects the m_changeHandler pointer; the handler is called
+    // out of the lock, through a copy of the pointer
+    mutable std::mutex                   m_changeHandlerMutex;
+    std::shared_ptr<const ChangeHandler> m_changeHandler;
+};
+
+
+//------------------------------------------------------------------------------
+// An in-memory registry backend (see RegMemoryBackend) storing the keys in
+// a RegConcurrentTree: RegKey lookups are lock-free, and threads changing
+// different keys don't wait for each other.
+//------------------------------------------------------------------------------
+class RegConcurrentTreeBackend : public RegMemoryBackend
+{
+public:
+
+    explicit RegConcurrentTreeBackend(size_t shardCount = RegConcurrentTree::kDefaultShardCount);
+
+    // Return a copy of the current content
+    [[nodiscard]] RegTree Snapshot() const;
+
+    // The concurrent tree: its changes are not notified to RegKey
+    [[nodiscard]] RegConcurrentTree& Tree() noexcept;
+
+protected:
+
+    [[nodiscard]] bool StoreContainsKey(std::wstring_view keyPath) override;
+    [[nodiscard]] RegTree::ValuePtr StoreFindValue(std::wstring_view keyPath,
+                                                   std::wstring_view valueName) override;
+    [[nodiscard]] bool StoreReadSubKeys(std::wstring_view keyPath,
+                                        std::vector<std::wstring>& subKeyNames) override;
+    [[nodiscard]] bool StoreReadValues(std::wstring_view keyPath,
+                                       std::vector<RegTree::ValuePtr>& values) override;
+    bool StoreCreateKey(std::wstring_view keyPath) override;
+    void StoreSetValue(std::wstring_view keyPath,
+                       std::wstring_view valueName,
+                       DWORD type,
+                       const BYTE* data,
+                       size_t dataSize) override;
+    bool StoreDeleteValue(std::wstring_view keyPath, std::wstring_view valueName) override;
+    bool StoreDeleteTree(std::wstring_view keyPath) override;
+    [[nodiscard]] LSTATUS StoreRenameKey(std::wstring_view keyPath, std::wstring_view newKeyName) override;
+
+private:
+    RegConcurrentTree m_tree;
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegConcurrentTree
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Build the case-folded form of the path made of the first componentCount
+// components, used as the key of the RegConcurrentTree shards
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::wstring FoldKeyPath(
+    const std::vector<std::wstring_view>& pathComponents,
+    const size_t componentCount
+)
+{
+    _ASSERTE(componentCount <= pathComponents.size());
+
+    std::wstring foldedPath;
+    for (size_t index = 0; index < componentCount; index++)
+    {
+        if (index > 0)
+        {
+            foldedPath.push_back(L'\\');
+        }
+        for (const wchar_t ch : pathComponents[index])
+        {
+            foldedPath.push_back(FoldCase(ch));
+        }
+    }
+    return foldedPath;
+}
+
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegConcurrentTree Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegConcurrentTree::RegConcurrentTree(const size_t shardCount)
+    : m_shards{ std::make_unique<Shard[]>((shardCount > 0) ? shardCount : 1) }
+    , m_shardCount{ (shardCount > 0) ? shardCount : 1 }
+    , m_root{ std::make_shared<KeyNode>() }
+{
+    for (size_t index = 0; index < m_shardCount; index++)
+    {
+        m_shards[index].Buckets.store(new ShardBuckets{ kInitialBucketCount });
+    }
+
+    RegisterNode(m_root);
+}
+
+
+inline RegConcurrentTree::~RegConcurrentTree()
+{
+    // The retired objects are deleted by m_retired
+    for (size_t index = 0; index < m_shardCount; index++)
+    {
+        const ShardBuckets* const buckets = m_shards[index].Buckets.load();
+        for (size_t bucket = 0; bucket < buckets->Count; bucket++)
+        {
+            const ShardEntry* entry = buckets->Heads[bucket].load();
+            while (entry != nullptr)
+            {
+                const ShardEntry* const next = entry->Next.load();
+                delete entry;
+                entry = next;
+            }
+        }
+        delete buckets;
+    }
+}
+
+
+inline RegConcurrentTree::Shard& RegConcurrentTree::ShardOf(const std::wstring& foldedPath,
+                                                            size_t& hash) const noexcept
+{
+    hash = std::hash<std::wstring>{}(foldedPath);
+    return m_shards[hash % m_shardCount];
+}
+
+
+inline const RegConcurrentTree::ShardEntry* RegConcurrentTree::FindEntry(const std::wstring& foldedPath) const
+{
+    size_t hash = 0;
+    const Shard& shard = ShardOf(foldedPath, hash);
+
+    // The shard index used the low part of the hash: pick the bucket with the rest
+    const ShardBuckets* const buckets = shard.Buckets.load();
+    const ShardEntry* entry = buckets->Heads[(hash / m_shardCount) % buckets->Count].load();
+    while ((entry != nullptr) && (entry->FoldedPath != foldedPath))
+    {
+        entry = entry->Next.load();
+    }
+    return entry;
+}
+
+
+inline RegConcurrentTree::KeyNodePtr RegConcurrentTree::FindNode(const std::wstring& foldedPath) const
+{
+    const details::EpochGuard epochGuard;
+    const ShardEntry* const entry = FindEntry(foldedPath);
+    return (entry != nullptr) ? entry->Node : nullptr;
+}
+
+
+inline void RegConcurrentTree::RegisterNode(const KeyNodePtr& node)
+{
+    size_t hash = 0;
+    Shard& shard = ShardOf(node->FoldedPath, hash);
+    {
+        std::lock_guard<std::mutex> shardLock{ shard.Mutex };
+
+        ShardBuckets* buckets = shard.Buckets.load();
+        if (shard.KeyCount >= 2 * buckets->Count)
+        {
+            // Rehash into twice the buckets, with new entries: the entries
+            // in the old chains may still be followed by lookups
+            auto newBuckets = std::make_unique<ShardBuckets>(2 * buckets->Count);
+            std::vector<const ShardEntry*> oldEntries;
+            oldEntries.reserve(shard.KeyCount);
+            for (size_t bucket = 0; bucket < buckets->Count; bucket++)
+            {
+                for (const ShardEntry* entry = buckets->Heads[bucket].load(); entry != nullptr; entry = entry->Next.load())
+                {
+                    const size_t entryHash = std::hash<std::wstring>{}(entry->FoldedPath);
+                    std::atomic<ShardEntry*>& head = newBuckets->Heads[(entryHash / m_shardCount) % newBuckets->Count];
+                    head.store(new ShardEntry{ entry->FoldedPath, entry->Node, head.load() });
+                    oldEntries.push_back(entry);
+                }
+            }
+
+            shard.Buckets.store(newBuckets.get());
+            m_retired.Retire(buckets);
+            for (const ShardEntry* entry : oldEntries)
+            {
+                m_retired.Retire(entry);
+            }
+            buckets = newBuckets.release();
+        }
+
+        std::atomic<ShardEntry*>& head = buckets->Heads[(hash / m_shardCount) % buckets->Count];
+
+        // Unlink any entry left for the same path by a subtree being detached
+        std::atomic<ShardEntry*>* link = &head;
+        for (ShardEntry* entry = link->load(); entry != nullptr; entry = link->load())
+        {
+            if (entry->FoldedPath == node->FoldedPath)
+            {
+                link->store(entry->Next.load());
+                m_retired.Retire(entry);
+                shard.KeyCount--;
+                break;
+            }
+            link = &entry->Next;
+        }
+
+        // Publish the new entry, complete, at the head of its chain
+        head.store(new ShardEntry{ node->FoldedPath, node, head.load() });
+        shard.KeyCount++;
+    }
+    m_retired.Reclaim();
+}
+
+
+inline void RegConcurrentTree::UnregisterNode(const KeyNode* const node)
+{
+    size_t hash = 0;
+    Shard& shard = ShardOf(node->FoldedPath, hash);
+    {
+        std::lock_guard<std::mutex> shardLock{ shard.Mutex };
+
+        ShardBuckets* const buckets = shard.Buckets.load();
+        std::atomic<ShardEntry*>* link = &buckets->Heads[(hash / m_shardCount) % buckets->Count];
+        for (ShardEntry* entry = link->load(); entry != nullptr; entry = link->load())
+        {
+            if (entry->Node.get() == node)
+            {
+                // Lookups on the entry can still follow its Next link
+                link->store(entry->Next.load());
+                m_retired.Retire(entry);
+                shard.KeyCount--;
+                break;
+            }
+            link = &entry->Next;
+        }
+    }
+    m_retired.Reclaim();
+}
+
+
+inline void RegConcurrentTree::StoreValues(KeyNode& node, const ValueVector* const values)
+{
+    m_retired.Retire(node.Values.exchange(values));
+}
+
+
+inline RegConcurrentTree::KeyNodePtr RegConcurrentTree::CreateNode(
+    const std::vector<std::wstring_view>& pathComponents,
+    const size_t componentCount,
+    bool& created
+)
+{
+    if (componentCount == 0)
+    {
+        return m_root;
+    }
+
+    const std::wstring foldedPath = details::FoldKeyPath(pathComponents, componentCount);
+    const std::wstring_view name = pathComponents[componentCount - 1];
+
+    for (;;)
+    {
+        if (KeyNodePtr node = FindNode(foldedPath))
+        {
+            return node;
+        }
+
+        const KeyNodePtr parent = CreateNode(pathComponents, componentCount - 1, created);
+        std::unique_lock<std::shared_mutex> parentLock{ parent->Mutex };
+        if (parent->Deleted)
+        {
+            // The parent was deleted meanwhile: recreate it
+            continue;
+        }
+
+        const auto [position, found] = details::FindByFoldedName(parent->SubKeys, name);
+        if (found)
+        {
+            return parent->SubKeys[position];
+        }
+
+        auto node = std::make_shared<KeyNode>();
+        node->Name = std::wstring{ name };
+        node->FoldedPath = foldedPath;
+        RegisterNode(node);
+        parent->SubKeys.insert(parent->SubKeys.begin() + position, node);
+        created = true;
+        return node;
+    }
+}
+
+
+inline void RegConcurrentTree::DetachSubtree(const KeyNodePtr& node)
+{
+    std::vector<KeyNodePtr> subKeys;
+    {
+        std::unique_lock<std::shared_mutex> lock{ node->Mutex };
+        node->Deleted = true;
+        subKeys.swap(node->SubKeys);
+    }
+
+    UnregisterNode(node.get());
+
+    for (const KeyNodePtr& subKey : subKeys)
+    {
+        DetachSubtree(subKey);
+    }
+}
+
+
+inline bool RegConcurrentTree::ContainsKey(const std::wstring_view keyPath) const
+{
+    const std::wstring foldedPath = details::FoldKeyPath(keyPath);
+
+    const details::EpochGuard epochGuard;
+    const ShardEntry* const entry = FindEntry(foldedPath);
+    return (entry != nullptr) && !entry->Node->Deleted.load(std::memory_order_acquire);
+}
+
+
+inline RegTree::ValuePtr RegConcurrentTree::FindValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName
+) const
+{
+    const std::wstring foldedPath = details::FoldKeyPath(keyPath);
+
+    const details::EpochGuard epochGuard;
+    const ShardEntry* const entry = FindEntry(foldedPath);
+    if ((entry == nullptr) || entry->Node->Deleted.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+
+    const ValueVector& values = *entry->Node->Values.load();
+    const auto [position, found] = details::FindByFoldedName(values, valueName);
+    return found ? values[position] : nullptr;
+}
+
+
+inline std::vector<std::wstring> RegConcurrentTree::EnumSubKeys(const std::wstring_view keyPath) const
+{
+    RegExpected<std::vector<std::wstring>> subKeyNames = TryEnumSubKeys(keyPath);
+    if (!subKeyNames.IsValid())
+    {
+        throw RegException{ subKeyNames.GetError().Code(), "Cannot enumerate the subkeys: key not found." };
+    }
+    return std::move(subKeyNames).GetValue();
+}
+
+
+inline RegExpected<std::vector<std::wstring>>
+    RegConcurrentTree::TryEnumSubKeys(const std::wstring_view keyPath) const
+{
+    using ReturnType = std::vector<std::wstring>;
+
+    const KeyNodePtr node = FindNode(details::FoldKeyPath(keyPath));
+    if (!node)
+    {
+        return RegExpected<ReturnType>{ RegResult{ ERROR_FILE_NOT_FOUND } };
+    }
+
+    std::shared_lock<std::shared_mutex> lock{ node->Mutex };
+    if (node->Deleted)
+    {
+        return RegExpected<ReturnType>{ RegResult{ ERROR_FILE_NOT_FOUND } };
+    }
+
+    ReturnType subKeyNames;
+    subKeyNames.reserve(node->SubKeys.size());
+    for (const KeyNodePtr& subKey : node->SubKeys)
+    {
+        subKeyNames.push_back(subKey->Name);
+    }
+    return RegExpected<ReturnType>{ std::move(subKeyNames) };
+}
+
+
+inline std::vector<RegTree::ValuePtr> RegConcurrentTree::EnumValues(const std::wstring_view keyPath) const
+{
+    RegExpected<std::vector<RegTree::ValuePtr>> values = TryEnumValues(keyPath);
+    if (!values.IsValid())
+    {
+        throw RegException{ values.GetError().Code(), "Cannot enumerate the values: key not found." };
+    }
+    return std::move(values).GetValue();
+}
+
+
+inline RegExpected<std::vector<RegTree::ValuePtr>>
+    RegConcurrentTree::TryEnumValues(const std::wstring_view keyPath) const
+{
+    using ReturnType = std::vector<RegTree::ValuePtr>;
+
+    const std::wstring foldedPath = details::FoldKeyPath(keyPath);
+
+    const details::EpochGuard epochGuard;
+    const ShardEntry* const entry = FindEntry(foldedPath);
+    if ((entry == nullptr) || entry->Node->Deleted.load(std::memory_order_acquire))
+    {
+        return RegExpected<ReturnType>{ RegResult{ ERROR_FILE_NOT_FOUND } };
+    }
+
+    return RegExpected<ReturnType>{ ReturnType{ *entry->Node->Values.load() } };
+}
+
+
+inline size_t RegConcurrentTree::KeyCount() const
+{
+    size_t keyCount = 0;
+    for (size_t index = 0; index < m_shardCount; index++)
+    {
+        std::lock_guard<std::mutex> shardLock{ m_shards[index].Mutex };
+        keyCount += m_shards[index].KeyCount;
+    }
+    return keyCount;
+}
+
+
+inline RegTree RegConcurrentTree::ToTree() const
+{
+    RegTree tree;
+
+    // Depth-first walk, holding one key lock at a time
+    std::vector<std::pair<std::wstring, KeyNodePtr>> pending;
+    pending.emplace_back(std::wstring{}, m_root);
+    while (!pending.empty())
+    {
+        auto [keyPath, node] = std::move(pending.back());
+        pending.pop_back();
+
+        std::vector<KeyNodePtr> subKeys;
+        {
+            std::shared_lock<std::shared_mutex> lock{ node->Mutex };
+            if (node->Deleted)
+            {
+                continue;
+            }
+            subKeys = node->SubKeys;
+        }
+
+        tree.CreateKey(keyPath);
+        const details::EpochGuard epochGuard;
+        for (const RegTree::ValuePtr& value : *node->Values.load())
+        {
+            tree.SetValue(keyPath, value->Name, value->Type, value->Data, value->DataSize);
+        }
+
+        for (const KeyNodePtr& subKey : subKeys)
+        {
+            pending.emplace_back(keyPath.empty() ? subKey->Name : (keyPath + L'\\' + subKey->Name), subKey);
+        }
+    }
+
+    return tree;
+}
+
+
+inline bool RegConcurrentTree::CreateKey(const std::wstring_view keyPath)
+{
+    const std::vector<std::wstring_view> pathComponents = details::SplitKeyPath(keyPath);
+    bool created = false;
+    for (;;)
+    {
+        const KeyNodePtr node = CreateNode(pathComponents, pathComponents.size(), created);
+
+        std::shared_lock<std::shared_mutex> lock{ node->Mutex };
+        if (!node->Deleted)
+        {
+            break;
+        }
+    }
+
+    if (created)
+    {
+        NotifyChange(keyPath, false);
+    }
+    return created;
+}
+
+
+inline void RegConcurrentTree::SetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    std::vector<BYTE> data
+)
+{
+    RegTree::ValuePtr value =
+        RegTree::ValueArena::StoreSingle(valueName, type, data.data(), data.size());
+
+    const std::vector<std::wstring_view> pathComponents = details::SplitKeyPath(keyPath);
+    bool created = false;
+    for (;;)
+    {
+        const KeyNodePtr node = CreateNode(pathComponents, pathComponents.size(), created);
+
+        std::unique_lock<std::shared_mutex> lock{ node->Mutex };
+        if (node->Deleted)
+        {
+            continue;
+        }
+
+        // Copy-on-write: lookups keep using the previous vector
+        auto values = std::make_unique<ValueVector>(*node->Values.load());
+        const auto [position, found] = details::FindByFoldedName(*values, valueName);
+        if (found)
+        {
+            (*values)[position] = std::move(value);
+        }
+        else
+        {
+            values->insert(values->begin() + position, std::move(value));
+        }
+
+        StoreValues(*node, values.release());
+        lock.unlock();
+        m_retired.Reclaim();
+
+        NotifyChange(keyPath, false);
+        return;
+    }
+}
+
+
+inline bool RegConcurrentTree::DeleteValue(const std::wstring_view keyPath, const std::wstring_view valueName)
+{
+    const std::wstring foldedPath = details::FoldKeyPath(keyPath);
+    for (;;)
+    {
+        const KeyNodePtr node = FindNode(foldedPath);
+        if (!node)
+        {
+            return false;
+        }
+
+        std::unique_lock<std::shared_mutex> lock{ node->Mutex };
+        if (node->Deleted)
+        {
+            continue;
+        }
+
+        const ValueVector& values = *node->Values.load();
+        const auto [position, found] = details::FindByFoldedName(values, valueName);
+        if (!found)
+        {
+            return false;
+        }
+
+        auto newValues = std::make_unique<ValueVector>(values);
+        newValues->erase(newValues->begin() + position);
+        StoreValues(*node, newValues.release());
+        lock.unlock();
+        m_retired.Reclaim();
+
+        NotifyChange(keyPath, false);
+        return true;
+    }
+}
+
+
+inline bool RegConcurrentTree::DeleteTree(const std::wstring_view keyPath)
+{
+    const std::vector<std::wstring_view> pathComponents = details::SplitKeyPath(keyPath);
+    if (pathComponents.empty())
+    {
+        // The root key cannot be deleted
+        return false;
+    }
+
+    const std::wstring parentPath = details::FoldKeyPath(pathComponents, pathComponents.size() - 1);
+    for (;;)
+    {
+        const KeyNodePtr parent = FindNode(parentPath);
+        if (!parent)
+        {
+            return false;
+        }
+
+        std::unique_lock<std::shared_mutex> parentLock{ parent->Mutex };
+        if (parent->Deleted)
+        {
+            continue;
+        }
+
+        const auto [position, found] = details::FindByFoldedName(parent->SubKeys, pathComponents.back());
+        if (!found)
+        {
+            return false;
+        }
+
+        // Unlink the subtree; keeping the parent locked meanwhile, nobody
+        // can recreate the key before the old subtree is fully detached
+        const KeyNodePtr node = parent->SubKeys[position];
+        parent->SubKeys.erase(parent->SubKeys.begin() + position);
+        DetachSubtree(node);
+        parentLock.unlock();
+
+        NotifyChange(keyPath, true);
+        return true;
+    }
+}
+
+
+inline bool RegConcurrentTree::RenameKey(const std::wstring_view keyPath, const std::wstring_view newKeyName)
+{
+    const std::vector<std::wstring_view> pathComponents = details::SplitKeyPath(keyPath);
+    if (pathComponents.empty()
+        || newKeyName.empty()
+        || (newKeyName.find(L'\\') != std::wstring_view::npos))
+    {
+        return false;
+    }
+
+    const std::wstring parentPath = details::FoldKeyPath(pathComponents, pathComponents.size() - 1);
+    std::wstring newFoldedPath = parentPath;
+    if (!newFoldedPath.empty())
+    {
+        newFoldedPath.push_back(L'\\');
+    }
+    newFoldedPath += details::FoldKeyPath(newKeyName);
+
+    for (;;)
+    {
+        const KeyNodePtr parent = FindNode(parentPath);
+        if (!parent)
+        {
+            return false;
+        }
+
+        std::unique_lock<std::shared_mutex> parentLock{ parent->Mutex };
+        if (parent->Deleted)
+        {
+            continue;
+        }
+
+        const auto [position, found] = details::FindByFoldedName(parent->SubKeys, pathComponents.back());
+        const auto [newPosition, newFound] = details::FindByFoldedName(parent->SubKeys, newKeyName);
+        if (!found || (newFound && (newPosition != position)))
+        {
+            // Missing key, or new name taken by another key (a change of case is allowed)
+            return false;
+        }
+
+        // Lock the whole subtree, from ancestors to descendants,
+        // so that it doesn't change while it's copied
+        const KeyNodePtr node = parent->SubKeys[position];
+        std::vector<KeyNodePtr> oldNodes{ node };
+        std::vector<std::unique_lock<std::shared_mutex>> oldNodeLocks;
+        for (size_t index = 0; index < oldNodes.size(); index++)
+        {
+            oldNodeLocks.emplace_back(oldNodes[index]->Mutex);
+            oldNodes.insert(oldNodes.end(), oldNodes[index]->SubKeys.begin(), oldNodes[index]->SubKeys.end());
+        }
+
+        // Copy the subtree under the new path; the value vectors are copied,
+        // the values (immutable) are shared
+        const size_t oldPathLength = node->FoldedPath.length();
+        std::vector<KeyNodePtr> newNodes;
+        newNodes.reserve(oldNodes.size());
+        for (const KeyNodePtr& oldNode : oldNodes)
+        {
+            auto newNode = std::make_shared<KeyNode>();
+            newNode->Name = (oldNode == node) ? std::wstring{ newKeyName } : oldNode->Name;
+            newNode->FoldedPath = newFoldedPath + oldNode->FoldedPath.substr(oldPathLength);
+            delete newNode->Values.exchange(new ValueVector{ *oldNode->Values.load() });
+            newNodes.push_back(std::move(newNode));
+        }
+
+        // The nodes were added breadth-first: link each node to its parent,
+        // in the same (sorted) order
+        for (size_t index = 0, child = 1; index < oldNodes.size(); index++)
+        {
+            const size_t subKeyCount = oldNodes[index]->SubKeys.size();
+            newNodes[index]->SubKeys.assign(newNodes.begin() + child, newNodes.begin() + child + subKeyCount);
+            child += subKeyCount;
+        }
+
+        // Replace the old subtree with the copy
+        for (const KeyNodePtr& oldNode : oldNodes)
+        {
+            oldNode->Deleted = true;
+            UnregisterNode(oldNode.get());
+        }
+        for (const KeyNodePtr& newNode : newNodes)
+        {
+            RegisterNode(newNode);
+        }
+        parent->SubKeys.erase(parent->SubKeys.begin() + position);
+        const auto [insertPosition, taken] = details::FindByFoldedName(parent->SubKeys, newKeyName);
+        parent->SubKeys.insert(parent->SubKeys.begin() + insertPosition, newNodes.front());
+
+        for (const KeyNodePtr& oldNode : oldNodes)
+        {
+            oldNode->SubKeys.clear();
+        }
+        oldNodeLocks.clear();
+        parentLock.unlock();
+
+        std::wstring newKeyPath{ keyPath.substr(0, keyPath.length() - pathComponents.back().length()) };
+        newKeyPath += newKeyName;
+        NotifyChange(keyPath, true);
+        NotifyChange(newKeyPath, false);
+        return true;
+    }
+}
+
+
+inline void RegConcurrentTree::SetChangeHandler(ChangeHandler handler)
+{
+    std::shared_ptr<const ChangeHandler> newHandler;
+    if (handler)
+    {
+        newHandler = std::make_shared<const ChangeHandler>(std::move(handler));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ m_changeHandlerMutex };
+        m_changeHandler.swap(newHandler);
+    }
+    // The previous handler is released here, out of the lock
+}
+
+
+inline void RegConcurrentTree::NotifyChange(const std::wstring_view keyPath, const bool deletedSubtree) const
+{
+    std::shared_ptr<const ChangeHandler> handler;
+    {
+        std::lock_guard<std::mutex> lock{ m_changeHandlerMutex };
+        handler = m_changeHandler;
+    }
+
+    if (handler)
+    {
+        (*handler)(keyPath, deletedSubtree);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//                  RegConcurrentTreeBackend Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegConcurrentTreeBackend::RegConcurrentTreeBackend(const size_t shardCount)
+    : m_tree{ shardCount }
+{}
+
+
+inline RegTree RegConcurrentTreeBackend::Snapshot() const
+{
+    return m_tree.ToTree();
+}
+
+
+inline RegConcurrentTree& RegConcurrentTreeBackend::Tree() noexcept
+{
+    return m_tree;
+}
+
+
+inline bool RegConcurrentTreeBackend::StoreContainsKey(const std::wstring_view keyPath)
+{
+    return m_tree.ContainsKey(keyPath);
+}
+
+
+inline RegTree::ValuePtr RegConcurrentTreeBackend::StoreFindValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName)
+{
+    return m_tree.FindValue(keyPath, valueName);
+}
+
+
+inline bool RegConcurrentTreeBackend::StoreReadSubKeys(
+    const std::wstring_view keyPath,
+    std::vector<std::wstring>& subKeyNames)
+{
+    RegExpected<std::vector<std::wstring>> result = m_tree.TryEnumSubKeys(keyPath);
+    if (!result.IsValid())
+    {
+        return false;
+    }
+
+    subKeyNames = std::move(result).GetValue();
+    return true;
+}
+
+
+inline bool RegConcurrentTreeBackend::StoreReadValues(
+    const std::wstring_view keyPath,
+    std::vector<RegTree::ValuePtr>& values)
+{
+    RegExpected<std::vector<RegTree::ValuePtr>> result = m_tree.TryEnumValues(keyPath);
+    if (!result.IsValid())
+    {
+        return false;
+    }
+
+    values = std::move(result).GetValue();
+    return true;
+}
+
+
+inline bool RegConcurrentTreeBackend::StoreCreateKey(const std::wstring_view keyPath)
+{
+    return m_tree.CreateKey(keyPath);
+}
+
+
+inline void RegConcurrentTreeBackend::StoreSetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize)
+{
+    m_tree.SetValue(keyPath, valueName, type, std::vector<BYTE>(data, data + dataSize));
+}
+
+
+inline bool RegConcurrentTreeBackend::StoreDeleteValue(const std::wstring_view keyPath,
+                                                       const std::wstring_view valueName)
+{
+    return m_tree.DeleteValue(keyPath, valueName);
+}
+
+
+inline bool RegConcurrentTreeBackend::StoreDeleteTree(const std::wstring_view keyPath)
+{
+    return m_tree.DeleteTree(keyPath);
+}
+
+
+inline LSTATUS RegConcurrentTreeBackend::StoreRenameKey(const std::wstring_view keyPath,
+                                                        const std::wstring_view newKeyName)
+{
+    if (m_tree.RenameKey(keyPath, newKeyName))
+    {
+        return ERROR_SUCCESS;
+    }
+
+    return m_tree.ContainsKey(keyPath) ? ERROR_ACCESS_DENIED : ERROR_FILE_NOT_FOUND;
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGCONCURRENTTREE_HPP_INCLUDED
@@ -0,0 +1,353 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGEPOCH_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGEPOCH_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegEpoch: epoch-based reclamation, that lets the in-memory stores
+// (RegVersionedTree, RegConcurrentTree) be read without locks, deleting
+// the objects unpublished by their writers only when no reader can be
+// using them anymore.
+//
+// The headers of those stores include this header: don't include it directly.
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>        // std::stable_partition
+#include <atomic>           // std::atomic
+#include <cstddef>          // size_t
+#include <cstdint>          // std::uint64_t
+#include <limits>           // std::numeric_limits
+#include <mutex>            // std::mutex, std::lock_guard
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Epoch-based reclamation, shared by all the lock-free in-memory stores.
+//
+// Each thread has a slot (an EpochRecord), where it stores the global epoch
+// while it reads shared objects, and 0 otherwise. An object unpublished by a
+// writer is retired with the epoch returned by Retire, that also advances the
+// global epoch: readers that enter after that can't reach the object anymore,
+// so the object can be deleted as soon as every active reader has entered in a
+// later epoch (see IsReclaimable).
+//
+// Entering and leaving only write the slot of the calling thread, so readers
+// don't contend on any shared cache line; the slots are never freed, but are
+// reused by new threads.
+//------------------------------------------------------------------------------
+class EpochDomain
+{
+public:
+
+    // The domain used by all the stores
+    [[nodiscard]] static EpochDomain& Global() noexcept;
+
+    // Announce the calling thread as a reader (nested calls are allowed)
+    void Enter();
+
+    // Leave the reader state entered by the matching Enter call
+    void Leave() noexcept;
+
+    // Return the epoch to retire an object with, after unpublishing it
+    [[nodiscard]] std::uint64_t Retire() noexcept;
+
+    // Can the objects retired with the given epoch be deleted?
+    [[nodiscard]] bool IsReclaimable(std::uint64_t retireEpoch) const noexcept;
+
+    // Return the oldest epoch of the active readers (max if there are none)
+    [[nodiscard]] std::uint64_t OldestActiveEpoch() const noexcept;
+
+private:
+
+    // Avoid false sharing between the slots of different threads
+    static constexpr size_t kCacheLineSize = 64;
+
+    struct alignas(kCacheLineSize) EpochRecord
+    {
+        std::atomic<std::uint64_t> Epoch{ 0 };        // 0 when not reading
+        std::atomic<bool>          InUse{ false };    // owned by a thread
+        EpochRecord*               Next{ nullptr };   // immutable once published
+    };
+
+    // The slot of the calling thread, released when the thread exits
+    struct ThreadState
+    {
+        EpochRecord* Record{ nullptr };
+        unsigned int Depth{ 0 };
+
+        ~ThreadState();
+    };
+
+    [[nodiscard]] static ThreadState& GetThreadState() noexcept;
+
+    // Find a free slot, or add one
+    [[nodiscard]] EpochRecord* AcquireRecord();
+
+    alignas(kCacheLineSize) std::atomic<std::uint64_t> m_epoch{ 1 };
+    alignas(kCacheLineSize) std::atomic<EpochRecord*>  m_records{ nullptr };
+};
+
+
+//------------------------------------------------------------------------------
+// Enter the epoch domain for the lifetime of this object
+//------------------------------------------------------------------------------
+class EpochGuard
+{
+public:
+    EpochGuard()
+    {
+        EpochDomain::Global().Enter();
+    }
+
+    ~EpochGuard()
+    {
+        EpochDomain::Global().Leave();
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+
+inline EpochDomain& EpochDomain::Global() noexcept
+{
+    static EpochDomain s_domain;
+    return s_domain;
+}
+
+
+inline EpochDomain::ThreadState& EpochDomain::GetThreadState() noexcept
+{
+    thread_local ThreadState state;
+    return state;
+}
+
+
+inline EpochDomain::ThreadState::~ThreadState()
+{
+    if (Record != nullptr)
+    {
+        Record->Epoch.store(0);
+        Record->InUse.store(false, std::memory_order_release);
+    }
+}
+
+
+inline EpochDomain::EpochRecord* EpochDomain::AcquireRecord()
+{
+    for (EpochRecord* record = m_records.load(std::memory_order_acquire); record != nullptr; record = record->Next)
+    {
+        bool inUse = false;
+        if (!record->InUse.load(std::memory_order_relaxed)
+            && record->InUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+        {
+            return record;
+        }
+    }
+
+    auto* const record = new EpochRecord;
+    record->InUse.store(true, std::memory_order_relaxed);
+    EpochRecord* head = m_records.load(std::memory_order_relaxed);
+    do
+    {
+        record->Next = head;
+    } while (!m_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    return record;
+}
+
+
+inline void EpochDomain::Enter()
+{
+    ThreadState& state = GetThreadState();
+    if (state.Depth++ > 0)
+    {
+        return;
+    }
+
+    try
+    {
+        if (state.Record == nullptr)
+        {
+            state.Record = AcquireRecord();
+        }
+    }
+    catch (...)
+    {
+        state.Depth--;
+        throw;
+    }
+
+    // Sequentially consistent, so that a writer that doesn't see this store
+    // has advanced the epoch before the reads that follow it
+    state.Record->Epoch.store(m_epoch.load());
+}
+
+
+inline void EpochDomain::Leave() noexcept
+{
+    ThreadState& state = GetThreadState();
+    if (--state.Depth == 0)
+    {
+        state.Record->Epoch.store(0, std::memory_order_release);
+    }
+}
+
+
+inline std::uint64_t EpochDomain::Retire() noexcept
+{
+    return m_epoch.fetch_add(1);
+}
+
+
+inline std::uint64_t EpochDomain::OldestActiveEpoch() const noexcept
+{
+    std::uint64_t oldest = (std::numeric_limits<std::uint64_t>::max)();
+    for (const EpochRecord* record = m_records.load(std::memory_order_acquire); record != nullptr; record = record->Next)
+    {
+        const std::uint64_t epoch = record->Epoch.load();
+        if ((epoch != 0) && (epoch < oldest))
+        {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+
+inline bool EpochDomain::IsReclaimable(const std::uint64_t retireEpoch) const noexcept
+{
+    return retireEpoch < OldestActiveEpoch();
+}
+
+
+//------------------------------------------------------------------------------
+// The objects retired by the writers of a store, each one deleted once no
+// reader can be using it anymore.
+//
+// Writers unpublish an object (e.g. swapping an atomic pointer), retire it,
+// and call Reclaim after releasing their locks; readers use the published
+// objects within an EpochGuard.
+//------------------------------------------------------------------------------
+class EpochRetiredList
+{
+public:
+    EpochRetiredList() noexcept = default;
+
+    // Delete all the retired objects: no reader can be active anymore
+    ~EpochRetiredList();
+
+    // Ban copy and move (the object is shared among threads)
+    EpochRetiredList(const EpochRetiredList&) = delete;
+    EpochRetiredList& operator=(const EpochRetiredList&) = delete;
+
+    // Retire an object that readers can't reach anymore.
+    // If out of memory, the object is leaked rather than deleted under a reader.
+    template <typename T>
+    void Retire(const T* object) noexcept;
+
+    // Delete the retired objects that no reader can be using
+    void Reclaim();
+
+    // Return the number of retired objects not deleted yet
+    [[nodiscard]] size_t Size() const;
+
+private:
+
+    struct RetiredObject
+    {
+        const void*   Object;
+        void        (*Delete)(const void*);
+        std::uint64_t Epoch;
+    };
+
+    mutable std::mutex         m_mutex;     // protects m_objects
+    std::vector<RetiredObject> m_objects;
+};
+
+
+inline EpochRetiredList::~EpochRetiredList()
+{
+    for (const RetiredObject& retired : m_objects)
+    {
+        retired.Delete(retired.Object);
+    }
+}
+
+
+template <typename T>
+inline void EpochRetiredList::Retire(const T* const object) noexcept
+{
+    if (object == nullptr)
+    {
+        return;
+    }
+
+    // The readers that entered before this point may still use the object:
+    // retire it with the epoch they can have
+    try
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        m_objects.push_back(RetiredObject{
+            object,
+            [](const void* retiredObject) { delete static_cast<const T*>(retiredObject); },
+            EpochDomain::Global().Retire()
+        });
+    }
+    catch (...)
+    {
+        // Out of memory: leak the object
+    }
+}
+
+
+inline void EpochRetiredList::Reclaim()
+{
+    std::vector<RetiredObject> reclaimable;
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        if (m_objects.empty())
+        {
+            return;
+        }
+
+        const std::uint64_t oldestActiveEpoch = EpochDomain::Global().OldestActiveEpoch();
+        const auto firstKept = std::stable_partition(m_objects.begin(), m_objects.end(),
+            [oldestActiveEpoch](const RetiredObject& retired) { return retired.Epoch < oldestActiveEpoch; });
+        reclaimable.assign(m_objects.begin(), firstKept);
+        m_objects.erase(m_objects.begin(), firstKept);
+    }
+
+    // Deleted out of the lock: deleting an object can release others
+    for (const RetiredObject& retired : reclaimable)
+    {
+        retired.Delete(retired.Object);
+    }
+}
+
+
+inline size_t EpochRetiredList::Size() const
+{
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    return m_objects.size();
+}
+
+
+} // namespace details
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGEPOCH_HPP_INCLUDED
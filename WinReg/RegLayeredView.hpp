@@ -0,0 +1,580 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGLAYEREDVIEW_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGLAYEREDVIEW_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegLayeredView: a merged, cached view of the values of several registry keys,
+// resolved by precedence (e.g. HKCU, then HKLM, then a default).
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegMap.hpp"       // RegMap value conversions
+
+#include <algorithm>        // std::sort, std::remove_if
+#include <chrono>           // std::chrono::milliseconds, std::chrono::steady_clock
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <unordered_map>    // std::unordered_map
+#include <utility>          // std::move
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// A registry key, in the list of layers of a RegLayeredView
+//------------------------------------------------------------------------------
+struct RegLayer
+{
+    HKEY         RootKey{ nullptr };
+    std::wstring SubKey;
+};
+
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Change notification of a registry key: an event that RegNotifyChangeKeyValue
+// signals when a value of the key is set or deleted (or the key is deleted).
+// Unlike the last write time of the key, whose resolution is the system timer
+// tick, this catches every change made after the notification was armed.
+//------------------------------------------------------------------------------
+class KeyChangeNotification
+{
+public:
+
+    KeyChangeNotification() noexcept = default;
+
+    ~KeyChangeNotification() noexcept
+    {
+        Close();
+    }
+
+    // Ban copy, allow move
+    KeyChangeNotification(const KeyChangeNotification&) = delete;
+    KeyChangeNotification& operator=(const KeyChangeNotification&) = delete;
+
+    KeyChangeNotification(KeyChangeNotification&& other) noexcept
+        : m_event{ other.m_event }
+    {
+        other.m_event = nullptr;
+    }
+
+    KeyChangeNotification& operator=(KeyChangeNotification&& other) noexcept
+    {
+        if (&other != this)
+        {
+            Close();
+            m_event = other.m_event;
+            other.m_event = nullptr;
+        }
+        return *this;
+    }
+
+    // (Re)arm the notification on the given key, opened with KEY_NOTIFY access.
+    // The registration isn't tied to the calling thread.
+    [[nodiscard]] LSTATUS Arm(const HKEY hKey) noexcept
+    {
+        if (m_event == nullptr)
+        {
+            m_event = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);  // manual reset, not signaled
+            if (m_event == nullptr)
+            {
+                return static_cast<LSTATUS>(::GetLastError());
+            }
+        }
+        else
+        {
+            ::ResetEvent(m_event);
+        }
+
+        return CallRegNotifyChangeKeyValue(
+            hKey,
+            FALSE,  // only this key, not its subtree
+            REG_NOTIFY_CHANGE_LAST_SET | REG_NOTIFY_THREAD_AGNOSTIC,
+            m_event,
+            TRUE    // asynchronous
+        );
+    }
+
+    // Was the key changed since the notification was armed?
+    // A notification not armed (or closed) always reports a change.
+    [[nodiscard]] bool HasChanged() const noexcept
+    {
+        return (m_event == nullptr) || (::WaitForSingleObject(m_event, 0) == WAIT_OBJECT_0);
+    }
+
+    void Close() noexcept
+    {
+        if (m_event != nullptr)
+        {
+            ::CloseHandle(m_event);
+            m_event = nullptr;
+        }
+    }
+
+private:
+    HANDLE m_event{ nullptr };
+};
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+// A merged, cached view of the values of several registry keys (layers),
+// resolved by precedence: e.g. a policy setting read from HKCU, else from
+// HKLM, else a default.
+//
+// The first lookup reads all the values of all the layers (one enumeration
+// per layer), and merges them into a hash table: a lookup is then a single
+// probe, with no registry calls. Layer keys that don't exist are empty.
+//
+// Each layer key is watched with RegNotifyChangeKeyValue: Refresh checks the
+// event of each layer (no registry calls), and re-reads only the layers that
+// changed, or that were created or deleted. (The last write time of the keys
+// is not used: its resolution is the system timer tick, so a change made in
+// the same tick as a read would be missed.) Layers whose keys can't be
+// watched, e.g. on remote registries, are re-read by each Refresh.
+// With a refresh interval, lookups call Refresh by themselves at most once
+// per interval.
+//
+// The layer keys are opened in the given registry view: KEY_WOW64_64KEY
+// (the default, like for the RegKey constructors), KEY_WOW64_32KEY,
+// or 0 for the default view of the process.
+//
+// Value names are compared ignoring case, like the registry does.
+// REG_SZ lookups also accept REG_EXPAND_SZ values, returned unexpanded.
+//
+// Typical usage:
+//
+//   RegLayeredView policy{ {
+//       { HKEY_CURRENT_USER,  L"SOFTWARE\\Policies\\Contoso" },
+//       { HKEY_LOCAL_MACHINE, L"SOFTWARE\\Policies\\Contoso" },
+//   } };
+//   DWORD timeout = policy.GetValueOr<DWORD>(L"Timeout", 30);
+//
+// This class isn't thread-safe.
+//------------------------------------------------------------------------------
+class RegLayeredView
+{
+public:
+
+    // A value of the merged view, with the index of the layer it comes from
+    struct EffectiveValue
+    {
+        RegTree::ValuePtr Value;
+        size_t            LayerIndex{ 0 };
+    };
+
+    // Layers in precedence order: values of the first layers win.
+    // With a non-zero refresh interval, lookups call Refresh by themselves
+    // when the cache is older than the interval.
+    explicit RegLayeredView(std::vector<RegLayer> layers,
+                            std::chrono::milliseconds refreshInterval = std::chrono::milliseconds::zero(),
+                            REGSAM registryView = KEY_WOW64_64KEY);
+
+    // Number of layers
+    [[nodiscard]] size_t LayerCount() const noexcept;
+
+    // Return the effective value with the given name, or nullptr if no layer
+    // has it. The pointer is valid until the view is refreshed.
+    // Throw RegException if a layer can't be read.
+    [[nodiscard]] const EffectiveValue* Find(std::wstring_view valueName);
+
+    // Return the effective value converted to T (DWORD, ULONGLONG,
+    // std::wstring, std::vector<std::wstring> or std::vector<BYTE>).
+    // Throw RegException if no layer has the value, or if it has another type.
+    template <typename T>
+    [[nodiscard]] T GetValue(std::wstring_view valueName);
+
+    // Return the effective value converted to T, or defaultValue if no layer
+    // has it. Throw RegException if the value has another type.
+    template <typename T>
+    [[nodiscard]] T GetValueOr(std::wstring_view valueName, T defaultValue);
+
+    // Return the effective value converted to T, or an error:
+    // ERROR_FILE_NOT_FOUND if no layer has it, ERROR_UNSUPPORTED_TYPE if it
+    // has another type
+    template <typename T>
+    [[nodiscard]] RegExpected<T> TryGetValue(std::wstring_view valueName);
+
+    // Return all the effective values, sorted by name
+    [[nodiscard]] std::vector<EffectiveValue> EnumValues();
+
+    // Return the effective values that come from the given layer
+    // (i.e. the values of that layer not overridden by previous layers),
+    // sorted by name
+    [[nodiscard]] std::vector<EffectiveValue> EnumValues(size_t layerIndex);
+
+    // Re-read the layers that changed since they were read.
+    // Return true if any layer was re-read.
+    // Throw RegException on failure.
+    bool Refresh();
+
+    // Re-read the layers that changed since they were read
+    [[nodiscard]] RegExpected<bool> TryRefresh();
+
+    // Drop the cache: the next lookup reads all the layers again
+    void Invalidate() noexcept;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    struct Layer
+    {
+        RegLayer                       Location;
+        RegKey                         Key;             // invalid if the key doesn't exist
+        details::KeyChangeNotification Notification;    // armed before reading Values
+        std::vector<RegTree::ValuePtr> Values;
+    };
+
+    // Hash and compare value names ignoring case
+    struct NameHash
+    {
+        [[nodiscard]] size_t operator()(std::wstring_view name) const noexcept;
+    };
+
+    struct NameEqual
+    {
+        [[nodiscard]] bool operator()(std::wstring_view a, std::wstring_view b) const noexcept;
+    };
+
+    // Read the layers if not cached, or refresh them if the interval elapsed
+    void EnsureLoaded();
+
+    // (Re)read all the values of a layer, opening its key in the given view
+    [[nodiscard]] static LSTATUS LoadLayer(Layer& layer, REGSAM registryView);
+
+    // Rebuild the merged table from the layers
+    void Merge();
+
+    std::vector<Layer>         m_layers;
+    std::chrono::milliseconds  m_refreshInterval;
+    REGSAM                     m_registryView;
+    std::chrono::steady_clock::time_point m_lastRefresh{};
+    bool                       m_loaded{ false };
+
+    // The keys are views of the names of the mapped values
+    std::unordered_map<std::wstring_view, EffectiveValue, NameHash, NameEqual> m_merged;
+};
+
+
+//------------------------------------------------------------------------------
+//                      RegLayeredView Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegLayeredView::RegLayeredView(
+    std::vector<RegLayer> layers,
+    const std::chrono::milliseconds refreshInterval,
+    const REGSAM registryView
+)
+    : m_refreshInterval{ refreshInterval }
+    , m_registryView{ registryView }
+{
+    m_layers.reserve(layers.size());
+    for (auto& location : layers)
+    {
+        _ASSERTE(location.RootKey != nullptr);
+
+        Layer layer;
+        layer.Location = std::move(location);
+        m_layers.push_back(std::move(layer));
+    }
+}
+
+
+inline size_t RegLayeredView::LayerCount() const noexcept
+{
+    return m_layers.size();
+}
+
+
+inline const RegLayeredView::EffectiveValue* RegLayeredView::Find(const std::wstring_view valueName)
+{
+    EnsureLoaded();
+
+    const auto it = m_merged.find(valueName);
+    return (it != m_merged.end()) ? &(it->second) : nullptr;
+}
+
+
+template <typename T>
+inline T RegLayeredView::GetValue(const std::wstring_view valueName)
+{
+    RegExpected<T> result = TryGetValue<T>(valueName);
+    if (!result)
+    {
+        throw RegException{ result.GetError().Code(), "Cannot get the value from the layered view." };
+    }
+
+    return result.GetValue();
+}
+
+
+template <typename T>
+inline T RegLayeredView::GetValueOr(const std::wstring_view valueName, T defaultValue)
+{
+    const EffectiveValue* value = Find(valueName);
+    if (value == nullptr)
+    {
+        return defaultValue;
+    }
+
+    T result{};
+    LSTATUS retCode = details::DecodeValueData(*(value->Value), result);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get the value from the layered view." };
+    }
+
+    return result;
+}
+
+
+template <typename T>
+inline RegExpected<T> RegLayeredView::TryGetValue(const std::wstring_view valueName)
+{
+    const EffectiveValue* value = Find(valueName);
+    if (value == nullptr)
+    {
+        return details::MakeRegExpectedWithError<T>(ERROR_FILE_NOT_FOUND);
+    }
+
+    T result{};
+    LSTATUS retCode = details::DecodeValueData(*(value->Value), result);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<T>(retCode);
+    }
+
+    return RegExpected<T>{ std::move(result) };
+}
+
+
+inline std::vector<RegLayeredView::EffectiveValue> RegLayeredView::EnumValues()
+{
+    EnsureLoaded();
+
+    std::vector<EffectiveValue> values;
+    values.reserve(m_merged.size());
+    for (const auto& entry : m_merged)
+    {
+        values.push_back(entry.second);
+    }
+
+    std::sort(values.begin(), values.end(), [](const EffectiveValue& a, const EffectiveValue& b) {
+        return details::CompareStrings(a.Value->Name, b.Value->Name, StringComparison::IgnoreCase) < 0;
+    });
+
+    return values;
+}
+
+
+inline std::vector<RegLayeredView::EffectiveValue> RegLayeredView::EnumValues(const size_t layerIndex)
+{
+    _ASSERTE(layerIndex < m_layers.size());
+
+    std::vector<EffectiveValue> values = EnumValues();
+    values.erase(
+        std::remove_if(values.begin(), values.end(),
+            [layerIndex](const EffectiveValue& value) { return value.LayerIndex != layerIndex; }),
+        values.end()
+    );
+
+    return values;
+}
+
+
+inline bool RegLayeredView::Refresh()
+{
+    RegExpected<bool> result = TryRefresh();
+    if (!result)
+    {
+        throw RegException{ result.GetError().Code(), "Cannot refresh the layered view." };
+    }
+
+    return result.GetValue();
+}
+
+
+inline RegExpected<bool> RegLayeredView::TryRefresh()
+{
+    if (!m_loaded)
+    {
+        for (auto& layer : m_layers)
+        {
+            LSTATUS retCode = LoadLayer(layer, m_registryView);
+            if (retCode != ERROR_SUCCESS)
+            {
+                return details::MakeRegExpectedWithError<bool>(retCode);
+            }
+        }
+
+        Merge();
+        m_loaded = true;
+        m_lastRefresh = std::chrono::steady_clock::now();
+        return RegExpected<bool>{ true };
+    }
+
+    bool changed = false;
+    for (auto& layer : m_layers)
+    {
+        // A missing key is checked again: is it still missing?
+        // (Deleting a watched key signals its notification as well.)
+        if (layer.Key.IsValid() && !layer.Notification.HasChanged())
+        {
+            continue;
+        }
+
+        const bool wasEmpty = !layer.Key.IsValid() && layer.Values.empty();
+        LSTATUS retCode = LoadLayer(layer, m_registryView);
+        if (retCode != ERROR_SUCCESS)
+        {
+            // Keep the merged values in sync with the layers reloaded so far
+            if (changed)
+            {
+                Merge();
+            }
+            return details::MakeRegExpectedWithError<bool>(retCode);
+        }
+
+        if (!(wasEmpty && !layer.Key.IsValid()))
+        {
+            changed = true;
+        }
+    }
+
+    if (changed)
+    {
+        Merge();
+    }
+
+    // Set only on success, so that the next access retries a failed refresh
+    m_lastRefresh = std::chrono::steady_clock::now();
+    return RegExpected<bool>{ changed };
+}
+
+
+inline void RegLayeredView::Invalidate() noexcept
+{
+    m_merged.clear();
+    for (auto& layer : m_layers)
+    {
+        layer.Notification.Close();
+        layer.Key.Close();
+        layer.Values.clear();
+    }
+    m_loaded = false;
+}
+
+
+inline size_t RegLayeredView::NameHash::operator()(const std::wstring_view name) const noexcept
+{
+    return static_cast<size_t>(details::HashString(name, StringComparison::IgnoreCase));
+}
+
+
+inline bool RegLayeredView::NameEqual::operator()(
+    const std::wstring_view a,
+    const std::wstring_view b
+) const noexcept
+{
+    return details::EqualStrings(a, b, StringComparison::IgnoreCase);
+}
+
+
+inline void RegLayeredView::EnsureLoaded()
+{
+    const bool refreshDue = m_loaded
+        && (m_refreshInterval > std::chrono::milliseconds::zero())
+        && (std::chrono::steady_clock::now() - m_lastRefresh >= m_refreshInterval);
+
+    if (!m_loaded || refreshDue)
+    {
+        Refresh();
+    }
+}
+
+
+inline LSTATUS RegLayeredView::LoadLayer(Layer& layer, const REGSAM registryView)
+{
+    if (!layer.Key.IsValid())
+    {
+        // KEY_READ includes KEY_NOTIFY
+        RegResult retCode = layer.Key.TryOpen(
+            layer.Location.RootKey, layer.Location.SubKey, KEY_READ | registryView);
+        if (retCode.Code() == ERROR_FILE_NOT_FOUND)
+        {
+            // A missing key is an empty layer
+            layer.Notification.Close();
+            layer.Values.clear();
+            return ERROR_SUCCESS;
+        }
+        if (retCode.Failed())
+        {
+            return retCode.Code();
+        }
+    }
+
+    // Arm the notification before reading, so that a change made meanwhile
+    // is seen by the next Refresh. If the key can't be watched, the layer
+    // is read again by each Refresh.
+    if (layer.Notification.Arm(layer.Key.Get()) != ERROR_SUCCESS)
+    {
+        layer.Notification.Close();
+    }
+
+    LSTATUS retCode = details::ReadKeyValues(layer.Key.Get(), layer.Values);
+    if (retCode == ERROR_KEY_DELETED)
+    {
+        // The key was deleted: check whether it was created again
+        layer.Notification.Close();
+        layer.Key.Close();
+        return LoadLayer(layer, registryView);
+    }
+
+    return retCode;
+}
+
+
+inline void RegLayeredView::Merge()
+{
+    m_merged.clear();
+
+    // Layers are visited in precedence order: the first value with a name wins
+    for (size_t layerIndex = 0; layerIndex < m_layers.size(); layerIndex++)
+    {
+        for (const auto& value : m_layers[layerIndex].Values)
+        {
+            m_merged.try_emplace(value->Name, EffectiveValue{ value, layerIndex });
+        }
+    }
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGLAYEREDVIEW_HPP_INCLUDED
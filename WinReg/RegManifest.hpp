@@ -0,0 +1,646 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGMANIFEST_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGMANIFEST_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegManifest: a fixed set of registry values known at compile time, indexed
+// by a minimal perfect hash; RegManifestValues loads them from the registry.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "WinReg.hpp"       // RegKey
+
+#include <algorithm>        // std::find_if
+#include <array>            // std::array
+#include <cstdint>          // std::uint64_t
+#include <stdexcept>        // std::invalid_argument, std::logic_error
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <tuple>            // std::tuple, std::get
+#include <type_traits>      // std::integral_constant, std::remove_cv_t
+#include <utility>          // std::index_sequence, std::move
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// A registry value declared in a RegManifest
+//------------------------------------------------------------------------------
+struct RegManifestEntry
+{
+    std::wstring_view KeyPath;
+    std::wstring_view ValueName;
+    DWORD             Type{ REG_NONE };
+};
+
+
+//------------------------------------------------------------------------------
+// Map a registry type to the C++ type used to store its values
+// (unsupported registry types are rejected at compile time)
+//------------------------------------------------------------------------------
+template <DWORD Type>
+struct RegValueTypeTraits;
+
+template <>
+struct RegValueTypeTraits<REG_DWORD>
+{
+    using ValueType = DWORD;
+};
+
+template <>
+struct RegValueTypeTraits<REG_QWORD>
+{
+    using ValueType = ULONGLONG;
+};
+
+template <>
+struct RegValueTypeTraits<REG_SZ>
+{
+    using ValueType = std::wstring;
+};
+
+template <>
+struct RegValueTypeTraits<REG_EXPAND_SZ>
+{
+    using ValueType = std::wstring;
+};
+
+template <>
+struct RegValueTypeTraits<REG_MULTI_SZ>
+{
+    using ValueType = std::vector<std::wstring>;
+};
+
+template <>
+struct RegValueTypeTraits<REG_BINARY>
+{
+    using ValueType = std::vector<BYTE>;
+};
+
+
+//------------------------------------------------------------------------------
+// A fixed set of registry values, known at compile time.
+//
+// The constructor builds a minimal perfect hash over the (key path, value name)
+// pairs, so IndexOf maps a declared value to its position in the manifest with
+// one hash computation, two array reads and one final comparison.
+// When used in a constant expression, IndexOf costs nothing at run time.
+//
+// Key paths and value names are matched ignoring the case of ASCII letters.
+// Declaring the same value twice fails to compile (when the manifest is
+// constexpr). Manifests of several hundred values may need a higher
+// compiler limit for constant evaluation steps.
+//
+// Typical usage:
+//
+//   constexpr RegManifestEntry kConfigEntries[] = {
+//       { L"SOFTWARE\\Contoso", L"Timeout", REG_DWORD },
+//       { L"SOFTWARE\\Contoso", L"Server",  REG_SZ },
+//   };
+//   constexpr auto kConfig = MakeRegManifest(kConfigEntries);
+//
+//   RegManifestValues<kConfig> config;
+//   config.Load(HKEY_CURRENT_USER);
+//   DWORD timeout = config.Get<kConfig.IndexOf(L"SOFTWARE\\Contoso", L"Timeout")>();
+//------------------------------------------------------------------------------
+template <size_t N>
+class RegManifest
+{
+public:
+
+    static_assert(N > 0, "A RegManifest must declare at least one value.");
+
+    // Returned by IndexOf for values not in the manifest
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Build the manifest and its perfect hash
+    constexpr explicit RegManifest(const RegManifestEntry (&entries)[N]);
+
+    // Number of values in the manifest
+    [[nodiscard]] static constexpr size_t Size() noexcept;
+
+    // Access the declared values, in declaration order
+    [[nodiscard]] constexpr const RegManifestEntry& operator[](size_t index) const noexcept;
+
+    // Return the position of the given value in the manifest, or npos
+    [[nodiscard]] constexpr size_t IndexOf(std::wstring_view keyPath,
+                                           std::wstring_view valueName) const noexcept;
+
+    [[nodiscard]] constexpr bool Contains(std::wstring_view keyPath,
+                                          std::wstring_view valueName) const noexcept;
+
+private:
+    std::array<RegManifestEntry, N> m_entries{};
+
+    // Hash seed of each bucket
+    std::array<std::uint32_t, N> m_seeds{};
+
+    // Entry index stored in each slot of the hash table
+    std::array<std::uint32_t, N> m_slots{};
+};
+
+
+// Build a RegManifest from an array of entries, deducing its size
+template <size_t N>
+[[nodiscard]] constexpr RegManifest<N> MakeRegManifest(const RegManifestEntry (&entries)[N]);
+
+
+//------------------------------------------------------------------------------
+// The values declared in a RegManifest, loaded from the registry.
+//
+// Each value is stored with the C++ type matching its declared registry type
+// (see RegValueTypeTraits), and accessed by its manifest index with Get<Index>,
+// so type mismatches and undeclared values are compile-time errors.
+//
+// Loading opens each declared key once, and reads the values with the
+// RegKey::TryGetXxxValue methods.
+//------------------------------------------------------------------------------
+template <const auto& Manifest>
+class RegManifestValues
+{
+    using ManifestType = std::remove_cv_t<std::remove_reference_t<decltype(Manifest)>>;
+
+public:
+
+    // Number of values in the manifest
+    static constexpr size_t kSize = ManifestType::Size();
+
+    // Initialize with default values; nothing is loaded yet
+    RegManifestValues();
+
+    // Load all the values declared in the manifest, under the given root key;
+    // the declared keys are opened in the given registry view.
+    // Values that can't be read keep their previous content, and their status
+    // records the error. Throw RegException with the first error, after
+    // trying to load all the values.
+    void Load(HKEY rootKey, REGSAM registryView = KEY_WOW64_64KEY);
+
+    // Load all the values, returning the first error (if any)
+    [[nodiscard]] RegResult TryLoad(HKEY rootKey, REGSAM registryView = KEY_WOW64_64KEY);
+
+    // Access a value by its manifest index
+    template <size_t Index>
+    [[nodiscard]] const auto& Get() const noexcept;
+
+    // Was the value at the given index read by the last load?
+    [[nodiscard]] bool IsLoaded(size_t index) const noexcept;
+
+    // Result of reading the value at the given index in the last load
+    // (ERROR_FILE_NOT_FOUND if never loaded)
+    [[nodiscard]] RegResult Status(size_t index) const noexcept;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    template <size_t... Index>
+    static auto MakeStorage(std::index_sequence<Index...>)
+        -> std::tuple<typename RegValueTypeTraits<Manifest[Index].Type>::ValueType...>;
+
+    using Storage = decltype(MakeStorage(std::make_index_sequence<kSize>{}));
+
+    template <size_t Index>
+    [[nodiscard]] LSTATUS LoadValue(const RegKey& key);
+
+    template <size_t... Index>
+    [[nodiscard]] LSTATUS LoadAll(HKEY rootKey, REGSAM registryView, std::index_sequence<Index...>);
+
+    Storage                      m_values;
+    std::array<LSTATUS, kSize>   m_status;
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegManifest
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+// Fold ASCII letters to upper case (usable in constant expressions)
+[[nodiscard]] constexpr wchar_t FoldAsciiCase(const wchar_t ch) noexcept
+{
+    return ((ch >= L'a') && (ch <= L'z')) ? static_cast<wchar_t>(ch - (L'a' - L'A')) : ch;
+}
+
+
+[[nodiscard]] constexpr bool EqualAsciiIgnoreCase(const std::wstring_view a,
+                                                  const std::wstring_view b) noexcept
+{
+    if (a.length() != b.length())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.length(); i++)
+    {
+        if (FoldAsciiCase(a[i]) != FoldAsciiCase(b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Final mixing step of a 64-bit hash (from SplitMix64)
+[[nodiscard]] constexpr std::uint64_t MixHash(std::uint64_t hash) noexcept
+{
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+
+//------------------------------------------------------------------------------
+// Hash of a (key path, value name) pair, ignoring ASCII case (FNV-1a + mixing)
+//------------------------------------------------------------------------------
+[[nodiscard]] constexpr std::uint64_t ManifestNameHash(const std::wstring_view keyPath,
+                                                       const std::wstring_view valueName) noexcept
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+
+    for (const wchar_t ch : keyPath)
+    {
+        hash ^= static_cast<std::uint64_t>(FoldAsciiCase(ch));
+        hash *= 1099511628211ULL;
+    }
+
+    // Separate the key path from the value name
+    hash ^= 0xFFFFFFFFULL;
+    hash *= 1099511628211ULL;
+
+    for (const wchar_t ch : valueName)
+    {
+        hash ^= static_cast<std::uint64_t>(FoldAsciiCase(ch));
+        hash *= 1099511628211ULL;
+    }
+
+    return MixHash(hash);
+}
+
+
+// Derive the hash table slot hash from a name hash and a bucket seed
+[[nodiscard]] constexpr std::uint64_t ManifestSlotHash(const std::uint64_t nameHash,
+                                                       const std::uint32_t seed) noexcept
+{
+    return MixHash(nameHash ^ (static_cast<std::uint64_t>(seed) * 0x9E3779B97F4A7C15ULL));
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegManifest Inline Methods
+//------------------------------------------------------------------------------
+
+//
+// The perfect hash uses "hash and displace": entries are split into N buckets
+// by their name hash; then, starting from the largest buckets, a seed is
+// searched for each bucket that maps all its entries to free slots of the
+// N-slot table. Lookups hash the name, read the bucket seed, and find the
+// only candidate entry in the slot.
+//
+template <size_t N>
+inline constexpr RegManifest<N>::RegManifest(const RegManifestEntry (&entries)[N])
+{
+    // Give up on pathological inputs (never needed in practice)
+    constexpr std::uint32_t kMaxSeed = 1u << 20;
+
+    std::array<std::uint64_t, N> hashes{};
+    std::array<size_t, N> bucketSizes{};
+    size_t maxBucketSize = 0;
+
+    for (size_t i = 0; i < N; i++)
+    {
+        m_entries[i] = entries[i];
+        hashes[i] = details::ManifestNameHash(entries[i].KeyPath, entries[i].ValueName);
+
+        const size_t bucket = static_cast<size_t>(hashes[i] % N);
+        bucketSizes[bucket]++;
+        if (bucketSizes[bucket] > maxBucketSize)
+        {
+            maxBucketSize = bucketSizes[bucket];
+        }
+    }
+
+    // Group the entries by bucket
+    std::array<size_t, N + 1> bucketStart{};
+    for (size_t bucket = 0; bucket < N; bucket++)
+    {
+        bucketStart[bucket + 1] = bucketStart[bucket] + bucketSizes[bucket];
+    }
+
+    std::array<size_t, N> bucketFill{};
+    std::array<size_t, N> members{};
+    for (size_t i = 0; i < N; i++)
+    {
+        const size_t bucket = static_cast<size_t>(hashes[i] % N);
+        members[bucketStart[bucket] + bucketFill[bucket]] = i;
+        bucketFill[bucket]++;
+    }
+
+    // Reject duplicate declarations (they always share a bucket)
+    for (size_t bucket = 0; bucket < N; bucket++)
+    {
+        for (size_t a = bucketStart[bucket]; a < bucketStart[bucket + 1]; a++)
+        {
+            for (size_t b = a + 1; b < bucketStart[bucket + 1]; b++)
+            {
+                const size_t i = members[a];
+                const size_t j = members[b];
+                if ((hashes[i] == hashes[j])
+                    && details::EqualAsciiIgnoreCase(entries[i].KeyPath, entries[j].KeyPath)
+                    && details::EqualAsciiIgnoreCase(entries[i].ValueName, entries[j].ValueName))
+                {
+                    throw std::invalid_argument("Duplicate value in RegManifest.");
+                }
+            }
+        }
+    }
+
+    // Place the buckets, largest first
+    std::array<bool, N> usedSlots{};
+    for (size_t size = maxBucketSize; size > 0; size--)
+    {
+        for (size_t bucket = 0; bucket < N; bucket++)
+        {
+            if (bucketSizes[bucket] != size)
+            {
+                continue;
+            }
+
+            for (std::uint32_t seed = 1; ; seed++)
+            {
+                if (seed > kMaxSeed)
+                {
+                    throw std::logic_error("Cannot build the RegManifest perfect hash.");
+                }
+
+                // Tentatively take the slots of this bucket's entries
+                size_t placed = 0;
+                for (; placed < size; placed++)
+                {
+                    const size_t entry = members[bucketStart[bucket] + placed];
+                    const size_t slot =
+                        static_cast<size_t>(details::ManifestSlotHash(hashes[entry], seed) % N);
+                    if (usedSlots[slot])
+                    {
+                        break;
+                    }
+                    usedSlots[slot] = true;
+                    m_slots[slot] = static_cast<std::uint32_t>(entry);
+                }
+
+                if (placed == size)
+                {
+                    m_seeds[bucket] = seed;
+                    break;
+                }
+
+                // Collision: release the slots taken, and try the next seed
+                for (size_t k = 0; k < placed; k++)
+                {
+                    const size_t entry = members[bucketStart[bucket] + k];
+                    const size_t slot =
+                        static_cast<size_t>(details::ManifestSlotHash(hashes[entry], seed) % N);
+                    usedSlots[slot] = false;
+                }
+            }
+        }
+    }
+}
+
+
+template <size_t N>
+inline constexpr size_t RegManifest<N>::Size() noexcept
+{
+    return N;
+}
+
+
+template <size_t N>
+inline constexpr const RegManifestEntry& RegManifest<N>::operator[](const size_t index) const noexcept
+{
+    _ASSERTE(index < N);
+    return m_entries[index];
+}
+
+
+template <size_t N>
+inline constexpr size_t RegManifest<N>::IndexOf(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName
+) const noexcept
+{
+    const std::uint64_t hash = details::ManifestNameHash(keyPath, valueName);
+    const std::uint32_t seed = m_seeds[static_cast<size_t>(hash % N)];
+    const size_t index = m_slots[static_cast<size_t>(details::ManifestSlotHash(hash, seed) % N)];
+
+    // The slot holds the only possible match: check it
+    if (details::EqualAsciiIgnoreCase(m_entries[index].KeyPath, keyPath)
+        && details::EqualAsciiIgnoreCase(m_entries[index].ValueName, valueName))
+    {
+        return index;
+    }
+
+    return npos;
+}
+
+
+template <size_t N>
+inline constexpr bool RegManifest<N>::Contains(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName
+) const noexcept
+{
+    return IndexOf(keyPath, valueName) != npos;
+}
+
+
+template <size_t N>
+inline constexpr RegManifest<N> MakeRegManifest(const RegManifestEntry (&entries)[N])
+{
+    return RegManifest<N>{ entries };
+}
+
+
+//------------------------------------------------------------------------------
+//                      RegManifestValues Inline Methods
+//------------------------------------------------------------------------------
+
+template <const auto& Manifest>
+inline RegManifestValues<Manifest>::RegManifestValues()
+    : m_values{}
+{
+    m_status.fill(ERROR_FILE_NOT_FOUND);
+}
+
+
+template <const auto& Manifest>
+inline void RegManifestValues<Manifest>::Load(const HKEY rootKey, const REGSAM registryView)
+{
+    RegResult retCode = TryLoad(rootKey, registryView);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot load the values declared in the manifest." };
+    }
+}
+
+
+template <const auto& Manifest>
+inline RegResult RegManifestValues<Manifest>::TryLoad(const HKEY rootKey, const REGSAM registryView)
+{
+    return RegResult{ LoadAll(rootKey, registryView, std::make_index_sequence<kSize>{}) };
+}
+
+
+template <const auto& Manifest>
+template <size_t Index>
+inline const auto& RegManifestValues<Manifest>::Get() const noexcept
+{
+    static_assert(Index < kSize, "The value is not declared in the manifest.");
+    return std::get<Index>(m_values);
+}
+
+
+template <const auto& Manifest>
+inline bool RegManifestValues<Manifest>::IsLoaded(const size_t index) const noexcept
+{
+    _ASSERTE(index < kSize);
+    return m_status[index] == ERROR_SUCCESS;
+}
+
+
+template <const auto& Manifest>
+inline RegResult RegManifestValues<Manifest>::Status(const size_t index) const noexcept
+{
+    _ASSERTE(index < kSize);
+    return RegResult{ m_status[index] };
+}
+
+
+template <const auto& Manifest>
+template <size_t Index>
+inline LSTATUS RegManifestValues<Manifest>::LoadValue(const RegKey& key)
+{
+    constexpr DWORD type = Manifest[Index].Type;
+    const std::wstring valueName{ Manifest[Index].ValueName };
+
+    auto assign = [this](auto&& result) -> LSTATUS
+    {
+        if (!result.IsValid())
+        {
+            return result.GetError().Code();
+        }
+        std::get<Index>(m_values) = result.GetValue();
+        return ERROR_SUCCESS;
+    };
+
+    if constexpr (type == REG_DWORD)
+    {
+        return assign(key.TryGetDwordValue(valueName));
+    }
+    else if constexpr (type == REG_QWORD)
+    {
+        return assign(key.TryGetQwordValue(valueName));
+    }
+    else if constexpr (type == REG_SZ)
+    {
+        return assign(key.TryGetStringValue(valueName));
+    }
+    else if constexpr (type == REG_EXPAND_SZ)
+    {
+        return assign(key.TryGetExpandStringValue(valueName));
+    }
+    else if constexpr (type == REG_MULTI_SZ)
+    {
+        return assign(key.TryGetMultiStringValue(valueName));
+    }
+    else
+    {
+        static_assert(type == REG_BINARY, "Unsupported registry type in the manifest.");
+        return assign(key.TryGetBinaryValue(valueName));
+    }
+}
+
+
+template <const auto& Manifest>
+template <size_t... Index>
+inline LSTATUS RegManifestValues<Manifest>::LoadAll(const HKEY rootKey,
+                                                    const REGSAM registryView,
+                                                    std::index_sequence<Index...>)
+{
+    // Each declared key is opened once, and reused for all its values
+    struct OpenedKey
+    {
+        std::wstring_view Path;
+        RegKey            Key;
+        LSTATUS           OpenResult;
+    };
+    std::vector<OpenedKey> openedKeys;
+
+    LSTATUS firstError = ERROR_SUCCESS;
+
+    auto loadValue = [&](auto indexConstant)
+    {
+        constexpr size_t index = decltype(indexConstant)::value;
+        const std::wstring_view keyPath = Manifest[index].KeyPath;
+
+        auto opened = std::find_if(openedKeys.begin(), openedKeys.end(),
+            [keyPath](const OpenedKey& k) { return details::EqualAsciiIgnoreCase(k.Path, keyPath); });
+        if (opened == openedKeys.end())
+        {
+            RegKey key;
+            const RegResult openResult = key.TryOpen(rootKey, std::wstring{ keyPath }, KEY_READ | registryView);
+            openedKeys.push_back(OpenedKey{ keyPath, std::move(key), openResult.Code() });
+            opened = openedKeys.end() - 1;
+        }
+
+        LSTATUS retCode = opened->OpenResult;
+        if (retCode == ERROR_SUCCESS)
+        {
+            retCode = this->template LoadValue<index>(opened->Key);
+        }
+
+        m_status[index] = retCode;
+        if ((retCode != ERROR_SUCCESS) && (firstError == ERROR_SUCCESS))
+        {
+            firstError = retCode;
+        }
+    };
+
+    (loadValue(std::integral_constant<size_t, Index>{}), ...);
+
+    return firstError;
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGMANIFEST_HPP_INCLUDED
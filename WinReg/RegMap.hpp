@@ -0,0 +1,984 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGMAP_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGMAP_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegMap<T>: a std::map-like view of the values of type T under a registry key,
+// with a read-through, write-back cache.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegTree.hpp"      // RegTree
+
+#include <algorithm>        // std::lower_bound
+#include <cstddef>          // std::ptrdiff_t
+#include <cstring>          // std::memcpy
+#include <iterator>         // std::forward_iterator_tag
+#include <map>              // std::map
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <type_traits>      // std::is_same_v
+#include <utility>          // std::move, std::pair
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// A std::map-like view of the values of type T under a registry key,
+// with a read-through, write-back cache.
+//
+// T is the C++ type of one of the supported registry types: DWORD (REG_DWORD),
+// ULONGLONG (REG_QWORD), std::wstring (REG_SZ), std::vector<std::wstring>
+// (REG_MULTI_SZ) or std::vector<BYTE> (REG_BINARY). Values of other types
+// under the key are not part of the map: in particular, REG_EXPAND_SZ values
+// are not part of a RegMap<std::wstring>, both for lookups and iteration.
+//
+// A value is read from the registry the first time it's looked up, then
+// served from the cache (values found missing are cached as well).
+// Assignments and erasures only update the cache: Commit writes all the
+// pending changes in one batch, and the destructor commits what's left
+// (ignoring errors; call Commit to get them).
+//
+// Changes made by others after a value was cached are seen after Refresh,
+// that reads the values of the key again and compares them with the cached
+// ones (keeping pending changes). The last write time of the key is not used
+// to detect changes: its resolution is the system timer tick (about 15.6 ms),
+// so a change made in the same tick as our read would be missed.
+//
+// Names are compared ignoring case, like the registry does, and lookups
+// take a std::wstring_view, so no std::wstring is built for cached values.
+//
+// Typical usage:
+//
+//   RegMap<DWORD> settings{ key };
+//   settings[L"Timeout"] = 30;
+//   DWORD retries = settings[L"Retries"];   // DWORD{} if missing
+//   settings.erase(L"Legacy");
+//   settings.Commit();
+//
+// Like the standard containers, this class isn't thread-safe.
+//------------------------------------------------------------------------------
+template <typename T>
+class RegMap
+{
+    // Cache state of a value
+    enum class EntryState
+    {
+        Clean,      // same as in the registry
+        Dirty,      // assigned, to be written
+        Erased,     // erased, to be deleted
+        Missing     // not in the registry
+    };
+
+    struct Entry
+    {
+        T          Value{};
+        EntryState State{ EntryState::Missing };
+    };
+
+    // Compare names ignoring case, accepting any string type convertible
+    // to std::wstring_view (heterogeneous lookup)
+    struct NameLess
+    {
+        using is_transparent = void;
+
+        [[nodiscard]] bool operator()(std::wstring_view a, std::wstring_view b) const noexcept;
+    };
+
+    using Cache = std::map<std::wstring, Entry, NameLess>;
+
+public:
+
+    using key_type    = std::wstring;
+    using mapped_type = T;
+
+    // (name, value) pairs seen by iteration
+    using value_type  = std::pair<const std::wstring&, const T&>;
+
+    // Iterate over the values in the map, in case-insensitive name order
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = RegMap::value_type;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = value_type;
+
+        // Holds the pair returned by operator->
+        struct pointer
+        {
+            value_type Pair;
+            [[nodiscard]] const value_type* operator->() const noexcept { return &Pair; }
+        };
+
+        const_iterator() = default;
+
+        [[nodiscard]] reference operator*() const noexcept;
+        [[nodiscard]] pointer operator->() const noexcept;
+
+        const_iterator& operator++() noexcept;
+        const_iterator operator++(int) noexcept;
+
+        [[nodiscard]] bool operator==(const const_iterator& other) const noexcept;
+        [[nodiscard]] bool operator!=(const const_iterator& other) const noexcept;
+
+    private:
+        friend class RegMap;
+
+        using CacheIterator = typename Cache::const_iterator;
+
+        const_iterator(CacheIterator it, CacheIterator end) noexcept;
+
+        // Skip the erased and missing entries
+        void SkipAbsent() noexcept;
+
+        CacheIterator m_it{};
+        CacheIterator m_end{};
+    };
+
+    using iterator = const_iterator;
+
+    // Returned by operator[]: reads or assigns the value with the given name.
+    // Holds a copy of the name, so it can be stored and used later.
+    class ValueReference
+    {
+    public:
+        ValueReference& operator=(const T& value);
+        ValueReference& operator=(T&& value);
+        ValueReference& operator=(const ValueReference& other);
+
+        // The value, or T{} if there is no value with this name
+        // (reading doesn't add the value to the map)
+        [[nodiscard]] operator T() const;
+
+    private:
+        friend class RegMap;
+
+        ValueReference(RegMap& map, std::wstring name);
+
+        RegMap&      m_map;
+        std::wstring m_name;
+    };
+
+    // Access the values under the given key
+    // (not owned: it must outlive this object)
+    explicit RegMap(RegKey& key) noexcept;
+
+    // Commit the pending changes, ignoring errors
+    ~RegMap() noexcept;
+
+    // Ban copy
+    RegMap(const RegMap&) = delete;
+    RegMap& operator=(const RegMap&) = delete;
+
+    // Find the value with the given name, reading it from the registry
+    // if not cached. Returns end() if not found.
+    [[nodiscard]] const_iterator find(std::wstring_view name);
+
+    // Is there a value with the given name?
+    [[nodiscard]] bool contains(std::wstring_view name);
+
+    // Read or assign the value with the given name, e.g. map[L"Timeout"] = 30
+    [[nodiscard]] ValueReference operator[](std::wstring_view name);
+
+    // Assign a value, adding it if not present
+    const_iterator insert_or_assign(std::wstring_view name, T value);
+
+    // Remove the value with the given name (if present)
+    void erase(std::wstring_view name);
+
+    // Iterate over all the values of type T under the key
+    // (loading the ones not cached yet)
+    [[nodiscard]] const_iterator begin();
+    [[nodiscard]] const_iterator end() const noexcept;
+
+    // Read all the values of type T not cached yet
+    void Load();
+
+    // Write the pending changes (assigned and erased values).
+    // All the changes are attempted; throw RegException with the first error.
+    void Commit();
+
+    // Write the pending changes, returning the first error (if any)
+    [[nodiscard]] RegResult TryCommit();
+
+    // Are there changes not committed yet?
+    [[nodiscard]] bool IsDirty() const noexcept;
+
+    // Read all the values of type T from the registry, with one enumeration,
+    // and replace the cached values with them; pending changes are kept.
+    // Returns true if any cached value differed from the registry
+    // (changed, added or deleted by others).
+    bool Refresh();
+
+    // Drop all the cached values, including the pending changes
+    void Discard() noexcept;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Return the cache entry for the given name, reading the value from
+    // the registry if not cached
+    [[nodiscard]] typename Cache::iterator Lookup(std::wstring_view name);
+
+    // Return the cache entry for the given name, adding it if needed
+    // (without reading the registry)
+    [[nodiscard]] typename Cache::iterator Slot(std::wstring_view name);
+
+    // Read all the values of type T under the key, as Clean entries
+    [[nodiscard]] Cache ReadAll() const;
+
+    RegKey&  m_key;
+    Cache    m_cache;
+    bool     m_loaded{ false };         // all the values were read by Load
+    size_t   m_pendingChanges{ 0 };     // number of Dirty and Erased entries
+};
+
+
+//------------------------------------------------------------------------------
+//                      Private Helpers for RegMap
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Registry type of the values stored in a RegMap<T>
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] constexpr DWORD RegMapValueType() noexcept
+{
+    if constexpr (std::is_same_v<T, DWORD>)
+    {
+        return REG_DWORD;
+    }
+    else if constexpr (std::is_same_v<T, ULONGLONG>)
+    {
+        return REG_QWORD;
+    }
+    else if constexpr (std::is_same_v<T, std::wstring>)
+    {
+        return REG_SZ;
+    }
+    else if constexpr (std::is_same_v<T, std::vector<std::wstring>>)
+    {
+        return REG_MULTI_SZ;
+    }
+    else
+    {
+        static_assert(std::is_same_v<T, std::vector<BYTE>>, "Unsupported RegMap value type.");
+        return REG_BINARY;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Read a RegMap<T> value with the matching RegKey::TryGetXxxValue method
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline RegExpected<T> TryReadMapValue(const RegKey& key, const std::wstring& valueName)
+{
+    constexpr DWORD type = RegMapValueType<T>();
+
+    if constexpr (type == REG_DWORD)
+    {
+        return key.TryGetDwordValue(valueName);
+    }
+    else if constexpr (type == REG_QWORD)
+    {
+        return key.TryGetQwordValue(valueName);
+    }
+    else if constexpr (type == REG_SZ)
+    {
+        // Without RRF_NOEXPAND, RegGetValue would return REG_EXPAND_SZ values
+        // (expanded) as well: only REG_SZ values are part of a RegMap<std::wstring>
+        std::wstring value;
+        const LSTATUS retCode = GetStringValueAt(
+            key.Get(), std::wstring{}, valueName, RRF_RT_REG_SZ | RRF_NOEXPAND, value);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return MakeRegExpectedWithError<std::wstring>(retCode);
+        }
+        return RegExpected<std::wstring>{ std::move(value) };
+    }
+    else if constexpr (type == REG_MULTI_SZ)
+    {
+        return key.TryGetMultiStringValue(valueName);
+    }
+    else
+    {
+        return key.TryGetBinaryValue(valueName);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Write a RegMap<T> value with the matching RegKey::TrySetXxxValue method
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline RegResult TryWriteMapValue(RegKey& key, const std::wstring& valueName, const T& value)
+{
+    constexpr DWORD type = RegMapValueType<T>();
+
+    if constexpr (type == REG_DWORD)
+    {
+        return key.TrySetDwordValue(valueName, value);
+    }
+    else if constexpr (type == REG_QWORD)
+    {
+        return key.TrySetQwordValue(valueName, value);
+    }
+    else if constexpr (type == REG_SZ)
+    {
+        return key.TrySetStringValue(valueName, value);
+    }
+    else if constexpr (type == REG_MULTI_SZ)
+    {
+        return key.TrySetMultiStringValue(valueName, value);
+    }
+    else
+    {
+        return key.TrySetBinaryValue(valueName, value);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Read all the values of a key (names, types and data),
+// replacing the content of 'values'.
+// On failure, 'values' is left unchanged.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS ReadKeyValues(const HKEY hKey, std::vector<RegTree::ValuePtr>& values)
+{
+    std::vector<RegTree::ValuePtr> keyValues;
+
+    // The values of the key are stored together
+    RegTree::ValueArena valueArena;
+
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    DWORD maxValueDataLen = 0;
+    LSTATUS retCode = TracedRegQueryInfoKeyW(
+        __func__,
+        hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        nullptr,    // no subkey count
+        nullptr,    // no subkey max length
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        &maxValueDataLen,
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    // One RegEnumValue call per value, reusing the same buffers
+    std::vector<wchar_t> nameBuffer(static_cast<size_t>(maxValueNameLen) + 1);
+    std::vector<BYTE> dataBuffer(maxValueDataLen);
+    keyValues.reserve(valueCount);
+
+    for (DWORD index = 0; index < valueCount; )
+    {
+        DWORD valueNameLen = static_cast<DWORD>(nameBuffer.size());
+        DWORD valueType = REG_NONE;
+        DWORD dataSize = static_cast<DWORD>(dataBuffer.size());
+        retCode = TracedRegEnumValueW(
+            __func__,
+            hKey,
+            index,
+            nameBuffer.data(),
+            &valueNameLen,
+            nullptr,    // reserved
+            &valueType,
+            dataBuffer.empty() ? nullptr : dataBuffer.data(),
+            &dataSize
+        );
+        if ((retCode == ERROR_SUCCESS) && (dataSize > dataBuffer.size()))
+        {
+            // With a null data pointer the call succeeds and only reports the size:
+            // the value gained data since RegQueryInfoKey
+            retCode = ERROR_MORE_DATA;
+        }
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // The value changed since RegQueryInfoKey: grow the buffers and retry
+            nameBuffer.resize(nameBuffer.size() * 2);
+            if (dataSize > dataBuffer.size())
+            {
+                dataBuffer.resize(dataSize);
+            }
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Values were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        keyValues.push_back(valueArena.Store(std::wstring_view{ nameBuffer.data(), valueNameLen },
+                                             valueType, dataBuffer.data(), dataSize));
+
+        index++;
+    }
+
+    values = std::move(keyValues);
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Convert the raw data of a value to T (one of the RegMap value types).
+// REG_EXPAND_SZ values are accepted as strings, and returned unexpanded.
+// Returns ERROR_UNSUPPORTED_TYPE if the value has another type.
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline LSTATUS DecodeValueData(const RegTree::Value& value, T& result)
+{
+    constexpr DWORD type = RegMapValueType<T>();
+
+    const bool typeMatches = (value.Type == type)
+        || ((type == REG_SZ) && (value.Type == REG_EXPAND_SZ));
+    if (!typeMatches)
+    {
+        return ERROR_UNSUPPORTED_TYPE;
+    }
+
+    const BYTE* const data = value.Data;
+    const size_t dataSize = value.DataSize;
+
+    if constexpr ((type == REG_DWORD) || (type == REG_QWORD))
+    {
+        if (dataSize != sizeof(T))
+        {
+            return ERROR_INVALID_DATA;
+        }
+        std::memcpy(&result, data, sizeof(T));
+    }
+    else if constexpr (type == REG_SZ)
+    {
+        result.resize(dataSize / sizeof(wchar_t));
+        if (!result.empty())
+        {
+            std::memcpy(result.data(), data, result.size() * sizeof(wchar_t));
+        }
+
+        // Drop the terminating NUL, like RegGetValue does
+        if (!result.empty() && (result.back() == L'\0'))
+        {
+            result.pop_back();
+        }
+    }
+    else if constexpr (type == REG_MULTI_SZ)
+    {
+        std::vector<wchar_t> multiString(dataSize / sizeof(wchar_t));
+        if (!multiString.empty())
+        {
+            std::memcpy(multiString.data(), data, multiString.size() * sizeof(wchar_t));
+        }
+
+        // Add the terminating NULs that are missing, like RegGetValue does
+        while (!IsDoubleNullTerminated(multiString))
+        {
+            multiString.push_back(L'\0');
+        }
+        result = ParseMultiString(multiString);
+    }
+    else
+    {
+        result.assign(data, data + dataSize);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                          RegMap Inline Methods
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline bool RegMap<T>::NameLess::operator()(
+    const std::wstring_view a,
+    const std::wstring_view b
+) const noexcept
+{
+    return details::CompareStrings(a, b, StringComparison::IgnoreCase) < 0;
+}
+
+
+template <typename T>
+inline RegMap<T>::const_iterator::const_iterator(const CacheIterator it, const CacheIterator end) noexcept
+    : m_it{ it }
+    , m_end{ end }
+{
+}
+
+
+template <typename T>
+inline typename RegMap<T>::const_iterator::reference RegMap<T>::const_iterator::operator*() const noexcept
+{
+    return value_type{ m_it->first, m_it->second.Value };
+}
+
+
+template <typename T>
+inline typename RegMap<T>::const_iterator::pointer RegMap<T>::const_iterator::operator->() const noexcept
+{
+    return pointer{ **this };
+}
+
+
+template <typename T>
+inline typename RegMap<T>::const_iterator& RegMap<T>::const_iterator::operator++() noexcept
+{
+    ++m_it;
+    SkipAbsent();
+    return *this;
+}
+
+
+template <typename T>
+inline typename RegMap<T>::const_iterator RegMap<T>::const_iterator::operator++(int) noexcept
+{
+    const_iterator previous = *this;
+    ++(*this);
+    return previous;
+}
+
+
+template <typename T>
+inline bool RegMap<T>::const_iterator::operator==(const const_iterator& other) const noexcept
+{
+    return m_it == other.m_it;
+}
+
+
+template <typename T>
+inline bool RegMap<T>::const_iterator::operator!=(const const_iterator& other) const noexcept
+{
+    return m_it != other.m_it;
+}
+
+
+template <typename T>
+inline void RegMap<T>::const_iterator::SkipAbsent() noexcept
+{
+    while ((m_it != m_end)
+           && ((m_it->second.State == EntryState::Erased) || (m_it->second.State == EntryState::Missing)))
+    {
+        ++m_it;
+    }
+}
+
+
+template <typename T>
+inline RegMap<T>::ValueReference::ValueReference(RegMap& map, std::wstring name)
+    : m_map{ map }
+    , m_name{ std::move(name) }
+{
+}
+
+
+template <typename T>
+inline typename RegMap<T>::ValueReference& RegMap<T>::ValueReference::operator=(const T& value)
+{
+    m_map.insert_or_assign(m_name, value);
+    return *this;
+}
+
+
+template <typename T>
+inline typename RegMap<T>::ValueReference& RegMap<T>::ValueReference::operator=(T&& value)
+{
+    m_map.insert_or_assign(m_name, std::move(value));
+    return *this;
+}
+
+
+template <typename T>
+inline typename RegMap<T>::ValueReference&
+    RegMap<T>::ValueReference::operator=(const ValueReference& other)
+{
+    return *this = static_cast<T>(other);
+}
+
+
+template <typename T>
+inline RegMap<T>::ValueReference::operator T() const
+{
+    const auto it = m_map.find(m_name);
+    return (it != m_map.end()) ? it->second : T{};
+}
+
+
+template <typename T>
+inline RegMap<T>::RegMap(RegKey& key) noexcept
+    : m_key{ key }
+{
+    _ASSERTE(key.IsValid());
+}
+
+
+template <typename T>
+inline RegMap<T>::~RegMap() noexcept
+{
+    try
+    {
+        (void)TryCommit();
+    }
+    catch (...)
+    {
+        // Changes not written are lost: call Commit to get the errors
+    }
+}
+
+
+template <typename T>
+inline typename RegMap<T>::const_iterator RegMap<T>::find(const std::wstring_view name)
+{
+    const auto it = Lookup(name);
+    if ((it->second.State == EntryState::Erased) || (it->second.State == EntryState::Missing))
+    {
+        return end();
+    }
+
+    return const_iterator{ it, m_cache.end() };
+}
+
+
+template <typename T>
+inline bool RegMap<T>::contains(const std::wstring_view name)
+{
+    return find(name) != end();
+}
+
+
+template <typename T>
+inline typename RegMap<T>::ValueReference RegMap<T>::operator[](const std::wstring_view name)
+{
+    return ValueReference{ *this, std::wstring{ name } };
+}
+
+
+template <typename T>
+inline typename RegMap<T>::const_iterator RegMap<T>::insert_or_assign(const std::wstring_view name, T value)
+{
+    const auto it = Slot(name);
+    Entry& entry = it->second;
+
+    if ((entry.State != EntryState::Dirty) && (entry.State != EntryState::Erased))
+    {
+        ++m_pendingChanges;
+    }
+
+    entry.Value = std::move(value);
+    entry.State = EntryState::Dirty;
+
+    return const_iterator{ it, m_cache.end() };
+}
+
+
+template <typename T>
+inline void RegMap<T>::erase(const std::wstring_view name)
+{
+    auto it = m_cache.find(name);
+    if (it == m_cache.end())
+    {
+        if (m_loaded)
+        {
+            // Not in the registry
+            return;
+        }
+
+        // Delete it on commit, without reading it first
+        it = Slot(name);
+    }
+    else if ((it->second.State == EntryState::Erased) || (it->second.State == EntryState::Missing))
+    {
+        return;
+    }
+
+    Entry& entry = it->second;
+    if (entry.State != EntryState::Dirty)
+    {
+        ++m_pendingChanges;
+    }
+
+    entry.Value = T{};
+    entry.State = EntryState::Erased;
+}
+
+
+template <typename T>
+inline typename RegMap<T>::const_iterator RegMap<T>::begin()
+{
+    Load();
+
+    const_iterator it{ m_cache.begin(), m_cache.end() };
+    it.SkipAbsent();
+    return it;
+}
+
+
+template <typename T>
+inline typename RegMap<T>::const_iterator RegMap<T>::end() const noexcept
+{
+    return const_iterator{ m_cache.end(), m_cache.end() };
+}
+
+
+template <typename T>
+inline void RegMap<T>::Load()
+{
+    if (m_loaded)
+    {
+        return;
+    }
+
+    // Values already cached (or with pending changes) are kept
+    Cache values = ReadAll();
+    m_cache.merge(values);
+
+    m_loaded = true;
+}
+
+
+template <typename T>
+inline void RegMap<T>::Commit()
+{
+    RegResult retCode = TryCommit();
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot commit the changes to the registry values." };
+    }
+}
+
+
+template <typename T>
+inline RegResult RegMap<T>::TryCommit()
+{
+    if (m_pendingChanges == 0)
+    {
+        return RegResult{ ERROR_SUCCESS };
+    }
+
+    LSTATUS firstError = ERROR_SUCCESS;
+
+    for (auto& [valueName, entry] : m_cache)
+    {
+        LSTATUS retCode = ERROR_SUCCESS;
+
+        if (entry.State == EntryState::Dirty)
+        {
+            retCode = details::TryWriteMapValue(m_key, valueName, entry.Value).Code();
+            if (retCode == ERROR_SUCCESS)
+            {
+                entry.State = EntryState::Clean;
+                --m_pendingChanges;
+            }
+        }
+        else if (entry.State == EntryState::Erased)
+        {
+            retCode = m_key.TryDeleteValue(valueName).Code();
+            if ((retCode == ERROR_SUCCESS) || (retCode == ERROR_FILE_NOT_FOUND))
+            {
+                retCode = ERROR_SUCCESS;
+                entry.State = EntryState::Missing;
+                --m_pendingChanges;
+            }
+        }
+
+        if ((retCode != ERROR_SUCCESS) && (firstError == ERROR_SUCCESS))
+        {
+            firstError = retCode;
+        }
+    }
+
+    return RegResult{ firstError };
+}
+
+
+template <typename T>
+inline bool RegMap<T>::IsDirty() const noexcept
+{
+    return m_pendingChanges != 0;
+}
+
+
+template <typename T>
+inline bool RegMap<T>::Refresh()
+{
+    Cache values = ReadAll();
+    bool changed = false;
+
+    // Compare the cached values with the registry; pending changes are kept
+    for (auto it = m_cache.begin(); it != m_cache.end(); )
+    {
+        Entry& entry = it->second;
+        if ((entry.State == EntryState::Dirty) || (entry.State == EntryState::Erased))
+        {
+            values.erase(it->first);
+            ++it;
+            continue;
+        }
+
+        const auto current = values.find(it->first);
+        if (current == values.end())
+        {
+            // Deleted by others (or still missing)
+            changed = changed || (entry.State == EntryState::Clean);
+            it = m_cache.erase(it);
+            continue;
+        }
+
+        if ((entry.State == EntryState::Missing) || !(entry.Value == current->second.Value))
+        {
+            changed = true;
+            entry.Value = std::move(current->second.Value);
+            entry.State = EntryState::Clean;
+        }
+        values.erase(current);
+        ++it;
+    }
+
+    // The values left were not cached: after Load, they were added by others
+    changed = changed || (m_loaded && !values.empty());
+    m_cache.merge(values);
+    m_loaded = true;
+
+    return changed;
+}
+
+
+template <typename T>
+inline void RegMap<T>::Discard() noexcept
+{
+    m_cache.clear();
+    m_loaded = false;
+    m_pendingChanges = 0;
+}
+
+
+template <typename T>
+inline typename RegMap<T>::Cache::iterator RegMap<T>::Lookup(const std::wstring_view name)
+{
+    auto it = m_cache.find(name);
+    if (it != m_cache.end())
+    {
+        return it;
+    }
+
+    Entry entry;
+
+    // After Load, values not cached are not in the registry
+    std::wstring valueName{ name };
+    if (!m_loaded)
+    {
+        const RegExpected<T> value = details::TryReadMapValue<T>(m_key, valueName);
+        if (value)
+        {
+            entry.Value = value.GetValue();
+            entry.State = EntryState::Clean;
+        }
+        else
+        {
+            // Values of other types are not part of the map
+            const LSTATUS retCode = value.GetError().Code();
+            if ((retCode != ERROR_FILE_NOT_FOUND) && (retCode != ERROR_UNSUPPORTED_TYPE))
+            {
+                throw RegException{ retCode, "Cannot read the registry value." };
+            }
+        }
+    }
+
+    return m_cache.emplace(std::move(valueName), std::move(entry)).first;
+}
+
+
+template <typename T>
+inline typename RegMap<T>::Cache::iterator RegMap<T>::Slot(const std::wstring_view name)
+{
+    auto it = m_cache.find(name);
+    if (it == m_cache.end())
+    {
+        it = m_cache.emplace(std::wstring{ name }, Entry{}).first;
+    }
+    return it;
+}
+
+
+template <typename T>
+inline typename RegMap<T>::Cache RegMap<T>::ReadAll() const
+{
+    // Read the names, types and data in a single enumeration
+    std::vector<RegTree::ValuePtr> values;
+    const LSTATUS retCode = details::ReadKeyValues(m_key.Get(), values);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot read the registry values." };
+    }
+
+    // Only the values of the exact type are part of the map
+    // (e.g. not REG_EXPAND_SZ values in a RegMap<std::wstring>)
+    constexpr DWORD type = details::RegMapValueType<T>();
+    Cache result;
+    for (const RegTree::ValuePtr& value : values)
+    {
+        if (value->Type != type)
+        {
+            continue;
+        }
+
+        Entry entry;
+        const LSTATUS decodeError = details::DecodeValueData(*value, entry.Value);
+        if (decodeError != ERROR_SUCCESS)
+        {
+            throw RegException{ decodeError, "Cannot read the registry value." };
+        }
+        entry.State = EntryState::Clean;
+
+        result.emplace(value->Name, std::move(entry));
+    }
+
+    return result;
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGMAP_HPP_INCLUDED
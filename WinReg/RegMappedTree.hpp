@@ -0,0 +1,734 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGMAPPEDTREE_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGMAPPEDTREE_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegMappedTree: a read-only registry tree stored in a single file, and served
+// directly from a memory mapping of that file.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegTree.hpp"      // RegTree
+
+#include <algorithm>        // std::sort, std::lower_bound, std::copy_n
+#include <cstdint>          // std::uint32_t, std::uint64_t
+#include <cstring>          // std::memcpy
+#include <limits>           // std::numeric_limits
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <utility>          // std::move, std::pair, std::swap
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// A read-only registry tree stored in a single file, and served directly from
+// a memory mapping of that file.
+//
+// The file holds one entry per key and per value, sorted by (case-folded key
+// path, case-folded value name), followed by an index of entry offsets.
+// Opening the file only maps it and checks its header, so the startup cost
+// doesn't depend on the store size; lookups are binary searches on the index,
+// and the returned names and data point straight into the mapping.
+//
+// The file is never modified in place: Write builds a complete new image in a
+// temporary file and atomically renames it over the old one, so a crash leaves
+// either the old or the new tree, and there are no holes to compact.
+// Use ToTree to get an editable RegTree, and Write to store it back.
+//
+// Open shares the file for reading only (no FILE_SHARE_DELETE): while a store
+// is open, in this process or in another one, nobody can rename or delete the
+// file, so the mapped data can't change under the readers. That includes
+// Write, so close all the instances of a store before writing it.
+//------------------------------------------------------------------------------
+class RegMappedTree
+{
+public:
+
+    // A value stored in the mapped file.
+    // The views and the data pointer are valid as long as the file is open.
+    struct Value
+    {
+        std::wstring_view KeyPath;
+        std::wstring_view Name;
+        DWORD             Type{ REG_NONE };
+        const BYTE*       Data{ nullptr };
+        DWORD             DataSize{ 0 };
+    };
+
+    // Initialize as a closed store
+    RegMappedTree() noexcept = default;
+
+    // Unmap and close the file
+    ~RegMappedTree() noexcept;
+
+    // Ban copy
+    RegMappedTree(const RegMappedTree&) = delete;
+    RegMappedTree& operator=(const RegMappedTree&) = delete;
+
+    // Move-only
+    RegMappedTree(RegMappedTree&& other) noexcept;
+    RegMappedTree& operator=(RegMappedTree&& other) noexcept;
+
+    // Map the given store file; throw RegException on failure
+    void Open(const std::wstring& path);
+
+    // Map the given store file
+    [[nodiscard]] RegResult TryOpen(const std::wstring& path);
+
+    // Unmap and close the file
+    void Close() noexcept;
+
+    [[nodiscard]] bool IsOpen() const noexcept;
+
+    // Total number of entries (keys and values) in the store
+    [[nodiscard]] size_t EntryCount() const noexcept;
+
+    // Does the key exist? The root key (empty path) always exists.
+    // Key paths and value names are matched case-insensitively.
+    [[nodiscard]] bool ContainsKey(std::wstring_view keyPath) const;
+
+    // Look up a value; return false if it doesn't exist
+    [[nodiscard]] bool FindValue(std::wstring_view keyPath,
+                                 std::wstring_view valueName,
+                                 Value& value) const;
+
+    // Return the values of the given key, in case-folded name order
+    [[nodiscard]] std::vector<Value> EnumValues(std::wstring_view keyPath) const;
+
+    // Load the whole store into an editable in-memory tree
+    [[nodiscard]] RegTree ToTree() const;
+
+    // Write the given tree as a store file, atomically replacing any existing one.
+    // The file must not be open (mapped) at the time.
+    static void Write(const RegTree& tree, const std::wstring& path);
+    [[nodiscard]] static RegResult TryWrite(const RegTree& tree, const std::wstring& path);
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Decode the entry at the given index position; return false if corrupted
+    [[nodiscard]] bool ReadEntry(size_t index, bool& isKey, Value& entry) const noexcept;
+
+    // Index of the first entry not less than (keyPath, isKey, valueName)
+    [[nodiscard]] size_t LowerBound(std::wstring_view keyPath,
+                                    bool isKey,
+                                    std::wstring_view valueName) const;
+
+    HANDLE      m_file{ INVALID_HANDLE_VALUE };
+    HANDLE      m_mapping{ nullptr };
+    const BYTE* m_view{ nullptr };
+    size_t      m_size{ 0 };
+    size_t      m_entryCount{ 0 };
+    size_t      m_indexOffset{ 0 };
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegMappedTree
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Memory-mapped store file format.
+//
+// The file starts with a MappedStoreHeader, followed by the entries, each one
+// made by a MappedEntryHeader, the key path, the value name (both UTF-16,
+// not NUL-terminated) and the value data. Then comes the index: an array of
+// 64-bit entry offsets, sorted by (folded key path, kind, folded value name),
+// with key entries sorted before the values of the same key.
+// Entries and the index start at 8-byte aligned offsets.
+//------------------------------------------------------------------------------
+
+constexpr std::uint32_t kMappedStoreMagic   = 0x4D525757; // "WWRM"
+constexpr std::uint32_t kMappedStoreVersion = 1;
+constexpr std::uint32_t kMappedEntryKey     = 0;
+constexpr std::uint32_t kMappedEntryValue   = 1;
+
+struct MappedStoreHeader
+{
+    std::uint32_t Magic;
+    std::uint32_t Version;
+    std::uint64_t EntryCount;
+    std::uint64_t IndexOffset;
+    std::uint64_t FileSize;
+};
+
+struct MappedEntryHeader
+{
+    std::uint32_t Kind;
+    std::uint32_t KeyPathLength;    // in wchar_ts
+    std::uint32_t ValueNameLength;  // in wchar_ts
+    std::uint32_t Type;
+    std::uint32_t DataSize;         // in bytes
+    std::uint32_t Reserved;
+};
+
+
+[[nodiscard]] constexpr size_t AlignMappedOffset(const size_t offset) noexcept
+{
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+
+//------------------------------------------------------------------------------
+// Compare two store entries by (folded key path, kind, folded value name)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline int CompareMappedEntries(
+    const std::wstring_view keyPathA, const bool isKeyA, const std::wstring_view valueNameA,
+    const std::wstring_view keyPathB, const bool isKeyB, const std::wstring_view valueNameB
+) noexcept
+{
+    const int result = CompareStrings(keyPathA, keyPathB, StringComparison::IgnoreCase);
+    if (result != 0)
+    {
+        return result;
+    }
+
+    if (isKeyA != isKeyB)
+    {
+        return isKeyA ? -1 : 1;
+    }
+
+    return CompareStrings(valueNameA, valueNameB, StringComparison::IgnoreCase);
+}
+
+
+// An entry to be written to a store file
+struct MappedEntrySource
+{
+    std::wstring           KeyPath;
+    bool                   IsKey;
+    const RegTree::Value*  Value;
+};
+
+
+//------------------------------------------------------------------------------
+// Collect the keys and values of a subtree as store entries
+//------------------------------------------------------------------------------
+inline void CollectMappedEntries(
+    const RegTree::Node& node,
+    std::wstring& keyPath,
+    std::vector<MappedEntrySource>& entries
+)
+{
+    if (!keyPath.empty())
+    {
+        entries.push_back(MappedEntrySource{ keyPath, true, nullptr });
+    }
+
+    for (const auto& value : node.Values)
+    {
+        entries.push_back(MappedEntrySource{ keyPath, false, value.get() });
+    }
+
+    for (const auto& subKey : node.SubKeys)
+    {
+        const size_t parentPathLength = keyPath.length();
+        if (!keyPath.empty())
+        {
+            keyPath += L'\\';
+        }
+        keyPath += subKey.Name.View();
+
+        CollectMappedEntries(*subKey.Key, keyPath, entries);
+
+        keyPath.resize(parentPathLength);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Build the image of a store file for the given tree
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::vector<BYTE> BuildMappedStoreImage(const RegTree& tree)
+{
+    std::vector<MappedEntrySource> entries;
+    std::wstring keyPath;
+    CollectMappedEntries(*tree.Root(), keyPath, entries);
+
+    std::sort(entries.begin(), entries.end(),
+        [](const MappedEntrySource& a, const MappedEntrySource& b)
+        {
+            return CompareMappedEntries(
+                a.KeyPath, a.IsKey, a.IsKey ? std::wstring_view{} : a.Value->Name,
+                b.KeyPath, b.IsKey, b.IsKey ? std::wstring_view{} : b.Value->Name) < 0;
+        });
+
+    std::vector<BYTE> image(AlignMappedOffset(sizeof(MappedStoreHeader)));
+    std::vector<std::uint64_t> index;
+    index.reserve(entries.size());
+
+    auto appendBytes = [&image](const void* data, const size_t size)
+    {
+        const BYTE* bytes = static_cast<const BYTE*>(data);
+        image.insert(image.end(), bytes, bytes + size);
+    };
+
+    for (const auto& source : entries)
+    {
+        index.push_back(image.size());
+
+        const std::wstring_view valueName = source.IsKey ? std::wstring_view{} : source.Value->Name;
+
+        MappedEntryHeader header{};
+        header.Kind = source.IsKey ? kMappedEntryKey : kMappedEntryValue;
+        header.KeyPathLength = SafeCastSizeToDword(source.KeyPath.length());
+        header.ValueNameLength = SafeCastSizeToDword(valueName.length());
+        header.Type = source.IsKey ? REG_NONE : source.Value->Type;
+        header.DataSize = source.IsKey ? 0 : source.Value->DataSize;
+
+        appendBytes(&header, sizeof(header));
+        appendBytes(source.KeyPath.data(), source.KeyPath.length() * sizeof(wchar_t));
+        appendBytes(valueName.data(), valueName.length() * sizeof(wchar_t));
+        if (!source.IsKey)
+        {
+            appendBytes(source.Value->Data, source.Value->DataSize);
+        }
+
+        image.resize(AlignMappedOffset(image.size()));
+    }
+
+    MappedStoreHeader storeHeader{};
+    storeHeader.Magic = kMappedStoreMagic;
+    storeHeader.Version = kMappedStoreVersion;
+    storeHeader.EntryCount = index.size();
+    storeHeader.IndexOffset = image.size();
+
+    appendBytes(index.data(), index.size() * sizeof(std::uint64_t));
+
+    storeHeader.FileSize = image.size();
+    std::copy_n(reinterpret_cast<const BYTE*>(&storeHeader), sizeof(storeHeader), image.begin());
+
+    return image;
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegMappedTree Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegMappedTree::~RegMappedTree() noexcept
+{
+    Close();
+}
+
+
+inline RegMappedTree::RegMappedTree(RegMappedTree&& other) noexcept
+    : m_file{ other.m_file }
+    , m_mapping{ other.m_mapping }
+    , m_view{ other.m_view }
+    , m_size{ other.m_size }
+    , m_entryCount{ other.m_entryCount }
+    , m_indexOffset{ other.m_indexOffset }
+{
+    other.m_file = INVALID_HANDLE_VALUE;
+    other.m_mapping = nullptr;
+    other.m_view = nullptr;
+    other.m_size = 0;
+    other.m_entryCount = 0;
+    other.m_indexOffset = 0;
+}
+
+
+inline RegMappedTree& RegMappedTree::operator=(RegMappedTree&& other) noexcept
+{
+    // Prevent self-move-assign
+    if (&other != this)
+    {
+        Close();
+
+        std::swap(m_file, other.m_file);
+        std::swap(m_mapping, other.m_mapping);
+        std::swap(m_view, other.m_view);
+        std::swap(m_size, other.m_size);
+        std::swap(m_entryCount, other.m_entryCount);
+        std::swap(m_indexOffset, other.m_indexOffset);
+    }
+    return *this;
+}
+
+
+inline void RegMappedTree::Open(const std::wstring& path)
+{
+    RegResult retCode = TryOpen(path);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot open the memory-mapped registry tree." };
+    }
+}
+
+
+inline RegResult RegMappedTree::TryOpen(const std::wstring& path)
+{
+    Close();
+
+    details::ScopedFileHandle file{ ::CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,    // default security
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr     // no template
+    ) };
+    if (!file.IsValid())
+    {
+        return RegResult{ details::LastErrorAsStatus() };
+    }
+
+    LARGE_INTEGER fileSize{};
+    if (!::GetFileSizeEx(file.Get(), &fileSize))
+    {
+        return RegResult{ details::LastErrorAsStatus() };
+    }
+
+    if ((static_cast<ULONGLONG>(fileSize.QuadPart) < sizeof(details::MappedStoreHeader))
+        || (static_cast<ULONGLONG>(fileSize.QuadPart) > (std::numeric_limits<size_t>::max)()))
+    {
+        return RegResult{ ERROR_BADDB };
+    }
+
+    const HANDLE mapping = ::CreateFileMappingW(
+        file.Get(),
+        nullptr,    // default security
+        PAGE_READONLY,
+        0, 0,       // map the whole file
+        nullptr     // no name
+    );
+    if (mapping == nullptr)
+    {
+        return RegResult{ details::LastErrorAsStatus() };
+    }
+
+    const BYTE* view = static_cast<const BYTE*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (view == nullptr)
+    {
+        const LSTATUS retCode = details::LastErrorAsStatus();
+        ::CloseHandle(mapping);
+        return RegResult{ retCode };
+    }
+
+    m_file = file.Detach();
+    m_mapping = mapping;
+    m_view = view;
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+
+    // Only the header is checked here; entries are checked when they are read
+    details::MappedStoreHeader header{};
+    std::copy_n(m_view, sizeof(header), reinterpret_cast<BYTE*>(&header));
+
+    const size_t maxEntryCount = m_size / sizeof(std::uint64_t);
+    if ((header.Magic != details::kMappedStoreMagic)
+        || (header.Version != details::kMappedStoreVersion)
+        || (header.FileSize != m_size)
+        || (header.EntryCount > maxEntryCount)
+        || (header.IndexOffset != details::AlignMappedOffset(static_cast<size_t>(header.IndexOffset)))
+        || (header.IndexOffset > m_size)
+        || ((m_size - header.IndexOffset) / sizeof(std::uint64_t) < header.EntryCount))
+    {
+        Close();
+        return RegResult{ ERROR_BADDB };
+    }
+
+    m_entryCount = static_cast<size_t>(header.EntryCount);
+    m_indexOffset = static_cast<size_t>(header.IndexOffset);
+
+    return RegResult{ ERROR_SUCCESS };
+}
+
+
+inline void RegMappedTree::Close() noexcept
+{
+    if (m_view != nullptr)
+    {
+        ::UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+
+    if (m_mapping != nullptr)
+    {
+        ::CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        ::CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+
+    m_size = 0;
+    m_entryCount = 0;
+    m_indexOffset = 0;
+}
+
+
+inline bool RegMappedTree::IsOpen() const noexcept
+{
+    return m_view != nullptr;
+}
+
+
+inline size_t RegMappedTree::EntryCount() const noexcept
+{
+    return m_entryCount;
+}
+
+
+inline bool RegMappedTree::ReadEntry(const size_t index, bool& isKey, Value& entry) const noexcept
+{
+    _ASSERTE(IsOpen());
+    _ASSERTE(index < m_entryCount);
+
+    // The index is 8-byte aligned, and the mapping is page-aligned
+    const std::uint64_t offset =
+        reinterpret_cast<const std::uint64_t*>(m_view + m_indexOffset)[index];
+    if ((offset % 8 != 0)
+        || (offset > m_indexOffset)
+        || (m_indexOffset - offset < sizeof(details::MappedEntryHeader)))
+    {
+        return false;
+    }
+
+    // The sizes read from the file are checked in 64 bits: with a 32-bit size_t,
+    // huge name lengths would wrap around and pass the bounds check
+    const auto* header = reinterpret_cast<const details::MappedEntryHeader*>(m_view + offset);
+    const std::uint64_t available = m_indexOffset - offset - sizeof(details::MappedEntryHeader);
+    const std::uint64_t namesSize =
+        (static_cast<std::uint64_t>(header->KeyPathLength) + header->ValueNameLength) * sizeof(wchar_t);
+    if (namesSize + header->DataSize > available)
+    {
+        return false;
+    }
+
+    const auto* keyPath = reinterpret_cast<const wchar_t*>(header + 1);
+    isKey = (header->Kind == details::kMappedEntryKey);
+    entry.KeyPath = std::wstring_view{ keyPath, header->KeyPathLength };
+    entry.Name = std::wstring_view{ keyPath + header->KeyPathLength, header->ValueNameLength };
+    entry.Type = header->Type;
+    entry.Data = reinterpret_cast<const BYTE*>(keyPath) + namesSize;
+    entry.DataSize = header->DataSize;
+    return true;
+}
+
+
+inline size_t RegMappedTree::LowerBound(
+    const std::wstring_view keyPath,
+    const bool isKey,
+    const std::wstring_view valueName
+) const
+{
+    size_t first = 0;
+    size_t count = m_entryCount;
+    while (count > 0)
+    {
+        const size_t step = count / 2;
+        const size_t middle = first + step;
+
+        bool entryIsKey = false;
+        Value entry;
+        if (!ReadEntry(middle, entryIsKey, entry))
+        {
+            throw RegException{ ERROR_BADDB, "Corrupted memory-mapped registry tree entry." };
+        }
+
+        if (details::CompareMappedEntries(entry.KeyPath, entryIsKey, entry.Name,
+                                          keyPath, isKey, valueName) < 0)
+        {
+            first = middle + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    return first;
+}
+
+
+inline bool RegMappedTree::ContainsKey(const std::wstring_view keyPath) const
+{
+    if (keyPath.empty())
+    {
+        return true;
+    }
+
+    const size_t index = LowerBound(keyPath, true, {});
+    if (index == m_entryCount)
+    {
+        return false;
+    }
+
+    bool isKey = false;
+    Value entry;
+    return ReadEntry(index, isKey, entry)
+        && isKey
+        && details::EqualStrings(entry.KeyPath, keyPath, StringComparison::IgnoreCase);
+}
+
+
+inline bool RegMappedTree::FindValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    Value& value
+) const
+{
+    const size_t index = LowerBound(keyPath, false, valueName);
+    if (index == m_entryCount)
+    {
+        return false;
+    }
+
+    bool isKey = false;
+    Value entry;
+    if (!ReadEntry(index, isKey, entry)
+        || isKey
+        || !details::EqualStrings(entry.KeyPath, keyPath, StringComparison::IgnoreCase)
+        || !details::EqualStrings(entry.Name, valueName, StringComparison::IgnoreCase))
+    {
+        return false;
+    }
+
+    value = entry;
+    return true;
+}
+
+
+inline std::vector<RegMappedTree::Value> RegMappedTree::EnumValues(const std::wstring_view keyPath) const
+{
+    std::vector<Value> values;
+
+    // The values of a key follow its key entry
+    for (size_t index = LowerBound(keyPath, false, {}); index < m_entryCount; index++)
+    {
+        bool isKey = false;
+        Value entry;
+        if (!ReadEntry(index, isKey, entry))
+        {
+            throw RegException{ ERROR_BADDB, "Corrupted memory-mapped registry tree entry." };
+        }
+
+        if (isKey || !details::EqualStrings(entry.KeyPath, keyPath, StringComparison::IgnoreCase))
+        {
+            break;
+        }
+
+        values.push_back(entry);
+    }
+
+    return values;
+}
+
+
+inline RegTree RegMappedTree::ToTree() const
+{
+    RegTree tree;
+
+    for (size_t index = 0; index < m_entryCount; index++)
+    {
+        bool isKey = false;
+        Value entry;
+        if (!ReadEntry(index, isKey, entry))
+        {
+            throw RegException{ ERROR_BADDB, "Corrupted memory-mapped registry tree entry." };
+        }
+
+        if (isKey)
+        {
+            tree.CreateKey(entry.KeyPath);
+        }
+        else
+        {
+            tree.SetValue(entry.KeyPath, entry.Name, entry.Type,
+                          std::vector<BYTE>(entry.Data, entry.Data + entry.DataSize));
+        }
+    }
+
+    return tree;
+}
+
+
+inline void RegMappedTree::Write(const RegTree& tree, const std::wstring& path)
+{
+    RegResult retCode = TryWrite(tree, path);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot write the memory-mapped registry tree." };
+    }
+}
+
+
+inline RegResult RegMappedTree::TryWrite(const RegTree& tree, const std::wstring& path)
+{
+    const std::vector<BYTE> image = details::BuildMappedStoreImage(tree);
+
+    // Write the new image to a temporary file, then atomically replace the old one
+    const std::wstring tempPath = path + L".tmp";
+    {
+        details::ScopedFileHandle tempFile{ ::CreateFileW(
+            tempPath.c_str(),
+            GENERIC_WRITE,
+            0,          // no sharing
+            nullptr,    // default security
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr     // no template
+        ) };
+        if (!tempFile.IsValid())
+        {
+            return RegResult{ details::LastErrorAsStatus() };
+        }
+
+        LSTATUS retCode = details::WriteFileFully(tempFile.Get(), image.data(), image.size());
+        if ((retCode == ERROR_SUCCESS) && !::FlushFileBuffers(tempFile.Get()))
+        {
+            retCode = details::LastErrorAsStatus();
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+    }
+
+    if (!::MoveFileExW(tempPath.c_str(), path.c_str(),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        return RegResult{ details::LastErrorAsStatus() };
+    }
+
+    return RegResult{ ERROR_SUCCESS };
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGMAPPEDTREE_HPP_INCLUDED
@@ -0,0 +1,1861 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGMEMORYBACKEND_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGMEMORYBACKEND_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegMemoryBackend: the base of the in-memory registry backends, that run
+// RegKey code against an in-memory store instead of the Windows registry;
+// and RegTreeBackend, the backend storing the keys in a RegTree.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegTree.hpp"      // RegTree
+
+#include <algorithm>        // std::max, std::none_of
+#include <atomic>           // std::atomic
+#include <chrono>           // std::chrono::system_clock
+#include <condition_variable> // std::condition_variable
+#include <cstdint>          // std::uint64_t, std::uintptr_t
+#include <cstring>          // std::memcpy, std::memset
+#include <cwchar>           // std::wcslen, std::wcschr
+#include <memory>           // std::shared_ptr, std::make_shared
+#include <mutex>            // std::mutex, std::lock_guard, std::unique_lock
+#include <new>              // std::bad_alloc
+#include <shared_mutex>     // std::shared_mutex, std::shared_lock
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <unordered_map>    // std::unordered_map
+#include <utility>          // std::move, std::pair
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// The base of the in-memory registry backends (see RegBackend): it implements
+// the Windows Registry API functions on top of a few store operations, that
+// the derived classes provide on their own store (e.g. RegTreeBackend).
+//
+// - The top-level keys of the store are the predefined keys, named like their
+//   constants: e.g. HKEY_CURRENT_USER\Software is "HKEY_CURRENT_USER\Software"
+//   in the store. The predefined keys always exist, even in an empty store.
+//
+// - An open key handle refers to its key by path: after the key is deleted
+//   (or renamed), the handle fails with ERROR_KEY_DELETED.
+//
+// - RegEnumKeyEx and RegEnumValue return the subkeys (or values) of a snapshot
+//   taken at index 0, kept with the handle: enumerating from 0 up to
+//   ERROR_NO_MORE_ITEMS returns a consistent list, even while other threads
+//   change the key.
+//
+// - Access rights are checked: e.g. setting a value needs a handle opened with
+//   KEY_SET_VALUE. There is a single registry view (KEY_WOW64_32KEY and
+//   KEY_WOW64_64KEY are ignored).
+//
+// - RegNotifyChangeKeyValue works for the changes made through the backend;
+//   the changes made directly on the store (bypassing RegKey) are not seen,
+//   unless the derived class reports them (see NotifyStoreChange).
+//
+// - RegGetValue applies the RRF_RT_* type restrictions and adds the missing
+//   string terminators; REG_EXPAND_SZ data is returned without expanding
+//   the environment variables.
+//
+// - There are no key classes, security descriptors or symbolic links; the last
+//   write time of every key is the time of the latest change made through
+//   the backend.
+//
+// Each Windows Registry API call is a few store operations, each of them
+// atomic: e.g. RegCopyTree copies the keys one by one, and a key deleted
+// meanwhile may be left out. RegDeleteKeyEx (that fails if the key has
+// subkeys) is atomic only if the store overrides StoreDeleteKey.
+//------------------------------------------------------------------------------
+class RegMemoryBackend : public RegBackend
+{
+public:
+
+    ~RegMemoryBackend() override = default;
+
+    // Number of key handles currently open (the predefined keys excluded)
+    [[nodiscard]] size_t OpenKeyCount() const;
+
+
+    //
+    // RegBackend implementation
+    //
+
+    LSTATUS OpenKeyEx(HKEY hKey, LPCWSTR subKey, DWORD options, REGSAM desiredAccess,
+                      PHKEY result) noexcept override;
+
+    LSTATUS CreateKeyEx(HKEY hKey, LPCWSTR subKey, DWORD reserved, LPWSTR keyClass,
+                        DWORD options, REGSAM desiredAccess,
+                        SECURITY_ATTRIBUTES* securityAttributes,
+                        PHKEY result, LPDWORD disposition) noexcept override;
+
+    LSTATUS CloseKey(HKEY hKey) noexcept override;
+
+    // Any machine name refers to this backend
+    LSTATUS ConnectRegistry(LPCWSTR machineName, HKEY hKey, PHKEY result) noexcept override;
+
+    LSTATUS GetValue(HKEY hKey, LPCWSTR subKey, LPCWSTR valueName, DWORD flags,
+                     LPDWORD type, void* data, LPDWORD dataSize) noexcept override;
+
+    LSTATUS QueryValueEx(HKEY hKey, LPCWSTR valueName, LPDWORD reserved, LPDWORD type,
+                         BYTE* data, LPDWORD dataSize) noexcept override;
+
+    LSTATUS SetValueEx(HKEY hKey, LPCWSTR valueName, DWORD reserved, DWORD type,
+                       const BYTE* data, DWORD dataSize) noexcept override;
+
+    LSTATUS SetKeyValue(HKEY hKey, LPCWSTR subKey, LPCWSTR valueName, DWORD type,
+                        const void* data, DWORD dataSize) noexcept override;
+
+    LSTATUS QueryInfoKey(HKEY hKey, LPWSTR keyClass, LPDWORD keyClassLength,
+                         LPDWORD reserved, LPDWORD subKeyCount,
+                         LPDWORD maxSubKeyNameLength, LPDWORD maxClassLength,
+                         LPDWORD valueCount, LPDWORD maxValueNameLength,
+                         LPDWORD maxValueDataLength, LPDWORD securityDescriptorSize,
+                         FILETIME* lastWriteTime) noexcept override;
+
+    LSTATUS EnumKeyEx(HKEY hKey, DWORD index, LPWSTR name, LPDWORD nameLength,
+                      LPDWORD reserved, LPWSTR keyClass, LPDWORD keyClassLength,
+                      FILETIME* lastWriteTime) noexcept override;
+
+    LSTATUS EnumValue(HKEY hKey, DWORD index, LPWSTR valueName, LPDWORD valueNameLength,
+                      LPDWORD reserved, LPDWORD type, BYTE* data,
+                      LPDWORD dataSize) noexcept override;
+
+    LSTATUS DeleteValue(HKEY hKey, LPCWSTR valueName) noexcept override;
+
+    LSTATUS DeleteKeyEx(HKEY hKey, LPCWSTR subKey, REGSAM desiredAccess,
+                        DWORD reserved) noexcept override;
+
+    LSTATUS DeleteTree(HKEY hKey, LPCWSTR subKey) noexcept override;
+
+    LSTATUS CopyTree(HKEY hKeySource, LPCWSTR subKey, HKEY hKeyDest) noexcept override;
+
+    LSTATUS RenameKey(HKEY hKey, LPCWSTR subKey, LPCWSTR newKeyName) noexcept override;
+
+    LSTATUS FlushKey(HKEY hKey) noexcept override;
+
+    // Both asynchronous (with an event) and synchronous notifications
+    LSTATUS NotifyChangeKeyValue(HKEY hKey, BOOL watchSubtree, DWORD notifyFilter,
+                                 HANDLE event, BOOL asynchronous) noexcept override;
+
+
+protected:
+
+    // Register the predefined keys
+    RegMemoryBackend();
+
+
+    //
+    // Store operations, implemented by the derived classes.
+    //
+    // Key paths are full paths, starting with the name of a predefined key
+    // (e.g. "HKEY_CURRENT_USER\Software\GioTest"); key and value names are
+    // compared case-insensitively. Each operation must be atomic and
+    // thread-safe; errors are reported by throwing (e.g. std::bad_alloc,
+    // or RegException).
+    //
+
+    // Does the key exist?
+    [[nodiscard]] virtual bool StoreContainsKey(std::wstring_view keyPath) = 0;
+
+    // Return the value, or nullptr if it (or its key) doesn't exist
+    [[nodiscard]] virtual RegTree::ValuePtr StoreFindValue(std::wstring_view keyPath,
+                                                           std::wstring_view valueName) = 0;
+
+    // Read the names of the subkeys, sorted by case-folded name.
+    // Return false if the key doesn't exist.
+    [[nodiscard]] virtual bool StoreReadSubKeys(std::wstring_view keyPath,
+                                                std::vector<std::wstring>& subKeyNames) = 0;
+
+    // Read the values, sorted by case-folded name.
+    // Return false if the key doesn't exist.
+    [[nodiscard]] virtual bool StoreReadValues(std::wstring_view keyPath,
+                                               std::vector<RegTree::ValuePtr>& values) = 0;
+
+    // Create the key, with any missing parent key; return true if it was created
+    virtual bool StoreCreateKey(std::wstring_view keyPath) = 0;
+
+    // Set a value, creating any missing key
+    virtual void StoreSetValue(std::wstring_view keyPath,
+                               std::wstring_view valueName,
+                               DWORD type,
+                               const BYTE* data,
+                               size_t dataSize) = 0;
+
+    // Delete a value; return false if it doesn't exist
+    virtual bool StoreDeleteValue(std::wstring_view keyPath, std::wstring_view valueName) = 0;
+
+    // Delete a key and all its subtree; return false if it doesn't exist
+    virtual bool StoreDeleteTree(std::wstring_view keyPath) = 0;
+
+    // Delete a key that has no subkeys: return ERROR_FILE_NOT_FOUND if it
+    // doesn't exist, ERROR_ACCESS_DENIED if it has subkeys.
+    // By default, checks the subkeys, then calls StoreDeleteTree.
+    [[nodiscard]] virtual LSTATUS StoreDeleteKey(std::wstring_view keyPath);
+
+    // Rename a key, keeping it under the same parent: return ERROR_FILE_NOT_FOUND
+    // if it doesn't exist, ERROR_ACCESS_DENIED if the new name is taken.
+    // By default, fails with ERROR_NOT_SUPPORTED.
+    [[nodiscard]] virtual LSTATUS StoreRenameKey(std::wstring_view keyPath, std::wstring_view newKeyName);
+
+    // Make the changes durable; by default, there is nothing to do
+    [[nodiscard]] virtual LSTATUS StoreFlush();
+
+    // Signal the watches that see a change of the key made outside the backend
+    // (e.g. by another client of a remote store), whatever their filter, as the
+    // kind of change is unknown: the watches on the key, on its ancestors
+    // (watching the subtree) and on its parent. If the key was deleted with
+    // its subtree, the watches on its subkeys are signaled too; an empty path
+    // then signals all the watches.
+    void NotifyStoreChange(std::wstring_view keyPath, bool deletedSubtree);
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // A key handle
+    struct OpenKey
+    {
+        std::wstring Path;
+        REGSAM       Access{ 0 };
+
+        // The enumeration snapshots, taken at index 0
+        std::mutex                                            SnapshotMutex;
+        std::shared_ptr<const std::vector<std::wstring>>      SubKeyNames;
+        std::shared_ptr<const std::vector<RegTree::ValuePtr>> Values;
+    };
+
+    using OpenKeyPtr = std::shared_ptr<OpenKey>;
+
+    // A pending RegNotifyChangeKeyValue call
+    struct Watch
+    {
+        std::uint64_t Id{ 0 };
+        HKEY          Handle{ nullptr };
+        std::wstring  FoldedPath;
+        bool          WatchSubtree{ false };
+        DWORD         NotifyFilter{ 0 };
+        HANDLE        Event{ nullptr };     // nullptr for a synchronous call
+    };
+
+    // Range of the handle values; the predefined keys are not in it
+    static constexpr std::uintptr_t kFirstHandle = 0x1000;
+    static constexpr std::uintptr_t kLastHandle = 0x7FFF0000;
+    static constexpr std::uintptr_t kHandleStep = 0x10;
+
+    // Run the function, turning its exceptions into error codes
+    template <typename Function>
+    [[nodiscard]] static LSTATUS Guarded(Function&& function) noexcept;
+
+    // Find the open key of a handle, opened with (at least) the given access
+    [[nodiscard]] LSTATUS FindOpenKey(HKEY hKey, REGSAM requiredAccess, OpenKeyPtr& openKey) const;
+
+    // Register a new handle
+    [[nodiscard]] HKEY AddOpenKey(std::wstring keyPath, REGSAM access);
+
+    // Does the key exist (the predefined keys always do)?
+    [[nodiscard]] bool KeyExists(std::wstring_view keyPath);
+
+    // Error code for a key found missing: a key that a handle refers to
+    // was deleted, a subkey was not found
+    [[nodiscard]] LSTATUS MissingKeyError(std::wstring_view keyPath, LPCWSTR subKey);
+
+    // Record a change made through the backend, and signal the watches
+    // that see it
+    void NotifyChange(std::wstring_view keyPath, DWORD changeFilter);
+
+    // Same as above for a key deleted (or renamed) with its subtree:
+    // a change of the subkeys of its parent, that also signals the watches
+    // on the key and its subtree
+    void NotifyKeyRemoved(std::wstring_view keyPath);
+
+    // Signal the watches matching the predicate
+    template <typename Predicate>
+    void SignalWatches(Predicate isSignaled);
+
+    // Copy the subtree at sourcePath to destPath
+    void CopySubtree(std::wstring_view sourcePath, std::wstring_view destPath);
+
+    // Protects m_openKeys and m_nextHandle
+    mutable std::shared_mutex               m_openKeysMutex;
+    std::unordered_map<HKEY, OpenKeyPtr>    m_openKeys;
+    std::uintptr_t                          m_nextHandle{ kFirstHandle };
+    size_t                                  m_predefinedKeyCount{ 0 };
+
+    // Pending change notifications
+    std::mutex              m_watchMutex;
+    std::condition_variable m_watchSignaled;
+    std::vector<Watch>      m_watches;
+    std::uint64_t           m_nextWatchId{ 1 };
+    std::atomic<size_t>     m_watchCount{ 0 };
+
+    // Time of the latest change, as a FILETIME
+    std::atomic<ULONGLONG> m_lastWriteTime{ 0 };
+};
+
+
+//------------------------------------------------------------------------------
+// An in-memory registry backend storing the keys in a RegTree: RegKey code
+// runs against it unchanged (e.g. in tests, or where there is no Windows
+// registry), and its content can be taken as a RegTree at any time.
+//
+// A reader-writer lock protects the tree: readers share it, while each change
+// (that copies the nodes on the path to the changed key, see RegTree) holds
+// it exclusively. Snapshot is O(1), and the tree it returns is not affected
+// by later changes.
+//------------------------------------------------------------------------------
+class RegTreeBackend : public RegMemoryBackend
+{
+public:
+
+    // Start from the given tree (e.g. captured with RegTree::FromKey, under
+    // a top-level key named like a predefined key)
+    explicit RegTreeBackend(RegTree tree = RegTree{});
+
+    // Return the current content of the backend
+    [[nodiscard]] RegTree Snapshot() const;
+
+    // Replace the content of the backend; open handles keep their paths
+    void Reset(RegTree tree);
+
+protected:
+
+    [[nodiscard]] bool StoreContainsKey(std::wstring_view keyPath) override;
+    [[nodiscard]] RegTree::ValuePtr StoreFindValue(std::wstring_view keyPath,
+                                                   std::wstring_view valueName) override;
+    [[nodiscard]] bool StoreReadSubKeys(std::wstring_view keyPath,
+                                        std::vector<std::wstring>& subKeyNames) override;
+    [[nodiscard]] bool StoreReadValues(std::wstring_view keyPath,
+                                       std::vector<RegTree::ValuePtr>& values) override;
+    bool StoreCreateKey(std::wstring_view keyPath) override;
+    void StoreSetValue(std::wstring_view keyPath,
+                       std::wstring_view valueName,
+                       DWORD type,
+                       const BYTE* data,
+                       size_t dataSize) override;
+    bool StoreDeleteValue(std::wstring_view keyPath, std::wstring_view valueName) override;
+    bool StoreDeleteTree(std::wstring_view keyPath) override;
+    [[nodiscard]] LSTATUS StoreDeleteKey(std::wstring_view keyPath) override;
+    [[nodiscard]] LSTATUS StoreRenameKey(std::wstring_view keyPath, std::wstring_view newKeyName) override;
+
+private:
+    mutable std::shared_mutex m_mutex;
+    RegTree                   m_tree;
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegMemoryBackend
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Join a key path and a subkey path (that can be nullptr or empty)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::wstring JoinKeyPath(const std::wstring_view keyPath, const LPCWSTR subKey)
+{
+    std::wstring path{ keyPath };
+    if ((subKey != nullptr) && (*subKey != L'\0'))
+    {
+        path += L'\\';
+        path += subKey;
+    }
+    return path;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the path of the parent of a key (empty for a top-level key)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::wstring_view ParentKeyPath(const std::wstring_view keyPath) noexcept
+{
+    const size_t separator = keyPath.rfind(L'\\');
+    return (separator != std::wstring_view::npos) ? keyPath.substr(0, separator) : std::wstring_view{};
+}
+
+
+//------------------------------------------------------------------------------
+// The RRF_RT_* flag that RegGetValue matches against a value type
+// (0 for the types that only RRF_RT_ANY matches)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline DWORD RegGetValueTypeFlag(const DWORD type) noexcept
+{
+    switch (type)
+    {
+    case REG_NONE:      return RRF_RT_REG_NONE;
+    case REG_SZ:        return RRF_RT_REG_SZ;
+    case REG_EXPAND_SZ: return RRF_RT_REG_EXPAND_SZ;
+    case REG_BINARY:    return RRF_RT_REG_BINARY;
+    case REG_DWORD:     return RRF_RT_REG_DWORD;
+    case REG_MULTI_SZ:  return RRF_RT_REG_MULTI_SZ;
+    case REG_QWORD:     return RRF_RT_REG_QWORD;
+    default:            return 0;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Number of NUL wchar_ts that RegGetValue appends to the data of a string
+// value, to terminate it (a REG_MULTI_SZ value ends with two NULs)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline DWORD MissingStringTerminators(const RegTree::Value& value) noexcept
+{
+    DWORD requiredNuls = 0;
+    switch (value.Type)
+    {
+    case REG_SZ:
+    case REG_EXPAND_SZ:
+        requiredNuls = 1;
+        break;
+
+    case REG_MULTI_SZ:
+        requiredNuls = 2;
+        break;
+
+    default:
+        return 0;
+    }
+
+    if ((value.DataSize % sizeof(wchar_t)) != 0)
+    {
+        return 0;
+    }
+
+    const size_t length = value.DataSize / sizeof(wchar_t);
+    DWORD trailingNuls = 0;
+    while ((trailingNuls < requiredNuls) && (trailingNuls < length))
+    {
+        wchar_t ch = 0;
+        std::memcpy(&ch, value.Data + (length - trailingNuls - 1) * sizeof(wchar_t), sizeof(ch));
+        if (ch != L'\0')
+        {
+            break;
+        }
+        trailingNuls++;
+    }
+
+    return requiredNuls - trailingNuls;
+}
+
+
+//------------------------------------------------------------------------------
+// Copy a name into a Win32 API output buffer of *length wchar_ts: fail with
+// ERROR_MORE_DATA if it doesn't fit with its terminator, otherwise store the
+// name length in *length
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS CopyNameToBuffer(
+    const std::wstring_view name,
+    const LPWSTR buffer,
+    const LPDWORD length
+) noexcept
+{
+    if ((buffer == nullptr) || (length == nullptr))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (name.length() >= *length)
+    {
+        return ERROR_MORE_DATA;
+    }
+
+    std::memcpy(buffer, name.data(), name.length() * sizeof(wchar_t));
+    buffer[name.length()] = L'\0';
+    *length = static_cast<DWORD>(name.length());
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Store an empty key class, for the Win32 API functions returning it
+//------------------------------------------------------------------------------
+inline void StoreEmptyKeyClass(const LPWSTR keyClass, const LPDWORD keyClassLength) noexcept
+{
+    if (keyClassLength != nullptr)
+    {
+        if ((keyClass != nullptr) && (*keyClassLength > 0))
+        {
+            keyClass[0] = L'\0';
+        }
+        *keyClassLength = 0;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Convert a ULONGLONG into a FILETIME
+//------------------------------------------------------------------------------
+[[nodiscard]] inline FILETIME MakeFileTime(const ULONGLONG time) noexcept
+{
+    FILETIME fileTime;
+    fileTime.dwLowDateTime = static_cast<DWORD>(time & 0xFFFFFFFF);
+    fileTime.dwHighDateTime = static_cast<DWORD>(time >> 32);
+    return fileTime;
+}
+
+
+//------------------------------------------------------------------------------
+// The current time as a FILETIME value: 100-nanosecond intervals since
+// January 1st, 1601 (UTC)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline ULONGLONG CurrentFileTime() noexcept
+{
+    // FILETIME of the Unix epoch, that std::chrono::system_clock uses
+    constexpr ULONGLONG kUnixEpochFileTime = 116444736000000000ULL;
+
+    using FileTimeTicks = std::chrono::duration<ULONGLONG, std::ratio<1, 10000000>>;
+    return kUnixEpochFileTime + std::chrono::duration_cast<FileTimeTicks>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+//------------------------------------------------------------------------------
+// Store operations on a RegTree, shared by the backends storing a RegTree
+//------------------------------------------------------------------------------
+
+[[nodiscard]] inline RegTree::ValuePtr FindTreeValue(
+    const RegTree& tree,
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName
+)
+{
+    const RegTree::Node* const node = tree.FindKey(keyPath);
+    if (node == nullptr)
+    {
+        return nullptr;
+    }
+
+    const auto [position, found] = FindByFoldedName(node->Values, valueName);
+    return found ? node->Values[position] : nullptr;
+}
+
+
+[[nodiscard]] inline bool ReadTreeSubKeys(
+    const RegTree& tree,
+    const std::wstring_view keyPath,
+    std::vector<std::wstring>& subKeyNames
+)
+{
+    const RegTree::Node* const node = tree.FindKey(keyPath);
+    if (node == nullptr)
+    {
+        return false;
+    }
+
+    subKeyNames.clear();
+    subKeyNames.reserve(node->SubKeys.size());
+    for (const RegTree::SubKeyEntry& entry : node->SubKeys)
+    {
+        subKeyNames.emplace_back(entry.Name.View());
+    }
+    return true;
+}
+
+
+[[nodiscard]] inline bool ReadTreeValues(
+    const RegTree& tree,
+    const std::wstring_view keyPath,
+    std::vector<RegTree::ValuePtr>& values
+)
+{
+    const RegTree::Node* const node = tree.FindKey(keyPath);
+    if (node == nullptr)
+    {
+        return false;
+    }
+
+    values = node->Values;
+    return true;
+}
+
+
+// Create a key, and return true if it didn't exist
+inline bool CreateTreeKey(RegTree& tree, const std::wstring_view keyPath)
+{
+    if (tree.ContainsKey(keyPath))
+    {
+        return false;
+    }
+
+    tree.CreateKey(keyPath);
+    return true;
+}
+
+
+// Delete a key without subkeys (see RegMemoryBackend::StoreDeleteKey)
+[[nodiscard]] inline LSTATUS DeleteTreeKey(RegTree& tree, const std::wstring_view keyPath)
+{
+    const RegTree::Node* const node = tree.FindKey(keyPath);
+    if (node == nullptr)
+    {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    if (!node->SubKeys.empty())
+    {
+        return ERROR_ACCESS_DENIED;
+    }
+
+    return tree.DeleteTree(keyPath) ? ERROR_SUCCESS : ERROR_ACCESS_DENIED;
+}
+
+
+// Rename a key (see RegMemoryBackend::StoreRenameKey)
+[[nodiscard]] inline LSTATUS RenameTreeKey(
+    RegTree& tree,
+    const std::wstring_view keyPath,
+    const std::wstring_view newKeyName
+)
+{
+    if (!tree.ContainsKey(keyPath))
+    {
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    return tree.RenameKey(keyPath, newKeyName) ? ERROR_SUCCESS : ERROR_ACCESS_DENIED;
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegMemoryBackend Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegMemoryBackend::RegMemoryBackend()
+{
+    const HKEY predefinedKeys[] =
+    {
+        HKEY_CLASSES_ROOT,
+        HKEY_CURRENT_USER,
+        HKEY_LOCAL_MACHINE,
+        HKEY_USERS,
+        HKEY_CURRENT_CONFIG,
+        HKEY_CURRENT_USER_LOCAL_SETTINGS,
+        HKEY_PERFORMANCE_DATA,
+        HKEY_PERFORMANCE_NLSTEXT,
+        HKEY_PERFORMANCE_TEXT
+    };
+
+    for (const HKEY hKey : predefinedKeys)
+    {
+        auto openKey = std::make_shared<OpenKey>();
+        openKey->Path = details::PredefinedKeyName(hKey);
+        openKey->Access = KEY_ALL_ACCESS;
+        m_openKeys.emplace(hKey, std::move(openKey));
+    }
+    m_predefinedKeyCount = m_openKeys.size();
+}
+
+
+template <typename Function>
+inline LSTATUS RegMemoryBackend::Guarded(Function&& function) noexcept
+{
+    try
+    {
+        return function();
+    }
+    catch (const RegException& e)
+    {
+        return static_cast<LSTATUS>(e.code().value());
+    }
+    catch (const std::bad_alloc&)
+    {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+    catch (...)
+    {
+        return ERROR_INTERNAL_ERROR;
+    }
+}
+
+
+inline size_t RegMemoryBackend::OpenKeyCount() const
+{
+    std::shared_lock<std::shared_mutex> lock{ m_openKeysMutex };
+    return m_openKeys.size() - m_predefinedKeyCount;
+}
+
+
+inline LSTATUS RegMemoryBackend::FindOpenKey(
+    const HKEY hKey,
+    const REGSAM requiredAccess,
+    OpenKeyPtr& openKey
+) const
+{
+    {
+        std::shared_lock<std::shared_mutex> lock{ m_openKeysMutex };
+        const auto it = m_openKeys.find(hKey);
+        if (it == m_openKeys.end())
+        {
+            return ERROR_INVALID_HANDLE;
+        }
+        openKey = it->second;
+    }
+
+    if ((openKey->Access & requiredAccess) != requiredAccess)
+    {
+        return ERROR_ACCESS_DENIED;
+    }
+    return ERROR_SUCCESS;
+}
+
+
+inline HKEY RegMemoryBackend::AddOpenKey(std::wstring keyPath, const REGSAM access)
+{
+    auto openKey = std::make_shared<OpenKey>();
+    openKey->Path = std::move(keyPath);
+    openKey->Access = access & ~(KEY_WOW64_32KEY | KEY_WOW64_64KEY);
+
+    std::unique_lock<std::shared_mutex> lock{ m_openKeysMutex };
+    for (;;)
+    {
+        const HKEY hKey = reinterpret_cast<HKEY>(m_nextHandle);
+        m_nextHandle = (m_nextHandle < kLastHandle) ? (m_nextHandle + kHandleStep) : kFirstHandle;
+
+        // Skip the handles still open, after wrapping around
+        if (m_openKeys.emplace(hKey, openKey).second)
+        {
+            return hKey;
+        }
+    }
+}
+
+
+inline bool RegMemoryBackend::KeyExists(const std::wstring_view keyPath)
+{
+    // The top-level keys are the predefined keys
+    return (keyPath.find(L'\\') == std::wstring_view::npos) || StoreContainsKey(keyPath);
+}
+
+
+inline LSTATUS RegMemoryBackend::MissingKeyError(const std::wstring_view keyPath, const LPCWSTR subKey)
+{
+    if ((subKey == nullptr) || (*subKey == L'\0'))
+    {
+        return ERROR_KEY_DELETED;
+    }
+
+    // The subkey is missing, unless the key of the handle itself was deleted
+    const std::wstring_view handlePath = keyPath.substr(0, keyPath.length() - std::wcslen(subKey) - 1);
+    return KeyExists(handlePath) ? ERROR_FILE_NOT_FOUND : ERROR_KEY_DELETED;
+}
+
+
+template <typename Predicate>
+inline void RegMemoryBackend::SignalWatches(Predicate isSignaled)
+{
+    bool signaledSynchronousWatch = false;
+    {
+        std::lock_guard<std::mutex> lock{ m_watchMutex };
+        auto it = m_watches.begin();
+        while (it != m_watches.end())
+        {
+            if (!isSignaled(*it))
+            {
+                ++it;
+                continue;
+            }
+
+            // Notifications are one-shot, like RegNotifyChangeKeyValue ones
+            if (it->Event != nullptr)
+            {
+                ::SetEvent(it->Event);
+            }
+            else
+            {
+                signaledSynchronousWatch = true;
+            }
+            it = m_watches.erase(it);
+        }
+        m_watchCount.store(m_watches.size(), std::memory_order_relaxed);
+    }
+
+    if (signaledSynchronousWatch)
+    {
+        m_watchSignaled.notify_all();
+    }
+}
+
+
+inline void RegMemoryBackend::NotifyChange(const std::wstring_view keyPath, const DWORD changeFilter)
+{
+    m_lastWriteTime.store(details::CurrentFileTime(), std::memory_order_relaxed);
+
+    if (m_watchCount.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    const std::wstring changedPath = details::FoldKeyPath(keyPath);
+    SignalWatches([&](const Watch& watch) {
+        return ((watch.NotifyFilter & changeFilter) != 0)
+            && details::IsWatchedChange(changedPath, watch.FoldedPath, watch.WatchSubtree);
+    });
+}
+
+
+inline void RegMemoryBackend::NotifyKeyRemoved(const std::wstring_view keyPath)
+{
+    NotifyChange(details::ParentKeyPath(keyPath), REG_NOTIFY_CHANGE_NAME);
+
+    if (m_watchCount.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    // The watches on the removed keys are signaled, whatever their filter
+    const std::wstring removedPath = details::FoldKeyPath(keyPath);
+    SignalWatches([&](const Watch& watch) {
+        return details::IsWatchedChange(watch.FoldedPath, removedPath, true);
+    });
+}
+
+
+inline void RegMemoryBackend::NotifyStoreChange(const std::wstring_view keyPath, const bool deletedSubtree)
+{
+    m_lastWriteTime.store(details::CurrentFileTime(), std::memory_order_relaxed);
+
+    if (m_watchCount.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    const std::wstring changedPath = details::FoldKeyPath(keyPath);
+    const std::wstring_view parentPath = details::ParentKeyPath(changedPath);
+    SignalWatches([&](const Watch& watch) {
+        return details::IsWatchedChange(changedPath, watch.FoldedPath, watch.WatchSubtree)
+            || (watch.FoldedPath == parentPath)
+            || (deletedSubtree && details::IsWatchedChange(watch.FoldedPath, changedPath, true));
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::StoreDeleteKey(const std::wstring_view keyPath)
+{
+    std::vector<std::wstring> subKeyNames;
+    if (!StoreReadSubKeys(keyPath, subKeyNames))
+    {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    if (!subKeyNames.empty())
+    {
+        return ERROR_ACCESS_DENIED;
+    }
+
+    return StoreDeleteTree(keyPath) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND;
+}
+
+
+inline LSTATUS RegMemoryBackend::StoreRenameKey(
+    [[maybe_unused]] const std::wstring_view keyPath,
+    [[maybe_unused]] const std::wstring_view newKeyName)
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+
+inline LSTATUS RegMemoryBackend::StoreFlush()
+{
+    return ERROR_SUCCESS;
+}
+
+
+inline LSTATUS RegMemoryBackend::OpenKeyEx(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    [[maybe_unused]] const DWORD options,
+    const REGSAM desiredAccess,
+    const PHKEY result) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if (result == nullptr)
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        OpenKeyPtr parent;
+        LSTATUS retCode = FindOpenKey(hKey, 0, parent);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        std::wstring keyPath = details::JoinKeyPath(parent->Path, subKey);
+        if (!KeyExists(keyPath))
+        {
+            return MissingKeyError(keyPath, subKey);
+        }
+
+        *result = AddOpenKey(std::move(keyPath), desiredAccess);
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::CreateKeyEx(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    [[maybe_unused]] const DWORD reserved,
+    [[maybe_unused]] const LPWSTR keyClass,
+    [[maybe_unused]] const DWORD options,
+    const REGSAM desiredAccess,
+    [[maybe_unused]] SECURITY_ATTRIBUTES* const securityAttributes,
+    const PHKEY result,
+    const LPDWORD disposition) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if ((subKey == nullptr) || (result == nullptr))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        OpenKeyPtr parent;
+        LSTATUS retCode = FindOpenKey(hKey, 0, parent);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+        if (!KeyExists(parent->Path))
+        {
+            return ERROR_KEY_DELETED;
+        }
+
+        std::wstring keyPath = details::JoinKeyPath(parent->Path, subKey);
+        bool created = false;
+        if (!KeyExists(keyPath))
+        {
+            if ((parent->Access & KEY_CREATE_SUB_KEY) == 0)
+            {
+                return ERROR_ACCESS_DENIED;
+            }
+
+            created = StoreCreateKey(keyPath);
+            if (created)
+            {
+                NotifyChange(details::ParentKeyPath(keyPath), REG_NOTIFY_CHANGE_NAME);
+            }
+        }
+
+        if (disposition != nullptr)
+        {
+            *disposition = created ? REG_CREATED_NEW_KEY : REG_OPENED_EXISTING_KEY;
+        }
+        *result = AddOpenKey(std::move(keyPath), desiredAccess);
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::CloseKey(const HKEY hKey) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        OpenKeyPtr openKey;
+        {
+            std::unique_lock<std::shared_mutex> lock{ m_openKeysMutex };
+            const auto it = m_openKeys.find(hKey);
+            if (it == m_openKeys.end())
+            {
+                return ERROR_INVALID_HANDLE;
+            }
+            if (details::PredefinedKeyName(hKey) != nullptr)
+            {
+                return ERROR_SUCCESS;
+            }
+
+            // Released out of the lock
+            openKey = std::move(it->second);
+            m_openKeys.erase(it);
+        }
+
+        // Closing a key signals its pending notifications
+        if (m_watchCount.load(std::memory_order_relaxed) != 0)
+        {
+            SignalWatches([hKey](const Watch& watch) { return watch.Handle == hKey; });
+        }
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::ConnectRegistry(
+    [[maybe_unused]] const LPCWSTR machineName,
+    const HKEY hKey,
+    const PHKEY result) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if (result == nullptr)
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+        if ((hKey != HKEY_LOCAL_MACHINE) && (hKey != HKEY_USERS))
+        {
+            return ERROR_INVALID_HANDLE;
+        }
+
+        *result = AddOpenKey(details::PredefinedKeyName(hKey), KEY_ALL_ACCESS);
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::GetValue(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const LPCWSTR valueName,
+    const DWORD flags,
+    const LPDWORD type,
+    void* const data,
+    const LPDWORD dataSize) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if ((data != nullptr) && (dataSize == nullptr))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        // Reading through a subkey only needs the subkey to be readable
+        const bool hasSubKey = (subKey != nullptr) && (*subKey != L'\0');
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, hasSubKey ? 0 : KEY_QUERY_VALUE, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        const std::wstring keyPath = details::JoinKeyPath(openKey->Path, subKey);
+        const RegTree::ValuePtr value = StoreFindValue(keyPath, (valueName != nullptr) ? valueName : L"");
+        if (!value)
+        {
+            return KeyExists(keyPath) ? ERROR_FILE_NOT_FOUND : MissingKeyError(keyPath, subKey);
+        }
+
+        // Without RRF_NOEXPAND, REG_EXPAND_SZ data is returned as REG_SZ
+        const bool expand = (value->Type == REG_EXPAND_SZ) && ((flags & RRF_NOEXPAND) == 0);
+        DWORD allowedFlags = details::RegGetValueTypeFlag(value->Type);
+        if (expand)
+        {
+            allowedFlags |= RRF_RT_REG_SZ;
+        }
+        if (((flags & RRF_RT_ANY) != RRF_RT_ANY) && ((flags & allowedFlags) == 0))
+        {
+            return ERROR_UNSUPPORTED_TYPE;
+        }
+
+        const DWORD terminatorSize = details::MissingStringTerminators(*value) * sizeof(wchar_t);
+        const DWORD requiredSize = value->DataSize + terminatorSize;
+
+        if (type != nullptr)
+        {
+            *type = expand ? REG_SZ : value->Type;
+        }
+
+        if (data == nullptr)
+        {
+            if (dataSize != nullptr)
+            {
+                *dataSize = requiredSize;
+            }
+            return ERROR_SUCCESS;
+        }
+
+        if (*dataSize < requiredSize)
+        {
+            if ((flags & RRF_ZEROONFAILURE) != 0)
+            {
+                std::memset(data, 0, *dataSize);
+            }
+            *dataSize = requiredSize;
+            return ERROR_MORE_DATA;
+        }
+
+        if (value->DataSize > 0)
+        {
+            std::memcpy(data, value->Data, value->DataSize);
+        }
+        std::memset(static_cast<BYTE*>(data) + value->DataSize, 0, terminatorSize);
+        *dataSize = requiredSize;
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::QueryValueEx(
+    const HKEY hKey,
+    const LPCWSTR valueName,
+    [[maybe_unused]] const LPDWORD reserved,
+    const LPDWORD type,
+    BYTE* const data,
+    const LPDWORD dataSize) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if ((data != nullptr) && (dataSize == nullptr))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, KEY_QUERY_VALUE, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        const RegTree::ValuePtr value = StoreFindValue(openKey->Path, (valueName != nullptr) ? valueName : L"");
+        if (!value)
+        {
+            return KeyExists(openKey->Path) ? ERROR_FILE_NOT_FOUND : ERROR_KEY_DELETED;
+        }
+
+        if (type != nullptr)
+        {
+            *type = value->Type;
+        }
+
+        if (data != nullptr)
+        {
+            if (*dataSize < value->DataSize)
+            {
+                *dataSize = value->DataSize;
+                return ERROR_MORE_DATA;
+            }
+            if (value->DataSize > 0)
+            {
+                std::memcpy(data, value->Data, value->DataSize);
+            }
+        }
+
+        if (dataSize != nullptr)
+        {
+            *dataSize = value->DataSize;
+        }
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::SetValueEx(
+    const HKEY hKey,
+    const LPCWSTR valueName,
+    [[maybe_unused]] const DWORD reserved,
+    const DWORD type,
+    const BYTE* const data,
+    const DWORD dataSize) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if ((data == nullptr) && (dataSize != 0))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, KEY_SET_VALUE, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        // Don't recreate a deleted key
+        if (!KeyExists(openKey->Path))
+        {
+            return ERROR_KEY_DELETED;
+        }
+
+        StoreSetValue(openKey->Path, (valueName != nullptr) ? valueName : L"", type, data, dataSize);
+        NotifyChange(openKey->Path, REG_NOTIFY_CHANGE_LAST_SET);
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::SetKeyValue(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const LPCWSTR valueName,
+    const DWORD type,
+    const void* const data,
+    const DWORD dataSize) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if ((data == nullptr) && (dataSize != 0))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        const bool hasSubKey = (subKey != nullptr) && (*subKey != L'\0');
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, hasSubKey ? KEY_CREATE_SUB_KEY : KEY_SET_VALUE, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+        if (!KeyExists(openKey->Path))
+        {
+            return ERROR_KEY_DELETED;
+        }
+
+        // The subkey is created if missing
+        const std::wstring keyPath = details::JoinKeyPath(openKey->Path, subKey);
+        if (hasSubKey && StoreCreateKey(keyPath))
+        {
+            NotifyChange(details::ParentKeyPath(keyPath), REG_NOTIFY_CHANGE_NAME);
+        }
+
+        StoreSetValue(keyPath, (valueName != nullptr) ? valueName : L"", type,
+                      static_cast<const BYTE*>(data), dataSize);
+        NotifyChange(keyPath, REG_NOTIFY_CHANGE_LAST_SET);
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::QueryInfoKey(
+    const HKEY hKey,
+    const LPWSTR keyClass,
+    const LPDWORD keyClassLength,
+    [[maybe_unused]] const LPDWORD reserved,
+    const LPDWORD subKeyCount,
+    const LPDWORD maxSubKeyNameLength,
+    const LPDWORD maxClassLength,
+    const LPDWORD valueCount,
+    const LPDWORD maxValueNameLength,
+    const LPDWORD maxValueDataLength,
+    const LPDWORD securityDescriptorSize,
+    FILETIME* const lastWriteTime) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, KEY_QUERY_VALUE, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        std::vector<std::wstring> subKeyNames;
+        std::vector<RegTree::ValuePtr> values;
+        if (!StoreReadSubKeys(openKey->Path, subKeyNames) || !StoreReadValues(openKey->Path, values))
+        {
+            if (!KeyExists(openKey->Path))
+            {
+                return ERROR_KEY_DELETED;
+            }
+
+            // An empty predefined key
+            subKeyNames.clear();
+            values.clear();
+        }
+
+        size_t maxSubKeyName = 0;
+        for (const std::wstring& name : subKeyNames)
+        {
+            maxSubKeyName = (std::max)(maxSubKeyName, name.length());
+        }
+
+        size_t maxValueName = 0;
+        DWORD maxValueData = 0;
+        for (const RegTree::ValuePtr& value : values)
+        {
+            maxValueName = (std::max)(maxValueName, value->Name.length());
+            maxValueData = (std::max)(maxValueData, value->DataSize);
+        }
+
+        details::StoreEmptyKeyClass(keyClass, keyClassLength);
+        if (subKeyCount != nullptr)
+        {
+            *subKeyCount = static_cast<DWORD>(subKeyNames.size());
+        }
+        if (maxSubKeyNameLength != nullptr)
+        {
+            *maxSubKeyNameLength = static_cast<DWORD>(maxSubKeyName);
+        }
+        if (maxClassLength != nullptr)
+        {
+            *maxClassLength = 0;
+        }
+        if (valueCount != nullptr)
+        {
+            *valueCount = static_cast<DWORD>(values.size());
+        }
+        if (maxValueNameLength != nullptr)
+        {
+            *maxValueNameLength = static_cast<DWORD>(maxValueName);
+        }
+        if (maxValueDataLength != nullptr)
+        {
+            *maxValueDataLength = maxValueData;
+        }
+        if (securityDescriptorSize != nullptr)
+        {
+            *securityDescriptorSize = 0;
+        }
+        if (lastWriteTime != nullptr)
+        {
+            *lastWriteTime = details::MakeFileTime(m_lastWriteTime.load(std::memory_order_relaxed));
+        }
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::EnumKeyEx(
+    const HKEY hKey,
+    const DWORD index,
+    const LPWSTR name,
+    const LPDWORD nameLength,
+    [[maybe_unused]] const LPDWORD reserved,
+    const LPWSTR keyClass,
+    const LPDWORD keyClassLength,
+    FILETIME* const lastWriteTime) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, KEY_ENUMERATE_SUB_KEYS, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        std::shared_ptr<const std::vector<std::wstring>> subKeyNames;
+        {
+            std::lock_guard<std::mutex> lock{ openKey->SnapshotMutex };
+            if ((index == 0) || !openKey->SubKeyNames)
+            {
+                auto snapshot = std::make_shared<std::vector<std::wstring>>();
+                if (!StoreReadSubKeys(openKey->Path, *snapshot) && !KeyExists(openKey->Path))
+                {
+                    return ERROR_KEY_DELETED;
+                }
+                openKey->SubKeyNames = std::move(snapshot);
+            }
+            subKeyNames = openKey->SubKeyNames;
+        }
+
+        if (index >= subKeyNames->size())
+        {
+            return ERROR_NO_MORE_ITEMS;
+        }
+
+        retCode = details::CopyNameToBuffer((*subKeyNames)[index], name, nameLength);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        details::StoreEmptyKeyClass(keyClass, keyClassLength);
+        if (lastWriteTime != nullptr)
+        {
+            *lastWriteTime = details::MakeFileTime(m_lastWriteTime.load(std::memory_order_relaxed));
+        }
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::EnumValue(
+    const HKEY hKey,
+    const DWORD index,
+    const LPWSTR valueName,
+    const LPDWORD valueNameLength,
+    [[maybe_unused]] const LPDWORD reserved,
+    const LPDWORD type,
+    BYTE* const data,
+    const LPDWORD dataSize) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if ((data != nullptr) && (dataSize == nullptr))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, KEY_QUERY_VALUE, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        std::shared_ptr<const std::vector<RegTree::ValuePtr>> values;
+        {
+            std::lock_guard<std::mutex> lock{ openKey->SnapshotMutex };
+            if ((index == 0) || !openKey->Values)
+            {
+                auto snapshot = std::make_shared<std::vector<RegTree::ValuePtr>>();
+                if (!StoreReadValues(openKey->Path, *snapshot) && !KeyExists(openKey->Path))
+                {
+                    return ERROR_KEY_DELETED;
+                }
+                openKey->Values = std::move(snapshot);
+            }
+            values = openKey->Values;
+        }
+
+        if (index >= values->size())
+        {
+            return ERROR_NO_MORE_ITEMS;
+        }
+
+        const RegTree::Value& value = *(*values)[index];
+        retCode = details::CopyNameToBuffer(value.Name, valueName, valueNameLength);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        if (type != nullptr)
+        {
+            *type = value.Type;
+        }
+
+        if (data != nullptr)
+        {
+            if (*dataSize < value.DataSize)
+            {
+                *dataSize = value.DataSize;
+                return ERROR_MORE_DATA;
+            }
+            if (value.DataSize > 0)
+            {
+                std::memcpy(data, value.Data, value.DataSize);
+            }
+        }
+
+        if (dataSize != nullptr)
+        {
+            *dataSize = value.DataSize;
+        }
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::DeleteValue(const HKEY hKey, const LPCWSTR valueName) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, KEY_SET_VALUE, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        if (!StoreDeleteValue(openKey->Path, (valueName != nullptr) ? valueName : L""))
+        {
+            return KeyExists(openKey->Path) ? ERROR_FILE_NOT_FOUND : ERROR_KEY_DELETED;
+        }
+
+        NotifyChange(openKey->Path, REG_NOTIFY_CHANGE_LAST_SET);
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::DeleteKeyEx(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    [[maybe_unused]] const REGSAM desiredAccess,
+    [[maybe_unused]] const DWORD reserved) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if (subKey == nullptr)
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, 0, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        // An empty subkey deletes the key of the handle; not a predefined key
+        const std::wstring keyPath = details::JoinKeyPath(openKey->Path, subKey);
+        if (keyPath.find(L'\\') == std::wstring::npos)
+        {
+            return ERROR_ACCESS_DENIED;
+        }
+
+        retCode = StoreDeleteKey(keyPath);
+        if (retCode == ERROR_FILE_NOT_FOUND)
+        {
+            return MissingKeyError(keyPath, subKey);
+        }
+        if (retCode == ERROR_SUCCESS)
+        {
+            NotifyKeyRemoved(keyPath);
+        }
+        return retCode;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::DeleteTree(const HKEY hKey, const LPCWSTR subKey) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, 0, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        if ((subKey != nullptr) && (*subKey != L'\0'))
+        {
+            const std::wstring keyPath = details::JoinKeyPath(openKey->Path, subKey);
+            if (!StoreDeleteTree(keyPath))
+            {
+                return MissingKeyError(keyPath, subKey);
+            }
+
+            NotifyKeyRemoved(keyPath);
+            return ERROR_SUCCESS;
+        }
+
+        // Without a subkey, delete the content of the key, keeping the key
+        std::vector<std::wstring> subKeyNames;
+        std::vector<RegTree::ValuePtr> values;
+        if (!StoreReadSubKeys(openKey->Path, subKeyNames) || !StoreReadValues(openKey->Path, values))
+        {
+            return KeyExists(openKey->Path) ? ERROR_SUCCESS : ERROR_KEY_DELETED;
+        }
+
+        for (const std::wstring& name : subKeyNames)
+        {
+            const std::wstring keyPath = details::JoinKeyPath(openKey->Path, name.c_str());
+            if (StoreDeleteTree(keyPath))
+            {
+                NotifyKeyRemoved(keyPath);
+            }
+        }
+        for (const RegTree::ValuePtr& value : values)
+        {
+            if (StoreDeleteValue(openKey->Path, value->Name))
+            {
+                NotifyChange(openKey->Path, REG_NOTIFY_CHANGE_LAST_SET);
+            }
+        }
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline void RegMemoryBackend::CopySubtree(const std::wstring_view sourcePath, const std::wstring_view destPath)
+{
+    // Read the whole source first, so that copying a key into its own
+    // subtree terminates
+    struct KeyContent
+    {
+        std::wstring                   RelativePath;
+        std::vector<RegTree::ValuePtr> Values;
+    };
+
+    std::vector<KeyContent> keys;
+    std::vector<std::wstring> pending{ std::wstring{} };
+    while (!pending.empty())
+    {
+        KeyContent key;
+        key.RelativePath = std::move(pending.back());
+        pending.pop_back();
+
+        const std::wstring keyPath = key.RelativePath.empty()
+            ? std::wstring{ sourcePath } : details::JoinKeyPath(sourcePath, key.RelativePath.c_str());
+
+        std::vector<std::wstring> subKeyNames;
+        if (!StoreReadSubKeys(keyPath, subKeyNames) || !StoreReadValues(keyPath, key.Values))
+        {
+            // Deleted meanwhile
+            continue;
+        }
+
+        for (const std::wstring& name : subKeyNames)
+        {
+            pending.push_back(key.RelativePath.empty() ? name : (key.RelativePath + L'\\' + name));
+        }
+        keys.push_back(std::move(key));
+    }
+
+    for (const KeyContent& key : keys)
+    {
+        const std::wstring keyPath = key.RelativePath.empty()
+            ? std::wstring{ destPath } : details::JoinKeyPath(destPath, key.RelativePath.c_str());
+
+        if (StoreCreateKey(keyPath))
+        {
+            NotifyChange(details::ParentKeyPath(keyPath), REG_NOTIFY_CHANGE_NAME);
+        }
+        for (const RegTree::ValuePtr& value : key.Values)
+        {
+            StoreSetValue(keyPath, value->Name, value->Type, value->Data, value->DataSize);
+        }
+        if (!key.Values.empty())
+        {
+            NotifyChange(keyPath, REG_NOTIFY_CHANGE_LAST_SET);
+        }
+    }
+}
+
+
+inline LSTATUS RegMemoryBackend::CopyTree(const HKEY hKeySource, const LPCWSTR subKey, const HKEY hKeyDest) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        OpenKeyPtr sourceKey;
+        LSTATUS retCode = FindOpenKey(hKeySource, KEY_QUERY_VALUE | KEY_ENUMERATE_SUB_KEYS, sourceKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        OpenKeyPtr destKey;
+        retCode = FindOpenKey(hKeyDest, KEY_CREATE_SUB_KEY | KEY_SET_VALUE, destKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        const std::wstring sourcePath = details::JoinKeyPath(sourceKey->Path, subKey);
+        if (!KeyExists(sourcePath))
+        {
+            return MissingKeyError(sourcePath, subKey);
+        }
+        if (!KeyExists(destKey->Path))
+        {
+            return ERROR_KEY_DELETED;
+        }
+
+        CopySubtree(sourcePath, destKey->Path);
+        return ERROR_SUCCESS;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::RenameKey(const HKEY hKey, const LPCWSTR subKey, const LPCWSTR newKeyName) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if ((newKeyName == nullptr) || (*newKeyName == L'\0') || (std::wcschr(newKeyName, L'\\') != nullptr))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        OpenKeyPtr openKey;
+        LSTATUS retCode = FindOpenKey(hKey, 0, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        // Without a subkey, rename the key of the handle; not a predefined key
+        const std::wstring keyPath = details::JoinKeyPath(openKey->Path, subKey);
+        if (keyPath.find(L'\\') == std::wstring::npos)
+        {
+            return ERROR_ACCESS_DENIED;
+        }
+
+        retCode = StoreRenameKey(keyPath, newKeyName);
+        if (retCode == ERROR_FILE_NOT_FOUND)
+        {
+            return MissingKeyError(keyPath, subKey);
+        }
+        if (retCode == ERROR_SUCCESS)
+        {
+            NotifyKeyRemoved(keyPath);
+        }
+        return retCode;
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::FlushKey(const HKEY hKey) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        OpenKeyPtr openKey;
+        const LSTATUS retCode = FindOpenKey(hKey, 0, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        return StoreFlush();
+    });
+}
+
+
+inline LSTATUS RegMemoryBackend::NotifyChangeKeyValue(
+    const HKEY hKey,
+    const BOOL watchSubtree,
+    const DWORD notifyFilter,
+    const HANDLE event,
+    const BOOL asynchronous) noexcept
+{
+    return Guarded([&]() -> LSTATUS {
+        if (asynchronous && (event == nullptr))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        OpenKeyPtr openKey;
+        const LSTATUS retCode = FindOpenKey(hKey, KEY_NOTIFY, openKey);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+        if (!KeyExists(openKey->Path))
+        {
+            return ERROR_KEY_DELETED;
+        }
+
+        Watch watch;
+        watch.Handle = hKey;
+        watch.FoldedPath = details::FoldKeyPath(openKey->Path);
+        watch.WatchSubtree = (watchSubtree != FALSE);
+        watch.NotifyFilter = notifyFilter;
+        watch.Event = asynchronous ? event : nullptr;
+
+        std::unique_lock<std::mutex> lock{ m_watchMutex };
+        const std::uint64_t watchId = m_nextWatchId++;
+        watch.Id = watchId;
+        m_watches.push_back(std::move(watch));
+        m_watchCount.store(m_watches.size(), std::memory_order_relaxed);
+
+        if (!asynchronous)
+        {
+            // Wait until the watch is signaled (and removed)
+            m_watchSignaled.wait(lock, [this, watchId] {
+                return std::none_of(m_watches.begin(), m_watches.end(),
+                                    [watchId](const Watch& pending) { return pending.Id == watchId; });
+            });
+        }
+        return ERROR_SUCCESS;
+    });
+}
+
+
+//------------------------------------------------------------------------------
+//                      RegTreeBackend Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegTreeBackend::RegTreeBackend(RegTree tree)
+    : m_tree{ std::move(tree) }
+{}
+
+
+inline RegTree RegTreeBackend::Snapshot() const
+{
+    std::shared_lock<std::shared_mutex> lock{ m_mutex };
+    return m_tree;
+}
+
+
+inline void RegTreeBackend::Reset(RegTree tree)
+{
+    std::unique_lock<std::shared_mutex> lock{ m_mutex };
+    m_tree = std::move(tree);
+}
+
+
+inline bool RegTreeBackend::StoreContainsKey(const std::wstring_view keyPath)
+{
+    std::shared_lock<std::shared_mutex> lock{ m_mutex };
+    return m_tree.ContainsKey(keyPath);
+}
+
+
+inline RegTree::ValuePtr RegTreeBackend::StoreFindValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName)
+{
+    std::shared_lock<std::shared_mutex> lock{ m_mutex };
+    return details::FindTreeValue(m_tree, keyPath, valueName);
+}
+
+
+inline bool RegTreeBackend::StoreReadSubKeys(
+    const std::wstring_view keyPath,
+    std::vector<std::wstring>& subKeyNames)
+{
+    std::shared_lock<std::shared_mutex> lock{ m_mutex };
+    return details::ReadTreeSubKeys(m_tree, keyPath, subKeyNames);
+}
+
+
+inline bool RegTreeBackend::StoreReadValues(
+    const std::wstring_view keyPath,
+    std::vector<RegTree::ValuePtr>& values)
+{
+    std::shared_lock<std::shared_mutex> lock{ m_mutex };
+    return details::ReadTreeValues(m_tree, keyPath, values);
+}
+
+
+inline bool RegTreeBackend::StoreCreateKey(const std::wstring_view keyPath)
+{
+    std::unique_lock<std::shared_mutex> lock{ m_mutex };
+    return details::CreateTreeKey(m_tree, keyPath);
+}
+
+
+inline void RegTreeBackend::StoreSetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize)
+{
+    std::unique_lock<std::shared_mutex> lock{ m_mutex };
+    m_tree.SetValue(keyPath, valueName, type, data, dataSize);
+}
+
+
+inline bool RegTreeBackend::StoreDeleteValue(const std::wstring_view keyPath, const std::wstring_view valueName)
+{
+    std::unique_lock<std::shared_mutex> lock{ m_mutex };
+    return m_tree.DeleteValue(keyPath, valueName);
+}
+
+
+inline bool RegTreeBackend::StoreDeleteTree(const std::wstring_view keyPath)
+{
+    std::unique_lock<std::shared_mutex> lock{ m_mutex };
+    return m_tree.DeleteTree(keyPath);
+}
+
+
+inline LSTATUS RegTreeBackend::StoreDeleteKey(const std::wstring_view keyPath)
+{
+    std::unique_lock<std::shared_mutex> lock{ m_mutex };
+    return details::DeleteTreeKey(m_tree, keyPath);
+}
+
+
+inline LSTATUS RegTreeBackend::StoreRenameKey(const std::wstring_view keyPath, const std::wstring_view newKeyName)
+{
+    std::unique_lock<std::shared_mutex> lock{ m_mutex };
+    return details::RenameTreeKey(m_tree, keyPath, newKeyName);
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGMEMORYBACKEND_HPP_INCLUDED
@@ -0,0 +1,432 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGNAMEPOOL_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGNAMEPOOL_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegNamePool: a thread-safe pool of interned key and value names, and the
+// RegKey::EnumSubKeys and RegKey::EnumValues overloads that intern into it.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "WinReg.hpp"       // RegKey
+
+#include <algorithm>        // std::copy, std::min, std::max
+#include <cstdint>          // std::uint64_t
+#include <memory>           // std::unique_ptr, std::make_unique
+#include <mutex>            // std::unique_lock
+#include <shared_mutex>     // std::shared_mutex, std::shared_lock
+#include <string_view>      // std::wstring_view
+#include <unordered_set>    // std::unordered_set
+#include <utility>          // std::move, std::pair
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// A thread-safe pool of interned key and value names.
+//
+// Walking large trees meets the same names over and over (e.g. "Parameters",
+// "Enum", "DisplayName"). Interned, each distinct name is stored only once,
+// and all its occurrences are the same NUL-terminated view: two names interned
+// in the same pool are equal exactly when their data pointers are equal.
+//
+// Like registry names, interned names are case-insensitive (compared with
+// ordinal upper-case folding): "Parameters" and "parameters" are the same
+// name, and the pool keeps the case of the first one interned.
+// The characters are stored in fixed-size chunks
+// that are never moved or freed before the pool, so the views are valid as
+// long as the pool lives.
+//
+// Like in RegConcurrentTree, the lookup table is split into shards, each with
+// its own reader-writer lock: names already in the pool are found under
+// a shared lock, and only adding a name takes an exclusive one.
+//------------------------------------------------------------------------------
+class RegNamePool
+{
+public:
+
+    static constexpr size_t kDefaultShardCount = 16;
+
+    // Initialize an empty pool
+    explicit RegNamePool(size_t shardCount = kDefaultShardCount);
+
+    // Ban copy and move (the object is shared among threads)
+    RegNamePool(const RegNamePool&) = delete;
+    RegNamePool& operator=(const RegNamePool&) = delete;
+    RegNamePool(RegNamePool&&) = delete;
+    RegNamePool& operator=(RegNamePool&&) = delete;
+
+    // Return the interned copy of the name (that may differ in case),
+    // adding it to the pool if needed
+    [[nodiscard]] std::wstring_view Intern(std::wstring_view name);
+
+    // Return the interned copy of the name (that may differ in case),
+    // or an empty view with a null data pointer if the name is not in the pool
+    [[nodiscard]] std::wstring_view Find(std::wstring_view name) const;
+
+    // Number of distinct names in the pool
+    [[nodiscard]] size_t Size() const;
+
+    // Bytes allocated to store the names (including the unused tail
+    // of the last chunk of each shard)
+    [[nodiscard]] size_t StorageBytes() const;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Length of the storage chunks, in wchar_ts: the first chunk of a shard
+    // is small, and each following one doubles, up to the maximum length
+    static constexpr size_t kMinChunkLength = 256;
+    static constexpr size_t kMaxChunkLength = 16 * 1024;
+
+    // Hash and compare names ignoring case
+    struct NameHash
+    {
+        [[nodiscard]] size_t operator()(std::wstring_view name) const noexcept;
+    };
+
+    struct NameEqual
+    {
+        [[nodiscard]] bool operator()(std::wstring_view a, std::wstring_view b) const noexcept;
+    };
+
+    struct Shard
+    {
+        mutable std::shared_mutex                                     Mutex;
+        std::unordered_set<std::wstring_view, NameHash, NameEqual>    Names;    // views into Chunks
+        std::vector<std::unique_ptr<wchar_t[]>>                       Chunks;
+        size_t                                                        LastChunkLength{ 0 };
+        size_t                                                        LastChunkUsed{ 0 };
+        size_t                                                        StorageLength{ 0 };
+    };
+
+    [[nodiscard]] Shard& ShardOf(std::wstring_view name) const noexcept;
+
+    // Copy the name (NUL-terminated) into the chunks of the shard,
+    // and return the stored copy. Must be called with the shard lock held.
+    [[nodiscard]] static std::wstring_view Store(Shard& shard, std::wstring_view name);
+
+    std::unique_ptr<Shard[]> m_shards;
+    size_t                   m_shardCount;
+};
+
+
+//------------------------------------------------------------------------------
+//                          RegNamePool Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegNamePool::RegNamePool(const size_t shardCount)
+    : m_shards{ std::make_unique<Shard[]>((shardCount > 0) ? shardCount : 1) }
+    , m_shardCount{ (shardCount > 0) ? shardCount : 1 }
+{}
+
+
+inline size_t RegNamePool::NameHash::operator()(const std::wstring_view name) const noexcept
+{
+    // Fold the name a piece at a time, with one LCMapStringEx call per piece
+    // for non-ASCII names
+    std::uint64_t hash = details::kFnvOffsetBasis;
+    details::ForEachFoldedChunk(name, [&hash](const std::wstring_view chunk)
+        {
+            hash = details::HashString(chunk, StringComparison::CaseSensitive, hash);
+        }
+    );
+    return static_cast<size_t>(hash);
+}
+
+
+inline bool RegNamePool::NameEqual::operator()(
+    const std::wstring_view a,
+    const std::wstring_view b
+) const noexcept
+{
+    return (a == b) || details::EqualStrings(a, b, StringComparison::IgnoreCase);
+}
+
+
+inline RegNamePool::Shard& RegNamePool::ShardOf(const std::wstring_view name) const noexcept
+{
+    return m_shards[NameHash{}(name) % m_shardCount];
+}
+
+
+inline std::wstring_view RegNamePool::Store(Shard& shard, const std::wstring_view name)
+{
+    const size_t length = name.length() + 1;
+    wchar_t* storage = nullptr;
+
+    if (length > kMaxChunkLength)
+    {
+        // Long names get a chunk of their own, keeping the current last chunk
+        auto chunk = std::make_unique<wchar_t[]>(length);
+        storage = chunk.get();
+        shard.Chunks.insert(shard.Chunks.empty() ? shard.Chunks.end() : shard.Chunks.end() - 1,
+                            std::move(chunk));
+        shard.StorageLength += length;
+    }
+    else
+    {
+        if (shard.LastChunkUsed + length > shard.LastChunkLength)
+        {
+            size_t chunkLength = (std::min)(
+                (std::max)(shard.LastChunkLength * 2, kMinChunkLength), kMaxChunkLength);
+            while (chunkLength < length)
+            {
+                chunkLength *= 2;
+            }
+
+            shard.Chunks.push_back(std::make_unique<wchar_t[]>(chunkLength));
+            shard.LastChunkLength = chunkLength;
+            shard.LastChunkUsed = 0;
+            shard.StorageLength += chunkLength;
+        }
+        storage = shard.Chunks.back().get() + shard.LastChunkUsed;
+        shard.LastChunkUsed += length;
+    }
+
+    std::copy(name.begin(), name.end(), storage);
+    storage[name.length()] = L'\0';
+    return std::wstring_view{ storage, name.length() };
+}
+
+
+inline std::wstring_view RegNamePool::Intern(const std::wstring_view name)
+{
+    Shard& shard = ShardOf(name);
+    {
+        std::shared_lock<std::shared_mutex> lock{ shard.Mutex };
+        auto it = shard.Names.find(name);
+        if (it != shard.Names.end())
+        {
+            return *it;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock{ shard.Mutex };
+
+    // Another thread may have added the name meanwhile
+    auto it = shard.Names.find(name);
+    if (it != shard.Names.end())
+    {
+        return *it;
+    }
+
+    const std::wstring_view stored = Store(shard, name);
+    shard.Names.insert(stored);
+    return stored;
+}
+
+
+inline std::wstring_view RegNamePool::Find(const std::wstring_view name) const
+{
+    const Shard& shard = ShardOf(name);
+    std::shared_lock<std::shared_mutex> lock{ shard.Mutex };
+
+    auto it = shard.Names.find(name);
+    return (it != shard.Names.end()) ? *it : std::wstring_view{};
+}
+
+
+inline size_t RegNamePool::Size() const
+{
+    size_t size = 0;
+    for (size_t index = 0; index < m_shardCount; index++)
+    {
+        std::shared_lock<std::shared_mutex> lock{ m_shards[index].Mutex };
+        size += m_shards[index].Names.size();
+    }
+    return size;
+}
+
+
+inline size_t RegNamePool::StorageBytes() const
+{
+    size_t length = 0;
+    for (size_t index = 0; index < m_shardCount; index++)
+    {
+        std::shared_lock<std::shared_mutex> lock{ m_shards[index].Mutex };
+        length += m_shards[index].StorageLength;
+    }
+    return length * sizeof(wchar_t);
+}
+
+
+//------------------------------------------------------------------------------
+//              RegKey Enumeration into a RegNamePool Inline Methods
+//------------------------------------------------------------------------------
+
+
+inline std::vector<std::wstring_view> RegKey::EnumSubKeys(RegNamePool& namePool) const
+{
+    RegExpected<std::vector<std::wstring_view>> subKeyNames = TryEnumSubKeys(namePool);
+    if (!subKeyNames)
+    {
+        throw RegException{ subKeyNames.GetError().Code(), "RegEnumKeyExW failed." };
+    }
+
+    return subKeyNames.GetValue();
+}
+
+
+inline std::vector<std::pair<std::wstring_view, DWORD>> RegKey::EnumValues(RegNamePool& namePool) const
+{
+    RegExpected<std::vector<std::pair<std::wstring_view, DWORD>>> valueInfo = TryEnumValues(namePool);
+    if (!valueInfo)
+    {
+        throw RegException{ valueInfo.GetError().Code(), "RegEnumValueW failed." };
+    }
+
+    return valueInfo.GetValue();
+}
+
+
+inline RegExpected<std::vector<std::wstring_view>> RegKey::TryEnumSubKeys(RegNamePool& namePool) const
+{
+    _ASSERTE(IsValid());
+
+    using ReturnType = std::vector<std::wstring_view>;
+
+    DWORD subKeyCount = 0;
+    DWORD maxSubKeyNameLen = 0;
+    LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        m_hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        &subKeyCount,
+        &maxSubKeyNameLen,
+        nullptr,    // no subkey class length
+        nullptr,    // no value count
+        nullptr,    // no value name max length
+        nullptr,    // no max value length
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<ReturnType>{ RegResult{ retCode } };
+    }
+
+    // Intern each name straight from a single reused buffer
+    const DWORD nameBufferLen = maxSubKeyNameLen + 1;
+    auto nameBuffer = std::make_unique<wchar_t[]>(nameBufferLen);
+    details::RecordAllocation(RegAllocationCategory::Enumeration, nameBufferLen * sizeof(wchar_t));
+    ReturnType subKeyNames;
+    details::ReserveAccounted(RegAllocationCategory::Enumeration, subKeyNames, subKeyCount);
+
+    for (DWORD index = 0; index < subKeyCount; index++)
+    {
+        DWORD subKeyNameLen = nameBufferLen;
+        retCode = details::TracedRegEnumKeyExW(
+            __func__,
+            m_hKey,
+            index,
+            nameBuffer.get(),
+            &subKeyNameLen,
+            nullptr, // reserved
+            nullptr, // no class
+            nullptr, // no class
+            nullptr  // no last write time
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegExpected<ReturnType>{ RegResult{ retCode } };
+        }
+
+        subKeyNames.push_back(namePool.Intern(std::wstring_view{ nameBuffer.get(), subKeyNameLen }));
+    }
+
+    return RegExpected<ReturnType>{ std::move(subKeyNames) };
+}
+
+
+inline RegExpected<std::vector<std::pair<std::wstring_view, DWORD>>>
+    RegKey::TryEnumValues(RegNamePool& namePool) const
+{
+    _ASSERTE(IsValid());
+
+    using ReturnType = std::vector<std::pair<std::wstring_view, DWORD>>;
+
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        m_hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        nullptr,    // no subkey count
+        nullptr,    // no subkey max length
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        nullptr,    // no max value length
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<ReturnType>{ RegResult{ retCode } };
+    }
+
+    // Intern each name straight from a single reused buffer
+    const DWORD nameBufferLen = maxValueNameLen + 1;
+    auto nameBuffer = std::make_unique<wchar_t[]>(nameBufferLen);
+    details::RecordAllocation(RegAllocationCategory::Enumeration, nameBufferLen * sizeof(wchar_t));
+    ReturnType valueInfo;
+    details::ReserveAccounted(RegAllocationCategory::Enumeration, valueInfo, valueCount);
+
+    for (DWORD index = 0; index < valueCount; index++)
+    {
+        DWORD valueNameLen = nameBufferLen;
+        DWORD valueType = 0;
+        retCode = details::TracedRegEnumValueW(
+            __func__,
+            m_hKey,
+            index,
+            nameBuffer.get(),
+            &valueNameLen,
+            nullptr,    // reserved
+            &valueType,
+            nullptr,    // no data
+            nullptr     // no data size
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegExpected<ReturnType>{ RegResult{ retCode } };
+        }
+
+        valueInfo.emplace_back(namePool.Intern(std::wstring_view{ nameBuffer.get(), valueNameLen }), valueType);
+    }
+
+    return RegExpected<ReturnType>{ std::move(valueInfo) };
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGNAMEPOOL_HPP_INCLUDED
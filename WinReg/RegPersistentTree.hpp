@@ -0,0 +1,1301 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGPERSISTENTTREE_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGPERSISTENTTREE_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegPersistentTree: a durable in-memory registry tree, whose changes are
+// recorded in a write-ahead log on disk (with group commit and checkpoints),
+// and RegPersistentTreeBackend, to use it as the registry of RegKey.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegMemoryBackend.hpp" // RegMemoryBackend
+#include "RegVersionedTree.hpp"// RegVersionedTree
+
+#include <algorithm>        // std::copy
+#include <cstdint>          // std::uint32_t
+#include <cstring>          // std::memcpy
+#include <iterator>         // std::begin, std::end
+#include <limits>           // std::numeric_limits
+#include <memory>           // std::unique_ptr, std::make_unique
+#include <mutex>            // std::mutex, std::lock_guard
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <utility>          // std::move, std::exchange
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Options
+//
+
+// Options for the write-ahead log of RegPersistentTree
+struct RegJournalOptions
+{
+    // Group commit: number of operations buffered before they are written
+    // to the log and flushed to disk together.
+    // 1 makes every operation durable before it returns;
+    // 0 flushes only on explicit Flush (or Checkpoint, or Close) calls.
+    size_t FlushEveryOperations = 64;
+
+    // Size of the log, in bytes, above which a compacted checkpoint is
+    // written (and the log emptied) after a flush; 0 disables automatic
+    // checkpoints.
+    ULONGLONG CheckpointLogSize = 16 * 1024 * 1024;
+};
+
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// A durable in-memory registry tree: a RegVersionedTree whose changes are
+// recorded in a write-ahead log on disk.
+//
+// Two files are used, named after the base path passed to Open:
+//
+// - <basePath>.log: an append-only log of create-key, set-value,
+//   delete-value and delete-tree operations, each record protected by
+//   a checksum (a key rename is logged as a copy of the subtree followed
+//   by its deletion). Records are buffered and written with group commit
+//   (see RegJournalOptions); Flush makes everything durable, like
+//   RegKey::FlushKey does for the registry.
+//
+// - <basePath>.checkpoint: a compacted image of the whole tree, written to a
+//   temporary file and then atomically renamed; the log is then emptied.
+//
+// On Open, the checkpoint is loaded and the log replayed on top of it; a torn
+// record at the end of the log (e.g. after a crash in the middle of a write)
+// is discarded. Log operations are blind writes, so replaying a log
+// on top of a checkpoint that already includes it gives the same tree.
+//
+// Writers are serialized, so that the log order matches the order in which
+// the versions are published. An operation is published to readers only after
+// its record has been written to the log and flushed to disk (with group
+// commit, when its batch is flushed): snapshots never contain changes that
+// could be lost on a crash. If a log write fails, the log is truncated back to
+// the end of the last complete flush before anything else is appended.
+//------------------------------------------------------------------------------
+class RegPersistentTree
+{
+public:
+
+    // Initialize as a closed store
+    RegPersistentTree() noexcept = default;
+
+    // Ban copy and move (the object is shared among threads)
+    RegPersistentTree(const RegPersistentTree&) = delete;
+    RegPersistentTree& operator=(const RegPersistentTree&) = delete;
+    RegPersistentTree(RegPersistentTree&&) = delete;
+    RegPersistentTree& operator=(RegPersistentTree&&) = delete;
+
+    // Flush any pending operation (ignoring errors) and close the files
+    ~RegPersistentTree() noexcept;
+
+    // Open (or create) the store, recovering its content from disk.
+    // Throw RegException on failure.
+    void Open(const std::wstring& basePath, const RegJournalOptions& options = RegJournalOptions{});
+
+    // Open (or create) the store, recovering its content from disk
+    [[nodiscard]] RegResult TryOpen(const std::wstring& basePath,
+                                    const RegJournalOptions& options = RegJournalOptions{});
+
+    // Flush any pending operation and close the files
+    void Close();
+
+    // Is the store open?
+    [[nodiscard]] bool IsOpen() const noexcept;
+
+    // Return a snapshot of the durable tree (O(1)).
+    // Operations still buffered by group commit are not included.
+    [[nodiscard]] RegTree Snapshot() const;
+
+    // Call read (taking a const RegTree&) on the latest tree, including the
+    // operations still buffered by group commit, and return its result:
+    // like registry reads see the changes not yet made durable by
+    // RegFlushKey. Waits for the writers.
+    template <typename ReadFunction>
+    decltype(auto) ReadLatest(ReadFunction&& read) const;
+
+
+    //
+    // Updates: appended to the log, and published to the in-memory tree
+    // once the log is flushed.
+    // Throw RegException if writing the log fails; in that case
+    // the operation is not applied.
+    // Nothing is logged for operations that don't change the tree
+    // (they return false).
+    //
+
+    bool CreateKey(std::wstring_view keyPath);
+    void SetValue(std::wstring_view keyPath, std::wstring_view valueName,
+                  DWORD type, const std::vector<BYTE>& data);
+    bool DeleteValue(std::wstring_view keyPath, std::wstring_view valueName);
+    bool DeleteTree(std::wstring_view keyPath);
+
+    // Rename a key, keeping it under the same parent. The copy and the
+    // deletion are logged in the same batch, but a crash while writing it
+    // can leave both keys. The Try variant returns ERROR_FILE_NOT_FOUND if
+    // the key doesn't exist, and ERROR_ACCESS_DENIED if the new name is taken.
+    void RenameKey(std::wstring_view keyPath, std::wstring_view newKeyName);
+    [[nodiscard]] RegResult TryRenameKey(std::wstring_view keyPath, std::wstring_view newKeyName);
+
+
+    //
+    // Durability
+    //
+
+    // Write the pending operations to the log and flush it to disk
+    void Flush();
+    [[nodiscard]] RegResult TryFlush();
+
+    // Write a compacted checkpoint of the whole tree, and empty the log
+    void Checkpoint();
+    [[nodiscard]] RegResult TryCheckpoint();
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Append an operation record to the pending buffer, with newTree
+    // (the pending tree with the operation applied), and flush if needed.
+    // If the flush fails, the operation is discarded.
+    // Must be called with m_mutex held.
+    [[nodiscard]] LSTATUS AppendRecord(RegTree newTree,
+                                       BYTE operation,
+                                       std::wstring_view keyPath,
+                                       std::wstring_view valueName,
+                                       DWORD type,
+                                       const std::vector<BYTE>& data);
+
+    // Complete an operation whose records were appended to the pending
+    // buffer from recordStart (see AppendRecord).
+    // Must be called with m_mutex held.
+    [[nodiscard]] LSTATUS CommitPendingOperation(RegTree newTree, size_t recordStart);
+
+    // Must be called with m_mutex held
+    [[nodiscard]] LSTATUS FlushLocked();
+    [[nodiscard]] LSTATUS CheckpointLocked();
+
+    // Truncate the log to m_logSize, removing a partially written batch.
+    // Must be called with m_mutex held.
+    [[nodiscard]] LSTATUS RewindLogLocked();
+
+    // Protects the log and serializes writers
+    mutable std::mutex m_mutex;
+
+    // The durable in-memory tree, as seen by readers
+    std::unique_ptr<RegVersionedTree> m_tree;
+
+    // The tree with the pending operations applied
+    RegTree m_pendingTree;
+
+    RegJournalOptions m_options;
+    std::wstring      m_logPath;
+    std::wstring      m_checkpointPath;
+    HANDLE            m_logFile{ INVALID_HANDLE_VALUE };
+    ULONGLONG         m_logSize{ 0 };       // size of the flushed records
+    bool              m_logNeedsRewind{ false };
+
+    // Encoded records not yet written to the log
+    std::vector<BYTE> m_pendingRecords;
+    size_t            m_pendingCount{ 0 };
+};
+
+
+//------------------------------------------------------------------------------
+// An in-memory registry backend (see RegMemoryBackend) storing the keys in
+// a RegPersistentTree: the changes made with RegKey are written to its log
+// with group commit, and RegKey::FlushKey flushes the log to disk.
+// Like on the registry, reads see the changes not yet flushed.
+//------------------------------------------------------------------------------
+class RegPersistentTreeBackend : public RegMemoryBackend
+{
+public:
+
+    // Open (or create) the store named after basePath (see RegPersistentTree).
+    // Throw RegException on failure.
+    explicit RegPersistentTreeBackend(const std::wstring& basePath,
+                                      const RegJournalOptions& options = RegJournalOptions{});
+
+    // Return a snapshot of the durable content
+    [[nodiscard]] RegTree Snapshot() const;
+
+    // The persistent tree: e.g. to write a checkpoint
+    [[nodiscard]] RegPersistentTree& Tree() noexcept;
+
+protected:
+
+    [[nodiscard]] bool StoreContainsKey(std::wstring_view keyPath) override;
+    [[nodiscard]] RegTree::ValuePtr StoreFindValue(std::wstring_view keyPath,
+                                                   std::wstring_view valueName) override;
+    [[nodiscard]] bool StoreReadSubKeys(std::wstring_view keyPath,
+                                        std::vector<std::wstring>& subKeyNames) override;
+    [[nodiscard]] bool StoreReadValues(std::wstring_view keyPath,
+                                       std::vector<RegTree::ValuePtr>& values) override;
+    bool StoreCreateKey(std::wstring_view keyPath) override;
+    void StoreSetValue(std::wstring_view keyPath,
+                       std::wstring_view valueName,
+                       DWORD type,
+                       const BYTE* data,
+                       size_t dataSize) override;
+    bool StoreDeleteValue(std::wstring_view keyPath, std::wstring_view valueName) override;
+    bool StoreDeleteTree(std::wstring_view keyPath) override;
+    [[nodiscard]] LSTATUS StoreRenameKey(std::wstring_view keyPath, std::wstring_view newKeyName) override;
+    [[nodiscard]] LSTATUS StoreFlush() override;
+
+private:
+    RegPersistentTree m_tree;
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegPersistentTree
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Read a whole file into memory
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS ReadFileFully(const HANDLE file, std::vector<BYTE>& data)
+{
+    LARGE_INTEGER fileSize{};
+    if (!::GetFileSizeEx(file, &fileSize))
+    {
+        return LastErrorAsStatus();
+    }
+
+    if (static_cast<ULONGLONG>(fileSize.QuadPart) > (std::numeric_limits<size_t>::max)())
+    {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    data.resize(static_cast<size_t>(fileSize.QuadPart));
+
+    constexpr size_t kMaxChunkSize = 1024 * 1024 * 1024;
+
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        const size_t remaining = data.size() - offset;
+        const DWORD chunkSize = static_cast<DWORD>((remaining < kMaxChunkSize) ? remaining : kMaxChunkSize);
+        DWORD read = 0;
+        if (!::ReadFile(file, data.data() + offset, chunkSize, &read, nullptr))
+        {
+            return LastErrorAsStatus();
+        }
+        if (read == 0)
+        {
+            // The file shrank while reading
+            break;
+        }
+        offset += read;
+    }
+
+    data.resize(offset);
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Write-ahead log and checkpoint file format.
+//
+// Both files start with a header: a 32-bit magic number and a 32-bit format
+// version. Then a sequence of records follows, each one made by:
+//
+//   payload size (32-bit) | checksum of the payload (32-bit) | payload
+//
+// where the payload is:
+//
+//   operation (8-bit) | key path length (32-bit) | key path (UTF-16) |
+//   value name length (32-bit) | value name (UTF-16) |
+//   value type (32-bit) | data size (32-bit) | data
+//
+// Lengths are in wchar_ts; all the integers are little-endian.
+// A checkpoint is just the sequence of records that rebuilds the tree.
+//------------------------------------------------------------------------------
+
+constexpr std::uint32_t kJournalLogMagic        = 0x4A525757; // "WWRJ"
+constexpr std::uint32_t kJournalCheckpointMagic = 0x43525757; // "WWRC"
+constexpr std::uint32_t kJournalFormatVersion   = 1;
+constexpr size_t        kJournalHeaderSize      = 2 * sizeof(std::uint32_t);
+
+enum JournalOperation : BYTE
+{
+    kJournalCreateKey   = 1,
+    kJournalSetValue    = 2,
+    kJournalDeleteValue = 3,
+    kJournalDeleteTree  = 4
+};
+
+// A decoded journal record
+struct JournalRecord
+{
+    BYTE              Operation{ 0 };
+    std::wstring      KeyPath;
+    std::wstring      ValueName;
+    DWORD             Type{ REG_NONE };
+    std::vector<BYTE> Data;
+};
+
+
+//------------------------------------------------------------------------------
+// 32-bit checksum of a byte sequence (FNV-1a)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::uint32_t JournalChecksum(const BYTE* data, const size_t size) noexcept
+{
+    std::uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+
+inline void AppendJournalUInt32(std::vector<BYTE>& buffer, const std::uint32_t value)
+{
+    const BYTE bytes[] =
+    {
+        static_cast<BYTE>(value),
+        static_cast<BYTE>(value >> 8),
+        static_cast<BYTE>(value >> 16),
+        static_cast<BYTE>(value >> 24)
+    };
+    buffer.insert(buffer.end(), std::begin(bytes), std::end(bytes));
+}
+
+
+[[nodiscard]] inline std::uint32_t ReadJournalUInt32(const BYTE* data) noexcept
+{
+    return static_cast<std::uint32_t>(data[0])
+        | (static_cast<std::uint32_t>(data[1]) << 8)
+        | (static_cast<std::uint32_t>(data[2]) << 16)
+        | (static_cast<std::uint32_t>(data[3]) << 24);
+}
+
+
+inline void AppendJournalString(std::vector<BYTE>& buffer, const std::wstring_view s)
+{
+    AppendJournalUInt32(buffer, SafeCastSizeToDword(s.length()));
+    for (const wchar_t ch : s)
+    {
+        buffer.push_back(static_cast<BYTE>(ch));
+        buffer.push_back(static_cast<BYTE>(static_cast<std::uint32_t>(ch) >> 8));
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Encode a journal header
+//------------------------------------------------------------------------------
+inline void AppendJournalHeader(std::vector<BYTE>& buffer, const std::uint32_t magic)
+{
+    AppendJournalUInt32(buffer, magic);
+    AppendJournalUInt32(buffer, kJournalFormatVersion);
+}
+
+
+//------------------------------------------------------------------------------
+// Encode a journal record at the end of the buffer
+//------------------------------------------------------------------------------
+inline void AppendJournalRecord(
+    std::vector<BYTE>& buffer,
+    const BYTE operation,
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize
+)
+{
+    // Room for the payload size and checksum, filled in below
+    const size_t recordStart = buffer.size();
+    buffer.resize(recordStart + 2 * sizeof(std::uint32_t));
+
+    const size_t payloadStart = buffer.size();
+    buffer.push_back(operation);
+    AppendJournalString(buffer, keyPath);
+    AppendJournalString(buffer, valueName);
+    AppendJournalUInt32(buffer, type);
+    AppendJournalUInt32(buffer, SafeCastSizeToDword(dataSize));
+    buffer.insert(buffer.end(), data, data + dataSize);
+
+    const size_t payloadSize = buffer.size() - payloadStart;
+    const std::uint32_t checksum = JournalChecksum(buffer.data() + payloadStart, payloadSize);
+
+    std::vector<BYTE> prefix;
+    prefix.reserve(2 * sizeof(std::uint32_t));
+    AppendJournalUInt32(prefix, SafeCastSizeToDword(payloadSize));
+    AppendJournalUInt32(prefix, checksum);
+    std::copy(prefix.begin(), prefix.end(), buffer.begin() + recordStart);
+}
+
+
+//------------------------------------------------------------------------------
+// Decode the journal record starting at the given offset.
+// Return false if the record is incomplete or corrupted;
+// on success, advance offset past the record.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool ReadJournalRecord(
+    const std::vector<BYTE>& buffer,
+    size_t& offset,
+    JournalRecord& record
+)
+{
+    const size_t available = buffer.size() - offset;
+    if (available < 2 * sizeof(std::uint32_t))
+    {
+        return false;
+    }
+
+    const BYTE* p = buffer.data() + offset;
+    const size_t payloadSize = ReadJournalUInt32(p);
+    const std::uint32_t checksum = ReadJournalUInt32(p + 4);
+    if (payloadSize > available - 2 * sizeof(std::uint32_t))
+    {
+        return false;
+    }
+
+    const BYTE* payload = p + 2 * sizeof(std::uint32_t);
+    if (JournalChecksum(payload, payloadSize) != checksum)
+    {
+        return false;
+    }
+
+    // Decode the payload, checking every field against the payload bounds
+    size_t pos = 0;
+    auto readUInt32 = [&](std::uint32_t& value)
+    {
+        if (payloadSize - pos < sizeof(std::uint32_t))
+        {
+            return false;
+        }
+        value = ReadJournalUInt32(payload + pos);
+        pos += sizeof(std::uint32_t);
+        return true;
+    };
+    auto readString = [&](std::wstring& s)
+    {
+        std::uint32_t length = 0;
+        if (!readUInt32(length) || ((payloadSize - pos) / 2 < length))
+        {
+            return false;
+        }
+        s.resize(length);
+        for (std::uint32_t i = 0; i < length; i++)
+        {
+            s[i] = static_cast<wchar_t>(payload[pos] | (payload[pos + 1] << 8));
+            pos += 2;
+        }
+        return true;
+    };
+
+    if (payloadSize < 1)
+    {
+        return false;
+    }
+    record.Operation = payload[pos++];
+
+    std::uint32_t type = 0;
+    std::uint32_t dataSize = 0;
+    if (!readString(record.KeyPath)
+        || !readString(record.ValueName)
+        || !readUInt32(type)
+        || !readUInt32(dataSize)
+        || (payloadSize - pos != dataSize))
+    {
+        return false;
+    }
+    record.Type = type;
+    record.Data.assign(payload + pos, payload + pos + dataSize);
+
+    offset += 2 * sizeof(std::uint32_t) + payloadSize;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Apply a decoded journal record to a tree.
+// Return false for unknown operations.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool ApplyJournalRecord(RegTree& tree, JournalRecord& record)
+{
+    switch (record.Operation)
+    {
+        case kJournalCreateKey:
+            tree.CreateKey(record.KeyPath);
+            return true;
+
+        case kJournalSetValue:
+            tree.SetValue(record.KeyPath, record.ValueName, record.Type, std::move(record.Data));
+            return true;
+
+        case kJournalDeleteValue:
+            tree.DeleteValue(record.KeyPath, record.ValueName);
+            return true;
+
+        case kJournalDeleteTree:
+            tree.DeleteTree(record.KeyPath);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Encode the whole subtree rooted at the given node as journal records
+//------------------------------------------------------------------------------
+inline void AppendJournalTreeRecords(
+    std::vector<BYTE>& buffer,
+    const RegTree::Node& node,
+    std::wstring& keyPath
+)
+{
+    // Record the key itself, so that empty keys are preserved
+    if (!keyPath.empty())
+    {
+        AppendJournalRecord(buffer, kJournalCreateKey, keyPath, {}, REG_NONE, nullptr, 0);
+    }
+
+    for (const auto& value : node.Values)
+    {
+        AppendJournalRecord(buffer, kJournalSetValue, keyPath, value->Name, value->Type,
+                            value->Data, value->DataSize);
+    }
+
+    for (const auto& subKey : node.SubKeys)
+    {
+        const size_t parentPathLength = keyPath.length();
+        if (!keyPath.empty())
+        {
+            keyPath += L'\\';
+        }
+        keyPath += subKey.Name.View();
+
+        AppendJournalTreeRecords(buffer, *subKey.Key, keyPath);
+
+        keyPath.resize(parentPathLength);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Replay the journal records stored in a whole file image into a tree.
+// validSize receives the size of the valid prefix of the file
+// (header and records up to the first incomplete or corrupted one).
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS ReplayJournal(
+    const std::vector<BYTE>& fileData,
+    const std::uint32_t expectedMagic,
+    RegTree& tree,
+    size_t& validSize
+)
+{
+    validSize = 0;
+
+    if (fileData.size() < kJournalHeaderSize)
+    {
+        // Empty (or torn) header: nothing to replay
+        return ERROR_SUCCESS;
+    }
+
+    if ((ReadJournalUInt32(fileData.data()) != expectedMagic)
+        || (ReadJournalUInt32(fileData.data() + 4) != kJournalFormatVersion))
+    {
+        return ERROR_BADDB;
+    }
+
+    size_t offset = kJournalHeaderSize;
+    JournalRecord record;
+    while (ReadJournalRecord(fileData, offset, record))
+    {
+        if (!ApplyJournalRecord(tree, record))
+        {
+            return ERROR_BADDB;
+        }
+    }
+
+    validSize = offset;
+    return ERROR_SUCCESS;
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegPersistentTree Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegPersistentTree::~RegPersistentTree() noexcept
+{
+    try
+    {
+        Close();
+    }
+    catch (...)
+    {
+        // Destructors must not throw: pending operations that can't be
+        // written are lost, like on a crash
+    }
+}
+
+
+inline void RegPersistentTree::Open(const std::wstring& basePath, const RegJournalOptions& options)
+{
+    RegResult retCode = TryOpen(basePath, options);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot open the persistent registry tree." };
+    }
+}
+
+
+inline RegResult RegPersistentTree::TryOpen(const std::wstring& basePath,
+                                            const RegJournalOptions& options)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_logFile != INVALID_HANDLE_VALUE)
+    {
+        // Already open
+        return RegResult{ ERROR_INVALID_FUNCTION };
+    }
+
+    const std::wstring checkpointPath = basePath + L".checkpoint";
+    const std::wstring logPath = basePath + L".log";
+
+    RegTree tree;
+    std::vector<BYTE> fileData;
+    size_t validSize = 0;
+
+    // Load the checkpoint, if any
+    {
+        details::ScopedFileHandle checkpointFile{ ::CreateFileW(
+            checkpointPath.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,    // default security
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr     // no template
+        ) };
+        if (checkpointFile.IsValid())
+        {
+            LSTATUS retCode = details::ReadFileFully(checkpointFile.Get(), fileData);
+            if (retCode == ERROR_SUCCESS)
+            {
+                retCode = details::ReplayJournal(fileData, details::kJournalCheckpointMagic,
+                                                 tree, validSize);
+            }
+            if (retCode != ERROR_SUCCESS)
+            {
+                return RegResult{ retCode };
+            }
+
+            // Checkpoints are renamed into place only when complete
+            if (validSize != fileData.size())
+            {
+                return RegResult{ ERROR_BADDB };
+            }
+        }
+        else if (::GetLastError() != ERROR_FILE_NOT_FOUND)
+        {
+            return RegResult{ details::LastErrorAsStatus() };
+        }
+    }
+
+    // Open the log, and replay it on top of the checkpoint
+    details::ScopedFileHandle logFile{ ::CreateFileW(
+        logPath.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ,
+        nullptr,    // default security
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr     // no template
+    ) };
+    if (!logFile.IsValid())
+    {
+        return RegResult{ details::LastErrorAsStatus() };
+    }
+
+    LSTATUS retCode = details::ReadFileFully(logFile.Get(), fileData);
+    if (retCode == ERROR_SUCCESS)
+    {
+        retCode = details::ReplayJournal(fileData, details::kJournalLogMagic, tree, validSize);
+    }
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
+
+    if (validSize < details::kJournalHeaderSize)
+    {
+        // New (or torn) log: write a fresh header
+        std::vector<BYTE> header;
+        details::AppendJournalHeader(header, details::kJournalLogMagic);
+
+        LARGE_INTEGER start{};
+        if (!::SetFilePointerEx(logFile.Get(), start, nullptr, FILE_BEGIN)
+            || !::SetEndOfFile(logFile.Get()))
+        {
+            return RegResult{ details::LastErrorAsStatus() };
+        }
+
+        retCode = details::WriteFileFully(logFile.Get(), header.data(), header.size());
+        if ((retCode == ERROR_SUCCESS) && !::FlushFileBuffers(logFile.Get()))
+        {
+            retCode = details::LastErrorAsStatus();
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        validSize = header.size();
+    }
+    else
+    {
+        // Discard any torn record at the end of the log, and append from there
+        LARGE_INTEGER end{};
+        end.QuadPart = static_cast<LONGLONG>(validSize);
+        if (!::SetFilePointerEx(logFile.Get(), end, nullptr, FILE_BEGIN)
+            || !::SetEndOfFile(logFile.Get()))
+        {
+            return RegResult{ details::LastErrorAsStatus() };
+        }
+    }
+
+    m_tree = std::make_unique<RegVersionedTree>(tree);
+    m_pendingTree = std::move(tree);
+    m_options = options;
+    m_logPath = logPath;
+    m_checkpointPath = checkpointPath;
+    m_logSize = validSize;
+    m_logNeedsRewind = false;
+    m_logFile = logFile.Detach();
+    m_pendingRecords.clear();
+    m_pendingCount = 0;
+
+    return RegResult{ ERROR_SUCCESS };
+}
+
+
+inline void RegPersistentTree::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_logFile == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    const LSTATUS retCode = FlushLocked();
+
+    ::CloseHandle(m_logFile);
+    m_logFile = INVALID_HANDLE_VALUE;
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot flush the persistent registry tree log." };
+    }
+}
+
+
+inline bool RegPersistentTree::IsOpen() const noexcept
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_logFile != INVALID_HANDLE_VALUE;
+}
+
+
+inline RegTree RegPersistentTree::Snapshot() const
+{
+    _ASSERTE(m_tree != nullptr);
+    return m_tree->Snapshot();
+}
+
+
+template <typename ReadFunction>
+inline decltype(auto) RegPersistentTree::ReadLatest(ReadFunction&& read) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return read(static_cast<const RegTree&>(m_pendingTree));
+}
+
+
+inline LSTATUS RegPersistentTree::AppendRecord(
+    RegTree newTree,
+    const BYTE operation,
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const std::vector<BYTE>& data
+)
+{
+    const size_t recordStart = m_pendingRecords.size();
+    details::AppendJournalRecord(m_pendingRecords, operation, keyPath, valueName, type,
+                                 data.data(), data.size());
+    return CommitPendingOperation(std::move(newTree), recordStart);
+}
+
+
+inline LSTATUS RegPersistentTree::CommitPendingOperation(RegTree newTree, const size_t recordStart)
+{
+    m_pendingCount++;
+    RegTree previousTree = std::exchange(m_pendingTree, std::move(newTree));
+
+    if ((m_options.FlushEveryOperations != 0) && (m_pendingCount >= m_options.FlushEveryOperations))
+    {
+        const LSTATUS retCode = FlushLocked();
+        if ((retCode != ERROR_SUCCESS) && !m_pendingRecords.empty())
+        {
+            // The log write failed: drop this operation, that the caller reports as failed;
+            // the operations buffered before it are written by the next flush
+            m_pendingRecords.resize(recordStart);
+            m_pendingCount--;
+            m_pendingTree = std::move(previousTree);
+            return retCode;
+        }
+
+        // Otherwise the records are durable, and only the automatic checkpoint
+        // may have failed: it's tried again after the next flush
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+inline bool RegPersistentTree::CreateKey(const std::wstring_view keyPath)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    _ASSERTE(m_logFile != INVALID_HANDLE_VALUE);
+
+    if (m_pendingTree.ContainsKey(keyPath))
+    {
+        return false;
+    }
+
+    RegTree tree = m_pendingTree;
+    tree.CreateKey(keyPath);
+
+    LSTATUS retCode = AppendRecord(std::move(tree), details::kJournalCreateKey, keyPath, {}, REG_NONE, {});
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write the persistent registry tree log." };
+    }
+    return true;
+}
+
+
+inline void RegPersistentTree::SetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const std::vector<BYTE>& data
+)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    _ASSERTE(m_logFile != INVALID_HANDLE_VALUE);
+
+    RegTree tree = m_pendingTree;
+    tree.SetValue(keyPath, valueName, type, data);
+
+    LSTATUS retCode = AppendRecord(std::move(tree), details::kJournalSetValue, keyPath, valueName, type, data);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write the persistent registry tree log." };
+    }
+}
+
+
+inline bool RegPersistentTree::DeleteValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName
+)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    _ASSERTE(m_logFile != INVALID_HANDLE_VALUE);
+
+    RegTree tree = m_pendingTree;
+    if (!tree.DeleteValue(keyPath, valueName))
+    {
+        return false;
+    }
+
+    LSTATUS retCode = AppendRecord(std::move(tree), details::kJournalDeleteValue, keyPath, valueName, REG_NONE, {});
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write the persistent registry tree log." };
+    }
+    return true;
+}
+
+
+inline bool RegPersistentTree::DeleteTree(const std::wstring_view keyPath)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    _ASSERTE(m_logFile != INVALID_HANDLE_VALUE);
+
+    RegTree tree = m_pendingTree;
+    if (!tree.DeleteTree(keyPath))
+    {
+        return false;
+    }
+
+    LSTATUS retCode = AppendRecord(std::move(tree), details::kJournalDeleteTree, keyPath, {}, REG_NONE, {});
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write the persistent registry tree log." };
+    }
+    return true;
+}
+
+
+inline void RegPersistentTree::RenameKey(const std::wstring_view keyPath, const std::wstring_view newKeyName)
+{
+    RegResult retCode = TryRenameKey(keyPath, newKeyName);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot rename the key of the persistent registry tree." };
+    }
+}
+
+
+inline RegResult RegPersistentTree::TryRenameKey(const std::wstring_view keyPath, const std::wstring_view newKeyName)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    _ASSERTE(m_logFile != INVALID_HANDLE_VALUE);
+
+    RegTree tree = m_pendingTree;
+    LSTATUS retCode = details::RenameTreeKey(tree, keyPath, newKeyName);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
+
+    std::wstring newKeyPath{ details::ParentKeyPath(keyPath) };
+    if (!newKeyPath.empty())
+    {
+        newKeyPath += L'\\';
+    }
+    newKeyPath += newKeyName;
+
+    // Log blind writes, like for the other operations: replaying them on top
+    // of a checkpoint that already includes the rename gives the same tree
+    const size_t recordStart = m_pendingRecords.size();
+    details::AppendJournalTreeRecords(m_pendingRecords, *tree.FindKey(newKeyPath), newKeyPath);
+    details::AppendJournalRecord(m_pendingRecords, details::kJournalDeleteTree, keyPath, {}, REG_NONE, nullptr, 0);
+
+    return RegResult{ CommitPendingOperation(std::move(tree), recordStart) };
+}
+
+
+inline void RegPersistentTree::Flush()
+{
+    RegResult retCode = TryFlush();
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot flush the persistent registry tree log." };
+    }
+}
+
+
+inline RegResult RegPersistentTree::TryFlush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return RegResult{ FlushLocked() };
+}
+
+
+inline LSTATUS RegPersistentTree::FlushLocked()
+{
+    if (m_logFile == INVALID_HANDLE_VALUE)
+    {
+        return ERROR_INVALID_HANDLE;
+    }
+
+    if (m_pendingRecords.empty())
+    {
+        return ERROR_SUCCESS;
+    }
+
+    if (m_logNeedsRewind)
+    {
+        LSTATUS retCode = RewindLogLocked();
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+    }
+
+    // Group commit: one write and one disk flush for all the pending records
+    LSTATUS retCode = details::WriteFileFully(m_logFile, m_pendingRecords.data(),
+                                              m_pendingRecords.size());
+    if ((retCode == ERROR_SUCCESS) && !::FlushFileBuffers(m_logFile))
+    {
+        retCode = details::LastErrorAsStatus();
+    }
+    if (retCode != ERROR_SUCCESS)
+    {
+        // Remove what was written: replay stops at the first torn record,
+        // so records appended after it would be lost.
+        // If the log can't be truncated now, it's tried again before the next write.
+        m_logNeedsRewind = true;
+        (void)RewindLogLocked();
+        return retCode;
+    }
+
+    m_logSize += m_pendingRecords.size();
+    m_pendingRecords.clear();
+    m_pendingCount = 0;
+
+    // Publish the operations to readers, now that they are durable
+    m_tree->Update([this](RegTree& tree) { tree = m_pendingTree; });
+
+    if ((m_options.CheckpointLogSize != 0) && (m_logSize > m_options.CheckpointLogSize))
+    {
+        return CheckpointLocked();
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+inline LSTATUS RegPersistentTree::RewindLogLocked()
+{
+    LARGE_INTEGER end{};
+    end.QuadPart = static_cast<LONGLONG>(m_logSize);
+    if (!::SetFilePointerEx(m_logFile, end, nullptr, FILE_BEGIN)
+        || !::SetEndOfFile(m_logFile))
+    {
+        return details::LastErrorAsStatus();
+    }
+
+    m_logNeedsRewind = false;
+    return ERROR_SUCCESS;
+}
+
+
+inline void RegPersistentTree::Checkpoint()
+{
+    RegResult retCode = TryCheckpoint();
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot checkpoint the persistent registry tree." };
+    }
+}
+
+
+inline RegResult RegPersistentTree::TryCheckpoint()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    LSTATUS retCode = FlushLocked();
+    if (retCode == ERROR_SUCCESS)
+    {
+        retCode = CheckpointLocked();
+    }
+
+    return RegResult{ retCode };
+}
+
+
+inline LSTATUS RegPersistentTree::CheckpointLocked()
+{
+    if (m_logFile == INVALID_HANDLE_VALUE)
+    {
+        return ERROR_INVALID_HANDLE;
+    }
+
+    // Writers are blocked by m_mutex, so the snapshot includes all the logged operations
+    const RegTree tree = m_tree->Snapshot();
+
+    std::vector<BYTE> image;
+    details::AppendJournalHeader(image, details::kJournalCheckpointMagic);
+    std::wstring keyPath;
+    details::AppendJournalTreeRecords(image, *tree.Root(), keyPath);
+
+    // Write the new checkpoint to a temporary file, then atomically replace the old one
+    const std::wstring tempPath = m_checkpointPath + L".tmp";
+    {
+        details::ScopedFileHandle tempFile{ ::CreateFileW(
+            tempPath.c_str(),
+            GENERIC_WRITE,
+            0,          // no sharing
+            nullptr,    // default security
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr     // no template
+        ) };
+        if (!tempFile.IsValid())
+        {
+            return details::LastErrorAsStatus();
+        }
+
+        LSTATUS retCode = details::WriteFileFully(tempFile.Get(), image.data(), image.size());
+        if ((retCode == ERROR_SUCCESS) && !::FlushFileBuffers(tempFile.Get()))
+        {
+            retCode = details::LastErrorAsStatus();
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+    }
+
+    if (!::MoveFileExW(tempPath.c_str(), m_checkpointPath.c_str(),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        return details::LastErrorAsStatus();
+    }
+
+    // The checkpoint now includes everything in the log: empty it (keeping the header).
+    // A crash before this point just replays the log on top of the new checkpoint.
+    LARGE_INTEGER headerEnd{};
+    headerEnd.QuadPart = static_cast<LONGLONG>(details::kJournalHeaderSize);
+    if (!::SetFilePointerEx(m_logFile, headerEnd, nullptr, FILE_BEGIN)
+        || !::SetEndOfFile(m_logFile)
+        || !::FlushFileBuffers(m_logFile))
+    {
+        return details::LastErrorAsStatus();
+    }
+
+    m_logSize = details::kJournalHeaderSize;
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+//                  RegPersistentTreeBackend Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegPersistentTreeBackend::RegPersistentTreeBackend(
+    const std::wstring& basePath,
+    const RegJournalOptions& options
+)
+{
+    m_tree.Open(basePath, options);
+}
+
+
+inline RegTree RegPersistentTreeBackend::Snapshot() const
+{
+    return m_tree.Snapshot();
+}
+
+
+inline RegPersistentTree& RegPersistentTreeBackend::Tree() noexcept
+{
+    return m_tree;
+}
+
+
+inline bool RegPersistentTreeBackend::StoreContainsKey(const std::wstring_view keyPath)
+{
+    return m_tree.ReadLatest([keyPath](const RegTree& tree) { return tree.ContainsKey(keyPath); });
+}
+
+
+inline RegTree::ValuePtr RegPersistentTreeBackend::StoreFindValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName)
+{
+    return m_tree.ReadLatest([keyPath, valueName](const RegTree& tree) {
+        return details::FindTreeValue(tree, keyPath, valueName);
+    });
+}
+
+
+inline bool RegPersistentTreeBackend::StoreReadSubKeys(
+    const std::wstring_view keyPath,
+    std::vector<std::wstring>& subKeyNames)
+{
+    return m_tree.ReadLatest([keyPath, &subKeyNames](const RegTree& tree) {
+        return details::ReadTreeSubKeys(tree, keyPath, subKeyNames);
+    });
+}
+
+
+inline bool RegPersistentTreeBackend::StoreReadValues(
+    const std::wstring_view keyPath,
+    std::vector<RegTree::ValuePtr>& values)
+{
+    return m_tree.ReadLatest([keyPath, &values](const RegTree& tree) {
+        return details::ReadTreeValues(tree, keyPath, values);
+    });
+}
+
+
+inline bool RegPersistentTreeBackend::StoreCreateKey(const std::wstring_view keyPath)
+{
+    return m_tree.CreateKey(keyPath);
+}
+
+
+inline void RegPersistentTreeBackend::StoreSetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize)
+{
+    m_tree.SetValue(keyPath, valueName, type, std::vector<BYTE>(data, data + dataSize));
+}
+
+
+inline bool RegPersistentTreeBackend::StoreDeleteValue(const std::wstring_view keyPath,
+                                                       const std::wstring_view valueName)
+{
+    return m_tree.DeleteValue(keyPath, valueName);
+}
+
+
+inline bool RegPersistentTreeBackend::StoreDeleteTree(const std::wstring_view keyPath)
+{
+    return m_tree.DeleteTree(keyPath);
+}
+
+
+inline LSTATUS RegPersistentTreeBackend::StoreRenameKey(const std::wstring_view keyPath,
+                                                        const std::wstring_view newKeyName)
+{
+    return m_tree.TryRenameKey(keyPath, newKeyName).Code();
+}
+
+
+inline LSTATUS RegPersistentTreeBackend::StoreFlush()
+{
+    return m_tree.TryFlush().Code();
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGPERSISTENTTREE_HPP_INCLUDED
@@ -0,0 +1,1423 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGREMOTESERVER_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGREMOTESERVER_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegRemoteServer: serves the tree of a RegRemoteSimulator over TCP; and
+// RegRemoteClientBackend, the registry backend that sends the registry calls
+// made through RegKey to a RegRemoteServer.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the socket headers it needs).
+// On Windows, define WIN32_LEAN_AND_MEAN (or include <winsock2.h>) before
+// including WinReg.hpp, as <Windows.h> otherwise includes the old <winsock.h>;
+// the program links ws2_32.lib.
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegMemoryBackend.hpp"     // RegMemoryBackend
+#include "RegRemoteSimulator.hpp"   // RegRemoteSimulator
+
+#include <algorithm>        // std::min
+#include <atomic>           // std::atomic
+#include <chrono>           // std::chrono::milliseconds
+#include <cstdint>          // std::uint32_t, std::uint64_t
+#include <memory>           // std::unique_ptr, std::make_unique
+#include <mutex>            // std::mutex, std::lock_guard
+#include <new>              // std::bad_alloc
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <thread>           // std::thread
+#include <utility>          // std::move, std::exchange
+#include <vector>           // std::vector
+
+#ifdef _WIN32
+#include <winsock2.h>       // socket, send, recv, select
+#include <ws2tcpip.h>       // inet_pton
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif // _MSC_VER
+#else // _WIN32
+#include <arpa/inet.h>      // inet_pton, htons, htonl
+#include <netinet/in.h>     // sockaddr_in
+#include <netinet/tcp.h>    // TCP_NODELAY
+#include <sys/select.h>     // select
+#include <sys/socket.h>     // socket, send, recv, shutdown
+#include <unistd.h>         // close
+#endif // _WIN32
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+namespace details
+{
+
+#ifdef _WIN32
+using RemoteSocketHandle = SOCKET;
+constexpr RemoteSocketHandle kInvalidRemoteSocket = INVALID_SOCKET;
+#else // _WIN32
+using RemoteSocketHandle = int;
+constexpr RemoteSocketHandle kInvalidRemoteSocket = -1;
+#endif // _WIN32
+
+// The requests of the remote registry protocol
+enum class RemoteRequest : BYTE
+{
+    OpenKey = 1,
+    EnumSubKeys,
+    EnumValues,
+    GetValue,
+    SetValue,
+    CreateKey,
+    DeleteValue,
+    DeleteTree,
+    RenameKey,
+    ReadChanges
+};
+
+
+//------------------------------------------------------------------------------
+// A connected or listening TCP socket, closed by the destructor
+//------------------------------------------------------------------------------
+class RemoteSocket
+{
+public:
+
+    RemoteSocket() noexcept = default;
+    explicit RemoteSocket(RemoteSocketHandle handle) noexcept;
+    ~RemoteSocket();
+
+    RemoteSocket(const RemoteSocket&) = delete;
+    RemoteSocket& operator=(const RemoteSocket&) = delete;
+    RemoteSocket(RemoteSocket&& other) noexcept;
+    RemoteSocket& operator=(RemoteSocket&& other) noexcept;
+
+    [[nodiscard]] bool IsValid() const noexcept;
+
+    // Listen on the loopback interface, at the given port (0 picks a free one).
+    // Throw RegException on failure.
+    [[nodiscard]] static RemoteSocket Listen(unsigned short port);
+
+    // Connect to the given IPv4 address and port.
+    // Throw RegException (RPC_S_SERVER_UNAVAILABLE) on failure.
+    [[nodiscard]] static RemoteSocket Connect(const char* address, unsigned short port);
+
+    // Port of a listening socket
+    [[nodiscard]] unsigned short LocalPort() const;
+
+    // Wait up to the given time for a connection, and accept it;
+    // return an invalid socket if none arrived
+    [[nodiscard]] RemoteSocket Accept(std::chrono::milliseconds timeout);
+
+    // Send a framed message (see RemoteMessageWriter); return false if the
+    // connection is broken
+    [[nodiscard]] bool SendMessage(const std::vector<BYTE>& message) noexcept;
+
+    // Receive the payload of a framed message; return false if the connection
+    // was closed or is broken, or the message is too large
+    [[nodiscard]] bool ReceiveMessage(std::vector<BYTE>& payload);
+
+    // Stop the sends and receives in progress on other threads
+    void Shutdown() noexcept;
+
+private:
+    void Close() noexcept;
+
+    RemoteSocketHandle m_handle{ kInvalidRemoteSocket };
+};
+
+
+//------------------------------------------------------------------------------
+// Build a framed message of the remote registry protocol: the payload size
+// (32-bit), then the payload. Integers are little-endian; strings are their
+// length followed by their characters, 32 bits each (whatever the size of
+// wchar_t); byte arrays are their size followed by the bytes.
+//------------------------------------------------------------------------------
+class RemoteMessageWriter
+{
+public:
+
+    RemoteMessageWriter();
+
+    void WriteUInt32(std::uint32_t value);
+    void WriteUInt64(std::uint64_t value);
+    void WriteString(std::wstring_view s);
+    void WriteBytes(const BYTE* data, size_t dataSize);
+
+    // Fill in the payload size, and return the framed message
+    [[nodiscard]] const std::vector<BYTE>& Frame();
+
+private:
+    std::vector<BYTE> m_bytes;
+};
+
+
+//------------------------------------------------------------------------------
+// Read the payload of a message of the remote registry protocol;
+// throw RegException (ERROR_INVALID_DATA) past its end
+//------------------------------------------------------------------------------
+class RemoteMessageReader
+{
+public:
+
+    // The payload must outlive this object
+    explicit RemoteMessageReader(const std::vector<BYTE>& payload) noexcept;
+
+    [[nodiscard]] std::uint32_t ReadUInt32();
+    [[nodiscard]] std::uint64_t ReadUInt64();
+    [[nodiscard]] std::wstring ReadString();
+
+    // Return a pointer to the bytes in the payload, and their size
+    [[nodiscard]] const BYTE* ReadBytes(size_t& dataSize);
+
+private:
+    [[nodiscard]] const BYTE* Consume(size_t byteCount);
+
+    const std::vector<BYTE>& m_payload;
+    size_t                   m_offset{ 0 };
+};
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+// Serve the requests of RegRemoteSimulator (open, enumerate, get, set, delete,
+// rename, read changes) to RegRemoteClientBackend, over TCP on the loopback
+// interface: each request is executed by the simulator, that charges its
+// latency and bandwidth costs and injects its failures, as configured.
+//
+// A thread accepts the connections, and each connection is served by its own
+// thread, so the requests of a client sent on different connections run
+// concurrently. The destructor closes the connections: requests in progress
+// fail on the client side.
+//------------------------------------------------------------------------------
+class RegRemoteServer
+{
+public:
+
+    // Start serving at the given TCP port (0 picks a free one, see Port).
+    // The simulator must outlive this object.
+    // Throw RegException if the port can't be listened on.
+    explicit RegRemoteServer(RegRemoteSimulator& simulator, unsigned short port = 0);
+
+    // Stop serving, and wait for the connection threads
+    ~RegRemoteServer();
+
+    // Ban copy and move (the threads reference this object)
+    RegRemoteServer(const RegRemoteServer&) = delete;
+    RegRemoteServer& operator=(const RegRemoteServer&) = delete;
+    RegRemoteServer(RegRemoteServer&&) = delete;
+    RegRemoteServer& operator=(RegRemoteServer&&) = delete;
+
+    [[nodiscard]] unsigned short Port() const noexcept;
+
+    // Number of connections accepted so far
+    [[nodiscard]] size_t AcceptedConnectionCount() const noexcept;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Longest wait for changes, so that the server stops promptly
+    static constexpr std::chrono::milliseconds kMaxChangeWait{ 250 };
+
+    // How often the accepting thread checks whether the server is stopping
+    static constexpr std::chrono::milliseconds kAcceptPollTime{ 50 };
+
+    void AcceptConnections();
+    void ServeConnection(details::RemoteSocket& connection);
+
+    // Run a request, and write its response
+    void ServeRequest(details::RemoteMessageReader& request, details::RemoteMessageWriter& response);
+
+    RegRemoteSimulator&   m_simulator;
+    details::RemoteSocket m_listener;
+    unsigned short        m_port{ 0 };
+    std::atomic<bool>     m_stopping{ false };
+    std::atomic<size_t>   m_acceptedConnectionCount{ 0 };
+
+    // Protects m_connections and m_connectionThreads
+    std::mutex                                          m_connectionsMutex;
+    std::vector<std::unique_ptr<details::RemoteSocket>> m_connections;
+    std::vector<std::thread>                            m_connectionThreads;
+
+    std::thread m_acceptThread;
+};
+
+
+//------------------------------------------------------------------------------
+// A registry backend storing the keys on a RegRemoteServer, possibly in
+// another process: RegKey code runs against it unchanged (see RegBackend),
+// each store operation being a request to the server (see RegMemoryBackend).
+//
+// The requests of concurrent threads are sent on different connections, that
+// are kept open for the next requests: OpenedConnectionCount shows how many
+// were needed. A request fails with the error code returned by the server
+// (e.g. an injected failure), or RPC_S_SERVER_UNAVAILABLE if the server can't
+// be reached, or RPC_S_CALL_FAILED if the connection is lost meanwhile.
+//
+// RegNotifyChangeKeyValue also reports the changes made on the server by other
+// clients, or directly on its tree: once the first notification is requested,
+// a thread reads the changes from the server, and signals the watches that
+// see them, whatever their filter (see RegMemoryBackend::NotifyStoreChange).
+//------------------------------------------------------------------------------
+class RegRemoteClientBackend : public RegMemoryBackend
+{
+public:
+
+    // Send the requests to the server listening at the given IPv4 address
+    // and TCP port; the connections are opened when needed
+    explicit RegRemoteClientBackend(unsigned short port, std::string address = "127.0.0.1");
+
+    // Stop reading the changes from the server
+    ~RegRemoteClientBackend() override;
+
+    // Number of connections opened so far
+    [[nodiscard]] size_t OpenedConnectionCount() const noexcept;
+
+    // Start reading the changes from the server, if not done yet
+    LSTATUS NotifyChangeKeyValue(HKEY hKey, BOOL watchSubtree, DWORD notifyFilter,
+                                 HANDLE event, BOOL asynchronous) noexcept override;
+
+
+protected:
+
+    //
+    // Store operations: each one is a request to the server
+    //
+
+    [[nodiscard]] bool StoreContainsKey(std::wstring_view keyPath) override;
+
+    [[nodiscard]] RegTree::ValuePtr StoreFindValue(std::wstring_view keyPath,
+                                                   std::wstring_view valueName) override;
+
+    [[nodiscard]] bool StoreReadSubKeys(std::wstring_view keyPath,
+                                        std::vector<std::wstring>& subKeyNames) override;
+
+    [[nodiscard]] bool StoreReadValues(std::wstring_view keyPath,
+                                       std::vector<RegTree::ValuePtr>& values) override;
+
+    bool StoreCreateKey(std::wstring_view keyPath) override;
+
+    void StoreSetValue(std::wstring_view keyPath,
+                       std::wstring_view valueName,
+                       DWORD type,
+                       const BYTE* data,
+                       size_t dataSize) override;
+
+    bool StoreDeleteValue(std::wstring_view keyPath, std::wstring_view valueName) override;
+
+    bool StoreDeleteTree(std::wstring_view keyPath) override;
+
+    [[nodiscard]] LSTATUS StoreRenameKey(std::wstring_view keyPath, std::wstring_view newKeyName) override;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Idle connections kept open for the next requests
+    static constexpr size_t kMaxIdleConnections = 16;
+
+    // Longest wait of each request for changes
+    static constexpr std::chrono::milliseconds kChangePollTime{ 200 };
+
+    // Send a request on an idle connection (or a new one), and return the
+    // payload of the response; throw RegException if the server can't be
+    // reached, or the connection is lost
+    [[nodiscard]] std::vector<BYTE> Call(details::RemoteMessageWriter& request);
+
+    // Send a request, and return the status of the response; the payload
+    // is returned too, to read the rest of the response
+    [[nodiscard]] LSTATUS CallWithStatus(details::RemoteMessageWriter& request,
+                                         std::vector<BYTE>& response);
+
+    // Read the changes made on the server after the given sequence number,
+    // waiting for them up to the given time
+    [[nodiscard]] RegRemoteChangeList ReadChanges(std::uint64_t afterSequence,
+                                                  std::chrono::milliseconds timeout);
+
+    // Start the thread reading the changes from the server, if not done yet
+    [[nodiscard]] LSTATUS StartChangeWatcher() noexcept;
+
+    // Signal the watches that see the changes made on the server, until stopped
+    void WatchChanges(std::uint64_t sequence);
+
+    const std::string   m_address;
+    const unsigned short m_port;
+
+    // Idle connections
+    std::mutex                         m_connectionsMutex;
+    std::vector<details::RemoteSocket> m_idleConnections;
+    std::atomic<size_t>                m_openedConnectionCount{ 0 };
+
+    // Protects m_watcher
+    std::mutex        m_watcherMutex;
+    std::thread       m_watcher;
+    std::atomic<bool> m_stopping{ false };
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegRemoteServer
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+// Largest message accepted, to reject a corrupted stream
+constexpr std::uint32_t kMaxRemoteMessageSize = 64 * 1024 * 1024;
+
+
+#ifdef _WIN32
+
+//------------------------------------------------------------------------------
+// Initialize Winsock for the whole process, the first time it's called
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool InitializeWinsock() noexcept
+{
+    static const bool s_initialized = []() noexcept
+    {
+        WSADATA data{};
+        return ::WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return s_initialized;
+}
+
+#endif // _WIN32
+
+
+//------------------------------------------------------------------------------
+// Build the loopback (or given) IPv4 address of a socket
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool MakeRemoteAddress(
+    const char* const address,
+    const unsigned short port,
+    sockaddr_in& socketAddress
+) noexcept
+{
+    socketAddress = sockaddr_in{};
+    socketAddress.sin_family = AF_INET;
+    socketAddress.sin_port = htons(port);
+    return ::inet_pton(AF_INET, address, &socketAddress.sin_addr) == 1;
+}
+
+
+//------------------------------------------------------------------------------
+//                      RemoteSocket Inline Methods
+//------------------------------------------------------------------------------
+
+inline RemoteSocket::RemoteSocket(const RemoteSocketHandle handle) noexcept
+    : m_handle{ handle }
+{}
+
+
+inline RemoteSocket::~RemoteSocket()
+{
+    Close();
+}
+
+
+inline RemoteSocket::RemoteSocket(RemoteSocket&& other) noexcept
+    : m_handle{ std::exchange(other.m_handle, kInvalidRemoteSocket) }
+{}
+
+
+inline RemoteSocket& RemoteSocket::operator=(RemoteSocket&& other) noexcept
+{
+    if (&other != this)
+    {
+        Close();
+        m_handle = std::exchange(other.m_handle, kInvalidRemoteSocket);
+    }
+    return *this;
+}
+
+
+inline bool RemoteSocket::IsValid() const noexcept
+{
+    return m_handle != kInvalidRemoteSocket;
+}
+
+
+inline void RemoteSocket::Close() noexcept
+{
+    if (m_handle != kInvalidRemoteSocket)
+    {
+#ifdef _WIN32
+        ::closesocket(m_handle);
+#else // _WIN32
+        ::close(m_handle);
+#endif // _WIN32
+        m_handle = kInvalidRemoteSocket;
+    }
+}
+
+
+inline void RemoteSocket::Shutdown() noexcept
+{
+    if (m_handle != kInvalidRemoteSocket)
+    {
+#ifdef _WIN32
+        ::shutdown(m_handle, SD_BOTH);
+#else // _WIN32
+        ::shutdown(m_handle, SHUT_RDWR);
+#endif // _WIN32
+    }
+}
+
+
+inline RemoteSocket RemoteSocket::Listen(const unsigned short port)
+{
+#ifdef _WIN32
+    if (!InitializeWinsock())
+    {
+        throw RegException{ ERROR_NOT_SUPPORTED, "Winsock initialization failed." };
+    }
+#endif // _WIN32
+
+    RemoteSocket listener{ ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) };
+    if (!listener.IsValid())
+    {
+        throw RegException{ ERROR_NOT_ENOUGH_MEMORY, "Can't create the listening socket." };
+    }
+
+    const int reuseAddress = 1;
+    ::setsockopt(listener.m_handle, SOL_SOCKET, SO_REUSEADDR,
+                 reinterpret_cast<const char*>(&reuseAddress), sizeof(reuseAddress));
+
+    sockaddr_in socketAddress{};
+    if (!MakeRemoteAddress("127.0.0.1", port, socketAddress)
+        || (::bind(listener.m_handle, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0)
+        || (::listen(listener.m_handle, SOMAXCONN) != 0))
+    {
+        throw RegException{ ERROR_ACCESS_DENIED, "Can't listen on the given port." };
+    }
+    return listener;
+}
+
+
+inline RemoteSocket RemoteSocket::Connect(const char* const address, const unsigned short port)
+{
+#ifdef _WIN32
+    if (!InitializeWinsock())
+    {
+        throw RegException{ RPC_S_SERVER_UNAVAILABLE, "Winsock initialization failed." };
+    }
+#endif // _WIN32
+
+    sockaddr_in socketAddress{};
+    RemoteSocket connection{ ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) };
+    if (!connection.IsValid()
+        || !MakeRemoteAddress(address, port, socketAddress)
+        || (::connect(connection.m_handle, reinterpret_cast<const sockaddr*>(&socketAddress),
+                      sizeof(socketAddress)) != 0))
+    {
+        throw RegException{ RPC_S_SERVER_UNAVAILABLE, "Can't connect to the remote registry server." };
+    }
+
+    // The requests are small, and each one waits for its response
+    const int noDelay = 1;
+    ::setsockopt(connection.m_handle, IPPROTO_TCP, TCP_NODELAY,
+                 reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    return connection;
+}
+
+
+inline unsigned short RemoteSocket::LocalPort() const
+{
+    sockaddr_in socketAddress{};
+#ifdef _WIN32
+    int addressSize = sizeof(socketAddress);
+#else // _WIN32
+    socklen_t addressSize = sizeof(socketAddress);
+#endif // _WIN32
+    if (::getsockname(m_handle, reinterpret_cast<sockaddr*>(&socketAddress), &addressSize) != 0)
+    {
+        throw RegException{ ERROR_INVALID_HANDLE, "Can't get the port of the listening socket." };
+    }
+    return ntohs(socketAddress.sin_port);
+}
+
+
+inline RemoteSocket RemoteSocket::Accept(const std::chrono::milliseconds timeout)
+{
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(m_handle, &readSet);
+
+    timeval waitTime{};
+    waitTime.tv_sec = static_cast<long>(timeout.count() / 1000);
+    waitTime.tv_usec = static_cast<long>((timeout.count() % 1000) * 1000);
+
+    // The first parameter is ignored on Windows
+    if (::select(static_cast<int>(m_handle) + 1, &readSet, nullptr, nullptr, &waitTime) <= 0)
+    {
+        return RemoteSocket{};
+    }
+
+    RemoteSocket connection{ ::accept(m_handle, nullptr, nullptr) };
+    if (connection.IsValid())
+    {
+        const int noDelay = 1;
+        ::setsockopt(connection.m_handle, IPPROTO_TCP, TCP_NODELAY,
+                     reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    }
+    return connection;
+}
+
+
+inline bool RemoteSocket::SendMessage(const std::vector<BYTE>& message) noexcept
+{
+    size_t sent = 0;
+    while (sent < message.size())
+    {
+        const int chunkSize = static_cast<int>((std::min)(message.size() - sent, size_t{ 1 } << 20));
+#ifdef _WIN32
+        const int result = ::send(m_handle, reinterpret_cast<const char*>(message.data() + sent), chunkSize, 0);
+#else // _WIN32
+        // Don't raise SIGPIPE if the peer has closed the connection
+        const auto result = ::send(m_handle, message.data() + sent, chunkSize, MSG_NOSIGNAL);
+#endif // _WIN32
+        if (result <= 0)
+        {
+            return false;
+        }
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+
+inline bool RemoteSocket::ReceiveMessage(std::vector<BYTE>& payload)
+{
+    auto receiveFully = [this](BYTE* const buffer, const size_t size) noexcept
+    {
+        size_t received = 0;
+        while (received < size)
+        {
+            const int chunkSize = static_cast<int>((std::min)(size - received, size_t{ 1 } << 20));
+#ifdef _WIN32
+            const int result = ::recv(m_handle, reinterpret_cast<char*>(buffer + received), chunkSize, 0);
+#else // _WIN32
+            const auto result = ::recv(m_handle, buffer + received, chunkSize, 0);
+#endif // _WIN32
+            if (result <= 0)
+            {
+                return false;
+            }
+            received += static_cast<size_t>(result);
+        }
+        return true;
+    };
+
+    BYTE header[sizeof(std::uint32_t)];
+    if (!receiveFully(header, sizeof(header)))
+    {
+        return false;
+    }
+
+    const std::uint32_t payloadSize = static_cast<std::uint32_t>(header[0])
+        | (static_cast<std::uint32_t>(header[1]) << 8)
+        | (static_cast<std::uint32_t>(header[2]) << 16)
+        | (static_cast<std::uint32_t>(header[3]) << 24);
+    if (payloadSize > kMaxRemoteMessageSize)
+    {
+        return false;
+    }
+
+    payload.resize(payloadSize);
+    return receiveFully(payload.data(), payload.size());
+}
+
+
+//------------------------------------------------------------------------------
+//                  RemoteMessageWriter Inline Methods
+//------------------------------------------------------------------------------
+
+inline RemoteMessageWriter::RemoteMessageWriter()
+    : m_bytes(sizeof(std::uint32_t))    // room for the payload size
+{}
+
+
+inline void RemoteMessageWriter::WriteUInt32(const std::uint32_t value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        m_bytes.push_back(static_cast<BYTE>(value >> shift));
+    }
+}
+
+
+inline void RemoteMessageWriter::WriteUInt64(const std::uint64_t value)
+{
+    WriteUInt32(static_cast<std::uint32_t>(value));
+    WriteUInt32(static_cast<std::uint32_t>(value >> 32));
+}
+
+
+inline void RemoteMessageWriter::WriteString(const std::wstring_view s)
+{
+    WriteUInt32(static_cast<std::uint32_t>(s.length()));
+    m_bytes.reserve(m_bytes.size() + s.length() * sizeof(std::uint32_t));
+    for (const wchar_t ch : s)
+    {
+        WriteUInt32(static_cast<std::uint32_t>(ch));
+    }
+}
+
+
+inline void RemoteMessageWriter::WriteBytes(const BYTE* const data, const size_t dataSize)
+{
+    WriteUInt32(static_cast<std::uint32_t>(dataSize));
+    m_bytes.insert(m_bytes.end(), data, data + dataSize);
+}
+
+
+inline const std::vector<BYTE>& RemoteMessageWriter::Frame()
+{
+    const size_t payloadSize = m_bytes.size() - sizeof(std::uint32_t);
+    if (payloadSize > kMaxRemoteMessageSize)
+    {
+        throw RegException{ ERROR_INVALID_DATA, "The remote registry message is too large." };
+    }
+
+    for (int index = 0; index < 4; index++)
+    {
+        m_bytes[index] = static_cast<BYTE>(payloadSize >> (index * 8));
+    }
+    return m_bytes;
+}
+
+
+//------------------------------------------------------------------------------
+//                  RemoteMessageReader Inline Methods
+//------------------------------------------------------------------------------
+
+inline RemoteMessageReader::RemoteMessageReader(const std::vector<BYTE>& payload) noexcept
+    : m_payload{ payload }
+{}
+
+
+inline const BYTE* RemoteMessageReader::Consume(const size_t byteCount)
+{
+    if (byteCount > m_payload.size() - m_offset)
+    {
+        throw RegException{ ERROR_INVALID_DATA, "Truncated remote registry message." };
+    }
+
+    const BYTE* const bytes = m_payload.data() + m_offset;
+    m_offset += byteCount;
+    return bytes;
+}
+
+
+inline std::uint32_t RemoteMessageReader::ReadUInt32()
+{
+    const BYTE* const bytes = Consume(sizeof(std::uint32_t));
+    return static_cast<std::uint32_t>(bytes[0])
+        | (static_cast<std::uint32_t>(bytes[1]) << 8)
+        | (static_cast<std::uint32_t>(bytes[2]) << 16)
+        | (static_cast<std::uint32_t>(bytes[3]) << 24);
+}
+
+
+inline std::uint64_t RemoteMessageReader::ReadUInt64()
+{
+    const std::uint64_t low = ReadUInt32();
+    const std::uint64_t high = ReadUInt32();
+    return low | (high << 32);
+}
+
+
+inline std::wstring RemoteMessageReader::ReadString()
+{
+    const size_t length = ReadUInt32();
+    const BYTE* const bytes = Consume(length * sizeof(std::uint32_t));
+
+    std::wstring s(length, L'\0');
+    for (size_t index = 0; index < length; index++)
+    {
+        const BYTE* const unit = bytes + index * sizeof(std::uint32_t);
+        s[index] = static_cast<wchar_t>(static_cast<std::uint32_t>(unit[0])
+            | (static_cast<std::uint32_t>(unit[1]) << 8)
+            | (static_cast<std::uint32_t>(unit[2]) << 16)
+            | (static_cast<std::uint32_t>(unit[3]) << 24));
+    }
+    return s;
+}
+
+
+inline const BYTE* RemoteMessageReader::ReadBytes(size_t& dataSize)
+{
+    dataSize = ReadUInt32();
+    return Consume(dataSize);
+}
+
+
+//------------------------------------------------------------------------------
+// Write a value to a message, and read it back
+//------------------------------------------------------------------------------
+inline void WriteRemoteValue(RemoteMessageWriter& message, const RegTree::Value& value)
+{
+    message.WriteString(value.Name);
+    message.WriteUInt32(value.Type);
+    message.WriteBytes(value.Data, value.DataSize);
+}
+
+
+[[nodiscard]] inline RegTree::ValuePtr ReadRemoteValue(RemoteMessageReader& message)
+{
+    const std::wstring name = message.ReadString();
+    const DWORD type = message.ReadUInt32();
+    size_t dataSize = 0;
+    const BYTE* const data = message.ReadBytes(dataSize);
+    return RegTree::ValueArena::StoreSingle(name, type, data, dataSize);
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegRemoteServer Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegRemoteServer::RegRemoteServer(RegRemoteSimulator& simulator, const unsigned short port)
+    : m_simulator{ simulator }
+    , m_listener{ details::RemoteSocket::Listen(port) }
+    , m_port{ m_listener.LocalPort() }
+{
+    m_acceptThread = std::thread([this] { AcceptConnections(); });
+}
+
+
+inline RegRemoteServer::~RegRemoteServer()
+{
+    m_stopping.store(true);
+    m_acceptThread.join();
+
+    // No connection is added anymore: stop the ones in progress
+    for (const auto& connection : m_connections)
+    {
+        connection->Shutdown();
+    }
+    for (std::thread& connectionThread : m_connectionThreads)
+    {
+        connectionThread.join();
+    }
+}
+
+
+inline unsigned short RegRemoteServer::Port() const noexcept
+{
+    return m_port;
+}
+
+
+inline size_t RegRemoteServer::AcceptedConnectionCount() const noexcept
+{
+    return m_acceptedConnectionCount.load(std::memory_order_relaxed);
+}
+
+
+inline void RegRemoteServer::AcceptConnections()
+{
+    while (!m_stopping.load())
+    {
+        try
+        {
+            details::RemoteSocket connection = m_listener.Accept(kAcceptPollTime);
+            if (!connection.IsValid())
+            {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock{ m_connectionsMutex };
+            m_connections.push_back(std::make_unique<details::RemoteSocket>(std::move(connection)));
+            details::RemoteSocket& servedConnection = *m_connections.back();
+            m_connectionThreads.emplace_back([this, &servedConnection] { ServeConnection(servedConnection); });
+            m_acceptedConnectionCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        catch (...)
+        {
+            // Out of resources: the connection is dropped, the client sees
+            // its requests fail
+        }
+    }
+}
+
+
+inline void RegRemoteServer::ServeConnection(details::RemoteSocket& connection)
+{
+    try
+    {
+        std::vector<BYTE> requestPayload;
+        while (!m_stopping.load() && connection.ReceiveMessage(requestPayload))
+        {
+            details::RemoteMessageReader request{ requestPayload };
+            details::RemoteMessageWriter response;
+            ServeRequest(request, response);
+            if (!connection.SendMessage(response.Frame()))
+            {
+                break;
+            }
+        }
+    }
+    catch (...)
+    {
+        // A malformed request, or out of memory: drop the connection
+    }
+
+    connection.Shutdown();
+}
+
+
+inline void RegRemoteServer::ServeRequest(
+    details::RemoteMessageReader& request,
+    details::RemoteMessageWriter& response
+)
+{
+    using details::RemoteRequest;
+
+    const auto requestType = static_cast<RemoteRequest>(request.ReadUInt32());
+    switch (requestType)
+    {
+    case RemoteRequest::OpenKey:
+    {
+        const std::wstring keyPath = request.ReadString();
+        response.WriteUInt32(m_simulator.TryOpenKey(keyPath).Code());
+        break;
+    }
+
+    case RemoteRequest::EnumSubKeys:
+    {
+        const std::wstring keyPath = request.ReadString();
+        const RegExpected<std::vector<std::wstring>> subKeyNames = m_simulator.TryEnumSubKeys(keyPath);
+        if (!subKeyNames.IsValid())
+        {
+            response.WriteUInt32(subKeyNames.GetError().Code());
+            break;
+        }
+
+        response.WriteUInt32(ERROR_SUCCESS);
+        response.WriteUInt32(static_cast<std::uint32_t>(subKeyNames.GetValue().size()));
+        for (const std::wstring& subKeyName : subKeyNames.GetValue())
+        {
+            response.WriteString(subKeyName);
+        }
+        break;
+    }
+
+    case RemoteRequest::EnumValues:
+    {
+        const std::wstring keyPath = request.ReadString();
+        const RegExpected<std::vector<RegTree::ValuePtr>> values = m_simulator.TryEnumValues(keyPath);
+        if (!values.IsValid())
+        {
+            response.WriteUInt32(values.GetError().Code());
+            break;
+        }
+
+        response.WriteUInt32(ERROR_SUCCESS);
+        response.WriteUInt32(static_cast<std::uint32_t>(values.GetValue().size()));
+        for (const RegTree::ValuePtr& value : values.GetValue())
+        {
+            details::WriteRemoteValue(response, *value);
+        }
+        break;
+    }
+
+    case RemoteRequest::GetValue:
+    {
+        const std::wstring keyPath = request.ReadString();
+        const std::wstring valueName = request.ReadString();
+        const RegExpected<RegTree::ValuePtr> value = m_simulator.TryGetValue(keyPath, valueName);
+        if (!value.IsValid())
+        {
+            response.WriteUInt32(value.GetError().Code());
+            break;
+        }
+
+        response.WriteUInt32(ERROR_SUCCESS);
+        details::WriteRemoteValue(response, *value.GetValue());
+        break;
+    }
+
+    case RemoteRequest::SetValue:
+    {
+        const std::wstring keyPath = request.ReadString();
+        const std::wstring valueName = request.ReadString();
+        const DWORD type = request.ReadUInt32();
+        size_t dataSize = 0;
+        const BYTE* const data = request.ReadBytes(dataSize);
+        response.WriteUInt32(m_simulator.TrySetValue(keyPath, valueName, type,
+                                                     std::vector<BYTE>(data, data + dataSize)).Code());
+        break;
+    }
+
+    case RemoteRequest::CreateKey:
+    {
+        const std::wstring keyPath = request.ReadString();
+        const RegExpected<bool> created = m_simulator.TryCreateKey(keyPath);
+        if (!created.IsValid())
+        {
+            response.WriteUInt32(created.GetError().Code());
+            break;
+        }
+
+        response.WriteUInt32(ERROR_SUCCESS);
+        response.WriteUInt32(created.GetValue() ? 1 : 0);
+        break;
+    }
+
+    case RemoteRequest::DeleteValue:
+    {
+        const std::wstring keyPath = request.ReadString();
+        const std::wstring valueName = request.ReadString();
+        response.WriteUInt32(m_simulator.TryDeleteValue(keyPath, valueName).Code());
+        break;
+    }
+
+    case RemoteRequest::DeleteTree:
+    {
+        const std::wstring keyPath = request.ReadString();
+        response.WriteUInt32(m_simulator.TryDeleteTree(keyPath).Code());
+        break;
+    }
+
+    case RemoteRequest::RenameKey:
+    {
+        const std::wstring keyPath = request.ReadString();
+        const std::wstring newKeyName = request.ReadString();
+        response.WriteUInt32(m_simulator.TryRenameKey(keyPath, newKeyName).Code());
+        break;
+    }
+
+    case RemoteRequest::ReadChanges:
+    {
+        const std::uint64_t afterSequence = request.ReadUInt64();
+        const std::chrono::milliseconds timeout{ request.ReadUInt32() };
+        const RegExpected<RegRemoteChangeList> changeList =
+            m_simulator.TryReadChanges(afterSequence, (std::min)(timeout, kMaxChangeWait));
+        if (!changeList.IsValid())
+        {
+            response.WriteUInt32(changeList.GetError().Code());
+            break;
+        }
+
+        response.WriteUInt32(ERROR_SUCCESS);
+        response.WriteUInt64(changeList.GetValue().Sequence);
+        response.WriteUInt32(changeList.GetValue().Overflow ? 1 : 0);
+        response.WriteUInt32(static_cast<std::uint32_t>(changeList.GetValue().Changes.size()));
+        for (const auto& [keyPath, deletedSubtree] : changeList.GetValue().Changes)
+        {
+            response.WriteString(keyPath);
+            response.WriteUInt32(deletedSubtree ? 1 : 0);
+        }
+        break;
+    }
+
+    default:
+        response.WriteUInt32(ERROR_NOT_SUPPORTED);
+        break;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//                  RegRemoteClientBackend Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegRemoteClientBackend::RegRemoteClientBackend(const unsigned short port, std::string address)
+    : m_address{ std::move(address) }
+    , m_port{ port }
+{}
+
+
+inline RegRemoteClientBackend::~RegRemoteClientBackend()
+{
+    m_stopping.store(true);
+
+    std::lock_guard<std::mutex> lock{ m_watcherMutex };
+    if (m_watcher.joinable())
+    {
+        m_watcher.join();
+    }
+}
+
+
+inline size_t RegRemoteClientBackend::OpenedConnectionCount() const noexcept
+{
+    return m_openedConnectionCount.load(std::memory_order_relaxed);
+}
+
+
+inline std::vector<BYTE> RegRemoteClientBackend::Call(details::RemoteMessageWriter& request)
+{
+    details::RemoteSocket connection;
+    {
+        std::lock_guard<std::mutex> lock{ m_connectionsMutex };
+        if (!m_idleConnections.empty())
+        {
+            connection = std::move(m_idleConnections.back());
+            m_idleConnections.pop_back();
+        }
+    }
+    if (!connection.IsValid())
+    {
+        connection = details::RemoteSocket::Connect(m_address.c_str(), m_port);
+        m_openedConnectionCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // A broken connection is closed, not reused
+    std::vector<BYTE> response;
+    if (!connection.SendMessage(request.Frame()) || !connection.ReceiveMessage(response))
+    {
+        throw RegException{ RPC_S_CALL_FAILED, "The connection to the remote registry server was lost." };
+    }
+
+    std::lock_guard<std::mutex> lock{ m_connectionsMutex };
+    if (m_idleConnections.size() < kMaxIdleConnections)
+    {
+        m_idleConnections.push_back(std::move(connection));
+    }
+    return response;
+}
+
+
+inline LSTATUS RegRemoteClientBackend::CallWithStatus(
+    details::RemoteMessageWriter& request,
+    std::vector<BYTE>& response
+)
+{
+    response = Call(request);
+    details::RemoteMessageReader reader{ response };
+    return static_cast<LSTATUS>(reader.ReadUInt32());
+}
+
+
+inline bool RegRemoteClientBackend::StoreContainsKey(const std::wstring_view keyPath)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::OpenKey));
+    request.WriteString(keyPath);
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if ((retCode != ERROR_SUCCESS) && (retCode != ERROR_FILE_NOT_FOUND))
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+    return retCode == ERROR_SUCCESS;
+}
+
+
+inline RegTree::ValuePtr RegRemoteClientBackend::StoreFindValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::GetValue));
+    request.WriteString(keyPath);
+    request.WriteString(valueName);
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if (retCode == ERROR_FILE_NOT_FOUND)
+    {
+        return nullptr;
+    }
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+
+    details::RemoteMessageReader reader{ response };
+    (void)reader.ReadUInt32();
+    return details::ReadRemoteValue(reader);
+}
+
+
+inline bool RegRemoteClientBackend::StoreReadSubKeys(
+    const std::wstring_view keyPath,
+    std::vector<std::wstring>& subKeyNames)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::EnumSubKeys));
+    request.WriteString(keyPath);
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if (retCode == ERROR_FILE_NOT_FOUND)
+    {
+        return false;
+    }
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+
+    details::RemoteMessageReader reader{ response };
+    (void)reader.ReadUInt32();
+    const size_t count = reader.ReadUInt32();
+    subKeyNames.clear();
+    for (size_t index = 0; index < count; index++)
+    {
+        subKeyNames.push_back(reader.ReadString());
+    }
+    return true;
+}
+
+
+inline bool RegRemoteClientBackend::StoreReadValues(
+    const std::wstring_view keyPath,
+    std::vector<RegTree::ValuePtr>& values)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::EnumValues));
+    request.WriteString(keyPath);
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if (retCode == ERROR_FILE_NOT_FOUND)
+    {
+        return false;
+    }
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+
+    details::RemoteMessageReader reader{ response };
+    (void)reader.ReadUInt32();
+    const size_t count = reader.ReadUInt32();
+    values.clear();
+    for (size_t index = 0; index < count; index++)
+    {
+        values.push_back(details::ReadRemoteValue(reader));
+    }
+    return true;
+}
+
+
+inline bool RegRemoteClientBackend::StoreCreateKey(const std::wstring_view keyPath)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::CreateKey));
+    request.WriteString(keyPath);
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+
+    details::RemoteMessageReader reader{ response };
+    (void)reader.ReadUInt32();
+    return reader.ReadUInt32() != 0;
+}
+
+
+inline void RegRemoteClientBackend::StoreSetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::SetValue));
+    request.WriteString(keyPath);
+    request.WriteString(valueName);
+    request.WriteUInt32(type);
+    request.WriteBytes(data, dataSize);
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+}
+
+
+inline bool RegRemoteClientBackend::StoreDeleteValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::DeleteValue));
+    request.WriteString(keyPath);
+    request.WriteString(valueName);
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if ((retCode != ERROR_SUCCESS) && (retCode != ERROR_FILE_NOT_FOUND))
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+    return retCode == ERROR_SUCCESS;
+}
+
+
+inline bool RegRemoteClientBackend::StoreDeleteTree(const std::wstring_view keyPath)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::DeleteTree));
+    request.WriteString(keyPath);
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if ((retCode != ERROR_SUCCESS) && (retCode != ERROR_FILE_NOT_FOUND))
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+    return retCode == ERROR_SUCCESS;
+}
+
+
+inline LSTATUS RegRemoteClientBackend::StoreRenameKey(
+    const std::wstring_view keyPath,
+    const std::wstring_view newKeyName)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::RenameKey));
+    request.WriteString(keyPath);
+    request.WriteString(newKeyName);
+
+    std::vector<BYTE> response;
+    return CallWithStatus(request, response);
+}
+
+
+inline RegRemoteChangeList RegRemoteClientBackend::ReadChanges(
+    const std::uint64_t afterSequence,
+    const std::chrono::milliseconds timeout)
+{
+    details::RemoteMessageWriter request;
+    request.WriteUInt32(static_cast<std::uint32_t>(details::RemoteRequest::ReadChanges));
+    request.WriteUInt64(afterSequence);
+    request.WriteUInt32(static_cast<std::uint32_t>(timeout.count()));
+
+    std::vector<BYTE> response;
+    const LSTATUS retCode = CallWithStatus(request, response);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "The remote registry request failed." };
+    }
+
+    details::RemoteMessageReader reader{ response };
+    (void)reader.ReadUInt32();
+
+    RegRemoteChangeList changeList;
+    changeList.Sequence = reader.ReadUInt64();
+    changeList.Overflow = (reader.ReadUInt32() != 0);
+    const size_t count = reader.ReadUInt32();
+    for (size_t index = 0; index < count; index++)
+    {
+        std::wstring keyPath = reader.ReadString();
+        const bool deletedSubtree = (reader.ReadUInt32() != 0);
+        changeList.Changes.emplace_back(std::move(keyPath), deletedSubtree);
+    }
+    return changeList;
+}
+
+
+inline LSTATUS RegRemoteClientBackend::StartChangeWatcher() noexcept
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock{ m_watcherMutex };
+        if (m_watcher.joinable())
+        {
+            return ERROR_SUCCESS;
+        }
+
+        // The changes made from now on are reported
+        const std::uint64_t sequence = ReadChanges(0, std::chrono::milliseconds{ 0 }).Sequence;
+        m_watcher = std::thread([this, sequence] { WatchChanges(sequence); });
+        return ERROR_SUCCESS;
+    }
+    catch (const RegException& e)
+    {
+        return static_cast<LSTATUS>(e.code().value());
+    }
+    catch (const std::bad_alloc&)
+    {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+    catch (...)
+    {
+        return ERROR_INTERNAL_ERROR;
+    }
+}
+
+
+inline void RegRemoteClientBackend::WatchChanges(std::uint64_t sequence)
+{
+    while (!m_stopping.load())
+    {
+        try
+        {
+            const RegRemoteChangeList changeList = ReadChanges(sequence, kChangePollTime);
+            sequence = changeList.Sequence;
+
+            if (changeList.Overflow)
+            {
+                NotifyStoreChange(std::wstring_view{}, true);
+            }
+            for (const auto& [keyPath, deletedSubtree] : changeList.Changes)
+            {
+                NotifyStoreChange(keyPath, deletedSubtree);
+            }
+        }
+        catch (...)
+        {
+            // The server can't be reached, or the request failed:
+            // the changes are read again later
+            std::this_thread::sleep_for(kChangePollTime);
+        }
+    }
+}
+
+
+inline LSTATUS RegRemoteClientBackend::NotifyChangeKeyValue(
+    const HKEY hKey,
+    const BOOL watchSubtree,
+    const DWORD notifyFilter,
+    const HANDLE event,
+    const BOOL asynchronous) noexcept
+{
+    const LSTATUS retCode = StartChangeWatcher();
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+    return RegMemoryBackend::NotifyChangeKeyValue(hKey, watchSubtree, notifyFilter, event, asynchronous);
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGREMOTESERVER_HPP_INCLUDED
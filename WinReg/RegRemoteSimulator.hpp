@@ -0,0 +1,1291 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGREMOTESIMULATOR_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGREMOTESIMULATOR_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegRemoteSimulator: an in-process stand-in for the registry of a remote machine,
+// with a configurable cost model and failure injection; and
+// RegRemoteSimulatorBackend, a backend that charges the same costs to the
+// registry calls made through another backend.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegConcurrentTree.hpp"// RegConcurrentTree
+
+#include <algorithm>        // std::min, std::max
+#include <atomic>           // std::atomic
+#include <chrono>           // std::chrono::microseconds
+#include <condition_variable> // std::condition_variable
+#include <cstdint>          // std::uint64_t
+#include <mutex>            // std::mutex, std::lock_guard
+#include <new>              // std::bad_alloc
+#include <random>           // std::mt19937, std::bernoulli_distribution
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <thread>           // std::this_thread::sleep_for
+#include <utility>          // std::move, std::pair
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+// Cost model and failure injection of RegRemoteSimulator
+struct RegRemoteSimulatorOptions
+{
+    // Fixed cost of each request (a network round trip)
+    std::chrono::microseconds RoundTripLatency{ 500 };
+
+    // Link bandwidth, used to add the transfer time of the request
+    // and response payloads; 0 means unlimited
+    ULONGLONG BytesPerSecond = 0;
+
+    // Probability (0 to 1) that a request fails with FailureCode,
+    // without being executed
+    double  FailureProbability = 0.0;
+    LSTATUS FailureCode = RPC_S_SERVER_UNAVAILABLE;
+
+    // Seed of the failure injection, for reproducible runs
+    unsigned int RandomSeed = 0;
+};
+
+// Counters of the requests served by RegRemoteSimulator
+struct RegRemoteSimulatorStatistics
+{
+    ULONGLONG Requests{ 0 };
+    ULONGLONG FailedRequests{ 0 };      // injected failures
+    ULONGLONG BytesTransferred{ 0 };    // request and response payloads
+    ULONGLONG SimulatedMicroseconds{ 0 };
+};
+
+// The changes of the remote tree after a given point
+// (see RegRemoteSimulator::TryReadChanges)
+struct RegRemoteChangeList
+{
+    // Sequence number of the latest change, to pass to the next call
+    std::uint64_t Sequence{ 0 };
+
+    // The case-folded paths of the changed keys, oldest first, each with
+    // a flag set if the key was deleted with its subtree
+    std::vector<std::pair<std::wstring, bool>> Changes;
+
+    // Some of the changes were dropped (only the most recent ones are kept):
+    // any key may have changed
+    bool Overflow{ false };
+};
+
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// The cost model and failure injection of a simulated link, with the counters
+// of the requests sent over it
+//------------------------------------------------------------------------------
+class SimulatedLink
+{
+public:
+
+    explicit SimulatedLink(const RegRemoteSimulatorOptions& options);
+
+    [[nodiscard]] RegRemoteSimulatorOptions Options() const;
+    void SetOptions(const RegRemoteSimulatorOptions& options);
+
+    [[nodiscard]] RegRemoteSimulatorStatistics Statistics() const noexcept;
+    void ResetStatistics() noexcept;
+
+    // Charge a round trip moving the given payload bytes, and decide whether
+    // it fails (unless canFail is false). Return ERROR_SUCCESS or the injected
+    // failure code.
+    [[nodiscard]] LSTATUS RoundTrip(ULONGLONG payloadBytes, bool canFail = true);
+
+    // Charge the transfer of the response payload of a successful request
+    void Response(ULONGLONG payloadBytes);
+
+private:
+
+    // Protects m_options and m_random
+    mutable std::mutex        m_optionsMutex;
+    RegRemoteSimulatorOptions m_options;
+    std::mt19937              m_random;
+
+    std::atomic<ULONGLONG> m_requests{ 0 };
+    std::atomic<ULONGLONG> m_failedRequests{ 0 };
+    std::atomic<ULONGLONG> m_bytesTransferred{ 0 };
+    std::atomic<ULONGLONG> m_simulatedMicroseconds{ 0 };
+};
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+// An in-process stand-in for the registry of a remote machine (as reached with
+// RegKey::ConnectRegistry), to measure remote-access strategies like batching
+// and connection pooling without a real host running the Remote Registry
+// service.
+//
+// The remote tree is a RegConcurrentTree. Each request (open, enumerate, get,
+// set, wait for change) is charged like a round trip: the calling thread
+// waits for the configured latency plus the transfer time of its payload,
+// and the request may fail with an injected error. TryGetValues reads many
+// values of a key in a single round trip.
+//
+// Waits shorter than a scheduler tick can't be slept accurately, so costs
+// below 2 ms are busy-waited on steady_clock; longer costs are slept, except
+// for their last 2 ms.
+//
+// Every change to the tree, made through the requests or directly on Tree(),
+// wakes the threads waiting in TryWaitForChange on that key (or on an
+// ancestor, when watching a subtree), like RegNotifyChangeKeyValue does;
+// deleting a key also wakes the waiters on its subkeys. TryReadChanges
+// returns all the recent changes instead, e.g. to forward them to a client.
+// Changes made directly on Tree() are not charged.
+//
+// The requests can be called in-process, or served over loopback TCP by
+// a RegRemoteServer to a RegRemoteClientBackend, that RegKey code runs
+// against unchanged (see RegRemoteServer.hpp). To charge the costs of a
+// remote link to the registry calls made through any other backend, use
+// RegRemoteSimulatorBackend.
+//------------------------------------------------------------------------------
+class RegRemoteSimulator
+{
+public:
+
+    explicit RegRemoteSimulator(const RegRemoteSimulatorOptions& options = RegRemoteSimulatorOptions{});
+
+    // Ban copy and move (the object is shared among threads)
+    RegRemoteSimulator(const RegRemoteSimulator&) = delete;
+    RegRemoteSimulator& operator=(const RegRemoteSimulator&) = delete;
+    RegRemoteSimulator(RegRemoteSimulator&&) = delete;
+    RegRemoteSimulator& operator=(RegRemoteSimulator&&) = delete;
+
+    // Access the remote tree directly (e.g. to populate it), at no cost
+    [[nodiscard]] RegConcurrentTree& Tree() noexcept;
+
+    [[nodiscard]] RegRemoteSimulatorOptions Options() const;
+    void SetOptions(const RegRemoteSimulatorOptions& options);
+
+    [[nodiscard]] RegRemoteSimulatorStatistics Statistics() const noexcept;
+    void ResetStatistics() noexcept;
+
+
+    //
+    // Requests: each one is a simulated round trip
+    //
+
+    // Check that the key exists (ERROR_FILE_NOT_FOUND otherwise)
+    [[nodiscard]] RegResult TryOpenKey(std::wstring_view keyPath);
+
+    [[nodiscard]] RegExpected<std::vector<std::wstring>> TryEnumSubKeys(std::wstring_view keyPath);
+    [[nodiscard]] RegExpected<std::vector<RegTree::ValuePtr>> TryEnumValues(std::wstring_view keyPath);
+
+    // Read a value (ERROR_FILE_NOT_FOUND if it doesn't exist)
+    [[nodiscard]] RegExpected<RegTree::ValuePtr> TryGetValue(std::wstring_view keyPath,
+                                                             std::wstring_view valueName);
+
+    // Read several values of a key in a single round trip;
+    // the missing values are returned as nullptr
+    [[nodiscard]] RegExpected<std::vector<RegTree::ValuePtr>> TryGetValues(
+        std::wstring_view keyPath,
+        const std::vector<std::wstring>& valueNames);
+
+    // Write a value, creating any missing key
+    [[nodiscard]] RegResult TrySetValue(std::wstring_view keyPath,
+                                        std::wstring_view valueName,
+                                        DWORD type,
+                                        std::vector<BYTE> data);
+
+    // Create a key, with any missing parent key; return true if it was created
+    [[nodiscard]] RegExpected<bool> TryCreateKey(std::wstring_view keyPath);
+
+    // Delete a value (ERROR_FILE_NOT_FOUND if it doesn't exist)
+    [[nodiscard]] RegResult TryDeleteValue(std::wstring_view keyPath, std::wstring_view valueName);
+
+    // Delete a key and its subtree (ERROR_FILE_NOT_FOUND if it doesn't exist)
+    [[nodiscard]] RegResult TryDeleteTree(std::wstring_view keyPath);
+
+    // Rename a key, keeping it under the same parent: ERROR_FILE_NOT_FOUND
+    // if it doesn't exist, ERROR_ACCESS_DENIED if the new name is taken
+    [[nodiscard]] RegResult TryRenameKey(std::wstring_view keyPath, std::wstring_view newKeyName);
+
+    // Wait until the key (or its subtree, if watchSubtree is true) is changed,
+    // or until the timeout expires (ERROR_TIMEOUT). The round trip is charged
+    // once the wait is over.
+    [[nodiscard]] RegResult TryWaitForChange(std::wstring_view keyPath,
+                                             bool watchSubtree,
+                                             std::chrono::milliseconds timeout);
+
+    // Wait until the tree is changed after the given sequence number (0 at
+    // the start), or until the timeout expires, and return the changes made
+    // meanwhile (none on timeout). The round trip is charged once the wait
+    // is over.
+    [[nodiscard]] RegExpected<RegRemoteChangeList> TryReadChanges(std::uint64_t afterSequence,
+                                                                  std::chrono::milliseconds timeout);
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Record a change of the tree and wake the waiters (the change handler
+    // of the tree)
+    void RecordChange(std::wstring_view keyPath, bool deletedSubtree);
+
+    RegConcurrentTree      m_tree;
+    details::SimulatedLink m_link;
+
+    // Change notifications: a sequence number and the most recent changes
+    static constexpr size_t kMaxRecentChanges = 1024;
+
+    struct Change
+    {
+        std::uint64_t Sequence{ 0 };
+        std::wstring  FoldedKeyPath;
+        bool          DeletedSubtree{ false };
+    };
+
+    std::mutex              m_changeMutex;
+    std::condition_variable m_changed;
+    std::uint64_t           m_changeSequence{ 0 };
+    std::vector<Change>     m_recentChanges;
+};
+
+
+//------------------------------------------------------------------------------
+// A registry backend that forwards the registry calls to another backend,
+// charging each of them like a request to a remote registry (see
+// RegRemoteSimulatorOptions): the calling thread waits for the round trip
+// latency plus the transfer time of the names and data it moves, and the
+// call may fail with an injected error, without being forwarded.
+//
+// Installed in place of the forwarded backend, it runs RegKey code as if the
+// keys were on a remote machine, e.g. to compare the round trips of reading
+// values one by one and of enumerating them. Each call is one round trip, as
+// with the Remote Registry service; closing a key is charged but never fails,
+// so that no handle is leaked.
+//------------------------------------------------------------------------------
+class RegRemoteSimulatorBackend : public RegBackend
+{
+public:
+
+    // The forwarded backend must outlive this object
+    explicit RegRemoteSimulatorBackend(RegBackend& backend,
+                                       const RegRemoteSimulatorOptions& options = RegRemoteSimulatorOptions{});
+
+    [[nodiscard]] RegRemoteSimulatorOptions Options() const;
+    void SetOptions(const RegRemoteSimulatorOptions& options);
+
+    [[nodiscard]] RegRemoteSimulatorStatistics Statistics() const noexcept;
+    void ResetStatistics() noexcept;
+
+
+    //
+    // RegBackend implementation
+    //
+
+    LSTATUS OpenKeyEx(HKEY hKey, LPCWSTR subKey, DWORD options, REGSAM desiredAccess,
+                      PHKEY result) noexcept override;
+
+    LSTATUS CreateKeyEx(HKEY hKey, LPCWSTR subKey, DWORD reserved, LPWSTR keyClass,
+                        DWORD options, REGSAM desiredAccess,
+                        SECURITY_ATTRIBUTES* securityAttributes,
+                        PHKEY result, LPDWORD disposition) noexcept override;
+
+    LSTATUS CloseKey(HKEY hKey) noexcept override;
+
+    LSTATUS GetValue(HKEY hKey, LPCWSTR subKey, LPCWSTR valueName, DWORD flags,
+                     LPDWORD type, void* data, LPDWORD dataSize) noexcept override;
+
+    LSTATUS QueryValueEx(HKEY hKey, LPCWSTR valueName, LPDWORD reserved, LPDWORD type,
+                         BYTE* data, LPDWORD dataSize) noexcept override;
+
+    LSTATUS SetValueEx(HKEY hKey, LPCWSTR valueName, DWORD reserved, DWORD type,
+                       const BYTE* data, DWORD dataSize) noexcept override;
+
+    LSTATUS QueryInfoKey(HKEY hKey, LPWSTR keyClass, LPDWORD keyClassLength,
+                         LPDWORD reserved, LPDWORD subKeyCount,
+                         LPDWORD maxSubKeyNameLength, LPDWORD maxClassLength,
+                         LPDWORD valueCount, LPDWORD maxValueNameLength,
+                         LPDWORD maxValueDataLength, LPDWORD securityDescriptorSize,
+                         FILETIME* lastWriteTime) noexcept override;
+
+    LSTATUS EnumKeyEx(HKEY hKey, DWORD index, LPWSTR name, LPDWORD nameLength,
+                      LPDWORD reserved, LPWSTR keyClass, LPDWORD keyClassLength,
+                      FILETIME* lastWriteTime) noexcept override;
+
+    LSTATUS EnumValue(HKEY hKey, DWORD index, LPWSTR valueName, LPDWORD valueNameLength,
+                      LPDWORD reserved, LPDWORD type, BYTE* data,
+                      LPDWORD dataSize) noexcept override;
+
+    LSTATUS DeleteValue(HKEY hKey, LPCWSTR valueName) noexcept override;
+
+    LSTATUS DeleteKeyEx(HKEY hKey, LPCWSTR subKey, REGSAM desiredAccess,
+                        DWORD reserved) noexcept override;
+
+    LSTATUS DeleteTree(HKEY hKey, LPCWSTR subKey) noexcept override;
+
+    LSTATUS ConnectRegistry(LPCWSTR machineName, HKEY hKey, PHKEY result) noexcept override;
+
+    LSTATUS SetKeyValue(HKEY hKey, LPCWSTR subKey, LPCWSTR valueName, DWORD type,
+                        const void* data, DWORD dataSize) noexcept override;
+
+    LSTATUS CopyTree(HKEY hKeySource, LPCWSTR subKey, HKEY hKeyDest) noexcept override;
+    LSTATUS RenameKey(HKEY hKey, LPCWSTR subKey, LPCWSTR newKeyName) noexcept override;
+    LSTATUS FlushKey(HKEY hKey) noexcept override;
+
+    LSTATUS LoadKey(HKEY hKey, LPCWSTR subKey, LPCWSTR fileName) noexcept override;
+    LSTATUS SaveKey(HKEY hKey, LPCWSTR fileName,
+                    SECURITY_ATTRIBUTES* securityAttributes) noexcept override;
+
+    LSTATUS QueryReflectionKey(HKEY hKey, BOOL* isReflectionDisabled) noexcept override;
+    LSTATUS EnableReflectionKey(HKEY hKey) noexcept override;
+    LSTATUS DisableReflectionKey(HKEY hKey) noexcept override;
+
+    // A synchronous call is charged once the notification arrives
+    LSTATUS NotifyChangeKeyValue(HKEY hKey, BOOL watchSubtree, DWORD notifyFilter,
+                                 HANDLE event, BOOL asynchronous) noexcept override;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Charge a round trip moving the given payload bytes, then forward the call
+    // (unless an injected failure is allowed and drawn), turning the exceptions
+    // of the cost model into error codes
+    template <typename Call>
+    [[nodiscard]] LSTATUS Forward(ULONGLONG payloadBytes, bool canFail, Call&& call) noexcept;
+
+    RegBackend&            m_backend;
+    details::SimulatedLink m_link;
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegRemoteSimulator
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+// Size of a string sent over the simulated link, in bytes
+[[nodiscard]] inline ULONGLONG SimulatedPayloadSize(const std::wstring_view s) noexcept
+{
+    return static_cast<ULONGLONG>(s.length()) * sizeof(wchar_t);
+}
+
+
+// Same as above for a string that may be nullptr (sent as an empty one)
+[[nodiscard]] inline ULONGLONG SimulatedPayloadSize(const LPCWSTR s) noexcept
+{
+    return (s != nullptr) ? SimulatedPayloadSize(std::wstring_view{ s }) : 0;
+}
+
+
+// Size of a value sent over the simulated link, in bytes
+[[nodiscard]] inline ULONGLONG SimulatedPayloadSize(const RegTree::Value& value) noexcept
+{
+    return SimulatedPayloadSize(value.Name) + sizeof(DWORD) + value.DataSize;
+}
+
+
+// Time to transfer the given bytes at the given bandwidth (0 means unlimited)
+[[nodiscard]] inline std::chrono::microseconds SimulatedTransferTime(
+    const ULONGLONG bytes,
+    const ULONGLONG bytesPerSecond
+) noexcept
+{
+    if (bytesPerSecond == 0)
+    {
+        return std::chrono::microseconds{ 0 };
+    }
+    return std::chrono::microseconds{
+        static_cast<std::chrono::microseconds::rep>((bytes * 1000000) / bytesPerSecond) };
+}
+
+
+// Wait for the given simulated cost. Sleeping is only as accurate as the
+// scheduler tick (about 15.6 ms by default on Windows), so the last part
+// of the wait spins on steady_clock.
+inline void SimulateDelay(const std::chrono::microseconds cost)
+{
+    constexpr std::chrono::milliseconds kSpinTime{ 2 };
+
+    const auto deadline = std::chrono::steady_clock::now() + cost;
+    if (cost > kSpinTime)
+    {
+        std::this_thread::sleep_for(cost - kSpinTime);
+    }
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::yield();
+    }
+}
+
+
+
+//------------------------------------------------------------------------------
+//                      SimulatedLink Inline Methods
+//------------------------------------------------------------------------------
+
+inline SimulatedLink::SimulatedLink(const RegRemoteSimulatorOptions& options)
+    : m_options{ options }
+    , m_random{ options.RandomSeed }
+{}
+
+
+inline RegRemoteSimulatorOptions SimulatedLink::Options() const
+{
+    std::lock_guard<std::mutex> lock{ m_optionsMutex };
+    return m_options;
+}
+
+
+inline void SimulatedLink::SetOptions(const RegRemoteSimulatorOptions& options)
+{
+    std::lock_guard<std::mutex> lock{ m_optionsMutex };
+    m_options = options;
+    m_random.seed(options.RandomSeed);
+}
+
+
+inline RegRemoteSimulatorStatistics SimulatedLink::Statistics() const noexcept
+{
+    RegRemoteSimulatorStatistics statistics;
+    statistics.Requests = m_requests.load(std::memory_order_relaxed);
+    statistics.FailedRequests = m_failedRequests.load(std::memory_order_relaxed);
+    statistics.BytesTransferred = m_bytesTransferred.load(std::memory_order_relaxed);
+    statistics.SimulatedMicroseconds = m_simulatedMicroseconds.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+
+inline void SimulatedLink::ResetStatistics() noexcept
+{
+    m_requests.store(0, std::memory_order_relaxed);
+    m_failedRequests.store(0, std::memory_order_relaxed);
+    m_bytesTransferred.store(0, std::memory_order_relaxed);
+    m_simulatedMicroseconds.store(0, std::memory_order_relaxed);
+}
+
+
+inline LSTATUS SimulatedLink::RoundTrip(const ULONGLONG payloadBytes, const bool canFail)
+{
+    std::chrono::microseconds cost{ 0 };
+    LSTATUS failureCode = ERROR_SUCCESS;
+    {
+        std::lock_guard<std::mutex> lock{ m_optionsMutex };
+        cost = m_options.RoundTripLatency
+            + SimulatedTransferTime(payloadBytes, m_options.BytesPerSecond);
+
+        const double probability = (std::min)((std::max)(m_options.FailureProbability, 0.0), 1.0);
+        if (canFail && (probability > 0.0) && std::bernoulli_distribution{ probability }(m_random))
+        {
+            failureCode = m_options.FailureCode;
+        }
+    }
+
+    m_requests.fetch_add(1, std::memory_order_relaxed);
+    m_bytesTransferred.fetch_add(payloadBytes, std::memory_order_relaxed);
+    m_simulatedMicroseconds.fetch_add(static_cast<ULONGLONG>(cost.count()), std::memory_order_relaxed);
+    SimulateDelay(cost);
+
+    if (failureCode != ERROR_SUCCESS)
+    {
+        m_failedRequests.fetch_add(1, std::memory_order_relaxed);
+    }
+    return failureCode;
+}
+
+
+inline void SimulatedLink::Response(const ULONGLONG payloadBytes)
+{
+    ULONGLONG bytesPerSecond = 0;
+    {
+        std::lock_guard<std::mutex> lock{ m_optionsMutex };
+        bytesPerSecond = m_options.BytesPerSecond;
+    }
+
+    const std::chrono::microseconds cost = SimulatedTransferTime(payloadBytes, bytesPerSecond);
+    m_bytesTransferred.fetch_add(payloadBytes, std::memory_order_relaxed);
+    m_simulatedMicroseconds.fetch_add(static_cast<ULONGLONG>(cost.count()), std::memory_order_relaxed);
+    SimulateDelay(cost);
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegRemoteSimulator Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegRemoteSimulator::RegRemoteSimulator(const RegRemoteSimulatorOptions& options)
+    : m_link{ options }
+{
+    m_tree.SetChangeHandler([this](const std::wstring_view keyPath, const bool deletedSubtree)
+        {
+            RecordChange(keyPath, deletedSubtree);
+        }
+    );
+}
+
+
+inline RegConcurrentTree& RegRemoteSimulator::Tree() noexcept
+{
+    return m_tree;
+}
+
+
+inline RegRemoteSimulatorOptions RegRemoteSimulator::Options() const
+{
+    return m_link.Options();
+}
+
+
+inline void RegRemoteSimulator::SetOptions(const RegRemoteSimulatorOptions& options)
+{
+    m_link.SetOptions(options);
+}
+
+
+inline RegRemoteSimulatorStatistics RegRemoteSimulator::Statistics() const noexcept
+{
+    return m_link.Statistics();
+}
+
+
+inline void RegRemoteSimulator::ResetStatistics() noexcept
+{
+    m_link.ResetStatistics();
+}
+
+
+inline RegResult RegRemoteSimulator::TryOpenKey(const std::wstring_view keyPath)
+{
+    const LSTATUS retCode = m_link.RoundTrip(details::SimulatedPayloadSize(keyPath));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
+
+    return RegResult{ m_tree.ContainsKey(keyPath) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND };
+}
+
+
+inline RegExpected<std::vector<std::wstring>> RegRemoteSimulator::TryEnumSubKeys(const std::wstring_view keyPath)
+{
+    using ReturnType = std::vector<std::wstring>;
+
+    const LSTATUS retCode = m_link.RoundTrip(details::SimulatedPayloadSize(keyPath));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<ReturnType>{ RegResult{ retCode } };
+    }
+
+    RegExpected<ReturnType> subKeyNames = m_tree.TryEnumSubKeys(keyPath);
+    if (subKeyNames.IsValid())
+    {
+        ULONGLONG responseBytes = 0;
+        for (const std::wstring& name : subKeyNames.GetValue())
+        {
+            responseBytes += details::SimulatedPayloadSize(name);
+        }
+        m_link.Response(responseBytes);
+    }
+    return subKeyNames;
+}
+
+
+inline RegExpected<std::vector<RegTree::ValuePtr>>
+    RegRemoteSimulator::TryEnumValues(const std::wstring_view keyPath)
+{
+    using ReturnType = std::vector<RegTree::ValuePtr>;
+
+    const LSTATUS retCode = m_link.RoundTrip(details::SimulatedPayloadSize(keyPath));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<ReturnType>{ RegResult{ retCode } };
+    }
+
+    RegExpected<ReturnType> values = m_tree.TryEnumValues(keyPath);
+    if (values.IsValid())
+    {
+        ULONGLONG responseBytes = 0;
+        for (const RegTree::ValuePtr& value : values.GetValue())
+        {
+            responseBytes += details::SimulatedPayloadSize(*value);
+        }
+        m_link.Response(responseBytes);
+    }
+    return values;
+}
+
+
+inline RegExpected<RegTree::ValuePtr> RegRemoteSimulator::TryGetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName
+)
+{
+    using ReturnType = RegTree::ValuePtr;
+
+    const LSTATUS retCode = m_link.RoundTrip(
+        details::SimulatedPayloadSize(keyPath) + details::SimulatedPayloadSize(valueName));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<ReturnType>{ RegResult{ retCode } };
+    }
+
+    ReturnType value = m_tree.FindValue(keyPath, valueName);
+    if (!value)
+    {
+        return RegExpected<ReturnType>{ RegResult{ ERROR_FILE_NOT_FOUND } };
+    }
+
+    m_link.Response(details::SimulatedPayloadSize(*value));
+    return RegExpected<ReturnType>{ std::move(value) };
+}
+
+
+inline RegExpected<std::vector<RegTree::ValuePtr>> RegRemoteSimulator::TryGetValues(
+    const std::wstring_view keyPath,
+    const std::vector<std::wstring>& valueNames
+)
+{
+    using ReturnType = std::vector<RegTree::ValuePtr>;
+
+    ULONGLONG requestBytes = details::SimulatedPayloadSize(keyPath);
+    for (const std::wstring& valueName : valueNames)
+    {
+        requestBytes += details::SimulatedPayloadSize(valueName);
+    }
+
+    const LSTATUS retCode = m_link.RoundTrip(requestBytes);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<ReturnType>{ RegResult{ retCode } };
+    }
+
+    // A single consistent read of the values of the key
+    RegExpected<ReturnType> keyValues = m_tree.TryEnumValues(keyPath);
+    if (!keyValues.IsValid())
+    {
+        return keyValues;
+    }
+
+    ReturnType values;
+    values.reserve(valueNames.size());
+    ULONGLONG responseBytes = 0;
+    for (const std::wstring& valueName : valueNames)
+    {
+        const auto [position, found] = details::FindByFoldedName(keyValues.GetValue(), valueName);
+        if (found)
+        {
+            values.push_back(keyValues.GetValue()[position]);
+            responseBytes += details::SimulatedPayloadSize(*values.back());
+        }
+        else
+        {
+            values.push_back(nullptr);
+        }
+    }
+
+    m_link.Response(responseBytes);
+    return RegExpected<ReturnType>{ std::move(values) };
+}
+
+
+inline RegResult RegRemoteSimulator::TrySetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    std::vector<BYTE> data
+)
+{
+    const LSTATUS retCode = m_link.RoundTrip(
+        details::SimulatedPayloadSize(keyPath) + details::SimulatedPayloadSize(valueName)
+        + sizeof(DWORD) + data.size());
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
+
+    // The waiters are woken by RecordChange
+    m_tree.SetValue(keyPath, valueName, type, std::move(data));
+    return RegResult{ ERROR_SUCCESS };
+}
+
+
+inline RegExpected<bool> RegRemoteSimulator::TryCreateKey(const std::wstring_view keyPath)
+{
+    const LSTATUS retCode = m_link.RoundTrip(details::SimulatedPayloadSize(keyPath));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<bool>{ RegResult{ retCode } };
+    }
+
+    return RegExpected<bool>{ m_tree.CreateKey(keyPath) };
+}
+
+
+inline RegResult RegRemoteSimulator::TryDeleteValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName
+)
+{
+    const LSTATUS retCode = m_link.RoundTrip(
+        details::SimulatedPayloadSize(keyPath) + details::SimulatedPayloadSize(valueName));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
+
+    return RegResult{ m_tree.DeleteValue(keyPath, valueName) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND };
+}
+
+
+inline RegResult RegRemoteSimulator::TryDeleteTree(const std::wstring_view keyPath)
+{
+    const LSTATUS retCode = m_link.RoundTrip(details::SimulatedPayloadSize(keyPath));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
+
+    return RegResult{ m_tree.DeleteTree(keyPath) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND };
+}
+
+
+inline RegResult RegRemoteSimulator::TryRenameKey(
+    const std::wstring_view keyPath,
+    const std::wstring_view newKeyName
+)
+{
+    const LSTATUS retCode = m_link.RoundTrip(
+        details::SimulatedPayloadSize(keyPath) + details::SimulatedPayloadSize(newKeyName));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
+
+    if (m_tree.RenameKey(keyPath, newKeyName))
+    {
+        return RegResult{ ERROR_SUCCESS };
+    }
+    return RegResult{ m_tree.ContainsKey(keyPath) ? ERROR_ACCESS_DENIED : ERROR_FILE_NOT_FOUND };
+}
+
+
+inline void RegRemoteSimulator::RecordChange(const std::wstring_view keyPath, const bool deletedSubtree)
+{
+    std::wstring foldedKeyPath = details::FoldKeyPath(keyPath);
+    {
+        std::lock_guard<std::mutex> lock{ m_changeMutex };
+        m_changeSequence++;
+        if (m_recentChanges.size() == kMaxRecentChanges)
+        {
+            m_recentChanges.erase(m_recentChanges.begin());
+        }
+        m_recentChanges.push_back(Change{ m_changeSequence, std::move(foldedKeyPath), deletedSubtree });
+    }
+    m_changed.notify_all();
+}
+
+
+inline RegResult RegRemoteSimulator::TryWaitForChange(
+    const std::wstring_view keyPath,
+    const bool watchSubtree,
+    const std::chrono::milliseconds timeout
+)
+{
+    const std::wstring watchedPath = details::FoldKeyPath(keyPath);
+
+    bool changed = false;
+    {
+        std::unique_lock<std::mutex> lock{ m_changeMutex };
+        const std::uint64_t startSequence = m_changeSequence;
+
+        auto isWatchedChange = [&]()
+        {
+            if (m_changeSequence == startSequence)
+            {
+                return false;
+            }
+
+            // Some changes after the start were dropped: report a change
+            if (m_recentChanges.empty() || (m_recentChanges.front().Sequence > startSequence + 1))
+            {
+                return true;
+            }
+
+            for (auto it = m_recentChanges.rbegin();
+                 (it != m_recentChanges.rend()) && (it->Sequence > startSequence);
+                 ++it)
+            {
+                if (details::IsWatchedChange(it->FoldedKeyPath, watchedPath, watchSubtree)
+                    || (it->DeletedSubtree && details::IsWatchedChange(watchedPath, it->FoldedKeyPath, true)))
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        changed = m_changed.wait_for(lock, timeout, isWatchedChange);
+    }
+
+    const LSTATUS retCode = m_link.RoundTrip(details::SimulatedPayloadSize(keyPath));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
+
+    return RegResult{ changed ? ERROR_SUCCESS : ERROR_TIMEOUT };
+}
+
+
+inline RegExpected<RegRemoteChangeList> RegRemoteSimulator::TryReadChanges(
+    const std::uint64_t afterSequence,
+    const std::chrono::milliseconds timeout
+)
+{
+    RegRemoteChangeList changeList;
+    ULONGLONG responseBytes = sizeof(changeList.Sequence);
+    {
+        std::unique_lock<std::mutex> lock{ m_changeMutex };
+        m_changed.wait_for(lock, timeout, [this, afterSequence] { return m_changeSequence != afterSequence; });
+
+        // A sequence number from the future (e.g. of another simulator)
+        // is reported like dropped changes
+        changeList.Sequence = m_changeSequence;
+        changeList.Overflow = (afterSequence > m_changeSequence)
+            || ((afterSequence < m_changeSequence)
+                && (m_recentChanges.empty() || (m_recentChanges.front().Sequence > afterSequence + 1)));
+
+        if (!changeList.Overflow)
+        {
+            for (const Change& change : m_recentChanges)
+            {
+                if (change.Sequence > afterSequence)
+                {
+                    changeList.Changes.emplace_back(change.FoldedKeyPath, change.DeletedSubtree);
+                    responseBytes += details::SimulatedPayloadSize(change.FoldedKeyPath) + 1;
+                }
+            }
+        }
+    }
+
+    const LSTATUS retCode = m_link.RoundTrip(sizeof(afterSequence));
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<RegRemoteChangeList>{ RegResult{ retCode } };
+    }
+
+    m_link.Response(responseBytes);
+    return RegExpected<RegRemoteChangeList>{ std::move(changeList) };
+}
+
+
+//------------------------------------------------------------------------------
+//                  RegRemoteSimulatorBackend Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegRemoteSimulatorBackend::RegRemoteSimulatorBackend(
+    RegBackend& backend,
+    const RegRemoteSimulatorOptions& options
+)
+    : m_backend{ backend }
+    , m_link{ options }
+{}
+
+
+inline RegRemoteSimulatorOptions RegRemoteSimulatorBackend::Options() const
+{
+    return m_link.Options();
+}
+
+
+inline void RegRemoteSimulatorBackend::SetOptions(const RegRemoteSimulatorOptions& options)
+{
+    m_link.SetOptions(options);
+}
+
+
+inline RegRemoteSimulatorStatistics RegRemoteSimulatorBackend::Statistics() const noexcept
+{
+    return m_link.Statistics();
+}
+
+
+inline void RegRemoteSimulatorBackend::ResetStatistics() noexcept
+{
+    m_link.ResetStatistics();
+}
+
+
+template <typename Call>
+inline LSTATUS RegRemoteSimulatorBackend::Forward(
+    const ULONGLONG payloadBytes,
+    const bool canFail,
+    Call&& call) noexcept
+{
+    try
+    {
+        const LSTATUS retCode = m_link.RoundTrip(payloadBytes, canFail);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+        return call();
+    }
+    catch (const std::bad_alloc&)
+    {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+    catch (...)
+    {
+        return ERROR_INTERNAL_ERROR;
+    }
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::OpenKeyEx(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const DWORD options,
+    const REGSAM desiredAccess,
+    const PHKEY result) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(subKey), true, [&] {
+        return m_backend.OpenKeyEx(hKey, subKey, options, desiredAccess, result);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::CreateKeyEx(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const DWORD reserved,
+    const LPWSTR keyClass,
+    const DWORD options,
+    const REGSAM desiredAccess,
+    SECURITY_ATTRIBUTES* const securityAttributes,
+    const PHKEY result,
+    const LPDWORD disposition) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(subKey) + details::SimulatedPayloadSize(keyClass), true, [&] {
+        return m_backend.CreateKeyEx(hKey, subKey, reserved, keyClass, options, desiredAccess,
+                                     securityAttributes, result, disposition);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::CloseKey(const HKEY hKey) noexcept
+{
+    return Forward(0, false, [&] {
+        return m_backend.CloseKey(hKey);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::GetValue(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const LPCWSTR valueName,
+    const DWORD flags,
+    const LPDWORD type,
+    void* const data,
+    const LPDWORD dataSize) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(subKey) + details::SimulatedPayloadSize(valueName), true, [&] {
+        const LSTATUS retCode = m_backend.GetValue(hKey, subKey, valueName, flags, type, data, dataSize);
+        if ((retCode == ERROR_SUCCESS) && (data != nullptr) && (dataSize != nullptr))
+        {
+            m_link.Response(*dataSize);
+        }
+        return retCode;
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::QueryValueEx(
+    const HKEY hKey,
+    const LPCWSTR valueName,
+    const LPDWORD reserved,
+    const LPDWORD type,
+    BYTE* const data,
+    const LPDWORD dataSize) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(valueName), true, [&] {
+        const LSTATUS retCode = m_backend.QueryValueEx(hKey, valueName, reserved, type, data, dataSize);
+        if ((retCode == ERROR_SUCCESS) && (data != nullptr) && (dataSize != nullptr))
+        {
+            m_link.Response(*dataSize);
+        }
+        return retCode;
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::SetValueEx(
+    const HKEY hKey,
+    const LPCWSTR valueName,
+    const DWORD reserved,
+    const DWORD type,
+    const BYTE* const data,
+    const DWORD dataSize) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(valueName) + sizeof(DWORD) + dataSize, true, [&] {
+        return m_backend.SetValueEx(hKey, valueName, reserved, type, data, dataSize);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::QueryInfoKey(
+    const HKEY hKey,
+    const LPWSTR keyClass,
+    const LPDWORD keyClassLength,
+    const LPDWORD reserved,
+    const LPDWORD subKeyCount,
+    const LPDWORD maxSubKeyNameLength,
+    const LPDWORD maxClassLength,
+    const LPDWORD valueCount,
+    const LPDWORD maxValueNameLength,
+    const LPDWORD maxValueDataLength,
+    const LPDWORD securityDescriptorSize,
+    FILETIME* const lastWriteTime) noexcept
+{
+    return Forward(0, true, [&] {
+        return m_backend.QueryInfoKey(hKey, keyClass, keyClassLength, reserved, subKeyCount,
+                                      maxSubKeyNameLength, maxClassLength, valueCount, maxValueNameLength,
+                                      maxValueDataLength, securityDescriptorSize, lastWriteTime);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::EnumKeyEx(
+    const HKEY hKey,
+    const DWORD index,
+    const LPWSTR name,
+    const LPDWORD nameLength,
+    const LPDWORD reserved,
+    const LPWSTR keyClass,
+    const LPDWORD keyClassLength,
+    FILETIME* const lastWriteTime) noexcept
+{
+    return Forward(sizeof(index), true, [&] {
+        const LSTATUS retCode = m_backend.EnumKeyEx(hKey, index, name, nameLength, reserved,
+                                                    keyClass, keyClassLength, lastWriteTime);
+        if (retCode == ERROR_SUCCESS)
+        {
+            m_link.Response(static_cast<ULONGLONG>(*nameLength) * sizeof(wchar_t));
+        }
+        return retCode;
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::EnumValue(
+    const HKEY hKey,
+    const DWORD index,
+    const LPWSTR valueName,
+    const LPDWORD valueNameLength,
+    const LPDWORD reserved,
+    const LPDWORD type,
+    BYTE* const data,
+    const LPDWORD dataSize) noexcept
+{
+    return Forward(sizeof(index), true, [&] {
+        const LSTATUS retCode = m_backend.EnumValue(hKey, index, valueName, valueNameLength, reserved,
+                                                    type, data, dataSize);
+        if (retCode == ERROR_SUCCESS)
+        {
+            const ULONGLONG dataBytes = ((data != nullptr) && (dataSize != nullptr)) ? *dataSize : 0;
+            m_link.Response(static_cast<ULONGLONG>(*valueNameLength) * sizeof(wchar_t) + dataBytes);
+        }
+        return retCode;
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::DeleteValue(const HKEY hKey, const LPCWSTR valueName) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(valueName), true, [&] {
+        return m_backend.DeleteValue(hKey, valueName);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::DeleteKeyEx(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const REGSAM desiredAccess,
+    const DWORD reserved) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(subKey), true, [&] {
+        return m_backend.DeleteKeyEx(hKey, subKey, desiredAccess, reserved);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::DeleteTree(const HKEY hKey, const LPCWSTR subKey) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(subKey), true, [&] {
+        return m_backend.DeleteTree(hKey, subKey);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::ConnectRegistry(
+    const LPCWSTR machineName,
+    const HKEY hKey,
+    const PHKEY result) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(machineName), true, [&] {
+        return m_backend.ConnectRegistry(machineName, hKey, result);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::SetKeyValue(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const LPCWSTR valueName,
+    const DWORD type,
+    const void* const data,
+    const DWORD dataSize) noexcept
+{
+    const ULONGLONG payloadBytes = details::SimulatedPayloadSize(subKey)
+        + details::SimulatedPayloadSize(valueName) + sizeof(DWORD) + dataSize;
+    return Forward(payloadBytes, true, [&] {
+        return m_backend.SetKeyValue(hKey, subKey, valueName, type, data, dataSize);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::CopyTree(
+    const HKEY hKeySource,
+    const LPCWSTR subKey,
+    const HKEY hKeyDest) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(subKey), true, [&] {
+        return m_backend.CopyTree(hKeySource, subKey, hKeyDest);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::RenameKey(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const LPCWSTR newKeyName) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(subKey) + details::SimulatedPayloadSize(newKeyName), true, [&] {
+        return m_backend.RenameKey(hKey, subKey, newKeyName);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::FlushKey(const HKEY hKey) noexcept
+{
+    return Forward(0, true, [&] {
+        return m_backend.FlushKey(hKey);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::LoadKey(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const LPCWSTR fileName) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(subKey) + details::SimulatedPayloadSize(fileName), true, [&] {
+        return m_backend.LoadKey(hKey, subKey, fileName);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::SaveKey(
+    const HKEY hKey,
+    const LPCWSTR fileName,
+    SECURITY_ATTRIBUTES* const securityAttributes) noexcept
+{
+    return Forward(details::SimulatedPayloadSize(fileName), true, [&] {
+        return m_backend.SaveKey(hKey, fileName, securityAttributes);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::QueryReflectionKey(
+    const HKEY hKey,
+    BOOL* const isReflectionDisabled) noexcept
+{
+    return Forward(0, true, [&] {
+        return m_backend.QueryReflectionKey(hKey, isReflectionDisabled);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::EnableReflectionKey(const HKEY hKey) noexcept
+{
+    return Forward(0, true, [&] {
+        return m_backend.EnableReflectionKey(hKey);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::DisableReflectionKey(const HKEY hKey) noexcept
+{
+    return Forward(0, true, [&] {
+        return m_backend.DisableReflectionKey(hKey);
+    });
+}
+
+
+inline LSTATUS RegRemoteSimulatorBackend::NotifyChangeKeyValue(
+    const HKEY hKey,
+    const BOOL watchSubtree,
+    const DWORD notifyFilter,
+    const HANDLE event,
+    const BOOL asynchronous) noexcept
+{
+    if (asynchronous)
+    {
+        return Forward(0, true, [&] {
+            return m_backend.NotifyChangeKeyValue(hKey, watchSubtree, notifyFilter, event, asynchronous);
+        });
+    }
+
+    const LSTATUS retCode = m_backend.NotifyChangeKeyValue(hKey, watchSubtree, notifyFilter, event, asynchronous);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+    return Forward(0, true, [] {
+        return static_cast<LSTATUS>(ERROR_SUCCESS);
+    });
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGREMOTESIMULATOR_HPP_INCLUDED
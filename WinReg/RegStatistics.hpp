@@ -0,0 +1,1181 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGSTATISTICS_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGSTATISTICS_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegStatistics: statistics about a registry subtree (a live key or a RegTree
+// snapshot), for capacity planning.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegTree.hpp"      // RegTree
+
+#include <algorithm>        // std::push_heap, std::pop_heap, std::sort
+#include <atomic>           // std::atomic
+#include <cstdint>          // std::uint32_t
+#include <exception>        // std::exception_ptr
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <thread>           // std::thread
+#include <utility>          // std::move
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Options
+//
+
+// Options for RegStatistics::Analyze
+struct RegStatisticsOptions
+{
+    // Number of entries kept in each top-N list
+    size_t TopCount = 10;
+
+    // Number of threads walking the top-level subkeys in parallel;
+    // 0 uses std::thread::hardware_concurrency().
+    // Only the top-level subkeys are split among the threads: each of their
+    // subtrees is walked by a single thread.
+    unsigned int ThreadCount = 0;
+
+    // Cancellation and deadline of the walk
+    RegOperationLimits Limits;
+
+    // Registry view the subkeys are opened in
+    REGSAM RegistryView = KEY_WOW64_64KEY;
+};
+
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// Statistics about a registry subtree, for capacity planning.
+//
+// Analyze walks a RegKey subtree (or a RegTree snapshot), splitting the
+// top-level subkeys among worker threads (deeper levels are not split, so
+// a subtree dominated by a single top-level subkey is walked by a single
+// thread), and collects counts, histograms,
+// per-type totals, and top-N lists of the largest values and of the largest
+// and widest keys. The top-N lists are kept in bounded heaps, so the memory
+// used doesn't depend on the size of the tree.
+//
+// Histograms of sizes use power-of-two buckets: bucket 0 counts zeros, and
+// bucket i (i > 0) counts sizes in [2^(i-1), 2^i).
+//------------------------------------------------------------------------------
+class RegStatistics
+{
+public:
+
+    // Number of buckets in the name length and data size histograms
+    static constexpr size_t kHistogramBucketCount = 33;
+
+    // Number of values and data bytes for a registry type
+    struct TypeTotal
+    {
+        DWORD     Type{ REG_NONE };
+        ULONGLONG ValueCount{ 0 };
+        ULONGLONG DataBytes{ 0 };
+    };
+
+    // An entry of the top-N value list
+    struct ValueEntry
+    {
+        std::wstring KeyPath;
+        std::wstring ValueName;
+        DWORD        Type{ REG_NONE };
+        ULONGLONG    DataSize{ 0 };
+    };
+
+    // An entry of the top-N key lists: Measure is the total data size of the
+    // key values (for LargestKeys) or its number of subkeys and values
+    // (for WidestKeys)
+    struct KeyEntry
+    {
+        std::wstring KeyPath;
+        ULONGLONG    Measure{ 0 };
+    };
+
+    // Initialize empty statistics
+    RegStatistics();
+
+    // Analyze the subtree of an open key (opened with KEY_READ access).
+    // Subkeys that can't be opened for access rights are skipped, and counted
+    // in InaccessibleKeyCount. Throw RegException on other failures.
+    [[nodiscard]] static RegStatistics Analyze(const RegKey& key,
+                                               const RegStatisticsOptions& options = RegStatisticsOptions{});
+
+    [[nodiscard]] static RegExpected<RegStatistics> TryAnalyze(const RegKey& key,
+                                                               const RegStatisticsOptions& options = RegStatisticsOptions{});
+
+    // Analyze an in-memory tree snapshot
+    [[nodiscard]] static RegStatistics Analyze(const RegTree& tree,
+                                               const RegStatisticsOptions& options = RegStatisticsOptions{});
+
+    // Counts (the root key is included in the key count)
+    [[nodiscard]] ULONGLONG KeyCount() const noexcept;
+    [[nodiscard]] ULONGLONG ValueCount() const noexcept;
+    [[nodiscard]] ULONGLONG TotalDataBytes() const noexcept;
+    [[nodiscard]] ULONGLONG InaccessibleKeyCount() const noexcept;
+
+    // Number of keys at each depth (the root key is at depth 0)
+    [[nodiscard]] const std::vector<ULONGLONG>& DepthHistogram() const noexcept;
+
+    // Histogram of key and value name lengths, in wchar_ts
+    [[nodiscard]] const std::vector<ULONGLONG>& NameLengthHistogram() const noexcept;
+
+    // Histogram of value data sizes, in bytes
+    [[nodiscard]] const std::vector<ULONGLONG>& DataSizeHistogram() const noexcept;
+
+    // Totals for each registry type found, sorted by type
+    [[nodiscard]] const std::vector<TypeTotal>& TypeTotals() const noexcept;
+
+    // Top-N lists, sorted by decreasing size
+    [[nodiscard]] const std::vector<ValueEntry>& LargestValues() const noexcept;
+    [[nodiscard]] const std::vector<KeyEntry>& LargestKeys() const noexcept;
+    [[nodiscard]] const std::vector<KeyEntry>& WidestKeys() const noexcept;
+
+    // Return the histogram bucket of the given size
+    [[nodiscard]] static size_t HistogramBucket(ULONGLONG size) noexcept;
+
+    // Format the statistics as a JSON object
+    [[nodiscard]] std::wstring ToJson() const;
+
+    // Format the statistics as human-readable text
+    [[nodiscard]] std::wstring ToText() const;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Per-thread accumulation
+    void AddKey(const std::wstring& keyPath, size_t nameLength, size_t depth,
+                ULONGLONG subKeyCount, ULONGLONG valueCount, ULONGLONG dataBytes);
+    void AddValue(const std::wstring& keyPath, std::wstring_view valueName,
+                  DWORD type, ULONGLONG dataSize);
+    void Merge(const RegStatistics& other);
+
+    // Sort the top-N lists and the type totals
+    void Finish();
+
+    // Walk a subtree, recursively
+    void WalkNode(const RegTree::Node& node, std::wstring& keyPath, size_t nameLength, size_t depth);
+    [[nodiscard]] LSTATUS WalkKey(HKEY hKey, std::wstring& keyPath, size_t nameLength, size_t depth,
+                                  const RegOperationLimits& limits, REGSAM registryView);
+    [[nodiscard]] LSTATUS WalkValues(HKEY hKey, const std::wstring& keyPath,
+                                     DWORD valueCount, DWORD maxValueNameLen,
+                                     const RegOperationLimits& limits,
+                                     ULONGLONG& dataBytes, DWORD& valuesFound);
+
+    // Split the top-level subkeys among threads; walkSubKey(index, stats)
+    // returns an LSTATUS
+    template <typename WalkSubKey>
+    [[nodiscard]] static LSTATUS WalkInParallel(size_t subKeyCount,
+                                                const RegStatisticsOptions& options,
+                                                RegStatistics& result,
+                                                WalkSubKey&& walkSubKey);
+
+    size_t                  m_topCount{ 10 };
+    ULONGLONG               m_keyCount{ 0 };
+    ULONGLONG               m_valueCount{ 0 };
+    ULONGLONG               m_totalDataBytes{ 0 };
+    ULONGLONG               m_inaccessibleKeyCount{ 0 };
+    std::vector<ULONGLONG>  m_depthHistogram;
+    std::vector<ULONGLONG>  m_nameLengthHistogram;
+    std::vector<ULONGLONG>  m_dataSizeHistogram;
+    std::vector<TypeTotal>  m_typeTotals;
+
+    // Min-heaps while accumulating; sorted by decreasing size by Finish
+    std::vector<ValueEntry> m_largestValues;
+    std::vector<KeyEntry>   m_largestKeys;
+    std::vector<KeyEntry>   m_widestKeys;
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegStatistics
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Add an item to a bounded min-heap of the largest items, ordered by
+// the given "less" comparator. isLargerThan(smallest) tells if the candidate
+// item is larger than the smallest item in the heap, and makeItem is only
+// invoked when the item enters the heap, to avoid building strings for most
+// candidates.
+//------------------------------------------------------------------------------
+template <typename T, typename Less, typename IsLargerThan, typename MakeItem>
+inline void PushBoundedHeap(
+    std::vector<T>& heap,
+    const size_t capacity,
+    Less less,
+    IsLargerThan&& isLargerThan,
+    MakeItem&& makeItem
+)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+
+    // Invert the comparator to keep the smallest item at the front
+    auto greater = [&less](const T& a, const T& b) { return less(b, a); };
+
+    if (heap.size() < capacity)
+    {
+        heap.push_back(makeItem());
+        std::push_heap(heap.begin(), heap.end(), greater);
+    }
+    else if (isLargerThan(heap.front()))
+    {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        heap.back() = makeItem();
+        std::push_heap(heap.begin(), heap.end(), greater);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Order of the top-N entries: by size, then by path (the smaller path ranks
+// higher), so that ties are broken the same way whatever the walk order is
+//------------------------------------------------------------------------------
+inline bool KeyEntryLess(
+    const ULONGLONG measureA,
+    const std::wstring_view keyPathA,
+    const ULONGLONG measureB,
+    const std::wstring_view keyPathB
+) noexcept
+{
+    if (measureA != measureB)
+    {
+        return measureA < measureB;
+    }
+    return keyPathA > keyPathB;
+}
+
+
+inline bool KeyEntryLess(const RegStatistics::KeyEntry& a, const RegStatistics::KeyEntry& b) noexcept
+{
+    return KeyEntryLess(a.Measure, a.KeyPath, b.Measure, b.KeyPath);
+}
+
+
+inline bool ValueEntryLess(
+    const ULONGLONG dataSizeA,
+    const std::wstring_view keyPathA,
+    const std::wstring_view valueNameA,
+    const ULONGLONG dataSizeB,
+    const std::wstring_view keyPathB,
+    const std::wstring_view valueNameB
+) noexcept
+{
+    if (dataSizeA != dataSizeB)
+    {
+        return dataSizeA < dataSizeB;
+    }
+    if (keyPathA != keyPathB)
+    {
+        return keyPathA > keyPathB;
+    }
+    return valueNameA > valueNameB;
+}
+
+
+inline bool ValueEntryLess(const RegStatistics::ValueEntry& a, const RegStatistics::ValueEntry& b) noexcept
+{
+    return ValueEntryLess(a.DataSize, a.KeyPath, a.ValueName, b.DataSize, b.KeyPath, b.ValueName);
+}
+
+
+//------------------------------------------------------------------------------
+// Append an array of counts as a JSON array, omitting trailing zeros
+//------------------------------------------------------------------------------
+inline void AppendJsonCounts(std::wstring& json, const std::vector<ULONGLONG>& counts)
+{
+    size_t count = counts.size();
+    while ((count > 0) && (counts[count - 1] == 0))
+    {
+        count--;
+    }
+
+    json += L'[';
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i != 0)
+        {
+            json += L", ";
+        }
+        json += std::to_wstring(counts[i]);
+    }
+    json += L']';
+}
+
+
+//------------------------------------------------------------------------------
+// Append a size histogram as text lines, omitting empty buckets
+//------------------------------------------------------------------------------
+inline void AppendTextHistogram(std::wstring& text, const std::vector<ULONGLONG>& counts)
+{
+    for (size_t bucket = 0; bucket < counts.size(); bucket++)
+    {
+        if (counts[bucket] == 0)
+        {
+            continue;
+        }
+
+        if (bucket == 0)
+        {
+            text += L"  0: ";
+        }
+        else
+        {
+            text += L"  [" + std::to_wstring(1ULL << (bucket - 1))
+                  + L", " + std::to_wstring(1ULL << bucket) + L"): ";
+        }
+        text += std::to_wstring(counts[bucket]);
+        text += L'\n';
+    }
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegStatistics Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegStatistics::RegStatistics()
+    : m_nameLengthHistogram(kHistogramBucketCount)
+    , m_dataSizeHistogram(kHistogramBucketCount)
+{}
+
+
+inline ULONGLONG RegStatistics::KeyCount() const noexcept
+{
+    return m_keyCount;
+}
+
+
+inline ULONGLONG RegStatistics::ValueCount() const noexcept
+{
+    return m_valueCount;
+}
+
+
+inline ULONGLONG RegStatistics::TotalDataBytes() const noexcept
+{
+    return m_totalDataBytes;
+}
+
+
+inline ULONGLONG RegStatistics::InaccessibleKeyCount() const noexcept
+{
+    return m_inaccessibleKeyCount;
+}
+
+
+inline const std::vector<ULONGLONG>& RegStatistics::DepthHistogram() const noexcept
+{
+    return m_depthHistogram;
+}
+
+
+inline const std::vector<ULONGLONG>& RegStatistics::NameLengthHistogram() const noexcept
+{
+    return m_nameLengthHistogram;
+}
+
+
+inline const std::vector<ULONGLONG>& RegStatistics::DataSizeHistogram() const noexcept
+{
+    return m_dataSizeHistogram;
+}
+
+
+inline const std::vector<RegStatistics::TypeTotal>& RegStatistics::TypeTotals() const noexcept
+{
+    return m_typeTotals;
+}
+
+
+inline const std::vector<RegStatistics::ValueEntry>& RegStatistics::LargestValues() const noexcept
+{
+    return m_largestValues;
+}
+
+
+inline const std::vector<RegStatistics::KeyEntry>& RegStatistics::LargestKeys() const noexcept
+{
+    return m_largestKeys;
+}
+
+
+inline const std::vector<RegStatistics::KeyEntry>& RegStatistics::WidestKeys() const noexcept
+{
+    return m_widestKeys;
+}
+
+
+inline size_t RegStatistics::HistogramBucket(ULONGLONG size) noexcept
+{
+    size_t bucket = 0;
+    while ((size != 0) && (bucket < kHistogramBucketCount - 1))
+    {
+        size >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+
+inline void RegStatistics::AddKey(
+    const std::wstring& keyPath,
+    const size_t nameLength,
+    const size_t depth,
+    const ULONGLONG subKeyCount,
+    const ULONGLONG valueCount,
+    const ULONGLONG dataBytes
+)
+{
+    m_keyCount++;
+
+    if (m_depthHistogram.size() <= depth)
+    {
+        m_depthHistogram.resize(depth + 1);
+    }
+    m_depthHistogram[depth]++;
+
+    // The root key name is not part of the subtree
+    if (depth != 0)
+    {
+        m_nameLengthHistogram[HistogramBucket(nameLength)]++;
+    }
+
+    auto keyEntryLess = [](const KeyEntry& a, const KeyEntry& b) { return details::KeyEntryLess(a, b); };
+
+    details::PushBoundedHeap(m_largestKeys, m_topCount, keyEntryLess,
+        [&](const KeyEntry& smallest)
+        {
+            return details::KeyEntryLess(smallest.Measure, smallest.KeyPath, dataBytes, keyPath);
+        },
+        [&] { return KeyEntry{ keyPath, dataBytes }; });
+
+    const ULONGLONG width = subKeyCount + valueCount;
+    details::PushBoundedHeap(m_widestKeys, m_topCount, keyEntryLess,
+        [&](const KeyEntry& smallest)
+        {
+            return details::KeyEntryLess(smallest.Measure, smallest.KeyPath, width, keyPath);
+        },
+        [&] { return KeyEntry{ keyPath, width }; });
+}
+
+
+inline void RegStatistics::AddValue(
+    const std::wstring& keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const ULONGLONG dataSize
+)
+{
+    m_valueCount++;
+    m_totalDataBytes += dataSize;
+    m_nameLengthHistogram[HistogramBucket(valueName.length())]++;
+    m_dataSizeHistogram[HistogramBucket(dataSize)]++;
+
+    auto typeTotal = std::find_if(m_typeTotals.begin(), m_typeTotals.end(),
+        [type](const TypeTotal& t) { return t.Type == type; });
+    if (typeTotal == m_typeTotals.end())
+    {
+        m_typeTotals.push_back(TypeTotal{ type, 0, 0 });
+        typeTotal = m_typeTotals.end() - 1;
+    }
+    typeTotal->ValueCount++;
+    typeTotal->DataBytes += dataSize;
+
+    details::PushBoundedHeap(m_largestValues, m_topCount,
+        [](const ValueEntry& a, const ValueEntry& b) { return details::ValueEntryLess(a, b); },
+        [&](const ValueEntry& smallest)
+        {
+            return details::ValueEntryLess(smallest.DataSize, smallest.KeyPath, smallest.ValueName,
+                                           dataSize, keyPath, valueName);
+        },
+        [&] { return ValueEntry{ keyPath, std::wstring{ valueName }, type, dataSize }; });
+}
+
+
+inline void RegStatistics::Merge(const RegStatistics& other)
+{
+    m_keyCount += other.m_keyCount;
+    m_valueCount += other.m_valueCount;
+    m_totalDataBytes += other.m_totalDataBytes;
+    m_inaccessibleKeyCount += other.m_inaccessibleKeyCount;
+
+    if (m_depthHistogram.size() < other.m_depthHistogram.size())
+    {
+        m_depthHistogram.resize(other.m_depthHistogram.size());
+    }
+    for (size_t i = 0; i < other.m_depthHistogram.size(); i++)
+    {
+        m_depthHistogram[i] += other.m_depthHistogram[i];
+    }
+
+    for (size_t i = 0; i < kHistogramBucketCount; i++)
+    {
+        m_nameLengthHistogram[i] += other.m_nameLengthHistogram[i];
+        m_dataSizeHistogram[i] += other.m_dataSizeHistogram[i];
+    }
+
+    for (const auto& otherTotal : other.m_typeTotals)
+    {
+        auto typeTotal = std::find_if(m_typeTotals.begin(), m_typeTotals.end(),
+            [&otherTotal](const TypeTotal& t) { return t.Type == otherTotal.Type; });
+        if (typeTotal == m_typeTotals.end())
+        {
+            m_typeTotals.push_back(otherTotal);
+        }
+        else
+        {
+            typeTotal->ValueCount += otherTotal.ValueCount;
+            typeTotal->DataBytes += otherTotal.DataBytes;
+        }
+    }
+
+    auto valueEntryLess = [](const ValueEntry& a, const ValueEntry& b) { return details::ValueEntryLess(a, b); };
+    auto keyEntryLess = [](const KeyEntry& a, const KeyEntry& b) { return details::KeyEntryLess(a, b); };
+
+    for (const auto& entry : other.m_largestValues)
+    {
+        details::PushBoundedHeap(m_largestValues, m_topCount, valueEntryLess,
+            [&entry](const ValueEntry& smallest) { return details::ValueEntryLess(smallest, entry); },
+            [&entry] { return entry; });
+    }
+    for (const auto& entry : other.m_largestKeys)
+    {
+        details::PushBoundedHeap(m_largestKeys, m_topCount, keyEntryLess,
+            [&entry](const KeyEntry& smallest) { return details::KeyEntryLess(smallest, entry); },
+            [&entry] { return entry; });
+    }
+    for (const auto& entry : other.m_widestKeys)
+    {
+        details::PushBoundedHeap(m_widestKeys, m_topCount, keyEntryLess,
+            [&entry](const KeyEntry& smallest) { return details::KeyEntryLess(smallest, entry); },
+            [&entry] { return entry; });
+    }
+}
+
+
+inline void RegStatistics::Finish()
+{
+    auto byDecreasingKey = [](const KeyEntry& a, const KeyEntry& b)
+    {
+        return details::KeyEntryLess(b, a);
+    };
+    std::sort(m_largestKeys.begin(), m_largestKeys.end(), byDecreasingKey);
+    std::sort(m_widestKeys.begin(), m_widestKeys.end(), byDecreasingKey);
+    std::sort(m_largestValues.begin(), m_largestValues.end(),
+        [](const ValueEntry& a, const ValueEntry& b)
+        {
+            return details::ValueEntryLess(b, a);
+        });
+    std::sort(m_typeTotals.begin(), m_typeTotals.end(),
+        [](const TypeTotal& a, const TypeTotal& b)
+        {
+            return a.Type < b.Type;
+        });
+}
+
+
+inline void RegStatistics::WalkNode(
+    const RegTree::Node& node,
+    std::wstring& keyPath,
+    const size_t nameLength,
+    const size_t depth
+)
+{
+    ULONGLONG dataBytes = 0;
+    for (const auto& value : node.Values)
+    {
+        AddValue(keyPath, value->Name, value->Type, value->DataSize);
+        dataBytes += value->DataSize;
+    }
+
+    AddKey(keyPath, nameLength, depth, node.SubKeys.size(), node.Values.size(), dataBytes);
+
+    for (const auto& subKey : node.SubKeys)
+    {
+        const size_t parentPathLength = keyPath.length();
+        if (!keyPath.empty())
+        {
+            keyPath += L'\\';
+        }
+        keyPath += subKey.Name.View();
+
+        WalkNode(*subKey.Key, keyPath, subKey.Name.Length(), depth + 1);
+
+        keyPath.resize(parentPathLength);
+    }
+}
+
+
+inline LSTATUS RegStatistics::WalkValues(
+    const HKEY hKey,
+    const std::wstring& keyPath,
+    const DWORD valueCount,
+    const DWORD maxValueNameLen,
+    const RegOperationLimits& limits,
+    ULONGLONG& dataBytes,
+    DWORD& valuesFound
+)
+{
+    // Query value names, types and sizes, without reading the data
+    std::vector<wchar_t> nameBuffer(static_cast<size_t>(maxValueNameLen) + 1);
+    dataBytes = 0;
+    valuesFound = 0;
+    for (DWORD index = 0; index < valueCount; )
+    {
+        LSTATUS retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        DWORD valueNameLen = static_cast<DWORD>(nameBuffer.size());
+        DWORD valueType = REG_NONE;
+        DWORD dataSize = 0;
+        retCode = details::TracedRegEnumValueW(
+            __func__,
+            hKey,
+            index,
+            nameBuffer.data(),
+            &valueNameLen,
+            nullptr,    // reserved
+            &valueType,
+            nullptr,    // no data
+            &dataSize
+        );
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // A longer value name was added since RegQueryInfoKey
+            nameBuffer.resize(nameBuffer.size() * 2);
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Values were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        AddValue(keyPath, std::wstring_view{ nameBuffer.data(), valueNameLen }, valueType, dataSize);
+        dataBytes += dataSize;
+        valuesFound++;
+        index++;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+inline LSTATUS RegStatistics::WalkKey(
+    const HKEY hKey,
+    std::wstring& keyPath,
+    const size_t nameLength,
+    const size_t depth,
+    const RegOperationLimits& limits,
+    const REGSAM registryView
+)
+{
+    LSTATUS retCode = details::CheckOperationLimits(limits);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    DWORD subKeyCount = 0;
+    DWORD maxSubKeyNameLen = 0;
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        &subKeyCount,
+        &maxSubKeyNameLen,
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        nullptr,    // no max value data length
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    ULONGLONG dataBytes = 0;
+    DWORD valuesFound = 0;
+    retCode = WalkValues(hKey, keyPath, valueCount, maxValueNameLen, limits, dataBytes, valuesFound);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    AddKey(keyPath, nameLength, depth, subKeyCount, valuesFound, dataBytes);
+
+    // Walk the subkeys, recursively
+    std::vector<wchar_t> nameBuffer(static_cast<size_t>(maxSubKeyNameLen) + 1);
+    for (DWORD index = 0; index < subKeyCount; )
+    {
+        retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        DWORD subKeyNameLen = static_cast<DWORD>(nameBuffer.size());
+        retCode = details::TracedRegEnumKeyExW(
+            __func__,
+            hKey,
+            index,
+            nameBuffer.data(),
+            &subKeyNameLen,
+            nullptr, // reserved
+            nullptr, // no class
+            nullptr, // no class
+            nullptr  // no last write time
+        );
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // A subkey with a longer name was added (or renamed) since RegQueryInfoKey
+            nameBuffer.resize(nameBuffer.size() * 2);
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Subkeys were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        const std::wstring subKeyName{ nameBuffer.data(), subKeyNameLen };
+
+        const size_t parentPathLength = keyPath.length();
+        if (!keyPath.empty())
+        {
+            keyPath += L'\\';
+        }
+        keyPath += subKeyName;
+
+        RegKey subKey;
+        RegResult openResult = subKey.TryOpen(hKey, subKeyName, KEY_READ | registryView);
+        if (openResult.Code() == ERROR_ACCESS_DENIED)
+        {
+            m_inaccessibleKeyCount++;
+        }
+        else if (openResult.Failed())
+        {
+            return openResult.Code();
+        }
+        else
+        {
+            retCode = WalkKey(subKey.Get(), keyPath, subKeyNameLen, depth + 1, limits, registryView);
+            if (retCode != ERROR_SUCCESS)
+            {
+                return retCode;
+            }
+        }
+
+        keyPath.resize(parentPathLength);
+        index++;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+template <typename WalkSubKey>
+inline LSTATUS RegStatistics::WalkInParallel(
+    const size_t subKeyCount,
+    const RegStatisticsOptions& options,
+    RegStatistics& result,
+    WalkSubKey&& walkSubKey
+)
+{
+    size_t threadCount = options.ThreadCount;
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount > subKeyCount)
+    {
+        threadCount = subKeyCount;
+    }
+
+    if (threadCount <= 1)
+    {
+        for (size_t index = 0; index < subKeyCount; index++)
+        {
+            const LSTATUS retCode = walkSubKey(index, result);
+            if (retCode != ERROR_SUCCESS)
+            {
+                return retCode;
+            }
+        }
+        return ERROR_SUCCESS;
+    }
+
+    // Each worker picks the next top-level subkey, and accumulates
+    // into its own statistics; they are merged at the end
+    std::atomic<size_t> nextIndex{ 0 };
+    std::atomic<bool> failed{ false };
+    std::vector<RegStatistics> partials(threadCount);
+    std::vector<LSTATUS> retCodes(threadCount, ERROR_SUCCESS);
+    std::vector<std::exception_ptr> exceptions(threadCount);
+
+    auto worker = [&](const size_t threadIndex)
+    {
+        try
+        {
+            RegStatistics& partial = partials[threadIndex];
+            partial.m_topCount = result.m_topCount;
+
+            for (size_t index = nextIndex++; (index < subKeyCount) && !failed; index = nextIndex++)
+            {
+                const LSTATUS retCode = walkSubKey(index, partial);
+                if (retCode != ERROR_SUCCESS)
+                {
+                    retCodes[threadIndex] = retCode;
+                    failed = true;
+                }
+            }
+        }
+        catch (...)
+        {
+            exceptions[threadIndex] = std::current_exception();
+            failed = true;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    try
+    {
+        for (size_t threadIndex = 1; threadIndex < threadCount; threadIndex++)
+        {
+            threads.emplace_back(worker, threadIndex);
+        }
+    }
+    catch (...)
+    {
+        // Couldn't start all the threads: the running ones will do the work
+    }
+
+    // The calling thread works too
+    worker(0);
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t threadIndex = 0; threadIndex < threadCount; threadIndex++)
+    {
+        if (exceptions[threadIndex])
+        {
+            std::rethrow_exception(exceptions[threadIndex]);
+        }
+        if (retCodes[threadIndex] != ERROR_SUCCESS)
+        {
+            return retCodes[threadIndex];
+        }
+    }
+
+    for (const auto& partial : partials)
+    {
+        result.Merge(partial);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+inline RegStatistics RegStatistics::Analyze(const RegKey& key, const RegStatisticsOptions& options)
+{
+    RegExpected<RegStatistics> statistics = TryAnalyze(key, options);
+    if (!statistics.IsValid())
+    {
+        throw RegException{ statistics.GetError().Code(), "Cannot analyze the registry subtree." };
+    }
+    return std::move(statistics).GetValue();
+}
+
+
+inline RegExpected<RegStatistics> RegStatistics::TryAnalyze(const RegKey& key,
+                                                            const RegStatisticsOptions& options)
+{
+    _ASSERTE(key.IsValid());
+
+    using ReturnType = RegExpected<RegStatistics>;
+
+    RegStatistics result;
+    result.m_topCount = options.TopCount;
+
+    LSTATUS retCode = details::CheckOperationLimits(options.Limits);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return ReturnType{ RegResult{ retCode } };
+    }
+
+    // Walk the root key values; its subkeys are walked in parallel below
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        key.Get(),
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        nullptr,    // no subkey count
+        nullptr,    // no subkey max length
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        nullptr,    // no max value data length
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return ReturnType{ RegResult{ retCode } };
+    }
+
+    const std::wstring rootPath;
+    ULONGLONG rootDataBytes = 0;
+    DWORD rootValueCount = 0;
+    retCode = result.WalkValues(key.Get(), rootPath, valueCount, maxValueNameLen,
+                                options.Limits, rootDataBytes, rootValueCount);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return ReturnType{ RegResult{ retCode } };
+    }
+
+    auto subKeyNames = key.TryEnumSubKeys(options.Limits);
+    if (!subKeyNames.IsValid())
+    {
+        return ReturnType{ subKeyNames.GetError() };
+    }
+    const std::vector<std::wstring>& names = subKeyNames.GetValue();
+    result.AddKey(rootPath, 0, 0, names.size(), rootValueCount, rootDataBytes);
+
+    retCode = WalkInParallel(names.size(), options, result,
+        [&](const size_t index, RegStatistics& statistics) -> LSTATUS
+        {
+            RegKey subKey;
+            RegResult openResult = subKey.TryOpen(key.Get(), names[index],
+                                                  KEY_READ | options.RegistryView);
+            if (openResult.Code() == ERROR_ACCESS_DENIED)
+            {
+                statistics.m_inaccessibleKeyCount++;
+                return ERROR_SUCCESS;
+            }
+            if (openResult.Failed())
+            {
+                return openResult.Code();
+            }
+
+            std::wstring keyPath = names[index];
+            return statistics.WalkKey(subKey.Get(), keyPath, keyPath.length(), 1,
+                                      options.Limits, options.RegistryView);
+        }
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return ReturnType{ RegResult{ retCode } };
+    }
+
+    result.Finish();
+    return ReturnType{ std::move(result) };
+}
+
+
+inline RegStatistics RegStatistics::Analyze(const RegTree& tree, const RegStatisticsOptions& options)
+{
+    RegStatistics result;
+    result.m_topCount = options.TopCount;
+
+    const RegTree::Node& root = *tree.Root();
+
+    std::wstring rootPath;
+    ULONGLONG rootDataBytes = 0;
+    for (const auto& value : root.Values)
+    {
+        result.AddValue(rootPath, value->Name, value->Type, value->DataSize);
+        rootDataBytes += value->DataSize;
+    }
+    result.AddKey(rootPath, 0, 0, root.SubKeys.size(), root.Values.size(), rootDataBytes);
+
+    // Walking a snapshot can't fail
+    const LSTATUS retCode = WalkInParallel(root.SubKeys.size(), options, result,
+        [&root](const size_t index, RegStatistics& statistics) -> LSTATUS
+        {
+            const RegTree::SubKeyEntry& subKey = root.SubKeys[index];
+            std::wstring keyPath{ subKey.Name.View() };
+            statistics.WalkNode(*subKey.Key, keyPath, keyPath.length(), 1);
+            return ERROR_SUCCESS;
+        }
+    );
+    _ASSERTE(retCode == ERROR_SUCCESS);
+    static_cast<void>(retCode);
+
+    result.Finish();
+    return result;
+}
+
+
+inline std::wstring RegStatistics::ToJson() const
+{
+    std::wstring json = L"{\n";
+
+    json += L"  \"keyCount\": " + std::to_wstring(m_keyCount) + L",\n";
+    json += L"  \"valueCount\": " + std::to_wstring(m_valueCount) + L",\n";
+    json += L"  \"totalDataBytes\": " + std::to_wstring(m_totalDataBytes) + L",\n";
+    json += L"  \"inaccessibleKeyCount\": " + std::to_wstring(m_inaccessibleKeyCount) + L",\n";
+
+    json += L"  \"depthHistogram\": ";
+    details::AppendJsonCounts(json, m_depthHistogram);
+    json += L",\n  \"nameLengthHistogram\": ";
+    details::AppendJsonCounts(json, m_nameLengthHistogram);
+    json += L",\n  \"dataSizeHistogram\": ";
+    details::AppendJsonCounts(json, m_dataSizeHistogram);
+
+    json += L",\n  \"types\": [";
+    for (size_t i = 0; i < m_typeTotals.size(); i++)
+    {
+        json += (i == 0) ? L"\n    " : L",\n    ";
+        json += L"{ \"type\": ";
+        details::AppendJsonString(json, RegKey::RegTypeToString(m_typeTotals[i].Type));
+        json += L", \"valueCount\": " + std::to_wstring(m_typeTotals[i].ValueCount);
+        json += L", \"dataBytes\": " + std::to_wstring(m_typeTotals[i].DataBytes) + L" }";
+    }
+    json += L"\n  ],\n  \"largestValues\": [";
+    for (size_t i = 0; i < m_largestValues.size(); i++)
+    {
+        json += (i == 0) ? L"\n    " : L",\n    ";
+        json += L"{ \"key\": ";
+        details::AppendJsonString(json, m_largestValues[i].KeyPath);
+        json += L", \"name\": ";
+        details::AppendJsonString(json, m_largestValues[i].ValueName);
+        json += L", \"type\": ";
+        details::AppendJsonString(json, RegKey::RegTypeToString(m_largestValues[i].Type));
+        json += L", \"dataSize\": " + std::to_wstring(m_largestValues[i].DataSize) + L" }";
+    }
+
+    auto appendKeys = [&json](const wchar_t* name, const wchar_t* measure,
+                              const std::vector<KeyEntry>& entries)
+    {
+        json += L"\n  ],\n  \"";
+        json += name;
+        json += L"\": [";
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            json += (i == 0) ? L"\n    " : L",\n    ";
+            json += L"{ \"key\": ";
+            details::AppendJsonString(json, entries[i].KeyPath);
+            json += L", \"";
+            json += measure;
+            json += L"\": " + std::to_wstring(entries[i].Measure) + L" }";
+        }
+    };
+    appendKeys(L"largestKeys", L"dataBytes", m_largestKeys);
+    appendKeys(L"widestKeys", L"entryCount", m_widestKeys);
+
+    json += L"\n  ]\n}\n";
+    return json;
+}
+
+
+inline std::wstring RegStatistics::ToText() const
+{
+    std::wstring text;
+
+    text += L"Keys: " + std::to_wstring(m_keyCount) + L'\n';
+    text += L"Values: " + std::to_wstring(m_valueCount) + L'\n';
+    text += L"Total data bytes: " + std::to_wstring(m_totalDataBytes) + L'\n';
+    text += L"Inaccessible keys: " + std::to_wstring(m_inaccessibleKeyCount) + L'\n';
+
+    text += L"\nKeys by depth:\n";
+    for (size_t depth = 0; depth < m_depthHistogram.size(); depth++)
+    {
+        text += L"  " + std::to_wstring(depth) + L": " + std::to_wstring(m_depthHistogram[depth]) + L'\n';
+    }
+
+    text += L"\nName lengths:\n";
+    details::AppendTextHistogram(text, m_nameLengthHistogram);
+
+    text += L"\nData sizes:\n";
+    details::AppendTextHistogram(text, m_dataSizeHistogram);
+
+    text += L"\nTypes:\n";
+    for (const auto& typeTotal : m_typeTotals)
+    {
+        text += L"  " + RegKey::RegTypeToString(typeTotal.Type)
+              + L": " + std::to_wstring(typeTotal.ValueCount) + L" values, "
+              + std::to_wstring(typeTotal.DataBytes) + L" bytes\n";
+    }
+
+    text += L"\nLargest values:\n";
+    for (const auto& entry : m_largestValues)
+    {
+        text += L"  " + std::to_wstring(entry.DataSize) + L" bytes  ["
+              + entry.KeyPath + L"] " + entry.ValueName + L'\n';
+    }
+
+    text += L"\nLargest keys:\n";
+    for (const auto& entry : m_largestKeys)
+    {
+        text += L"  " + std::to_wstring(entry.Measure) + L" bytes  [" + entry.KeyPath + L"]\n";
+    }
+
+    text += L"\nWidest keys:\n";
+    for (const auto& entry : m_widestKeys)
+    {
+        text += L"  " + std::to_wstring(entry.Measure) + L" entries  [" + entry.KeyPath + L"]\n";
+    }
+
+    return text;
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGSTATISTICS_HPP_INCLUDED
@@ -0,0 +1,1467 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGTREE_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGTREE_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegTree: an in-memory, persistent (immutable and structurally shared) tree of
+// registry keys and values, that can be captured from a live key and diffed.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "WinReg.hpp"       // RegKey
+
+#include <algorithm>        // std::lower_bound, std::sort, std::copy, std::equal
+#include <atomic>           // std::atomic
+#include <cstdint>          // std::uint32_t
+#include <cstring>          // std::memcpy
+#include <iterator>         // std::begin, std::end
+#include <limits>           // std::numeric_limits
+#include <memory>           // std::shared_ptr, std::unique_ptr
+#include <new>              // std::bad_alloc
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <type_traits>      // std::is_trivially_destructible_v
+#include <utility>          // std::move, std::pair
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// An in-memory, persistent (immutable and structurally shared) tree of
+// registry keys and values.
+//
+// Nodes are never modified once built: they are shared via
+// std::shared_ptr<const Node>. So:
+//
+// - Copying a RegTree is an O(1) snapshot (just the root pointer is copied).
+//
+// - Updates copy only the nodes on the path from the root to the modified key
+//   (each copy duplicates the arrays of subkey entries and value pointers,
+//   not the subtrees); other snapshots sharing the old nodes are not affected.
+//
+// - Diff skips the subtrees that two snapshots still share,
+//   just comparing the node pointers.
+//
+// The layout keeps lookups cache-friendly:
+//
+// - The subkeys of a key are a contiguous array of entries, sorted by
+//   case-folded name, and each entry stores the subkey name (inline, for
+//   names up to InlineName::kInlineLength characters): so finding a subkey
+//   is a binary search in one array, and each path component touches just
+//   that array and the child node found.
+//
+// - Values, with their names and data, are bump-allocated in chunks
+//   (see ValueArena): values read or written together are contiguous in
+//   memory, and a Value is a single allocation-free record.
+//
+// Key and value names are compared case-insensitively, like the registry does;
+// subkeys and values are kept sorted by case-folded name.
+// Key paths are relative to the root of the tree, with components separated
+// by backslashes (the empty path is the root itself).
+//
+// Distinct RegTree objects can be used from different threads concurrently,
+// even when they share nodes; a single RegTree object must not be modified
+// while other threads access it.
+//------------------------------------------------------------------------------
+class RegTree
+{
+public:
+
+    // A registry value, with its raw data as stored in the registry.
+    // The name and the data are stored in the same arena chunk as the Value
+    // itself (see ValueArena), so they are valid as long as the Value is;
+    // the data is aligned for DWORD and QWORD reads.
+    struct Value
+    {
+        std::wstring_view Name;
+        DWORD             Type{ REG_NONE };
+        const BYTE*       Data{ nullptr };
+        DWORD             DataSize{ 0 };    // in bytes
+    };
+
+    // Keeps the arena chunk of the value alive
+    using ValuePtr = std::shared_ptr<const Value>;
+
+    //--------------------------------------------------------------------------
+    // Bump allocator for values: each value is stored, with its name and data,
+    // at the end of the current chunk; a new chunk (twice as large as the
+    // previous one, up to a maximum size) is started when it is full.
+    // A chunk is freed when the last ValuePtr to a value stored in it is
+    // released.
+    //
+    // Only the owner of an arena appends to its current chunk: so copying an
+    // arena starts a new one, and the ValuePtrs already handed out can be
+    // read from other threads.
+    //--------------------------------------------------------------------------
+    class ValueArena
+    {
+    public:
+
+        ValueArena() noexcept = default;
+
+        // Copies don't share the current chunk
+        ValueArena(const ValueArena&) noexcept;
+        ValueArena& operator=(const ValueArena&) noexcept;
+
+        ValueArena(ValueArena&&) noexcept = default;
+        ValueArena& operator=(ValueArena&&) noexcept = default;
+
+        // Store a copy of the value in the arena
+        [[nodiscard]] ValuePtr Store(std::wstring_view name,
+                                     DWORD type,
+                                     const BYTE* data,
+                                     size_t dataSize);
+
+        // Store a copy of the value in a chunk of its own, of the exact size
+        // (e.g. for a value kept outside of any tree)
+        [[nodiscard]] static ValuePtr StoreSingle(std::wstring_view name,
+                                                  DWORD type,
+                                                  const BYTE* data,
+                                                  size_t dataSize);
+
+    private:
+
+        // Size of the chunks, in bytes; values larger than a quarter of the
+        // maximum size get a chunk of their own
+        static constexpr size_t kMinChunkSize = 1024;
+        static constexpr size_t kMaxChunkSize = 64 * 1024;
+
+        struct Chunk
+        {
+            std::unique_ptr<BYTE[]> Bytes;
+            size_t                  Size{ 0 };
+            size_t                  Used{ 0 };
+        };
+
+        // Alignment of the Values, and of their data, in the chunks
+        static constexpr size_t kRecordAlignment = (std::max)(alignof(Value), sizeof(ULONGLONG));
+        static constexpr size_t kDataAlignment = sizeof(ULONGLONG);
+
+        [[nodiscard]] static std::shared_ptr<Chunk> NewChunk(size_t size);
+
+        // Offset of the data from the start of a value, and bytes taken
+        // by the value in a chunk
+        [[nodiscard]] static size_t DataOffset(std::wstring_view name);
+        [[nodiscard]] static size_t RecordSize(std::wstring_view name, size_t dataSize);
+
+        // Copy the value at the given offset of the chunk
+        [[nodiscard]] static ValuePtr Construct(std::shared_ptr<Chunk> chunk,
+                                                size_t offset,
+                                                std::wstring_view name,
+                                                DWORD type,
+                                                const BYTE* data,
+                                                size_t dataSize);
+
+        std::shared_ptr<Chunk> m_chunk;
+        size_t                 m_nextChunkSize{ kMinChunkSize };
+    };
+
+    //--------------------------------------------------------------------------
+    // An immutable key or value name. Names up to kInlineLength characters
+    // are stored in the object itself; longer ones in a heap buffer shared
+    // (with a reference count) by the copies.
+    //--------------------------------------------------------------------------
+    class InlineName
+    {
+    public:
+
+        // Maximum length of the names stored inline, in wchar_ts
+        // (the object is 32 bytes long)
+        static constexpr size_t kInlineLength = (32 - sizeof(std::uint32_t)) / sizeof(wchar_t);
+
+        InlineName() noexcept = default;
+        explicit InlineName(std::wstring_view name);
+
+        InlineName(const InlineName& other) noexcept;
+        InlineName(InlineName&& other) noexcept;
+        InlineName& operator=(const InlineName& other) noexcept;
+        InlineName& operator=(InlineName&& other) noexcept;
+        ~InlineName();
+
+        [[nodiscard]] std::wstring_view View() const noexcept;
+        operator std::wstring_view() const noexcept;
+
+        [[nodiscard]] size_t Length() const noexcept;
+
+    private:
+
+        // Heap buffer of a long name: the reference count, then the characters
+        struct LongName
+        {
+            std::atomic<std::uint32_t> RefCount;
+        };
+
+        [[nodiscard]] LongName* GetLongName() const noexcept;
+        void Release() noexcept;
+
+        std::uint32_t m_length{ 0 };
+
+        // The name characters, or (for long names) the LongName pointer
+        wchar_t m_chars[kInlineLength]{};
+    };
+
+    struct Node;
+
+    using NodePtr = std::shared_ptr<const Node>;
+
+    // A subkey of a key, with its name: the subkeys of a key are searched
+    // without touching the child nodes
+    struct SubKeyEntry
+    {
+        InlineName Name;
+        NodePtr    Key;
+    };
+
+    // A registry key; immutable once shared in a tree.
+    // The name of a key is stored in the entry of its parent, so renaming
+    // or moving a key doesn't copy its node.
+    struct Node
+    {
+        std::vector<SubKeyEntry> SubKeys;   // sorted by case-folded name
+        std::vector<ValuePtr>    Values;    // sorted by case-folded name
+
+        // Return the direct subkey with the given name, or nullptr if not found
+        [[nodiscard]] const Node* FindSubKey(std::wstring_view name) const noexcept;
+
+        // Return the value with the given name, or nullptr if not found
+        [[nodiscard]] const Value* FindValue(std::wstring_view name) const noexcept;
+    };
+
+    // A difference between two trees, as reported by Diff
+    struct Difference
+    {
+        enum class Kind
+        {
+            KeyAdded,       // the whole subtree rooted at KeyPath was added
+            KeyDeleted,     // the whole subtree rooted at KeyPath was deleted
+            ValueAdded,
+            ValueDeleted,
+            ValueChanged    // type and/or data changed
+        };
+
+        Kind         DifferenceKind;
+        std::wstring KeyPath;
+        std::wstring ValueName;     // empty for key differences
+    };
+
+
+    // Initialize as a tree with just an empty root key
+    RegTree();
+
+    // Build a tree from a live registry key, recursively reading
+    // all its subkeys and values; the subkeys are opened in the given
+    // registry view.
+    // Throw RegException on failure.
+    [[nodiscard]] static RegTree FromKey(const RegKey& key,
+                                         const RegOperationLimits& limits = RegOperationLimits{},
+                                         REGSAM registryView = KEY_WOW64_64KEY);
+
+    // Build a tree from a live registry key, recursively reading
+    // all its subkeys and values
+    [[nodiscard]] static RegExpected<RegTree> TryFromKey(const RegKey& key,
+                                                         const RegOperationLimits& limits = RegOperationLimits{},
+                                                         REGSAM registryView = KEY_WOW64_64KEY);
+
+    // Access the (immutable) root node
+    [[nodiscard]] const NodePtr& Root() const noexcept;
+
+    // Do the two trees share the same root (i.e. is one an unmodified snapshot of the other)?
+    [[nodiscard]] bool SharesRootWith(const RegTree& other) const noexcept;
+
+
+    //
+    // Queries
+    //
+
+    // Return the key at the given path, or nullptr if not found
+    [[nodiscard]] const Node* FindKey(std::wstring_view keyPath) const noexcept;
+
+    // Does the tree contain the key at the given path?
+    [[nodiscard]] bool ContainsKey(std::wstring_view keyPath) const noexcept;
+
+    // Return the value under the given key, or nullptr if not found
+    [[nodiscard]] const Value* FindValue(std::wstring_view keyPath,
+                                         std::wstring_view valueName) const noexcept;
+
+
+    //
+    // Updates (path copying)
+    //
+
+    // Create the key at the given path, with any missing parent key.
+    // Do nothing if the key already exists.
+    void CreateKey(std::wstring_view keyPath);
+
+    // Set a value under the given key, creating any missing key.
+    // The name and the data are copied into the value arena of this tree.
+    void SetValue(std::wstring_view keyPath,
+                  std::wstring_view valueName,
+                  DWORD type,
+                  const std::vector<BYTE>& data);
+
+    void SetValue(std::wstring_view keyPath,
+                  std::wstring_view valueName,
+                  DWORD type,
+                  const BYTE* data,
+                  size_t dataSize);
+
+    // Delete a value; return false if it doesn't exist
+    bool DeleteValue(std::wstring_view keyPath, std::wstring_view valueName);
+
+    // Delete a key and all its subtree; return false if it doesn't exist.
+    // The root key cannot be deleted.
+    bool DeleteTree(std::wstring_view keyPath);
+
+    // Move a key and all its subtree to destKeyPath, creating any missing
+    // parent key. The subtree is relinked, not copied: only the nodes on the
+    // two paths are copied.
+    // Return false if the source doesn't exist or is the root, if the
+    // destination already exists (except for a change in the case of the
+    // key name), or if it is inside the source subtree.
+    bool MoveKey(std::wstring_view sourceKeyPath, std::wstring_view destKeyPath);
+
+    // Rename a key, keeping it under the same parent (see MoveKey)
+    bool RenameKey(std::wstring_view keyPath, std::wstring_view newKeyName);
+
+
+    //
+    // Structural diff
+    //
+
+    // Return the differences to apply to oldTree to get newTree.
+    // Subtrees shared by the two trees are skipped without being visited.
+    [[nodiscard]] static std::vector<Difference> Diff(const RegTree& oldTree,
+                                                      const RegTree& newTree);
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // Build a tree with the given root, and the arena of its values
+    RegTree(NodePtr root, ValueArena valueArena) noexcept;
+
+    // Copy the nodes on the path to the given key, and apply the edit
+    // to a copy of that key. If the edit changes nothing, the original
+    // nodes are kept (and shared).
+    template <typename EditFunction>
+    [[nodiscard]] static NodePtr UpdateAtPath(
+        const NodePtr& node,
+        const std::vector<std::wstring_view>& pathComponents,
+        size_t depth,
+        bool createMissingKeys,
+        EditFunction& edit
+    );
+
+    // Recursively read a live registry key into a new node,
+    // storing the values in the given arena
+    [[nodiscard]] static LSTATUS CaptureKey(HKEY hKey,
+                                            const RegOperationLimits& limits,
+                                            REGSAM registryView,
+                                            ValueArena& valueArena,
+                                            NodePtr& result);
+
+    // Recursively compare two nodes
+    static void DiffNodes(const Node& oldNode,
+                          const Node& newNode,
+                          std::wstring& keyPath,
+                          std::vector<Difference>& differences);
+
+    NodePtr    m_root;
+    ValueArena m_valueArena;
+};
+
+
+//------------------------------------------------------------------------------
+//                      Private Helpers for RegTree
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Split a backslash-separated key path into its components
+// (empty components are skipped)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::vector<std::wstring_view> SplitKeyPath(const std::wstring_view keyPath)
+{
+    std::vector<std::wstring_view> components;
+
+    size_t start = 0;
+    while (start <= keyPath.length())
+    {
+        size_t end = keyPath.find(L'\\', start);
+        if (end == std::wstring_view::npos)
+        {
+            end = keyPath.length();
+        }
+
+        if (end > start)
+        {
+            components.push_back(keyPath.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+
+    return components;
+}
+
+
+//------------------------------------------------------------------------------
+// Name of an item of a vector sorted by FindByFoldedName: a shared pointer
+// to an object with a Name member, or a RegTree subkey entry
+//------------------------------------------------------------------------------
+template <typename Ptr>
+[[nodiscard]] inline std::wstring_view SortedItemName(const Ptr& item) noexcept
+{
+    return item->Name;
+}
+
+
+[[nodiscard]] inline std::wstring_view SortedItemName(const RegTree::SubKeyEntry& entry) noexcept
+{
+    return entry.Name.View();
+}
+
+
+//------------------------------------------------------------------------------
+// Binary search a vector of items (see SortedItemName), sorted by
+// case-folded name. Return the position where the name is, or
+// should be inserted, and whether it was found.
+//------------------------------------------------------------------------------
+template <typename Item>
+[[nodiscard]] inline std::pair<size_t, bool> FindByFoldedName(
+    const std::vector<Item>& items,
+    const std::wstring_view name
+) noexcept
+{
+    auto it = std::lower_bound(items.begin(), items.end(), name,
+        [](const Item& item, const std::wstring_view value)
+        {
+            return CompareStrings(SortedItemName(item), value, StringComparison::IgnoreCase) < 0;
+        }
+    );
+
+    const size_t position = static_cast<size_t>(it - items.begin());
+    const bool found = (it != items.end())
+        && EqualStrings(SortedItemName(*it), name, StringComparison::IgnoreCase);
+
+    return { position, found };
+}
+
+
+//------------------------------------------------------------------------------
+// Is the data of the RegTree value equal to the given bytes?
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool EqualValueData(
+    const RegTree::Value& value,
+    const BYTE* const data,
+    const size_t dataSize
+) noexcept
+{
+    return (value.DataSize == dataSize)
+        && ((dataSize == 0) || (std::memcmp(value.Data, data, dataSize) == 0));
+}
+
+
+//------------------------------------------------------------------------------
+// Build the case-folded form of a key path, in a single pass
+// (empty components are skipped, like SplitKeyPath does)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::wstring FoldKeyPath(const std::wstring_view keyPath)
+{
+    std::wstring foldedPath;
+    foldedPath.reserve(keyPath.length());
+
+    bool pendingSeparator = false;
+    for (const wchar_t ch : keyPath)
+    {
+        if (ch == L'\\')
+        {
+            pendingSeparator = !foldedPath.empty();
+            continue;
+        }
+        if (pendingSeparator)
+        {
+            foldedPath.push_back(L'\\');
+            pendingSeparator = false;
+        }
+        foldedPath.push_back(FoldCase(ch));
+    }
+    return foldedPath;
+}
+
+
+//------------------------------------------------------------------------------
+// Is a change to changedPath visible to a watch on watchedPath (both case-folded)?
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool IsWatchedChange(
+    const std::wstring_view changedPath,
+    const std::wstring_view watchedPath,
+    const bool watchSubtree
+) noexcept
+{
+    if (changedPath == watchedPath)
+    {
+        return true;
+    }
+    if (!watchSubtree)
+    {
+        return false;
+    }
+    return watchedPath.empty()
+        || ((changedPath.length() > watchedPath.length())
+            && (changedPath.compare(0, watchedPath.length(), watchedPath) == 0)
+            && (changedPath[watchedPath.length()] == L'\\'));
+}
+
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                          RegTree Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegTree::ValueArena::ValueArena(const ValueArena&) noexcept
+{}
+
+
+inline RegTree::ValueArena& RegTree::ValueArena::operator=(const ValueArena&) noexcept
+{
+    // Keep appending to the current chunk, that is not shared
+    return *this;
+}
+
+
+inline std::shared_ptr<RegTree::ValueArena::Chunk> RegTree::ValueArena::NewChunk(const size_t size)
+{
+    auto chunk = std::make_shared<Chunk>();
+    chunk->Bytes.reset(new BYTE[size]);
+    chunk->Size = size;
+    return chunk;
+}
+
+
+inline RegTree::ValuePtr RegTree::ValueArena::Store(
+    const std::wstring_view name,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize
+)
+{
+    const size_t recordSize = RecordSize(name, dataSize);
+    if (recordSize > kMaxChunkSize / 4)
+    {
+        // A large value gets a chunk of its own
+        return StoreSingle(name, type, data, dataSize);
+    }
+
+    size_t offset = 0;
+    if (m_chunk)
+    {
+        // Keep the Values aligned
+        offset = (m_chunk->Used + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+    }
+    if (!m_chunk || (offset > m_chunk->Size) || (recordSize > m_chunk->Size - offset))
+    {
+        m_chunk = NewChunk((std::max)(m_nextChunkSize, recordSize));
+        m_nextChunkSize = (std::min)(m_nextChunkSize * 2, kMaxChunkSize);
+        offset = 0;
+    }
+
+    ValuePtr value = Construct(m_chunk, offset, name, type, data, dataSize);
+    m_chunk->Used = offset + recordSize;
+    return value;
+}
+
+
+inline RegTree::ValuePtr RegTree::ValueArena::StoreSingle(
+    const std::wstring_view name,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize
+)
+{
+    return Construct(NewChunk(RecordSize(name, dataSize)), 0, name, type, data, dataSize);
+}
+
+
+inline size_t RegTree::ValueArena::DataOffset(const std::wstring_view name)
+{
+    // The Value is followed by the name characters, then by the data
+    // (aligned, so that DWORD and QWORD data can be read in place)
+    if (name.length() > ((std::numeric_limits<size_t>::max)() - sizeof(Value)) / sizeof(wchar_t) - 1)
+    {
+        throw std::bad_alloc{};
+    }
+    const size_t nameEnd = sizeof(Value) + name.length() * sizeof(wchar_t);
+    return (nameEnd + kDataAlignment - 1) & ~(kDataAlignment - 1);
+}
+
+
+inline size_t RegTree::ValueArena::RecordSize(const std::wstring_view name, const size_t dataSize)
+{
+    const size_t dataOffset = DataOffset(name);
+    if (dataSize > (std::numeric_limits<size_t>::max)() - dataOffset)
+    {
+        throw std::bad_alloc{};
+    }
+    return dataOffset + dataSize;
+}
+
+
+inline RegTree::ValuePtr RegTree::ValueArena::Construct(
+    std::shared_ptr<Chunk> chunk,
+    const size_t offset,
+    const std::wstring_view name,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize
+)
+{
+    static_assert(std::is_trivially_destructible_v<Value>,
+        "Values are never destroyed: their chunk is just freed.");
+
+    const DWORD valueDataSize = details::SafeCastSizeToDword(dataSize);
+    const size_t nameSize = name.length() * sizeof(wchar_t);
+
+    BYTE* const record = chunk->Bytes.get() + offset;
+    wchar_t* const nameChars = reinterpret_cast<wchar_t*>(record + sizeof(Value));
+    BYTE* const dataBytes = record + DataOffset(name);
+    if (nameSize != 0)
+    {
+        std::memcpy(nameChars, name.data(), nameSize);
+    }
+    if (dataSize != 0)
+    {
+        std::memcpy(dataBytes, data, dataSize);
+    }
+
+    const Value* const value = new (record) Value{
+        std::wstring_view{ nameChars, name.length() }, type, dataBytes, valueDataSize };
+
+    // The ValuePtr shares the ownership of the chunk
+    return ValuePtr{ std::move(chunk), value };
+}
+
+
+inline RegTree::InlineName::InlineName(const std::wstring_view name)
+    : m_length{ static_cast<std::uint32_t>(details::SafeCastSizeToDword(name.length())) }
+{
+    static_assert(sizeof(LongName*) <= sizeof(m_chars), "No room for the long name pointer.");
+
+    if (name.length() <= kInlineLength)
+    {
+        std::copy(name.begin(), name.end(), m_chars);
+        return;
+    }
+
+    void* const storage = ::operator new(sizeof(LongName) + name.length() * sizeof(wchar_t));
+    LongName* const longName = new (storage) LongName{ 1 };
+    std::copy(name.begin(), name.end(), reinterpret_cast<wchar_t*>(longName + 1));
+    std::memcpy(m_chars, &longName, sizeof(longName));
+}
+
+
+inline RegTree::InlineName::InlineName(const InlineName& other) noexcept
+    : m_length{ other.m_length }
+{
+    std::copy(std::begin(other.m_chars), std::end(other.m_chars), m_chars);
+    if (m_length > kInlineLength)
+    {
+        GetLongName()->RefCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+inline RegTree::InlineName::InlineName(InlineName&& other) noexcept
+    : m_length{ other.m_length }
+{
+    std::copy(std::begin(other.m_chars), std::end(other.m_chars), m_chars);
+    other.m_length = 0;
+}
+
+
+inline RegTree::InlineName& RegTree::InlineName::operator=(const InlineName& other) noexcept
+{
+    if (this != &other)
+    {
+        InlineName copy{ other };
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+
+inline RegTree::InlineName& RegTree::InlineName::operator=(InlineName&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+        m_length = other.m_length;
+        std::copy(std::begin(other.m_chars), std::end(other.m_chars), m_chars);
+        other.m_length = 0;
+    }
+    return *this;
+}
+
+
+inline RegTree::InlineName::~InlineName()
+{
+    Release();
+}
+
+
+inline std::wstring_view RegTree::InlineName::View() const noexcept
+{
+    if (m_length > kInlineLength)
+    {
+        return std::wstring_view{ reinterpret_cast<const wchar_t*>(GetLongName() + 1), m_length };
+    }
+    return std::wstring_view{ m_chars, m_length };
+}
+
+
+inline RegTree::InlineName::operator std::wstring_view() const noexcept
+{
+    return View();
+}
+
+
+inline size_t RegTree::InlineName::Length() const noexcept
+{
+    return m_length;
+}
+
+
+inline RegTree::InlineName::LongName* RegTree::InlineName::GetLongName() const noexcept
+{
+    _ASSERTE(m_length > kInlineLength);
+
+    LongName* longName = nullptr;
+    std::memcpy(&longName, m_chars, sizeof(longName));
+    return longName;
+}
+
+
+inline void RegTree::InlineName::Release() noexcept
+{
+    if (m_length > kInlineLength)
+    {
+        LongName* const longName = GetLongName();
+        if (longName->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            longName->~LongName();
+            ::operator delete(longName);
+        }
+    }
+    m_length = 0;
+}
+
+
+inline const RegTree::Node* RegTree::Node::FindSubKey(const std::wstring_view name) const noexcept
+{
+    const auto [position, found] = details::FindByFoldedName(SubKeys, name);
+    return found ? SubKeys[position].Key.get() : nullptr;
+}
+
+
+inline const RegTree::Value* RegTree::Node::FindValue(const std::wstring_view name) const noexcept
+{
+    const auto [position, found] = details::FindByFoldedName(Values, name);
+    return found ? Values[position].get() : nullptr;
+}
+
+
+inline RegTree::RegTree()
+    : m_root{ std::make_shared<const Node>() }
+{}
+
+
+inline RegTree::RegTree(NodePtr root, ValueArena valueArena) noexcept
+    : m_root{ std::move(root) }
+    , m_valueArena{ std::move(valueArena) }
+{
+    _ASSERTE(m_root != nullptr);
+}
+
+
+inline RegTree RegTree::FromKey(const RegKey& key,
+                                const RegOperationLimits& limits,
+                                const REGSAM registryView)
+{
+    RegExpected<RegTree> result = TryFromKey(key, limits, registryView);
+    if (!result)
+    {
+        throw RegException{ result.GetError().Code(), "Cannot read the registry key into a tree." };
+    }
+
+    return result.GetValue();
+}
+
+
+inline RegExpected<RegTree> RegTree::TryFromKey(const RegKey& key,
+                                                const RegOperationLimits& limits,
+                                                const REGSAM registryView)
+{
+    _ASSERTE(key.IsValid());
+
+    // The values of the whole subtree are stored in the arena of the new tree
+    ValueArena valueArena;
+    NodePtr root;
+    LSTATUS retCode = CaptureKey(key.Get(), limits, registryView, valueArena, root);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<RegTree>(retCode);
+    }
+
+    return RegExpected<RegTree>{ RegTree{ std::move(root), std::move(valueArena) } };
+}
+
+
+inline LSTATUS RegTree::CaptureKey(
+    const HKEY hKey,
+    const RegOperationLimits& limits,
+    const REGSAM registryView,
+    ValueArena& valueArena,
+    NodePtr& result
+)
+{
+    LSTATUS retCode = details::CheckOperationLimits(limits);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    auto node = std::make_shared<Node>();
+
+    DWORD subKeyCount = 0;
+    DWORD maxSubKeyNameLen = 0;
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    DWORD maxValueDataLen = 0;
+    retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        &subKeyCount,
+        &maxSubKeyNameLen,
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        &maxValueDataLen,
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    // Read the values: names, types and data, with one RegEnumValue call per value
+    std::vector<wchar_t> nameBuffer(static_cast<size_t>(maxValueNameLen) + 1);
+    std::vector<BYTE> dataBuffer(maxValueDataLen);
+    node->Values.reserve(valueCount);
+
+    for (DWORD index = 0; index < valueCount; )
+    {
+        retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        DWORD valueNameLen = static_cast<DWORD>(nameBuffer.size());
+        DWORD valueType = REG_NONE;
+        DWORD dataSize = static_cast<DWORD>(dataBuffer.size());
+        retCode = details::TracedRegEnumValueW(
+            __func__,
+            hKey,
+            index,
+            nameBuffer.data(),
+            &valueNameLen,
+            nullptr,    // reserved
+            &valueType,
+            dataBuffer.empty() ? nullptr : dataBuffer.data(),
+            &dataSize
+        );
+        if ((retCode == ERROR_SUCCESS) && (dataSize > dataBuffer.size()))
+        {
+            // With a null data pointer the call succeeds and only reports the size:
+            // the value gained data since RegQueryInfoKey
+            retCode = ERROR_MORE_DATA;
+        }
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // The value changed since RegQueryInfoKey: grow the buffers and retry
+            nameBuffer.resize(nameBuffer.size() * 2);
+            if (dataSize > dataBuffer.size())
+            {
+                dataBuffer.resize(dataSize);
+            }
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Values were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        node->Values.push_back(valueArena.Store(std::wstring_view{ nameBuffer.data(), valueNameLen },
+                                                valueType, dataBuffer.data(), dataSize));
+
+        index++;
+    }
+
+    // Read the subkeys, recursively
+    nameBuffer.resize(static_cast<size_t>(maxSubKeyNameLen) + 1);
+    node->SubKeys.reserve(subKeyCount);
+
+    for (DWORD index = 0; index < subKeyCount; index++)
+    {
+        retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        DWORD subKeyNameLen = static_cast<DWORD>(nameBuffer.size());
+        retCode = details::TracedRegEnumKeyExW(
+            __func__,
+            hKey,
+            index,
+            nameBuffer.data(),
+            &subKeyNameLen,
+            nullptr, // reserved
+            nullptr, // no class
+            nullptr, // no class
+            nullptr  // no last write time
+        );
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Subkeys were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        std::wstring subKeyName{ nameBuffer.data(), subKeyNameLen };
+
+        RegKey subKey;
+        RegResult openResult = subKey.TryOpen(hKey, subKeyName, KEY_READ | registryView);
+        if (openResult.Failed())
+        {
+            return openResult.Code();
+        }
+
+        NodePtr child;
+        retCode = CaptureKey(subKey.Get(), limits, registryView, valueArena, child);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+        node->SubKeys.push_back(SubKeyEntry{ InlineName{ subKeyName }, std::move(child) });
+    }
+
+    // Keep subkeys and values sorted by case-folded name
+    std::sort(node->Values.begin(), node->Values.end(),
+        [](const ValuePtr& a, const ValuePtr& b)
+        {
+            return details::CompareStrings(a->Name, b->Name, StringComparison::IgnoreCase) < 0;
+        }
+    );
+    std::sort(node->SubKeys.begin(), node->SubKeys.end(),
+        [](const SubKeyEntry& a, const SubKeyEntry& b)
+        {
+            return details::CompareStrings(a.Name, b.Name, StringComparison::IgnoreCase) < 0;
+        }
+    );
+
+    result = std::move(node);
+    return ERROR_SUCCESS;
+}
+
+
+inline const RegTree::NodePtr& RegTree::Root() const noexcept
+{
+    return m_root;
+}
+
+
+inline bool RegTree::SharesRootWith(const RegTree& other) const noexcept
+{
+    return m_root == other.m_root;
+}
+
+
+inline const RegTree::Node* RegTree::FindKey(const std::wstring_view keyPath) const noexcept
+{
+    const Node* node = m_root.get();
+
+    size_t start = 0;
+    while ((node != nullptr) && (start < keyPath.length()))
+    {
+        size_t end = keyPath.find(L'\\', start);
+        if (end == std::wstring_view::npos)
+        {
+            end = keyPath.length();
+        }
+
+        if (end > start)
+        {
+            node = node->FindSubKey(keyPath.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+
+    return node;
+}
+
+
+inline bool RegTree::ContainsKey(const std::wstring_view keyPath) const noexcept
+{
+    return FindKey(keyPath) != nullptr;
+}
+
+
+inline const RegTree::Value* RegTree::FindValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName
+) const noexcept
+{
+    const Node* node = FindKey(keyPath);
+    return (node != nullptr) ? node->FindValue(valueName) : nullptr;
+}
+
+
+template <typename EditFunction>
+inline RegTree::NodePtr RegTree::UpdateAtPath(
+    const NodePtr& node,
+    const std::vector<std::wstring_view>& pathComponents,
+    const size_t depth,
+    const bool createMissingKeys,
+    EditFunction& edit
+)
+{
+    if (depth == pathComponents.size())
+    {
+        // Reached the key to edit: work on a copy of it
+        auto copy = std::make_shared<Node>(*node);
+        if (!edit(*copy))
+        {
+            // Nothing changed: keep sharing the original node
+            return node;
+        }
+        return copy;
+    }
+
+    const std::wstring_view childName = pathComponents[depth];
+    const auto [position, found] = details::FindByFoldedName(node->SubKeys, childName);
+
+    NodePtr child;
+    if (found)
+    {
+        child = node->SubKeys[position].Key;
+    }
+    else if (createMissingKeys)
+    {
+        child = std::make_shared<const Node>();
+    }
+    else
+    {
+        // The key doesn't exist: nothing to update
+        return node;
+    }
+
+    NodePtr newChild = UpdateAtPath(child, pathComponents, depth + 1, createMissingKeys, edit);
+    if (found && (newChild == child))
+    {
+        // The subtree didn't change
+        return node;
+    }
+
+    // Copy this node (sharing all the other subtrees), and link the new child
+    auto copy = std::make_shared<Node>(*node);
+    if (found)
+    {
+        copy->SubKeys[position].Key = std::move(newChild);
+    }
+    else
+    {
+        copy->SubKeys.insert(copy->SubKeys.begin() + position,
+                             SubKeyEntry{ InlineName{ childName }, std::move(newChild) });
+    }
+    return copy;
+}
+
+
+inline void RegTree::CreateKey(const std::wstring_view keyPath)
+{
+    auto edit = [](Node&) { return false; };
+    m_root = UpdateAtPath(m_root, details::SplitKeyPath(keyPath), 0, true, edit);
+}
+
+
+inline void RegTree::SetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const std::vector<BYTE>& data
+)
+{
+    SetValue(keyPath, valueName, type, data.data(), data.size());
+}
+
+
+inline void RegTree::SetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize
+)
+{
+    auto edit = [&](Node& node)
+    {
+        const auto [position, found] = details::FindByFoldedName(node.Values, valueName);
+        if (found
+            && (node.Values[position]->Type == type)
+            && details::EqualValueData(*node.Values[position], data, dataSize))
+        {
+            return false;
+        }
+
+        ValuePtr value = m_valueArena.Store(valueName, type, data, dataSize);
+
+        if (found)
+        {
+            node.Values[position] = std::move(value);
+        }
+        else
+        {
+            node.Values.insert(node.Values.begin() + position, std::move(value));
+        }
+        return true;
+    };
+
+    m_root = UpdateAtPath(m_root, details::SplitKeyPath(keyPath), 0, true, edit);
+}
+
+
+inline bool RegTree::DeleteValue(const std::wstring_view keyPath, const std::wstring_view valueName)
+{
+    bool deleted = false;
+    auto edit = [&](Node& node)
+    {
+        const auto [position, found] = details::FindByFoldedName(node.Values, valueName);
+        if (found)
+        {
+            node.Values.erase(node.Values.begin() + position);
+            deleted = true;
+        }
+        return found;
+    };
+
+    m_root = UpdateAtPath(m_root, details::SplitKeyPath(keyPath), 0, false, edit);
+    return deleted;
+}
+
+
+inline bool RegTree::DeleteTree(const std::wstring_view keyPath)
+{
+    std::vector<std::wstring_view> pathComponents = details::SplitKeyPath(keyPath);
+    if (pathComponents.empty())
+    {
+        // The root key cannot be deleted
+        return false;
+    }
+
+    // Edit the parent key, unlinking the child subtree
+    const std::wstring_view keyName = pathComponents.back();
+    pathComponents.pop_back();
+
+    bool deleted = false;
+    auto edit = [&](Node& node)
+    {
+        const auto [position, found] = details::FindByFoldedName(node.SubKeys, keyName);
+        if (found)
+        {
+            node.SubKeys.erase(node.SubKeys.begin() + position);
+            deleted = true;
+        }
+        return found;
+    };
+
+    m_root = UpdateAtPath(m_root, pathComponents, 0, false, edit);
+    return deleted;
+}
+
+
+inline bool RegTree::MoveKey(const std::wstring_view sourceKeyPath, const std::wstring_view destKeyPath)
+{
+    std::vector<std::wstring_view> sourceComponents = details::SplitKeyPath(sourceKeyPath);
+    std::vector<std::wstring_view> destComponents = details::SplitKeyPath(destKeyPath);
+    if (sourceComponents.empty() || destComponents.empty())
+    {
+        // The root key cannot be moved, or replaced
+        return false;
+    }
+
+    // The destination must not be inside the source subtree
+    if ((destComponents.size() >= sourceComponents.size())
+        && std::equal(sourceComponents.begin(), sourceComponents.end(), destComponents.begin(),
+            [](const std::wstring_view a, const std::wstring_view b)
+            {
+                return details::EqualStrings(a, b, StringComparison::IgnoreCase);
+            }))
+    {
+        if (destComponents.size() > sourceComponents.size())
+        {
+            return false;
+        }
+
+        // Same key: only the case of its name can change
+        const std::wstring_view newName = destComponents.back();
+        destComponents.pop_back();
+
+        bool renamed = false;
+        auto rename = [&](Node& node)
+        {
+            const auto [position, found] = details::FindByFoldedName(node.SubKeys, newName);
+            if (!found || (node.SubKeys[position].Name.View() == newName))
+            {
+                return false;
+            }
+
+            node.SubKeys[position].Name = InlineName{ newName };
+            renamed = true;
+            return true;
+        };
+
+        m_root = UpdateAtPath(m_root, destComponents, 0, false, rename);
+        return renamed;
+    }
+
+    if (ContainsKey(destKeyPath))
+    {
+        return false;
+    }
+
+    // Unlink the subtree from the source parent
+    const std::wstring_view sourceName = sourceComponents.back();
+    sourceComponents.pop_back();
+
+    NodePtr moved;
+    auto unlink = [&](Node& node)
+    {
+        const auto [position, found] = details::FindByFoldedName(node.SubKeys, sourceName);
+        if (found)
+        {
+            moved = std::move(node.SubKeys[position].Key);
+            node.SubKeys.erase(node.SubKeys.begin() + position);
+        }
+        return found;
+    };
+
+    NodePtr newRoot = UpdateAtPath(m_root, sourceComponents, 0, false, unlink);
+    if (!moved)
+    {
+        return false;
+    }
+
+    const std::wstring_view destName = destComponents.back();
+    destComponents.pop_back();
+
+    // Link the subtree under the destination parent, with its new name
+    auto link = [&](Node& node)
+    {
+        const auto [position, found] = details::FindByFoldedName(node.SubKeys, destName);
+        _ASSERTE(!found);
+        node.SubKeys.insert(node.SubKeys.begin() + position,
+                            SubKeyEntry{ InlineName{ destName }, std::move(moved) });
+        return true;
+    };
+
+    m_root = UpdateAtPath(newRoot, destComponents, 0, true, link);
+    return true;
+}
+
+
+inline bool RegTree::RenameKey(const std::wstring_view keyPath, const std::wstring_view newKeyName)
+{
+    if (newKeyName.empty() || (newKeyName.find(L'\\') != std::wstring_view::npos))
+    {
+        return false;
+    }
+
+    const size_t separator = keyPath.rfind(L'\\');
+    std::wstring destKeyPath;
+    if (separator != std::wstring_view::npos)
+    {
+        destKeyPath.assign(keyPath.data(), separator + 1);
+    }
+    destKeyPath.append(newKeyName.data(), newKeyName.length());
+
+    return MoveKey(keyPath, destKeyPath);
+}
+
+
+inline std::vector<RegTree::Difference> RegTree::Diff(const RegTree& oldTree,
+                                                      const RegTree& newTree)
+{
+    std::vector<Difference> differences;
+    std::wstring keyPath;
+    DiffNodes(*oldTree.m_root, *newTree.m_root, keyPath, differences);
+    return differences;
+}
+
+
+inline void RegTree::DiffNodes(
+    const Node& oldNode,
+    const Node& newNode,
+    std::wstring& keyPath,
+    std::vector<Difference>& differences
+)
+{
+    // Shared subtree: nothing changed below this point
+    if (&oldNode == &newNode)
+    {
+        return;
+    }
+
+    auto compareNames = [](const std::wstring_view a, const std::wstring_view b)
+    {
+        return details::CompareStrings(a, b, StringComparison::IgnoreCase);
+    };
+
+    // Merge-join the sorted values
+    size_t i = 0;
+    size_t j = 0;
+    while ((i < oldNode.Values.size()) || (j < newNode.Values.size()))
+    {
+        int order = 0;
+        if (i == oldNode.Values.size())
+        {
+            order = 1;
+        }
+        else if (j == newNode.Values.size())
+        {
+            order = -1;
+        }
+        else
+        {
+            order = compareNames(oldNode.Values[i]->Name, newNode.Values[j]->Name);
+        }
+
+        if (order < 0)
+        {
+            differences.push_back(Difference{
+                Difference::Kind::ValueDeleted, keyPath, std::wstring{ oldNode.Values[i]->Name } });
+            i++;
+        }
+        else if (order > 0)
+        {
+            differences.push_back(Difference{
+                Difference::Kind::ValueAdded, keyPath, std::wstring{ newNode.Values[j]->Name } });
+            j++;
+        }
+        else
+        {
+            const Value& oldValue = *oldNode.Values[i];
+            const Value& newValue = *newNode.Values[j];
+            if ((&oldValue != &newValue)
+                && ((oldValue.Type != newValue.Type)
+                    || !details::EqualValueData(oldValue, newValue.Data, newValue.DataSize)))
+            {
+                differences.push_back(Difference{
+                    Difference::Kind::ValueChanged, keyPath, std::wstring{ newValue.Name } });
+            }
+            i++;
+            j++;
+        }
+    }
+
+    // Merge-join the sorted subkeys
+    i = 0;
+    j = 0;
+    while ((i < oldNode.SubKeys.size()) || (j < newNode.SubKeys.size()))
+    {
+        int order = 0;
+        if (i == oldNode.SubKeys.size())
+        {
+            order = 1;
+        }
+        else if (j == newNode.SubKeys.size())
+        {
+            order = -1;
+        }
+        else
+        {
+            order = compareNames(oldNode.SubKeys[i].Name, newNode.SubKeys[j].Name);
+        }
+
+        const SubKeyEntry& subKey = (order < 0) ? oldNode.SubKeys[i] : newNode.SubKeys[j];
+
+        // Append the subkey name to the current path
+        const size_t parentPathLength = keyPath.length();
+        if (!keyPath.empty())
+        {
+            keyPath += L'\\';
+        }
+        keyPath += subKey.Name.View();
+
+        if (order < 0)
+        {
+            differences.push_back(Difference{ Difference::Kind::KeyDeleted, keyPath, {} });
+            i++;
+        }
+        else if (order > 0)
+        {
+            differences.push_back(Difference{ Difference::Kind::KeyAdded, keyPath, {} });
+            j++;
+        }
+        else
+        {
+            DiffNodes(*oldNode.SubKeys[i].Key, *newNode.SubKeys[j].Key, keyPath, differences);
+            i++;
+            j++;
+        }
+
+        keyPath.resize(parentPathLength);
+    }
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGTREE_HPP_INCLUDED
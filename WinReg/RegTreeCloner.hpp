@@ -0,0 +1,660 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGTREECLONER_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGTREECLONER_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegTreeCloner: streams a live registry subtree into an in-memory tree or under
+// another registry key (RegKeyTreeWriter), with a reader thread.
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "WinReg.hpp"       // RegKey
+
+#include <algorithm>        // std::max
+#include <condition_variable>// std::condition_variable
+#include <deque>            // std::deque
+#include <exception>        // std::exception_ptr
+#include <mutex>            // std::mutex, std::unique_lock
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <thread>           // std::thread
+#include <utility>          // std::move
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Options
+//
+
+// Options for RegTreeCloner::Clone
+struct RegCloneOptions
+{
+    // Maximum size, in bytes, of the keys and values read from the source
+    // and not yet written to the destination; when reached, the reader waits
+    // for the writer. A single value larger than this is still passed through.
+    size_t MaxQueuedBytes = 1024 * 1024;
+
+    // Cancellation and deadline of the clone
+    RegOperationLimits Limits;
+
+    // Registry view the source subkeys are opened in
+    REGSAM RegistryView = KEY_WOW64_64KEY;
+};
+
+
+//
+// Class Declarations
+//
+
+// Counters collected by RegTreeCloner::Clone
+struct RegCloneStatistics
+{
+    // Keys and values written (the source key itself is included in KeyCount)
+    ULONGLONG KeyCount{ 0 };
+    ULONGLONG ValueCount{ 0 };
+
+    // Total size of the value data written
+    ULONGLONG DataBytes{ 0 };
+
+    // Highest number of bytes queued between the reader and the writer
+    size_t PeakQueuedBytes{ 0 };
+};
+
+
+//------------------------------------------------------------------------------
+// Streams a live registry subtree into a destination, without reading the
+// whole subtree into memory first.
+//
+// A reader thread walks the source key depth-first, and pushes its keys and
+// values into a bounded queue, while the calling thread pops them and writes
+// them to the destination. So, enumeration and writes overlap, and the memory
+// used doesn't depend on the size of the subtree (see RegCloneOptions).
+//
+// The destination can be any object with these methods, like RegTree,
+// RegConcurrentTree, RegPersistentTree, or RegKeyTreeWriter for a live key:
+//
+//   void CreateKey(std::wstring_view keyPath);
+//   void SetValue(std::wstring_view keyPath, std::wstring_view valueName,
+//                 DWORD type, std::vector<BYTE> data);
+//
+// Key paths are relative to the source key (the empty path is the source
+// key itself); each key is created before its values and its subkeys.
+//------------------------------------------------------------------------------
+class RegTreeCloner
+{
+public:
+
+    // Clone the subtree of an open key (opened with KEY_READ access).
+    // Throw RegException on failure; exceptions thrown by the destination
+    // are propagated. When the clone fails, the keys and values already
+    // written to the destination are left there.
+    template <typename Destination>
+    static RegCloneStatistics Clone(const RegKey& source,
+                                    Destination& destination,
+                                    const RegCloneOptions& options = RegCloneOptions{});
+
+    // Same as above, returning the error instead of throwing (a RegException
+    // thrown by the destination is returned as well)
+    template <typename Destination>
+    [[nodiscard]] static RegExpected<RegCloneStatistics> TryClone(const RegKey& source,
+                                                                  Destination& destination,
+                                                                  const RegCloneOptions& options = RegCloneOptions{});
+};
+
+
+//------------------------------------------------------------------------------
+// Writes keys and values under a live registry key, with the same CreateKey
+// and SetValue methods as the in-memory trees (e.g. as the destination of
+// RegTreeCloner). Key paths are relative to the root key.
+//
+// The last key written to is kept open, so consecutive values of the same key
+// cost one RegSetValueEx call each. Methods throw RegException on failure.
+//------------------------------------------------------------------------------
+class RegKeyTreeWriter
+{
+public:
+
+    // Write under the given key (not owned: it must outlive this object),
+    // creating the keys in the given registry view
+    explicit RegKeyTreeWriter(const RegKey& rootKey, REGSAM registryView = KEY_WOW64_64KEY) noexcept;
+
+    // Create the key at the given path, with any missing parent key
+    void CreateKey(std::wstring_view keyPath);
+
+    // Set a value under the given key, creating any missing key
+    void SetValue(std::wstring_view keyPath,
+                  std::wstring_view valueName,
+                  DWORD type,
+                  const std::vector<BYTE>& data);
+
+private:
+
+    // Make the key at the given path the current one, creating it if needed
+    void SelectKey(std::wstring_view keyPath);
+
+    HKEY         m_hKeyRoot{ nullptr };
+    REGSAM       m_registryView{ KEY_WOW64_64KEY };
+    RegKey       m_currentKey;
+    std::wstring m_currentKeyPath;
+
+    // NUL-terminated copy of the value name being written
+    std::wstring m_valueName;
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegTreeCloner
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+// A key or a value read by the clone reader thread.
+// The values of a key follow its key record (and precede its subkeys),
+// so they don't repeat the key path.
+struct CloneRecord
+{
+    bool              IsKey{ false };
+    std::wstring      Name;     // key path (relative to the source) or value name
+    DWORD             Type{ REG_NONE };
+    std::vector<BYTE> Data;
+};
+
+
+// Number of bytes accounted for a queued record
+[[nodiscard]] inline size_t CloneRecordSize(const CloneRecord& record) noexcept
+{
+    return sizeof(CloneRecord) + record.Name.length() * sizeof(wchar_t) + record.Data.size();
+}
+
+
+//------------------------------------------------------------------------------
+// Bounded queue between the clone reader (producer) and writer (consumer).
+// The writer pops all the queued records at once; they stay accounted until
+// its next Pop, so the bound also covers the records being written.
+//------------------------------------------------------------------------------
+class CloneQueue
+{
+public:
+
+    explicit CloneQueue(const size_t maxBytes) noexcept
+        : m_maxBytes{ maxBytes }
+    {}
+
+    // Wait for room, then add a record; return false if the writer stopped
+    [[nodiscard]] bool Push(CloneRecord&& record)
+    {
+        const size_t recordSize = CloneRecordSize(record);
+
+        std::unique_lock<std::mutex> lock{ m_mutex };
+        m_notFull.wait(lock, [&]
+        {
+            // A record larger than the bound goes through when the queue is empty
+            return m_stopped || (m_queuedBytes == 0) || (m_queuedBytes + recordSize <= m_maxBytes);
+        });
+        if (m_stopped)
+        {
+            return false;
+        }
+
+        m_records.push_back(std::move(record));
+        m_queuedBytes += recordSize;
+        if (m_queuedBytes > m_peakBytes)
+        {
+            m_peakBytes = m_queuedBytes;
+        }
+
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Called by the reader when it is done, successfully or not
+    void Finish(const LSTATUS retCode) noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            m_readerResult = retCode;
+            m_finished = true;
+        }
+        m_notEmpty.notify_one();
+    }
+
+    // Release the previous batch, wait for records, and move all the queued
+    // ones into batch. Return false when the reader finished and nothing is left.
+    [[nodiscard]] bool Pop(std::vector<CloneRecord>& batch)
+    {
+        batch.clear();
+
+        std::unique_lock<std::mutex> lock{ m_mutex };
+        m_queuedBytes -= m_batchBytes;
+        m_batchBytes = 0;
+        m_notFull.notify_one();
+
+        m_notEmpty.wait(lock, [&] { return !m_records.empty() || m_finished; });
+        if (m_records.empty())
+        {
+            return false;
+        }
+
+        // Swap the buffers, so both sides reuse their capacity
+        batch.swap(m_records);
+        m_batchBytes = m_queuedBytes;
+        return true;
+    }
+
+    // Called by the writer to stop the reader (e.g. on a write error)
+    void Stop() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            m_stopped = true;
+        }
+        m_notFull.notify_one();
+    }
+
+    [[nodiscard]] LSTATUS ReaderResult() const
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        return m_readerResult;
+    }
+
+    [[nodiscard]] size_t PeakBytes() const
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        return m_peakBytes;
+    }
+
+private:
+    mutable std::mutex       m_mutex;
+    std::condition_variable  m_notFull;
+    std::condition_variable  m_notEmpty;
+    std::vector<CloneRecord> m_records;
+    size_t                   m_maxBytes;
+    size_t                   m_queuedBytes{ 0 };    // queued and being written
+    size_t                   m_batchBytes{ 0 };     // being written
+    size_t                   m_peakBytes{ 0 };
+    LSTATUS                  m_readerResult{ ERROR_SUCCESS };
+    bool                     m_finished{ false };
+    bool                     m_stopped{ false };
+};
+
+
+//------------------------------------------------------------------------------
+// Read a key and its subtree into the clone queue, depth-first
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS ReadKeyIntoCloneQueue(
+    const HKEY hKey,
+    std::wstring& keyPath,
+    CloneQueue& queue,
+    const RegOperationLimits& limits,
+    const REGSAM registryView
+)
+{
+    LSTATUS retCode = CheckOperationLimits(limits);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    CloneRecord keyRecord;
+    keyRecord.IsKey = true;
+    keyRecord.Name = keyPath;
+    if (!queue.Push(std::move(keyRecord)))
+    {
+        return ERROR_CANCELLED;
+    }
+
+    DWORD subKeyCount = 0;
+    DWORD maxSubKeyNameLen = 0;
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    DWORD maxValueDataLen = 0;
+    retCode = TracedRegQueryInfoKeyW(
+        __func__,
+        hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        &subKeyCount,
+        &maxSubKeyNameLen,
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        &maxValueDataLen,
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    // Read the values, with one RegEnumValue call per value
+    std::vector<wchar_t> nameBuffer(static_cast<size_t>((std::max)(maxValueNameLen, maxSubKeyNameLen)) + 1);
+    std::vector<BYTE> dataBuffer(maxValueDataLen);
+
+    for (DWORD index = 0; index < valueCount; )
+    {
+        retCode = CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        DWORD valueNameLen = static_cast<DWORD>(nameBuffer.size());
+        DWORD valueType = REG_NONE;
+        DWORD dataSize = static_cast<DWORD>(dataBuffer.size());
+        retCode = TracedRegEnumValueW(
+            __func__,
+            hKey,
+            index,
+            nameBuffer.data(),
+            &valueNameLen,
+            nullptr,    // reserved
+            &valueType,
+            dataBuffer.empty() ? nullptr : dataBuffer.data(),
+            &dataSize
+        );
+        if ((retCode == ERROR_SUCCESS) && (dataSize > dataBuffer.size()))
+        {
+            // With a null data pointer the call succeeds and only reports the size:
+            // the value gained data since RegQueryInfoKey
+            retCode = ERROR_MORE_DATA;
+        }
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // The value changed since RegQueryInfoKey: grow the buffers and retry
+            nameBuffer.resize(nameBuffer.size() * 2);
+            if (dataSize > dataBuffer.size())
+            {
+                dataBuffer.resize(dataSize);
+            }
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Values were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        CloneRecord valueRecord;
+        valueRecord.Name.assign(nameBuffer.data(), valueNameLen);
+        valueRecord.Type = valueType;
+        valueRecord.Data.assign(dataBuffer.begin(), dataBuffer.begin() + dataSize);
+        if (!queue.Push(std::move(valueRecord)))
+        {
+            return ERROR_CANCELLED;
+        }
+
+        index++;
+    }
+
+    // Read the subkeys, recursively
+    for (DWORD index = 0; index < subKeyCount; )
+    {
+        retCode = CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        DWORD subKeyNameLen = static_cast<DWORD>(nameBuffer.size());
+        retCode = TracedRegEnumKeyExW(
+            __func__,
+            hKey,
+            index,
+            nameBuffer.data(),
+            &subKeyNameLen,
+            nullptr, // reserved
+            nullptr, // no class
+            nullptr, // no class
+            nullptr  // no last write time
+        );
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // A longer subkey was added since RegQueryInfoKey: grow the buffer and retry
+            nameBuffer.resize(nameBuffer.size() * 2);
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Subkeys were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        const std::wstring subKeyName{ nameBuffer.data(), subKeyNameLen };
+
+        RegKey subKey;
+        retCode = subKey.TryOpen(hKey, subKeyName, KEY_READ | registryView).Code();
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        const size_t keyPathLength = keyPath.length();
+        if (keyPathLength != 0)
+        {
+            keyPath += L'\\';
+        }
+        keyPath += subKeyName;
+
+        retCode = ReadKeyIntoCloneQueue(subKey.Get(), keyPath, queue, limits, registryView);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        keyPath.resize(keyPathLength);
+        index++;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegTreeCloner Inline Methods
+//------------------------------------------------------------------------------
+
+template <typename Destination>
+inline RegCloneStatistics RegTreeCloner::Clone(
+    const RegKey& source,
+    Destination& destination,
+    const RegCloneOptions& options
+)
+{
+    RegExpected<RegCloneStatistics> result = TryClone(source, destination, options);
+    if (!result)
+    {
+        throw RegException{ result.GetError().Code(), "Cannot clone the registry key." };
+    }
+
+    return result.GetValue();
+}
+
+
+template <typename Destination>
+inline RegExpected<RegCloneStatistics> RegTreeCloner::TryClone(
+    const RegKey& source,
+    Destination& destination,
+    const RegCloneOptions& options
+)
+{
+    _ASSERTE(source.IsValid());
+
+    details::CloneQueue queue{ options.MaxQueuedBytes };
+    std::exception_ptr readerException;
+
+    // The reader walks the source, while this thread writes to the destination
+    std::thread reader([&]
+    {
+        LSTATUS retCode = ERROR_CANCELLED;
+        try
+        {
+            std::wstring keyPath;
+            retCode = details::ReadKeyIntoCloneQueue(source.Get(), keyPath, queue,
+                                                     options.Limits, options.RegistryView);
+        }
+        catch (...)
+        {
+            readerException = std::current_exception();
+        }
+        queue.Finish(retCode);
+    });
+
+    RegCloneStatistics statistics;
+    LSTATUS retCode = ERROR_SUCCESS;
+    try
+    {
+        std::vector<details::CloneRecord> batch;
+        std::wstring keyPath;
+
+        while (queue.Pop(batch))
+        {
+            retCode = details::CheckOperationLimits(options.Limits);
+            if (retCode != ERROR_SUCCESS)
+            {
+                break;
+            }
+
+            for (auto& record : batch)
+            {
+                if (record.IsKey)
+                {
+                    keyPath = std::move(record.Name);
+                    destination.CreateKey(keyPath);
+                    statistics.KeyCount++;
+                }
+                else
+                {
+                    statistics.DataBytes += record.Data.size();
+                    destination.SetValue(keyPath, record.Name, record.Type, std::move(record.Data));
+                    statistics.ValueCount++;
+                }
+            }
+        }
+    }
+    catch (const RegException& e)
+    {
+        retCode = static_cast<LSTATUS>(e.code().value());
+    }
+    catch (...)
+    {
+        queue.Stop();
+        reader.join();
+        throw;
+    }
+
+    queue.Stop();
+    reader.join();
+
+    if (readerException)
+    {
+        std::rethrow_exception(readerException);
+    }
+    if (retCode == ERROR_SUCCESS)
+    {
+        retCode = queue.ReaderResult();
+    }
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<RegCloneStatistics>(retCode);
+    }
+
+    statistics.PeakQueuedBytes = queue.PeakBytes();
+    return RegExpected<RegCloneStatistics>{ statistics };
+}
+
+
+//------------------------------------------------------------------------------
+//                      RegKeyTreeWriter Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegKeyTreeWriter::RegKeyTreeWriter(const RegKey& rootKey, const REGSAM registryView) noexcept
+    : m_hKeyRoot{ rootKey.Get() }
+    , m_registryView{ registryView }
+{
+    _ASSERTE(rootKey.IsValid());
+}
+
+
+inline void RegKeyTreeWriter::CreateKey(const std::wstring_view keyPath)
+{
+    SelectKey(keyPath);
+}
+
+
+inline void RegKeyTreeWriter::SetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const std::vector<BYTE>& data
+)
+{
+    SelectKey(keyPath);
+
+    m_valueName.assign(valueName.data(), valueName.length());
+    LSTATUS retCode = details::TracedRegSetValueExW(
+        __func__,
+        m_currentKey.Get(),
+        m_valueName.c_str(),
+        0, // reserved
+        type,
+        data.empty() ? nullptr : data.data(),
+        static_cast<DWORD>(data.size())
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegSetValueExW failed." };
+    }
+}
+
+
+inline void RegKeyTreeWriter::SelectKey(const std::wstring_view keyPath)
+{
+    if (m_currentKey.IsValid() && (keyPath == m_currentKeyPath))
+    {
+        return;
+    }
+
+    m_currentKey.Close();
+    m_currentKeyPath.assign(keyPath.data(), keyPath.length());
+
+    RegResult retCode = m_currentKey.TryCreate(m_hKeyRoot, m_currentKeyPath, KEY_WRITE | m_registryView);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "RegCreateKeyExW failed." };
+    }
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGTREECLONER_HPP_INCLUDED
@@ -0,0 +1,564 @@
+#ifndef GIOVANNI_DICANIO_WINREG_REGVERSIONEDTREE_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_REGVERSIONEDTREE_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// RegVersionedTree: a thread-safe, multi-version container of a RegTree, for
+// concurrent readers and writers (multi-version concurrency control).
+//
+// This header is opt-in: WinReg.hpp doesn't include it, so code using only
+// RegKey doesn't compile it (nor the standard headers it needs).
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "RegEpoch.hpp"     // details::EpochGuard, details::EpochRetiredList
+#include "RegMemoryBackend.hpp" // RegMemoryBackend
+#include "RegTree.hpp"      // RegTree
+
+#include <atomic>           // std::atomic
+#include <cstdint>          // std::uint64_t
+#include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
+#include <utility>          // std::move
+#include <vector>           // std::vector
+
+
+
+namespace winreg
+{
+
+//
+// Class Declarations
+//
+
+//------------------------------------------------------------------------------
+// A thread-safe, multi-version container of a RegTree, for concurrent
+// readers and writers (multi-version concurrency control).
+//
+// - Readers never lock nor wait: Read runs a function on the current version
+//   after announcing the reader in its own per-thread slot (an epoch, see
+//   below), and loading the version pointer; the version never changes under
+//   it. As readers don't write any shared memory location, the read
+//   throughput scales with the number of threads. Snapshot copies the tree
+//   of the current version, to keep it after the call (that touches the
+//   reference count of its root, shared by all the snapshots).
+//
+// - Writers build a new version from a snapshot (path copying, see RegTree)
+//   and publish it with a compare-and-swap of the current version.
+//   Conflicts are detected per key: if another writer published a version in
+//   the meantime, TryCommit compares the keys changed by the two writers
+//   (using RegTree::Diff, that skips the unchanged shared subtrees); when they
+//   are disjoint, the changes are rebased on the new version and published,
+//   otherwise the commit fails. Update instead re-runs the update function on
+//   the new version. So an update never overwrites changes it has not seen.
+//
+// - Old versions are reclaimed with epoch-based reclamation: a version
+//   replaced by a writer is retired with the current epoch, and deleted
+//   by a later writer once every reader active in that epoch has left
+//   (see RegEpoch.hpp). Its nodes shared with newer versions,
+//   or with snapshots, live on.
+//------------------------------------------------------------------------------
+class RegVersionedTree
+{
+public:
+
+    // Initialize with a tree containing just an empty root key
+    RegVersionedTree();
+
+    // Initialize with the given tree as version 0
+    explicit RegVersionedTree(RegTree initialTree);
+
+    // Ban copy and move (the object is shared among threads)
+    RegVersionedTree(const RegVersionedTree&) = delete;
+    RegVersionedTree& operator=(const RegVersionedTree&) = delete;
+    RegVersionedTree(RegVersionedTree&&) = delete;
+    RegVersionedTree& operator=(RegVersionedTree&&) = delete;
+
+    // No reader can be active anymore
+    ~RegVersionedTree();
+
+    // Call read (taking a const RegTree&) on the current version, and return
+    // its result. Doesn't lock nor allocate: the tree must not be used after
+    // read returns (take a Snapshot for that).
+    template <typename ReadFunction>
+    decltype(auto) Read(ReadFunction&& read) const;
+
+    // Return a snapshot of the current version (O(1))
+    [[nodiscard]] RegTree Snapshot() const;
+
+    // Return the number of the current version
+    [[nodiscard]] std::uint64_t CurrentVersion() const;
+
+    // Publish newTree (derived from the snapshot baseTree) as the next version.
+    // If other versions were published after baseTree, the changes from
+    // baseTree to newTree are applied to the current version, unless they
+    // touch a key (or a subtree) that was changed by those versions.
+    // Return false on conflict, in which case nothing is published.
+    [[nodiscard]] bool TryCommit(const RegTree& baseTree, const RegTree& newTree);
+
+    // Apply the update function (taking a RegTree& to modify) to a snapshot
+    // of the current version, and publish the result; on conflict with
+    // another writer, retry on the newly published version.
+    // Return the number of the version published (or the current one,
+    // if the update didn't change anything).
+    template <typename UpdateFunction>
+    std::uint64_t Update(UpdateFunction&& update);
+
+    // Return the number of the old versions not deleted yet, as readers
+    // may still be using them
+    [[nodiscard]] size_t RetiredVersionCount() const;
+
+private:
+
+    // An immutable published version
+    struct Version
+    {
+        RegTree       Tree;
+        std::uint64_t Number;
+    };
+
+    // Publish next, if the current version is still expected (that the
+    // caller protects with an EpochGuard); otherwise return false, and load
+    // the current version into expected. Takes the ownership of next.
+    [[nodiscard]] bool CompareExchange(const Version*& expected, const Version* next);
+
+    std::atomic<const Version*> m_current;
+
+    // The replaced versions, waiting for the readers that may use them
+    details::EpochRetiredList   m_retired;
+};
+
+
+//------------------------------------------------------------------------------
+// An in-memory registry backend (see RegMemoryBackend) storing the keys in
+// a RegVersionedTree: the lookups and enumerations of RegKey are lock-free
+// reads of the current version, so they scale with the number of reader
+// threads, and each change is committed as a new version.
+//------------------------------------------------------------------------------
+class RegVersionedTreeBackend : public RegMemoryBackend
+{
+public:
+
+    // Start from the given tree, as version 0 (see RegTreeBackend)
+    explicit RegVersionedTreeBackend(RegTree tree = RegTree{});
+
+    // Return a snapshot of the current version
+    [[nodiscard]] RegTree Snapshot() const;
+
+    // The versioned tree: e.g. to update many keys in a single version
+    // (such updates are not notified to RegKey)
+    [[nodiscard]] RegVersionedTree& Tree() noexcept;
+
+protected:
+
+    [[nodiscard]] bool StoreContainsKey(std::wstring_view keyPath) override;
+    [[nodiscard]] RegTree::ValuePtr StoreFindValue(std::wstring_view keyPath,
+                                                   std::wstring_view valueName) override;
+    [[nodiscard]] bool StoreReadSubKeys(std::wstring_view keyPath,
+                                        std::vector<std::wstring>& subKeyNames) override;
+    [[nodiscard]] bool StoreReadValues(std::wstring_view keyPath,
+                                       std::vector<RegTree::ValuePtr>& values) override;
+    bool StoreCreateKey(std::wstring_view keyPath) override;
+    void StoreSetValue(std::wstring_view keyPath,
+                       std::wstring_view valueName,
+                       DWORD type,
+                       const BYTE* data,
+                       size_t dataSize) override;
+    bool StoreDeleteValue(std::wstring_view keyPath, std::wstring_view valueName) override;
+    bool StoreDeleteTree(std::wstring_view keyPath) override;
+    [[nodiscard]] LSTATUS StoreDeleteKey(std::wstring_view keyPath) override;
+    [[nodiscard]] LSTATUS StoreRenameKey(std::wstring_view keyPath, std::wstring_view newKeyName) override;
+
+private:
+    RegVersionedTree m_tree;
+};
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for RegVersionedTree
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+
+// Is keyPath the same key as ancestorPath, or inside its subtree?
+[[nodiscard]] inline bool IsSameOrDescendantKeyPath(
+    const std::wstring_view keyPath,
+    const std::wstring_view ancestorPath
+) noexcept
+{
+    if (keyPath.size() < ancestorPath.size())
+    {
+        return false;
+    }
+
+    if (!EqualStrings(keyPath.substr(0, ancestorPath.size()), ancestorPath, StringComparison::IgnoreCase))
+    {
+        return false;
+    }
+
+    return (keyPath.size() == ancestorPath.size())
+        || ancestorPath.empty()
+        || (keyPath[ancestorPath.size()] == L'\\');
+}
+
+
+// Do two sets of changes from the same base tree touch a common key?
+// Value changes conflict if they are under the same key; added or deleted
+// keys conflict with any change in their subtree.
+[[nodiscard]] inline bool ChangesOverlap(
+    const std::vector<RegTree::Difference>& ourChanges,
+    const std::vector<RegTree::Difference>& theirChanges
+) noexcept
+{
+    auto isKeyChange = [](const RegTree::Difference& change) noexcept
+    {
+        return (change.DifferenceKind == RegTree::Difference::Kind::KeyAdded)
+            || (change.DifferenceKind == RegTree::Difference::Kind::KeyDeleted);
+    };
+
+    for (const RegTree::Difference& ours : ourChanges)
+    {
+        for (const RegTree::Difference& theirs : theirChanges)
+        {
+            if (EqualStrings(ours.KeyPath, theirs.KeyPath, StringComparison::IgnoreCase)
+                || (isKeyChange(ours) && IsSameOrDescendantKeyPath(theirs.KeyPath, ours.KeyPath))
+                || (isKeyChange(theirs) && IsSameOrDescendantKeyPath(ours.KeyPath, theirs.KeyPath)))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+// Add the given key (read from a source tree), with all its subtree, to target
+inline void CopyTreeNode(const RegTree::Node& node, std::wstring& keyPath, RegTree& target)
+{
+    target.CreateKey(keyPath);
+    for (const RegTree::ValuePtr& value : node.Values)
+    {
+        target.SetValue(keyPath, value->Name, value->Type, value->Data, value->DataSize);
+    }
+
+    const size_t parentPathLength = keyPath.size();
+    for (const RegTree::SubKeyEntry& subKey : node.SubKeys)
+    {
+        if (!keyPath.empty())
+        {
+            keyPath += L'\\';
+        }
+        keyPath += subKey.Name.View();
+
+        CopyTreeNode(*subKey.Key, keyPath, target);
+
+        keyPath.resize(parentPathLength);
+    }
+}
+
+
+// Apply to target the changes, as reported by RegTree::Diff, that lead to source
+inline void ApplyTreeChanges(
+    const RegTree& source,
+    const std::vector<RegTree::Difference>& changes,
+    RegTree& target
+)
+{
+    for (const RegTree::Difference& change : changes)
+    {
+        switch (change.DifferenceKind)
+        {
+        case RegTree::Difference::Kind::KeyAdded:
+            {
+                std::wstring keyPath = change.KeyPath;
+                CopyTreeNode(*source.FindKey(keyPath), keyPath, target);
+            }
+            break;
+
+        case RegTree::Difference::Kind::KeyDeleted:
+            target.DeleteTree(change.KeyPath);
+            break;
+
+        case RegTree::Difference::Kind::ValueAdded:
+        case RegTree::Difference::Kind::ValueChanged:
+            {
+                const RegTree::Value* const value = source.FindValue(change.KeyPath, change.ValueName);
+                target.SetValue(change.KeyPath, value->Name, value->Type, value->Data, value->DataSize);
+            }
+            break;
+
+        case RegTree::Difference::Kind::ValueDeleted:
+            target.DeleteValue(change.KeyPath, change.ValueName);
+            break;
+        }
+    }
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                      RegVersionedTree Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegVersionedTree::RegVersionedTree()
+    : RegVersionedTree{ RegTree{} }
+{}
+
+
+inline RegVersionedTree::RegVersionedTree(RegTree initialTree)
+    : m_current{ new Version{ std::move(initialTree), 0 } }
+{}
+
+
+inline RegVersionedTree::~RegVersionedTree()
+{
+    // The retired versions are deleted by m_retired
+    delete m_current.load();
+}
+
+
+template <typename ReadFunction>
+inline decltype(auto) RegVersionedTree::Read(ReadFunction&& read) const
+{
+    const details::EpochGuard epochGuard;
+    return read(static_cast<const RegTree&>(m_current.load()->Tree));
+}
+
+
+inline RegTree RegVersionedTree::Snapshot() const
+{
+    return Read([](const RegTree& tree) { return tree; });
+}
+
+
+inline std::uint64_t RegVersionedTree::CurrentVersion() const
+{
+    const details::EpochGuard epochGuard;
+    return m_current.load()->Number;
+}
+
+
+inline size_t RegVersionedTree::RetiredVersionCount() const
+{
+    return m_retired.Size();
+}
+
+
+inline bool RegVersionedTree::TryCommit(const RegTree& baseTree, const RegTree& newTree)
+{
+    if (baseTree.SharesRootWith(newTree))
+    {
+        // Nothing to publish
+        return true;
+    }
+
+    // The versions loaded into current are not deleted while this guard lives
+    const details::EpochGuard epochGuard;
+    const Version* current = m_current.load();
+
+    // Computed only if other writers published versions after baseTree
+    std::vector<RegTree::Difference> ourChanges;
+
+    for (;;)
+    {
+        RegTree tree = newTree;
+        if (!current->Tree.SharesRootWith(baseTree))
+        {
+            if (ourChanges.empty())
+            {
+                ourChanges = RegTree::Diff(baseTree, newTree);
+            }
+
+            const std::vector<RegTree::Difference> theirChanges = RegTree::Diff(baseTree, current->Tree);
+            if (details::ChangesOverlap(ourChanges, theirChanges))
+            {
+                return false;
+            }
+
+            // Rebase our changes on the current version
+            tree = current->Tree;
+            details::ApplyTreeChanges(newTree, ourChanges, tree);
+        }
+
+        // On failure, current is updated to the version published by another writer
+        if (CompareExchange(current, new Version{ std::move(tree), current->Number + 1 }))
+        {
+            return true;
+        }
+    }
+}
+
+
+template <typename UpdateFunction>
+inline std::uint64_t RegVersionedTree::Update(UpdateFunction&& update)
+{
+    // The versions loaded into current are not deleted while this guard lives
+    const details::EpochGuard epochGuard;
+    const Version* current = m_current.load();
+    for (;;)
+    {
+        RegTree tree = current->Tree;
+        update(tree);
+
+        if (tree.SharesRootWith(current->Tree))
+        {
+            // The update didn't change anything
+            return current->Number;
+        }
+
+        const std::uint64_t nextNumber = current->Number + 1;
+
+        // On failure, current is updated to the version published by another writer
+        if (CompareExchange(current, new Version{ std::move(tree), nextNumber }))
+        {
+            return nextNumber;
+        }
+    }
+}
+
+
+inline bool RegVersionedTree::CompareExchange(const Version*& expected, const Version* const next)
+{
+    // The caller's EpochGuard keeps expected alive, so it can't be deleted
+    // and reallocated at the same address meanwhile (no ABA problem)
+    const Version* const replaced = expected;
+    if (!m_current.compare_exchange_strong(expected, next))
+    {
+        delete next;
+        return false;
+    }
+
+    // The readers that entered before this point may still use the replaced version
+    m_retired.Retire(replaced);
+    m_retired.Reclaim();
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//                  RegVersionedTreeBackend Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegVersionedTreeBackend::RegVersionedTreeBackend(RegTree tree)
+    : m_tree{ std::move(tree) }
+{}
+
+
+inline RegTree RegVersionedTreeBackend::Snapshot() const
+{
+    return m_tree.Snapshot();
+}
+
+
+inline RegVersionedTree& RegVersionedTreeBackend::Tree() noexcept
+{
+    return m_tree;
+}
+
+
+inline bool RegVersionedTreeBackend::StoreContainsKey(const std::wstring_view keyPath)
+{
+    return m_tree.Read([keyPath](const RegTree& tree) { return tree.ContainsKey(keyPath); });
+}
+
+
+inline RegTree::ValuePtr RegVersionedTreeBackend::StoreFindValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName)
+{
+    return m_tree.Read([keyPath, valueName](const RegTree& tree) {
+        return details::FindTreeValue(tree, keyPath, valueName);
+    });
+}
+
+
+inline bool RegVersionedTreeBackend::StoreReadSubKeys(
+    const std::wstring_view keyPath,
+    std::vector<std::wstring>& subKeyNames)
+{
+    return m_tree.Read([keyPath, &subKeyNames](const RegTree& tree) {
+        return details::ReadTreeSubKeys(tree, keyPath, subKeyNames);
+    });
+}
+
+
+inline bool RegVersionedTreeBackend::StoreReadValues(
+    const std::wstring_view keyPath,
+    std::vector<RegTree::ValuePtr>& values)
+{
+    return m_tree.Read([keyPath, &values](const RegTree& tree) {
+        return details::ReadTreeValues(tree, keyPath, values);
+    });
+}
+
+
+// The results of the write operations are taken from the last run of the
+// update function, the one that got published
+
+inline bool RegVersionedTreeBackend::StoreCreateKey(const std::wstring_view keyPath)
+{
+    bool created = false;
+    m_tree.Update([keyPath, &created](RegTree& tree) { created = details::CreateTreeKey(tree, keyPath); });
+    return created;
+}
+
+
+inline void RegVersionedTreeBackend::StoreSetValue(
+    const std::wstring_view keyPath,
+    const std::wstring_view valueName,
+    const DWORD type,
+    const BYTE* const data,
+    const size_t dataSize)
+{
+    m_tree.Update([&](RegTree& tree) { tree.SetValue(keyPath, valueName, type, data, dataSize); });
+}
+
+
+inline bool RegVersionedTreeBackend::StoreDeleteValue(const std::wstring_view keyPath, const std::wstring_view valueName)
+{
+    bool deleted = false;
+    m_tree.Update([&](RegTree& tree) { deleted = tree.DeleteValue(keyPath, valueName); });
+    return deleted;
+}
+
+
+inline bool RegVersionedTreeBackend::StoreDeleteTree(const std::wstring_view keyPath)
+{
+    bool deleted = false;
+    m_tree.Update([&](RegTree& tree) { deleted = tree.DeleteTree(keyPath); });
+    return deleted;
+}
+
+
+inline LSTATUS RegVersionedTreeBackend::StoreDeleteKey(const std::wstring_view keyPath)
+{
+    LSTATUS retCode = ERROR_SUCCESS;
+    m_tree.Update([&](RegTree& tree) { retCode = details::DeleteTreeKey(tree, keyPath); });
+    return retCode;
+}
+
+
+inline LSTATUS RegVersionedTreeBackend::StoreRenameKey(const std::wstring_view keyPath, const std::wstring_view newKeyName)
+{
+    LSTATUS retCode = ERROR_SUCCESS;
+    m_tree.Update([&](RegTree& tree) { retCode = details::RenameTreeKey(tree, keyPath, newKeyName); });
+    return retCode;
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_REGVERSIONEDTREE_HPP_INCLUDED
@@ -9,7 +9,7 @@
 //               Copyright (C) by Giovanni Dicanio
 //
 // First version: 2017, January 22nd
-// Last update:   2024, November 6th
+// Last update:   2026, October 18th
 //
 // E-mail: <first name>.<last name> AT REMOVE_THIS gmail.com
 //
@@ -65,14 +65,31 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 
+#ifdef _WIN32
 #include <Windows.h>        // Windows Platform SDK
 #include <crtdbg.h>         // _ASSERTE
-
+#else // _WIN32
+#include "WinRegPosix.hpp"  // The Windows API subset used here, on POSIX systems
+#endif // _WIN32
+
+#include <algorithm>        // std::sort, std::lower_bound, std::upper_bound
+#include <array>            // std::array
+#include <atomic>           // std::atomic
+#include <chrono>           // std::chrono::steady_clock
+#include <cstdint>          // std::uint32_t, std::uint64_t
+#include <cstring>          // std::memcpy
+#include <functional>       // std::function
 #include <limits>           // std::numeric_limits
 #include <memory>           // std::unique_ptr, std::make_unique
+#include <mutex>            // std::mutex, std::lock_guard
+#include <new>              // std::bad_alloc
+#include <shared_mutex>     // std::shared_mutex, std::shared_lock
 #include <stdexcept>        // std::overflow_error
 #include <string>           // std::wstring
+#include <string_view>      // std::wstring_view
 #include <system_error>     // std::system_error
+#include <type_traits>      // std::is_trivially_copyable_v, std::is_nothrow_invocable_v
+#include <unordered_map>    // std::unordered_map
 #include <utility>          // std::swap, std::pair, std::move
 #include <variant>          // std::variant
 #include <vector>           // std::vector
@@ -91,6 +108,88 @@ class RegResult;
 template <typename T>
 class RegExpected;
 
+struct RegValueView;
+struct RegDeleteValuesResult;
+
+class RegCancellationToken;
+class RegBackend;
+class RegBackendScope;
+class RegTrace;
+class RegAllocationStats;
+
+class RegMultiStringSet;
+
+template <typename T>
+class RegBinaryArray;
+
+class RegNameList;
+class RegNamePool;
+
+
+//
+// Options
+//
+
+// How strings are compared by the APIs that search string data
+// (e.g. RegMultiStringSet)
+enum class StringComparison
+{
+    CaseSensitive,
+    IgnoreCase
+};
+
+// How the validating string getters (e.g. RegKey::GetStringValue taking
+// a RegStringValidation) handle data that isn't well-formed UTF-16:
+// unpaired surrogates, and NULs embedded in a REG_SZ or REG_EXPAND_SZ value.
+// With any mode but None, the returned strings are valid UTF-16 without NULs.
+enum class RegStringValidation
+{
+    None,           // return the data as stored
+    Reject,         // fail with ERROR_INVALID_DATA
+    Replace,        // replace each invalid wchar_t with U+FFFD
+    TruncateAtNul   // cut the string at the first embedded NUL, and replace
+                    // unpaired surrogates with U+FFFD (like Replace for REG_MULTI_SZ,
+                    // where NUL is the separator)
+};
+
+// Options for the in-place REG_MULTI_SZ edit methods
+// (e.g. RegKey::AppendToMultiString)
+struct MultiStringEditOptions
+{
+    // How strings are matched against the existing ones
+    StringComparison Comparison = StringComparison::CaseSensitive;
+
+    // Avoid storing duplicates: AppendToMultiString skips strings that are
+    // already present, and ReplaceInMultiString doesn't replace an entry
+    // with a string that is already present (the entry is removed instead)
+    bool Dedupe = false;
+
+    // Re-read the value just before writing it back, and restart the edit
+    // from the fresh data if another writer changed it in the meantime.
+    // Note that the registry has no compare-and-swap primitive, so this
+    // narrows, but cannot close, the window for lost updates.
+    bool DetectConcurrentChanges = false;
+
+    // Maximum number of restarts when DetectConcurrentChanges is true;
+    // when exhausted, the edit fails with ERROR_RETRY
+    int MaxRetries = 3;
+};
+
+// Limits for long-running operations (e.g. the RegKey::DeleteTree overload
+// taking limits), checked before each registry call.
+// When the token is cancelled, the operation stops with ERROR_CANCELLED;
+// when the deadline has passed, it stops with ERROR_TIMEOUT
+// (see RegResult::IsCancelled and RegResult::IsTimedOut).
+// A registry call already in progress is not interrupted.
+struct RegOperationLimits
+{
+    // Optional cancellation token (not owned: it must outlive the operation)
+    const RegCancellationToken* Cancellation = nullptr;
+
+    // Optional deadline; the default value means no deadline
+    std::chrono::steady_clock::time_point Deadline = (std::chrono::steady_clock::time_point::max)();
+};
+
 
 //
 // Class Declarations
@@ -322,6 +421,64 @@ public:
                                               DWORD dataSize) noexcept;
 
 
+    //
+    // Path-Addressed Registry Value Setters
+    //
+    // Write a value under a subkey of this key, passing the subkey path
+    // to RegSetKeyValue instead of opening the subkey first.
+    // The subkey is created if it doesn't exist.
+    //
+
+    void SetDwordValue(const std::wstring& subKey, const std::wstring& valueName, DWORD data);
+    void SetQwordValue(const std::wstring& subKey, const std::wstring& valueName, const ULONGLONG& data);
+    void SetStringValue(const std::wstring& subKey, const std::wstring& valueName, const std::wstring& data);
+    void SetExpandStringValue(const std::wstring& subKey, const std::wstring& valueName, const std::wstring& data);
+    void SetMultiStringValue(const std::wstring& subKey, const std::wstring& valueName,
+                             const std::vector<std::wstring>& data);
+    void SetBinaryValue(const std::wstring& subKey, const std::wstring& valueName, const std::vector<BYTE>& data);
+
+    [[nodiscard]] RegResult TrySetDwordValue(const std::wstring& subKey,
+                                             const std::wstring& valueName,
+                                             DWORD data) noexcept;
+    [[nodiscard]] RegResult TrySetQwordValue(const std::wstring& subKey,
+                                             const std::wstring& valueName,
+                                             const ULONGLONG& data) noexcept;
+    [[nodiscard]] RegResult TrySetStringValue(const std::wstring& subKey,
+                                              const std::wstring& valueName,
+                                              const std::wstring& data);
+    [[nodiscard]] RegResult TrySetExpandStringValue(const std::wstring& subKey,
+                                                    const std::wstring& valueName,
+                                                    const std::wstring& data);
+    [[nodiscard]] RegResult TrySetMultiStringValue(const std::wstring& subKey,
+                                                   const std::wstring& valueName,
+                                                   const std::vector<std::wstring>& data);
+    [[nodiscard]] RegResult TrySetBinaryValue(const std::wstring& subKey,
+                                              const std::wstring& valueName,
+                                              const std::vector<BYTE>& data);
+
+
+    //
+    // Typed REG_BINARY Setters
+    //
+    // Write an array of fixed-size records (trivially copyable type T)
+    // directly from the caller's memory, without intermediate copies.
+    //
+
+    template <typename T>
+    void SetBinaryValueAs(const std::wstring& valueName, const T* data, size_t count);
+
+    template <typename T>
+    void SetBinaryValueAs(const std::wstring& valueName, const std::vector<T>& data);
+
+    template <typename T>
+    void SetBinaryValueAs(const std::wstring& valueName, const RegBinaryArray<T>& data);
+
+    template <typename T>
+    [[nodiscard]] RegResult TrySetBinaryValueAs(const std::wstring& valueName,
+                                                const T* data,
+                                                size_t count);
+
+
     //
     // Registry Value Getters
     //
@@ -366,6 +523,199 @@ public:
             TryGetBinaryValue(const std::wstring& valueName) const;
 
 
+    //
+    // Registry Value Getters with Defaults
+    //
+    // Return defaultValue if the value doesn't exist (ERROR_FILE_NOT_FOUND),
+    // without throwing or allocating on that path; throw RegException
+    // on other errors (e.g. a value of another type).
+    //
+
+    [[nodiscard]] DWORD GetDwordValueOr(const std::wstring& valueName, DWORD defaultValue) const;
+    [[nodiscard]] ULONGLONG GetQwordValueOr(const std::wstring& valueName, ULONGLONG defaultValue) const;
+    [[nodiscard]] std::wstring GetStringValueOr(const std::wstring& valueName, std::wstring defaultValue) const;
+
+    [[nodiscard]] std::wstring GetExpandStringValueOr(
+        const std::wstring& valueName,
+        std::wstring defaultValue,
+        ExpandStringOption expandOption = ExpandStringOption::DontExpand
+    ) const;
+
+    [[nodiscard]] std::vector<std::wstring> GetMultiStringValueOr(
+        const std::wstring& valueName,
+        std::vector<std::wstring> defaultValue
+    ) const;
+
+    [[nodiscard]] std::vector<BYTE> GetBinaryValueOr(
+        const std::wstring& valueName,
+        std::vector<BYTE> defaultValue
+    ) const;
+
+    // Generic form, for T = DWORD, ULONGLONG, std::wstring (REG_SZ),
+    // std::vector<std::wstring> or std::vector<BYTE>
+    template <typename T>
+    [[nodiscard]] T GetValueOr(const std::wstring& valueName, T defaultValue) const;
+
+
+    //
+    // Validating String Getters
+    //
+    // Check that the string data is well-formed UTF-16, and reject or repair
+    // it according to the RegStringValidation mode.
+    //
+
+    [[nodiscard]] std::wstring GetStringValue(
+        const std::wstring& valueName,
+        RegStringValidation validation
+    ) const;
+
+    [[nodiscard]] std::wstring GetExpandStringValue(
+        const std::wstring& valueName,
+        ExpandStringOption expandOption,
+        RegStringValidation validation
+    ) const;
+
+    [[nodiscard]] std::vector<std::wstring> GetMultiStringValue(
+        const std::wstring& valueName,
+        RegStringValidation validation
+    ) const;
+
+    [[nodiscard]] RegExpected<std::wstring> TryGetStringValue(
+        const std::wstring& valueName,
+        RegStringValidation validation
+    ) const;
+
+    [[nodiscard]] RegExpected<std::wstring> TryGetExpandStringValue(
+        const std::wstring& valueName,
+        ExpandStringOption expandOption,
+        RegStringValidation validation
+    ) const;
+
+    [[nodiscard]] RegExpected<std::vector<std::wstring>> TryGetMultiStringValue(
+        const std::wstring& valueName,
+        RegStringValidation validation
+    ) const;
+
+
+    //
+    // Path-Addressed Registry Value Getters
+    //
+    // Read a value under a subkey of this key, with a single RegGetValue call
+    // that receives the subkey path, instead of opening the subkey first.
+    //
+
+    [[nodiscard]] DWORD GetDwordValue(const std::wstring& subKey, const std::wstring& valueName) const;
+    [[nodiscard]] ULONGLONG GetQwordValue(const std::wstring& subKey, const std::wstring& valueName) const;
+    [[nodiscard]] std::wstring GetStringValue(const std::wstring& subKey, const std::wstring& valueName) const;
+
+    [[nodiscard]] std::wstring GetExpandStringValue(
+        const std::wstring& subKey,
+        const std::wstring& valueName,
+        ExpandStringOption expandOption = ExpandStringOption::DontExpand
+    ) const;
+
+    [[nodiscard]] std::vector<std::wstring> GetMultiStringValue(const std::wstring& subKey,
+                                                                const std::wstring& valueName) const;
+    [[nodiscard]] std::vector<BYTE> GetBinaryValue(const std::wstring& subKey,
+                                                   const std::wstring& valueName) const;
+
+    [[nodiscard]] RegExpected<DWORD> TryGetDwordValue(const std::wstring& subKey,
+                                                      const std::wstring& valueName) const;
+    [[nodiscard]] RegExpected<ULONGLONG> TryGetQwordValue(const std::wstring& subKey,
+                                                          const std::wstring& valueName) const;
+    [[nodiscard]] RegExpected<std::wstring> TryGetStringValue(const std::wstring& subKey,
+                                                              const std::wstring& valueName) const;
+
+    [[nodiscard]] RegExpected<std::wstring> TryGetExpandStringValue(
+        const std::wstring& subKey,
+        const std::wstring& valueName,
+        ExpandStringOption expandOption = ExpandStringOption::DontExpand
+    ) const;
+
+    [[nodiscard]] RegExpected<std::vector<std::wstring>>
+            TryGetMultiStringValue(const std::wstring& subKey, const std::wstring& valueName) const;
+
+    [[nodiscard]] RegExpected<std::vector<BYTE>>
+            TryGetBinaryValue(const std::wstring& subKey, const std::wstring& valueName) const;
+
+
+    //
+    // Typed REG_BINARY Getters
+    //
+    // Read REG_BINARY data storing an array of fixed-size records
+    // (trivially copyable type T) directly into a properly aligned array of T.
+    // The data size must be a multiple of sizeof(T), else ERROR_INVALID_DATA
+    // is signaled.
+    //
+
+    template <typename T>
+    [[nodiscard]] RegBinaryArray<T> GetBinaryValueAs(const std::wstring& valueName) const;
+
+    template <typename T>
+    [[nodiscard]] RegExpected<RegBinaryArray<T>>
+            TryGetBinaryValueAs(const std::wstring& valueName) const;
+
+
+    //
+    // In-Place REG_MULTI_SZ Edits
+    //
+    // These methods read the raw double-NUL-terminated data once, edit it in place
+    // (without parsing it into separate wstrings), and write it back once.
+    // No write happens if the edit doesn't change anything.
+    //
+
+    // Append a string to the multi-string value,
+    // creating the value if it doesn't exist.
+    // Return false if the string was already present and options.Dedupe is set.
+    //
+    // Empty strings can be appended and used as replacements, like
+    // SetMultiStringValue stores them; but an edit leaving just one empty
+    // string fails with ERROR_INVALID_PARAMETER, as that multi-string would
+    // be stored exactly like the empty one.
+    bool AppendToMultiString(
+        const std::wstring& valueName,
+        std::wstring_view s,
+        const MultiStringEditOptions& options = MultiStringEditOptions{}
+    );
+
+    // Remove all the occurrences of a string from the multi-string value.
+    // Return the number of strings removed.
+    size_t RemoveFromMultiString(
+        const std::wstring& valueName,
+        std::wstring_view s,
+        const MultiStringEditOptions& options = MultiStringEditOptions{}
+    );
+
+    // Replace all the occurrences of oldString with newString
+    // in the multi-string value.
+    // Return the number of strings replaced.
+    size_t ReplaceInMultiString(
+        const std::wstring& valueName,
+        std::wstring_view oldString,
+        std::wstring_view newString,
+        const MultiStringEditOptions& options = MultiStringEditOptions{}
+    );
+
+    [[nodiscard]] RegExpected<bool> TryAppendToMultiString(
+        const std::wstring& valueName,
+        std::wstring_view s,
+        const MultiStringEditOptions& options = MultiStringEditOptions{}
+    );
+
+    [[nodiscard]] RegExpected<size_t> TryRemoveFromMultiString(
+        const std::wstring& valueName,
+        std::wstring_view s,
+        const MultiStringEditOptions& options = MultiStringEditOptions{}
+    );
+
+    [[nodiscard]] RegExpected<size_t> TryReplaceInMultiString(
+        const std::wstring& valueName,
+        std::wstring_view oldString,
+        std::wstring_view newString,
+        const MultiStringEditOptions& options = MultiStringEditOptions{}
+    );
+
+
     //
     // Query Operations
     //
@@ -417,6 +767,26 @@ public:
     // the DWORD is the value type.
     [[nodiscard]] std::vector<std::pair<std::wstring, DWORD>> EnumValues() const;
 
+    // Enumerate the subkeys of the registry key into a flat name list.
+    // The list is cleared first; its buffers are reused across calls.
+    void EnumSubKeys(RegNameList& subKeyNames) const;
+
+    // Enumerate the values under the registry key into a flat name list,
+    // that stores the value types as well.
+    // The list is cleared first; its buffers are reused across calls.
+    void EnumValues(RegNameList& valueNames) const;
+
+    // Enumerate the subkeys of the registry key, interning their names in
+    // the given pool (so names repeated across keys are stored only once).
+    // The returned views are valid as long as the pool; as the pool is
+    // case-insensitive, a name may be reported with the case it was first
+    // interned with. Include RegNamePool.hpp to call the RegNamePool overloads.
+    [[nodiscard]] std::vector<std::wstring_view> EnumSubKeys(RegNamePool& namePool) const;
+
+    // Enumerate the values under the registry key, interning their names in
+    // the given pool; the returned views are valid as long as the pool.
+    [[nodiscard]] std::vector<std::pair<std::wstring_view, DWORD>> EnumValues(RegNamePool& namePool) const;
+
     // Check if the current key contains the specified value
     [[nodiscard]] bool ContainsValue(const std::wstring& valueName) const;
 
@@ -447,6 +817,19 @@ public:
     // the DWORD is the value type.
     [[nodiscard]] RegExpected<std::vector<std::pair<std::wstring, DWORD>>> TryEnumValues() const;
 
+    // Enumerate the subkeys of the registry key into a flat name list
+    [[nodiscard]] RegResult TryEnumSubKeys(RegNameList& subKeyNames) const;
+
+    // Enumerate the values under the registry key into a flat name list
+    [[nodiscard]] RegResult TryEnumValues(RegNameList& valueNames) const;
+
+    // Enumerate the subkeys of the registry key, interning their names in the given pool
+    [[nodiscard]] RegExpected<std::vector<std::wstring_view>> TryEnumSubKeys(RegNamePool& namePool) const;
+
+    // Enumerate the values under the registry key, interning their names in the given pool
+    [[nodiscard]] RegExpected<std::vector<std::pair<std::wstring_view, DWORD>>>
+            TryEnumValues(RegNamePool& namePool) const;
+
     // Check if the current key contains the specified value
     [[nodiscard]] RegExpected<bool> TryContainsValue(const std::wstring& valueName) const;
 
@@ -462,6 +845,9 @@ public:
     void DeleteKey(const std::wstring& subKey, REGSAM desiredAccess);
     void DeleteTree(const std::wstring& subKey);
     void CopyTree(const std::wstring& sourceSubKey, const RegKey& destKey);
+    void RenameKey(const std::wstring& subKey, const std::wstring& newKeyName);
+    void MoveKey(const std::wstring& sourceSubKey, const RegKey& destKey, const std::wstring& destSubKey,
+                 REGSAM registryView = KEY_WOW64_64KEY);
     void FlushKey();
     void LoadKey(const std::wstring& subKey, const std::wstring& filename);
     void SaveKey(const std::wstring& filename, SECURITY_ATTRIBUTES* securityAttributes) const;
@@ -482,6 +868,28 @@ public:
     [[nodiscard]] RegResult TryCopyTree(const std::wstring& sourceSubKey,
                                         const RegKey& destKey) noexcept;
 
+    // Rename a subkey, keeping it under the same parent (newKeyName is
+    // a name, not a path), with a single RegRenameKey call
+    [[nodiscard]] RegResult TryRenameKey(const std::wstring& subKey,
+                                         const std::wstring& newKeyName) noexcept;
+
+    // Move a subkey, with all its subtree, to destKey\destSubKey.
+    // When the destination has the same parent (destKey is this key, and
+    // the two paths differ only in their last component), the key is just
+    // renamed; otherwise the subtree is copied with RegCopyTree and then
+    // the source is deleted. If the copy fails, the partial copy and the
+    // parent keys created for it are removed; if deleting the source fails,
+    // the deleted part is copied back from the destination, that is then
+    // removed (it is kept if copying back fails, being the only complete copy).
+    // The keys are opened and created in the given registry view.
+    // Fails with ERROR_ALREADY_EXISTS if the destination key already exists,
+    // and with ERROR_INVALID_PARAMETER if it is inside the source subtree
+    // (also when destKey is another handle to a key of that subtree).
+    [[nodiscard]] RegResult TryMoveKey(const std::wstring& sourceSubKey,
+                                       const RegKey& destKey,
+                                       const std::wstring& destSubKey,
+                                       REGSAM registryView = KEY_WOW64_64KEY) noexcept;
+
     [[nodiscard]] RegResult TryFlushKey() noexcept;
 
     [[nodiscard]] RegResult TryLoadKey(const std::wstring& subKey,
@@ -497,6 +905,79 @@ public:
                                                HKEY hKeyPredefined) noexcept;
 
 
+    //
+    // Long-Running Operations with Cancellation and Deadline
+    //
+    // These overloads check the limits before each registry call, and stop
+    // with ERROR_CANCELLED or ERROR_TIMEOUT (see RegOperationLimits).
+    // DeleteTree and CopyTree walk the subtree one key at a time, instead of
+    // calling RegDeleteTree or RegCopyTree (that can't be interrupted);
+    // the subkeys are opened in the given registry view: KEY_WOW64_64KEY
+    // (the default, like for the RegKey constructors), KEY_WOW64_32KEY,
+    // or 0 for the default view of the process.
+    // When they stop, the work already done is not rolled back.
+    // The Try overloads don't throw: a failed allocation is reported
+    // as ERROR_NOT_ENOUGH_MEMORY.
+    //
+
+    [[nodiscard]] std::vector<std::wstring> EnumSubKeys(const RegOperationLimits& limits) const;
+    [[nodiscard]] std::vector<std::pair<std::wstring, DWORD>> EnumValues(const RegOperationLimits& limits) const;
+    void EnumSubKeys(RegNameList& subKeyNames, const RegOperationLimits& limits) const;
+    void EnumValues(RegNameList& valueNames, const RegOperationLimits& limits) const;
+    void DeleteTree(const std::wstring& subKey, const RegOperationLimits& limits,
+                    REGSAM registryView = KEY_WOW64_64KEY);
+    void CopyTree(const std::wstring& sourceSubKey, const RegKey& destKey, const RegOperationLimits& limits,
+                  REGSAM registryView = KEY_WOW64_64KEY);
+
+    [[nodiscard]] RegExpected<std::vector<std::wstring>>
+            TryEnumSubKeys(const RegOperationLimits& limits) const noexcept;
+
+    [[nodiscard]] RegExpected<std::vector<std::pair<std::wstring, DWORD>>>
+            TryEnumValues(const RegOperationLimits& limits) const noexcept;
+
+    [[nodiscard]] RegResult TryEnumSubKeys(RegNameList& subKeyNames,
+                                           const RegOperationLimits& limits) const noexcept;
+
+    [[nodiscard]] RegResult TryEnumValues(RegNameList& valueNames,
+                                          const RegOperationLimits& limits) const noexcept;
+
+    [[nodiscard]] RegResult TryDeleteTree(const std::wstring& subKey,
+                                          const RegOperationLimits& limits,
+                                          REGSAM registryView = KEY_WOW64_64KEY) noexcept;
+
+    [[nodiscard]] RegResult TryCopyTree(const std::wstring& sourceSubKey,
+                                        const RegKey& destKey,
+                                        const RegOperationLimits& limits,
+                                        REGSAM registryView = KEY_WOW64_64KEY) noexcept;
+
+
+    //
+    // Batch Value Deletion
+    //
+    // The values are deleted back to back, one RegDeleteValue call each.
+    // A value that can't be deleted (e.g. ERROR_FILE_NOT_FOUND, if it
+    // doesn't exist) is reported in the returned result, and doesn't stop
+    // the deletion of the other values.
+    //
+
+    RegDeleteValuesResult DeleteValues(const std::vector<std::wstring>& valueNames);
+    RegDeleteValuesResult DeleteValues(const RegNameList& valueNames);
+
+    // Delete the values for which predicate(const RegValueView&) returns true.
+    // Names, types and data are read in a single enumeration pass, the names
+    // of the matching values are collected into a RegNameList, and then
+    // deleted after the enumeration completes.
+    // Throws RegException if the enumeration fails.
+    // TryDeleteValuesIf reports a failed allocation as ERROR_NOT_ENOUGH_MEMORY,
+    // and is noexcept when the predicate is.
+    template <typename Predicate>
+    RegDeleteValuesResult DeleteValuesIf(Predicate&& predicate);
+
+    template <typename Predicate>
+    [[nodiscard]] RegExpected<RegDeleteValuesResult> TryDeleteValuesIf(Predicate&& predicate)
+        noexcept(std::is_nothrow_invocable_v<Predicate&, const RegValueView&>);
+
+
     // Return a string representation of Windows registry types
     [[nodiscard]] static std::wstring RegTypeToString(DWORD regType);
 
@@ -554,6 +1035,12 @@ public:
     // Get the wrapped Win32 code
     [[nodiscard]] LSTATUS Code() const noexcept;
 
+    // Was the operation stopped by its cancellation token (ERROR_CANCELLED)?
+    [[nodiscard]] bool IsCancelled() const noexcept;
+
+    // Was the operation stopped by its deadline (ERROR_TIMEOUT)?
+    [[nodiscard]] bool IsTimedOut() const noexcept;
+
     // Return the system error message associated to the current error code
     [[nodiscard]] std::wstring ErrorMessage() const;
 
@@ -597,7 +1084,10 @@ public:
 
     // Access the value (if the object contains a valid value).
     // Throws an exception if the object is in invalid state.
-    [[nodiscard]] const T& GetValue() const;
+    [[nodiscard]] const T& GetValue() const &;
+
+    // Move the value out of an expiring object, e.g. std::move(x).GetValue()
+    [[nodiscard]] T&& GetValue() &&;
 
     // Access the error code (if the object contains an error status)
     // Throws an exception if the object is in valid state.
@@ -612,652 +1102,4175 @@ private:
 
 
 //------------------------------------------------------------------------------
-//          Overloads of relational comparison operators for RegKey
+// A registry value passed to the predicate of RegKey::DeleteValuesIf.
+// The name and the data refer to the enumeration buffers, so they are valid
+// only during the predicate call.
 //------------------------------------------------------------------------------
-
-inline bool operator==(const RegKey& a, const RegKey& b) noexcept
-{
-    return a.Get() == b.Get();
-}
-
-inline bool operator!=(const RegKey& a, const RegKey& b) noexcept
+struct RegValueView
 {
-    return a.Get() != b.Get();
-}
+    std::wstring_view Name;
+    DWORD             Type{ REG_NONE };
+    const BYTE*       Data{ nullptr };
+    DWORD             DataSize{ 0 };    // in bytes
+};
 
-inline bool operator<(const RegKey& a, const RegKey& b) noexcept
-{
-    return a.Get() < b.Get();
-}
 
-inline bool operator<=(const RegKey& a, const RegKey& b) noexcept
+//------------------------------------------------------------------------------
+// The outcome of the batch value deletion methods (e.g. RegKey::DeleteValues)
+//------------------------------------------------------------------------------
+struct RegDeleteValuesResult
 {
-    return a.Get() <= b.Get();
-}
+    // Number of values successfully deleted
+    size_t DeletedCount{ 0 };
 
-inline bool operator>(const RegKey& a, const RegKey& b) noexcept
-{
-    return a.Get() > b.Get();
-}
+    // The values that could not be deleted, each one with its error
+    std::vector<std::pair<std::wstring, RegResult>> Failures;
 
-inline bool operator>=(const RegKey& a, const RegKey& b) noexcept
-{
-    return a.Get() >= b.Get();
-}
+    // Were all the requested values deleted?
+    [[nodiscard]] bool AllDeleted() const noexcept;
+};
 
 
 //------------------------------------------------------------------------------
-//                  Private Helper Classes and Functions
+// A cancellation flag for long-running operations (see RegOperationLimits).
+//
+// Cancel can be called from any thread; the operations checking the token
+// stop before their next registry call.
+//
+// This class is neither copyable nor movable (operations refer to it
+// by address).
 //------------------------------------------------------------------------------
-
-namespace details
+class RegCancellationToken
 {
+public:
+
+    // Initialize as not cancelled
+    RegCancellationToken() noexcept = default;
+
+    RegCancellationToken(const RegCancellationToken&) = delete;
+    RegCancellationToken& operator=(const RegCancellationToken&) = delete;
+
+    // Request the cancellation of the operations checking this token
+    void Cancel() noexcept;
+
+    // Clear the cancellation request, to reuse the token
+    void Reset() noexcept;
+
+    // Was cancellation requested?
+    [[nodiscard]] bool IsCancelled() const noexcept;
+
+private:
+    std::atomic<bool> m_cancelled{ false };
+};
+
 
 //------------------------------------------------------------------------------
-// Simple scoped-based RAII wrapper that *automatically* invokes LocalFree()
-// in its destructor.
+// A registry backend: an implementation of the Windows Registry API functions
+// called by WinReg, that can stand in for the Windows registry (e.g. an
+// in-memory store, see RegMemoryBackend.hpp).
+//
+// While a backend is installed (with SetCurrent, or RegBackendScope), all the
+// registry calls made through RegKey and the other WinReg classes, from any
+// thread, go to the backend instead of the Windows registry. The HKEY handles
+// are then the backend's own ones (the predefined keys, like HKEY_CURRENT_USER,
+// excepted): keys opened before a backend is installed must be closed before
+// it is changed.
+//
+// Each method takes the parameters of the Windows Registry API function with
+// the same name (e.g. OpenKeyEx is RegOpenKeyExW), and returns the same error
+// codes; methods must be thread-safe, and must not throw.
+// The optional methods fail with ERROR_NOT_SUPPORTED, unless overridden.
 //------------------------------------------------------------------------------
-template <typename T>
-class ScopedLocalFree
+class RegBackend
 {
 public:
 
-    typedef T  Type;
-    typedef T* TypePtr;
+    RegBackend() noexcept = default;
+    virtual ~RegBackend() = default;
 
+    // Ban copy and move (an installed backend is referenced by address)
+    RegBackend(const RegBackend&) = delete;
+    RegBackend& operator=(const RegBackend&) = delete;
 
-    // Init wrapped pointer to nullptr
-    ScopedLocalFree() noexcept = default;
+    // Install the given backend for the whole process (nullptr goes back to
+    // the Windows registry), and return the previously installed one.
+    // The backend must stay alive while installed.
+    static RegBackend* SetCurrent(RegBackend* backend) noexcept;
+
+    // Return the installed backend, or nullptr if none is
+    [[nodiscard]] static RegBackend* Current() noexcept;
 
-    // Automatically and safely invoke ::LocalFree()
-    ~ScopedLocalFree() noexcept
-    {
-        Free();
-    }
 
     //
-    // Ban copy and move operations
+    // Required methods
     //
-    ScopedLocalFree(const ScopedLocalFree&) = delete;
-    ScopedLocalFree(ScopedLocalFree&&) = delete;
-    ScopedLocalFree& operator=(const ScopedLocalFree&) = delete;
-    ScopedLocalFree& operator=(ScopedLocalFree&&) = delete;
 
+    virtual LSTATUS OpenKeyEx(HKEY hKey, LPCWSTR subKey, DWORD options, REGSAM desiredAccess,
+                              PHKEY result) noexcept = 0;
 
-    // Read-only access to the wrapped pointer
-    [[nodiscard]] T* Get() const noexcept
-    {
-        return m_ptr;
-    }
+    virtual LSTATUS CreateKeyEx(HKEY hKey, LPCWSTR subKey, DWORD reserved, LPWSTR keyClass,
+                                DWORD options, REGSAM desiredAccess,
+                                SECURITY_ATTRIBUTES* securityAttributes,
+                                PHKEY result, LPDWORD disposition) noexcept = 0;
 
-    // Writable access to the wrapped pointer
-    [[nodiscard]] T** AddressOf() noexcept
-    {
-        return &m_ptr;
-    }
+    virtual LSTATUS CloseKey(HKEY hKey) noexcept = 0;
 
-    // Explicit pointer conversion to bool
-    explicit operator bool() const noexcept
-    {
-        return (m_ptr != nullptr);
-    }
+    virtual LSTATUS GetValue(HKEY hKey, LPCWSTR subKey, LPCWSTR valueName, DWORD flags,
+                             LPDWORD type, void* data, LPDWORD dataSize) noexcept = 0;
 
-    // Safely invoke ::LocalFree() on the wrapped pointer
-    void Free() noexcept
-    {
-        if (m_ptr != nullptr)
-        {
-            ::LocalFree(m_ptr);
-            m_ptr = nullptr;
-        }
-    }
+    virtual LSTATUS QueryValueEx(HKEY hKey, LPCWSTR valueName, LPDWORD reserved, LPDWORD type,
+                                 BYTE* data, LPDWORD dataSize) noexcept = 0;
+
+    virtual LSTATUS SetValueEx(HKEY hKey, LPCWSTR valueName, DWORD reserved, DWORD type,
+                               const BYTE* data, DWORD dataSize) noexcept = 0;
+
+    virtual LSTATUS QueryInfoKey(HKEY hKey, LPWSTR keyClass, LPDWORD keyClassLength,
+                                 LPDWORD reserved, LPDWORD subKeyCount,
+                                 LPDWORD maxSubKeyNameLength, LPDWORD maxClassLength,
+                                 LPDWORD valueCount, LPDWORD maxValueNameLength,
+                                 LPDWORD maxValueDataLength, LPDWORD securityDescriptorSize,
+                                 FILETIME* lastWriteTime) noexcept = 0;
+
+    virtual LSTATUS EnumKeyEx(HKEY hKey, DWORD index, LPWSTR name, LPDWORD nameLength,
+                              LPDWORD reserved, LPWSTR keyClass, LPDWORD keyClassLength,
+                              FILETIME* lastWriteTime) noexcept = 0;
+
+    virtual LSTATUS EnumValue(HKEY hKey, DWORD index, LPWSTR valueName, LPDWORD valueNameLength,
+                              LPDWORD reserved, LPDWORD type, BYTE* data,
+                              LPDWORD dataSize) noexcept = 0;
+
+    virtual LSTATUS DeleteValue(HKEY hKey, LPCWSTR valueName) noexcept = 0;
+
+    virtual LSTATUS DeleteKeyEx(HKEY hKey, LPCWSTR subKey, REGSAM desiredAccess,
+                                DWORD reserved) noexcept = 0;
+
+    virtual LSTATUS DeleteTree(HKEY hKey, LPCWSTR subKey) noexcept = 0;
 
 
     //
-    // IMPLEMENTATION
+    // Optional methods
     //
+
+    virtual LSTATUS ConnectRegistry(LPCWSTR machineName, HKEY hKey, PHKEY result) noexcept;
+
+    // By default, creates the subkey, sets the value and closes the subkey
+    virtual LSTATUS SetKeyValue(HKEY hKey, LPCWSTR subKey, LPCWSTR valueName, DWORD type,
+                                const void* data, DWORD dataSize) noexcept;
+
+    virtual LSTATUS CopyTree(HKEY hKeySource, LPCWSTR subKey, HKEY hKeyDest) noexcept;
+    virtual LSTATUS RenameKey(HKEY hKey, LPCWSTR subKey, LPCWSTR newKeyName) noexcept;
+
+    // By default, succeeds (there is nothing to flush)
+    virtual LSTATUS FlushKey(HKEY hKey) noexcept;
+
+    virtual LSTATUS LoadKey(HKEY hKey, LPCWSTR subKey, LPCWSTR fileName) noexcept;
+    virtual LSTATUS SaveKey(HKEY hKey, LPCWSTR fileName,
+                            SECURITY_ATTRIBUTES* securityAttributes) noexcept;
+
+    virtual LSTATUS QueryReflectionKey(HKEY hKey, BOOL* isReflectionDisabled) noexcept;
+    virtual LSTATUS EnableReflectionKey(HKEY hKey) noexcept;
+    virtual LSTATUS DisableReflectionKey(HKEY hKey) noexcept;
+
+    virtual LSTATUS NotifyChangeKeyValue(HKEY hKey, BOOL watchSubtree, DWORD notifyFilter,
+                                         HANDLE event, BOOL asynchronous) noexcept;
+
 private:
-    T* m_ptr{ nullptr };
+    static inline std::atomic<RegBackend*> s_current{ nullptr };
 };
 
 
 //------------------------------------------------------------------------------
-// Helper function to build a multi-string from a vector<wstring>.
-//
-// A multi-string is a sequence of contiguous NUL-terminated strings,
-// that terminates with an additional NUL.
-// Basically, considered as a whole, the sequence is terminated by two NULs.
-// E.g.:
-//          Hello\0World\0\0
+// Install a registry backend for the lifetime of this object; the destructor
+// reinstalls the previous one (typically in tests).
 //------------------------------------------------------------------------------
-[[nodiscard]] inline std::vector<wchar_t> BuildMultiString(const std::vector<std::wstring>& data)
+class RegBackendScope
 {
-    // Special case of the empty multi-string
-    if (data.empty())
-    {
-        // Build a vector containing just two NULs
-        return std::vector<wchar_t>(2, L'\0');
-    }
-
-    // Get the total length in wchar_ts of the multi-string
-    size_t totalLen = 0;
-    for (const auto& s : data)
-    {
-        // Add one to current string's length for the terminating NUL
-        totalLen += (s.length() + 1);
-    }
-
-    // Add one for the last NUL terminator (making the whole structure double-NUL terminated)
-    totalLen++;
-
-    // Allocate a buffer to store the multi-string
-    std::vector<wchar_t> multiString;
-
-    // Reserve room in the vector to speed up the following insertion loop
-    multiString.reserve(totalLen);
+public:
 
-    // Copy the single strings into the multi-string
-    for (const auto& s : data)
-    {
-        if (!s.empty())
-        {
-            // Copy current string's content
-            multiString.insert(multiString.end(), s.begin(), s.end());
-        }
+    explicit RegBackendScope(RegBackend& backend) noexcept;
+    ~RegBackendScope();
 
-        // Don't forget to NUL-terminate the current string
-        // (or just insert L'\0' for empty strings)
-        multiString.emplace_back(L'\0');
-    }
+    RegBackendScope(const RegBackendScope&) = delete;
+    RegBackendScope& operator=(const RegBackendScope&) = delete;
 
-    // Add the last NUL-terminator
-    multiString.emplace_back(L'\0');
+private:
+    RegBackend* m_previous;
+};
 
-    return multiString;
-}
 
+#ifdef WINREG_ENABLE_TRACE
 
 //------------------------------------------------------------------------------
-// Return true if the wchar_t sequence stored in 'data' terminates
-// with two null (L'\0') wchar_t's
+// A span recorded by RegTrace: one Windows Registry API call
 //------------------------------------------------------------------------------
-[[nodiscard]] inline bool IsDoubleNullTerminated(const std::vector<wchar_t>& data)
+struct RegTraceSpan
 {
-    // First check that there's enough room for at least two nulls
-    if (data.size() < 2)
-    {
-        return false;
-    }
+    const char*  Operation{ nullptr };  // WinReg function making the call (e.g. "GetDwordValue")
+    const char*  Api{ nullptr };        // Windows Registry API (e.g. "RegGetValueW")
+    std::wstring KeyPath;               // key path, as far as it is known (see RegTrace)
+    std::wstring ValueName;             // empty for key operations
+    ULONGLONG    Bytes{ 0 };            // size of the value data read or written
+    LSTATUS      Result{ ERROR_SUCCESS };
+    DWORD        ThreadId{ 0 };
+    ULONGLONG    StartNanoseconds{ 0 }; // std::chrono::steady_clock time
+    ULONGLONG    DurationNanoseconds{ 0 };
+};
 
-    // Check that the sequence terminates with two nulls (L'\0', L'\0')
-    const size_t lastPosition = data.size() - 1;
-    return ((data[lastPosition]     == L'\0')  &&
-            (data[lastPosition - 1] == L'\0')) ? true : false;
-}
+// Options for RegTrace::Enable
+struct RegTraceOptions
+{
+    // Number of spans kept for each thread; older spans are overwritten
+    size_t SpansPerThread = 4096;
+
+    // Spans lasting at least this long are passed to SlowOperationHandler
+    std::chrono::microseconds SlowThreshold{ 1000 };
+
+    // Optional handler of the slow spans, called on the thread that made the
+    // registry call, just after it returned. The handler can use the registry
+    // (its own slow calls are not reported to it again); exceptions thrown
+    // by the handler are ignored.
+    std::function<void(const RegTraceSpan&)> SlowOperationHandler;
+};
 
 
 //------------------------------------------------------------------------------
-// Given a sequence of wchar_ts representing a double-null-terminated string,
-// returns a vector of wstrings that represent the single strings.
+// Process-wide tracing of the Windows Registry API calls made by WinReg
+// (by RegKey, and by the other classes and functions reading the registry).
 //
-// Also supports embedded empty strings in the sequence.
+// When tracing is enabled, each call is recorded as a span, with the calling
+// function, the API, the key path and value name, the bytes of value data,
+// the result code and the timing. Spans go into per-thread ring buffers;
+// the key paths are looked up in a table sharded by handle, under shared
+// locks, and copied into the reused span strings. They can be collected at
+// any time, and exported in the Chrome trace-event JSON format (that can be
+// loaded in chrome://tracing or in the Perfetto UI).
+//
+// Key paths are tracked for the keys opened or created while tracing is
+// enabled, starting from the predefined keys (e.g. HKEY_CURRENT_USER),
+// until the key is closed or detached from its RegKey; for other keys, just
+// the subkey path passed to the API (if any) is known. Enumeration spans
+// report the path of the enumerated key.
+//
+// Tracing is compiled in only when WINREG_ENABLE_TRACE is defined before
+// including WinReg.hpp. Otherwise RegTrace is not available, and the library
+// calls the registry API directly, with no tracing state at all.
+// When compiled in but disabled, the overhead of each registry call is a single
+// branch on a relaxed atomic load (and another one when closing a key).
 //------------------------------------------------------------------------------
-[[nodiscard]] inline std::vector<std::wstring> ParseMultiString(const std::vector<wchar_t>& data)
+class RegTrace
 {
-    // Make sure that there are two terminating L'\0's at the end of the sequence
-    if (!IsDoubleNullTerminated(data))
-    {
-        throw RegException{ ERROR_INVALID_DATA, "Not a double-null terminated string." };
-    }
+public:
 
-    // Parse the double-NUL-terminated string into a vector<wstring>,
-    // which will be returned to the caller
-    std::vector<std::wstring> result;
+    // Only static members
+    RegTrace() = delete;
 
-    //
-    // Note on Embedded Empty Strings
-    // ==============================
-    //
-    // Below commented-out there is the previous parsing code,
-    // that assumes that an empty string *terminates* the sequence.
-    //
-    // In fact, according to the official Microsoft MSDN documentation,
-    // an empty string is treated as a sequence terminator,
-    // so you can't have empty strings inside the sequence.
-    //
-    // Source: https://docs.microsoft.com/en-us/windows/win32/sysinfo/registry-value-types
-    //      "A REG_MULTI_SZ string ends with a string of length 0.
-    //       Therefore, it is not possible to include a zero-length string
-    //       in the sequence. An empty sequence would be defined as follows: \0."
-    //
-    // Unfortunately, it seems that Microsoft violates its own rule, for example
-    // in the PendingFileRenameOperations value under the
-    // "SYSTEM\CurrentControlSet\Control\Session Manager" key.
-    // This is a REG_MULTI_SZ value that does contain embedded empty strings.
-    //
-    // So, I changed the previous parsing code to support also embedded empty strings.
-    //
-    // -------------------------------------------------------------------------
-    //// *** Previous parsing code - Assumes an empty string terminates the sequence ***
-    //
-    //const wchar_t* currStringPtr = data.data();
-    //while (*currStringPtr != L'\0')
-    //{
-    //    // Current string is NUL-terminated, so get its length calling wcslen
-    //    const size_t currStringLength = wcslen(currStringPtr);
-    //
-    //    // Add current string to the result vector
-    //    result.emplace_back(currStringPtr, currStringLength);
-    //
-    //    // Move to the next string
-    //    currStringPtr += currStringLength + 1;
-    //}
-    // -------------------------------------------------------------------------
-    //
+    // Start recording spans
+    static void Enable(const RegTraceOptions& options = RegTraceOptions{});
 
-    const wchar_t* currStringPtr = data.data();
-    const wchar_t* const endPtr  = data.data() + data.size() - 1;
+    // Stop recording spans; the spans already recorded are kept
+    static void Disable();
 
-    while (currStringPtr < endPtr)
-    {
-        // Current string is NUL-terminated, so get its length calling wcslen
-        const size_t currStringLength = wcslen(currStringPtr);
+    // Is tracing enabled?
+    [[nodiscard]] static bool IsEnabled() noexcept;
 
-        // Add current string to the result vector
-        if (currStringLength > 0)
-        {
-            result.emplace_back(currStringPtr, currStringLength);
-        }
-        else
-        {
-            // Insert empty strings, as well
-            result.emplace_back(std::wstring{});
-        }
+    // Copy the spans recorded by all the threads, sorted by start time
+    [[nodiscard]] static std::vector<RegTraceSpan> CollectSpans();
 
-        // Move to the next string, skipping the terminating NUL
-        currStringPtr += currStringLength + 1;
-    }
+    // Discard the recorded spans
+    static void Clear();
 
-    return result;
-}
+    // Format spans as a Chrome trace-event JSON object
+    [[nodiscard]] static std::wstring ToChromeTraceJson(const std::vector<RegTraceSpan>& spans);
+
+    // Write the recorded spans to a Chrome trace-event JSON file (UTF-8)
+    static void WriteChromeTrace(const std::wstring& fileName);
+    [[nodiscard]] static RegResult TryWriteChromeTrace(const std::wstring& fileName);
+
+private:
+    static inline std::atomic<bool> s_enabled{ false };
+};
+
+#endif // WINREG_ENABLE_TRACE
 
 
 //------------------------------------------------------------------------------
-// Builds a RegExpected object that stores an error code
+// Categories of the heap allocations accounted by RegAllocationStats
 //------------------------------------------------------------------------------
-template <typename T>
-[[nodiscard]] inline RegExpected<T> MakeRegExpectedWithError(const LSTATUS retCode)
+enum class RegAllocationCategory
 {
-    return RegExpected<T>{ RegResult{ retCode } };
-}
+    StringValue,        // REG_SZ and REG_EXPAND_SZ reads
+    MultiStringValue,   // REG_MULTI_SZ reads (raw buffer and parsed strings)
+    BinaryValue,        // REG_BINARY reads
+    Enumeration,        // subkey and value enumeration, RegNameList storage
+
+    Count               // number of categories (not a category)
+};
+
+#ifdef WINREG_ENABLE_ALLOCATION_STATS
+
+// Heap allocations made by WinReg for a category
+struct RegAllocationCounters
+{
+    ULONGLONG Allocations{ 0 };     // number of allocations
+    ULONGLONG Bytes{ 0 };           // total bytes requested
+};
 
 
 //------------------------------------------------------------------------------
-// Return true if casting a size_t value to a DWORD is safe
-// (e.g. there is no overflow); false otherwise.
+// Accounting of the heap allocations made by WinReg for the data it reads
+// from the registry: the strings, vectors and buffers built by the value
+// getters (e.g. GetStringValue, GetMultiStringValue) and by the enumeration
+// methods (e.g. EnumValues, and the RegNameList storage).
+//
+// Accounting is compiled in only when WINREG_ENABLE_ALLOCATION_STATS
+// is defined before including WinReg.hpp; otherwise this class is not
+// available, and the library code paths carry no accounting at all.
+//
+// The containers owned by the library (like RegNameList) use an accounting
+// allocator; the standard containers returned to the caller are accounted
+// once, when the getter or enumeration method hands them out (one allocation
+// per heap buffer they own). Allocations made later by the caller on the
+// returned objects are not accounted.
+//
+// Counters are kept per thread (so threads don't contend while counting),
+// and summed on request. Measure and ExpectAtMost only look at the calling
+// thread, so they can be used to lock in allocation-free hot paths in tests,
+// e.g. reading into a reused RegNameList.
 //------------------------------------------------------------------------------
-[[nodiscard]] inline bool SizeToDwordCastIsSafe([[maybe_unused]] const size_t size) noexcept
+class RegAllocationStats
 {
-#ifdef _WIN64
+public:
 
-    //
-    // In 64-bit builds, DWORD is an unsigned 32-bit integer,
-    // while size_t is an unsigned *64-bit* integer.
-    // So we need to pay attention to the conversion from size_t --> to DWORD.
-    //
+    // Only static members
+    RegAllocationStats() = delete;
 
-    using DestinationType = DWORD;
+    // Allocations of all the threads for the given category,
+    // since the start of the process or the last Reset
+    [[nodiscard]] static RegAllocationCounters Get(RegAllocationCategory category);
 
-    // Pre-compute at compile-time the maximum value that can be stored by a DWORD.
-    // Note that this value is stored in a size_t for proper comparison with the 'size' parameter.
-    constexpr size_t kMaxDwordValue = static_cast<size_t>((std::numeric_limits<DestinationType>::max)());
+    // Allocations of all the threads, for all the categories
+    [[nodiscard]] static RegAllocationCounters GetTotal();
 
-    // Check against overflow
-    if (size > kMaxDwordValue)
-    {
-        // Overflow from size_t to DWORD
-        return false;
-    }
+    // Allocations of the calling thread for the given category
+    [[nodiscard]] static RegAllocationCounters GetForCurrentThread(RegAllocationCategory category);
 
-    // The conversion is safe
-    return true;
+    // Zero all the counters
+    static void Reset();
 
-#else
-    //
-    // In 32-bit builds with Microsoft Visual C++, a size_t is an unsigned 32-bit value,
-    // just like a DWORD. So, we can optimized this case out for 32-bit builds.
-    //
+    // Invoke function on the calling thread, and return the allocations
+    // it caused (for all the categories)
+    template <typename Function>
+    [[nodiscard]] static RegAllocationCounters Measure(Function&& function);
 
-    static_assert(sizeof(size_t) == sizeof(DWORD)); // Both 32-bit unsigned integers on 32-bit x86
-    //UNREFERENCED_PARAMETER(size); // Replaced with [[maybe_unused]] for compatibility with MinGW 32-bit
-    return true;
+    // Test helper: invoke function, and throw a RegException with
+    // ERROR_ASSERTION_FAILURE if it caused more than maxAllocations allocations
+    template <typename Function>
+    static void ExpectAtMost(ULONGLONG maxAllocations, Function&& function);
+};
 
-#endif // _WIN64
-}
 
+namespace details
+{
+
+// Account a heap allocation of the given size, in bytes
+void RecordAllocation(RegAllocationCategory category, size_t bytes) noexcept;
 
 //------------------------------------------------------------------------------
-// Safely cast a size_t value (usually from the STL)
-// to a DWORD (usually for Win32 API calls).
-// In case of overflow, throws an exception of type std::overflow_error.
+// Allocator of the containers owned by WinReg, accounting the allocations
+// in RegAllocationStats
 //------------------------------------------------------------------------------
-[[nodiscard]] inline DWORD SafeCastSizeToDword(const size_t size)
+template <typename T, RegAllocationCategory Category>
+class AccountingAllocator
 {
+public:
+    using value_type = T;
 
-#ifdef _WIN64
+    template <typename U>
+    struct rebind
+    {
+        using other = AccountingAllocator<U, Category>;
+    };
 
-    //
-    // In 64-bit builds, DWORD is an unsigned 32-bit integer,
-    // while size_t is an unsigned *64-bit* integer.
-    // So we need to pay attention to the conversion from size_t --> to DWORD.
-    //
+    AccountingAllocator() noexcept = default;
 
-    using DestinationType = DWORD;
+    template <typename U>
+    AccountingAllocator(const AccountingAllocator<U, Category>&) noexcept
+    {}
 
-    // Check against overflow
-    if (!SizeToDwordCastIsSafe(size))
+    [[nodiscard]] T* allocate(const size_t count)
     {
-        throw std::overflow_error(
-            "Input size_t value is too big: size_t value doesn't fit into a DWORD.");
+        T* const data = std::allocator<T>{}.allocate(count);
+        RecordAllocation(Category, count * sizeof(T));
+        return data;
     }
 
-    return static_cast<DestinationType>(size);
+    void deallocate(T* const data, const size_t count) noexcept
+    {
+        std::allocator<T>{}.deallocate(data, count);
+    }
 
-#else
-    //
-    // In 32-bit builds with Microsoft Visual C++, a size_t is an unsigned 32-bit value,
-    // just like a DWORD. So, we can optimize this case out for 32-bit builds.
-    //
+    template <typename U>
+    bool operator==(const AccountingAllocator<U, Category>&) const noexcept
+    {
+        return true;
+    }
 
-    _ASSERTE(SizeToDwordCastIsSafe(size)); // double-check just in debug builds
+    template <typename U>
+    bool operator!=(const AccountingAllocator<U, Category>&) const noexcept
+    {
+        return false;
+    }
+};
 
-    static_assert(sizeof(size_t) == sizeof(DWORD)); // Both 32-bit unsigned integers on 32-bit x86
-    return static_cast<DWORD>(size);
+#else // WINREG_ENABLE_ALLOCATION_STATS
 
-#endif // _WIN64
-}
+namespace details
+{
 
+// Without allocation accounting, the containers owned by WinReg
+// use the default allocator
+template <typename T, RegAllocationCategory Category>
+using AccountingAllocator = std::allocator<T>;
+
+#endif // WINREG_ENABLE_ALLOCATION_STATS
 
 } // namespace details
 
 
 //------------------------------------------------------------------------------
-//                          RegKey Inline Methods
+// Path-addressed registry value access, without a RegKey object.
+//
+// These functions read or write one value under rootKey\subKey with a single
+// registry call (RegGetValue or RegSetKeyValue, that receive the subkey path),
+// instead of opening the subkey, accessing the value and closing the subkey.
+// The setters create the subkey if it doesn't exist.
+//
+// The throwing versions throw RegException on error; the TryXxx versions
+// return RegResult or RegExpected<T>, like the corresponding RegKey methods.
 //------------------------------------------------------------------------------
 
-inline RegKey::RegKey(const HKEY hKey) noexcept
-    : m_hKey{ hKey }
-{
-}
+[[nodiscard]] DWORD GetDwordValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName);
+[[nodiscard]] ULONGLONG GetQwordValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName);
+[[nodiscard]] std::wstring GetStringValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName);
 
-
-inline RegKey::RegKey(const HKEY hKeyParent, const std::wstring& subKey)
-{
-    Create(hKeyParent, subKey);
-}
+[[nodiscard]] std::wstring GetExpandStringValue(
+    HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    RegKey::ExpandStringOption expandOption = RegKey::ExpandStringOption::DontExpand
+);
+
+[[nodiscard]] std::vector<std::wstring> GetMultiStringValue(HKEY rootKey,
+                                                            const std::wstring& subKey,
+                                                            const std::wstring& valueName);
+[[nodiscard]] std::vector<BYTE> GetBinaryValue(HKEY rootKey,
+                                               const std::wstring& subKey,
+                                               const std::wstring& valueName);
+
+[[nodiscard]] RegExpected<DWORD> TryGetDwordValue(HKEY rootKey,
+                                                  const std::wstring& subKey,
+                                                  const std::wstring& valueName);
+[[nodiscard]] RegExpected<ULONGLONG> TryGetQwordValue(HKEY rootKey,
+                                                      const std::wstring& subKey,
+                                                      const std::wstring& valueName);
+[[nodiscard]] RegExpected<std::wstring> TryGetStringValue(HKEY rootKey,
+                                                          const std::wstring& subKey,
+                                                          const std::wstring& valueName);
+
+[[nodiscard]] RegExpected<std::wstring> TryGetExpandStringValue(
+    HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    RegKey::ExpandStringOption expandOption = RegKey::ExpandStringOption::DontExpand
+);
+
+[[nodiscard]] RegExpected<std::vector<std::wstring>> TryGetMultiStringValue(HKEY rootKey,
+                                                                            const std::wstring& subKey,
+                                                                            const std::wstring& valueName);
+[[nodiscard]] RegExpected<std::vector<BYTE>> TryGetBinaryValue(HKEY rootKey,
+                                                               const std::wstring& subKey,
+                                                               const std::wstring& valueName);
+
+void SetDwordValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName, DWORD data);
+void SetQwordValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName,
+                   const ULONGLONG& data);
+void SetStringValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName,
+                    const std::wstring& data);
+void SetExpandStringValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName,
+                          const std::wstring& data);
+void SetMultiStringValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName,
+                         const std::vector<std::wstring>& data);
+void SetBinaryValue(HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName,
+                    const std::vector<BYTE>& data);
+
+[[nodiscard]] RegResult TrySetDwordValue(HKEY rootKey, const std::wstring& subKey,
+                                         const std::wstring& valueName, DWORD data) noexcept;
+[[nodiscard]] RegResult TrySetQwordValue(HKEY rootKey, const std::wstring& subKey,
+                                         const std::wstring& valueName, const ULONGLONG& data) noexcept;
+[[nodiscard]] RegResult TrySetStringValue(HKEY rootKey, const std::wstring& subKey,
+                                          const std::wstring& valueName, const std::wstring& data);
+[[nodiscard]] RegResult TrySetExpandStringValue(HKEY rootKey, const std::wstring& subKey,
+                                                const std::wstring& valueName, const std::wstring& data);
+[[nodiscard]] RegResult TrySetMultiStringValue(HKEY rootKey, const std::wstring& subKey,
+                                               const std::wstring& valueName,
+                                               const std::vector<std::wstring>& data);
+[[nodiscard]] RegResult TrySetBinaryValue(HKEY rootKey, const std::wstring& subKey,
+                                          const std::wstring& valueName, const std::vector<BYTE>& data);
 
 
-inline RegKey::RegKey(const HKEY hKeyParent, const std::wstring& subKey, const REGSAM desiredAccess)
+//------------------------------------------------------------------------------
+// A read-only set-like view of the strings stored in a REG_MULTI_SZ value,
+// that supports fast membership, count and prefix queries.
+//
+// The raw double-NUL-terminated multi-string is read into an internal buffer,
+// that is reused across Load calls; the single strings are *not* copied into
+// separate std::wstring objects. Instead, a compact open-addressing hash index
+// of std::wstring_views pointing into the buffer is built.
+//
+// The index is cached: if a subsequent Load reads back the same data
+// (same hash and same content), the index is not rebuilt.
+//
+// The strings are the same ones returned by RegKey::GetMultiStringValue
+// (embedded empty strings included).
+//
+// This class is movable but not copyable (the string views point
+// into the owned buffer).
+//------------------------------------------------------------------------------
+class RegMultiStringSet
 {
-    Create(hKeyParent, subKey, desiredAccess);
-}
+public:
 
+    // Initialize an empty set, using the given string comparison mode for queries
+    explicit RegMultiStringSet(
+        StringComparison comparison = StringComparison::CaseSensitive) noexcept;
 
-inline RegKey::RegKey(RegKey&& other) noexcept
-    : m_hKey{ other.m_hKey }
-{
-    // Other doesn't own the handle anymore
-    other.m_hKey = nullptr;
-}
+    RegMultiStringSet(RegMultiStringSet&&) noexcept = default;
+    RegMultiStringSet& operator=(RegMultiStringSet&&) noexcept = default;
 
+    // Ban copy
+    RegMultiStringSet(const RegMultiStringSet&) = delete;
+    RegMultiStringSet& operator=(const RegMultiStringSet&) = delete;
 
-inline RegKey& RegKey::operator=(RegKey&& other) noexcept
-{
-    // Prevent self-move-assign
-    if ((this != &other) && (m_hKey != other.m_hKey))
-    {
-        // Close current
-        Close();
 
-        // Move from other (i.e. take ownership of other's raw handle)
-        m_hKey = other.m_hKey;
-        other.m_hKey = nullptr;
-    }
-    return *this;
-}
+    // Read the given REG_MULTI_SZ value and (re)build the index if the data changed.
+    // Throw RegException on failure.
+    void Load(const RegKey& key, const std::wstring& valueName);
 
+    // Read the given REG_MULTI_SZ value and (re)build the index if the data changed.
+    // Return a RegResult instead of throwing on registry errors.
+    [[nodiscard]] RegResult TryLoad(const RegKey& key, const std::wstring& valueName);
 
-inline RegKey::~RegKey() noexcept
-{
-    // Release the owned handle (if any)
-    Close();
-}
+    // Does the multi-string contain the given string?
+    [[nodiscard]] bool Contains(std::wstring_view s) const noexcept;
 
+    // How many times the given string occurs in the multi-string
+    [[nodiscard]] size_t Count(std::wstring_view s) const noexcept;
 
-inline HKEY RegKey::Get() const noexcept
-{
-    return m_hKey;
-}
+    // How many strings in the multi-string start with the given prefix
+    [[nodiscard]] size_t CountWithPrefix(std::wstring_view prefix) const;
 
+    // Return the strings that start with the given prefix, in sorted order.
+    // The returned views point into this object's buffer.
+    [[nodiscard]] std::vector<std::wstring_view> FindWithPrefix(std::wstring_view prefix) const;
 
-inline void RegKey::Close() noexcept
-{
-    if (IsValid())
-    {
-        // Do not call RegCloseKey on predefined keys
-        if (! IsPredefined())
-        {
-            ::RegCloseKey(m_hKey);
-        }
+    // All the strings, in the order they are stored in the registry.
+    // The returned views point into this object's buffer.
+    [[nodiscard]] const std::vector<std::wstring_view>& Strings() const noexcept;
 
-        // Avoid dangling references
-        m_hKey = nullptr;
-    }
-}
+    // Total number of strings (duplicates included)
+    [[nodiscard]] size_t Size() const noexcept;
 
+    // Does the multi-string contain no strings?
+    [[nodiscard]] bool IsEmpty() const noexcept;
 
-inline bool RegKey::IsValid() const noexcept
-{
-    return m_hKey != nullptr;
-}
+    // Hash of the raw multi-string data the index was built from
+    [[nodiscard]] std::uint64_t DataHash() const noexcept;
 
+    // String comparison mode used by the queries
+    [[nodiscard]] StringComparison Comparison() const noexcept;
 
-inline RegKey::operator bool() const noexcept
-{
-    return IsValid();
-}
 
+    //
+    // Private Implementation
+    //
 
-inline bool RegKey::IsPredefined() const noexcept
-{
-    // Predefined keys
-    // https://msdn.microsoft.com/en-us/library/windows/desktop/ms724836(v=vs.85).aspx
+private:
 
-    if (   (m_hKey == HKEY_CURRENT_USER)
-        || (m_hKey == HKEY_LOCAL_MACHINE)
-        || (m_hKey == HKEY_CLASSES_ROOT)
-        || (m_hKey == HKEY_CURRENT_CONFIG)
-        || (m_hKey == HKEY_CURRENT_USER_LOCAL_SETTINGS)
-        || (m_hKey == HKEY_PERFORMANCE_DATA)
-        || (m_hKey == HKEY_PERFORMANCE_NLSTEXT)
-        || (m_hKey == HKEY_PERFORMANCE_TEXT)
-        || (m_hKey == HKEY_USERS))
+    // Hash index slot: refers to the first occurrence of a distinct string
+    struct Slot
     {
-        return true;
-    }
+        std::uint32_t Index; // index into m_strings
+        std::uint32_t Count; // number of occurrences; 0 marks an empty slot
+    };
 
-    return false;
-}
+    // Split m_data into string views, and rebuild the hash and sorted indexes
+    void BuildIndex();
 
+    // The string at the given index in the form used for hashing and comparing
+    // (i.e. upper-case for case-insensitive sets)
+    [[nodiscard]] std::wstring_view KeyAt(size_t index) const noexcept;
 
-inline HKEY RegKey::Detach() noexcept
-{
-    HKEY hKey = m_hKey;
+    // Return the slot storing the input string, or nullptr if not found
+    [[nodiscard]] const Slot* FindSlot(std::wstring_view s) const noexcept;
 
-    // We don't own the HKEY handle anymore
-    m_hKey = nullptr;
+    // Return the range of m_sorted whose strings start with the given prefix
+    [[nodiscard]] std::pair<std::vector<std::uint32_t>::const_iterator,
+                            std::vector<std::uint32_t>::const_iterator>
+            FindPrefixRange(std::wstring_view prefix) const;
 
-    // Transfer ownership to the caller
-    return hKey;
-}
+    // String comparison mode used by the queries
+    StringComparison m_comparison{ StringComparison::CaseSensitive };
 
+    // Raw double-NUL-terminated multi-string data
+    std::vector<wchar_t> m_data;
 
-inline void RegKey::Attach(const HKEY hKey) noexcept
-{
-    // Prevent self-attach
-    if (m_hKey != hKey)
-    {
-        // Close any open registry handle
-        Close();
+    // Reusable buffer for reading data from the registry
+    std::vector<wchar_t> m_readBuffer;
 
-        // Take ownership of the input hKey
-        m_hKey = hKey;
-    }
-}
+    // Hash of m_data
+    std::uint64_t m_dataHash{ 0 };
 
+    // Views into m_data, in registry order
+    std::vector<std::wstring_view> m_strings;
 
-inline void RegKey::SwapWith(RegKey& other) noexcept
-{
-    // Enable ADL (not necessary in this case, but good practice)
-    using std::swap;
+    // Case-insensitive sets only: upper-case copy of m_data (folded all at once),
+    // and views into it matching m_strings
+    std::vector<wchar_t> m_foldedData;
+    std::vector<std::wstring_view> m_foldedStrings;
 
-    // Swap the raw handle members
-    swap(m_hKey, other.m_hKey);
-}
+    // Open-addressing hash table (size is a power of two)
+    std::vector<Slot> m_slots;
+
+    // Indexes into m_strings, sorted according to m_comparison (for prefix queries)
+    std::vector<std::uint32_t> m_sorted;
+};
 
 
-inline void swap(RegKey& a, RegKey& b) noexcept
+//------------------------------------------------------------------------------
+// An owning, properly aligned array of fixed-size records read from
+// (or to be written to) a REG_BINARY value.
+//
+// Returned by RegKey::GetBinaryValueAs<T>: the registry data is read
+// directly into this array, so no per-element copies are needed.
+// Offers a span-like read interface (Data, Size, indexing, iteration).
+//
+// This class is movable but not copyable.
+//------------------------------------------------------------------------------
+template <typename T>
+class RegBinaryArray
 {
-    a.SwapWith(b);
-}
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "REG_BINARY records must be trivially copyable.");
+    static_assert(!std::is_pointer_v<T>,
+                  "Pointers cannot be meaningfully stored in REG_BINARY values.");
+    static_assert(std::is_default_constructible_v<T>,
+                  "REG_BINARY records must be default constructible.");
 
+public:
 
-inline void RegKey::Create(
-    const HKEY                  hKeyParent,
-    const std::wstring&         subKey,
-    const REGSAM                desiredAccess
-)
-{
-    constexpr DWORD kDefaultOptions = REG_OPTION_NON_VOLATILE;
+    // Initialize as an empty array
+    RegBinaryArray() noexcept = default;
 
-    Create(hKeyParent, subKey, desiredAccess, kDefaultOptions,
-        nullptr, // no security attributes,
-        nullptr  // no disposition
-    );
-}
+    // Allocate an array of count (default-initialized) records
+    explicit RegBinaryArray(size_t count);
 
+    // Take ownership of an array storing (at least) count records
+    RegBinaryArray(std::unique_ptr<T[]> data, size_t count) noexcept;
 
-inline void RegKey::Create(
-    const HKEY                  hKeyParent,
-    const std::wstring&         subKey,
-    const REGSAM                desiredAccess,
-    const DWORD                 options,
-    SECURITY_ATTRIBUTES* const  securityAttributes,
-    DWORD* const                disposition
-)
-{
-    HKEY hKey = nullptr;
-    LSTATUS retCode = ::RegCreateKeyExW(
-        hKeyParent,
-        subKey.c_str(),
-        0,          // reserved
-        REG_NONE,   // user-defined class type parameter not supported
-        options,
-        desiredAccess,
-        securityAttributes,
-        &hKey,
-        disposition
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "RegCreateKeyExW failed." };
-    }
+    RegBinaryArray(RegBinaryArray&&) noexcept = default;
+    RegBinaryArray& operator=(RegBinaryArray&&) noexcept = default;
 
-    // Safely close any previously opened key
-    Close();
+    // Ban copy
+    RegBinaryArray(const RegBinaryArray&) = delete;
+    RegBinaryArray& operator=(const RegBinaryArray&) = delete;
 
-    // Take ownership of the newly created key
-    m_hKey = hKey;
-}
+    // Access the records
+    [[nodiscard]] T* Data() noexcept;
+    [[nodiscard]] const T* Data() const noexcept;
 
+    // Number of records
+    [[nodiscard]] size_t Size() const noexcept;
 
-inline void RegKey::Open(
-    const HKEY              hKeyParent,
-    const std::wstring&     subKey,
-    const REGSAM            desiredAccess
-)
-{
-    HKEY hKey = nullptr;
-    LSTATUS retCode = ::RegOpenKeyExW(
-        hKeyParent,
-        subKey.c_str(),
-        REG_NONE,           // default options
-        desiredAccess,
-        &hKey
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "RegOpenKeyExW failed." };
-    }
+    // Size of the records, in bytes
+    [[nodiscard]] size_t SizeInBytes() const noexcept;
 
-    // Safely close any previously opened key
-    Close();
+    // Is the array empty?
+    [[nodiscard]] bool IsEmpty() const noexcept;
 
-    // Take ownership of the newly created key
-    m_hKey = hKey;
-}
+    // Access a record (no bounds checking)
+    [[nodiscard]] T& operator[](size_t index) noexcept;
+    [[nodiscard]] const T& operator[](size_t index) const noexcept;
 
+    // Support range-for iteration
+    [[nodiscard]] T* begin() noexcept;
+    [[nodiscard]] T* end() noexcept;
+    [[nodiscard]] const T* begin() const noexcept;
+    [[nodiscard]] const T* end() const noexcept;
 
-inline RegResult RegKey::TryCreate(
-    const HKEY          hKeyParent,
-    const std::wstring& subKey,
-    const REGSAM        desiredAccess
-) noexcept
+private:
+    std::unique_ptr<T[]> m_data;
+    size_t m_size{ 0 };
+};
+
+
+//------------------------------------------------------------------------------
+// A compact list of registry names (e.g. subkey or value names), with
+// an optional registry type associated to each name.
+//
+// Instead of allocating one std::wstring per name, all the names are stored
+// back to back (NUL-terminated) in a single contiguous character buffer,
+// with a contiguous array of (offset, length, type) entries referring to it.
+// Clearing the list keeps both buffers, so enumerating many keys
+// into the same list doesn't allocate in the steady state.
+//
+// The list can be sorted by case-folded name (which is how the registry
+// compares names), after which lookups by name use binary search.
+//------------------------------------------------------------------------------
+class RegNameList
 {
-    constexpr DWORD kDefaultOptions = REG_OPTION_NON_VOLATILE;
+public:
 
-    return TryCreate(hKeyParent, subKey, desiredAccess, kDefaultOptions,
-        nullptr, // no security attributes,
-        nullptr  // no disposition
-    );
-}
+    // Returned by Find when the name is not in the list
+    static constexpr size_t npos = static_cast<size_t>(-1);
 
+    // Initialize as an empty list
+    RegNameList() noexcept = default;
 
-inline RegResult RegKey::TryCreate(
-    const HKEY                  hKeyParent,
-    const std::wstring&         subKey,
-    const REGSAM                desiredAccess,
-    const DWORD                 options,
-    SECURITY_ATTRIBUTES* const  securityAttributes,
-    DWORD* const                disposition
-) noexcept
-{
-    HKEY hKey = nullptr;
-    RegResult retCode{ ::RegCreateKeyExW(
-        hKeyParent,
-        subKey.c_str(),
-        0,          // reserved
-        REG_NONE,   // user-defined class type parameter not supported
-        options,
-        desiredAccess,
-        securityAttributes,
-        &hKey,
-        disposition
-    ) };
-    if (retCode.Failed())
-    {
-        return retCode;
-    }
+    // Append a name (and its registry type, if meaningful)
+    void Append(std::wstring_view name, DWORD type = REG_NONE);
 
-    // Safely close any previously opened key
-    Close();
+    // Remove all the names, keeping the allocated memory for reuse
+    void Clear() noexcept;
 
-    // Take ownership of the newly created key
-    m_hKey = hKey;
+    // Reserve room for the given number of names
+    void Reserve(size_t nameCount);
 
-    _ASSERTE(retCode.IsOk());
-    return retCode;
-}
+    // Number of names in the list
+    [[nodiscard]] size_t Size() const noexcept;
+
+    // Is the list empty?
+    [[nodiscard]] bool IsEmpty() const noexcept;
+
+    // Access the name at the given index.
+    // The returned view is NUL-terminated, and valid until the list is modified.
+    [[nodiscard]] std::wstring_view operator[](size_t index) const noexcept;
+
+    // Access the name at the given index
+    [[nodiscard]] std::wstring_view Name(size_t index) const noexcept;
+
+    // Registry type associated to the name at the given index
+    [[nodiscard]] DWORD Type(size_t index) const noexcept;
+
+    // Sort the names by case-folded name
+    void SortByName();
+
+    // Is the list sorted by case-folded name?
+    [[nodiscard]] bool IsSortedByName() const noexcept;
+
+    // Return the index of the given name (compared case-insensitively,
+    // like the registry does), or npos if not found.
+    // Uses binary search if the list is sorted, else a linear scan.
+    [[nodiscard]] size_t Find(std::wstring_view name) const noexcept;
+
+    // Does the list contain the given name (compared case-insensitively)?
+    [[nodiscard]] bool Contains(std::wstring_view name) const noexcept;
+
+    // Copy the names into a vector of wstrings
+    [[nodiscard]] std::vector<std::wstring> ToVector() const;
+
+
+    //
+    // Private Implementation
+    //
+
+private:
+
+    // RegKey enumerates names directly into the character buffer
+    friend class RegKey;
+
+    struct Entry
+    {
+        std::uint32_t Offset;   // offset of the first character in m_chars
+        std::uint32_t Length;   // length in wchar_ts, excluding the terminating NUL
+        DWORD         Type;     // registry type (REG_NONE if not meaningful)
+    };
+
+    // Make room for a name of up to maxLength wchar_ts at the end of the
+    // character buffer, and return a pointer to it
+    [[nodiscard]] wchar_t* BeginAppend(size_t maxLength);
+
+    // Complete an append started with BeginAppend
+    void EndAppend(size_t length, DWORD type);
+
+    // Discard an append started with BeginAppend
+    void CancelAppend() noexcept;
+
+    // All the names, each one NUL-terminated
+    std::vector<wchar_t, details::AccountingAllocator<wchar_t, RegAllocationCategory::Enumeration>> m_chars;
+
+    // One entry per name
+    std::vector<Entry, details::AccountingAllocator<Entry, RegAllocationCategory::Enumeration>> m_entries;
+
+    // Offset of the name being appended (between BeginAppend and EndAppend)
+    size_t m_appendOffset{ 0 };
+
+    // Are the entries sorted by case-folded name?
+    bool m_sortedByName{ false };
+};
+
+
+//------------------------------------------------------------------------------
+//          Overloads of relational comparison operators for RegKey
+//------------------------------------------------------------------------------
+
+inline bool operator==(const RegKey& a, const RegKey& b) noexcept
+{
+    return a.Get() == b.Get();
+}
+
+inline bool operator!=(const RegKey& a, const RegKey& b) noexcept
+{
+    return a.Get() != b.Get();
+}
+
+inline bool operator<(const RegKey& a, const RegKey& b) noexcept
+{
+    return a.Get() < b.Get();
+}
+
+inline bool operator<=(const RegKey& a, const RegKey& b) noexcept
+{
+    return a.Get() <= b.Get();
+}
+
+inline bool operator>(const RegKey& a, const RegKey& b) noexcept
+{
+    return a.Get() > b.Get();
+}
+
+inline bool operator>=(const RegKey& a, const RegKey& b) noexcept
+{
+    return a.Get() >= b.Get();
+}
+
+
+//------------------------------------------------------------------------------
+//                  Private Helper Classes and Functions
+//------------------------------------------------------------------------------
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// Simple scoped-based RAII wrapper that *automatically* invokes LocalFree()
+// in its destructor.
+//------------------------------------------------------------------------------
+template <typename T>
+class ScopedLocalFree
+{
+public:
+
+    typedef T  Type;
+    typedef T* TypePtr;
+
+
+    // Init wrapped pointer to nullptr
+    ScopedLocalFree() noexcept = default;
+
+    // Automatically and safely invoke ::LocalFree()
+    ~ScopedLocalFree() noexcept
+    {
+        Free();
+    }
+
+    //
+    // Ban copy and move operations
+    //
+    ScopedLocalFree(const ScopedLocalFree&) = delete;
+    ScopedLocalFree(ScopedLocalFree&&) = delete;
+    ScopedLocalFree& operator=(const ScopedLocalFree&) = delete;
+    ScopedLocalFree& operator=(ScopedLocalFree&&) = delete;
+
+
+    // Read-only access to the wrapped pointer
+    [[nodiscard]] T* Get() const noexcept
+    {
+        return m_ptr;
+    }
+
+    // Writable access to the wrapped pointer
+    [[nodiscard]] T** AddressOf() noexcept
+    {
+        return &m_ptr;
+    }
+
+    // Explicit pointer conversion to bool
+    explicit operator bool() const noexcept
+    {
+        return (m_ptr != nullptr);
+    }
+
+    // Safely invoke ::LocalFree() on the wrapped pointer
+    void Free() noexcept
+    {
+        if (m_ptr != nullptr)
+        {
+            ::LocalFree(m_ptr);
+            m_ptr = nullptr;
+        }
+    }
+
+
+    //
+    // IMPLEMENTATION
+    //
+private:
+    T* m_ptr{ nullptr };
+};
+
+
+//------------------------------------------------------------------------------
+// Simple RAII wrapper that automatically invokes CloseHandle()
+// on a file handle in its destructor.
+//------------------------------------------------------------------------------
+class ScopedFileHandle
+{
+public:
+
+    ScopedFileHandle() noexcept = default;
+
+    explicit ScopedFileHandle(const HANDLE handle) noexcept
+        : m_handle{ handle }
+    {}
+
+    ~ScopedFileHandle() noexcept
+    {
+        Close();
+    }
+
+    //
+    // Ban copy and move operations
+    //
+    ScopedFileHandle(const ScopedFileHandle&) = delete;
+    ScopedFileHandle(ScopedFileHandle&&) = delete;
+    ScopedFileHandle& operator=(const ScopedFileHandle&) = delete;
+    ScopedFileHandle& operator=(ScopedFileHandle&&) = delete;
+
+    [[nodiscard]] HANDLE Get() const noexcept
+    {
+        return m_handle;
+    }
+
+    [[nodiscard]] bool IsValid() const noexcept
+    {
+        return m_handle != INVALID_HANDLE_VALUE;
+    }
+
+    // Transfer ownership of the handle to the caller
+    [[nodiscard]] HANDLE Detach() noexcept
+    {
+        HANDLE handle = m_handle;
+        m_handle = INVALID_HANDLE_VALUE;
+        return handle;
+    }
+
+    void Close() noexcept
+    {
+        if (IsValid())
+        {
+            ::CloseHandle(m_handle);
+            m_handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+private:
+    HANDLE m_handle{ INVALID_HANDLE_VALUE };
+};
+
+
+//------------------------------------------------------------------------------
+// Return the last Win32 error as an LSTATUS (never ERROR_SUCCESS)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS LastErrorAsStatus() noexcept
+{
+    const DWORD error = ::GetLastError();
+    return (error != ERROR_SUCCESS) ? static_cast<LSTATUS>(error) : ERROR_INVALID_FUNCTION;
+}
+
+
+//------------------------------------------------------------------------------
+// Write the whole buffer to the given file
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS WriteFileFully(const HANDLE file, const BYTE* data, size_t size) noexcept
+{
+    // Write in chunks that fit into a DWORD
+    constexpr size_t kMaxChunkSize = 1024 * 1024 * 1024;
+
+    while (size > 0)
+    {
+        const DWORD chunkSize = static_cast<DWORD>((size < kMaxChunkSize) ? size : kMaxChunkSize);
+        DWORD written = 0;
+        if (!::WriteFile(file, data, chunkSize, &written, nullptr))
+        {
+            return LastErrorAsStatus();
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the name of a predefined key, or nullptr for other keys
+//------------------------------------------------------------------------------
+[[nodiscard]] inline const wchar_t* PredefinedKeyName(const HKEY hKey) noexcept
+{
+    if (hKey == HKEY_CLASSES_ROOT)                { return L"HKEY_CLASSES_ROOT"; }
+    if (hKey == HKEY_CURRENT_USER)                { return L"HKEY_CURRENT_USER"; }
+    if (hKey == HKEY_LOCAL_MACHINE)               { return L"HKEY_LOCAL_MACHINE"; }
+    if (hKey == HKEY_USERS)                       { return L"HKEY_USERS"; }
+    if (hKey == HKEY_CURRENT_CONFIG)              { return L"HKEY_CURRENT_CONFIG"; }
+    if (hKey == HKEY_CURRENT_USER_LOCAL_SETTINGS) { return L"HKEY_CURRENT_USER_LOCAL_SETTINGS"; }
+    if (hKey == HKEY_PERFORMANCE_DATA)            { return L"HKEY_PERFORMANCE_DATA"; }
+    if (hKey == HKEY_PERFORMANCE_NLSTEXT)         { return L"HKEY_PERFORMANCE_NLSTEXT"; }
+    if (hKey == HKEY_PERFORMANCE_TEXT)            { return L"HKEY_PERFORMANCE_TEXT"; }
+    return nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+// Calls to the Windows Registry API functions used by WinReg, going to the
+// installed RegBackend, if any (see RegBackend::SetCurrent)
+//------------------------------------------------------------------------------
+
+inline LSTATUS CallRegOpenKeyExW(const HKEY hKey, const LPCWSTR subKey, const DWORD options,
+                                 const REGSAM desiredAccess, const PHKEY result) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->OpenKeyEx(hKey, subKey, options, desiredAccess, result);
+    }
+    return ::RegOpenKeyExW(hKey, subKey, options, desiredAccess, result);
+}
+
+
+inline LSTATUS CallRegCreateKeyExW(const HKEY hKey, const LPCWSTR subKey, const DWORD reserved,
+                                   const LPWSTR keyClass, const DWORD options, const REGSAM desiredAccess,
+                                   SECURITY_ATTRIBUTES* const securityAttributes,
+                                   const PHKEY result, const LPDWORD disposition) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->CreateKeyEx(hKey, subKey, reserved, keyClass, options, desiredAccess,
+                                    securityAttributes, result, disposition);
+    }
+    return ::RegCreateKeyExW(hKey, subKey, reserved, keyClass, options, desiredAccess,
+                             securityAttributes, result, disposition);
+}
+
+
+inline LSTATUS CallRegCloseKey(const HKEY hKey) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->CloseKey(hKey);
+    }
+    return ::RegCloseKey(hKey);
+}
+
+
+inline LSTATUS CallRegConnectRegistryW(const LPCWSTR machineName, const HKEY hKey, const PHKEY result) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->ConnectRegistry(machineName, hKey, result);
+    }
+    return ::RegConnectRegistryW(machineName, hKey, result);
+}
+
+
+inline LSTATUS CallRegGetValueW(const HKEY hKey, const LPCWSTR subKey, const LPCWSTR valueName,
+                                const DWORD flags, const LPDWORD type, void* const data,
+                                const LPDWORD dataSize) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->GetValue(hKey, subKey, valueName, flags, type, data, dataSize);
+    }
+    return ::RegGetValueW(hKey, subKey, valueName, flags, type, data, dataSize);
+}
+
+
+inline LSTATUS CallRegQueryValueExW(const HKEY hKey, const LPCWSTR valueName, const LPDWORD reserved,
+                                    const LPDWORD type, BYTE* const data, const LPDWORD dataSize) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->QueryValueEx(hKey, valueName, reserved, type, data, dataSize);
+    }
+    return ::RegQueryValueExW(hKey, valueName, reserved, type, data, dataSize);
+}
+
+
+inline LSTATUS CallRegSetValueExW(const HKEY hKey, const LPCWSTR valueName, const DWORD reserved,
+                                  const DWORD type, const BYTE* const data, const DWORD dataSize) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->SetValueEx(hKey, valueName, reserved, type, data, dataSize);
+    }
+    return ::RegSetValueExW(hKey, valueName, reserved, type, data, dataSize);
+}
+
+
+inline LSTATUS CallRegSetKeyValueW(const HKEY hKey, const LPCWSTR subKey, const LPCWSTR valueName,
+                                   const DWORD type, const void* const data, const DWORD dataSize) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->SetKeyValue(hKey, subKey, valueName, type, data, dataSize);
+    }
+    return ::RegSetKeyValueW(hKey, subKey, valueName, type, data, dataSize);
+}
+
+
+inline LSTATUS CallRegQueryInfoKeyW(const HKEY hKey, const LPWSTR keyClass, const LPDWORD keyClassLength,
+                                    const LPDWORD reserved, const LPDWORD subKeyCount,
+                                    const LPDWORD maxSubKeyNameLength, const LPDWORD maxClassLength,
+                                    const LPDWORD valueCount, const LPDWORD maxValueNameLength,
+                                    const LPDWORD maxValueDataLength, const LPDWORD securityDescriptorSize,
+                                    FILETIME* const lastWriteTime) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->QueryInfoKey(hKey, keyClass, keyClassLength, reserved, subKeyCount,
+                                     maxSubKeyNameLength, maxClassLength, valueCount, maxValueNameLength,
+                                     maxValueDataLength, securityDescriptorSize, lastWriteTime);
+    }
+    return ::RegQueryInfoKeyW(hKey, keyClass, keyClassLength, reserved, subKeyCount,
+                              maxSubKeyNameLength, maxClassLength, valueCount, maxValueNameLength,
+                              maxValueDataLength, securityDescriptorSize, lastWriteTime);
+}
+
+
+inline LSTATUS CallRegEnumKeyExW(const HKEY hKey, const DWORD index, const LPWSTR name,
+                                 const LPDWORD nameLength, const LPDWORD reserved, const LPWSTR keyClass,
+                                 const LPDWORD keyClassLength, FILETIME* const lastWriteTime) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->EnumKeyEx(hKey, index, name, nameLength, reserved, keyClass, keyClassLength,
+                                  lastWriteTime);
+    }
+    return ::RegEnumKeyExW(hKey, index, name, nameLength, reserved, keyClass, keyClassLength,
+                           lastWriteTime);
+}
+
+
+inline LSTATUS CallRegEnumValueW(const HKEY hKey, const DWORD index, const LPWSTR valueName,
+                                 const LPDWORD valueNameLength, const LPDWORD reserved, const LPDWORD type,
+                                 BYTE* const data, const LPDWORD dataSize) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->EnumValue(hKey, index, valueName, valueNameLength, reserved, type, data, dataSize);
+    }
+    return ::RegEnumValueW(hKey, index, valueName, valueNameLength, reserved, type, data, dataSize);
+}
+
+
+inline LSTATUS CallRegDeleteValueW(const HKEY hKey, const LPCWSTR valueName) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->DeleteValue(hKey, valueName);
+    }
+    return ::RegDeleteValueW(hKey, valueName);
+}
+
+
+inline LSTATUS CallRegDeleteKeyExW(const HKEY hKey, const LPCWSTR subKey, const REGSAM desiredAccess,
+                                   const DWORD reserved) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->DeleteKeyEx(hKey, subKey, desiredAccess, reserved);
+    }
+    return ::RegDeleteKeyExW(hKey, subKey, desiredAccess, reserved);
+}
+
+
+inline LSTATUS CallRegDeleteTreeW(const HKEY hKey, const LPCWSTR subKey) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->DeleteTree(hKey, subKey);
+    }
+    return ::RegDeleteTreeW(hKey, subKey);
+}
+
+
+inline LSTATUS CallRegCopyTreeW(const HKEY hKeySource, const LPCWSTR subKey, const HKEY hKeyDest) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->CopyTree(hKeySource, subKey, hKeyDest);
+    }
+    return ::RegCopyTreeW(hKeySource, subKey, hKeyDest);
+}
+
+
+inline LSTATUS CallRegRenameKey(const HKEY hKey, const LPCWSTR subKey, const LPCWSTR newKeyName) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->RenameKey(hKey, subKey, newKeyName);
+    }
+    return ::RegRenameKey(hKey, subKey, newKeyName);
+}
+
+
+inline LSTATUS CallRegFlushKey(const HKEY hKey) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->FlushKey(hKey);
+    }
+    return ::RegFlushKey(hKey);
+}
+
+
+inline LSTATUS CallRegLoadKeyW(const HKEY hKey, const LPCWSTR subKey, const LPCWSTR fileName) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->LoadKey(hKey, subKey, fileName);
+    }
+    return ::RegLoadKeyW(hKey, subKey, fileName);
+}
+
+
+inline LSTATUS CallRegSaveKeyW(const HKEY hKey, const LPCWSTR fileName,
+                               SECURITY_ATTRIBUTES* const securityAttributes) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->SaveKey(hKey, fileName, securityAttributes);
+    }
+    return ::RegSaveKeyW(hKey, fileName, securityAttributes);
+}
+
+
+inline LSTATUS CallRegQueryReflectionKey(const HKEY hKey, BOOL* const isReflectionDisabled) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->QueryReflectionKey(hKey, isReflectionDisabled);
+    }
+    return ::RegQueryReflectionKey(hKey, isReflectionDisabled);
+}
+
+
+inline LSTATUS CallRegEnableReflectionKey(const HKEY hKey) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->EnableReflectionKey(hKey);
+    }
+    return ::RegEnableReflectionKey(hKey);
+}
+
+
+inline LSTATUS CallRegDisableReflectionKey(const HKEY hKey) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->DisableReflectionKey(hKey);
+    }
+    return ::RegDisableReflectionKey(hKey);
+}
+
+
+inline LSTATUS CallRegNotifyChangeKeyValue(const HKEY hKey, const BOOL watchSubtree, const DWORD notifyFilter,
+                                           const HANDLE event, const BOOL asynchronous) noexcept
+{
+    if (RegBackend* const backend = RegBackend::Current())
+    {
+        return backend->NotifyChangeKeyValue(hKey, watchSubtree, notifyFilter, event, asynchronous);
+    }
+    return ::RegNotifyChangeKeyValue(hKey, watchSubtree, notifyFilter, event, asynchronous);
+}
+
+
+#ifdef WINREG_ENABLE_TRACE
+
+//------------------------------------------------------------------------------
+// Ring buffer of the spans recorded by one thread for RegTrace.
+// Written by its thread, and read by RegTrace::CollectSpans.
+//------------------------------------------------------------------------------
+struct TraceBuffer
+{
+    std::mutex                Mutex;
+    std::vector<RegTraceSpan> Spans;
+    size_t                    Next{ 0 };    // slot of the next span
+    size_t                    Count{ 0 };   // number of valid spans
+    DWORD                     ThreadId{ 0 };
+};
+
+
+//------------------------------------------------------------------------------
+// Process-wide state of RegTrace
+//------------------------------------------------------------------------------
+struct TraceState
+{
+    // Protects Buffers and Options
+    std::mutex Mutex;
+
+    // The buffers of all the threads that recorded spans
+    std::vector<std::shared_ptr<TraceBuffer>> Buffers;
+
+    // The current options. Each thread caches them, and takes Mutex
+    // to copy them again only when OptionsGeneration has changed.
+    std::shared_ptr<const RegTraceOptions> Options{ std::make_shared<RegTraceOptions>() };
+    std::atomic<unsigned long long>        OptionsGeneration{ 0 };
+
+    // Paths of the keys opened or created while tracing is enabled,
+    // sharded by handle value so that threads using different keys rarely
+    // share a lock. The spans only read them, under a shared lock.
+    struct KeyPathShard
+    {
+        std::shared_mutex                      Mutex;
+        std::unordered_map<HKEY, std::wstring> Paths;
+    };
+
+    static constexpr size_t KeyPathShardCount = 16;
+    KeyPathShard            KeyPathShards[KeyPathShardCount];
+
+    // Number of tracked paths, to skip the lookups when there are none
+    std::atomic<size_t> TrackedKeyPathCount{ 0 };
+
+    [[nodiscard]] KeyPathShard& ShardOf(const HKEY hKey) noexcept
+    {
+        // Handle values are multiples of 4
+        return KeyPathShards[(reinterpret_cast<std::uintptr_t>(hKey) >> 2) % KeyPathShardCount];
+    }
+};
+
+
+[[nodiscard]] inline TraceState& GetTraceState()
+{
+    static TraceState state;
+    return state;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the ring buffer of the calling thread, registering it on first use
+//------------------------------------------------------------------------------
+[[nodiscard]] inline TraceBuffer& GetThreadTraceBuffer()
+{
+    thread_local std::shared_ptr<TraceBuffer> buffer;
+    if (!buffer)
+    {
+        auto newBuffer = std::make_shared<TraceBuffer>();
+        newBuffer->ThreadId = ::GetCurrentThreadId();
+
+        TraceState& state = GetTraceState();
+        std::lock_guard<std::mutex> lock{ state.Mutex };
+        state.Buffers.push_back(newBuffer);
+        buffer = std::move(newBuffer);
+    }
+    return *buffer;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the current options, as cached by the calling thread.
+// The pointer stays valid until the next call on the same thread.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline const std::shared_ptr<const RegTraceOptions>& GetThreadTraceOptions()
+{
+    thread_local std::shared_ptr<const RegTraceOptions> options;
+    thread_local unsigned long long generation = 0;
+
+    TraceState& state = GetTraceState();
+    const unsigned long long currentGeneration = state.OptionsGeneration.load(std::memory_order_acquire);
+    if (!options || (generation != currentGeneration))
+    {
+        std::lock_guard<std::mutex> lock{ state.Mutex };
+        options = state.Options;
+        generation = state.OptionsGeneration.load(std::memory_order_relaxed);
+    }
+    return options;
+}
+
+
+//------------------------------------------------------------------------------
+// Store the traced path of hKey\subKey (subKey can be nullptr) into path,
+// reusing its capacity
+//------------------------------------------------------------------------------
+inline void AssignTraceKeyPath(std::wstring& path, const HKEY hKey, const wchar_t* const subKey)
+{
+    path.clear();
+    if (const wchar_t* const predefinedName = PredefinedKeyName(hKey))
+    {
+        path = predefinedName;
+    }
+    else
+    {
+        TraceState& state = GetTraceState();
+        if (state.TrackedKeyPathCount.load(std::memory_order_relaxed) != 0)
+        {
+            TraceState::KeyPathShard& shard = state.ShardOf(hKey);
+            std::shared_lock<std::shared_mutex> lock{ shard.Mutex };
+            const auto it = shard.Paths.find(hKey);
+            if (it != shard.Paths.end())
+            {
+                path = it->second;
+            }
+        }
+    }
+
+    if ((subKey != nullptr) && (*subKey != L'\0'))
+    {
+        if (!path.empty())
+        {
+            path += L'\\';
+        }
+        path += subKey;
+    }
+}
+
+
+[[nodiscard]] inline std::wstring TraceKeyPath(const HKEY hKey, const wchar_t* const subKey)
+{
+    std::wstring path;
+    AssignTraceKeyPath(path, hKey, subKey);
+    return path;
+}
+
+
+//------------------------------------------------------------------------------
+// Remember (or forget) the path of a key handle, for the spans of later calls.
+// Handles are forgotten when closed or detached, whether tracing is enabled
+// or not, so that a reused handle value is never reported with a stale path.
+//------------------------------------------------------------------------------
+inline void ForgetKeyPath(const HKEY hKey) noexcept
+{
+    TraceState& state = GetTraceState();
+    if (state.TrackedKeyPathCount.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    try
+    {
+        TraceState::KeyPathShard& shard = state.ShardOf(hKey);
+        std::unique_lock<std::shared_mutex> lock{ shard.Mutex };
+        if (shard.Paths.erase(hKey) != 0)
+        {
+            state.TrackedKeyPathCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    catch (...)
+    {
+        // Just leave the entry: it is replaced if the handle value is reused
+    }
+}
+
+
+inline void TrackKeyPath(const HKEY hKey, std::wstring path) noexcept
+{
+    try
+    {
+        TraceState& state = GetTraceState();
+        TraceState::KeyPathShard& shard = state.ShardOf(hKey);
+        std::unique_lock<std::shared_mutex> lock{ shard.Mutex };
+        if (shard.Paths.insert_or_assign(hKey, std::move(path)).second)
+        {
+            state.TrackedKeyPathCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    catch (...)
+    {
+        // The key will be traced without its path
+        ForgetKeyPath(hKey);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Measure one registry call, and record it as a span for RegTrace
+//------------------------------------------------------------------------------
+class TraceCall
+{
+public:
+
+    // Start measuring
+    TraceCall(const char* const operation, const char* const api) noexcept
+        : m_operation{ operation }
+        , m_api{ api }
+        , m_start{ std::chrono::steady_clock::now() }
+    {}
+
+    // Record the span of the completed call.
+    // Failures while recording (e.g. out of memory) just drop the span.
+    void Finish(
+        const HKEY hKey,
+        const wchar_t* const subKey,
+        const wchar_t* const valueName,
+        const ULONGLONG bytes,
+        const LSTATUS result
+    ) noexcept
+    {
+        const auto end = std::chrono::steady_clock::now();
+
+        try
+        {
+            const RegTraceOptions* const options = GetThreadTraceOptions().get();
+            if (options->SpansPerThread == 0)
+            {
+                return;
+            }
+
+            TraceBuffer& buffer = GetThreadTraceBuffer();
+            RegTraceSpan slowSpan;
+            bool isSlow = false;
+            {
+                std::lock_guard<std::mutex> lock{ buffer.Mutex };
+                if (buffer.Spans.size() != options->SpansPerThread)
+                {
+                    buffer.Spans.clear();
+                    buffer.Spans.resize(options->SpansPerThread);
+                    buffer.Next = 0;
+                    buffer.Count = 0;
+                }
+
+                // Reuse the slot strings, to avoid allocations in the steady state
+                RegTraceSpan& span = buffer.Spans[buffer.Next];
+                span.Operation = m_operation;
+                span.Api = m_api;
+                AssignTraceKeyPath(span.KeyPath, hKey, subKey);
+                span.ValueName.assign((valueName != nullptr) ? valueName : L"");
+                span.Bytes = bytes;
+                span.Result = result;
+                span.ThreadId = buffer.ThreadId;
+                span.StartNanoseconds = static_cast<ULONGLONG>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(m_start.time_since_epoch()).count());
+                span.DurationNanoseconds = static_cast<ULONGLONG>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count());
+
+                buffer.Next = (buffer.Next + 1) % buffer.Spans.size();
+                if (buffer.Count < buffer.Spans.size())
+                {
+                    buffer.Count++;
+                }
+
+                isSlow = options->SlowOperationHandler && ((end - m_start) >= options->SlowThreshold);
+                if (isSlow)
+                {
+                    slowSpan = span;
+                }
+            }
+
+            // Call the handler without holding the buffer lock, as it may use
+            // the registry; its own slow calls are not reported to it again
+            thread_local bool inSlowOperationHandler = false;
+            if (isSlow && !inSlowOperationHandler)
+            {
+                // Keep the options alive, even if the handler re-enables tracing
+                const std::shared_ptr<const RegTraceOptions> handlerOptions = GetThreadTraceOptions();
+                inSlowOperationHandler = true;
+                try
+                {
+                    handlerOptions->SlowOperationHandler(slowSpan);
+                }
+                catch (...)
+                {
+                }
+                inSlowOperationHandler = false;
+            }
+        }
+        catch (...)
+        {
+            // Drop the span
+        }
+    }
+
+private:
+    const char*                           m_operation;
+    const char*                           m_api;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+
+//------------------------------------------------------------------------------
+// Traced wrappers of the Windows Registry API functions used by WinReg.
+//
+// Each wrapper takes the name of the calling function, followed by the
+// parameters of the wrapped API. When tracing is disabled, it just calls
+// the API (through the CallReg functions above).
+//------------------------------------------------------------------------------
+
+inline LSTATUS TracedRegOpenKeyExW(const char* const operation, const HKEY hKey, const LPCWSTR subKey,
+                                   const DWORD options, const REGSAM desiredAccess, const PHKEY result) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegOpenKeyExW(hKey, subKey, options, desiredAccess, result);
+    }
+
+    TraceCall trace{ operation, "RegOpenKeyExW" };
+    const LSTATUS retCode = CallRegOpenKeyExW(hKey, subKey, options, desiredAccess, result);
+    trace.Finish(hKey, subKey, nullptr, 0, retCode);
+    if (retCode == ERROR_SUCCESS)
+    {
+        try
+        {
+            TrackKeyPath(*result, TraceKeyPath(hKey, subKey));
+        }
+        catch (...)
+        {
+        }
+    }
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegCreateKeyExW(const char* const operation, const HKEY hKey, const LPCWSTR subKey,
+                                     const DWORD reserved, const LPWSTR keyClass, const DWORD options,
+                                     const REGSAM desiredAccess,
+                                     SECURITY_ATTRIBUTES* const securityAttributes,
+                                     const PHKEY result, const LPDWORD disposition) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegCreateKeyExW(hKey, subKey, reserved, keyClass, options, desiredAccess,
+                                   securityAttributes, result, disposition);
+    }
+
+    TraceCall trace{ operation, "RegCreateKeyExW" };
+    const LSTATUS retCode = CallRegCreateKeyExW(hKey, subKey, reserved, keyClass, options, desiredAccess,
+                                                securityAttributes, result, disposition);
+    trace.Finish(hKey, subKey, nullptr, 0, retCode);
+    if (retCode == ERROR_SUCCESS)
+    {
+        try
+        {
+            TrackKeyPath(*result, TraceKeyPath(hKey, subKey));
+        }
+        catch (...)
+        {
+        }
+    }
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegCloseKey(const HKEY hKey) noexcept
+{
+    // Also when tracing is disabled, as the handle may have been tracked
+    // before; this is just an atomic load when no path is tracked
+    ForgetKeyPath(hKey);
+    return CallRegCloseKey(hKey);
+}
+
+
+inline LSTATUS TracedRegConnectRegistryW(const char* const operation, const LPCWSTR machineName,
+                                         const HKEY hKey, const PHKEY result) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegConnectRegistryW(machineName, hKey, result);
+    }
+
+    TraceCall trace{ operation, "RegConnectRegistryW" };
+    const LSTATUS retCode = CallRegConnectRegistryW(machineName, hKey, result);
+    trace.Finish(hKey, nullptr, nullptr, 0, retCode);
+    if (retCode == ERROR_SUCCESS)
+    {
+        try
+        {
+            std::wstring path = (machineName != nullptr) ? machineName : L"";
+            path += L'\\';
+            path += TraceKeyPath(hKey, nullptr);
+            TrackKeyPath(*result, std::move(path));
+        }
+        catch (...)
+        {
+        }
+    }
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegGetValueW(const char* const operation, const HKEY hKey, const LPCWSTR subKey,
+                                  const LPCWSTR valueName, const DWORD flags, const LPDWORD type,
+                                  void* const data, const LPDWORD dataSize) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegGetValueW(hKey, subKey, valueName, flags, type, data, dataSize);
+    }
+
+    TraceCall trace{ operation, "RegGetValueW" };
+    const LSTATUS retCode = CallRegGetValueW(hKey, subKey, valueName, flags, type, data, dataSize);
+    trace.Finish(hKey, subKey, valueName, (dataSize != nullptr) ? *dataSize : 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegQueryValueExW(const char* const operation, const HKEY hKey, const LPCWSTR valueName,
+                                      const LPDWORD reserved, const LPDWORD type,
+                                      BYTE* const data, const LPDWORD dataSize) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegQueryValueExW(hKey, valueName, reserved, type, data, dataSize);
+    }
+
+    TraceCall trace{ operation, "RegQueryValueExW" };
+    const LSTATUS retCode = CallRegQueryValueExW(hKey, valueName, reserved, type, data, dataSize);
+    trace.Finish(hKey, nullptr, valueName, (dataSize != nullptr) ? *dataSize : 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegSetValueExW(const char* const operation, const HKEY hKey, const LPCWSTR valueName,
+                                    const DWORD reserved, const DWORD type,
+                                    const BYTE* const data, const DWORD dataSize) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegSetValueExW(hKey, valueName, reserved, type, data, dataSize);
+    }
+
+    TraceCall trace{ operation, "RegSetValueExW" };
+    const LSTATUS retCode = CallRegSetValueExW(hKey, valueName, reserved, type, data, dataSize);
+    trace.Finish(hKey, nullptr, valueName, dataSize, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegSetKeyValueW(const char* const operation, const HKEY hKey, const LPCWSTR subKey,
+                                     const LPCWSTR valueName, const DWORD type,
+                                     const LPCVOID data, const DWORD dataSize) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegSetKeyValueW(hKey, subKey, valueName, type, data, dataSize);
+    }
+
+    TraceCall trace{ operation, "RegSetKeyValueW" };
+    const LSTATUS retCode = CallRegSetKeyValueW(hKey, subKey, valueName, type, data, dataSize);
+    trace.Finish(hKey, subKey, valueName, dataSize, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegQueryInfoKeyW(const char* const operation, const HKEY hKey,
+                                      const LPWSTR keyClass, const LPDWORD keyClassLength,
+                                      const LPDWORD reserved,
+                                      const LPDWORD subKeyCount, const LPDWORD maxSubKeyNameLength,
+                                      const LPDWORD maxClassLength,
+                                      const LPDWORD valueCount, const LPDWORD maxValueNameLength,
+                                      const LPDWORD maxValueDataLength,
+                                      const LPDWORD securityDescriptorSize,
+                                      FILETIME* const lastWriteTime) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegQueryInfoKeyW(hKey, keyClass, keyClassLength, reserved, subKeyCount,
+                                    maxSubKeyNameLength, maxClassLength, valueCount, maxValueNameLength,
+                                    maxValueDataLength, securityDescriptorSize, lastWriteTime);
+    }
+
+    TraceCall trace{ operation, "RegQueryInfoKeyW" };
+    const LSTATUS retCode = CallRegQueryInfoKeyW(hKey, keyClass, keyClassLength, reserved, subKeyCount,
+                                                 maxSubKeyNameLength, maxClassLength, valueCount,
+                                                 maxValueNameLength, maxValueDataLength,
+                                                 securityDescriptorSize, lastWriteTime);
+    trace.Finish(hKey, nullptr, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegEnumKeyExW(const char* const operation, const HKEY hKey, const DWORD index,
+                                   const LPWSTR name, const LPDWORD nameLength, const LPDWORD reserved,
+                                   const LPWSTR keyClass, const LPDWORD keyClassLength,
+                                   FILETIME* const lastWriteTime) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegEnumKeyExW(hKey, index, name, nameLength, reserved, keyClass, keyClassLength,
+                                 lastWriteTime);
+    }
+
+    TraceCall trace{ operation, "RegEnumKeyExW" };
+    const LSTATUS retCode = CallRegEnumKeyExW(hKey, index, name, nameLength, reserved, keyClass,
+                                              keyClassLength, lastWriteTime);
+    // The span is about the enumerated key, not about the returned subkey
+    trace.Finish(hKey, nullptr, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegEnumValueW(const char* const operation, const HKEY hKey, const DWORD index,
+                                   const LPWSTR valueName, const LPDWORD valueNameLength,
+                                   const LPDWORD reserved, const LPDWORD type,
+                                   BYTE* const data, const LPDWORD dataSize) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegEnumValueW(hKey, index, valueName, valueNameLength, reserved, type, data, dataSize);
+    }
+
+    TraceCall trace{ operation, "RegEnumValueW" };
+    const LSTATUS retCode = CallRegEnumValueW(hKey, index, valueName, valueNameLength, reserved, type,
+                                              data, dataSize);
+    trace.Finish(hKey, nullptr, (retCode == ERROR_SUCCESS) ? valueName : nullptr,
+                 (dataSize != nullptr) ? *dataSize : 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegDeleteValueW(const char* const operation, const HKEY hKey, const LPCWSTR valueName) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegDeleteValueW(hKey, valueName);
+    }
+
+    TraceCall trace{ operation, "RegDeleteValueW" };
+    const LSTATUS retCode = CallRegDeleteValueW(hKey, valueName);
+    trace.Finish(hKey, nullptr, valueName, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegDeleteKeyExW(const char* const operation, const HKEY hKey, const LPCWSTR subKey,
+                                     const REGSAM desiredAccess, const DWORD reserved) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegDeleteKeyExW(hKey, subKey, desiredAccess, reserved);
+    }
+
+    TraceCall trace{ operation, "RegDeleteKeyExW" };
+    const LSTATUS retCode = CallRegDeleteKeyExW(hKey, subKey, desiredAccess, reserved);
+    trace.Finish(hKey, subKey, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegDeleteTreeW(const char* const operation, const HKEY hKey, const LPCWSTR subKey) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegDeleteTreeW(hKey, subKey);
+    }
+
+    TraceCall trace{ operation, "RegDeleteTreeW" };
+    const LSTATUS retCode = CallRegDeleteTreeW(hKey, subKey);
+    trace.Finish(hKey, subKey, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegCopyTreeW(const char* const operation, const HKEY hKeySource,
+                                  const LPCWSTR subKey, const HKEY hKeyDest) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegCopyTreeW(hKeySource, subKey, hKeyDest);
+    }
+
+    TraceCall trace{ operation, "RegCopyTreeW" };
+    const LSTATUS retCode = CallRegCopyTreeW(hKeySource, subKey, hKeyDest);
+    trace.Finish(hKeySource, subKey, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegRenameKey(const char* const operation, const HKEY hKey,
+                                  const LPCWSTR subKey, const LPCWSTR newKeyName) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegRenameKey(hKey, subKey, newKeyName);
+    }
+
+    TraceCall trace{ operation, "RegRenameKey" };
+    const LSTATUS retCode = CallRegRenameKey(hKey, subKey, newKeyName);
+    trace.Finish(hKey, subKey, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegFlushKey(const char* const operation, const HKEY hKey) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegFlushKey(hKey);
+    }
+
+    TraceCall trace{ operation, "RegFlushKey" };
+    const LSTATUS retCode = CallRegFlushKey(hKey);
+    trace.Finish(hKey, nullptr, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegLoadKeyW(const char* const operation, const HKEY hKey,
+                                 const LPCWSTR subKey, const LPCWSTR fileName) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegLoadKeyW(hKey, subKey, fileName);
+    }
+
+    TraceCall trace{ operation, "RegLoadKeyW" };
+    const LSTATUS retCode = CallRegLoadKeyW(hKey, subKey, fileName);
+    trace.Finish(hKey, subKey, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegSaveKeyW(const char* const operation, const HKEY hKey, const LPCWSTR fileName,
+                                 SECURITY_ATTRIBUTES* const securityAttributes) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegSaveKeyW(hKey, fileName, securityAttributes);
+    }
+
+    TraceCall trace{ operation, "RegSaveKeyW" };
+    const LSTATUS retCode = CallRegSaveKeyW(hKey, fileName, securityAttributes);
+    trace.Finish(hKey, nullptr, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegQueryReflectionKey(const char* const operation, const HKEY hKey,
+                                           BOOL* const isReflectionDisabled) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegQueryReflectionKey(hKey, isReflectionDisabled);
+    }
+
+    TraceCall trace{ operation, "RegQueryReflectionKey" };
+    const LSTATUS retCode = CallRegQueryReflectionKey(hKey, isReflectionDisabled);
+    trace.Finish(hKey, nullptr, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegEnableReflectionKey(const char* const operation, const HKEY hKey) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegEnableReflectionKey(hKey);
+    }
+
+    TraceCall trace{ operation, "RegEnableReflectionKey" };
+    const LSTATUS retCode = CallRegEnableReflectionKey(hKey);
+    trace.Finish(hKey, nullptr, nullptr, 0, retCode);
+    return retCode;
+}
+
+
+inline LSTATUS TracedRegDisableReflectionKey(const char* const operation, const HKEY hKey) noexcept
+{
+    if (!RegTrace::IsEnabled())
+    {
+        return CallRegDisableReflectionKey(hKey);
+    }
+
+    TraceCall trace{ operation, "RegDisableReflectionKey" };
+    const LSTATUS retCode = CallRegDisableReflectionKey(hKey);
+    trace.Finish(hKey, nullptr, nullptr, 0, retCode);
+    return retCode;
+}
+
+#else // WINREG_ENABLE_TRACE
+
+//------------------------------------------------------------------------------
+// Without WINREG_ENABLE_TRACE, the wrappers of the Windows Registry API
+// functions just call the API: they take the same parameters as the traced
+// ones (see above), so the code calling them is the same in both builds.
+//------------------------------------------------------------------------------
+
+inline LSTATUS TracedRegOpenKeyExW(const char* /* operation */, const HKEY hKey, const LPCWSTR subKey,
+                                   const DWORD options, const REGSAM desiredAccess, const PHKEY result) noexcept
+{
+    return CallRegOpenKeyExW(hKey, subKey, options, desiredAccess, result);
+}
+
+
+inline LSTATUS TracedRegCreateKeyExW(const char* /* operation */, const HKEY hKey, const LPCWSTR subKey,
+                                     const DWORD reserved, const LPWSTR keyClass, const DWORD options,
+                                     const REGSAM desiredAccess,
+                                     SECURITY_ATTRIBUTES* const securityAttributes,
+                                     const PHKEY result, const LPDWORD disposition) noexcept
+{
+    return CallRegCreateKeyExW(hKey, subKey, reserved, keyClass, options, desiredAccess,
+                               securityAttributes, result, disposition);
+}
+
+
+inline LSTATUS TracedRegCloseKey(const HKEY hKey) noexcept
+{
+    return CallRegCloseKey(hKey);
+}
+
+
+inline LSTATUS TracedRegConnectRegistryW(const char* /* operation */, const LPCWSTR machineName,
+                                         const HKEY hKey, const PHKEY result) noexcept
+{
+    return CallRegConnectRegistryW(machineName, hKey, result);
+}
+
+
+inline LSTATUS TracedRegGetValueW(const char* /* operation */, const HKEY hKey, const LPCWSTR subKey,
+                                  const LPCWSTR valueName, const DWORD flags, const LPDWORD type,
+                                  void* const data, const LPDWORD dataSize) noexcept
+{
+    return CallRegGetValueW(hKey, subKey, valueName, flags, type, data, dataSize);
+}
+
+
+inline LSTATUS TracedRegQueryValueExW(const char* /* operation */, const HKEY hKey, const LPCWSTR valueName,
+                                      const LPDWORD reserved, const LPDWORD type,
+                                      BYTE* const data, const LPDWORD dataSize) noexcept
+{
+    return CallRegQueryValueExW(hKey, valueName, reserved, type, data, dataSize);
+}
+
+
+inline LSTATUS TracedRegSetValueExW(const char* /* operation */, const HKEY hKey, const LPCWSTR valueName,
+                                    const DWORD reserved, const DWORD type,
+                                    const BYTE* const data, const DWORD dataSize) noexcept
+{
+    return CallRegSetValueExW(hKey, valueName, reserved, type, data, dataSize);
+}
+
+
+inline LSTATUS TracedRegSetKeyValueW(const char* /* operation */, const HKEY hKey, const LPCWSTR subKey,
+                                     const LPCWSTR valueName, const DWORD type,
+                                     const LPCVOID data, const DWORD dataSize) noexcept
+{
+    return CallRegSetKeyValueW(hKey, subKey, valueName, type, data, dataSize);
+}
+
+
+inline LSTATUS TracedRegQueryInfoKeyW(const char* /* operation */, const HKEY hKey,
+                                      const LPWSTR keyClass, const LPDWORD keyClassLength,
+                                      const LPDWORD reserved,
+                                      const LPDWORD subKeyCount, const LPDWORD maxSubKeyNameLength,
+                                      const LPDWORD maxClassLength,
+                                      const LPDWORD valueCount, const LPDWORD maxValueNameLength,
+                                      const LPDWORD maxValueDataLength,
+                                      const LPDWORD securityDescriptorSize,
+                                      FILETIME* const lastWriteTime) noexcept
+{
+    return CallRegQueryInfoKeyW(hKey, keyClass, keyClassLength, reserved, subKeyCount,
+                                maxSubKeyNameLength, maxClassLength, valueCount, maxValueNameLength,
+                                maxValueDataLength, securityDescriptorSize, lastWriteTime);
+}
+
+
+inline LSTATUS TracedRegEnumKeyExW(const char* /* operation */, const HKEY hKey, const DWORD index,
+                                   const LPWSTR name, const LPDWORD nameLength, const LPDWORD reserved,
+                                   const LPWSTR keyClass, const LPDWORD keyClassLength,
+                                   FILETIME* const lastWriteTime) noexcept
+{
+    return CallRegEnumKeyExW(hKey, index, name, nameLength, reserved, keyClass, keyClassLength,
+                             lastWriteTime);
+}
+
+
+inline LSTATUS TracedRegEnumValueW(const char* /* operation */, const HKEY hKey, const DWORD index,
+                                   const LPWSTR valueName, const LPDWORD valueNameLength,
+                                   const LPDWORD reserved, const LPDWORD type,
+                                   BYTE* const data, const LPDWORD dataSize) noexcept
+{
+    return CallRegEnumValueW(hKey, index, valueName, valueNameLength, reserved, type, data, dataSize);
+}
+
+
+inline LSTATUS TracedRegDeleteValueW(const char* /* operation */, const HKEY hKey, const LPCWSTR valueName) noexcept
+{
+    return CallRegDeleteValueW(hKey, valueName);
+}
+
+
+inline LSTATUS TracedRegDeleteKeyExW(const char* /* operation */, const HKEY hKey, const LPCWSTR subKey,
+                                     const REGSAM desiredAccess, const DWORD reserved) noexcept
+{
+    return CallRegDeleteKeyExW(hKey, subKey, desiredAccess, reserved);
+}
+
+
+inline LSTATUS TracedRegDeleteTreeW(const char* /* operation */, const HKEY hKey, const LPCWSTR subKey) noexcept
+{
+    return CallRegDeleteTreeW(hKey, subKey);
+}
+
+
+inline LSTATUS TracedRegCopyTreeW(const char* /* operation */, const HKEY hKeySource,
+                                  const LPCWSTR subKey, const HKEY hKeyDest) noexcept
+{
+    return CallRegCopyTreeW(hKeySource, subKey, hKeyDest);
+}
+
+
+inline LSTATUS TracedRegRenameKey(const char* /* operation */, const HKEY hKey,
+                                  const LPCWSTR subKey, const LPCWSTR newKeyName) noexcept
+{
+    return CallRegRenameKey(hKey, subKey, newKeyName);
+}
+
+
+inline LSTATUS TracedRegFlushKey(const char* /* operation */, const HKEY hKey) noexcept
+{
+    return CallRegFlushKey(hKey);
+}
+
+
+inline LSTATUS TracedRegLoadKeyW(const char* /* operation */, const HKEY hKey,
+                                 const LPCWSTR subKey, const LPCWSTR fileName) noexcept
+{
+    return CallRegLoadKeyW(hKey, subKey, fileName);
+}
+
+
+inline LSTATUS TracedRegSaveKeyW(const char* /* operation */, const HKEY hKey, const LPCWSTR fileName,
+                                 SECURITY_ATTRIBUTES* const securityAttributes) noexcept
+{
+    return CallRegSaveKeyW(hKey, fileName, securityAttributes);
+}
+
+
+inline LSTATUS TracedRegQueryReflectionKey(const char* /* operation */, const HKEY hKey,
+                                           BOOL* const isReflectionDisabled) noexcept
+{
+    return CallRegQueryReflectionKey(hKey, isReflectionDisabled);
+}
+
+
+inline LSTATUS TracedRegEnableReflectionKey(const char* /* operation */, const HKEY hKey) noexcept
+{
+    return CallRegEnableReflectionKey(hKey);
+}
+
+
+inline LSTATUS TracedRegDisableReflectionKey(const char* /* operation */, const HKEY hKey) noexcept
+{
+    return CallRegDisableReflectionKey(hKey);
+}
+
+#endif // WINREG_ENABLE_TRACE
+
+
+#ifdef WINREG_ENABLE_ALLOCATION_STATS
+
+//------------------------------------------------------------------------------
+// Allocation counters of one thread for RegAllocationStats.
+// Written by its thread, and read (or zeroed) by the RegAllocationStats methods.
+//------------------------------------------------------------------------------
+struct AllocationCounterBlock
+{
+    static constexpr size_t kCategoryCount = static_cast<size_t>(RegAllocationCategory::Count);
+
+    std::array<std::atomic<ULONGLONG>, kCategoryCount> Allocations{};
+    std::array<std::atomic<ULONGLONG>, kCategoryCount> Bytes{};
+};
+
+
+//------------------------------------------------------------------------------
+// Process-wide state of RegAllocationStats
+//------------------------------------------------------------------------------
+struct AllocationStatsState
+{
+    // Protects Blocks
+    std::mutex Mutex;
+
+    // The counters of all the threads that made accounted allocations
+    std::vector<std::shared_ptr<AllocationCounterBlock>> Blocks;
+};
+
+
+[[nodiscard]] inline AllocationStatsState& GetAllocationStatsState()
+{
+    static AllocationStatsState state;
+    return state;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the allocation counters of the calling thread, registering them
+// on first use
+//------------------------------------------------------------------------------
+[[nodiscard]] inline AllocationCounterBlock& GetThreadAllocationCounters()
+{
+    thread_local std::shared_ptr<AllocationCounterBlock> counters;
+    if (!counters)
+    {
+        auto newCounters = std::make_shared<AllocationCounterBlock>();
+
+        AllocationStatsState& state = GetAllocationStatsState();
+        std::lock_guard<std::mutex> lock{ state.Mutex };
+        state.Blocks.push_back(newCounters);
+        counters = std::move(newCounters);
+    }
+    return *counters;
+}
+
+
+inline void RecordAllocation(const RegAllocationCategory category, const size_t bytes) noexcept
+{
+    try
+    {
+        AllocationCounterBlock& counters = GetThreadAllocationCounters();
+        const size_t index = static_cast<size_t>(category);
+        counters.Allocations[index].fetch_add(1, std::memory_order_relaxed);
+        counters.Bytes[index].fetch_add(bytes, std::memory_order_relaxed);
+    }
+    catch (...)
+    {
+        // Registering the counters of this thread failed: drop the sample
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Account the growth of a standard container filled by WinReg:
+// a capacity larger than previousCapacity means that it was (re)allocated
+//------------------------------------------------------------------------------
+template <typename Container>
+inline void AccountCapacityGrowth(
+    const RegAllocationCategory category,
+    const Container& container,
+    const size_t previousCapacity
+) noexcept
+{
+    if (container.capacity() > previousCapacity)
+    {
+        RecordAllocation(category, container.capacity() * sizeof(typename Container::value_type));
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Account the storage of a newly built string, if it doesn't fit
+// in the small string buffer
+//------------------------------------------------------------------------------
+inline void AccountStringStorage(const RegAllocationCategory category, const std::wstring& s) noexcept
+{
+    AccountCapacityGrowth(category, s, std::wstring{}.capacity());
+}
+
+
+//------------------------------------------------------------------------------
+// Account the strings returned by a multi-string getter: the buffer
+// of the vector, and the storage of the strings that don't fit
+// in the small string buffer
+//------------------------------------------------------------------------------
+inline void AccountMultiStringResult(const std::vector<std::wstring>& strings) noexcept
+{
+    AccountCapacityGrowth(RegAllocationCategory::MultiStringValue, strings, 0);
+    for (const auto& s : strings)
+    {
+        AccountStringStorage(RegAllocationCategory::MultiStringValue, s);
+    }
+}
+
+#else // WINREG_ENABLE_ALLOCATION_STATS
+
+// Without allocation accounting, these compile to nothing
+
+inline void RecordAllocation(RegAllocationCategory /* category */, size_t /* bytes */) noexcept
+{
+}
+
+inline void AccountStringStorage(RegAllocationCategory /* category */, const std::wstring& /* s */) noexcept
+{
+}
+
+inline void AccountMultiStringResult(const std::vector<std::wstring>& /* strings */) noexcept
+{
+}
+
+#endif // WINREG_ENABLE_ALLOCATION_STATS
+
+
+//------------------------------------------------------------------------------
+// Resize or reserve a standard container, accounting its growth
+//------------------------------------------------------------------------------
+template <typename Container>
+inline void ResizeAccounted([[maybe_unused]] const RegAllocationCategory category, Container& container, const size_t newSize)
+{
+#ifdef WINREG_ENABLE_ALLOCATION_STATS
+    const size_t previousCapacity = container.capacity();
+    container.resize(newSize);
+    AccountCapacityGrowth(category, container, previousCapacity);
+#else // WINREG_ENABLE_ALLOCATION_STATS
+    container.resize(newSize);
+#endif // WINREG_ENABLE_ALLOCATION_STATS
+}
+
+
+template <typename Container>
+inline void ReserveAccounted([[maybe_unused]] const RegAllocationCategory category, Container& container, const size_t newCapacity)
+{
+#ifdef WINREG_ENABLE_ALLOCATION_STATS
+    const size_t previousCapacity = container.capacity();
+    container.reserve(newCapacity);
+    AccountCapacityGrowth(category, container, previousCapacity);
+#else // WINREG_ENABLE_ALLOCATION_STATS
+    container.reserve(newCapacity);
+#endif // WINREG_ENABLE_ALLOCATION_STATS
+}
+
+
+//------------------------------------------------------------------------------
+// Helper function to build a multi-string from a vector<wstring>.
+//
+// A multi-string is a sequence of contiguous NUL-terminated strings,
+// that terminates with an additional NUL.
+// Basically, considered as a whole, the sequence is terminated by two NULs.
+// E.g.:
+//          Hello\0World\0\0
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::vector<wchar_t> BuildMultiString(const std::vector<std::wstring>& data)
+{
+    // Special case of the empty multi-string
+    if (data.empty())
+    {
+        // Build a vector containing just two NULs
+        return std::vector<wchar_t>(2, L'\0');
+    }
+
+    // Get the total length in wchar_ts of the multi-string
+    size_t totalLen = 0;
+    for (const auto& s : data)
+    {
+        // Add one to current string's length for the terminating NUL
+        totalLen += (s.length() + 1);
+    }
+
+    // Add one for the last NUL terminator (making the whole structure double-NUL terminated)
+    totalLen++;
+
+    // Allocate a buffer to store the multi-string
+    std::vector<wchar_t> multiString;
+
+    // Reserve room in the vector to speed up the following insertion loop
+    multiString.reserve(totalLen);
+
+    // Copy the single strings into the multi-string
+    for (const auto& s : data)
+    {
+        if (!s.empty())
+        {
+            // Copy current string's content
+            multiString.insert(multiString.end(), s.begin(), s.end());
+        }
+
+        // Don't forget to NUL-terminate the current string
+        // (or just insert L'\0' for empty strings)
+        multiString.emplace_back(L'\0');
+    }
+
+    // Add the last NUL-terminator
+    multiString.emplace_back(L'\0');
+
+    return multiString;
+}
+
+
+//------------------------------------------------------------------------------
+// Return true if the wchar_t sequence stored in 'data' terminates
+// with two null (L'\0') wchar_t's
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool IsDoubleNullTerminated(const std::vector<wchar_t>& data)
+{
+    // First check that there's enough room for at least two nulls
+    if (data.size() < 2)
+    {
+        return false;
+    }
+
+    // Check that the sequence terminates with two nulls (L'\0', L'\0')
+    const size_t lastPosition = data.size() - 1;
+    return ((data[lastPosition]     == L'\0')  &&
+            (data[lastPosition - 1] == L'\0')) ? true : false;
+}
+
+
+//------------------------------------------------------------------------------
+// Given a sequence of wchar_ts representing a double-null-terminated string,
+// returns a vector of wstrings that represent the single strings.
+//
+// Also supports embedded empty strings in the sequence.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::vector<std::wstring> ParseMultiString(const std::vector<wchar_t>& data)
+{
+    // Make sure that there are two terminating L'\0's at the end of the sequence
+    if (!IsDoubleNullTerminated(data))
+    {
+        throw RegException{ ERROR_INVALID_DATA, "Not a double-null terminated string." };
+    }
+
+    // Parse the double-NUL-terminated string into a vector<wstring>,
+    // which will be returned to the caller
+    std::vector<std::wstring> result;
+
+    //
+    // Note on Embedded Empty Strings
+    // ==============================
+    //
+    // Below commented-out there is the previous parsing code,
+    // that assumes that an empty string *terminates* the sequence.
+    //
+    // In fact, according to the official Microsoft MSDN documentation,
+    // an empty string is treated as a sequence terminator,
+    // so you can't have empty strings inside the sequence.
+    //
+    // Source: https://docs.microsoft.com/en-us/windows/win32/sysinfo/registry-value-types
+    //      "A REG_MULTI_SZ string ends with a string of length 0.
+    //       Therefore, it is not possible to include a zero-length string
+    //       in the sequence. An empty sequence would be defined as follows: \0."
+    //
+    // Unfortunately, it seems that Microsoft violates its own rule, for example
+    // in the PendingFileRenameOperations value under the
+    // "SYSTEM\CurrentControlSet\Control\Session Manager" key.
+    // This is a REG_MULTI_SZ value that does contain embedded empty strings.
+    //
+    // So, I changed the previous parsing code to support also embedded empty strings.
+    //
+    // -------------------------------------------------------------------------
+    //// *** Previous parsing code - Assumes an empty string terminates the sequence ***
+    //
+    //const wchar_t* currStringPtr = data.data();
+    //while (*currStringPtr != L'\0')
+    //{
+    //    // Current string is NUL-terminated, so get its length calling wcslen
+    //    const size_t currStringLength = wcslen(currStringPtr);
+    //
+    //    // Add current string to the result vector
+    //    result.emplace_back(currStringPtr, currStringLength);
+    //
+    //    // Move to the next string
+    //    currStringPtr += currStringLength + 1;
+    //}
+    // -------------------------------------------------------------------------
+    //
+
+    const wchar_t* currStringPtr = data.data();
+    const wchar_t* const endPtr  = data.data() + data.size() - 1;
+
+    // Each string of the sequence ends with one of these NULs:
+    // allocate the vector once
+    result.reserve(static_cast<size_t>(std::count(currStringPtr, endPtr, L'\0')));
+
+    while (currStringPtr < endPtr)
+    {
+        // Current string is NUL-terminated, so get its length calling wcslen
+        const size_t currStringLength = wcslen(currStringPtr);
+
+        // Add current string to the result vector
+        if (currStringLength > 0)
+        {
+            result.emplace_back(currStringPtr, currStringLength);
+        }
+        else
+        {
+            // Insert empty strings, as well
+            result.emplace_back(std::wstring{});
+        }
+
+        // Move to the next string, skipping the terminating NUL
+        currStringPtr += currStringLength + 1;
+    }
+
+    return result;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the position of the first wchar_t in [s, s + length) that is a NUL
+// or an unpaired surrogate, or length if the sequence is well-formed UTF-16.
+//
+// With 16-bit code units, four of them are checked at once in a 64-bit word
+// (SWAR, portable C++ without intrinsics), so clean strings are skipped
+// a word at a time; the scalar loop only looks at words that contain a NUL
+// or a surrogate. Templated on the code unit type so that it's also usable
+// (and testable) with char16_t data.
+//------------------------------------------------------------------------------
+template <typename CharT>
+[[nodiscard]] inline size_t FindInvalidUtf16(const CharT* const s, const size_t length) noexcept
+{
+    constexpr std::uint32_t surrogateMask = 0xFFFF'F800;  // 0xD800-0xDFFF
+    constexpr std::uint32_t pairHalfMask  = 0xFFFF'FC00;  // 0xD800-0xDBFF, 0xDC00-0xDFFF
+
+    size_t pos = 0;
+    while (pos < length)
+    {
+        if constexpr (sizeof(CharT) == 2)
+        {
+            constexpr std::uint64_t ones  = 0x0001'0001'0001'0001ULL;
+            constexpr std::uint64_t highs = 0x8000'8000'8000'8000ULL;
+
+            // Non-zero if some lane of the word is a NUL or a surrogate
+            const auto invalidLanes = [](const std::uint64_t word) noexcept
+            {
+                // Lanes that are zero here are surrogates
+                const std::uint64_t surrogates = (word & 0xF800'F800'F800'F800ULL)
+                                                 ^ 0xD800'D800'D800'D800ULL;
+
+                return (((word - ones) & ~word) | ((surrogates - ones) & ~surrogates)) & highs;
+            };
+
+            // Skip whole words without NULs and surrogates
+            while (pos + 4 <= length)
+            {
+                std::uint64_t word = 0;
+                std::memcpy(&word, s + pos, sizeof(word));
+                if (invalidLanes(word) != 0)
+                {
+                    break;
+                }
+
+                pos += 4;
+            }
+
+            if (pos == length)
+            {
+                break;
+            }
+        }
+
+        const std::uint32_t c = static_cast<std::uint32_t>(s[pos]);
+        if (c == 0)
+        {
+            return pos;
+        }
+
+        if ((c & surrogateMask) != 0xD800)
+        {
+            ++pos;
+            continue;
+        }
+
+        // A high surrogate must be followed by a low surrogate
+        if ((c & pairHalfMask) == 0xD800
+            && pos + 1 < length
+            && (static_cast<std::uint32_t>(s[pos + 1]) & pairHalfMask) == 0xDC00)
+        {
+            pos += 2;
+            continue;
+        }
+
+        return pos;
+    }
+
+    return length;
+}
+
+
+//------------------------------------------------------------------------------
+// Return true if the string is well-formed UTF-16 without NULs
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool IsValidUtf16(const std::wstring_view s) noexcept
+{
+    return FindInvalidUtf16(s.data(), s.length()) == s.length();
+}
+
+
+//------------------------------------------------------------------------------
+// Return a copy of 's' with each NUL and unpaired surrogate replaced by U+FFFD.
+// With RegStringValidation::TruncateAtNul, the string is cut at the first NUL
+// instead.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::wstring RepairUtf16(
+    const RegAllocationCategory category,
+    std::wstring_view s,
+    const RegStringValidation validation)
+{
+    if (validation == RegStringValidation::TruncateAtNul)
+    {
+        s = s.substr(0, s.find(L'\0'));
+    }
+
+    constexpr wchar_t replacementCharacter = 0xFFFD;
+
+    std::wstring result;
+    result.reserve(s.length());
+
+    size_t start = 0;
+    while (start < s.length())
+    {
+        const size_t invalidPos = start + FindInvalidUtf16(s.data() + start, s.length() - start);
+
+        result.append(s.data() + start, invalidPos - start);
+        if (invalidPos == s.length())
+        {
+            break;
+        }
+
+        result.push_back(replacementCharacter);
+        start = invalidPos + 1;
+    }
+
+    AccountStringStorage(category, result);
+    return result;
+}
+
+
+//------------------------------------------------------------------------------
+// Apply a RegStringValidation mode to a string read from the registry:
+// returns ERROR_INVALID_DATA if the string is invalid and the mode is Reject,
+// otherwise repairs the string in place (if needed) and returns ERROR_SUCCESS
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS ValidateUtf16InPlace(
+    const RegAllocationCategory category,
+    std::wstring& s,
+    const RegStringValidation validation)
+{
+    if (validation == RegStringValidation::None || IsValidUtf16(s))
+    {
+        return ERROR_SUCCESS;
+    }
+
+    if (validation == RegStringValidation::Reject)
+    {
+        return ERROR_INVALID_DATA;
+    }
+
+    s = RepairUtf16(category, s, validation);
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Builds a RegExpected object that stores an error code
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline RegExpected<T> MakeRegExpectedWithError(const LSTATUS retCode)
+{
+    return RegExpected<T>{ RegResult{ retCode } };
+}
+
+
+//------------------------------------------------------------------------------
+// Return true if casting a size_t value to a DWORD is safe
+// (e.g. there is no overflow); false otherwise.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool SizeToDwordCastIsSafe([[maybe_unused]] const size_t size) noexcept
+{
+#if defined(_WIN64) || defined(__LP64__)
+
+    //
+    // In 64-bit builds, DWORD is an unsigned 32-bit integer,
+    // while size_t is an unsigned *64-bit* integer.
+    // So we need to pay attention to the conversion from size_t --> to DWORD.
+    //
+
+    using DestinationType = DWORD;
+
+    // Pre-compute at compile-time the maximum value that can be stored by a DWORD.
+    // Note that this value is stored in a size_t for proper comparison with the 'size' parameter.
+    constexpr size_t kMaxDwordValue = static_cast<size_t>((std::numeric_limits<DestinationType>::max)());
+
+    // Check against overflow
+    if (size > kMaxDwordValue)
+    {
+        // Overflow from size_t to DWORD
+        return false;
+    }
+
+    // The conversion is safe
+    return true;
+
+#else
+    //
+    // In 32-bit builds with Microsoft Visual C++, a size_t is an unsigned 32-bit value,
+    // just like a DWORD. So, we can optimized this case out for 32-bit builds.
+    //
+
+    static_assert(sizeof(size_t) == sizeof(DWORD)); // Both 32-bit unsigned integers on 32-bit x86
+    //UNREFERENCED_PARAMETER(size); // Replaced with [[maybe_unused]] for compatibility with MinGW 32-bit
+    return true;
+
+#endif // defined(_WIN64) || defined(__LP64__)
+}
+
+
+//------------------------------------------------------------------------------
+// Safely cast a size_t value (usually from the STL)
+// to a DWORD (usually for Win32 API calls).
+// In case of overflow, throws an exception of type std::overflow_error.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline DWORD SafeCastSizeToDword(const size_t size)
+{
+
+#if defined(_WIN64) || defined(__LP64__)
+
+    //
+    // In 64-bit builds, DWORD is an unsigned 32-bit integer,
+    // while size_t is an unsigned *64-bit* integer.
+    // So we need to pay attention to the conversion from size_t --> to DWORD.
+    //
+
+    using DestinationType = DWORD;
+
+    // Check against overflow
+    if (!SizeToDwordCastIsSafe(size))
+    {
+        throw std::overflow_error(
+            "Input size_t value is too big: size_t value doesn't fit into a DWORD.");
+    }
+
+    return static_cast<DestinationType>(size);
+
+#else
+    //
+    // In 32-bit builds with Microsoft Visual C++, a size_t is an unsigned 32-bit value,
+    // just like a DWORD. So, we can optimize this case out for 32-bit builds.
+    //
+
+    _ASSERTE(SizeToDwordCastIsSafe(size)); // double-check just in debug builds
+
+    static_assert(sizeof(size_t) == sizeof(DWORD)); // Both 32-bit unsigned integers on 32-bit x86
+    return static_cast<DWORD>(size);
+
+#endif // defined(_WIN64) || defined(__LP64__)
+}
+
+
+//------------------------------------------------------------------------------
+// Map a wchar_t to its upper-case form, for case-insensitive comparisons.
+// ASCII characters are handled inline; other characters are mapped using
+// the invariant locale (same ordinal semantics used for registry names).
+//------------------------------------------------------------------------------
+[[nodiscard]] inline wchar_t FoldCase(const wchar_t ch) noexcept
+{
+    // Fast path for ASCII characters
+    if (ch < 0x80)
+    {
+        return ((ch >= L'a') && (ch <= L'z')) ? static_cast<wchar_t>(ch - (L'a' - L'A')) : ch;
+    }
+
+    wchar_t upper = ch;
+    const int result = ::LCMapStringEx(
+        LOCALE_NAME_INVARIANT,
+        LCMAP_UPPERCASE,
+        &ch, 1,
+        &upper, 1,
+        nullptr, // no version info
+        nullptr, // reserved
+        0        // reserved
+    );
+
+    return (result == 1) ? upper : ch;
+}
+
+
+//------------------------------------------------------------------------------
+// Write the upper-case form of the source string into dest, that must have
+// room for source.length() wchar_ts.
+// Pure ASCII strings are handled inline; otherwise the whole string is mapped
+// with a single LCMapStringEx call, instead of one call per character.
+//------------------------------------------------------------------------------
+inline void FoldString(const std::wstring_view source, wchar_t* const dest) noexcept
+{
+    bool isAscii = true;
+    for (size_t i = 0; i < source.length(); i++)
+    {
+        const wchar_t ch = source[i];
+        if (ch >= 0x80)
+        {
+            isAscii = false;
+        }
+        dest[i] = ((ch >= L'a') && (ch <= L'z')) ? static_cast<wchar_t>(ch - (L'a' - L'A')) : ch;
+    }
+
+    if (isAscii)
+    {
+        return;
+    }
+
+    if (source.length() <= static_cast<size_t>((std::numeric_limits<int>::max)()))
+    {
+        const int length = static_cast<int>(source.length());
+        const int result = ::LCMapStringEx(
+            LOCALE_NAME_INVARIANT,
+            LCMAP_UPPERCASE,
+            source.data(), length,
+            dest, length,
+            nullptr, // no version info
+            nullptr, // reserved
+            0        // reserved
+        );
+
+        if (result == length)
+        {
+            return;
+        }
+    }
+
+    // Fall back to mapping each character on its own
+    for (size_t i = 0; i < source.length(); i++)
+    {
+        dest[i] = FoldCase(source[i]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Call chunkFunction on consecutive pieces of the upper-case form of s, folded
+// with FoldString into a small stack buffer (so no memory is allocated).
+// Surrogate pairs are never split between two pieces.
+//------------------------------------------------------------------------------
+template <typename ChunkFunction>
+inline void ForEachFoldedChunk(std::wstring_view s, ChunkFunction chunkFunction) noexcept
+{
+    constexpr size_t kChunkLength = 64;
+    wchar_t buffer[kChunkLength];
+
+    while (!s.empty())
+    {
+        size_t length = (s.length() < kChunkLength) ? s.length() : kChunkLength;
+
+        // Keep a high surrogate together with the following low surrogate
+        if ((length < s.length()) && (s[length - 1] >= 0xD800) && (s[length - 1] <= 0xDBFF))
+        {
+            length--;
+        }
+
+        FoldString(s.substr(0, length), buffer);
+        chunkFunction(std::wstring_view{ buffer, length });
+        s.remove_prefix(length);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Compare two strings according to the given comparison mode.
+// Returns a negative value if a < b, zero if a == b, a positive value if a > b.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline int CompareStrings(
+    const std::wstring_view a,
+    const std::wstring_view b,
+    const StringComparison comparison
+) noexcept
+{
+    if (comparison == StringComparison::CaseSensitive)
+    {
+        return a.compare(b);
+    }
+
+    const size_t minLength = (a.length() < b.length()) ? a.length() : b.length();
+    for (size_t i = 0; i < minLength; i++)
+    {
+        const wchar_t chA = FoldCase(a[i]);
+        const wchar_t chB = FoldCase(b[i]);
+        if (chA != chB)
+        {
+            return (chA < chB) ? -1 : 1;
+        }
+    }
+
+    if (a.length() == b.length())
+    {
+        return 0;
+    }
+    return (a.length() < b.length()) ? -1 : 1;
+}
+
+
+//------------------------------------------------------------------------------
+// Check two strings for equality according to the given comparison mode
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool EqualStrings(
+    const std::wstring_view a,
+    const std::wstring_view b,
+    const StringComparison comparison
+) noexcept
+{
+    // Quick rejection on different lengths
+    if (a.length() != b.length())
+    {
+        return false;
+    }
+
+    return CompareStrings(a, b, comparison) == 0;
+}
+
+
+//------------------------------------------------------------------------------
+// 64-bit FNV-1a hash of a sequence of wchar_ts.
+// In case-insensitive mode, characters are case-folded before hashing,
+// so that strings comparing equal get the same hash.
+// Passing the hash of a previous piece continues hashing from there.
+//------------------------------------------------------------------------------
+constexpr std::uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+
+[[nodiscard]] inline std::uint64_t HashString(
+    const std::wstring_view s,
+    const StringComparison comparison,
+    std::uint64_t hash = kFnvOffsetBasis
+) noexcept
+{
+    constexpr std::uint64_t kFnvPrime = 1099511628211ULL;
+
+    for (const wchar_t ch : s)
+    {
+        const wchar_t folded = (comparison == StringComparison::IgnoreCase) ? FoldCase(ch) : ch;
+        hash ^= static_cast<std::uint64_t>(folded);
+        hash *= kFnvPrime;
+    }
+
+    return hash;
+}
+
+
+//------------------------------------------------------------------------------
+// Read the raw content of a REG_MULTI_SZ value into the given buffer.
+//
+// The buffer is reused: its whole capacity is offered to RegGetValue first,
+// so in the steady state a single registry call is enough.
+// On success, the buffer is resized to the size of the data read.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS ReadMultiStringData(
+    const HKEY hKey,
+    const std::wstring& valueName,
+    std::vector<wchar_t>& data
+)
+{
+    constexpr DWORD flags = RRF_RT_REG_MULTI_SZ;
+
+    // Offer all the room already available in the buffer
+    data.resize(data.capacity());
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+    while (retCode == ERROR_MORE_DATA)
+    {
+        DWORD dataSize = SafeCastSizeToDword(data.size() * sizeof(wchar_t));
+
+        // With an empty buffer, just query the size of the multi-string
+        const bool sizeQuery = data.empty();
+
+        retCode = TracedRegGetValueW(
+            __func__,
+            hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            sizeQuery ? nullptr : data.data(),
+            &dataSize
+        );
+
+        if ((retCode == ERROR_MORE_DATA) || (sizeQuery && (retCode == ERROR_SUCCESS)))
+        {
+            // Zero-length data: nothing more to read
+            if (dataSize == 0)
+            {
+                data.clear();
+                return ERROR_SUCCESS;
+            }
+
+            // Grow the buffer and try again
+            data.resize(dataSize / sizeof(wchar_t));
+            retCode = ERROR_MORE_DATA;
+            continue;
+        }
+
+        if (retCode == ERROR_SUCCESS)
+        {
+            // Trim to the actual size of the data read
+            data.resize(dataSize / sizeof(wchar_t));
+        }
+    }
+
+    return retCode;
+}
+
+
+//------------------------------------------------------------------------------
+// Bring raw REG_MULTI_SZ data read from the registry into a canonical form
+// for in-place editing: the strings, each one followed by its NUL,
+// plus one final NUL.
+//
+// Zero-length data, and the "\0" and "\0\0" sequences (the latter is what
+// BuildMultiString produces for an empty vector), all represent the empty
+// multi-string, which becomes a single L'\0'.
+//
+// Return false if the data is not a valid multi-string.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool NormalizeMultiStringForEdit(std::vector<wchar_t>& data)
+{
+    if ((data.size() <= 2) && ((data.empty()) || (data.front() == L'\0')))
+    {
+        if (!data.empty() && (data.back() != L'\0'))
+        {
+            return false;
+        }
+
+        data.assign(1, L'\0');
+        return true;
+    }
+
+    return IsDoubleNullTerminated(data);
+}
+
+
+//------------------------------------------------------------------------------
+// Is the input string present in the canonical multi-string data?
+//------------------------------------------------------------------------------
+[[nodiscard]] inline bool MultiStringDataContains(
+    const std::vector<wchar_t>& data,
+    const std::wstring_view s,
+    const StringComparison comparison
+) noexcept
+{
+    const size_t endPos = data.size() - 1;
+    for (size_t pos = 0; pos < endPos; )
+    {
+        const size_t length = wcslen(&data[pos]);
+        if (EqualStrings(std::wstring_view{ &data[pos], length }, s, comparison))
+        {
+            return true;
+        }
+        pos += length + 1;
+    }
+
+    return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Read-edit-write cycle shared by the in-place REG_MULTI_SZ edit methods.
+//
+// The edit function receives the canonical multi-string data (see
+// NormalizeMultiStringForEdit), edits it in place, and returns the number
+// of changes made; nothing is written back if that number is zero.
+//------------------------------------------------------------------------------
+template <typename EditFunction>
+[[nodiscard]] inline LSTATUS EditMultiString(
+    const HKEY hKey,
+    const std::wstring& valueName,
+    const MultiStringEditOptions& options,
+    const bool createIfMissing,
+    EditFunction&& edit,
+    size_t& editCount
+)
+{
+    editCount = 0;
+
+    std::vector<wchar_t> data;      // data to edit
+    std::vector<wchar_t> original;  // data as read, to detect concurrent changes
+    std::vector<wchar_t> current;   // data re-read just before writing
+
+    for (int attempt = 0; ; attempt++)
+    {
+        LSTATUS retCode = ReadMultiStringData(hKey, valueName, data);
+        if ((retCode == ERROR_FILE_NOT_FOUND) && createIfMissing)
+        {
+            data.clear();
+        }
+        else if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        if (options.DetectConcurrentChanges)
+        {
+            original = data;
+        }
+
+        if (!NormalizeMultiStringForEdit(data))
+        {
+            return ERROR_INVALID_DATA;
+        }
+
+        editCount = edit(data);
+        if (editCount == 0)
+        {
+            // Nothing changed: no need to write
+            return ERROR_SUCCESS;
+        }
+
+        // Empty strings are fine next to other strings (e.g. "a\0\0\0" is
+        // {"a", ""}), but a multi-string holding just one empty string would
+        // be written as two NULs, which is also how the empty multi-string
+        // is stored (see BuildMultiString): the edit would be silently lost
+        if ((data.size() == 2) && (data[0] == L'\0'))
+        {
+            editCount = 0;
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        if (options.DetectConcurrentChanges)
+        {
+            retCode = ReadMultiStringData(hKey, valueName, current);
+            if ((retCode == ERROR_FILE_NOT_FOUND) && createIfMissing)
+            {
+                current.clear();
+                retCode = original.empty() ? ERROR_SUCCESS : ERROR_RETRY;
+            }
+            else if ((retCode == ERROR_SUCCESS) && (current != original))
+            {
+                retCode = ERROR_RETRY;
+            }
+
+            if (retCode == ERROR_RETRY)
+            {
+                // Someone else changed the value: restart from the fresh data
+                editCount = 0;
+                if (attempt < options.MaxRetries)
+                {
+                    continue;
+                }
+                return ERROR_RETRY;
+            }
+
+            if (retCode != ERROR_SUCCESS)
+            {
+                return retCode;
+            }
+        }
+
+        // The empty multi-string is stored as two NULs, like BuildMultiString does
+        if (data.size() == 1)
+        {
+            data.emplace_back(L'\0');
+        }
+
+        // Total size, in bytes, of the whole multi-string structure
+        const DWORD dataSize = SafeCastSizeToDword(data.size() * sizeof(wchar_t));
+
+        return TracedRegSetValueExW(
+            __func__,
+            hKey,
+            valueName.c_str(),
+            0, // reserved
+            REG_MULTI_SZ,
+            reinterpret_cast<const BYTE*>(data.data()),
+            dataSize
+        );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// In-place edit: append a string at the end of the canonical multi-string data
+//------------------------------------------------------------------------------
+[[nodiscard]] inline size_t AppendToMultiStringData(
+    std::vector<wchar_t>& data,
+    const std::wstring_view s,
+    const MultiStringEditOptions& options
+)
+{
+    if (options.Dedupe && MultiStringDataContains(data, s, options.Comparison))
+    {
+        return 0;
+    }
+
+    // Insert the string and its NUL terminator before the final NUL
+    data.reserve(data.size() + s.length() + 1);
+    data.insert(data.end() - 1, s.begin(), s.end());
+    data.insert(data.end() - 1, L'\0');
+
+    return 1;
+}
+
+
+//------------------------------------------------------------------------------
+// In-place edit: remove all the occurrences of a string from the
+// canonical multi-string data, compacting the remaining strings
+//------------------------------------------------------------------------------
+[[nodiscard]] inline size_t RemoveFromMultiStringData(
+    std::vector<wchar_t>& data,
+    const std::wstring_view s,
+    const MultiStringEditOptions& options
+) noexcept
+{
+    size_t removedCount = 0;
+    size_t writePos = 0;
+
+    const size_t endPos = data.size() - 1;
+    for (size_t readPos = 0; readPos < endPos; )
+    {
+        const size_t length = wcslen(&data[readPos]);
+        if (EqualStrings(std::wstring_view{ &data[readPos], length }, s, options.Comparison))
+        {
+            removedCount++;
+        }
+        else
+        {
+            // Keep the current string (with its NUL), moving it down if needed
+            if (writePos != readPos)
+            {
+                std::copy(data.begin() + readPos,
+                          data.begin() + readPos + length + 1,
+                          data.begin() + writePos);
+            }
+            writePos += length + 1;
+        }
+        readPos += length + 1;
+    }
+
+    // Final NUL
+    data[writePos] = L'\0';
+    data.resize(writePos + 1);
+
+    return removedCount;
+}
+
+
+//------------------------------------------------------------------------------
+// In-place edit: replace all the occurrences of a string in the
+// canonical multi-string data
+//------------------------------------------------------------------------------
+[[nodiscard]] inline size_t ReplaceInMultiStringData(
+    std::vector<wchar_t>& data,
+    const std::wstring_view oldString,
+    const std::wstring_view newString,
+    const MultiStringEditOptions& options
+)
+{
+    // Nothing to do when replacing a string with itself
+    if (oldString == newString)
+    {
+        return 0;
+    }
+
+    // With dedupe on, newString must end up stored at most once
+    // (note that oldString may match newString, e.g. when just changing case)
+    bool newStringPresent = options.Dedupe
+        && !EqualStrings(oldString, newString, options.Comparison)
+        && MultiStringDataContains(data, newString, options.Comparison);
+
+    // Build the result in one output buffer, in a single pass
+    std::vector<wchar_t> result;
+    result.reserve(data.size() + newString.length() + 1);
+
+    size_t replacedCount = 0;
+
+    const size_t endPos = data.size() - 1;
+    for (size_t readPos = 0; readPos < endPos; )
+    {
+        const size_t length = wcslen(&data[readPos]);
+        const wchar_t* const currString = &data[readPos];
+
+        if (EqualStrings(std::wstring_view{ currString, length }, oldString, options.Comparison))
+        {
+            replacedCount++;
+
+            if (!(newStringPresent && options.Dedupe))
+            {
+                result.insert(result.end(), newString.begin(), newString.end());
+                result.emplace_back(L'\0');
+                newStringPresent = true;
+            }
+        }
+        else
+        {
+            result.insert(result.end(), currString, currString + length + 1);
+        }
+        readPos += length + 1;
+    }
+
+    result.emplace_back(L'\0');
+
+    if (replacedCount > 0)
+    {
+        data.swap(result);
+    }
+
+    return replacedCount;
+}
+
+
+//------------------------------------------------------------------------------
+// Safely compute the size in bytes of an array of count records of type T,
+// as a DWORD (usually for Win32 API calls).
+// In case of overflow, throws an exception of type std::overflow_error.
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline DWORD SafeArraySizeInBytes(const size_t count)
+{
+    constexpr size_t kMaxCount = (std::numeric_limits<size_t>::max)() / sizeof(T);
+    if (count > kMaxCount)
+    {
+        throw std::overflow_error("Input array is too big: its size in bytes overflows a size_t.");
+    }
+
+    return SafeCastSizeToDword(count * sizeof(T));
+}
+
+
+//------------------------------------------------------------------------------
+// Read REG_BINARY data directly into an array of records of type T.
+// The data size must be a multiple of sizeof(T).
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline LSTATUS ReadBinaryArray(
+    const HKEY hKey,
+    const std::wstring& valueName,
+    RegBinaryArray<T>& result
+)
+{
+    constexpr DWORD flags = RRF_RT_REG_BINARY;
+
+    std::unique_ptr<T[]> data;
+    DWORD dataSize = 0; // size of binary data, in bytes
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Request the size of the binary data, in bytes
+        retCode = TracedRegGetValueW(
+            __func__,
+            hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        if ((dataSize % sizeof(T)) != 0)
+        {
+            return ERROR_INVALID_DATA;
+        }
+
+        // Handle the special case of zero-length binary data
+        if (dataSize == 0)
+        {
+            result = RegBinaryArray<T>{};
+            return ERROR_SUCCESS;
+        }
+
+        // Allocate a properly aligned array of records,
+        // and read the binary data straight into it
+        data.reset(new T[dataSize / sizeof(T)]);
+
+        retCode = TracedRegGetValueW(
+            __func__,
+            hKey,
+            nullptr,        // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,        // type not required
+            data.get(),     // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    // The data may have shrunk since the size query
+    if ((dataSize % sizeof(T)) != 0)
+    {
+        return ERROR_INVALID_DATA;
+    }
+
+    result = RegBinaryArray<T>{ std::move(data), dataSize / sizeof(T) };
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Read a fixed-size value (DWORD or QWORD) under hKey\subKey
+// with a single RegGetValue call
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline LSTATUS GetFixedSizeValueAt(
+    const HKEY hKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const DWORD flags,
+    T& data
+) noexcept
+{
+    DWORD dataSize = sizeof(data);
+    return TracedRegGetValueW(
+        __func__,
+        hKey,
+        subKey.c_str(),
+        valueName.c_str(),
+        flags,
+        nullptr, // type not required
+        &data,
+        &dataSize
+    );
+}
+
+
+//------------------------------------------------------------------------------
+// Read a variable-size value under hKey\subKey into the given container
+// (std::wstring, std::vector<wchar_t> or std::vector<BYTE>).
+// The first RegGetValue call is made with a small buffer, so reading
+// short values takes a single registry call.
+// On success, the container is resized to the size of the data read
+// (including any terminating NULs).
+//------------------------------------------------------------------------------
+template <typename Container>
+[[nodiscard]] inline LSTATUS GetVariableSizeValueAt(
+    const HKEY hKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const DWORD flags,
+    const RegAllocationCategory category,
+    Container& data
+)
+{
+    using Element = typename Container::value_type;
+
+    // Initial buffer size, in bytes
+    constexpr size_t kInitialBufferSize = 256;
+
+    ResizeAccounted(category, data, kInitialBufferSize / sizeof(Element));
+    DWORD dataSize = SafeCastSizeToDword(data.size() * sizeof(Element));
+
+    LSTATUS retCode = TracedRegGetValueW(
+        __func__,
+        hKey,
+        subKey.c_str(),
+        valueName.c_str(),
+        flags,
+        nullptr, // type not required
+        data.data(),
+        &dataSize
+    );
+
+    // The value may grow between calls: retry until the buffer is large enough
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // dataSize holds the required size, in bytes
+        ResizeAccounted(category, data, (dataSize + sizeof(Element) - 1) / sizeof(Element));
+        dataSize = SafeCastSizeToDword(data.size() * sizeof(Element));
+
+        retCode = TracedRegGetValueW(
+            __func__,
+            hKey,
+            subKey.c_str(),
+            valueName.c_str(),
+            flags,
+            nullptr, // type not required
+            data.data(),
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        data.clear();
+        return retCode;
+    }
+
+    data.resize(dataSize / sizeof(Element));
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Read a REG_SZ or REG_EXPAND_SZ value under hKey\subKey
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS GetStringValueAt(
+    const HKEY hKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const DWORD flags,
+    std::wstring& result
+)
+{
+    LSTATUS retCode = GetVariableSizeValueAt(
+        hKey, subKey, valueName, flags, RegAllocationCategory::StringValue, result);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    // Remove the NUL terminator scribbled by RegGetValue from the wstring
+    if (!result.empty())
+    {
+        result.pop_back();
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Read a REG_MULTI_SZ value under hKey\subKey
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS GetMultiStringValueAt(
+    const HKEY hKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    std::vector<std::wstring>& result
+)
+{
+    std::vector<wchar_t> multiString;
+    LSTATUS retCode = GetVariableSizeValueAt(
+        hKey, subKey, valueName, RRF_RT_REG_MULTI_SZ, RegAllocationCategory::MultiStringValue, multiString);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    result = ParseMultiString(multiString);
+    AccountMultiStringResult(result);
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Write a value under hKey\subKey, creating the subkey if it doesn't exist
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS SetValueAt(
+    const HKEY hKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const DWORD type,
+    const void* const data,
+    const DWORD dataSize
+) noexcept
+{
+    return TracedRegSetKeyValueW(
+        __func__,
+        hKey,
+        subKey.c_str(),
+        valueName.c_str(),
+        type,
+        data,
+        dataSize
+    );
+}
+
+
+//------------------------------------------------------------------------------
+// Check the limits of a long-running operation: return ERROR_CANCELLED if
+// its token was cancelled, ERROR_TIMEOUT if its deadline has passed,
+// else ERROR_SUCCESS
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS CheckOperationLimits(const RegOperationLimits& limits) noexcept
+{
+    if ((limits.Cancellation != nullptr) && limits.Cancellation->IsCancelled())
+    {
+        return ERROR_CANCELLED;
+    }
+
+    if ((limits.Deadline != (std::chrono::steady_clock::time_point::max)())
+        && (std::chrono::steady_clock::now() >= limits.Deadline))
+    {
+        return ERROR_TIMEOUT;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Delete all the subkeys of hKey, recursively, checking the limits
+// before each registry call
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS DeleteSubKeysWithLimits(
+    const HKEY hKey,
+    const RegOperationLimits& limits,
+    const REGSAM registryView
+)
+{
+    // Registry key names are at most 255 wchar_ts long
+    std::vector<wchar_t> nameBuffer(256);
+
+    for (;;)
+    {
+        LSTATUS retCode = CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        // Always take the first subkey, as deleting it shifts the others down
+        DWORD subKeyNameLen = static_cast<DWORD>(nameBuffer.size());
+        retCode = TracedRegEnumKeyExW(
+            __func__,
+            hKey,
+            0,
+            nameBuffer.data(),
+            &subKeyNameLen,
+            nullptr, // reserved
+            nullptr, // no class
+            nullptr, // no class
+            nullptr  // no last write time
+        );
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            return ERROR_SUCCESS;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        const std::wstring subKeyName{ nameBuffer.data(), subKeyNameLen };
+        {
+            RegKey subKey;
+            retCode = subKey.TryOpen(hKey, subKeyName,
+                                     KEY_ENUMERATE_SUB_KEYS | KEY_QUERY_VALUE | registryView).Code();
+            if (retCode != ERROR_SUCCESS)
+            {
+                return retCode;
+            }
+
+            retCode = DeleteSubKeysWithLimits(subKey.Get(), limits, registryView);
+            if (retCode != ERROR_SUCCESS)
+            {
+                return retCode;
+            }
+        }
+
+        retCode = CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        retCode = TracedRegDeleteKeyExW(__func__, hKey, subKeyName.c_str(), registryView, 0);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Delete all the values of hKey, checking the limits before each registry call
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS DeleteValuesWithLimits(const HKEY hKey, const RegOperationLimits& limits)
+{
+    // Registry value names are at most 16383 wchar_ts long
+    std::vector<wchar_t> nameBuffer(16384);
+
+    for (;;)
+    {
+        LSTATUS retCode = CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        // Always take the first value, as deleting it shifts the others down
+        DWORD valueNameLen = static_cast<DWORD>(nameBuffer.size());
+        retCode = TracedRegEnumValueW(
+            __func__,
+            hKey,
+            0,
+            nameBuffer.data(),
+            &valueNameLen,
+            nullptr,    // reserved
+            nullptr,    // no type
+            nullptr,    // no data
+            nullptr     // no data size
+        );
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            return ERROR_SUCCESS;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        retCode = TracedRegDeleteValueW(__func__, hKey, nameBuffer.data());
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Copy the values and the subkeys of hSourceKey into hDestKey, recursively,
+// checking the limits before each registry call
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS CopyTreeWithLimits(
+    const HKEY hSourceKey,
+    const HKEY hDestKey,
+    const RegOperationLimits& limits,
+    const REGSAM registryView
+)
+{
+    LSTATUS retCode = CheckOperationLimits(limits);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    DWORD subKeyCount = 0;
+    DWORD maxSubKeyNameLen = 0;
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    DWORD maxValueDataLen = 0;
+    retCode = TracedRegQueryInfoKeyW(
+        __func__,
+        hSourceKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        &subKeyCount,
+        &maxSubKeyNameLen,
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        &maxValueDataLen,
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return retCode;
+    }
+
+    // Copy the values
+    std::vector<wchar_t> nameBuffer(static_cast<size_t>(maxValueNameLen) + 1);
+    std::vector<BYTE> dataBuffer(maxValueDataLen);
+    for (DWORD index = 0; index < valueCount; )
+    {
+        retCode = CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        DWORD valueNameLen = static_cast<DWORD>(nameBuffer.size());
+        DWORD valueType = REG_NONE;
+        DWORD dataSize = static_cast<DWORD>(dataBuffer.size());
+        retCode = TracedRegEnumValueW(
+            __func__,
+            hSourceKey,
+            index,
+            nameBuffer.data(),
+            &valueNameLen,
+            nullptr,    // reserved
+            &valueType,
+            dataBuffer.empty() ? nullptr : dataBuffer.data(),
+            &dataSize
+        );
+        if ((retCode == ERROR_SUCCESS) && (dataSize > dataBuffer.size()))
+        {
+            // With a null data pointer the call succeeds and only reports the size:
+            // the value gained data since RegQueryInfoKey
+            retCode = ERROR_MORE_DATA;
+        }
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // The value changed since RegQueryInfoKey: grow the buffers and retry
+            nameBuffer.resize(nameBuffer.size() * 2);
+            if (dataSize > dataBuffer.size())
+            {
+                dataBuffer.resize(dataSize);
+            }
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Values were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        retCode = TracedRegSetValueExW(
+            __func__,
+            hDestKey,
+            nameBuffer.data(),
+            0,  // reserved
+            valueType,
+            dataBuffer.empty() ? nullptr : dataBuffer.data(),
+            dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        index++;
+    }
+
+    // Copy the subkeys, recursively
+    nameBuffer.resize(static_cast<size_t>(maxSubKeyNameLen) + 1);
+    for (DWORD index = 0; index < subKeyCount; index++)
+    {
+        retCode = CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        DWORD subKeyNameLen = static_cast<DWORD>(nameBuffer.size());
+        retCode = TracedRegEnumKeyExW(
+            __func__,
+            hSourceKey,
+            index,
+            nameBuffer.data(),
+            &subKeyNameLen,
+            nullptr, // reserved
+            nullptr, // no class
+            nullptr, // no class
+            nullptr  // no last write time
+        );
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Subkeys were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        const std::wstring subKeyName{ nameBuffer.data(), subKeyNameLen };
+
+        RegKey sourceSubKey;
+        retCode = sourceSubKey.TryOpen(hSourceKey, subKeyName, KEY_READ | registryView).Code();
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        RegKey destSubKey;
+        retCode = destSubKey.TryCreate(hDestKey, subKeyName, KEY_READ | KEY_WRITE | registryView).Code();
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+
+        retCode = CopyTreeWithLimits(sourceSubKey.Get(), destSubKey.Get(), limits, registryView);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return retCode;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+} // namespace details
+
+
+//------------------------------------------------------------------------------
+//                          RegKey Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegKey::RegKey(const HKEY hKey) noexcept
+    : m_hKey{ hKey }
+{
+}
+
+
+inline RegKey::RegKey(const HKEY hKeyParent, const std::wstring& subKey)
+{
+    Create(hKeyParent, subKey);
+}
+
+
+inline RegKey::RegKey(const HKEY hKeyParent, const std::wstring& subKey, const REGSAM desiredAccess)
+{
+    Create(hKeyParent, subKey, desiredAccess);
+}
+
+
+inline RegKey::RegKey(RegKey&& other) noexcept
+    : m_hKey{ other.m_hKey }
+{
+    // Other doesn't own the handle anymore
+    other.m_hKey = nullptr;
+}
+
+
+inline RegKey& RegKey::operator=(RegKey&& other) noexcept
+{
+    // Prevent self-move-assign
+    if ((this != &other) && (m_hKey != other.m_hKey))
+    {
+        // Close current
+        Close();
+
+        // Move from other (i.e. take ownership of other's raw handle)
+        m_hKey = other.m_hKey;
+        other.m_hKey = nullptr;
+    }
+    return *this;
+}
+
+
+inline RegKey::~RegKey() noexcept
+{
+    // Release the owned handle (if any)
+    Close();
+}
+
+
+inline HKEY RegKey::Get() const noexcept
+{
+    return m_hKey;
+}
+
+
+inline void RegKey::Close() noexcept
+{
+    if (IsValid())
+    {
+        // Do not call RegCloseKey on predefined keys
+        if (! IsPredefined())
+        {
+            details::TracedRegCloseKey(m_hKey);
+        }
+
+        // Avoid dangling references
+        m_hKey = nullptr;
+    }
+}
+
+
+inline bool RegKey::IsValid() const noexcept
+{
+    return m_hKey != nullptr;
+}
+
+
+inline RegKey::operator bool() const noexcept
+{
+    return IsValid();
+}
+
+
+inline bool RegKey::IsPredefined() const noexcept
+{
+    // Predefined keys
+    // https://msdn.microsoft.com/en-us/library/windows/desktop/ms724836(v=vs.85).aspx
+
+    if (   (m_hKey == HKEY_CURRENT_USER)
+        || (m_hKey == HKEY_LOCAL_MACHINE)
+        || (m_hKey == HKEY_CLASSES_ROOT)
+        || (m_hKey == HKEY_CURRENT_CONFIG)
+        || (m_hKey == HKEY_CURRENT_USER_LOCAL_SETTINGS)
+        || (m_hKey == HKEY_PERFORMANCE_DATA)
+        || (m_hKey == HKEY_PERFORMANCE_NLSTEXT)
+        || (m_hKey == HKEY_PERFORMANCE_TEXT)
+        || (m_hKey == HKEY_USERS))
+    {
+        return true;
+    }
+
+    return false;
+}
+
+
+inline HKEY RegKey::Detach() noexcept
+{
+    HKEY hKey = m_hKey;
+
+    // We don't own the HKEY handle anymore
+    m_hKey = nullptr;
+
+#ifdef WINREG_ENABLE_TRACE
+    // The caller may close the handle without RegKey: don't report its path
+    // for another key that reuses the handle value
+    if (hKey != nullptr)
+    {
+        details::ForgetKeyPath(hKey);
+    }
+#endif // WINREG_ENABLE_TRACE
+
+    // Transfer ownership to the caller
+    return hKey;
+}
+
+
+inline void RegKey::Attach(const HKEY hKey) noexcept
+{
+    // Prevent self-attach
+    if (m_hKey != hKey)
+    {
+        // Close any open registry handle
+        Close();
+
+        // Take ownership of the input hKey
+        m_hKey = hKey;
+    }
+}
+
+
+inline void RegKey::SwapWith(RegKey& other) noexcept
+{
+    // Enable ADL (not necessary in this case, but good practice)
+    using std::swap;
+
+    // Swap the raw handle members
+    swap(m_hKey, other.m_hKey);
+}
+
+
+inline void swap(RegKey& a, RegKey& b) noexcept
+{
+    a.SwapWith(b);
+}
+
+
+inline void RegKey::Create(
+    const HKEY                  hKeyParent,
+    const std::wstring&         subKey,
+    const REGSAM                desiredAccess
+)
+{
+    constexpr DWORD kDefaultOptions = REG_OPTION_NON_VOLATILE;
+
+    Create(hKeyParent, subKey, desiredAccess, kDefaultOptions,
+        nullptr, // no security attributes,
+        nullptr  // no disposition
+    );
+}
+
+
+inline void RegKey::Create(
+    const HKEY                  hKeyParent,
+    const std::wstring&         subKey,
+    const REGSAM                desiredAccess,
+    const DWORD                 options,
+    SECURITY_ATTRIBUTES* const  securityAttributes,
+    DWORD* const                disposition
+)
+{
+    HKEY hKey = nullptr;
+    LSTATUS retCode = details::TracedRegCreateKeyExW(
+        __func__,
+        hKeyParent,
+        subKey.c_str(),
+        0,          // reserved
+        REG_NONE,   // user-defined class type parameter not supported
+        options,
+        desiredAccess,
+        securityAttributes,
+        &hKey,
+        disposition
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegCreateKeyExW failed." };
+    }
+
+    // Safely close any previously opened key
+    Close();
+
+    // Take ownership of the newly created key
+    m_hKey = hKey;
+}
+
+
+inline void RegKey::Open(
+    const HKEY              hKeyParent,
+    const std::wstring&     subKey,
+    const REGSAM            desiredAccess
+)
+{
+    HKEY hKey = nullptr;
+    LSTATUS retCode = details::TracedRegOpenKeyExW(
+        __func__,
+        hKeyParent,
+        subKey.c_str(),
+        REG_NONE,           // default options
+        desiredAccess,
+        &hKey
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegOpenKeyExW failed." };
+    }
+
+    // Safely close any previously opened key
+    Close();
+
+    // Take ownership of the newly created key
+    m_hKey = hKey;
+}
+
+
+inline RegResult RegKey::TryCreate(
+    const HKEY          hKeyParent,
+    const std::wstring& subKey,
+    const REGSAM        desiredAccess
+) noexcept
+{
+    constexpr DWORD kDefaultOptions = REG_OPTION_NON_VOLATILE;
+
+    return TryCreate(hKeyParent, subKey, desiredAccess, kDefaultOptions,
+        nullptr, // no security attributes,
+        nullptr  // no disposition
+    );
+}
+
+
+inline RegResult RegKey::TryCreate(
+    const HKEY                  hKeyParent,
+    const std::wstring&         subKey,
+    const REGSAM                desiredAccess,
+    const DWORD                 options,
+    SECURITY_ATTRIBUTES* const  securityAttributes,
+    DWORD* const                disposition
+) noexcept
+{
+    HKEY hKey = nullptr;
+    RegResult retCode{ details::TracedRegCreateKeyExW(
+        __func__,
+        hKeyParent,
+        subKey.c_str(),
+        0,          // reserved
+        REG_NONE,   // user-defined class type parameter not supported
+        options,
+        desiredAccess,
+        securityAttributes,
+        &hKey,
+        disposition
+    ) };
+    if (retCode.Failed())
+    {
+        return retCode;
+    }
+
+    // Safely close any previously opened key
+    Close();
+
+    // Take ownership of the newly created key
+    m_hKey = hKey;
+
+    _ASSERTE(retCode.IsOk());
+    return retCode;
+}
 
 
 inline RegResult RegKey::TryOpen(
@@ -1266,1904 +5279,5156 @@ inline RegResult RegKey::TryOpen(
     const REGSAM        desiredAccess
 ) noexcept
 {
-    HKEY hKey = nullptr;
-    RegResult retCode{ ::RegOpenKeyExW(
-        hKeyParent,
-        subKey.c_str(),
-        REG_NONE,           // default options
-        desiredAccess,
-        &hKey
-    ) };
+    HKEY hKey = nullptr;
+    RegResult retCode{ details::TracedRegOpenKeyExW(
+        __func__,
+        hKeyParent,
+        subKey.c_str(),
+        REG_NONE,           // default options
+        desiredAccess,
+        &hKey
+    ) };
+    if (retCode.Failed())
+    {
+        return retCode;
+    }
+
+    // Safely close any previously opened key
+    Close();
+
+    // Take ownership of the newly created key
+    m_hKey = hKey;
+
+    _ASSERTE(retCode.IsOk());
+    return retCode;
+}
+
+
+inline void RegKey::SetDwordValue(const std::wstring& valueName, const DWORD data)
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_DWORD,
+        reinterpret_cast<const BYTE*>(&data),
+        sizeof(data)
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write DWORD value: RegSetValueExW failed." };
+    }
+}
+
+
+inline void RegKey::SetQwordValue(const std::wstring& valueName, const ULONGLONG& data)
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_QWORD,
+        reinterpret_cast<const BYTE*>(&data),
+        sizeof(data)
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write QWORD value: RegSetValueExW failed." };
+    }
+}
+
+
+inline void RegKey::SetStringValue(const std::wstring& valueName, const std::wstring& data)
+{
+    _ASSERTE(IsValid());
+
+    // String size including the terminating NUL, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
+
+    LSTATUS retCode = details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_SZ,
+        reinterpret_cast<const BYTE*>(data.c_str()),
+        dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write string value: RegSetValueExW failed." };
+    }
+}
+
+
+inline void RegKey::SetExpandStringValue(const std::wstring& valueName, const std::wstring& data)
+{
+    _ASSERTE(IsValid());
+
+    // String size including the terminating NUL, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
+
+    LSTATUS retCode = details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_EXPAND_SZ,
+        reinterpret_cast<const BYTE*>(data.c_str()),
+        dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write expand string value: RegSetValueExW failed." };
+    }
+}
+
+
+inline void RegKey::SetMultiStringValue(
+    const std::wstring& valueName,
+    const std::vector<std::wstring>& data
+)
+{
+    _ASSERTE(IsValid());
+
+    // First, we have to build a double-NUL-terminated multi-string from the input data
+    const std::vector<wchar_t> multiString = details::BuildMultiString(data);
+
+    // Total size, in bytes, of the whole multi-string structure
+    const DWORD dataSize = details::SafeCastSizeToDword(multiString.size() * sizeof(wchar_t));
+
+    LSTATUS retCode = details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_MULTI_SZ,
+        reinterpret_cast<const BYTE*>(multiString.data()),
+        dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write multi-string value: RegSetValueExW failed." };
+    }
+}
+
+
+inline void RegKey::SetBinaryValue(const std::wstring& valueName, const std::vector<BYTE>& data)
+{
+    _ASSERTE(IsValid());
+
+    // Total data size, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword(data.size());
+
+    LSTATUS retCode = details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_BINARY,
+        data.data(),
+        dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write binary data value: RegSetValueExW failed." };
+    }
+}
+
+
+inline void RegKey::SetBinaryValue(
+    const std::wstring& valueName,
+    const void* const data,
+    const DWORD dataSize
+)
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_BINARY,
+        static_cast<const BYTE*>(data),
+        dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot write binary data value: RegSetValueExW failed." };
+    }
+}
+
+
+template <typename T>
+inline void RegKey::SetBinaryValueAs(
+    const std::wstring& valueName,
+    const T* const data,
+    const size_t count
+)
+{
+    RegResult retCode = TrySetBinaryValueAs(valueName, data, count);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot write binary data value: RegSetValueExW failed." };
+    }
+}
+
+
+template <typename T>
+inline void RegKey::SetBinaryValueAs(const std::wstring& valueName, const std::vector<T>& data)
+{
+    SetBinaryValueAs(valueName, data.data(), data.size());
+}
+
+
+template <typename T>
+inline void RegKey::SetBinaryValueAs(const std::wstring& valueName, const RegBinaryArray<T>& data)
+{
+    SetBinaryValueAs(valueName, data.Data(), data.Size());
+}
+
+
+template <typename T>
+inline RegResult RegKey::TrySetBinaryValueAs(
+    const std::wstring& valueName,
+    const T* const data,
+    const size_t count
+)
+{
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "REG_BINARY records must be trivially copyable.");
+    static_assert(!std::is_pointer_v<T>,
+                  "Pointers cannot be meaningfully stored in REG_BINARY values.");
+
+    _ASSERTE(IsValid());
+    _ASSERTE((data != nullptr) || (count == 0));
+
+    // Total data size, in bytes
+    const DWORD dataSize = details::SafeArraySizeInBytes<T>(count);
+
+    return RegResult{ details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_BINARY,
+        reinterpret_cast<const BYTE*>(data),
+        dataSize
+    ) };
+}
+
+
+inline RegResult RegKey::TrySetDwordValue(const std::wstring& valueName, const DWORD data) noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_DWORD,
+        reinterpret_cast<const BYTE*>(&data),
+        sizeof(data)
+    ) };
+}
+
+
+inline RegResult RegKey::TrySetQwordValue(const std::wstring& valueName,
+                                          const ULONGLONG& data) noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_QWORD,
+        reinterpret_cast<const BYTE*>(&data),
+        sizeof(data)
+    ) };
+}
+
+
+inline RegResult RegKey::TrySetStringValue(const std::wstring& valueName,
+                                           const std::wstring& data)
+{
+    _ASSERTE(IsValid());
+
+    // String size including the terminating NUL, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
+
+    return RegResult{ details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_SZ,
+        reinterpret_cast<const BYTE*>(data.c_str()),
+        dataSize
+    ) };
+}
+
+
+inline RegResult RegKey::TrySetExpandStringValue(const std::wstring& valueName,
+                                                 const std::wstring& data)
+{
+    _ASSERTE(IsValid());
+
+    // String size including the terminating NUL, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
+
+    return RegResult{ details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_EXPAND_SZ,
+        reinterpret_cast<const BYTE*>(data.c_str()),
+        dataSize
+    ) };
+}
+
+
+inline RegResult RegKey::TrySetMultiStringValue(const std::wstring& valueName,
+                                                const std::vector<std::wstring>& data)
+{
+    _ASSERTE(IsValid());
+
+    // First, we have to build a double-NUL-terminated multi-string from the input data.
+    //
+    // NOTE: This is the reason why I *cannot* mark this method noexcept,
+    // since a *dynamic allocation* happens for creating the std::vector in BuildMultiString.
+    // And, if dynamic memory allocations fail, an exception is thrown.
+    //
+    const std::vector<wchar_t> multiString = details::BuildMultiString(data);
+
+    // Total size, in bytes, of the whole multi-string structure
+    const DWORD dataSize = details::SafeCastSizeToDword(multiString.size() * sizeof(wchar_t));
+
+    return RegResult{ details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_MULTI_SZ,
+        reinterpret_cast<const BYTE*>(multiString.data()),
+        dataSize
+    ) };
+}
+
+
+inline RegResult RegKey::TrySetBinaryValue(const std::wstring& valueName,
+                                           const std::vector<BYTE>& data)
+{
+    _ASSERTE(IsValid());
+
+    // Total data size, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword(data.size());
+
+    return RegResult{ details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_BINARY,
+        data.data(),
+        dataSize
+    ) };
+}
+
+
+inline RegResult RegKey::TrySetBinaryValue(const std::wstring& valueName,
+                                           const void* const data,
+                                           const DWORD dataSize) noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegSetValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        0, // reserved
+        REG_BINARY,
+        static_cast<const BYTE*>(data),
+        dataSize
+    ) };
+}
+
+
+inline DWORD RegKey::GetDwordValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    DWORD data = 0;                  // to be read from the registry
+    DWORD dataSize = sizeof(data);   // size of data, in bytes
+
+    constexpr DWORD flags = RRF_RT_REG_DWORD;
+    LSTATUS retCode = details::TracedRegGetValueW(
+        __func__,
+        m_hKey,
+        nullptr, // no subkey
+        valueName.c_str(),
+        flags,
+        nullptr, // type not required
+        &data,
+        &dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get DWORD value: RegGetValueW failed." };
+    }
+
+    return data;
+}
+
+
+inline ULONGLONG RegKey::GetQwordValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    ULONGLONG data = 0;              // to be read from the registry
+    DWORD dataSize = sizeof(data);   // size of data, in bytes
+
+    constexpr DWORD flags = RRF_RT_REG_QWORD;
+    LSTATUS retCode = details::TracedRegGetValueW(
+        __func__,
+        m_hKey,
+        nullptr, // no subkey
+        valueName.c_str(),
+        flags,
+        nullptr, // type not required
+        &data,
+        &dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get QWORD value: RegGetValueW failed." };
+    }
+
+    return data;
+}
+
+
+inline std::wstring RegKey::GetStringValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    std::wstring result;    // to be read from the registry
+    DWORD dataSize = 0;     // size of the string data, in bytes
+
+    constexpr DWORD flags = RRF_RT_REG_SZ;
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Get the size of the result string
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            throw RegException{ retCode, "Cannot get the size of the string value: RegGetValueW failed." };
+        }
+
+        // Allocate a string of proper size.
+        // Note that dataSize is in bytes and includes the terminating NUL;
+        // we have to convert the size from bytes to wchar_ts for wstring::resize.
+        details::ResizeAccounted(RegAllocationCategory::StringValue, result, dataSize / sizeof(wchar_t));
+
+        // Call RegGetValue for the second time to read the string's content
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,       // type not required
+            result.data(), // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get the string value: RegGetValueW failed." };
+    }
+
+    // Remove the NUL terminator scribbled by RegGetValue from the wstring
+    result.resize((dataSize / sizeof(wchar_t)) - 1);
+
+    return result;
+}
+
+
+inline std::wstring RegKey::GetExpandStringValue(
+    const std::wstring& valueName,
+    const ExpandStringOption expandOption
+) const
+{
+    _ASSERTE(IsValid());
+
+    std::wstring result;    // to be read from the registry
+    DWORD dataSize = 0;     // size of the expand string data, in bytes
+
+
+    DWORD flags = RRF_RT_REG_EXPAND_SZ;
+
+    // Adjust the flag for RegGetValue considering the expand string option specified by the caller
+    if (expandOption == ExpandStringOption::DontExpand)
+    {
+        flags |= RRF_NOEXPAND;
+    }
+
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Get the size of the result string
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            throw RegException{ retCode,
+                                "Cannot get the size of the expand string value: RegGetValueW failed." };
+        }
+
+        // Allocate a string of proper size.
+        // Note that dataSize is in bytes and includes the terminating NUL;
+        // we have to convert the size from bytes to wchar_ts for wstring::resize.
+        details::ResizeAccounted(RegAllocationCategory::StringValue, result, dataSize / sizeof(wchar_t));
+
+        // Call RegGetValue for the second time to read the string's content
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,       // type not required
+            result.data(), // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get the expand string value: RegGetValueW failed." };
+    }
+
+    // Remove the NUL terminator scribbled by RegGetValue from the wstring
+    result.resize((dataSize / sizeof(wchar_t)) - 1);
+
+    return result;
+}
+
+
+inline std::vector<std::wstring> RegKey::GetMultiStringValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    // Room for the result multi-string, to be read from the registry
+    std::vector<wchar_t> multiString;
+
+    // Size of the multi-string, in bytes
+    DWORD dataSize = 0;
+
+    constexpr DWORD flags = RRF_RT_REG_MULTI_SZ;
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Request the size of the multi-string, in bytes
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            throw RegException{ retCode,
+                                "Cannot get the size of the multi-string value: RegGetValueW failed." };
+        }
+
+        // Allocate room for the result multi-string.
+        // Note that dataSize is in bytes, but our vector<wchar_t>::resize method requires size
+        // to be expressed in wchar_ts.
+        details::ResizeAccounted(RegAllocationCategory::MultiStringValue, multiString, dataSize / sizeof(wchar_t));
+
+        // Call RegGetValue for the second time to read the multi-string's content into the vector
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,                // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,                // type not required
+            multiString.data(),     // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get the multi-string value: RegGetValueW failed." };
+    }
+
+    // Resize vector to the actual size returned by the last call to RegGetValue.
+    // Note that the vector is a vector of wchar_ts, instead the size returned by RegGetValue
+    // is in bytes, so we have to scale from bytes to wchar_t count.
+    multiString.resize(dataSize / sizeof(wchar_t));
+
+    // Convert the double-null-terminated string structure to a vector<wstring>,
+    // and return that back to the caller
+    std::vector<std::wstring> result = details::ParseMultiString(multiString);
+    details::AccountMultiStringResult(result);
+    return result;
+}
+
+
+inline std::vector<BYTE> RegKey::GetBinaryValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    // Room for the binary data, to be read from the registry
+    std::vector<BYTE> binaryData;
+
+    // Size of binary data, in bytes
+    DWORD dataSize = 0;
+
+    constexpr DWORD flags = RRF_RT_REG_BINARY;
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Request the size of the binary data, in bytes
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            throw RegException{ retCode,
+                                "Cannot get the size of the binary data: RegGetValueW failed." };
+        }
+
+        // Allocate a buffer of proper size to store the binary data
+        details::ResizeAccounted(RegAllocationCategory::BinaryValue, binaryData, dataSize);
+
+        // Handle the special case of zero-length binary data:
+        // If the binary data value in the registry is empty, just return an empty vector.
+        if (dataSize == 0)
+        {
+            _ASSERTE(binaryData.empty());
+            return binaryData;
+        }
+
+        // Call RegGetValue for the second time to read the binary data content into the vector
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,            // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,            // type not required
+            binaryData.data(),  // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get the binary data: RegGetValueW failed." };
+    }
+
+    // Resize vector to the actual size returned by the last call to RegGetValue
+    binaryData.resize(dataSize);
+
+    return binaryData;
+}
+
+
+template <typename T>
+inline RegBinaryArray<T> RegKey::GetBinaryValueAs(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    RegBinaryArray<T> result;
+    LSTATUS retCode = details::ReadBinaryArray(m_hKey, valueName, result);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get the binary data as an array of records." };
+    }
+
+    return result;
+}
+
+
+template <typename T>
+inline RegExpected<RegBinaryArray<T>>
+    RegKey::TryGetBinaryValueAs(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    using RegValueType = RegBinaryArray<T>;
+
+    RegBinaryArray<T> result;
+    LSTATUS retCode = details::ReadBinaryArray(m_hKey, valueName, result);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<RegValueType>{ RegResult{ retCode } };
+    }
+
+    return RegExpected<RegValueType>{ std::move(result) };
+}
+
+
+inline RegExpected<DWORD> RegKey::TryGetDwordValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    using RegValueType = DWORD;
+
+    DWORD data = 0;                  // to be read from the registry
+    DWORD dataSize = sizeof(data);   // size of data, in bytes
+
+    constexpr DWORD flags = RRF_RT_REG_DWORD;
+    LSTATUS retCode = details::TracedRegGetValueW(
+        __func__,
+        m_hKey,
+        nullptr, // no subkey
+        valueName.c_str(),
+        flags,
+        nullptr, // type not required
+        &data,
+        &dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+    }
+
+    return RegExpected<RegValueType>{ data };
+}
+
+
+inline RegExpected<ULONGLONG> RegKey::TryGetQwordValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    using RegValueType = ULONGLONG;
+
+    ULONGLONG data = 0;              // to be read from the registry
+    DWORD dataSize = sizeof(data);   // size of data, in bytes
+
+    constexpr DWORD flags = RRF_RT_REG_QWORD;
+    LSTATUS retCode = details::TracedRegGetValueW(
+        __func__,
+        m_hKey,
+        nullptr, // no subkey
+        valueName.c_str(),
+        flags,
+        nullptr, // type not required
+        &data,
+        &dataSize
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+    }
+
+    return RegExpected<RegValueType>{ data };
+}
+
+
+inline RegExpected<std::wstring> RegKey::TryGetStringValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    using RegValueType = std::wstring;
+
+    constexpr DWORD flags = RRF_RT_REG_SZ;
+
+    std::wstring result;
+
+    DWORD dataSize = 0; // size of the string data, in bytes
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Get the size of the result string
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return details::MakeRegExpectedWithError<RegValueType>(retCode);
+        }
+
+        // Allocate a string of proper size.
+        // Note that dataSize is in bytes and includes the terminating NUL;
+        // we have to convert the size from bytes to wchar_ts for wstring::resize.
+        details::ResizeAccounted(RegAllocationCategory::StringValue, result, dataSize / sizeof(wchar_t));
+
+        // Call RegGetValue for the second time to read the string's content
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,       // type not required
+            result.data(), // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+    }
+
+    // Remove the NUL terminator scribbled by RegGetValue from the wstring
+    result.resize((dataSize / sizeof(wchar_t)) - 1);
+
+    return RegExpected<RegValueType>{ result };
+}
+
+
+inline RegExpected<std::wstring> RegKey::TryGetExpandStringValue(
+    const std::wstring& valueName,
+    const ExpandStringOption expandOption
+) const
+{
+    _ASSERTE(IsValid());
+
+    using RegValueType = std::wstring;
+
+    DWORD flags = RRF_RT_REG_EXPAND_SZ;
+
+    // Adjust the flag for RegGetValue considering the expand string option specified by the caller
+    if (expandOption == ExpandStringOption::DontExpand)
+    {
+        flags |= RRF_NOEXPAND;
+    }
+
+    std::wstring result;
+    DWORD dataSize = 0; // size of the expand string data, in bytes
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Get the size of the result string
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return details::MakeRegExpectedWithError<RegValueType>(retCode);
+        }
+
+        // Allocate a string of proper size.
+        // Note that dataSize is in bytes and includes the terminating NUL;
+        // we have to convert the size from bytes to wchar_ts for wstring::resize.
+        details::ResizeAccounted(RegAllocationCategory::StringValue, result, dataSize / sizeof(wchar_t));
+
+        // Call RegGetValue for the second time to read the string's content
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,       // type not required
+            result.data(), // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+    }
+
+    // Remove the NUL terminator scribbled by RegGetValue from the wstring
+    result.resize((dataSize / sizeof(wchar_t)) - 1);
+
+    return RegExpected<RegValueType>{ result };
+}
+
+
+inline RegExpected<std::vector<std::wstring>>
+    RegKey::TryGetMultiStringValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    using RegValueType = std::vector<std::wstring>;
+
+    constexpr DWORD flags = RRF_RT_REG_MULTI_SZ;
+
+    // Room for the result multi-string
+    std::vector<wchar_t> data;
+
+    // Size of the multi-string, in bytes
+    DWORD dataSize = 0;
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Request the size of the multi-string, in bytes
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return details::MakeRegExpectedWithError<RegValueType>(retCode);
+        }
+
+        // Allocate room for the result multi-string.
+        // Note that dataSize is in bytes, but our vector<wchar_t>::resize method requires size
+        // to be expressed in wchar_ts.
+        details::ResizeAccounted(RegAllocationCategory::MultiStringValue, data, dataSize / sizeof(wchar_t));
+
+        // Call RegGetValue for the second time to read the multi-string's content into the vector
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,        // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,        // type not required
+            data.data(),    // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+    }
+
+    // Resize vector to the actual size returned by the last call to RegGetValue.
+    // Note that the vector is a vector of wchar_ts, instead the size returned by RegGetValue
+    // is in bytes, so we have to scale from bytes to wchar_t count.
+    data.resize(dataSize / sizeof(wchar_t));
+
+    // Convert the double-null-terminated string structure to a vector<wstring>,
+    // and return that back to the caller
+    RegValueType result = details::ParseMultiString(data);
+    details::AccountMultiStringResult(result);
+    return RegExpected<RegValueType>{ std::move(result) };
+}
+
+
+inline RegExpected<std::vector<BYTE>>
+    RegKey::TryGetBinaryValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    using RegValueType = std::vector<BYTE>;
+
+    constexpr DWORD flags = RRF_RT_REG_BINARY;
+
+    // Room for the binary data
+    std::vector<BYTE> data;
+
+    DWORD dataSize = 0; // size of binary data, in bytes
+
+    LSTATUS retCode = ERROR_MORE_DATA;
+
+    while (retCode == ERROR_MORE_DATA)
+    {
+        // Request the size of the binary data, in bytes
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,    // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,    // type not required
+            nullptr,    // output buffer not needed now
+            &dataSize
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return details::MakeRegExpectedWithError<RegValueType>(retCode);
+        }
+
+        // Allocate a buffer of proper size to store the binary data
+        details::ResizeAccounted(RegAllocationCategory::BinaryValue, data, dataSize);
+
+        // Handle the special case of zero-length binary data:
+        // If the binary data value in the registry is empty, just return
+        if (dataSize == 0)
+        {
+            _ASSERTE(data.empty());
+            return RegExpected<RegValueType>{ data };
+        }
+
+        // Call RegGetValue for the second time to read the binary data content into the vector
+        retCode = details::TracedRegGetValueW(
+            __func__,
+            m_hKey,
+            nullptr,        // no subkey
+            valueName.c_str(),
+            flags,
+            nullptr,        // type not required
+            data.data(),    // output buffer
+            &dataSize
+        );
+    }
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+    }
+
+    // Resize vector to the actual size returned by the last call to RegGetValue
+    data.resize(dataSize);
+
+    return RegExpected<RegValueType>{ data };
+}
+
+
+inline DWORD RegKey::GetDwordValueOr(const std::wstring& valueName, const DWORD defaultValue) const
+{
+    RegExpected<DWORD> value = TryGetDwordValue(valueName);
+    if (value)
+    {
+        return value.GetValue();
+    }
+
+    const LSTATUS retCode = value.GetError().Code();
+    if (retCode != ERROR_FILE_NOT_FOUND)
+    {
+        throw RegException{ retCode, "Cannot get DWORD value: RegGetValueW failed." };
+    }
+
+    return defaultValue;
+}
+
+
+inline ULONGLONG RegKey::GetQwordValueOr(const std::wstring& valueName, const ULONGLONG defaultValue) const
+{
+    RegExpected<ULONGLONG> value = TryGetQwordValue(valueName);
+    if (value)
+    {
+        return value.GetValue();
+    }
+
+    const LSTATUS retCode = value.GetError().Code();
+    if (retCode != ERROR_FILE_NOT_FOUND)
+    {
+        throw RegException{ retCode, "Cannot get QWORD value: RegGetValueW failed." };
+    }
+
+    return defaultValue;
+}
+
+
+inline std::wstring RegKey::GetStringValueOr(const std::wstring& valueName, std::wstring defaultValue) const
+{
+    RegExpected<std::wstring> value = TryGetStringValue(valueName);
+    if (value)
+    {
+        return std::move(value).GetValue();
+    }
+
+    const LSTATUS retCode = value.GetError().Code();
+    if (retCode != ERROR_FILE_NOT_FOUND)
+    {
+        throw RegException{ retCode, "Cannot get string value: RegGetValueW failed." };
+    }
+
+    return defaultValue;
+}
+
+
+inline std::wstring RegKey::GetExpandStringValueOr(
+    const std::wstring& valueName,
+    std::wstring defaultValue,
+    const ExpandStringOption expandOption
+) const
+{
+    RegExpected<std::wstring> value = TryGetExpandStringValue(valueName, expandOption);
+    if (value)
+    {
+        return std::move(value).GetValue();
+    }
+
+    const LSTATUS retCode = value.GetError().Code();
+    if (retCode != ERROR_FILE_NOT_FOUND)
+    {
+        throw RegException{ retCode, "Cannot get expand string value: RegGetValueW failed." };
+    }
+
+    return defaultValue;
+}
+
+
+inline std::vector<std::wstring> RegKey::GetMultiStringValueOr(
+    const std::wstring& valueName,
+    std::vector<std::wstring> defaultValue
+) const
+{
+    RegExpected<std::vector<std::wstring>> value = TryGetMultiStringValue(valueName);
+    if (value)
+    {
+        return std::move(value).GetValue();
+    }
+
+    const LSTATUS retCode = value.GetError().Code();
+    if (retCode != ERROR_FILE_NOT_FOUND)
+    {
+        throw RegException{ retCode, "Cannot get multi-string value: RegGetValueW failed." };
+    }
+
+    return defaultValue;
+}
+
+
+inline std::vector<BYTE> RegKey::GetBinaryValueOr(
+    const std::wstring& valueName,
+    std::vector<BYTE> defaultValue
+) const
+{
+    RegExpected<std::vector<BYTE>> value = TryGetBinaryValue(valueName);
+    if (value)
+    {
+        return std::move(value).GetValue();
+    }
+
+    const LSTATUS retCode = value.GetError().Code();
+    if (retCode != ERROR_FILE_NOT_FOUND)
+    {
+        throw RegException{ retCode, "Cannot get binary value: RegGetValueW failed." };
+    }
+
+    return defaultValue;
+}
+
+
+template <typename T>
+inline T RegKey::GetValueOr(const std::wstring& valueName, T defaultValue) const
+{
+    if constexpr (std::is_same_v<T, DWORD>)
+    {
+        return GetDwordValueOr(valueName, defaultValue);
+    }
+    else if constexpr (std::is_same_v<T, ULONGLONG>)
+    {
+        return GetQwordValueOr(valueName, defaultValue);
+    }
+    else if constexpr (std::is_same_v<T, std::wstring>)
+    {
+        return GetStringValueOr(valueName, std::move(defaultValue));
+    }
+    else if constexpr (std::is_same_v<T, std::vector<std::wstring>>)
+    {
+        return GetMultiStringValueOr(valueName, std::move(defaultValue));
+    }
+    else
+    {
+        static_assert(std::is_same_v<T, std::vector<BYTE>>, "Unsupported value type for GetValueOr.");
+        return GetBinaryValueOr(valueName, std::move(defaultValue));
+    }
+}
+
+
+inline std::wstring RegKey::GetStringValue(
+    const std::wstring& valueName,
+    const RegStringValidation validation
+) const
+{
+    std::wstring value = GetStringValue(valueName);
+
+    LSTATUS retCode = details::ValidateUtf16InPlace(RegAllocationCategory::StringValue, value, validation);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "String value is not well-formed UTF-16." };
+    }
+
+    return value;
+}
+
+
+inline std::wstring RegKey::GetExpandStringValue(
+    const std::wstring& valueName,
+    const ExpandStringOption expandOption,
+    const RegStringValidation validation
+) const
+{
+    std::wstring value = GetExpandStringValue(valueName, expandOption);
+
+    LSTATUS retCode = details::ValidateUtf16InPlace(RegAllocationCategory::StringValue, value, validation);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Expand string value is not well-formed UTF-16." };
+    }
+
+    return value;
+}
+
+
+inline std::vector<std::wstring> RegKey::GetMultiStringValue(
+    const std::wstring& valueName,
+    const RegStringValidation validation
+) const
+{
+    std::vector<std::wstring> strings = GetMultiStringValue(valueName);
+
+    for (auto& s : strings)
+    {
+        LSTATUS retCode = details::ValidateUtf16InPlace(
+            RegAllocationCategory::MultiStringValue, s, validation);
+        if (retCode != ERROR_SUCCESS)
+        {
+            throw RegException{ retCode, "Multi-string value is not well-formed UTF-16." };
+        }
+    }
+
+    return strings;
+}
+
+
+inline RegExpected<std::wstring> RegKey::TryGetStringValue(
+    const std::wstring& valueName,
+    const RegStringValidation validation
+) const
+{
+    RegExpected<std::wstring> value = TryGetStringValue(valueName);
+    if (!value || validation == RegStringValidation::None || details::IsValidUtf16(value.GetValue()))
+    {
+        return value;
+    }
+
+    if (validation == RegStringValidation::Reject)
+    {
+        return details::MakeRegExpectedWithError<std::wstring>(ERROR_INVALID_DATA);
+    }
+
+    return RegExpected<std::wstring>{
+        details::RepairUtf16(RegAllocationCategory::StringValue, value.GetValue(), validation) };
+}
+
+
+inline RegExpected<std::wstring> RegKey::TryGetExpandStringValue(
+    const std::wstring& valueName,
+    const ExpandStringOption expandOption,
+    const RegStringValidation validation
+) const
+{
+    RegExpected<std::wstring> value = TryGetExpandStringValue(valueName, expandOption);
+    if (!value || validation == RegStringValidation::None || details::IsValidUtf16(value.GetValue()))
+    {
+        return value;
+    }
+
+    if (validation == RegStringValidation::Reject)
+    {
+        return details::MakeRegExpectedWithError<std::wstring>(ERROR_INVALID_DATA);
+    }
+
+    return RegExpected<std::wstring>{
+        details::RepairUtf16(RegAllocationCategory::StringValue, value.GetValue(), validation) };
+}
+
+
+inline RegExpected<std::vector<std::wstring>> RegKey::TryGetMultiStringValue(
+    const std::wstring& valueName,
+    const RegStringValidation validation
+) const
+{
+    using RegValueType = std::vector<std::wstring>;
+
+    RegExpected<RegValueType> value = TryGetMultiStringValue(valueName);
+    if (!value || validation == RegStringValidation::None)
+    {
+        return value;
+    }
+
+    const auto isValid = [](const std::wstring& s) { return details::IsValidUtf16(s); };
+    if (std::all_of(value.GetValue().begin(), value.GetValue().end(), isValid))
+    {
+        return value;
+    }
+
+    // Only copy the strings when some of them must be repaired
+    RegValueType strings = value.GetValue();
+    details::AccountMultiStringResult(strings);
+    for (auto& s : strings)
+    {
+        LSTATUS retCode = details::ValidateUtf16InPlace(
+            RegAllocationCategory::MultiStringValue, s, validation);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return details::MakeRegExpectedWithError<RegValueType>(retCode);
+        }
+    }
+
+    return RegExpected<RegValueType>{ std::move(strings) };
+}
+
+
+inline bool RegKey::AppendToMultiString(
+    const std::wstring& valueName,
+    const std::wstring_view s,
+    const MultiStringEditOptions& options
+)
+{
+    RegExpected<bool> result = TryAppendToMultiString(valueName, s, options);
+    if (!result)
+    {
+        throw RegException{ result.GetError().Code(), "Cannot append to the multi-string value." };
+    }
+
+    return result.GetValue();
+}
+
+
+inline size_t RegKey::RemoveFromMultiString(
+    const std::wstring& valueName,
+    const std::wstring_view s,
+    const MultiStringEditOptions& options
+)
+{
+    RegExpected<size_t> result = TryRemoveFromMultiString(valueName, s, options);
+    if (!result)
+    {
+        throw RegException{ result.GetError().Code(), "Cannot remove from the multi-string value." };
+    }
+
+    return result.GetValue();
+}
+
+
+inline size_t RegKey::ReplaceInMultiString(
+    const std::wstring& valueName,
+    const std::wstring_view oldString,
+    const std::wstring_view newString,
+    const MultiStringEditOptions& options
+)
+{
+    RegExpected<size_t> result = TryReplaceInMultiString(valueName, oldString, newString, options);
+    if (!result)
+    {
+        throw RegException{ result.GetError().Code(), "Cannot replace in the multi-string value." };
+    }
+
+    return result.GetValue();
+}
+
+
+inline RegExpected<bool> RegKey::TryAppendToMultiString(
+    const std::wstring& valueName,
+    const std::wstring_view s,
+    const MultiStringEditOptions& options
+)
+{
+    _ASSERTE(IsValid());
+
+    size_t editCount = 0;
+    LSTATUS retCode = details::EditMultiString(
+        m_hKey,
+        valueName,
+        options,
+        true, // create the value if it doesn't exist
+        [&](std::vector<wchar_t>& data)
+        {
+            return details::AppendToMultiStringData(data, s, options);
+        },
+        editCount
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<bool>(retCode);
+    }
+
+    return RegExpected<bool>{ editCount != 0 };
+}
+
+
+inline RegExpected<size_t> RegKey::TryRemoveFromMultiString(
+    const std::wstring& valueName,
+    const std::wstring_view s,
+    const MultiStringEditOptions& options
+)
+{
+    _ASSERTE(IsValid());
+
+    size_t editCount = 0;
+    LSTATUS retCode = details::EditMultiString(
+        m_hKey,
+        valueName,
+        options,
+        false, // the value must exist
+        [&](std::vector<wchar_t>& data)
+        {
+            return details::RemoveFromMultiStringData(data, s, options);
+        },
+        editCount
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<size_t>(retCode);
+    }
+
+    return RegExpected<size_t>{ editCount };
+}
+
+
+inline RegExpected<size_t> RegKey::TryReplaceInMultiString(
+    const std::wstring& valueName,
+    const std::wstring_view oldString,
+    const std::wstring_view newString,
+    const MultiStringEditOptions& options
+)
+{
+    _ASSERTE(IsValid());
+
+    size_t editCount = 0;
+    LSTATUS retCode = details::EditMultiString(
+        m_hKey,
+        valueName,
+        options,
+        false, // the value must exist
+        [&](std::vector<wchar_t>& data)
+        {
+            return details::ReplaceInMultiStringData(data, oldString, newString, options);
+        },
+        editCount
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<size_t>(retCode);
+    }
+
+    return RegExpected<size_t>{ editCount };
+}
+
+
+inline std::vector<std::wstring> RegKey::EnumSubKeys() const
+{
+    _ASSERTE(IsValid());
+
+    // Get some useful enumeration info, like the total number of subkeys
+    // and the maximum length of the subkey names
+    DWORD subKeyCount = 0;
+    DWORD maxSubKeyNameLen = 0;
+    LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        m_hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        &subKeyCount,
+        &maxSubKeyNameLen,
+        nullptr,    // no subkey class length
+        nullptr,    // no value count
+        nullptr,    // no value name max length
+        nullptr,    // no max value length
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{
+            retCode,
+            "RegQueryInfoKeyW failed while preparing for subkey enumeration."
+        };
+    }
+
+    // NOTE: According to the MSDN documentation, the size returned for subkey name max length
+    // does *not* include the terminating NUL, so let's add +1 to take it into account
+    // when I allocate the buffer for reading subkey names.
+    maxSubKeyNameLen++;
+
+    // Preallocate a buffer for the subkey names
+    auto nameBuffer = std::make_unique<wchar_t[]>(maxSubKeyNameLen);
+    details::RecordAllocation(RegAllocationCategory::Enumeration, maxSubKeyNameLen * sizeof(wchar_t));
+
+    // The result subkey names will be stored here
+    std::vector<std::wstring> subkeyNames;
+
+    // Reserve room in the vector to speed up the following insertion loop
+    details::ReserveAccounted(RegAllocationCategory::Enumeration, subkeyNames, subKeyCount);
+
+    // Enumerate all the subkeys; the key can change meanwhile, so the count
+    // and the name length returned by RegQueryInfoKey are just hints
+    for (DWORD index = 0; index < subKeyCount; )
+    {
+        // Get the name of the current subkey
+        DWORD subKeyNameLen = maxSubKeyNameLen;
+        retCode = details::TracedRegEnumKeyExW(
+            __func__,
+            m_hKey,
+            index,
+            nameBuffer.get(),
+            &subKeyNameLen,
+            nullptr, // reserved
+            nullptr, // no class
+            nullptr, // no class
+            nullptr  // no last write time
+        );
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // A longer subkey name was added since RegQueryInfoKey:
+            // grow the buffer and retry
+            maxSubKeyNameLen *= 2;
+            nameBuffer = std::make_unique<wchar_t[]>(maxSubKeyNameLen);
+            details::RecordAllocation(RegAllocationCategory::Enumeration, maxSubKeyNameLen * sizeof(wchar_t));
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Subkeys were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            throw RegException{ retCode, "Cannot enumerate subkeys: RegEnumKeyExW failed." };
+        }
+
+        // On success, the ::RegEnumKeyEx API writes the length of the
+        // subkey name in the subKeyNameLen output parameter
+        // (not including the terminating NUL).
+        // So I can build a wstring based on that length.
+        subkeyNames.emplace_back(nameBuffer.get(), subKeyNameLen);
+        details::AccountStringStorage(RegAllocationCategory::Enumeration, subkeyNames.back());
+        index++;
+    }
+
+    return subkeyNames;
+}
+
+
+inline std::vector<std::pair<std::wstring, DWORD>> RegKey::EnumValues() const
+{
+    _ASSERTE(IsValid());
+
+    // Get useful enumeration info, like the total number of values
+    // and the maximum length of the value names
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        m_hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        nullptr,    // no subkey count
+        nullptr,    // no subkey max length
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        nullptr,    // no max value length
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{
+            retCode,
+            "RegQueryInfoKeyW failed while preparing for value enumeration."
+        };
+    }
+
+    // NOTE: According to the MSDN documentation, the size returned for value name max length
+    // does *not* include the terminating NUL, so let's add +1 to take it into account
+    // when I allocate the buffer for reading value names.
+    maxValueNameLen++;
+
+    // Preallocate a buffer for the value names
+    auto nameBuffer = std::make_unique<wchar_t[]>(maxValueNameLen);
+    details::RecordAllocation(RegAllocationCategory::Enumeration, maxValueNameLen * sizeof(wchar_t));
+
+    // The value names and types will be stored here
+    std::vector<std::pair<std::wstring, DWORD>> valueInfo;
+
+    // Reserve room in the vector to speed up the following insertion loop
+    details::ReserveAccounted(RegAllocationCategory::Enumeration, valueInfo, valueCount);
+
+    // Enumerate all the values; the key can change meanwhile, so the count
+    // and the name length returned by RegQueryInfoKey are just hints
+    for (DWORD index = 0; index < valueCount; )
+    {
+        // Get the name and the type of the current value
+        DWORD valueNameLen = maxValueNameLen;
+        DWORD valueType = 0;
+        retCode = details::TracedRegEnumValueW(
+            __func__,
+            m_hKey,
+            index,
+            nameBuffer.get(),
+            &valueNameLen,
+            nullptr,    // reserved
+            &valueType,
+            nullptr,    // no data
+            nullptr     // no data size
+        );
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // A longer value name was added since RegQueryInfoKey:
+            // grow the buffer and retry
+            maxValueNameLen *= 2;
+            nameBuffer = std::make_unique<wchar_t[]>(maxValueNameLen);
+            details::RecordAllocation(RegAllocationCategory::Enumeration, maxValueNameLen * sizeof(wchar_t));
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Values were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            throw RegException{ retCode, "Cannot enumerate values: RegEnumValueW failed." };
+        }
+
+        // On success, the RegEnumValue API writes the length of the
+        // value name in the valueNameLen output parameter
+        // (not including the terminating NUL).
+        // So we can build a wstring based on that.
+        valueInfo.emplace_back(
+            std::wstring{ nameBuffer.get(), valueNameLen },
+            valueType
+        );
+        details::AccountStringStorage(RegAllocationCategory::Enumeration, valueInfo.back().first);
+        index++;
+    }
+
+    return valueInfo;
+}
+
+
+inline void RegKey::EnumSubKeys(RegNameList& subKeyNames) const
+{
+    RegResult retCode = TryEnumSubKeys(subKeyNames);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot enumerate subkeys." };
+    }
+}
+
+
+inline void RegKey::EnumValues(RegNameList& valueNames) const
+{
+    RegResult retCode = TryEnumValues(valueNames);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot enumerate values." };
+    }
+}
+
+
+inline RegResult RegKey::TryEnumSubKeys(RegNameList& subKeyNames) const
+{
+    return TryEnumSubKeys(subKeyNames, RegOperationLimits{});
+}
+
+
+inline RegResult RegKey::TryEnumSubKeys(RegNameList& subKeyNames,
+                                        const RegOperationLimits& limits) const noexcept
+{
+    _ASSERTE(IsValid());
+
+    try
+    {
+        subKeyNames.Clear();
+
+        LSTATUS retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        // Get some useful enumeration info, like the total number of subkeys
+        // and the maximum length of the subkey names
+        DWORD subKeyCount = 0;
+        DWORD maxSubKeyNameLen = 0;
+        retCode = details::TracedRegQueryInfoKeyW(
+            __func__,
+            m_hKey,
+            nullptr,    // no user-defined class
+            nullptr,    // no user-defined class size
+            nullptr,    // reserved
+            &subKeyCount,
+            &maxSubKeyNameLen,
+            nullptr,    // no subkey class length
+            nullptr,    // no value count
+            nullptr,    // no value name max length
+            nullptr,    // no max value length
+            nullptr,    // no security descriptor
+            nullptr     // no last write time
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        // Reserve room in the list to speed up the following insertion loop
+        subKeyNames.Reserve(subKeyCount);
+
+        // Enumerate all the subkeys, writing the names directly into the list buffer;
+        // the key can change meanwhile, so the count and the name length
+        // returned by RegQueryInfoKey are just hints
+        for (DWORD index = 0; index < subKeyCount; )
+        {
+            retCode = details::CheckOperationLimits(limits);
+            if (retCode != ERROR_SUCCESS)
+            {
+                subKeyNames.Clear();
+                return RegResult{ retCode };
+            }
+
+            // Room for the name, including the terminating NUL
+            DWORD subKeyNameLen = maxSubKeyNameLen + 1;
+            wchar_t* const nameBuffer = subKeyNames.BeginAppend(maxSubKeyNameLen);
+
+            retCode = details::TracedRegEnumKeyExW(
+                __func__,
+                m_hKey,
+                index,
+                nameBuffer,
+                &subKeyNameLen,
+                nullptr, // reserved
+                nullptr, // no class
+                nullptr, // no class
+                nullptr  // no last write time
+            );
+            if (retCode == ERROR_MORE_DATA)
+            {
+                // A longer subkey name was added since RegQueryInfoKey:
+                // grow the room and retry
+                subKeyNames.CancelAppend();
+                maxSubKeyNameLen = 2 * maxSubKeyNameLen + 1;
+                continue;
+            }
+            if (retCode == ERROR_NO_MORE_ITEMS)
+            {
+                // Subkeys were deleted since RegQueryInfoKey
+                subKeyNames.CancelAppend();
+                break;
+            }
+            if (retCode != ERROR_SUCCESS)
+            {
+                subKeyNames.Clear();
+                return RegResult{ retCode };
+            }
+
+            // subKeyNameLen now stores the length of the name, not including the terminating NUL
+            subKeyNames.EndAppend(subKeyNameLen, REG_NONE);
+            index++;
+        }
+
+        return RegResult{ ERROR_SUCCESS };
+    }
+    catch (const std::bad_alloc&)
+    {
+        return RegResult{ ERROR_NOT_ENOUGH_MEMORY };
+    }
+}
+
+
+inline RegResult RegKey::TryEnumValues(RegNameList& valueNames) const
+{
+    return TryEnumValues(valueNames, RegOperationLimits{});
+}
+
+
+inline RegResult RegKey::TryEnumValues(RegNameList& valueNames,
+                                       const RegOperationLimits& limits) const noexcept
+{
+    _ASSERTE(IsValid());
+
+    try
+    {
+        valueNames.Clear();
+
+        LSTATUS retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        // Get useful enumeration info, like the total number of values
+        // and the maximum length of the value names
+        DWORD valueCount = 0;
+        DWORD maxValueNameLen = 0;
+        retCode = details::TracedRegQueryInfoKeyW(
+            __func__,
+            m_hKey,
+            nullptr,    // no user-defined class
+            nullptr,    // no user-defined class size
+            nullptr,    // reserved
+            nullptr,    // no subkey count
+            nullptr,    // no subkey max length
+            nullptr,    // no subkey class length
+            &valueCount,
+            &maxValueNameLen,
+            nullptr,    // no max value length
+            nullptr,    // no security descriptor
+            nullptr     // no last write time
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        // Reserve room in the list to speed up the following insertion loop
+        valueNames.Reserve(valueCount);
+
+        // Enumerate all the values, writing the names directly into the list buffer;
+        // the key can change meanwhile, so the count and the name length
+        // returned by RegQueryInfoKey are just hints
+        for (DWORD index = 0; index < valueCount; )
+        {
+            retCode = details::CheckOperationLimits(limits);
+            if (retCode != ERROR_SUCCESS)
+            {
+                valueNames.Clear();
+                return RegResult{ retCode };
+            }
+
+            // Room for the name, including the terminating NUL
+            DWORD valueNameLen = maxValueNameLen + 1;
+            DWORD valueType = 0;
+            wchar_t* const nameBuffer = valueNames.BeginAppend(maxValueNameLen);
+
+            retCode = details::TracedRegEnumValueW(
+                __func__,
+                m_hKey,
+                index,
+                nameBuffer,
+                &valueNameLen,
+                nullptr,    // reserved
+                &valueType,
+                nullptr,    // no data
+                nullptr     // no data size
+            );
+            if (retCode == ERROR_MORE_DATA)
+            {
+                // A longer value name was added since RegQueryInfoKey:
+                // grow the room and retry
+                valueNames.CancelAppend();
+                maxValueNameLen = 2 * maxValueNameLen + 1;
+                continue;
+            }
+            if (retCode == ERROR_NO_MORE_ITEMS)
+            {
+                // Values were deleted since RegQueryInfoKey
+                valueNames.CancelAppend();
+                break;
+            }
+            if (retCode != ERROR_SUCCESS)
+            {
+                valueNames.Clear();
+                return RegResult{ retCode };
+            }
+
+            // valueNameLen now stores the length of the name, not including the terminating NUL
+            valueNames.EndAppend(valueNameLen, valueType);
+            index++;
+        }
+
+        return RegResult{ ERROR_SUCCESS };
+    }
+    catch (const std::bad_alloc&)
+    {
+        return RegResult{ ERROR_NOT_ENOUGH_MEMORY };
+    }
+}
+
+
+inline bool RegKey::ContainsValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    // Invoke RegGetValueW to just check if the input value exists under the current key
+    LSTATUS retCode = details::TracedRegGetValueW(
+        __func__,
+        m_hKey,             // current key
+        nullptr,            // no subkey - check value in current key
+        valueName.c_str(),  // value name
+        RRF_RT_ANY,         // no type restriction on this value
+        nullptr,            // we don't need to know the type of the value
+        nullptr, nullptr    // we don't need the actual value, just to check if it exists
+    );
+    if (retCode == ERROR_SUCCESS)
+    {
+        // The value exists under the current key
+        return true;
+    }
+    else if (retCode == ERROR_FILE_NOT_FOUND)
+    {
+        // The value does *not* exist under the current key
+        return false;
+    }
+    else
+    {
+        // Some other error occurred - signal it by throwing an exception
+        throw RegException{
+            retCode,
+            "RegGetValueW failed when checking if the current key contains the specified value."
+        };
+    }
+}
+
+
+inline bool RegKey::ContainsSubKey(const std::wstring& subKey) const
+{
+    _ASSERTE(IsValid());
+
+    // Let's try and open the specified subKey, then check the return code
+    // of RegOpenKeyExW to figure out if the subKey exists or not.
+    HKEY hSubKey = nullptr;
+    LSTATUS retCode = details::TracedRegOpenKeyExW(
+        __func__,
+        m_hKey,
+        subKey.c_str(),
+        0,
+        KEY_READ,
+        &hSubKey
+    );
+    if (retCode == ERROR_SUCCESS)
+    {
+        // We were able to open the specified sub-key, so the sub-key does exist.
+        //
+        // Don't forget to close the sub-key opened for this testing purpose!
+        details::TracedRegCloseKey(hSubKey);
+        hSubKey = nullptr;
+
+        return true;
+    }
+    else if ((retCode == ERROR_FILE_NOT_FOUND) || (retCode == ERROR_PATH_NOT_FOUND))
+    {
+        // The specified sub-key does not exist
+        return false;
+    }
+    else
+    {
+        // Some other error occurred - signal it by throwing an exception
+        throw RegException{
+            retCode,
+            "RegOpenKeyExW failed when checking if the current key contains the specified sub-key."
+        };
+    }
+}
+
+
+inline RegExpected<std::vector<std::wstring>> RegKey::TryEnumSubKeys() const
+{
+    _ASSERTE(IsValid());
+
+    using ReturnType = std::vector<std::wstring>;
+
+    // Get some useful enumeration info, like the total number of subkeys
+    // and the maximum length of the subkey names
+    DWORD subKeyCount = 0;
+    DWORD maxSubKeyNameLen = 0;
+    LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        m_hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        &subKeyCount,
+        &maxSubKeyNameLen,
+        nullptr,    // no subkey class length
+        nullptr,    // no value count
+        nullptr,    // no value name max length
+        nullptr,    // no max value length
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<ReturnType>(retCode);
+    }
+
+    // NOTE: According to the MSDN documentation, the size returned for subkey name max length
+    // does *not* include the terminating NUL, so let's add +1 to take it into account
+    // when I allocate the buffer for reading subkey names.
+    maxSubKeyNameLen++;
+
+    // Preallocate a buffer for the subkey names
+    auto nameBuffer = std::make_unique<wchar_t[]>(maxSubKeyNameLen);
+    details::RecordAllocation(RegAllocationCategory::Enumeration, maxSubKeyNameLen * sizeof(wchar_t));
+
+    // The result subkey names will be stored here
+    std::vector<std::wstring> subkeyNames;
+
+    // Reserve room in the vector to speed up the following insertion loop
+    details::ReserveAccounted(RegAllocationCategory::Enumeration, subkeyNames, subKeyCount);
+
+    // Enumerate all the subkeys; the key can change meanwhile, so the count
+    // and the name length returned by RegQueryInfoKey are just hints
+    for (DWORD index = 0; index < subKeyCount; )
+    {
+        // Get the name of the current subkey
+        DWORD subKeyNameLen = maxSubKeyNameLen;
+        retCode = details::TracedRegEnumKeyExW(
+            __func__,
+            m_hKey,
+            index,
+            nameBuffer.get(),
+            &subKeyNameLen,
+            nullptr, // reserved
+            nullptr, // no class
+            nullptr, // no class
+            nullptr  // no last write time
+        );
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // A longer subkey name was added since RegQueryInfoKey:
+            // grow the buffer and retry
+            maxSubKeyNameLen *= 2;
+            nameBuffer = std::make_unique<wchar_t[]>(maxSubKeyNameLen);
+            details::RecordAllocation(RegAllocationCategory::Enumeration, maxSubKeyNameLen * sizeof(wchar_t));
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Subkeys were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return details::MakeRegExpectedWithError<ReturnType>(retCode);
+        }
+
+        // On success, the ::RegEnumKeyEx API writes the length of the
+        // subkey name in the subKeyNameLen output parameter
+        // (not including the terminating NUL).
+        // So I can build a wstring based on that length.
+        subkeyNames.emplace_back(nameBuffer.get(), subKeyNameLen);
+        details::AccountStringStorage(RegAllocationCategory::Enumeration, subkeyNames.back());
+        index++;
+    }
+
+    return RegExpected<ReturnType>{ subkeyNames };
+}
+
+
+inline RegExpected<std::vector<std::pair<std::wstring, DWORD>>> RegKey::TryEnumValues() const
+{
+    _ASSERTE(IsValid());
+
+    using ReturnType = std::vector<std::pair<std::wstring, DWORD>>;
+
+    // Get useful enumeration info, like the total number of values
+    // and the maximum length of the value names
+    DWORD valueCount = 0;
+    DWORD maxValueNameLen = 0;
+    LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        m_hKey,
+        nullptr,    // no user-defined class
+        nullptr,    // no user-defined class size
+        nullptr,    // reserved
+        nullptr,    // no subkey count
+        nullptr,    // no subkey max length
+        nullptr,    // no subkey class length
+        &valueCount,
+        &maxValueNameLen,
+        nullptr,    // no max value length
+        nullptr,    // no security descriptor
+        nullptr     // no last write time
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<ReturnType>(retCode);
+    }
+
+    // NOTE: According to the MSDN documentation, the size returned for value name max length
+    // does *not* include the terminating NUL, so let's add +1 to take it into account
+    // when I allocate the buffer for reading value names.
+    maxValueNameLen++;
+
+    // Preallocate a buffer for the value names
+    auto nameBuffer = std::make_unique<wchar_t[]>(maxValueNameLen);
+    details::RecordAllocation(RegAllocationCategory::Enumeration, maxValueNameLen * sizeof(wchar_t));
+
+    // The value names and types will be stored here
+    std::vector<std::pair<std::wstring, DWORD>> valueInfo;
+
+    // Reserve room in the vector to speed up the following insertion loop
+    details::ReserveAccounted(RegAllocationCategory::Enumeration, valueInfo, valueCount);
+
+    // Enumerate all the values; the key can change meanwhile, so the count
+    // and the name length returned by RegQueryInfoKey are just hints
+    for (DWORD index = 0; index < valueCount; )
+    {
+        // Get the name and the type of the current value
+        DWORD valueNameLen = maxValueNameLen;
+        DWORD valueType = 0;
+        retCode = details::TracedRegEnumValueW(
+            __func__,
+            m_hKey,
+            index,
+            nameBuffer.get(),
+            &valueNameLen,
+            nullptr,    // reserved
+            &valueType,
+            nullptr,    // no data
+            nullptr     // no data size
+        );
+        if (retCode == ERROR_MORE_DATA)
+        {
+            // A longer value name was added since RegQueryInfoKey:
+            // grow the buffer and retry
+            maxValueNameLen *= 2;
+            nameBuffer = std::make_unique<wchar_t[]>(maxValueNameLen);
+            details::RecordAllocation(RegAllocationCategory::Enumeration, maxValueNameLen * sizeof(wchar_t));
+            continue;
+        }
+        if (retCode == ERROR_NO_MORE_ITEMS)
+        {
+            // Values were deleted since RegQueryInfoKey
+            break;
+        }
+        if (retCode != ERROR_SUCCESS)
+        {
+            return details::MakeRegExpectedWithError<ReturnType>(retCode);
+        }
+
+        // On success, the RegEnumValue API writes the length of the
+        // value name in the valueNameLen output parameter
+        // (not including the terminating NUL).
+        // So we can build a wstring based on that.
+        valueInfo.emplace_back(
+            std::wstring{ nameBuffer.get(), valueNameLen },
+            valueType
+        );
+        details::AccountStringStorage(RegAllocationCategory::Enumeration, valueInfo.back().first);
+        index++;
+    }
+
+    return RegExpected<ReturnType>{ valueInfo };
+}
+
+
+inline RegExpected<bool> RegKey::TryContainsValue(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    // Invoke RegGetValueW to just check if the input value exists under the current key
+    LSTATUS retCode = details::TracedRegGetValueW(
+        __func__,
+        m_hKey,             // current key
+        nullptr,            // no subkey - check value in current key
+        valueName.c_str(),  // value name
+        RRF_RT_ANY,         // no type restriction on this value
+        nullptr,            // we don't need to know the type of the value
+        nullptr, nullptr    // we don't need the actual value, just to check if it exists
+    );
+    if (retCode == ERROR_SUCCESS)
+    {
+        // The value exists under the current key
+        return RegExpected<bool>{ true };
+    }
+    else if (retCode == ERROR_FILE_NOT_FOUND)
+    {
+        // The value does *not* exist under the current key
+        return RegExpected<bool>{ false };
+    }
+    else
+    {
+        // Some other error occurred
+        return details::MakeRegExpectedWithError<bool>(retCode);
+    }
+}
+
+
+inline RegExpected<bool> RegKey::TryContainsSubKey(const std::wstring& subKey) const
+{
+    _ASSERTE(IsValid());
+
+    // Let's try and open the specified subKey, then check the return code
+    // of RegOpenKeyExW to figure out if the subKey exists or not.
+    HKEY hSubKey = nullptr;
+    LSTATUS retCode = details::TracedRegOpenKeyExW(
+        __func__,
+        m_hKey,
+        subKey.c_str(),
+        0,
+        KEY_READ,
+        &hSubKey
+    );
+    if (retCode == ERROR_SUCCESS)
+    {
+        // We were able to open the specified sub-key, so the sub-key does exist.
+        //
+        // Don't forget to close the sub-key opened for this testing purpose!
+        details::TracedRegCloseKey(hSubKey);
+        hSubKey = nullptr;
+
+        return RegExpected<bool>{ true };
+    }
+    else if ((retCode == ERROR_FILE_NOT_FOUND) || (retCode == ERROR_PATH_NOT_FOUND))
+    {
+        // The specified sub-key does not exist
+        return RegExpected<bool>{ false };
+    }
+    else
+    {
+        // Some other error occurred
+        return details::MakeRegExpectedWithError<bool>(retCode);
+    }
+}
+
+
+inline DWORD RegKey::QueryValueType(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    DWORD typeId = 0;     // will be returned by RegQueryValueEx
+
+    LSTATUS retCode = details::TracedRegQueryValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        nullptr,    // reserved
+        &typeId,
+        nullptr,    // not interested
+        nullptr     // not interested
+    );
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "Cannot get the value type: RegQueryValueExW failed." };
+    }
+
+    return typeId;
+}
+
+
+inline RegExpected<DWORD> RegKey::TryQueryValueType(const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+
+    using ReturnType = DWORD;
+
+    DWORD typeId = 0;     // will be returned by RegQueryValueEx
+
+    LSTATUS retCode = details::TracedRegQueryValueExW(
+        __func__,
+        m_hKey,
+        valueName.c_str(),
+        nullptr,    // reserved
+        &typeId,
+        nullptr,    // not interested
+        nullptr     // not interested
+    );
+
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<ReturnType>(retCode);
+    }
+
+    return RegExpected<ReturnType>{ typeId };
+}
+
+
+inline RegKey::InfoKey RegKey::QueryInfoKey() const
+{
+    _ASSERTE(IsValid());
+
+    InfoKey infoKey{};
+    LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        m_hKey,
+        nullptr,
+        nullptr,
+        nullptr,
+        &(infoKey.NumberOfSubKeys),
+        nullptr,
+        nullptr,
+        &(infoKey.NumberOfValues),
+        nullptr,
+        nullptr,
+        nullptr,
+        &(infoKey.LastWriteTime)
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegQueryInfoKeyW failed." };
+    }
+
+    return infoKey;
+}
+
+
+inline RegExpected<RegKey::InfoKey> RegKey::TryQueryInfoKey() const
+{
+    _ASSERTE(IsValid());
+
+    using ReturnType = RegKey::InfoKey;
+
+    InfoKey infoKey{};
+    LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+        __func__,
+        m_hKey,
+        nullptr,
+        nullptr,
+        nullptr,
+        &(infoKey.NumberOfSubKeys),
+        nullptr,
+        nullptr,
+        &(infoKey.NumberOfValues),
+        nullptr,
+        nullptr,
+        nullptr,
+        &(infoKey.LastWriteTime)
+    );
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<ReturnType>(retCode);
+    }
+
+    return RegExpected<ReturnType>{ infoKey };
+}
+
+
+inline RegKey::KeyReflection RegKey::QueryReflectionKey() const
+{
+    BOOL isReflectionDisabled = FALSE;
+    LSTATUS retCode = details::TracedRegQueryReflectionKey(__func__, m_hKey, &isReflectionDisabled);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegQueryReflectionKey failed." };
+    }
+
+    return (isReflectionDisabled ? KeyReflection::ReflectionDisabled
+                                 : KeyReflection::ReflectionEnabled);
+}
+
+
+inline RegExpected<RegKey::KeyReflection> RegKey::TryQueryReflectionKey() const
+{
+    using ReturnType = RegKey::KeyReflection;
+
+    BOOL isReflectionDisabled = FALSE;
+    LSTATUS retCode = details::TracedRegQueryReflectionKey(__func__, m_hKey, &isReflectionDisabled);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return details::MakeRegExpectedWithError<ReturnType>(retCode);
+    }
+
+    KeyReflection keyReflection = isReflectionDisabled ? KeyReflection::ReflectionDisabled
+                                                       : KeyReflection::ReflectionEnabled;
+    return RegExpected<ReturnType>{ keyReflection };
+}
+
+
+inline void RegKey::DeleteValue(const std::wstring& valueName)
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegDeleteValueW(__func__, m_hKey, valueName.c_str());
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegDeleteValueW failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryDeleteValue(const std::wstring& valueName) noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegDeleteValueW(__func__, m_hKey, valueName.c_str()) };
+}
+
+
+inline void RegKey::DeleteKey(const std::wstring& subKey, const REGSAM desiredAccess)
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegDeleteKeyExW(__func__, m_hKey, subKey.c_str(), desiredAccess, 0);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegDeleteKeyExW failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryDeleteKey(const std::wstring& subKey,
+                                      const REGSAM desiredAccess) noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegDeleteKeyExW(__func__, m_hKey, subKey.c_str(), desiredAccess, 0) };
+}
+
+
+inline void RegKey::DeleteTree(const std::wstring& subKey)
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegDeleteTreeW(__func__, m_hKey, subKey.c_str());
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegDeleteTreeW failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryDeleteTree(const std::wstring& subKey) noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegDeleteTreeW(__func__, m_hKey, subKey.c_str()) };
+}
+
+
+inline void RegKey::CopyTree(const std::wstring& sourceSubKey, const RegKey& destKey)
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegCopyTreeW(__func__, m_hKey, sourceSubKey.c_str(), destKey.Get());
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegCopyTreeW failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryCopyTree(const std::wstring& sourceSubKey,
+                                     const RegKey& destKey) noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegCopyTreeW(__func__, m_hKey, sourceSubKey.c_str(), destKey.Get()) };
+}
+
+
+inline void RegKey::RenameKey(const std::wstring& subKey, const std::wstring& newKeyName)
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegRenameKey(__func__, m_hKey, subKey.c_str(), newKeyName.c_str());
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegRenameKey failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryRenameKey(const std::wstring& subKey,
+                                      const std::wstring& newKeyName) noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegRenameKey(__func__, m_hKey, subKey.c_str(), newKeyName.c_str()) };
+}
+
+
+inline void RegKey::MoveKey(const std::wstring& sourceSubKey,
+                            const RegKey& destKey,
+                            const std::wstring& destSubKey,
+                            const REGSAM registryView)
+{
+    RegResult retCode = TryMoveKey(sourceSubKey, destKey, destSubKey, registryView);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Moving the registry key failed." };
+    }
+}
+
+
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// For each trailing part of destSubKey (the last component, the last two,
+// and so on up to the whole path), check whether it exists under sourceKey.
+// Used by RegKey::TryMoveKey to tell whether a newly created destination
+// appeared inside the source subtree.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::vector<bool> ProbeTrailingPathsUnder(
+    const HKEY sourceKey,
+    const std::wstring& destSubKey,
+    const REGSAM registryView
+)
+{
+    std::vector<bool> exists;
+    size_t start = destSubKey.length();
+    do
+    {
+        start = (start > 0) ? destSubKey.rfind(L'\\', start - 1) : std::wstring::npos;
+        const size_t trailingStart = (start == std::wstring::npos) ? 0 : start + 1;
+
+        RegKey probe;
+        exists.push_back(probe.TryOpen(sourceKey, destSubKey.substr(trailingStart),
+                                       KEY_QUERY_VALUE | registryView).IsOk());
+    } while (start != std::wstring::npos);
+
+    return exists;
+}
+
+} // namespace details
+
+
+inline RegResult RegKey::TryMoveKey(const std::wstring& sourceSubKey,
+                                    const RegKey& destKey,
+                                    const std::wstring& destSubKey,
+                                    const REGSAM registryView) noexcept
+{
+    _ASSERTE(IsValid());
+    _ASSERTE(destKey.IsValid());
+
+    const std::wstring_view sourcePath{ sourceSubKey };
+    const std::wstring_view destPath{ destSubKey };
+    const size_t destSeparator = destPath.rfind(L'\\');
+    const wchar_t* const newKeyName = (destSeparator != std::wstring_view::npos)
+        ? destSubKey.c_str() + destSeparator + 1 : destSubKey.c_str();
+
+    bool isSameParent = false;
+    if (destKey.Get() == m_hKey)
+    {
+        const size_t sourceSeparator = sourcePath.rfind(L'\\');
+        const std::wstring_view sourceParent = (sourceSeparator != std::wstring_view::npos)
+            ? sourcePath.substr(0, sourceSeparator) : std::wstring_view{};
+        const std::wstring_view destParent = (destSeparator != std::wstring_view::npos)
+            ? destPath.substr(0, destSeparator) : std::wstring_view{};
+        isSameParent = details::EqualStrings(sourceParent, destParent, StringComparison::IgnoreCase);
+
+        // A key cannot be moved into its own subtree (through another handle,
+        // this is detected after creating the destination, see below)
+        if (!isSameParent
+            && (destPath.length() > sourcePath.length())
+            && (destPath[sourcePath.length()] == L'\\')
+            && details::EqualStrings(destPath.substr(0, sourcePath.length()), sourcePath,
+                                     StringComparison::IgnoreCase))
+        {
+            return RegResult{ ERROR_INVALID_PARAMETER };
+        }
+
+        // Just changing the case of the name: the destination is the source itself
+        if (isSameParent && details::EqualStrings(sourcePath, destPath, StringComparison::IgnoreCase))
+        {
+            return RegResult{ details::TracedRegRenameKey(__func__, m_hKey, sourceSubKey.c_str(), newKeyName) };
+        }
+    }
+
+    // The destination must not exist
+    {
+        RegKey existingKey;
+        const RegResult openResult = existingKey.TryOpen(destKey.Get(), destSubKey, KEY_READ | registryView);
+        if (openResult.IsOk())
+        {
+            return RegResult{ ERROR_ALREADY_EXISTS };
+        }
+        if (openResult.Code() != ERROR_FILE_NOT_FOUND)
+        {
+            return openResult;
+        }
+    }
+
+    if (isSameParent)
+    {
+        // Same parent: just rename the key, without touching its subtree
+        return RegResult{ details::TracedRegRenameKey(__func__, m_hKey, sourceSubKey.c_str(), newKeyName) };
+    }
+
+    // Open the source first, so that nothing is created if it doesn't exist
+    RegKey sourceKey;
+    RegResult retCode = sourceKey.TryOpen(m_hKey, sourceSubKey, KEY_READ | registryView);
+    if (retCode.Failed())
+    {
+        return retCode;
+    }
+
+    try
+    {
+        // Find the first missing key on the destination path: it and its
+        // subtree are created here, and are removed on failure
+        std::wstring createdSubKey = destSubKey;
+        for (size_t separator = destPath.find(L'\\');
+             separator != std::wstring_view::npos;
+             separator = destPath.find(L'\\', separator + 1))
+        {
+            RegKey parentKey;
+            if (parentKey.TryOpen(destKey.Get(), destSubKey.substr(0, separator),
+                                  KEY_QUERY_VALUE | registryView).Failed())
+            {
+                createdSubKey = destSubKey.substr(0, separator);
+                break;
+            }
+        }
+
+        // The destination doesn't exist yet: if it is created inside the source
+        // subtree, one of these trailing paths will appear under the source
+        const std::vector<bool> existedUnderSource =
+            details::ProbeTrailingPathsUnder(sourceKey.Get(), destSubKey, registryView);
+
+        RegKey newKey;
+        DWORD disposition = 0;
+        retCode = newKey.TryCreate(destKey.Get(), destSubKey, KEY_READ | KEY_WRITE | registryView,
+                                   REG_OPTION_NON_VOLATILE, nullptr, &disposition);
+        if (retCode.Failed())
+        {
+            return retCode;
+        }
+        if (disposition == REG_OPENED_EXISTING_KEY)
+        {
+            // Created by someone else meanwhile
+            return RegResult{ ERROR_ALREADY_EXISTS };
+        }
+
+        if (details::ProbeTrailingPathsUnder(sourceKey.Get(), destSubKey, registryView) != existedUnderSource)
+        {
+            // A key cannot be moved into its own subtree
+            newKey.Close();
+            (void)details::TracedRegDeleteTreeW(__func__, destKey.Get(), createdSubKey.c_str());
+            return RegResult{ ERROR_INVALID_PARAMETER };
+        }
+
+        // Copy the whole subtree with a single call
+        retCode = RegResult{ details::TracedRegCopyTreeW(__func__, sourceKey.Get(), nullptr, newKey.Get()) };
+        if (retCode.Failed())
+        {
+            // Remove the partial copy and the created parents (best effort),
+            // and report the copy error
+            newKey.Close();
+            (void)details::TracedRegDeleteTreeW(__func__, destKey.Get(), createdSubKey.c_str());
+            return retCode;
+        }
+
+        retCode = RegResult{ details::TracedRegDeleteTreeW(__func__, m_hKey, sourceSubKey.c_str()) };
+        if (retCode.Failed())
+        {
+            // The source may have been partly deleted: copy back the complete
+            // subtree from the destination, and then remove the destination.
+            // If copying back fails, the destination is kept, being the only
+            // complete copy left.
+            RegKey restoredKey;
+            if (restoredKey.TryCreate(m_hKey, sourceSubKey, KEY_WRITE | registryView).IsOk()
+                && (details::TracedRegCopyTreeW(__func__, newKey.Get(), nullptr, restoredKey.Get())
+                    == ERROR_SUCCESS))
+            {
+                newKey.Close();
+                (void)details::TracedRegDeleteTreeW(__func__, destKey.Get(), createdSubKey.c_str());
+            }
+            return retCode;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return RegResult{ ERROR_NOT_ENOUGH_MEMORY };
+    }
+    catch (const RegException& e)
+    {
+        return RegResult{ static_cast<LSTATUS>(e.code().value()) };
+    }
+
+    return RegResult{ ERROR_SUCCESS };
+}
+
+
+inline void RegKey::FlushKey()
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegFlushKey(__func__, m_hKey);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegFlushKey failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryFlushKey() noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegFlushKey(__func__, m_hKey) };
+}
+
+
+inline void RegKey::LoadKey(const std::wstring& subKey, const std::wstring& filename)
+{
+    Close();
+
+    LSTATUS retCode = details::TracedRegLoadKeyW(__func__, m_hKey, subKey.c_str(), filename.c_str());
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegLoadKeyW failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryLoadKey(const std::wstring& subKey,
+                                    const std::wstring& filename) noexcept
+{
+    Close();
+
+    return RegResult{ details::TracedRegLoadKeyW(__func__, m_hKey, subKey.c_str(), filename.c_str()) };
+}
+
+
+inline void RegKey::SaveKey(
+    const std::wstring& filename,
+    SECURITY_ATTRIBUTES* const securityAttributes
+) const
+{
+    _ASSERTE(IsValid());
+
+    LSTATUS retCode = details::TracedRegSaveKeyW(__func__, m_hKey, filename.c_str(), securityAttributes);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegSaveKeyW failed." };
+    }
+}
+
+
+inline RegResult RegKey::TrySaveKey(
+    const std::wstring& filename,
+    SECURITY_ATTRIBUTES* const securityAttributes
+) const noexcept
+{
+    _ASSERTE(IsValid());
+
+    return RegResult{ details::TracedRegSaveKeyW(__func__, m_hKey, filename.c_str(), securityAttributes) };
+}
+
+
+inline void RegKey::EnableReflectionKey()
+{
+    LSTATUS retCode = details::TracedRegEnableReflectionKey(__func__, m_hKey);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegEnableReflectionKey failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryEnableReflectionKey() noexcept
+{
+    return RegResult{ details::TracedRegEnableReflectionKey(__func__, m_hKey) };
+}
+
+
+inline void RegKey::DisableReflectionKey()
+{
+    LSTATUS retCode = details::TracedRegDisableReflectionKey(__func__, m_hKey);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegDisableReflectionKey failed." };
+    }
+}
+
+
+inline RegResult RegKey::TryDisableReflectionKey() noexcept
+{
+    return RegResult{ details::TracedRegDisableReflectionKey(__func__, m_hKey) };
+}
+
+
+inline void RegKey::ConnectRegistry(const std::wstring& machineName, const HKEY hKeyPredefined)
+{
+    // Safely close any previously opened key
+    Close();
+
+    HKEY hKeyResult = nullptr;
+    LSTATUS retCode = details::TracedRegConnectRegistryW(__func__, machineName.c_str(), hKeyPredefined, &hKeyResult);
+    if (retCode != ERROR_SUCCESS)
+    {
+        throw RegException{ retCode, "RegConnectRegistryW failed." };
+    }
+
+    // Take ownership of the result key
+    m_hKey = hKeyResult;
+}
+
+
+inline RegResult RegKey::TryConnectRegistry(const std::wstring& machineName,
+                                            const HKEY hKeyPredefined) noexcept
+{
+    // Safely close any previously opened key
+    Close();
+
+    HKEY hKeyResult = nullptr;
+    RegResult retCode{ details::TracedRegConnectRegistryW(__func__, machineName.c_str(), hKeyPredefined, &hKeyResult) };
+    if (retCode.Failed())
+    {
+        return retCode;
+    }
+
+    // Take ownership of the result key
+    m_hKey = hKeyResult;
+
+    _ASSERTE(retCode.IsOk());
+    return retCode;
+}
+
+
+inline std::vector<std::wstring> RegKey::EnumSubKeys(const RegOperationLimits& limits) const
+{
+    RegNameList subKeyNames;
+    EnumSubKeys(subKeyNames, limits);
+    return subKeyNames.ToVector();
+}
+
+
+inline std::vector<std::pair<std::wstring, DWORD>> RegKey::EnumValues(const RegOperationLimits& limits) const
+{
+    RegExpected<std::vector<std::pair<std::wstring, DWORD>>> valueInfo = TryEnumValues(limits);
+    if (!valueInfo.IsValid())
+    {
+        throw RegException{ valueInfo.GetError().Code(), "Cannot enumerate values." };
+    }
+    return valueInfo.GetValue();
+}
+
+
+inline void RegKey::EnumSubKeys(RegNameList& subKeyNames, const RegOperationLimits& limits) const
+{
+    RegResult retCode = TryEnumSubKeys(subKeyNames, limits);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot enumerate subkeys." };
+    }
+}
+
+
+inline void RegKey::EnumValues(RegNameList& valueNames, const RegOperationLimits& limits) const
+{
+    RegResult retCode = TryEnumValues(valueNames, limits);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot enumerate values." };
+    }
+}
+
+
+inline void RegKey::DeleteTree(const std::wstring& subKey,
+                               const RegOperationLimits& limits,
+                               const REGSAM registryView)
+{
+    RegResult retCode = TryDeleteTree(subKey, limits, registryView);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot delete the registry subtree." };
+    }
+}
+
+
+inline void RegKey::CopyTree(const std::wstring& sourceSubKey,
+                             const RegKey& destKey,
+                             const RegOperationLimits& limits,
+                             const REGSAM registryView)
+{
+    RegResult retCode = TryCopyTree(sourceSubKey, destKey, limits, registryView);
     if (retCode.Failed())
     {
-        return retCode;
+        throw RegException{ retCode.Code(), "Cannot copy the registry subtree." };
+    }
+}
+
+
+inline RegExpected<std::vector<std::wstring>> RegKey::TryEnumSubKeys(const RegOperationLimits& limits) const noexcept
+{
+    using ReturnType = std::vector<std::wstring>;
+
+    try
+    {
+        RegNameList subKeyNames;
+        RegResult retCode = TryEnumSubKeys(subKeyNames, limits);
+        if (retCode.Failed())
+        {
+            return RegExpected<ReturnType>{ retCode };
+        }
+
+        return RegExpected<ReturnType>{ subKeyNames.ToVector() };
+    }
+    catch (const std::bad_alloc&)
+    {
+        return details::MakeRegExpectedWithError<ReturnType>(ERROR_NOT_ENOUGH_MEMORY);
+    }
+}
+
+
+inline RegExpected<std::vector<std::pair<std::wstring, DWORD>>>
+    RegKey::TryEnumValues(const RegOperationLimits& limits) const noexcept
+{
+    using ReturnType = std::vector<std::pair<std::wstring, DWORD>>;
+
+    try
+    {
+        RegNameList valueNames;
+        RegResult retCode = TryEnumValues(valueNames, limits);
+        if (retCode.Failed())
+        {
+            return RegExpected<ReturnType>{ retCode };
+        }
+
+        ReturnType valueInfo;
+        details::ReserveAccounted(RegAllocationCategory::Enumeration, valueInfo, valueNames.Size());
+        for (size_t index = 0; index < valueNames.Size(); index++)
+        {
+            valueInfo.emplace_back(std::wstring{ valueNames.Name(index) }, valueNames.Type(index));
+            details::AccountStringStorage(RegAllocationCategory::Enumeration, valueInfo.back().first);
+        }
+
+        return RegExpected<ReturnType>{ std::move(valueInfo) };
+    }
+    catch (const std::bad_alloc&)
+    {
+        return details::MakeRegExpectedWithError<ReturnType>(ERROR_NOT_ENOUGH_MEMORY);
+    }
+}
+
+
+inline RegResult RegKey::TryDeleteTree(const std::wstring& subKey,
+                                       const RegOperationLimits& limits,
+                                       const REGSAM registryView) noexcept
+{
+    _ASSERTE(IsValid());
+
+    try
+    {
+        if (subKey.empty())
+        {
+            // Like RegDeleteTree: delete the subkeys and the values of this key
+            LSTATUS retCode = details::DeleteSubKeysWithLimits(m_hKey, limits, registryView);
+            if (retCode != ERROR_SUCCESS)
+            {
+                return RegResult{ retCode };
+            }
+
+            return RegResult{ details::DeleteValuesWithLimits(m_hKey, limits) };
+        }
+
+        LSTATUS retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        {
+            RegKey key;
+            retCode = key.TryOpen(m_hKey, subKey,
+                                  KEY_ENUMERATE_SUB_KEYS | KEY_QUERY_VALUE | registryView).Code();
+            if (retCode != ERROR_SUCCESS)
+            {
+                return RegResult{ retCode };
+            }
+
+            retCode = details::DeleteSubKeysWithLimits(key.Get(), limits, registryView);
+            if (retCode != ERROR_SUCCESS)
+            {
+                return RegResult{ retCode };
+            }
+        }
+
+        retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        return RegResult{ details::TracedRegDeleteKeyExW(__func__, m_hKey, subKey.c_str(), registryView, 0) };
+    }
+    catch (const std::bad_alloc&)
+    {
+        return RegResult{ ERROR_NOT_ENOUGH_MEMORY };
+    }
+}
+
+
+inline RegResult RegKey::TryCopyTree(const std::wstring& sourceSubKey,
+                                     const RegKey& destKey,
+                                     const RegOperationLimits& limits,
+                                     const REGSAM registryView) noexcept
+{
+    _ASSERTE(IsValid());
+    _ASSERTE(destKey.IsValid());
+
+    try
+    {
+        if (sourceSubKey.empty())
+        {
+            return RegResult{ details::CopyTreeWithLimits(m_hKey, destKey.Get(), limits, registryView) };
+        }
+
+        LSTATUS retCode = details::CheckOperationLimits(limits);
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        RegKey sourceKey;
+        retCode = sourceKey.TryOpen(m_hKey, sourceSubKey, KEY_READ | registryView).Code();
+        if (retCode != ERROR_SUCCESS)
+        {
+            return RegResult{ retCode };
+        }
+
+        return RegResult{ details::CopyTreeWithLimits(sourceKey.Get(), destKey.Get(), limits, registryView) };
+    }
+    catch (const std::bad_alloc&)
+    {
+        return RegResult{ ERROR_NOT_ENOUGH_MEMORY };
+    }
+}
+
+
+inline RegDeleteValuesResult RegKey::DeleteValues(const std::vector<std::wstring>& valueNames)
+{
+    _ASSERTE(IsValid());
+
+    RegDeleteValuesResult result;
+    for (const auto& valueName : valueNames)
+    {
+        LSTATUS retCode = details::TracedRegDeleteValueW(__func__, m_hKey, valueName.c_str());
+        if (retCode == ERROR_SUCCESS)
+        {
+            result.DeletedCount++;
+        }
+        else
+        {
+            result.Failures.emplace_back(valueName, RegResult{ retCode });
+        }
+    }
+
+    return result;
+}
+
+
+inline RegDeleteValuesResult RegKey::DeleteValues(const RegNameList& valueNames)
+{
+    _ASSERTE(IsValid());
+
+    RegDeleteValuesResult result;
+    for (size_t i = 0; i < valueNames.Size(); i++)
+    {
+        // The names in a RegNameList are NUL-terminated
+        const std::wstring_view valueName = valueNames[i];
+        LSTATUS retCode = details::TracedRegDeleteValueW(__func__, m_hKey, valueName.data());
+        if (retCode == ERROR_SUCCESS)
+        {
+            result.DeletedCount++;
+        }
+        else
+        {
+            result.Failures.emplace_back(std::wstring{ valueName }, RegResult{ retCode });
+        }
+    }
+
+    return result;
+}
+
+
+template <typename Predicate>
+inline RegDeleteValuesResult RegKey::DeleteValuesIf(Predicate&& predicate)
+{
+    RegExpected<RegDeleteValuesResult> result = TryDeleteValuesIf(std::forward<Predicate>(predicate));
+    if (!result)
+    {
+        throw RegException{ result.GetError().Code(), "Enumerating the values to delete failed." };
+    }
+
+    return result.GetValue();
+}
+
+
+template <typename Predicate>
+inline RegExpected<RegDeleteValuesResult> RegKey::TryDeleteValuesIf(Predicate&& predicate)
+    noexcept(std::is_nothrow_invocable_v<Predicate&, const RegValueView&>)
+{
+    _ASSERTE(IsValid());
+
+    try
+    {
+        DWORD valueCount = 0;
+        DWORD maxValueNameLen = 0;
+        DWORD maxValueDataLen = 0;
+        LSTATUS retCode = details::TracedRegQueryInfoKeyW(
+            __func__,
+            m_hKey,
+            nullptr,    // no user-defined class
+            nullptr,    // no user-defined class size
+            nullptr,    // reserved
+            nullptr,    // no subkey count
+            nullptr,    // no subkey max length
+            nullptr,    // no subkey class length
+            &valueCount,
+            &maxValueNameLen,
+            &maxValueDataLen,
+            nullptr,    // no security descriptor
+            nullptr     // no last write time
+        );
+        if (retCode != ERROR_SUCCESS)
+        {
+            return details::MakeRegExpectedWithError<RegDeleteValuesResult>(retCode);
+        }
+
+        // Read names, types and data, with one RegEnumValue call per value,
+        // reusing the same buffers; the values to delete are collected
+        // (and deleted later) so the enumeration indexes stay stable
+        std::vector<wchar_t> nameBuffer(static_cast<size_t>(maxValueNameLen) + 1);
+        std::vector<BYTE> dataBuffer(maxValueDataLen);
+        RegNameList targets;
+
+        for (DWORD index = 0; index < valueCount; )
+        {
+            DWORD valueNameLen = static_cast<DWORD>(nameBuffer.size());
+            DWORD valueType = REG_NONE;
+            DWORD dataSize = static_cast<DWORD>(dataBuffer.size());
+            retCode = details::TracedRegEnumValueW(
+                __func__,
+                m_hKey,
+                index,
+                nameBuffer.data(),
+                &valueNameLen,
+                nullptr,    // reserved
+                &valueType,
+                dataBuffer.empty() ? nullptr : dataBuffer.data(),
+                &dataSize
+            );
+            if ((retCode == ERROR_SUCCESS) && (dataSize > dataBuffer.size()))
+            {
+                // With a null data pointer the call succeeds and only reports the size:
+                // the value gained data since RegQueryInfoKey
+                retCode = ERROR_MORE_DATA;
+            }
+            if (retCode == ERROR_MORE_DATA)
+            {
+                // The value changed since RegQueryInfoKey: grow the buffers and retry
+                nameBuffer.resize(nameBuffer.size() * 2);
+                if (dataSize > dataBuffer.size())
+                {
+                    dataBuffer.resize(dataSize);
+                }
+                continue;
+            }
+            if (retCode == ERROR_NO_MORE_ITEMS)
+            {
+                // Values were deleted since RegQueryInfoKey
+                break;
+            }
+            if (retCode != ERROR_SUCCESS)
+            {
+                return details::MakeRegExpectedWithError<RegDeleteValuesResult>(retCode);
+            }
+
+            const RegValueView value{
+                std::wstring_view{ nameBuffer.data(), valueNameLen },
+                valueType,
+                dataBuffer.empty() ? nullptr : dataBuffer.data(),
+                dataSize
+            };
+            if (predicate(value))
+            {
+                targets.Append(value.Name, valueType);
+            }
+
+            index++;
+        }
+
+        return RegExpected<RegDeleteValuesResult>{ DeleteValues(targets) };
+    }
+    catch (const std::bad_alloc&)
+    {
+        return details::MakeRegExpectedWithError<RegDeleteValuesResult>(ERROR_NOT_ENOUGH_MEMORY);
+    }
+}
+
+
+inline std::wstring RegKey::RegTypeToString(const DWORD regType)
+{
+    switch (regType)
+    {
+        case REG_SZ:        return L"REG_SZ";
+        case REG_EXPAND_SZ: return L"REG_EXPAND_SZ";
+        case REG_MULTI_SZ:  return L"REG_MULTI_SZ";
+        case REG_DWORD:     return L"REG_DWORD";
+        case REG_QWORD:     return L"REG_QWORD";
+        case REG_BINARY:    return L"REG_BINARY";
+
+        default:            return L"Unknown/unsupported registry type";
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//                          RegException Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegException::RegException(const LSTATUS errorCode, const char* const message)
+    : std::system_error{ errorCode, std::system_category(), message }
+{}
+
+
+inline RegException::RegException(const LSTATUS errorCode, const std::string& message)
+    : std::system_error{ errorCode, std::system_category(), message }
+{}
+
+
+//------------------------------------------------------------------------------
+//                          RegResult Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegResult::RegResult(const LSTATUS result) noexcept
+    : m_result{ result }
+{}
+
+
+inline bool RegResult::IsOk() const noexcept
+{
+    return m_result == ERROR_SUCCESS;
+}
+
+
+inline bool RegResult::Failed() const noexcept
+{
+    return m_result != ERROR_SUCCESS;
+}
+
+
+inline RegResult::operator bool() const noexcept
+{
+    return IsOk();
+}
+
+
+inline LSTATUS RegResult::Code() const noexcept
+{
+    return m_result;
+}
+
+
+inline bool RegResult::IsCancelled() const noexcept
+{
+    return m_result == ERROR_CANCELLED;
+}
+
+
+inline bool RegResult::IsTimedOut() const noexcept
+{
+    return m_result == ERROR_TIMEOUT;
+}
+
+
+inline std::wstring RegResult::ErrorMessage() const
+{
+    return ErrorMessage(MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT));
+}
+
+
+inline std::wstring RegResult::ErrorMessage(const DWORD languageId) const
+{
+    // Invoke FormatMessage() to retrieve the error message from Windows
+    details::ScopedLocalFree<wchar_t> messagePtr;
+    DWORD retCode = ::FormatMessageW(
+        FORMAT_MESSAGE_ALLOCATE_BUFFER |
+        FORMAT_MESSAGE_FROM_SYSTEM |
+        FORMAT_MESSAGE_IGNORE_INSERTS,
+        nullptr,
+        m_result,
+        languageId,
+        reinterpret_cast<LPWSTR>(messagePtr.AddressOf()),
+        0,
+        nullptr
+    );
+    if (retCode == 0)
+    {
+        // FormatMessage failed: return an empty string
+        return std::wstring{};
     }
 
-    // Safely close any previously opened key
-    Close();
+    // Safely copy the C-string returned by FormatMessage() into a std::wstring object,
+    // and return it back to the caller.
+    return std::wstring{ messagePtr.Get() };
+}
+
+
+//------------------------------------------------------------------------------
+//                          RegExpected Inline Methods
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline RegExpected<T>::RegExpected(const RegResult& errorCode) noexcept
+    : m_var{ errorCode }
+{}
+
+
+template <typename T>
+inline RegExpected<T>::RegExpected(const T& value)
+    : m_var{ value }
+{}
+
 
-    // Take ownership of the newly created key
-    m_hKey = hKey;
+template <typename T>
+inline RegExpected<T>::RegExpected(T&& value)
+    : m_var{ std::move(value) }
+{}
 
-    _ASSERTE(retCode.IsOk());
-    return retCode;
+
+template <typename T>
+inline RegExpected<T>::operator bool() const noexcept
+{
+    return IsValid();
 }
 
 
-inline void RegKey::SetDwordValue(const std::wstring& valueName, const DWORD data)
+template <typename T>
+inline bool RegExpected<T>::IsValid() const noexcept
 {
-    _ASSERTE(IsValid());
-
-    LSTATUS retCode = ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_DWORD,
-        reinterpret_cast<const BYTE*>(&data),
-        sizeof(data)
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "Cannot write DWORD value: RegSetValueExW failed." };
-    }
+    return std::holds_alternative<T>(m_var);
 }
 
 
-inline void RegKey::SetQwordValue(const std::wstring& valueName, const ULONGLONG& data)
+template <typename T>
+inline const T& RegExpected<T>::GetValue() const &
 {
+    // Check that the object stores a valid value
     _ASSERTE(IsValid());
 
-    LSTATUS retCode = ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_QWORD,
-        reinterpret_cast<const BYTE*>(&data),
-        sizeof(data)
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "Cannot write QWORD value: RegSetValueExW failed." };
-    }
+    // If the object is in a valid state, the variant stores an instance of T
+    return std::get<T>(m_var);
 }
 
 
-inline void RegKey::SetStringValue(const std::wstring& valueName, const std::wstring& data)
+template <typename T>
+inline T&& RegExpected<T>::GetValue() &&
 {
     _ASSERTE(IsValid());
-
-    // String size including the terminating NUL, in bytes
-    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
-
-    LSTATUS retCode = ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_SZ,
-        reinterpret_cast<const BYTE*>(data.c_str()),
-        dataSize
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "Cannot write string value: RegSetValueExW failed." };
-    }
+    return std::get<T>(std::move(m_var));
 }
 
 
-inline void RegKey::SetExpandStringValue(const std::wstring& valueName, const std::wstring& data)
+template <typename T>
+inline RegResult RegExpected<T>::GetError() const
 {
-    _ASSERTE(IsValid());
-
-    // String size including the terminating NUL, in bytes
-    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
+    // Check that the object is in an invalid state
+    _ASSERTE(!IsValid());
 
-    LSTATUS retCode = ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_EXPAND_SZ,
-        reinterpret_cast<const BYTE*>(data.c_str()),
-        dataSize
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "Cannot write expand string value: RegSetValueExW failed." };
-    }
+    // If the object is in an invalid state, the variant stores a RegResult
+    // that represents an error code from the Windows Registry API
+    return std::get<RegResult>(m_var);
 }
 
 
-inline void RegKey::SetMultiStringValue(
-    const std::wstring& valueName,
-    const std::vector<std::wstring>& data
-)
+//------------------------------------------------------------------------------
+//                      RegDeleteValuesResult Inline Methods
+//------------------------------------------------------------------------------
+
+inline bool RegDeleteValuesResult::AllDeleted() const noexcept
 {
-    _ASSERTE(IsValid());
+    return Failures.empty();
+}
 
-    // First, we have to build a double-NUL-terminated multi-string from the input data
-    const std::vector<wchar_t> multiString = details::BuildMultiString(data);
 
-    // Total size, in bytes, of the whole multi-string structure
-    const DWORD dataSize = details::SafeCastSizeToDword(multiString.size() * sizeof(wchar_t));
+//------------------------------------------------------------------------------
+//                          RegBackend Inline Methods
+//------------------------------------------------------------------------------
 
-    LSTATUS retCode = ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_MULTI_SZ,
-        reinterpret_cast<const BYTE*>(multiString.data()),
-        dataSize
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "Cannot write multi-string value: RegSetValueExW failed." };
-    }
+inline RegBackend* RegBackend::SetCurrent(RegBackend* const backend) noexcept
+{
+    return s_current.exchange(backend, std::memory_order_acq_rel);
 }
 
 
-inline void RegKey::SetBinaryValue(const std::wstring& valueName, const std::vector<BYTE>& data)
+inline RegBackend* RegBackend::Current() noexcept
 {
-    _ASSERTE(IsValid());
+    return s_current.load(std::memory_order_acquire);
+}
 
-    // Total data size, in bytes
-    const DWORD dataSize = details::SafeCastSizeToDword(data.size());
 
-    LSTATUS retCode = ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_BINARY,
-        data.data(),
-        dataSize
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "Cannot write binary data value: RegSetValueExW failed." };
-    }
+inline LSTATUS RegBackend::ConnectRegistry(
+    [[maybe_unused]] const LPCWSTR machineName,
+    [[maybe_unused]] const HKEY hKey,
+    [[maybe_unused]] const PHKEY result) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
 }
 
 
-inline void RegKey::SetBinaryValue(
-    const std::wstring& valueName,
+inline LSTATUS RegBackend::SetKeyValue(
+    const HKEY hKey,
+    const LPCWSTR subKey,
+    const LPCWSTR valueName,
+    const DWORD type,
     const void* const data,
-    const DWORD dataSize
-)
+    const DWORD dataSize) noexcept
 {
-    _ASSERTE(IsValid());
+    if ((subKey == nullptr) || (*subKey == L'\0'))
+    {
+        return SetValueEx(hKey, valueName, 0, type, static_cast<const BYTE*>(data), dataSize);
+    }
 
-    LSTATUS retCode = ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_BINARY,
-        static_cast<const BYTE*>(data),
-        dataSize
-    );
+    HKEY hSubKey = nullptr;
+    LSTATUS retCode = CreateKeyEx(hKey, subKey, 0, nullptr, REG_OPTION_NON_VOLATILE, KEY_SET_VALUE,
+                                  nullptr, &hSubKey, nullptr);
     if (retCode != ERROR_SUCCESS)
     {
-        throw RegException{ retCode, "Cannot write binary data value: RegSetValueExW failed." };
+        return retCode;
     }
+
+    retCode = SetValueEx(hSubKey, valueName, 0, type, static_cast<const BYTE*>(data), dataSize);
+    CloseKey(hSubKey);
+    return retCode;
 }
 
 
-inline RegResult RegKey::TrySetDwordValue(const std::wstring& valueName, const DWORD data) noexcept
+inline LSTATUS RegBackend::CopyTree(
+    [[maybe_unused]] const HKEY hKeySource,
+    [[maybe_unused]] const LPCWSTR subKey,
+    [[maybe_unused]] const HKEY hKeyDest) noexcept
 {
-    _ASSERTE(IsValid());
-
-    return RegResult{ ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_DWORD,
-        reinterpret_cast<const BYTE*>(&data),
-        sizeof(data)
-    ) };
+    return ERROR_NOT_SUPPORTED;
 }
 
 
-inline RegResult RegKey::TrySetQwordValue(const std::wstring& valueName,
-                                          const ULONGLONG& data) noexcept
+inline LSTATUS RegBackend::RenameKey(
+    [[maybe_unused]] const HKEY hKey,
+    [[maybe_unused]] const LPCWSTR subKey,
+    [[maybe_unused]] const LPCWSTR newKeyName) noexcept
 {
-    _ASSERTE(IsValid());
-
-    return RegResult{ ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_QWORD,
-        reinterpret_cast<const BYTE*>(&data),
-        sizeof(data)
-    ) };
+    return ERROR_NOT_SUPPORTED;
 }
 
 
-inline RegResult RegKey::TrySetStringValue(const std::wstring& valueName,
-                                           const std::wstring& data)
+inline LSTATUS RegBackend::FlushKey([[maybe_unused]] const HKEY hKey) noexcept
 {
-    _ASSERTE(IsValid());
+    return ERROR_SUCCESS;
+}
 
-    // String size including the terminating NUL, in bytes
-    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
 
-    return RegResult{ ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_SZ,
-        reinterpret_cast<const BYTE*>(data.c_str()),
-        dataSize
-    ) };
+inline LSTATUS RegBackend::LoadKey(
+    [[maybe_unused]] const HKEY hKey,
+    [[maybe_unused]] const LPCWSTR subKey,
+    [[maybe_unused]] const LPCWSTR fileName) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
 }
 
 
-inline RegResult RegKey::TrySetExpandStringValue(const std::wstring& valueName,
-                                                 const std::wstring& data)
+inline LSTATUS RegBackend::SaveKey(
+    [[maybe_unused]] const HKEY hKey,
+    [[maybe_unused]] const LPCWSTR fileName,
+    [[maybe_unused]] SECURITY_ATTRIBUTES* const securityAttributes) noexcept
 {
-    _ASSERTE(IsValid());
+    return ERROR_NOT_SUPPORTED;
+}
 
-    // String size including the terminating NUL, in bytes
-    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
 
-    return RegResult{ ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_EXPAND_SZ,
-        reinterpret_cast<const BYTE*>(data.c_str()),
-        dataSize
-    ) };
+inline LSTATUS RegBackend::QueryReflectionKey(
+    [[maybe_unused]] const HKEY hKey,
+    [[maybe_unused]] BOOL* const isReflectionDisabled) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
 }
 
 
-inline RegResult RegKey::TrySetMultiStringValue(const std::wstring& valueName,
-                                                const std::vector<std::wstring>& data)
+inline LSTATUS RegBackend::EnableReflectionKey([[maybe_unused]] const HKEY hKey) noexcept
 {
-    _ASSERTE(IsValid());
-
-    // First, we have to build a double-NUL-terminated multi-string from the input data.
-    //
-    // NOTE: This is the reason why I *cannot* mark this method noexcept,
-    // since a *dynamic allocation* happens for creating the std::vector in BuildMultiString.
-    // And, if dynamic memory allocations fail, an exception is thrown.
-    //
-    const std::vector<wchar_t> multiString = details::BuildMultiString(data);
+    return ERROR_NOT_SUPPORTED;
+}
 
-    // Total size, in bytes, of the whole multi-string structure
-    const DWORD dataSize = details::SafeCastSizeToDword(multiString.size() * sizeof(wchar_t));
 
-    return RegResult{ ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_MULTI_SZ,
-        reinterpret_cast<const BYTE*>(multiString.data()),
-        dataSize
-    ) };
+inline LSTATUS RegBackend::DisableReflectionKey([[maybe_unused]] const HKEY hKey) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
 }
 
 
-inline RegResult RegKey::TrySetBinaryValue(const std::wstring& valueName,
-                                           const std::vector<BYTE>& data)
+inline LSTATUS RegBackend::NotifyChangeKeyValue(
+    [[maybe_unused]] const HKEY hKey,
+    [[maybe_unused]] const BOOL watchSubtree,
+    [[maybe_unused]] const DWORD notifyFilter,
+    [[maybe_unused]] const HANDLE event,
+    [[maybe_unused]] const BOOL asynchronous) noexcept
 {
-    _ASSERTE(IsValid());
+    return ERROR_NOT_SUPPORTED;
+}
 
-    // Total data size, in bytes
-    const DWORD dataSize = details::SafeCastSizeToDword(data.size());
 
-    return RegResult{ ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_BINARY,
-        data.data(),
-        dataSize
-    ) };
-}
+//------------------------------------------------------------------------------
+//                      RegBackendScope Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegBackendScope::RegBackendScope(RegBackend& backend) noexcept
+    : m_previous{ RegBackend::SetCurrent(&backend) }
+{}
 
 
-inline RegResult RegKey::TrySetBinaryValue(const std::wstring& valueName,
-                                           const void* const data,
-                                           const DWORD dataSize) noexcept
+inline RegBackendScope::~RegBackendScope()
 {
-    _ASSERTE(IsValid());
+    RegBackend::SetCurrent(m_previous);
+}
 
-    return RegResult{ ::RegSetValueExW(
-        m_hKey,
-        valueName.c_str(),
-        0, // reserved
-        REG_BINARY,
-        static_cast<const BYTE*>(data),
-        dataSize
-    ) };
+
+//------------------------------------------------------------------------------
+//                      RegCancellationToken Inline Methods
+//------------------------------------------------------------------------------
+
+inline void RegCancellationToken::Cancel() noexcept
+{
+    m_cancelled.store(true, std::memory_order_release);
 }
 
 
-inline DWORD RegKey::GetDwordValue(const std::wstring& valueName) const
+inline void RegCancellationToken::Reset() noexcept
 {
-    _ASSERTE(IsValid());
+    m_cancelled.store(false, std::memory_order_release);
+}
 
-    DWORD data = 0;                  // to be read from the registry
-    DWORD dataSize = sizeof(data);   // size of data, in bytes
 
-    constexpr DWORD flags = RRF_RT_REG_DWORD;
-    LSTATUS retCode = ::RegGetValueW(
-        m_hKey,
-        nullptr, // no subkey
-        valueName.c_str(),
-        flags,
-        nullptr, // type not required
-        &data,
-        &dataSize
-    );
+inline bool RegCancellationToken::IsCancelled() const noexcept
+{
+    return m_cancelled.load(std::memory_order_acquire);
+}
+
+
+//------------------------------------------------------------------------------
+//              Path-Addressed Registry Value Access Inline Functions
+//------------------------------------------------------------------------------
+
+inline DWORD GetDwordValue(const HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName)
+{
+    DWORD data = 0;
+    LSTATUS retCode = details::GetFixedSizeValueAt(rootKey, subKey, valueName, RRF_RT_REG_DWORD, data);
     if (retCode != ERROR_SUCCESS)
     {
         throw RegException{ retCode, "Cannot get DWORD value: RegGetValueW failed." };
     }
-
     return data;
 }
 
 
-inline ULONGLONG RegKey::GetQwordValue(const std::wstring& valueName) const
+inline ULONGLONG GetQwordValue(const HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName)
 {
-    _ASSERTE(IsValid());
-
-    ULONGLONG data = 0;              // to be read from the registry
-    DWORD dataSize = sizeof(data);   // size of data, in bytes
-
-    constexpr DWORD flags = RRF_RT_REG_QWORD;
-    LSTATUS retCode = ::RegGetValueW(
-        m_hKey,
-        nullptr, // no subkey
-        valueName.c_str(),
-        flags,
-        nullptr, // type not required
-        &data,
-        &dataSize
-    );
+    ULONGLONG data = 0;
+    LSTATUS retCode = details::GetFixedSizeValueAt(rootKey, subKey, valueName, RRF_RT_REG_QWORD, data);
     if (retCode != ERROR_SUCCESS)
     {
         throw RegException{ retCode, "Cannot get QWORD value: RegGetValueW failed." };
     }
-
     return data;
 }
 
 
-inline std::wstring RegKey::GetStringValue(const std::wstring& valueName) const
+inline std::wstring GetStringValue(const HKEY rootKey, const std::wstring& subKey, const std::wstring& valueName)
 {
-    _ASSERTE(IsValid());
-
-    std::wstring result;    // to be read from the registry
-    DWORD dataSize = 0;     // size of the string data, in bytes
-
-    constexpr DWORD flags = RRF_RT_REG_SZ;
-
-    LSTATUS retCode = ERROR_MORE_DATA;
-
-    while (retCode == ERROR_MORE_DATA)
-    {
-        // Get the size of the result string
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,    // type not required
-            nullptr,    // output buffer not needed now
-            &dataSize
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            throw RegException{ retCode, "Cannot get the size of the string value: RegGetValueW failed." };
-        }
-
-        // Allocate a string of proper size.
-        // Note that dataSize is in bytes and includes the terminating NUL;
-        // we have to convert the size from bytes to wchar_ts for wstring::resize.
-        result.resize(dataSize / sizeof(wchar_t));
-
-        // Call RegGetValue for the second time to read the string's content
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,       // type not required
-            result.data(), // output buffer
-            &dataSize
-        );
-    }
-
+    std::wstring result;
+    LSTATUS retCode = details::GetStringValueAt(rootKey, subKey, valueName, RRF_RT_REG_SZ, result);
     if (retCode != ERROR_SUCCESS)
     {
         throw RegException{ retCode, "Cannot get the string value: RegGetValueW failed." };
     }
-
-    // Remove the NUL terminator scribbled by RegGetValue from the wstring
-    result.resize((dataSize / sizeof(wchar_t)) - 1);
-
     return result;
 }
 
 
-inline std::wstring RegKey::GetExpandStringValue(
+inline std::wstring GetExpandStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
     const std::wstring& valueName,
-    const ExpandStringOption expandOption
-) const
+    const RegKey::ExpandStringOption expandOption
+)
 {
-    _ASSERTE(IsValid());
-
-    std::wstring result;    // to be read from the registry
-    DWORD dataSize = 0;     // size of the expand string data, in bytes
-
-
     DWORD flags = RRF_RT_REG_EXPAND_SZ;
-
-    // Adjust the flag for RegGetValue considering the expand string option specified by the caller
-    if (expandOption == ExpandStringOption::DontExpand)
+    if (expandOption == RegKey::ExpandStringOption::DontExpand)
     {
         flags |= RRF_NOEXPAND;
     }
 
-
-    LSTATUS retCode = ERROR_MORE_DATA;
-
-    while (retCode == ERROR_MORE_DATA)
-    {
-        // Get the size of the result string
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,    // type not required
-            nullptr,    // output buffer not needed now
-            &dataSize
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            throw RegException{ retCode,
-                                "Cannot get the size of the expand string value: RegGetValueW failed." };
-        }
-
-        // Allocate a string of proper size.
-        // Note that dataSize is in bytes and includes the terminating NUL;
-        // we have to convert the size from bytes to wchar_ts for wstring::resize.
-        result.resize(dataSize / sizeof(wchar_t));
-
-        // Call RegGetValue for the second time to read the string's content
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,       // type not required
-            result.data(), // output buffer
-            &dataSize
-        );
-    }
-
+    std::wstring result;
+    LSTATUS retCode = details::GetStringValueAt(rootKey, subKey, valueName, flags, result);
     if (retCode != ERROR_SUCCESS)
     {
         throw RegException{ retCode, "Cannot get the expand string value: RegGetValueW failed." };
     }
-
-    // Remove the NUL terminator scribbled by RegGetValue from the wstring
-    result.resize((dataSize / sizeof(wchar_t)) - 1);
-
     return result;
 }
 
 
-inline std::vector<std::wstring> RegKey::GetMultiStringValue(const std::wstring& valueName) const
+inline std::vector<std::wstring> GetMultiStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName
+)
 {
-    _ASSERTE(IsValid());
-
-    // Room for the result multi-string, to be read from the registry
-    std::vector<wchar_t> multiString;
-
-    // Size of the multi-string, in bytes
-    DWORD dataSize = 0;
-
-    constexpr DWORD flags = RRF_RT_REG_MULTI_SZ;
-
-    LSTATUS retCode = ERROR_MORE_DATA;
-
-    while (retCode == ERROR_MORE_DATA)
-    {
-        // Request the size of the multi-string, in bytes
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,    // type not required
-            nullptr,    // output buffer not needed now
-            &dataSize
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            throw RegException{ retCode,
-                                "Cannot get the size of the multi-string value: RegGetValueW failed." };
-        }
-
-        // Allocate room for the result multi-string.
-        // Note that dataSize is in bytes, but our vector<wchar_t>::resize method requires size
-        // to be expressed in wchar_ts.
-        multiString.resize(dataSize / sizeof(wchar_t));
-
-        // Call RegGetValue for the second time to read the multi-string's content into the vector
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,                // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,                // type not required
-            multiString.data(),     // output buffer
-            &dataSize
-        );
-    }
-
+    std::vector<std::wstring> result;
+    LSTATUS retCode = details::GetMultiStringValueAt(rootKey, subKey, valueName, result);
     if (retCode != ERROR_SUCCESS)
     {
         throw RegException{ retCode, "Cannot get the multi-string value: RegGetValueW failed." };
     }
-
-    // Resize vector to the actual size returned by the last call to RegGetValue.
-    // Note that the vector is a vector of wchar_ts, instead the size returned by RegGetValue
-    // is in bytes, so we have to scale from bytes to wchar_t count.
-    multiString.resize(dataSize / sizeof(wchar_t));
-
-    // Convert the double-null-terminated string structure to a vector<wstring>,
-    // and return that back to the caller
-    return details::ParseMultiString(multiString);
+    return result;
 }
 
 
-inline std::vector<BYTE> RegKey::GetBinaryValue(const std::wstring& valueName) const
+inline std::vector<BYTE> GetBinaryValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName
+)
 {
-    _ASSERTE(IsValid());
-
-    // Room for the binary data, to be read from the registry
-    std::vector<BYTE> binaryData;
-
-    // Size of binary data, in bytes
-    DWORD dataSize = 0;
-
-    constexpr DWORD flags = RRF_RT_REG_BINARY;
-
-    LSTATUS retCode = ERROR_MORE_DATA;
-
-    while (retCode == ERROR_MORE_DATA)
+    std::vector<BYTE> result;
+    LSTATUS retCode = details::GetVariableSizeValueAt(
+        rootKey, subKey, valueName, RRF_RT_REG_BINARY, RegAllocationCategory::BinaryValue, result);
+    if (retCode != ERROR_SUCCESS)
     {
-        // Request the size of the binary data, in bytes
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,    // type not required
-            nullptr,    // output buffer not needed now
-            &dataSize
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            throw RegException{ retCode,
-                                "Cannot get the size of the binary data: RegGetValueW failed." };
-        }
-
-        // Allocate a buffer of proper size to store the binary data
-        binaryData.resize(dataSize);
-
-        // Handle the special case of zero-length binary data:
-        // If the binary data value in the registry is empty, just return an empty vector.
-        if (dataSize == 0)
-        {
-            _ASSERTE(binaryData.empty());
-            return binaryData;
-        }
-
-        // Call RegGetValue for the second time to read the binary data content into the vector
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,            // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,            // type not required
-            binaryData.data(),  // output buffer
-            &dataSize
-        );
+        throw RegException{ retCode, "Cannot get the binary data: RegGetValueW failed." };
     }
+    return result;
+}
 
+
+inline RegExpected<DWORD> TryGetDwordValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName
+)
+{
+    DWORD data = 0;
+    LSTATUS retCode = details::GetFixedSizeValueAt(rootKey, subKey, valueName, RRF_RT_REG_DWORD, data);
     if (retCode != ERROR_SUCCESS)
     {
-        throw RegException{ retCode, "Cannot get the binary data: RegGetValueW failed." };
+        return RegExpected<DWORD>{ RegResult{ retCode } };
     }
+    return RegExpected<DWORD>{ data };
+}
 
-    // Resize vector to the actual size returned by the last call to RegGetValue
-    binaryData.resize(dataSize);
 
-    return binaryData;
+inline RegExpected<ULONGLONG> TryGetQwordValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName
+)
+{
+    ULONGLONG data = 0;
+    LSTATUS retCode = details::GetFixedSizeValueAt(rootKey, subKey, valueName, RRF_RT_REG_QWORD, data);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<ULONGLONG>{ RegResult{ retCode } };
+    }
+    return RegExpected<ULONGLONG>{ data };
 }
 
 
-inline RegExpected<DWORD> RegKey::TryGetDwordValue(const std::wstring& valueName) const
+inline RegExpected<std::wstring> TryGetStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName
+)
 {
-    _ASSERTE(IsValid());
+    std::wstring result;
+    LSTATUS retCode = details::GetStringValueAt(rootKey, subKey, valueName, RRF_RT_REG_SZ, result);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<std::wstring>{ RegResult{ retCode } };
+    }
+    return RegExpected<std::wstring>{ std::move(result) };
+}
 
-    using RegValueType = DWORD;
 
-    DWORD data = 0;                  // to be read from the registry
-    DWORD dataSize = sizeof(data);   // size of data, in bytes
+inline RegExpected<std::wstring> TryGetExpandStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const RegKey::ExpandStringOption expandOption
+)
+{
+    DWORD flags = RRF_RT_REG_EXPAND_SZ;
+    if (expandOption == RegKey::ExpandStringOption::DontExpand)
+    {
+        flags |= RRF_NOEXPAND;
+    }
 
-    constexpr DWORD flags = RRF_RT_REG_DWORD;
-    LSTATUS retCode = ::RegGetValueW(
-        m_hKey,
-        nullptr, // no subkey
-        valueName.c_str(),
-        flags,
-        nullptr, // type not required
-        &data,
-        &dataSize
-    );
+    std::wstring result;
+    LSTATUS retCode = details::GetStringValueAt(rootKey, subKey, valueName, flags, result);
     if (retCode != ERROR_SUCCESS)
     {
-        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+        return RegExpected<std::wstring>{ RegResult{ retCode } };
     }
-
-    return RegExpected<RegValueType>{ data };
+    return RegExpected<std::wstring>{ std::move(result) };
 }
 
 
-inline RegExpected<ULONGLONG> RegKey::TryGetQwordValue(const std::wstring& valueName) const
+inline RegExpected<std::vector<std::wstring>> TryGetMultiStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName
+)
 {
-    _ASSERTE(IsValid());
+    using RegValueType = std::vector<std::wstring>;
 
-    using RegValueType = ULONGLONG;
+    std::vector<std::wstring> result;
+    LSTATUS retCode = details::GetMultiStringValueAt(rootKey, subKey, valueName, result);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegExpected<RegValueType>{ RegResult{ retCode } };
+    }
+    return RegExpected<RegValueType>{ std::move(result) };
+}
 
-    ULONGLONG data = 0;              // to be read from the registry
-    DWORD dataSize = sizeof(data);   // size of data, in bytes
 
-    constexpr DWORD flags = RRF_RT_REG_QWORD;
-    LSTATUS retCode = ::RegGetValueW(
-        m_hKey,
-        nullptr, // no subkey
-        valueName.c_str(),
-        flags,
-        nullptr, // type not required
-        &data,
-        &dataSize
-    );
+inline RegExpected<std::vector<BYTE>> TryGetBinaryValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName
+)
+{
+    using RegValueType = std::vector<BYTE>;
+
+    std::vector<BYTE> result;
+    LSTATUS retCode = details::GetVariableSizeValueAt(
+        rootKey, subKey, valueName, RRF_RT_REG_BINARY, RegAllocationCategory::BinaryValue, result);
     if (retCode != ERROR_SUCCESS)
     {
-        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+        return RegExpected<RegValueType>{ RegResult{ retCode } };
     }
+    return RegExpected<RegValueType>{ std::move(result) };
+}
 
-    return RegExpected<RegValueType>{ data };
+
+inline RegResult TrySetDwordValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const DWORD data
+) noexcept
+{
+    return RegResult{ details::SetValueAt(rootKey, subKey, valueName, REG_DWORD, &data, sizeof(data)) };
 }
 
 
-inline RegExpected<std::wstring> RegKey::TryGetStringValue(const std::wstring& valueName) const
+inline RegResult TrySetQwordValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const ULONGLONG& data
+) noexcept
 {
-    _ASSERTE(IsValid());
+    return RegResult{ details::SetValueAt(rootKey, subKey, valueName, REG_QWORD, &data, sizeof(data)) };
+}
 
-    using RegValueType = std::wstring;
 
-    constexpr DWORD flags = RRF_RT_REG_SZ;
+inline RegResult TrySetStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const std::wstring& data
+)
+{
+    // String size including the terminating NUL, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
 
-    std::wstring result;
+    return RegResult{ details::SetValueAt(rootKey, subKey, valueName, REG_SZ, data.c_str(), dataSize) };
+}
 
-    DWORD dataSize = 0; // size of the string data, in bytes
 
-    LSTATUS retCode = ERROR_MORE_DATA;
+inline RegResult TrySetExpandStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const std::wstring& data
+)
+{
+    // String size including the terminating NUL, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword((data.length() + 1) * sizeof(wchar_t));
 
-    while (retCode == ERROR_MORE_DATA)
-    {
-        // Get the size of the result string
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,    // type not required
-            nullptr,    // output buffer not needed now
-            &dataSize
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            return details::MakeRegExpectedWithError<RegValueType>(retCode);
-        }
+    return RegResult{ details::SetValueAt(rootKey, subKey, valueName, REG_EXPAND_SZ, data.c_str(), dataSize) };
+}
 
-        // Allocate a string of proper size.
-        // Note that dataSize is in bytes and includes the terminating NUL;
-        // we have to convert the size from bytes to wchar_ts for wstring::resize.
-        result.resize(dataSize / sizeof(wchar_t));
 
-        // Call RegGetValue for the second time to read the string's content
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,       // type not required
-            result.data(), // output buffer
-            &dataSize
-        );
-    }
+inline RegResult TrySetMultiStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const std::vector<std::wstring>& data
+)
+{
+    // Build a double-NUL-terminated multi-string from the input data
+    const std::vector<wchar_t> multiString = details::BuildMultiString(data);
 
-    if (retCode != ERROR_SUCCESS)
-    {
-        return details::MakeRegExpectedWithError<RegValueType>(retCode);
-    }
+    // Total size, in bytes, of the whole multi-string structure
+    const DWORD dataSize = details::SafeCastSizeToDword(multiString.size() * sizeof(wchar_t));
 
-    // Remove the NUL terminator scribbled by RegGetValue from the wstring
-    result.resize((dataSize / sizeof(wchar_t)) - 1);
+    return RegResult{ details::SetValueAt(rootKey, subKey, valueName, REG_MULTI_SZ,
+                                          multiString.data(), dataSize) };
+}
 
-    return RegExpected<RegValueType>{ result };
+
+inline RegResult TrySetBinaryValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const std::vector<BYTE>& data
+)
+{
+    // Total data size, in bytes
+    const DWORD dataSize = details::SafeCastSizeToDword(data.size());
+
+    return RegResult{ details::SetValueAt(rootKey, subKey, valueName, REG_BINARY, data.data(), dataSize) };
 }
 
 
-inline RegExpected<std::wstring> RegKey::TryGetExpandStringValue(
+inline void SetDwordValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
     const std::wstring& valueName,
-    const ExpandStringOption expandOption
-) const
+    const DWORD data
+)
 {
-    _ASSERTE(IsValid());
+    RegResult retCode = TrySetDwordValue(rootKey, subKey, valueName, data);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot write DWORD value: RegSetKeyValueW failed." };
+    }
+}
 
-    using RegValueType = std::wstring;
 
-    DWORD flags = RRF_RT_REG_EXPAND_SZ;
+inline void SetQwordValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const ULONGLONG& data
+)
+{
+    RegResult retCode = TrySetQwordValue(rootKey, subKey, valueName, data);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot write QWORD value: RegSetKeyValueW failed." };
+    }
+}
 
-    // Adjust the flag for RegGetValue considering the expand string option specified by the caller
-    if (expandOption == ExpandStringOption::DontExpand)
+
+inline void SetStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const std::wstring& data
+)
+{
+    RegResult retCode = TrySetStringValue(rootKey, subKey, valueName, data);
+    if (retCode.Failed())
     {
-        flags |= RRF_NOEXPAND;
+        throw RegException{ retCode.Code(), "Cannot write string value: RegSetKeyValueW failed." };
     }
+}
 
-    std::wstring result;
-    DWORD dataSize = 0; // size of the expand string data, in bytes
-    LSTATUS retCode = ERROR_MORE_DATA;
 
-    while (retCode == ERROR_MORE_DATA)
+inline void SetExpandStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const std::wstring& data
+)
+{
+    RegResult retCode = TrySetExpandStringValue(rootKey, subKey, valueName, data);
+    if (retCode.Failed())
     {
-        // Get the size of the result string
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,    // type not required
-            nullptr,    // output buffer not needed now
-            &dataSize
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            return details::MakeRegExpectedWithError<RegValueType>(retCode);
-        }
+        throw RegException{ retCode.Code(), "Cannot write expand string value: RegSetKeyValueW failed." };
+    }
+}
 
-        // Allocate a string of proper size.
-        // Note that dataSize is in bytes and includes the terminating NUL;
-        // we have to convert the size from bytes to wchar_ts for wstring::resize.
-        result.resize(dataSize / sizeof(wchar_t));
 
-        // Call RegGetValue for the second time to read the string's content
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,       // type not required
-            result.data(), // output buffer
-            &dataSize
-        );
+inline void SetMultiStringValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const std::vector<std::wstring>& data
+)
+{
+    RegResult retCode = TrySetMultiStringValue(rootKey, subKey, valueName, data);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot write multi-string value: RegSetKeyValueW failed." };
     }
+}
 
-    if (retCode != ERROR_SUCCESS)
+
+inline void SetBinaryValue(
+    const HKEY rootKey,
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const std::vector<BYTE>& data
+)
+{
+    RegResult retCode = TrySetBinaryValue(rootKey, subKey, valueName, data);
+    if (retCode.Failed())
     {
-        return details::MakeRegExpectedWithError<RegValueType>(retCode);
+        throw RegException{ retCode.Code(), "Cannot write binary data value: RegSetKeyValueW failed." };
     }
+}
+
+
+//------------------------------------------------------------------------------
+//              RegKey Path-Addressed Value Access Inline Methods
+//------------------------------------------------------------------------------
+
+inline void RegKey::SetDwordValue(const std::wstring& subKey, const std::wstring& valueName, const DWORD data)
+{
+    _ASSERTE(IsValid());
+    winreg::SetDwordValue(m_hKey, subKey, valueName, data);
+}
+
+
+inline void RegKey::SetQwordValue(const std::wstring& subKey, const std::wstring& valueName, const ULONGLONG& data)
+{
+    _ASSERTE(IsValid());
+    winreg::SetQwordValue(m_hKey, subKey, valueName, data);
+}
+
+
+inline void RegKey::SetStringValue(const std::wstring& subKey, const std::wstring& valueName,
+                                   const std::wstring& data)
+{
+    _ASSERTE(IsValid());
+    winreg::SetStringValue(m_hKey, subKey, valueName, data);
+}
 
-    // Remove the NUL terminator scribbled by RegGetValue from the wstring
-    result.resize((dataSize / sizeof(wchar_t)) - 1);
 
-    return RegExpected<RegValueType>{ result };
+inline void RegKey::SetExpandStringValue(const std::wstring& subKey, const std::wstring& valueName,
+                                         const std::wstring& data)
+{
+    _ASSERTE(IsValid());
+    winreg::SetExpandStringValue(m_hKey, subKey, valueName, data);
 }
 
 
-inline RegExpected<std::vector<std::wstring>>
-    RegKey::TryGetMultiStringValue(const std::wstring& valueName) const
+inline void RegKey::SetMultiStringValue(const std::wstring& subKey, const std::wstring& valueName,
+                                        const std::vector<std::wstring>& data)
 {
     _ASSERTE(IsValid());
+    winreg::SetMultiStringValue(m_hKey, subKey, valueName, data);
+}
 
-    using RegValueType = std::vector<std::wstring>;
 
-    constexpr DWORD flags = RRF_RT_REG_MULTI_SZ;
+inline void RegKey::SetBinaryValue(const std::wstring& subKey, const std::wstring& valueName,
+                                   const std::vector<BYTE>& data)
+{
+    _ASSERTE(IsValid());
+    winreg::SetBinaryValue(m_hKey, subKey, valueName, data);
+}
 
-    // Room for the result multi-string
-    std::vector<wchar_t> data;
 
-    // Size of the multi-string, in bytes
-    DWORD dataSize = 0;
+inline RegResult RegKey::TrySetDwordValue(const std::wstring& subKey, const std::wstring& valueName,
+                                          const DWORD data) noexcept
+{
+    _ASSERTE(IsValid());
+    return winreg::TrySetDwordValue(m_hKey, subKey, valueName, data);
+}
 
-    LSTATUS retCode = ERROR_MORE_DATA;
 
-    while (retCode == ERROR_MORE_DATA)
-    {
-        // Request the size of the multi-string, in bytes
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,    // type not required
-            nullptr,    // output buffer not needed now
-            &dataSize
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            return details::MakeRegExpectedWithError<RegValueType>(retCode);
-        }
+inline RegResult RegKey::TrySetQwordValue(const std::wstring& subKey, const std::wstring& valueName,
+                                          const ULONGLONG& data) noexcept
+{
+    _ASSERTE(IsValid());
+    return winreg::TrySetQwordValue(m_hKey, subKey, valueName, data);
+}
 
-        // Allocate room for the result multi-string.
-        // Note that dataSize is in bytes, but our vector<wchar_t>::resize method requires size
-        // to be expressed in wchar_ts.
-        data.resize(dataSize / sizeof(wchar_t));
 
-        // Call RegGetValue for the second time to read the multi-string's content into the vector
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,        // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,        // type not required
-            data.data(),    // output buffer
-            &dataSize
-        );
-    }
+inline RegResult RegKey::TrySetStringValue(const std::wstring& subKey, const std::wstring& valueName,
+                                           const std::wstring& data)
+{
+    _ASSERTE(IsValid());
+    return winreg::TrySetStringValue(m_hKey, subKey, valueName, data);
+}
 
-    if (retCode != ERROR_SUCCESS)
-    {
-        return details::MakeRegExpectedWithError<RegValueType>(retCode);
-    }
 
-    // Resize vector to the actual size returned by the last call to RegGetValue.
-    // Note that the vector is a vector of wchar_ts, instead the size returned by RegGetValue
-    // is in bytes, so we have to scale from bytes to wchar_t count.
-    data.resize(dataSize / sizeof(wchar_t));
+inline RegResult RegKey::TrySetExpandStringValue(const std::wstring& subKey, const std::wstring& valueName,
+                                                 const std::wstring& data)
+{
+    _ASSERTE(IsValid());
+    return winreg::TrySetExpandStringValue(m_hKey, subKey, valueName, data);
+}
 
-    // Convert the double-null-terminated string structure to a vector<wstring>,
-    // and return that back to the caller
-    return RegExpected<RegValueType>{ details::ParseMultiString(data) };
+
+inline RegResult RegKey::TrySetMultiStringValue(const std::wstring& subKey, const std::wstring& valueName,
+                                                const std::vector<std::wstring>& data)
+{
+    _ASSERTE(IsValid());
+    return winreg::TrySetMultiStringValue(m_hKey, subKey, valueName, data);
 }
 
 
-inline RegExpected<std::vector<BYTE>>
-    RegKey::TryGetBinaryValue(const std::wstring& valueName) const
+inline RegResult RegKey::TrySetBinaryValue(const std::wstring& subKey, const std::wstring& valueName,
+                                           const std::vector<BYTE>& data)
 {
     _ASSERTE(IsValid());
+    return winreg::TrySetBinaryValue(m_hKey, subKey, valueName, data);
+}
 
-    using RegValueType = std::vector<BYTE>;
 
-    constexpr DWORD flags = RRF_RT_REG_BINARY;
+inline DWORD RegKey::GetDwordValue(const std::wstring& subKey, const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+    return winreg::GetDwordValue(m_hKey, subKey, valueName);
+}
 
-    // Room for the binary data
-    std::vector<BYTE> data;
 
-    DWORD dataSize = 0; // size of binary data, in bytes
+inline ULONGLONG RegKey::GetQwordValue(const std::wstring& subKey, const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+    return winreg::GetQwordValue(m_hKey, subKey, valueName);
+}
 
-    LSTATUS retCode = ERROR_MORE_DATA;
 
-    while (retCode == ERROR_MORE_DATA)
-    {
-        // Request the size of the binary data, in bytes
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,    // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,    // type not required
-            nullptr,    // output buffer not needed now
-            &dataSize
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            return details::MakeRegExpectedWithError<RegValueType>(retCode);
-        }
+inline std::wstring RegKey::GetStringValue(const std::wstring& subKey, const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+    return winreg::GetStringValue(m_hKey, subKey, valueName);
+}
 
-        // Allocate a buffer of proper size to store the binary data
-        data.resize(dataSize);
 
-        // Handle the special case of zero-length binary data:
-        // If the binary data value in the registry is empty, just return
-        if (dataSize == 0)
-        {
-            _ASSERTE(data.empty());
-            return RegExpected<RegValueType>{ data };
-        }
+inline std::wstring RegKey::GetExpandStringValue(
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const ExpandStringOption expandOption
+) const
+{
+    _ASSERTE(IsValid());
+    return winreg::GetExpandStringValue(m_hKey, subKey, valueName, expandOption);
+}
 
-        // Call RegGetValue for the second time to read the binary data content into the vector
-        retCode = ::RegGetValueW(
-            m_hKey,
-            nullptr,        // no subkey
-            valueName.c_str(),
-            flags,
-            nullptr,        // type not required
-            data.data(),    // output buffer
-            &dataSize
-        );
-    }
 
-    if (retCode != ERROR_SUCCESS)
-    {
-        return details::MakeRegExpectedWithError<RegValueType>(retCode);
-    }
+inline std::vector<std::wstring> RegKey::GetMultiStringValue(const std::wstring& subKey,
+                                                             const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+    return winreg::GetMultiStringValue(m_hKey, subKey, valueName);
+}
 
-    // Resize vector to the actual size returned by the last call to RegGetValue
-    data.resize(dataSize);
 
-    return RegExpected<RegValueType>{ data };
+inline std::vector<BYTE> RegKey::GetBinaryValue(const std::wstring& subKey,
+                                                const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+    return winreg::GetBinaryValue(m_hKey, subKey, valueName);
 }
 
 
-inline std::vector<std::wstring> RegKey::EnumSubKeys() const
+inline RegExpected<DWORD> RegKey::TryGetDwordValue(const std::wstring& subKey,
+                                                   const std::wstring& valueName) const
 {
     _ASSERTE(IsValid());
+    return winreg::TryGetDwordValue(m_hKey, subKey, valueName);
+}
 
-    // Get some useful enumeration info, like the total number of subkeys
-    // and the maximum length of the subkey names
-    DWORD subKeyCount = 0;
-    DWORD maxSubKeyNameLen = 0;
-    LSTATUS retCode = ::RegQueryInfoKeyW(
-        m_hKey,
-        nullptr,    // no user-defined class
-        nullptr,    // no user-defined class size
-        nullptr,    // reserved
-        &subKeyCount,
-        &maxSubKeyNameLen,
-        nullptr,    // no subkey class length
-        nullptr,    // no value count
-        nullptr,    // no value name max length
-        nullptr,    // no max value length
-        nullptr,    // no security descriptor
-        nullptr     // no last write time
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{
-            retCode,
-            "RegQueryInfoKeyW failed while preparing for subkey enumeration."
-        };
-    }
 
-    // NOTE: According to the MSDN documentation, the size returned for subkey name max length
-    // does *not* include the terminating NUL, so let's add +1 to take it into account
-    // when I allocate the buffer for reading subkey names.
-    maxSubKeyNameLen++;
+inline RegExpected<ULONGLONG> RegKey::TryGetQwordValue(const std::wstring& subKey,
+                                                       const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+    return winreg::TryGetQwordValue(m_hKey, subKey, valueName);
+}
 
-    // Preallocate a buffer for the subkey names
-    auto nameBuffer = std::make_unique<wchar_t[]>(maxSubKeyNameLen);
 
-    // The result subkey names will be stored here
-    std::vector<std::wstring> subkeyNames;
+inline RegExpected<std::wstring> RegKey::TryGetStringValue(const std::wstring& subKey,
+                                                           const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+    return winreg::TryGetStringValue(m_hKey, subKey, valueName);
+}
 
-    // Reserve room in the vector to speed up the following insertion loop
-    subkeyNames.reserve(subKeyCount);
 
-    // Enumerate all the subkeys
-    for (DWORD index = 0; index < subKeyCount; index++)
-    {
-        // Get the name of the current subkey
-        DWORD subKeyNameLen = maxSubKeyNameLen;
-        retCode = ::RegEnumKeyExW(
-            m_hKey,
-            index,
-            nameBuffer.get(),
-            &subKeyNameLen,
-            nullptr, // reserved
-            nullptr, // no class
-            nullptr, // no class
-            nullptr  // no last write time
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            throw RegException{ retCode, "Cannot enumerate subkeys: RegEnumKeyExW failed." };
-        }
+inline RegExpected<std::wstring> RegKey::TryGetExpandStringValue(
+    const std::wstring& subKey,
+    const std::wstring& valueName,
+    const ExpandStringOption expandOption
+) const
+{
+    _ASSERTE(IsValid());
+    return winreg::TryGetExpandStringValue(m_hKey, subKey, valueName, expandOption);
+}
 
-        // On success, the ::RegEnumKeyEx API writes the length of the
-        // subkey name in the subKeyNameLen output parameter
-        // (not including the terminating NUL).
-        // So I can build a wstring based on that length.
-        subkeyNames.emplace_back(nameBuffer.get(), subKeyNameLen);
-    }
 
-    return subkeyNames;
+inline RegExpected<std::vector<std::wstring>>
+    RegKey::TryGetMultiStringValue(const std::wstring& subKey, const std::wstring& valueName) const
+{
+    _ASSERTE(IsValid());
+    return winreg::TryGetMultiStringValue(m_hKey, subKey, valueName);
 }
 
 
-inline std::vector<std::pair<std::wstring, DWORD>> RegKey::EnumValues() const
+inline RegExpected<std::vector<BYTE>>
+    RegKey::TryGetBinaryValue(const std::wstring& subKey, const std::wstring& valueName) const
 {
     _ASSERTE(IsValid());
+    return winreg::TryGetBinaryValue(m_hKey, subKey, valueName);
+}
+
+//------------------------------------------------------------------------------
+//                      RegMultiStringSet Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegMultiStringSet::RegMultiStringSet(const StringComparison comparison) noexcept
+    : m_comparison{ comparison }
+{}
 
-    // Get useful enumeration info, like the total number of values
-    // and the maximum length of the value names
-    DWORD valueCount = 0;
-    DWORD maxValueNameLen = 0;
-    LSTATUS retCode = ::RegQueryInfoKeyW(
-        m_hKey,
-        nullptr,    // no user-defined class
-        nullptr,    // no user-defined class size
-        nullptr,    // reserved
-        nullptr,    // no subkey count
-        nullptr,    // no subkey max length
-        nullptr,    // no subkey class length
-        &valueCount,
-        &maxValueNameLen,
-        nullptr,    // no max value length
-        nullptr,    // no security descriptor
-        nullptr     // no last write time
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{
-            retCode,
-            "RegQueryInfoKeyW failed while preparing for value enumeration."
-        };
-    }
 
-    // NOTE: According to the MSDN documentation, the size returned for value name max length
-    // does *not* include the terminating NUL, so let's add +1 to take it into account
-    // when I allocate the buffer for reading value names.
-    maxValueNameLen++;
+inline void RegMultiStringSet::Load(const RegKey& key, const std::wstring& valueName)
+{
+    RegResult retCode = TryLoad(key, valueName);
+    if (retCode.Failed())
+    {
+        throw RegException{ retCode.Code(), "Cannot load the multi-string value into the set." };
+    }
+}
 
-    // Preallocate a buffer for the value names
-    auto nameBuffer = std::make_unique<wchar_t[]>(maxValueNameLen);
 
-    // The value names and types will be stored here
-    std::vector<std::pair<std::wstring, DWORD>> valueInfo;
+inline RegResult RegMultiStringSet::TryLoad(const RegKey& key, const std::wstring& valueName)
+{
+    _ASSERTE(key.IsValid());
 
-    // Reserve room in the vector to speed up the following insertion loop
-    valueInfo.reserve(valueCount);
+    LSTATUS retCode = details::ReadMultiStringData(key.Get(), valueName, m_readBuffer);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
 
-    // Enumerate all the values
-    for (DWORD index = 0; index < valueCount; index++)
+    // An empty value is treated as an empty multi-string;
+    // anything else must be properly double-NUL-terminated
+    if (!m_readBuffer.empty() && !details::IsDoubleNullTerminated(m_readBuffer))
     {
-        // Get the name and the type of the current value
-        DWORD valueNameLen = maxValueNameLen;
-        DWORD valueType = 0;
-        retCode = ::RegEnumValueW(
-            m_hKey,
-            index,
-            nameBuffer.get(),
-            &valueNameLen,
-            nullptr,    // reserved
-            &valueType,
-            nullptr,    // no data
-            nullptr     // no data size
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            throw RegException{ retCode, "Cannot enumerate values: RegEnumValueW failed." };
-        }
+        return RegResult{ ERROR_INVALID_DATA };
+    }
 
-        // On success, the RegEnumValue API writes the length of the
-        // value name in the valueNameLen output parameter
-        // (not including the terminating NUL).
-        // So we can build a wstring based on that.
-        valueInfo.emplace_back(
-            std::wstring{ nameBuffer.get(), valueNameLen },
-            valueType
-        );
+    const std::uint64_t dataHash = details::HashString(
+        std::wstring_view{ m_readBuffer.data(), m_readBuffer.size() },
+        StringComparison::CaseSensitive
+    );
+
+    // If the data didn't change, the current index is still valid
+    if ((dataHash == m_dataHash) && (m_readBuffer == m_data) && !m_data.empty())
+    {
+        return RegResult{ ERROR_SUCCESS };
     }
 
-    return valueInfo;
+    // Keep the new data, and reuse the old buffer for the next read
+    m_data.swap(m_readBuffer);
+    m_dataHash = dataHash;
+
+    BuildIndex();
+
+    return RegResult{ ERROR_SUCCESS };
 }
 
 
-inline bool RegKey::ContainsValue(const std::wstring& valueName) const
+inline void RegMultiStringSet::BuildIndex()
 {
-    _ASSERTE(IsValid());
+    m_strings.clear();
+    m_foldedData.clear();
+    m_foldedStrings.clear();
+    m_slots.clear();
+    m_sorted.clear();
 
-    // Invoke RegGetValueW to just check if the input value exists under the current key
-    LSTATUS retCode = ::RegGetValueW(
-        m_hKey,             // current key
-        nullptr,            // no subkey - check value in current key
-        valueName.c_str(),  // value name
-        RRF_RT_ANY,         // no type restriction on this value
-        nullptr,            // we don't need to know the type of the value
-        nullptr, nullptr    // we don't need the actual value, just to check if it exists
-    );
-    if (retCode == ERROR_SUCCESS)
+    if (m_data.size() < 2)
     {
-        // The value exists under the current key
-        return true;
+        return;
     }
-    else if (retCode == ERROR_FILE_NOT_FOUND)
+
+    // Split the double-NUL-terminated data into views (same parsing as ParseMultiString)
+    const wchar_t* currStringPtr = m_data.data();
+    const wchar_t* const endPtr  = m_data.data() + m_data.size() - 1;
+    while (currStringPtr < endPtr)
     {
-        // The value does *not* exist under the current key
-        return false;
+        const size_t currStringLength = wcslen(currStringPtr);
+        m_strings.emplace_back(currStringPtr, currStringLength);
+        currStringPtr += currStringLength + 1;
     }
-    else
+
+    if (m_strings.size() >= (std::numeric_limits<std::uint32_t>::max)())
     {
-        // Some other error occurred - signal it by throwing an exception
-        throw RegException{
-            retCode,
-            "RegGetValueW failed when checking if the current key contains the specified value."
-        };
+        throw std::overflow_error("Too many strings in the multi-string value.");
     }
-}
 
+    // Fold the whole data at once: the hash table and the sorted order
+    // are then built with plain (case-sensitive) comparisons
+    if (m_comparison == StringComparison::IgnoreCase)
+    {
+        m_foldedData.resize(m_data.size());
+        details::FoldString(std::wstring_view{ m_data.data(), m_data.size() }, m_foldedData.data());
 
-inline bool RegKey::ContainsSubKey(const std::wstring& subKey) const
-{
-    _ASSERTE(IsValid());
+        m_foldedStrings.reserve(m_strings.size());
+        for (const std::wstring_view& str : m_strings)
+        {
+            const size_t offset = static_cast<size_t>(str.data() - m_data.data());
+            m_foldedStrings.emplace_back(m_foldedData.data() + offset, str.length());
+        }
+    }
 
-    // Let's try and open the specified subKey, then check the return code
-    // of RegOpenKeyExW to figure out if the subKey exists or not.
-    HKEY hSubKey = nullptr;
-    LSTATUS retCode = ::RegOpenKeyExW(
-        m_hKey,
-        subKey.c_str(),
-        0,
-        KEY_READ,
-        &hSubKey
-    );
-    if (retCode == ERROR_SUCCESS)
+    // Hash table size: a power of two, at most half full
+    size_t slotCount = 8;
+    while (slotCount < m_strings.size() * 2)
     {
-        // We were able to open the specified sub-key, so the sub-key does exist.
-        //
-        // Don't forget to close the sub-key opened for this testing purpose!
-        ::RegCloseKey(hSubKey);
-        hSubKey = nullptr;
-
-        return true;
+        slotCount *= 2;
     }
-    else if ((retCode == ERROR_FILE_NOT_FOUND) || (retCode == ERROR_PATH_NOT_FOUND))
+    m_slots.assign(slotCount, Slot{ 0, 0 });
+
+    const size_t mask = slotCount - 1;
+    for (size_t i = 0; i < m_strings.size(); i++)
     {
-        // The specified sub-key does not exist
-        return false;
+        const std::wstring_view key = KeyAt(i);
+        size_t pos = static_cast<size_t>(
+            details::HashString(key, StringComparison::CaseSensitive)) & mask;
+
+        // Linear probing
+        while (m_slots[pos].Count != 0)
+        {
+            if (KeyAt(m_slots[pos].Index) == key)
+            {
+                break;
+            }
+            pos = (pos + 1) & mask;
+        }
+
+        if (m_slots[pos].Count == 0)
+        {
+            m_slots[pos].Index = static_cast<std::uint32_t>(i);
+        }
+        m_slots[pos].Count++;
     }
-    else
+
+    // Sorted order for prefix queries
+    m_sorted.resize(m_strings.size());
+    for (size_t i = 0; i < m_sorted.size(); i++)
     {
-        // Some other error occurred - signal it by throwing an exception
-        throw RegException{
-            retCode,
-            "RegOpenKeyExW failed when checking if the current key contains the specified sub-key."
-        };
+        m_sorted[i] = static_cast<std::uint32_t>(i);
     }
+
+    std::sort(m_sorted.begin(), m_sorted.end(),
+        [this](const std::uint32_t a, const std::uint32_t b)
+        {
+            return KeyAt(a) < KeyAt(b);
+        }
+    );
 }
 
 
-inline RegExpected<std::vector<std::wstring>> RegKey::TryEnumSubKeys() const
+inline std::wstring_view RegMultiStringSet::KeyAt(const size_t index) const noexcept
 {
-    _ASSERTE(IsValid());
+    return (m_comparison == StringComparison::IgnoreCase) ? m_foldedStrings[index] : m_strings[index];
+}
 
-    using ReturnType = std::vector<std::wstring>;
 
-    // Get some useful enumeration info, like the total number of subkeys
-    // and the maximum length of the subkey names
-    DWORD subKeyCount = 0;
-    DWORD maxSubKeyNameLen = 0;
-    LSTATUS retCode = ::RegQueryInfoKeyW(
-        m_hKey,
-        nullptr,    // no user-defined class
-        nullptr,    // no user-defined class size
-        nullptr,    // reserved
-        &subKeyCount,
-        &maxSubKeyNameLen,
-        nullptr,    // no subkey class length
-        nullptr,    // no value count
-        nullptr,    // no value name max length
-        nullptr,    // no max value length
-        nullptr,    // no security descriptor
-        nullptr     // no last write time
-    );
-    if (retCode != ERROR_SUCCESS)
+inline const RegMultiStringSet::Slot* RegMultiStringSet::FindSlot(
+    const std::wstring_view s) const noexcept
+{
+    if (m_slots.empty())
     {
-        return details::MakeRegExpectedWithError<ReturnType>(retCode);
+        return nullptr;
     }
 
-    // NOTE: According to the MSDN documentation, the size returned for subkey name max length
-    // does *not* include the terminating NUL, so let's add +1 to take it into account
-    // when I allocate the buffer for reading subkey names.
-    maxSubKeyNameLen++;
+    const size_t mask = m_slots.size() - 1;
 
-    // Preallocate a buffer for the subkey names
-    auto nameBuffer = std::make_unique<wchar_t[]>(maxSubKeyNameLen);
+    if (m_comparison == StringComparison::CaseSensitive)
+    {
+        size_t pos = static_cast<size_t>(details::HashString(s, StringComparison::CaseSensitive)) & mask;
 
-    // The result subkey names will be stored here
-    std::vector<std::wstring> subkeyNames;
+        // Linear probing; the table always has empty slots, so this terminates
+        while (m_slots[pos].Count != 0)
+        {
+            if (m_strings[m_slots[pos].Index] == s)
+            {
+                return &m_slots[pos];
+            }
+            pos = (pos + 1) & mask;
+        }
 
-    // Reserve room in the vector to speed up the following insertion loop
-    subkeyNames.reserve(subKeyCount);
+        return nullptr;
+    }
 
-    // Enumerate all the subkeys
-    for (DWORD index = 0; index < subKeyCount; index++)
-    {
-        // Get the name of the current subkey
-        DWORD subKeyNameLen = maxSubKeyNameLen;
-        retCode = ::RegEnumKeyExW(
-            m_hKey,
-            index,
-            nameBuffer.get(),
-            &subKeyNameLen,
-            nullptr, // reserved
-            nullptr, // no class
-            nullptr, // no class
-            nullptr  // no last write time
-        );
-        if (retCode != ERROR_SUCCESS)
+    // Case-insensitive: fold the query piece by piece on the stack
+    // (same FNV-1a hash as HashString computes on the whole folded string)
+    std::uint64_t hash = details::kFnvOffsetBasis;
+    details::ForEachFoldedChunk(s, [&hash](const std::wstring_view chunk)
         {
-            return details::MakeRegExpectedWithError<ReturnType>(retCode);
+            hash = details::HashString(chunk, StringComparison::CaseSensitive, hash);
         }
+    );
 
-        // On success, the ::RegEnumKeyEx API writes the length of the
-        // subkey name in the subKeyNameLen output parameter
-        // (not including the terminating NUL).
-        // So I can build a wstring based on that length.
-        subkeyNames.emplace_back(nameBuffer.get(), subKeyNameLen);
+    size_t pos = static_cast<size_t>(hash) & mask;
+    while (m_slots[pos].Count != 0)
+    {
+        const std::wstring_view key = m_foldedStrings[m_slots[pos].Index];
+        if (key.length() == s.length())
+        {
+            size_t offset = 0;
+            bool equal = true;
+            details::ForEachFoldedChunk(s, [&](const std::wstring_view chunk)
+                {
+                    equal = equal && (key.substr(offset, chunk.length()) == chunk);
+                    offset += chunk.length();
+                }
+            );
+
+            if (equal)
+            {
+                return &m_slots[pos];
+            }
+        }
+        pos = (pos + 1) & mask;
     }
 
-    return RegExpected<ReturnType>{ subkeyNames };
+    return nullptr;
 }
 
 
-inline RegExpected<std::vector<std::pair<std::wstring, DWORD>>> RegKey::TryEnumValues() const
+inline bool RegMultiStringSet::Contains(const std::wstring_view s) const noexcept
 {
-    _ASSERTE(IsValid());
+    return FindSlot(s) != nullptr;
+}
 
-    using ReturnType = std::vector<std::pair<std::wstring, DWORD>>;
 
-    // Get useful enumeration info, like the total number of values
-    // and the maximum length of the value names
-    DWORD valueCount = 0;
-    DWORD maxValueNameLen = 0;
-    LSTATUS retCode = ::RegQueryInfoKeyW(
-        m_hKey,
-        nullptr,    // no user-defined class
-        nullptr,    // no user-defined class size
-        nullptr,    // reserved
-        nullptr,    // no subkey count
-        nullptr,    // no subkey max length
-        nullptr,    // no subkey class length
-        &valueCount,
-        &maxValueNameLen,
-        nullptr,    // no max value length
-        nullptr,    // no security descriptor
-        nullptr     // no last write time
-    );
-    if (retCode != ERROR_SUCCESS)
+inline size_t RegMultiStringSet::Count(const std::wstring_view s) const noexcept
+{
+    const Slot* slot = FindSlot(s);
+    return (slot != nullptr) ? slot->Count : 0;
+}
+
+
+inline std::pair<std::vector<std::uint32_t>::const_iterator,
+                 std::vector<std::uint32_t>::const_iterator>
+    RegMultiStringSet::FindPrefixRange(const std::wstring_view prefix) const
+{
+    // Compare against the sort keys, so fold the prefix too
+    std::wstring foldedPrefix;
+    std::wstring_view key = prefix;
+    if (m_comparison == StringComparison::IgnoreCase)
     {
-        return details::MakeRegExpectedWithError<ReturnType>(retCode);
+        foldedPrefix.resize(prefix.length());
+        details::FoldString(prefix, foldedPrefix.data());
+        key = foldedPrefix;
     }
 
-    // NOTE: According to the MSDN documentation, the size returned for value name max length
-    // does *not* include the terminating NUL, so let's add +1 to take it into account
-    // when I allocate the buffer for reading value names.
-    maxValueNameLen++;
+    // Strings sharing a prefix form a contiguous range in sorted order
+    auto first = std::lower_bound(m_sorted.cbegin(), m_sorted.cend(), key,
+        [this](const std::uint32_t index, const std::wstring_view value)
+        {
+            return KeyAt(index) < value;
+        }
+    );
 
-    // Preallocate a buffer for the value names
-    auto nameBuffer = std::make_unique<wchar_t[]>(maxValueNameLen);
+    auto last = std::upper_bound(first, m_sorted.cend(), key,
+        [this](const std::wstring_view value, const std::uint32_t index)
+        {
+            return value < KeyAt(index).substr(0, value.length());
+        }
+    );
 
-    // The value names and types will be stored here
-    std::vector<std::pair<std::wstring, DWORD>> valueInfo;
+    return { first, last };
+}
 
-    // Reserve room in the vector to speed up the following insertion loop
-    valueInfo.reserve(valueCount);
 
-    // Enumerate all the values
-    for (DWORD index = 0; index < valueCount; index++)
-    {
-        // Get the name and the type of the current value
-        DWORD valueNameLen = maxValueNameLen;
-        DWORD valueType = 0;
-        retCode = ::RegEnumValueW(
-            m_hKey,
-            index,
-            nameBuffer.get(),
-            &valueNameLen,
-            nullptr,    // reserved
-            &valueType,
-            nullptr,    // no data
-            nullptr     // no data size
-        );
-        if (retCode != ERROR_SUCCESS)
-        {
-            return details::MakeRegExpectedWithError<ReturnType>(retCode);
-        }
+inline size_t RegMultiStringSet::CountWithPrefix(const std::wstring_view prefix) const
+{
+    const auto [first, last] = FindPrefixRange(prefix);
+    return static_cast<size_t>(last - first);
+}
 
-        // On success, the RegEnumValue API writes the length of the
-        // value name in the valueNameLen output parameter
-        // (not including the terminating NUL).
-        // So we can build a wstring based on that.
-        valueInfo.emplace_back(
-            std::wstring{ nameBuffer.get(), valueNameLen },
-            valueType
-        );
+
+inline std::vector<std::wstring_view> RegMultiStringSet::FindWithPrefix(
+    const std::wstring_view prefix) const
+{
+    const auto [first, last] = FindPrefixRange(prefix);
+
+    std::vector<std::wstring_view> result;
+    result.reserve(static_cast<size_t>(last - first));
+    for (auto it = first; it != last; ++it)
+    {
+        result.push_back(m_strings[*it]);
     }
 
-    return RegExpected<ReturnType>{ valueInfo };
+    return result;
 }
 
 
-inline RegExpected<bool> RegKey::TryContainsValue(const std::wstring& valueName) const
+inline const std::vector<std::wstring_view>& RegMultiStringSet::Strings() const noexcept
 {
-    _ASSERTE(IsValid());
+    return m_strings;
+}
 
-    // Invoke RegGetValueW to just check if the input value exists under the current key
-    LSTATUS retCode = ::RegGetValueW(
-        m_hKey,             // current key
-        nullptr,            // no subkey - check value in current key
-        valueName.c_str(),  // value name
-        RRF_RT_ANY,         // no type restriction on this value
-        nullptr,            // we don't need to know the type of the value
-        nullptr, nullptr    // we don't need the actual value, just to check if it exists
-    );
-    if (retCode == ERROR_SUCCESS)
-    {
-        // The value exists under the current key
-        return RegExpected<bool>{ true };
-    }
-    else if (retCode == ERROR_FILE_NOT_FOUND)
-    {
-        // The value does *not* exist under the current key
-        return RegExpected<bool>{ false };
-    }
-    else
-    {
-        // Some other error occurred
-        return details::MakeRegExpectedWithError<bool>(retCode);
-    }
+
+inline size_t RegMultiStringSet::Size() const noexcept
+{
+    return m_strings.size();
 }
 
 
-inline RegExpected<bool> RegKey::TryContainsSubKey(const std::wstring& subKey) const
+inline bool RegMultiStringSet::IsEmpty() const noexcept
 {
-    _ASSERTE(IsValid());
+    return m_strings.empty();
+}
 
-    // Let's try and open the specified subKey, then check the return code
-    // of RegOpenKeyExW to figure out if the subKey exists or not.
-    HKEY hSubKey = nullptr;
-    LSTATUS retCode = ::RegOpenKeyExW(
-        m_hKey,
-        subKey.c_str(),
-        0,
-        KEY_READ,
-        &hSubKey
-    );
-    if (retCode == ERROR_SUCCESS)
-    {
-        // We were able to open the specified sub-key, so the sub-key does exist.
-        //
-        // Don't forget to close the sub-key opened for this testing purpose!
-        ::RegCloseKey(hSubKey);
-        hSubKey = nullptr;
 
-        return RegExpected<bool>{ true };
-    }
-    else if ((retCode == ERROR_FILE_NOT_FOUND) || (retCode == ERROR_PATH_NOT_FOUND))
-    {
-        // The specified sub-key does not exist
-        return RegExpected<bool>{ false };
-    }
-    else
-    {
-        // Some other error occurred
-        return details::MakeRegExpectedWithError<bool>(retCode);
-    }
+inline std::uint64_t RegMultiStringSet::DataHash() const noexcept
+{
+    return m_dataHash;
 }
 
 
-inline DWORD RegKey::QueryValueType(const std::wstring& valueName) const
+inline StringComparison RegMultiStringSet::Comparison() const noexcept
 {
-    _ASSERTE(IsValid());
+    return m_comparison;
+}
 
-    DWORD typeId = 0;     // will be returned by RegQueryValueEx
 
-    LSTATUS retCode = ::RegQueryValueExW(
-        m_hKey,
-        valueName.c_str(),
-        nullptr,    // reserved
-        &typeId,
-        nullptr,    // not interested
-        nullptr     // not interested
-    );
+//------------------------------------------------------------------------------
+//                      RegBinaryArray Inline Methods
+//------------------------------------------------------------------------------
 
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "Cannot get the value type: RegQueryValueExW failed." };
-    }
+template <typename T>
+inline RegBinaryArray<T>::RegBinaryArray(const size_t count)
+    : m_data{ new T[count] }
+    , m_size{ count }
+{}
 
-    return typeId;
+
+template <typename T>
+inline RegBinaryArray<T>::RegBinaryArray(std::unique_ptr<T[]> data, const size_t count) noexcept
+    : m_data{ std::move(data) }
+    , m_size{ count }
+{
+    _ASSERTE((m_data != nullptr) || (m_size == 0));
 }
 
 
-inline RegExpected<DWORD> RegKey::TryQueryValueType(const std::wstring& valueName) const
+template <typename T>
+inline T* RegBinaryArray<T>::Data() noexcept
 {
-    _ASSERTE(IsValid());
+    return m_data.get();
+}
 
-    using ReturnType = DWORD;
 
-    DWORD typeId = 0;     // will be returned by RegQueryValueEx
+template <typename T>
+inline const T* RegBinaryArray<T>::Data() const noexcept
+{
+    return m_data.get();
+}
 
-    LSTATUS retCode = ::RegQueryValueExW(
-        m_hKey,
-        valueName.c_str(),
-        nullptr,    // reserved
-        &typeId,
-        nullptr,    // not interested
-        nullptr     // not interested
-    );
 
-    if (retCode != ERROR_SUCCESS)
-    {
-        return details::MakeRegExpectedWithError<ReturnType>(retCode);
-    }
+template <typename T>
+inline size_t RegBinaryArray<T>::Size() const noexcept
+{
+    return m_size;
+}
 
-    return RegExpected<ReturnType>{ typeId };
+
+template <typename T>
+inline size_t RegBinaryArray<T>::SizeInBytes() const noexcept
+{
+    return m_size * sizeof(T);
 }
 
 
-inline RegKey::InfoKey RegKey::QueryInfoKey() const
+template <typename T>
+inline bool RegBinaryArray<T>::IsEmpty() const noexcept
 {
-    _ASSERTE(IsValid());
+    return m_size == 0;
+}
 
-    InfoKey infoKey{};
-    LSTATUS retCode = ::RegQueryInfoKeyW(
-        m_hKey,
-        nullptr,
-        nullptr,
-        nullptr,
-        &(infoKey.NumberOfSubKeys),
-        nullptr,
-        nullptr,
-        &(infoKey.NumberOfValues),
-        nullptr,
-        nullptr,
-        nullptr,
-        &(infoKey.LastWriteTime)
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "RegQueryInfoKeyW failed." };
-    }
 
-    return infoKey;
+template <typename T>
+inline T& RegBinaryArray<T>::operator[](const size_t index) noexcept
+{
+    _ASSERTE(index < m_size);
+    return m_data[index];
 }
 
 
-inline RegExpected<RegKey::InfoKey> RegKey::TryQueryInfoKey() const
+template <typename T>
+inline const T& RegBinaryArray<T>::operator[](const size_t index) const noexcept
 {
-    _ASSERTE(IsValid());
+    _ASSERTE(index < m_size);
+    return m_data[index];
+}
 
-    using ReturnType = RegKey::InfoKey;
 
-    InfoKey infoKey{};
-    LSTATUS retCode = ::RegQueryInfoKeyW(
-        m_hKey,
-        nullptr,
-        nullptr,
-        nullptr,
-        &(infoKey.NumberOfSubKeys),
-        nullptr,
-        nullptr,
-        &(infoKey.NumberOfValues),
-        nullptr,
-        nullptr,
-        nullptr,
-        &(infoKey.LastWriteTime)
-    );
-    if (retCode != ERROR_SUCCESS)
-    {
-        return details::MakeRegExpectedWithError<ReturnType>(retCode);
-    }
+template <typename T>
+inline T* RegBinaryArray<T>::begin() noexcept
+{
+    return m_data.get();
+}
 
-    return RegExpected<ReturnType>{ infoKey };
+
+template <typename T>
+inline T* RegBinaryArray<T>::end() noexcept
+{
+    return m_data.get() + m_size;
 }
 
 
-inline RegKey::KeyReflection RegKey::QueryReflectionKey() const
+template <typename T>
+inline const T* RegBinaryArray<T>::begin() const noexcept
 {
-    BOOL isReflectionDisabled = FALSE;
-    LSTATUS retCode = ::RegQueryReflectionKey(m_hKey, &isReflectionDisabled);
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "RegQueryReflectionKey failed." };
-    }
+    return m_data.get();
+}
 
-    return (isReflectionDisabled ? KeyReflection::ReflectionDisabled
-                                 : KeyReflection::ReflectionEnabled);
+
+template <typename T>
+inline const T* RegBinaryArray<T>::end() const noexcept
+{
+    return m_data.get() + m_size;
 }
 
 
-inline RegExpected<RegKey::KeyReflection> RegKey::TryQueryReflectionKey() const
+//------------------------------------------------------------------------------
+//                          RegNameList Inline Methods
+//------------------------------------------------------------------------------
+
+inline void RegNameList::Append(const std::wstring_view name, const DWORD type)
 {
-    using ReturnType = RegKey::KeyReflection;
+    wchar_t* const dest = BeginAppend(name.length());
+    std::copy(name.begin(), name.end(), dest);
+    EndAppend(name.length(), type);
+}
 
-    BOOL isReflectionDisabled = FALSE;
-    LSTATUS retCode = ::RegQueryReflectionKey(m_hKey, &isReflectionDisabled);
-    if (retCode != ERROR_SUCCESS)
+
+inline wchar_t* RegNameList::BeginAppend(const size_t maxLength)
+{
+    // Offsets are stored as 32-bit values to keep the entries compact
+    if ((m_chars.size() + maxLength + 1) > (std::numeric_limits<std::uint32_t>::max)())
     {
-        return details::MakeRegExpectedWithError<ReturnType>(retCode);
+        throw std::overflow_error("Too many characters in the name list.");
     }
 
-    KeyReflection keyReflection = isReflectionDisabled ? KeyReflection::ReflectionDisabled
-                                                       : KeyReflection::ReflectionEnabled;
-    return RegExpected<ReturnType>{ keyReflection };
+    m_appendOffset = m_chars.size();
+    m_chars.resize(m_appendOffset + maxLength + 1);
+    return m_chars.data() + m_appendOffset;
 }
 
 
-inline void RegKey::DeleteValue(const std::wstring& valueName)
+inline void RegNameList::CancelAppend() noexcept
 {
-    _ASSERTE(IsValid());
+    // Shrinking never reallocates
+    m_chars.resize(m_appendOffset);
+}
 
-    LSTATUS retCode = ::RegDeleteValueW(m_hKey, valueName.c_str());
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "RegDeleteValueW failed." };
-    }
+
+inline void RegNameList::EndAppend(const size_t length, const DWORD type)
+{
+    const size_t offset = m_appendOffset;
+
+    _ASSERTE(offset + length < m_chars.size());
+
+    // Trim the unused room, keeping the terminating NUL
+    m_chars.resize(offset + length + 1);
+    m_chars[offset + length] = L'\0';
+
+    m_entries.push_back(Entry{
+        static_cast<std::uint32_t>(offset),
+        static_cast<std::uint32_t>(length),
+        type
+    });
+
+    m_sortedByName = false;
 }
 
 
-inline RegResult RegKey::TryDeleteValue(const std::wstring& valueName) noexcept
+inline void RegNameList::Clear() noexcept
 {
-    _ASSERTE(IsValid());
+    m_chars.clear();
+    m_entries.clear();
+    m_appendOffset = 0;
+    m_sortedByName = false;
+}
+
 
-    return RegResult{ ::RegDeleteValueW(m_hKey, valueName.c_str()) };
+inline void RegNameList::Reserve(const size_t nameCount)
+{
+    m_entries.reserve(nameCount);
 }
 
 
-inline void RegKey::DeleteKey(const std::wstring& subKey, const REGSAM desiredAccess)
+inline size_t RegNameList::Size() const noexcept
 {
-    _ASSERTE(IsValid());
+    return m_entries.size();
+}
 
-    LSTATUS retCode = ::RegDeleteKeyExW(m_hKey, subKey.c_str(), desiredAccess, 0);
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "RegDeleteKeyExW failed." };
-    }
+
+inline bool RegNameList::IsEmpty() const noexcept
+{
+    return m_entries.empty();
 }
 
 
-inline RegResult RegKey::TryDeleteKey(const std::wstring& subKey,
-                                      const REGSAM desiredAccess) noexcept
+inline std::wstring_view RegNameList::operator[](const size_t index) const noexcept
 {
-    _ASSERTE(IsValid());
+    return Name(index);
+}
+
+
+inline std::wstring_view RegNameList::Name(const size_t index) const noexcept
+{
+    _ASSERTE(index < m_entries.size());
 
-    return RegResult{ ::RegDeleteKeyExW(m_hKey, subKey.c_str(), desiredAccess, 0) };
+    const Entry& entry = m_entries[index];
+    return std::wstring_view{ m_chars.data() + entry.Offset, entry.Length };
 }
 
 
-inline void RegKey::DeleteTree(const std::wstring& subKey)
+inline DWORD RegNameList::Type(const size_t index) const noexcept
 {
-    _ASSERTE(IsValid());
+    _ASSERTE(index < m_entries.size());
 
-    LSTATUS retCode = ::RegDeleteTreeW(m_hKey, subKey.c_str());
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "RegDeleteTreeW failed." };
-    }
+    return m_entries[index].Type;
 }
 
 
-inline RegResult RegKey::TryDeleteTree(const std::wstring& subKey) noexcept
+inline void RegNameList::SortByName()
 {
-    _ASSERTE(IsValid());
+    // Only the compact entries are moved around: the characters stay in place
+    std::sort(m_entries.begin(), m_entries.end(),
+        [this](const Entry& a, const Entry& b)
+        {
+            return details::CompareStrings(
+                std::wstring_view{ m_chars.data() + a.Offset, a.Length },
+                std::wstring_view{ m_chars.data() + b.Offset, b.Length },
+                StringComparison::IgnoreCase
+            ) < 0;
+        }
+    );
 
-    return RegResult{ ::RegDeleteTreeW(m_hKey, subKey.c_str()) };
+    m_sortedByName = true;
 }
 
 
-inline void RegKey::CopyTree(const std::wstring& sourceSubKey, const RegKey& destKey)
+inline bool RegNameList::IsSortedByName() const noexcept
 {
-    _ASSERTE(IsValid());
+    return m_sortedByName;
+}
 
-    LSTATUS retCode = ::RegCopyTreeW(m_hKey, sourceSubKey.c_str(), destKey.Get());
-    if (retCode != ERROR_SUCCESS)
+
+inline size_t RegNameList::Find(const std::wstring_view name) const noexcept
+{
+    if (m_sortedByName)
     {
-        throw RegException{ retCode, "RegCopyTreeW failed." };
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), name,
+            [this](const Entry& entry, const std::wstring_view value)
+            {
+                return details::CompareStrings(
+                    std::wstring_view{ m_chars.data() + entry.Offset, entry.Length },
+                    value,
+                    StringComparison::IgnoreCase
+                ) < 0;
+            }
+        );
+
+        if ((it != m_entries.end())
+            && details::EqualStrings(
+                    std::wstring_view{ m_chars.data() + it->Offset, it->Length },
+                    name,
+                    StringComparison::IgnoreCase))
+        {
+            return static_cast<size_t>(it - m_entries.begin());
+        }
+
+        return npos;
+    }
+
+    for (size_t index = 0; index < m_entries.size(); index++)
+    {
+        if (details::EqualStrings(Name(index), name, StringComparison::IgnoreCase))
+        {
+            return index;
+        }
     }
+
+    return npos;
 }
 
 
-inline RegResult RegKey::TryCopyTree(const std::wstring& sourceSubKey,
-                                     const RegKey& destKey) noexcept
+inline bool RegNameList::Contains(const std::wstring_view name) const noexcept
 {
-    _ASSERTE(IsValid());
-
-    return RegResult{ ::RegCopyTreeW(m_hKey, sourceSubKey.c_str(), destKey.Get()) };
+    return Find(name) != npos;
 }
 
 
-inline void RegKey::FlushKey()
+inline std::vector<std::wstring> RegNameList::ToVector() const
 {
-    _ASSERTE(IsValid());
+    std::vector<std::wstring> result;
+    details::ReserveAccounted(RegAllocationCategory::Enumeration, result, m_entries.size());
 
-    LSTATUS retCode = ::RegFlushKey(m_hKey);
-    if (retCode != ERROR_SUCCESS)
+    for (size_t index = 0; index < m_entries.size(); index++)
     {
-        throw RegException{ retCode, "RegFlushKey failed." };
+        result.emplace_back(Name(index));
+        details::AccountStringStorage(RegAllocationCategory::Enumeration, result.back());
     }
+
+    return result;
 }
 
+//------------------------------------------------------------------------------
+//                  Private Helper Classes and Functions
+//------------------------------------------------------------------------------
+
+namespace details
+{
 
-inline RegResult RegKey::TryFlushKey() noexcept
+//------------------------------------------------------------------------------
+// Append a string as a quoted JSON string literal
+//------------------------------------------------------------------------------
+inline void AppendJsonString(std::wstring& json, const std::wstring_view s)
 {
-    _ASSERTE(IsValid());
+    static const wchar_t kHexDigits[] = L"0123456789abcdef";
 
-    return RegResult{ ::RegFlushKey(m_hKey) };
+    json += L'"';
+    for (const wchar_t ch : s)
+    {
+        switch (ch)
+        {
+            case L'"':  json += L"\\\""; break;
+            case L'\\': json += L"\\\\"; break;
+            case L'\n': json += L"\\n";  break;
+            case L'\r': json += L"\\r";  break;
+            case L'\t': json += L"\\t";  break;
+            default:
+                if (ch < 0x20)
+                {
+                    json += L"\\u00";
+                    json += kHexDigits[(ch >> 4) & 0xF];
+                    json += kHexDigits[ch & 0xF];
+                }
+                else
+                {
+                    json += ch;
+                }
+                break;
+        }
+    }
+    json += L'"';
 }
 
 
-inline void RegKey::LoadKey(const std::wstring& subKey, const std::wstring& filename)
+//------------------------------------------------------------------------------
+// Append an ASCII string (e.g. a function name) as a quoted JSON string literal
+//------------------------------------------------------------------------------
+inline void AppendJsonAsciiString(std::wstring& json, const char* s)
 {
-    Close();
-
-    LSTATUS retCode = ::RegLoadKeyW(m_hKey, subKey.c_str(), filename.c_str());
-    if (retCode != ERROR_SUCCESS)
+    std::wstring wide;
+    for (; *s != '\0'; ++s)
     {
-        throw RegException{ retCode, "RegLoadKeyW failed." };
+        wide += static_cast<wchar_t>(static_cast<unsigned char>(*s));
     }
+    AppendJsonString(json, wide);
 }
 
 
-inline RegResult RegKey::TryLoadKey(const std::wstring& subKey,
-                                    const std::wstring& filename) noexcept
+//------------------------------------------------------------------------------
+// Append a time in nanoseconds as microseconds with three decimal digits,
+// as expected by the Chrome trace-event format
+//------------------------------------------------------------------------------
+inline void AppendTraceMicroseconds(std::wstring& json, const ULONGLONG nanoseconds)
 {
-    Close();
+    json += std::to_wstring(nanoseconds / 1000);
+    json += L'.';
 
-    return RegResult{ ::RegLoadKeyW(m_hKey, subKey.c_str(), filename.c_str()) };
+    const std::wstring fraction = std::to_wstring(nanoseconds % 1000);
+    json.append(3 - fraction.length(), L'0');
+    json += fraction;
 }
 
 
-inline void RegKey::SaveKey(
-    const std::wstring& filename,
-    SECURITY_ATTRIBUTES* const securityAttributes
-) const
+//------------------------------------------------------------------------------
+// Convert a UTF-16 string to UTF-8
+//------------------------------------------------------------------------------
+[[nodiscard]] inline LSTATUS Utf16ToUtf8(const std::wstring& utf16, std::string& utf8)
 {
-    _ASSERTE(IsValid());
+    utf8.clear();
+    if (utf16.empty())
+    {
+        return ERROR_SUCCESS;
+    }
 
-    LSTATUS retCode = ::RegSaveKeyW(m_hKey, filename.c_str(), securityAttributes);
-    if (retCode != ERROR_SUCCESS)
+    if (utf16.length() > static_cast<size_t>((std::numeric_limits<int>::max)()))
     {
-        throw RegException{ retCode, "RegSaveKeyW failed." };
+        return ERROR_ARITHMETIC_OVERFLOW;
     }
-}
+    const int utf16Length = static_cast<int>(utf16.length());
 
+    const int utf8Length = ::WideCharToMultiByte(CP_UTF8, 0, utf16.data(), utf16Length,
+                                                 nullptr, 0, nullptr, nullptr);
+    if (utf8Length == 0)
+    {
+        return LastErrorAsStatus();
+    }
 
-inline RegResult RegKey::TrySaveKey(
-    const std::wstring& filename,
-    SECURITY_ATTRIBUTES* const securityAttributes
-) const noexcept
-{
-    _ASSERTE(IsValid());
+    utf8.resize(static_cast<size_t>(utf8Length));
+    if (::WideCharToMultiByte(CP_UTF8, 0, utf16.data(), utf16Length,
+                              utf8.data(), utf8Length, nullptr, nullptr) == 0)
+    {
+        return LastErrorAsStatus();
+    }
 
-    return RegResult{ ::RegSaveKeyW(m_hKey, filename.c_str(), securityAttributes) };
+    return ERROR_SUCCESS;
 }
 
+} // namespace details
+
 
-inline void RegKey::EnableReflectionKey()
+#ifdef WINREG_ENABLE_TRACE
+
+//------------------------------------------------------------------------------
+//                          RegTrace Inline Methods
+//------------------------------------------------------------------------------
+
+inline void RegTrace::Enable(const RegTraceOptions& options)
 {
-    LSTATUS retCode = ::RegEnableReflectionKey(m_hKey);
-    if (retCode != ERROR_SUCCESS)
+    details::TraceState& state = details::GetTraceState();
     {
-        throw RegException{ retCode, "RegEnableReflectionKey failed." };
+        auto newOptions = std::make_shared<const RegTraceOptions>(options);
+        std::lock_guard<std::mutex> lock{ state.Mutex };
+        state.Options = std::move(newOptions);
+        state.OptionsGeneration.fetch_add(1, std::memory_order_release);
     }
+
+    // The paths of the keys that are still open are kept: their handles are
+    // forgotten when closed, even while tracing is disabled
+    s_enabled.store(true, std::memory_order_release);
 }
 
 
-inline RegResult RegKey::TryEnableReflectionKey() noexcept
+inline void RegTrace::Disable()
 {
-    return RegResult{ ::RegEnableReflectionKey(m_hKey) };
+    s_enabled.store(false, std::memory_order_release);
 }
 
 
-inline void RegKey::DisableReflectionKey()
+inline bool RegTrace::IsEnabled() noexcept
 {
-    LSTATUS retCode = ::RegDisableReflectionKey(m_hKey);
-    if (retCode != ERROR_SUCCESS)
-    {
-        throw RegException{ retCode, "RegDisableReflectionKey failed." };
-    }
+    return s_enabled.load(std::memory_order_relaxed);
 }
 
 
-inline RegResult RegKey::TryDisableReflectionKey() noexcept
+inline std::vector<RegTraceSpan> RegTrace::CollectSpans()
 {
-    return RegResult{ ::RegDisableReflectionKey(m_hKey) };
+    details::TraceState& state = details::GetTraceState();
+
+    std::vector<std::shared_ptr<details::TraceBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock{ state.Mutex };
+        buffers = state.Buffers;
+    }
+
+    std::vector<RegTraceSpan> spans;
+    for (const auto& buffer : buffers)
+    {
+        std::lock_guard<std::mutex> lock{ buffer->Mutex };
+
+        // Oldest span first
+        const size_t capacity = buffer->Spans.size();
+        const size_t first = (buffer->Count < capacity) ? 0 : buffer->Next;
+        for (size_t i = 0; i < buffer->Count; i++)
+        {
+            spans.push_back(buffer->Spans[(first + i) % capacity]);
+        }
+    }
+
+    std::stable_sort(spans.begin(), spans.end(),
+        [](const RegTraceSpan& a, const RegTraceSpan& b)
+        {
+            return a.StartNanoseconds < b.StartNanoseconds;
+        }
+    );
+    return spans;
 }
 
 
-inline void RegKey::ConnectRegistry(const std::wstring& machineName, const HKEY hKeyPredefined)
+inline void RegTrace::Clear()
 {
-    // Safely close any previously opened key
-    Close();
+    details::TraceState& state = details::GetTraceState();
+    std::lock_guard<std::mutex> lock{ state.Mutex };
 
-    HKEY hKeyResult = nullptr;
-    LSTATUS retCode = ::RegConnectRegistryW(machineName.c_str(), hKeyPredefined, &hKeyResult);
-    if (retCode != ERROR_SUCCESS)
+    for (const auto& buffer : state.Buffers)
     {
-        throw RegException{ retCode, "RegConnectRegistryW failed." };
+        std::lock_guard<std::mutex> bufferLock{ buffer->Mutex };
+        buffer->Next = 0;
+        buffer->Count = 0;
     }
 
-    // Take ownership of the result key
-    m_hKey = hKeyResult;
+    // Release the buffers of the threads that have exited
+    state.Buffers.erase(
+        std::remove_if(state.Buffers.begin(), state.Buffers.end(),
+            [](const std::shared_ptr<details::TraceBuffer>& buffer)
+            {
+                return buffer.use_count() == 1;
+            }
+        ),
+        state.Buffers.end()
+    );
 }
 
 
-inline RegResult RegKey::TryConnectRegistry(const std::wstring& machineName,
-                                            const HKEY hKeyPredefined) noexcept
+inline std::wstring RegTrace::ToChromeTraceJson(const std::vector<RegTraceSpan>& spans)
 {
-    // Safely close any previously opened key
-    Close();
+    const std::wstring processId = std::to_wstring(::GetCurrentProcessId());
 
-    HKEY hKeyResult = nullptr;
-    RegResult retCode{ ::RegConnectRegistryW(machineName.c_str(), hKeyPredefined, &hKeyResult) };
-    if (retCode.Failed())
+    std::wstring json = L"{\"traceEvents\":[";
+    for (size_t i = 0; i < spans.size(); i++)
     {
-        return retCode;
-    }
-
-    // Take ownership of the result key
-    m_hKey = hKeyResult;
+        const RegTraceSpan& span = spans[i];
+        if (i > 0)
+        {
+            json += L',';
+        }
 
-    _ASSERTE(retCode.IsOk());
-    return retCode;
+        // A complete event ("ph":"X"), with start time and duration
+        json += L"\n{\"name\":";
+        details::AppendJsonAsciiString(json, span.Operation);
+        json += L",\"cat\":\"winreg\",\"ph\":\"X\",\"ts\":";
+        details::AppendTraceMicroseconds(json, span.StartNanoseconds);
+        json += L",\"dur\":";
+        details::AppendTraceMicroseconds(json, span.DurationNanoseconds);
+        json += L",\"pid\":";
+        json += processId;
+        json += L",\"tid\":";
+        json += std::to_wstring(span.ThreadId);
+        json += L",\"args\":{\"api\":";
+        details::AppendJsonAsciiString(json, span.Api);
+        json += L",\"key\":";
+        details::AppendJsonString(json, span.KeyPath);
+        json += L",\"value\":";
+        details::AppendJsonString(json, span.ValueName);
+        json += L",\"bytes\":";
+        json += std::to_wstring(span.Bytes);
+        json += L",\"result\":";
+        json += std::to_wstring(span.Result);
+        json += L"}}";
+    }
+    json += L"\n],\"displayTimeUnit\":\"ns\"}\n";
+    return json;
 }
 
 
-inline std::wstring RegKey::RegTypeToString(const DWORD regType)
+inline void RegTrace::WriteChromeTrace(const std::wstring& fileName)
 {
-    switch (regType)
+    const RegResult result = TryWriteChromeTrace(fileName);
+    if (result.Failed())
     {
-        case REG_SZ:        return L"REG_SZ";
-        case REG_EXPAND_SZ: return L"REG_EXPAND_SZ";
-        case REG_MULTI_SZ:  return L"REG_MULTI_SZ";
-        case REG_DWORD:     return L"REG_DWORD";
-        case REG_QWORD:     return L"REG_QWORD";
-        case REG_BINARY:    return L"REG_BINARY";
-
-        default:            return L"Unknown/unsupported registry type";
+        throw RegException{ result.Code(), "Cannot write the Chrome trace file." };
     }
 }
 
 
-//------------------------------------------------------------------------------
-//                          RegException Inline Methods
-//------------------------------------------------------------------------------
+inline RegResult RegTrace::TryWriteChromeTrace(const std::wstring& fileName)
+{
+    std::string utf8;
+    LSTATUS retCode = details::Utf16ToUtf8(ToChromeTraceJson(CollectSpans()), utf8);
+    if (retCode != ERROR_SUCCESS)
+    {
+        return RegResult{ retCode };
+    }
 
-inline RegException::RegException(const LSTATUS errorCode, const char* const message)
-    : std::system_error{ errorCode, std::system_category(), message }
-{}
+    details::ScopedFileHandle file{ ::CreateFileW(
+        fileName.c_str(),
+        GENERIC_WRITE,
+        0,          // no sharing
+        nullptr,    // default security
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr     // no template
+    ) };
+    if (!file.IsValid())
+    {
+        return RegResult{ details::LastErrorAsStatus() };
+    }
+
+    retCode = details::WriteFileFully(file.Get(), reinterpret_cast<const BYTE*>(utf8.data()), utf8.size());
+    return RegResult{ retCode };
+}
 
+#endif // WINREG_ENABLE_TRACE
 
-inline RegException::RegException(const LSTATUS errorCode, const std::string& message)
-    : std::system_error{ errorCode, std::system_category(), message }
-{}
 
+#ifdef WINREG_ENABLE_ALLOCATION_STATS
 
 //------------------------------------------------------------------------------
-//                          RegResult Inline Methods
+//                      RegAllocationStats Inline Methods
 //------------------------------------------------------------------------------
 
-inline RegResult::RegResult(const LSTATUS result) noexcept
-    : m_result{ result }
-{}
-
+namespace details
+{
 
-inline bool RegResult::IsOk() const noexcept
+//------------------------------------------------------------------------------
+// Sum the counters of the given category (or of all the categories,
+// if category is RegAllocationCategory::Count) of one thread
+//------------------------------------------------------------------------------
+[[nodiscard]] inline RegAllocationCounters SumAllocationCounters(
+    const AllocationCounterBlock& counters,
+    const RegAllocationCategory category
+) noexcept
 {
-    return m_result == ERROR_SUCCESS;
+    RegAllocationCounters result;
+    for (size_t index = 0; index < AllocationCounterBlock::kCategoryCount; index++)
+    {
+        if ((category == RegAllocationCategory::Count) || (static_cast<size_t>(category) == index))
+        {
+            result.Allocations += counters.Allocations[index].load(std::memory_order_relaxed);
+            result.Bytes += counters.Bytes[index].load(std::memory_order_relaxed);
+        }
+    }
+    return result;
 }
 
 
-inline bool RegResult::Failed() const noexcept
+[[nodiscard]] inline RegAllocationCounters SumAllThreadsAllocationCounters(const RegAllocationCategory category)
 {
-    return m_result != ERROR_SUCCESS;
+    AllocationStatsState& state = GetAllocationStatsState();
+    std::lock_guard<std::mutex> lock{ state.Mutex };
+
+    RegAllocationCounters result;
+    for (const auto& counters : state.Blocks)
+    {
+        const RegAllocationCounters threadCounters = SumAllocationCounters(*counters, category);
+        result.Allocations += threadCounters.Allocations;
+        result.Bytes += threadCounters.Bytes;
+    }
+    return result;
 }
 
+} // namespace details
+
 
-inline RegResult::operator bool() const noexcept
+inline RegAllocationCounters RegAllocationStats::Get(const RegAllocationCategory category)
 {
-    return IsOk();
+    _ASSERTE(category != RegAllocationCategory::Count);
+
+    return details::SumAllThreadsAllocationCounters(category);
 }
 
 
-inline LSTATUS RegResult::Code() const noexcept
+inline RegAllocationCounters RegAllocationStats::GetTotal()
 {
-    return m_result;
+    return details::SumAllThreadsAllocationCounters(RegAllocationCategory::Count);
 }
 
 
-inline std::wstring RegResult::ErrorMessage() const
+inline RegAllocationCounters RegAllocationStats::GetForCurrentThread(const RegAllocationCategory category)
 {
-    return ErrorMessage(MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT));
+    _ASSERTE(category != RegAllocationCategory::Count);
+
+    return details::SumAllocationCounters(details::GetThreadAllocationCounters(), category);
 }
 
 
-inline std::wstring RegResult::ErrorMessage(const DWORD languageId) const
+inline void RegAllocationStats::Reset()
 {
-    // Invoke FormatMessage() to retrieve the error message from Windows
-    details::ScopedLocalFree<wchar_t> messagePtr;
-    DWORD retCode = ::FormatMessageW(
-        FORMAT_MESSAGE_ALLOCATE_BUFFER |
-        FORMAT_MESSAGE_FROM_SYSTEM |
-        FORMAT_MESSAGE_IGNORE_INSERTS,
-        nullptr,
-        m_result,
-        languageId,
-        reinterpret_cast<LPWSTR>(messagePtr.AddressOf()),
-        0,
-        nullptr
-    );
-    if (retCode == 0)
+    details::AllocationStatsState& state = details::GetAllocationStatsState();
+    std::lock_guard<std::mutex> lock{ state.Mutex };
+
+    for (const auto& counters : state.Blocks)
     {
-        // FormatMessage failed: return an empty string
-        return std::wstring{};
+        for (size_t index = 0; index < details::AllocationCounterBlock::kCategoryCount; index++)
+        {
+            counters->Allocations[index].store(0, std::memory_order_relaxed);
+            counters->Bytes[index].store(0, std::memory_order_relaxed);
+        }
     }
 
-    // Safely copy the C-string returned by FormatMessage() into a std::wstring object,
-    // and return it back to the caller.
-    return std::wstring{ messagePtr.Get() };
+    // Drop the counters of the threads that have exited
+    state.Blocks.erase(
+        std::remove_if(state.Blocks.begin(), state.Blocks.end(),
+            [](const auto& counters) { return counters.use_count() == 1; }),
+        state.Blocks.end()
+    );
 }
 
 
-//------------------------------------------------------------------------------
-//                          RegExpected Inline Methods
-//------------------------------------------------------------------------------
-
-template <typename T>
-inline RegExpected<T>::RegExpected(const RegResult& errorCode) noexcept
-    : m_var{ errorCode }
-{}
-
-
-template <typename T>
-inline RegExpected<T>::RegExpected(const T& value)
-    : m_var{ value }
-{}
-
-
-template <typename T>
-inline RegExpected<T>::RegExpected(T&& value)
-    : m_var{ std::move(value) }
-{}
-
-
-template <typename T>
-inline RegExpected<T>::operator bool() const noexcept
+template <typename Function>
+inline RegAllocationCounters RegAllocationStats::Measure(Function&& function)
 {
-    return IsValid();
-}
+    const details::AllocationCounterBlock& counters = details::GetThreadAllocationCounters();
 
+    const RegAllocationCounters before = details::SumAllocationCounters(counters, RegAllocationCategory::Count);
+    std::forward<Function>(function)();
+    const RegAllocationCounters after = details::SumAllocationCounters(counters, RegAllocationCategory::Count);
 
-template <typename T>
-inline bool RegExpected<T>::IsValid() const noexcept
-{
-    return std::holds_alternative<T>(m_var);
+    // A concurrent Reset may have zeroed the counters meanwhile
+    RegAllocationCounters result;
+    if (after.Allocations >= before.Allocations)
+    {
+        result.Allocations = after.Allocations - before.Allocations;
+        result.Bytes = after.Bytes - before.Bytes;
+    }
+    else
+    {
+        result = after;
+    }
+    return result;
 }
 
 
-template <typename T>
-inline const T& RegExpected<T>::GetValue() const
+template <typename Function>
+inline void RegAllocationStats::ExpectAtMost(const ULONGLONG maxAllocations, Function&& function)
 {
-    // Check that the object stores a valid value
-    _ASSERTE(IsValid());
-
-    // If the object is in a valid state, the variant stores an instance of T
-    return std::get<T>(m_var);
+    const RegAllocationCounters counters = Measure(std::forward<Function>(function));
+    if (counters.Allocations > maxAllocations)
+    {
+        throw RegException{ ERROR_ASSERTION_FAILURE, "More heap allocations than expected." };
+    }
 }
 
-
-template <typename T>
-inline RegResult RegExpected<T>::GetError() const
-{
-    // Check that the object is in an invalid state
-    _ASSERTE(!IsValid());
-
-    // If the object is in an invalid state, the variant stores a RegResult
-    // that represents an error code from the Windows Registry API
-    return std::get<RegResult>(m_var);
-}
+#endif // WINREG_ENABLE_ALLOCATION_STATS
 
 
 } // namespace winreg
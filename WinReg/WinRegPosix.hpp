@@ -0,0 +1,1453 @@
+#ifndef GIOVANNI_DICANIO_WINREG_WINREGPOSIX_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_WINREGPOSIX_HPP_INCLUDED
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//      *** Modern C++ Wrappers Around Windows Registry C API ***
+//
+//               Copyright (C) by Giovanni Dicanio
+//
+// WinRegPosix: the subset of the Windows API that WinReg uses, implemented on
+// POSIX systems (e.g. Linux), so that WinReg and the in-memory registry
+// classes built on it compile and run there too.
+//
+// WinReg.hpp includes this header in place of <Windows.h> when _WIN32 is not
+// defined: don't include it directly.
+//
+// There is no Windows registry on POSIX systems: the Windows Registry API
+// functions fail with ERROR_NOT_SUPPORTED, unless a RegBackend is installed
+// (e.g. a RegTreeBackend, see RegMemoryBackend.hpp), that then receives all
+// the registry calls made by WinReg.
+//
+// The rest of the subset (files, file mappings, events, errors, string
+// conversions, clocks) is implemented on the POSIX API, with the Windows
+// semantics that WinReg relies on:
+//
+// - File paths are converted to UTF-8; "\" is not a path separator.
+// - Handles are checked: a closed handle fails with ERROR_INVALID_HANDLE,
+//   and an object stays alive until the calls using it return.
+// - Events support the manual and auto reset modes, but not the names.
+// - Error codes are Windows error codes (GetLastError is per-thread);
+//   FormatMessageW only knows the messages of the error codes that WinReg
+//   and the registry functions return.
+// - Case mapping (LCMapStringEx) uses the C.UTF-8 locale, if available.
+//
+// The MIT License (MIT): see WinReg.hpp for the full license text.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <atomic>           // std::atomic
+#include <cassert>          // assert
+#include <cerrno>           // errno
+#include <chrono>           // std::chrono::steady_clock
+#include <condition_variable> // std::condition_variable
+#include <cstddef>          // size_t
+#include <cstdint>          // std::uint64_t, intptr_t, uintptr_t
+#include <cstdlib>          // std::malloc, std::free, std::getenv
+#include <cstring>          // std::memcpy, std::strlen
+#include <cwchar>           // std::wcslen
+#include <cwctype>          // std::towupper
+#include <limits>           // std::numeric_limits
+#include <memory>           // std::shared_ptr, std::make_shared
+#include <mutex>            // std::mutex, std::lock_guard, std::unique_lock
+#include <string>           // std::string
+#include <unordered_map>    // std::unordered_map
+
+#include <fcntl.h>          // open
+#include <locale.h>         // newlocale
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/stat.h>       // fstat
+#include <unistd.h>         // read, write, close, fsync, getpid
+
+#ifdef __linux__
+#include <sys/syscall.h>    // SYS_gettid
+#endif // __linux__
+
+
+//------------------------------------------------------------------------------
+//                          Windows Types
+//------------------------------------------------------------------------------
+
+typedef unsigned char       BYTE;
+typedef unsigned short      WORD;
+typedef unsigned int        DWORD;      // 32-bit, like on Windows
+typedef unsigned int        UINT;
+typedef int                 BOOL;
+typedef int                 LONG;       // 32-bit, like on Windows
+typedef LONG                LSTATUS;
+typedef LONG                HRESULT;
+typedef long long           LONGLONG;
+typedef unsigned long long  ULONGLONG;
+typedef intptr_t            LONG_PTR;
+typedef uintptr_t           ULONG_PTR;
+typedef DWORD               REGSAM;
+
+typedef void*               HANDLE;
+typedef void*               LPVOID;
+typedef const void*         LPCVOID;
+typedef wchar_t*            LPWSTR;
+typedef const wchar_t*      LPCWSTR;
+typedef DWORD*              LPDWORD;
+
+struct HKEY__;
+typedef HKEY__*             HKEY;
+typedef HKEY*               PHKEY;
+
+struct FILETIME
+{
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+};
+
+struct SECURITY_ATTRIBUTES
+{
+    DWORD  nLength;
+    LPVOID lpSecurityDescriptor;
+    BOOL   bInheritHandle;
+};
+
+union LARGE_INTEGER
+{
+    struct
+    {
+        DWORD LowPart;
+        LONG  HighPart;
+    } u;
+    LONGLONG QuadPart;
+};
+
+
+//------------------------------------------------------------------------------
+//                          Windows Constants
+//------------------------------------------------------------------------------
+
+#define TRUE                                1
+#define FALSE                               0
+#define INFINITE                            0xFFFFFFFF
+#define MAX_PATH                            260
+
+#define _ASSERTE(expr)                      assert(expr)
+
+// Predefined keys
+#define HKEY_CLASSES_ROOT                   ((HKEY)(ULONG_PTR)((LONG)0x80000000))
+#define HKEY_CURRENT_USER                   ((HKEY)(ULONG_PTR)((LONG)0x80000001))
+#define HKEY_LOCAL_MACHINE                  ((HKEY)(ULONG_PTR)((LONG)0x80000002))
+#define HKEY_USERS                          ((HKEY)(ULONG_PTR)((LONG)0x80000003))
+#define HKEY_PERFORMANCE_DATA               ((HKEY)(ULONG_PTR)((LONG)0x80000004))
+#define HKEY_PERFORMANCE_TEXT               ((HKEY)(ULONG_PTR)((LONG)0x80000050))
+#define HKEY_PERFORMANCE_NLSTEXT            ((HKEY)(ULONG_PTR)((LONG)0x80000060))
+#define HKEY_CURRENT_CONFIG                 ((HKEY)(ULONG_PTR)((LONG)0x80000005))
+#define HKEY_CURRENT_USER_LOCAL_SETTINGS    ((HKEY)(ULONG_PTR)((LONG)0x80000007))
+
+// Error codes (int, like LONG and LSTATUS here)
+#define ERROR_SUCCESS                       0
+#define ERROR_INVALID_FUNCTION              1
+#define ERROR_FILE_NOT_FOUND                2
+#define ERROR_PATH_NOT_FOUND                3
+#define ERROR_TOO_MANY_OPEN_FILES           4
+#define ERROR_ACCESS_DENIED                 5
+#define ERROR_INVALID_HANDLE                6
+#define ERROR_NOT_ENOUGH_MEMORY             8
+#define ERROR_INVALID_DATA                  13
+#define ERROR_OUTOFMEMORY                   14
+#define ERROR_GEN_FAILURE                   31
+#define ERROR_HANDLE_EOF                    38
+#define ERROR_NOT_SUPPORTED                 50
+#define ERROR_FILE_EXISTS                   80
+#define ERROR_INVALID_PARAMETER             87
+#define ERROR_DISK_FULL                     112
+#define ERROR_INSUFFICIENT_BUFFER           122
+#define ERROR_ALREADY_EXISTS                183
+#define ERROR_FILENAME_EXCED_RANGE          206
+#define ERROR_MORE_DATA                     234
+#define ERROR_NO_MORE_ITEMS                 259
+#define ERROR_ARITHMETIC_OVERFLOW           534
+#define ERROR_ASSERTION_FAILURE             668
+#define ERROR_OPERATION_ABORTED             995
+#define ERROR_BADDB                         1009
+#define ERROR_KEY_DELETED                   1018
+#define ERROR_CANCELLED                     1223
+#define ERROR_RETRY                         1237
+#define ERROR_INTERNAL_ERROR                1359
+#define ERROR_TIMEOUT                       1460
+#define ERROR_UNSUPPORTED_TYPE              1630
+#define RPC_S_SERVER_UNAVAILABLE            1722
+#define RPC_S_CALL_FAILED                   1726
+
+// Registry value types
+#define REG_NONE                            0
+#define REG_SZ                              1
+#define REG_EXPAND_SZ                       2
+#define REG_BINARY                          3
+#define REG_DWORD                           4
+#define REG_DWORD_BIG_ENDIAN                5
+#define REG_LINK                            6
+#define REG_MULTI_SZ                        7
+#define REG_QWORD                           11
+
+// Registry key options, dispositions and access rights
+#define REG_OPTION_NON_VOLATILE             0x00000000
+#define REG_OPTION_VOLATILE                 0x00000001
+#define REG_CREATED_NEW_KEY                 1
+#define REG_OPENED_EXISTING_KEY             2
+
+#define DELETE                              0x00010000
+#define KEY_QUERY_VALUE                     0x0001
+#define KEY_SET_VALUE                       0x0002
+#define KEY_CREATE_SUB_KEY                  0x0004
+#define KEY_ENUMERATE_SUB_KEYS              0x0008
+#define KEY_NOTIFY                          0x0010
+#define KEY_CREATE_LINK                     0x0020
+#define KEY_WOW64_64KEY                     0x0100
+#define KEY_WOW64_32KEY                     0x0200
+#define KEY_READ                            0x20019
+#define KEY_WRITE                           0x20006
+#define KEY_ALL_ACCESS                      0xF003F
+
+// RegGetValue flags
+#define RRF_RT_REG_NONE                     0x00000001
+#define RRF_RT_REG_SZ                       0x00000002
+#define RRF_RT_REG_EXPAND_SZ                0x00000004
+#define RRF_RT_REG_BINARY                   0x00000008
+#define RRF_RT_REG_DWORD                    0x00000010
+#define RRF_RT_REG_MULTI_SZ                 0x00000020
+#define RRF_RT_REG_QWORD                    0x00000040
+#define RRF_RT_ANY                          0x0000FFFF
+#define RRF_NOEXPAND                        0x10000000
+#define RRF_ZEROONFAILURE                   0x20000000
+
+// RegNotifyChangeKeyValue filters
+#define REG_NOTIFY_CHANGE_NAME              0x00000001
+#define REG_NOTIFY_CHANGE_ATTRIBUTES        0x00000002
+#define REG_NOTIFY_CHANGE_LAST_SET          0x00000004
+#define REG_NOTIFY_CHANGE_SECURITY          0x00000008
+#define REG_NOTIFY_THREAD_AGNOSTIC          0x10000000
+
+// Error messages
+#define LANG_NEUTRAL                        0x00
+#define SUBLANG_DEFAULT                     0x01
+#define MAKELANGID(p, s)                    ((((WORD)(s)) << 10) | (WORD)(p))
+#define FORMAT_MESSAGE_ALLOCATE_BUFFER      0x00000100
+#define FORMAT_MESSAGE_IGNORE_INSERTS       0x00000200
+#define FORMAT_MESSAGE_FROM_SYSTEM          0x00001000
+
+// Strings
+#define CP_UTF8                             65001
+#define LCMAP_UPPERCASE                     0x00000200
+#define LOCALE_NAME_INVARIANT               L""
+
+// Files and file mappings
+#define GENERIC_READ                        0x80000000
+#define GENERIC_WRITE                       0x40000000
+#define FILE_SHARE_READ                     0x00000001
+#define FILE_SHARE_WRITE                    0x00000002
+#define FILE_SHARE_DELETE                   0x00000004
+#define CREATE_NEW                          1
+#define CREATE_ALWAYS                       2
+#define OPEN_EXISTING                       3
+#define OPEN_ALWAYS                         4
+#define TRUNCATE_EXISTING                   5
+#define FILE_ATTRIBUTE_NORMAL               0x00000080
+#define FILE_BEGIN                          0
+#define FILE_CURRENT                        1
+#define FILE_END                            2
+#define INVALID_HANDLE_VALUE                ((HANDLE)(LONG_PTR)-1)
+#define PAGE_READONLY                       0x02
+#define FILE_MAP_READ                       0x0004
+#define MOVEFILE_REPLACE_EXISTING           0x00000001
+#define MOVEFILE_WRITE_THROUGH              0x00000008
+
+// Waits
+#define WAIT_OBJECT_0                       0x00000000
+#define WAIT_TIMEOUT                        0x00000102
+#define WAIT_FAILED                         0xFFFFFFFF
+
+
+//------------------------------------------------------------------------------
+//                  Private Helpers for the POSIX Implementation
+//------------------------------------------------------------------------------
+
+namespace winreg
+{
+namespace details
+{
+
+//------------------------------------------------------------------------------
+// The object behind a HANDLE: a file, a file mapping, or an event
+//------------------------------------------------------------------------------
+class PosixHandle
+{
+public:
+    PosixHandle() noexcept = default;
+    virtual ~PosixHandle() = default;
+
+    PosixHandle(const PosixHandle&) = delete;
+    PosixHandle& operator=(const PosixHandle&) = delete;
+};
+
+
+class PosixFile : public PosixHandle
+{
+public:
+    explicit PosixFile(const int fd) noexcept
+        : Fd{ fd }
+    {}
+
+    ~PosixFile() override
+    {
+        ::close(Fd);
+    }
+
+    const int Fd;
+};
+
+
+class PosixFileMapping : public PosixHandle
+{
+public:
+    PosixFileMapping(const int fd, const size_t size) noexcept
+        : Fd{ fd }
+        , Size{ size }
+    {}
+
+    ~PosixFileMapping() override
+    {
+        ::close(Fd);
+    }
+
+    const int    Fd;
+    const size_t Size;
+};
+
+
+class PosixEvent : public PosixHandle
+{
+public:
+    PosixEvent(const bool manualReset, const bool signaled) noexcept
+        : ManualReset{ manualReset }
+        , Signaled{ signaled }
+    {}
+
+    const bool              ManualReset;
+    std::mutex              Mutex;
+    std::condition_variable Condition;
+    bool                    Signaled;
+};
+
+
+//------------------------------------------------------------------------------
+// The last error of the calling thread (see GetLastError)
+//------------------------------------------------------------------------------
+inline thread_local DWORD t_posixLastError = ERROR_SUCCESS;
+
+
+//------------------------------------------------------------------------------
+// The open handles. A HANDLE is the address of its object, that the table
+// owns until CloseHandle; the calls using an object share its ownership,
+// so closing a handle on another thread doesn't destroy it under them.
+//------------------------------------------------------------------------------
+struct PosixHandleTable
+{
+    std::mutex                                                 Mutex;
+    std::unordered_map<HANDLE, std::shared_ptr<PosixHandle>>   Objects;
+};
+
+[[nodiscard]] inline PosixHandleTable& GetPosixHandleTable() noexcept
+{
+    static PosixHandleTable s_handles;
+    return s_handles;
+}
+
+
+//------------------------------------------------------------------------------
+// Add an object to the handle table, and return its handle
+//------------------------------------------------------------------------------
+[[nodiscard]] inline HANDLE AddPosixHandle(std::shared_ptr<PosixHandle> object)
+{
+    const HANDLE handle = static_cast<HANDLE>(object.get());
+
+    PosixHandleTable& handles = GetPosixHandleTable();
+    std::lock_guard<std::mutex> lock{ handles.Mutex };
+    handles.Objects.emplace(handle, std::move(object));
+    return handle;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the object of a handle, if it is open and of the given type;
+// otherwise, set the last error to ERROR_INVALID_HANDLE and return nullptr
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline std::shared_ptr<T> FindPosixHandle(const HANDLE handle) noexcept
+{
+    std::shared_ptr<T> object;
+    {
+        PosixHandleTable& handles = GetPosixHandleTable();
+        std::lock_guard<std::mutex> lock{ handles.Mutex };
+        const auto it = handles.Objects.find(handle);
+        if (it != handles.Objects.end())
+        {
+            object = std::dynamic_pointer_cast<T>(it->second);
+        }
+    }
+
+    if (!object)
+    {
+        t_posixLastError = ERROR_INVALID_HANDLE;
+    }
+    return object;
+}
+
+
+//------------------------------------------------------------------------------
+// Map an errno value to the Windows error code closest to it
+//------------------------------------------------------------------------------
+[[nodiscard]] inline DWORD ErrnoToWin32Error(const int error) noexcept
+{
+    switch (error)
+    {
+    case 0:             return ERROR_SUCCESS;
+    case ENOENT:        return ERROR_FILE_NOT_FOUND;
+    case ENOTDIR:       return ERROR_PATH_NOT_FOUND;
+    case EACCES:
+    case EPERM:
+    case EROFS:
+    case EISDIR:        return ERROR_ACCESS_DENIED;
+    case EBADF:         return ERROR_INVALID_HANDLE;
+    case ENOMEM:        return ERROR_NOT_ENOUGH_MEMORY;
+    case EEXIST:        return ERROR_FILE_EXISTS;
+    case EINVAL:        return ERROR_INVALID_PARAMETER;
+    case ENOSPC:        return ERROR_DISK_FULL;
+    case EMFILE:
+    case ENFILE:        return ERROR_TOO_MANY_OPEN_FILES;
+    case ENAMETOOLONG:  return ERROR_FILENAME_EXCED_RANGE;
+    case ENOTSUP:       return ERROR_NOT_SUPPORTED;
+    default:            return ERROR_GEN_FAILURE;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Set the last error from errno, and return the given failure value
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline T FailWithErrno(const T failureValue) noexcept
+{
+    t_posixLastError = ErrnoToWin32Error(errno);
+    return failureValue;
+}
+
+
+//------------------------------------------------------------------------------
+// Set the last error, and return the given failure value
+//------------------------------------------------------------------------------
+template <typename T>
+[[nodiscard]] inline T FailWithError(const DWORD error, const T failureValue) noexcept
+{
+    t_posixLastError = error;
+    return failureValue;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the code point starting at position i of the given wide string
+// (wchar_t is UTF-32 on POSIX systems, but UTF-16 surrogate pairs are
+// combined too), advancing i past it. Invalid code points are replaced
+// with U+FFFD.
+//------------------------------------------------------------------------------
+[[nodiscard]] inline char32_t NextCodePoint(const wchar_t* const s, const size_t length, size_t& i) noexcept
+{
+    const auto ch = static_cast<char32_t>(s[i++]);
+    if ((ch >= 0xD800) && (ch <= 0xDBFF) && (i < length))
+    {
+        const auto low = static_cast<char32_t>(s[i]);
+        if ((low >= 0xDC00) && (low <= 0xDFFF))
+        {
+            i++;
+            return 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+        }
+    }
+    if (((ch >= 0xD800) && (ch <= 0xDFFF)) || (ch > 0x10FFFF))
+    {
+        return 0xFFFD;
+    }
+    return ch;
+}
+
+
+//------------------------------------------------------------------------------
+// Append the UTF-8 encoding of a code point
+//------------------------------------------------------------------------------
+inline void AppendUtf8(std::string& utf8, const char32_t codePoint)
+{
+    if (codePoint < 0x80)
+    {
+        utf8 += static_cast<char>(codePoint);
+    }
+    else if (codePoint < 0x800)
+    {
+        utf8 += static_cast<char>(0xC0 | (codePoint >> 6));
+        utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else if (codePoint < 0x10000)
+    {
+        utf8 += static_cast<char>(0xE0 | (codePoint >> 12));
+        utf8 += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else
+    {
+        utf8 += static_cast<char>(0xF0 | (codePoint >> 18));
+        utf8 += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        utf8 += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Convert a wide string to UTF-8 (e.g. a file path for the POSIX API)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline std::string WideToUtf8(const wchar_t* const s, const size_t length)
+{
+    std::string utf8;
+    utf8.reserve(length);
+    size_t i = 0;
+    while (i < length)
+    {
+        AppendUtf8(utf8, NextCodePoint(s, length, i));
+    }
+    return utf8;
+}
+
+
+//------------------------------------------------------------------------------
+// The locale used for case mapping: C.UTF-8 if available, so that non-ASCII
+// characters are mapped too, whatever the locale of the program
+//------------------------------------------------------------------------------
+[[nodiscard]] inline locale_t PosixCaseMappingLocale() noexcept
+{
+    static const locale_t s_locale = ::newlocale(LC_CTYPE_MASK, "C.UTF-8", static_cast<locale_t>(0));
+    return s_locale;
+}
+
+
+//------------------------------------------------------------------------------
+// The length of each view of a file mapping, that munmap needs
+//------------------------------------------------------------------------------
+struct PosixMappedViews
+{
+    std::mutex                               Mutex;
+    std::unordered_map<const void*, size_t>  Lengths;
+};
+
+[[nodiscard]] inline PosixMappedViews& GetPosixMappedViews() noexcept
+{
+    static PosixMappedViews s_views;
+    return s_views;
+}
+
+
+//------------------------------------------------------------------------------
+// The messages of the error codes that WinReg and the registry functions
+// return (see FormatMessageW)
+//------------------------------------------------------------------------------
+[[nodiscard]] inline const wchar_t* PosixErrorMessage(const DWORD error) noexcept
+{
+    switch (error)
+    {
+    case ERROR_SUCCESS:             return L"The operation completed successfully.";
+    case ERROR_INVALID_FUNCTION:    return L"Incorrect function.";
+    case ERROR_FILE_NOT_FOUND:      return L"The system cannot find the file specified.";
+    case ERROR_PATH_NOT_FOUND:      return L"The system cannot find the path specified.";
+    case ERROR_ACCESS_DENIED:       return L"Access is denied.";
+    case ERROR_INVALID_HANDLE:      return L"The handle is invalid.";
+    case ERROR_NOT_ENOUGH_MEMORY:   return L"Not enough memory resources are available to process this command.";
+    case ERROR_INVALID_DATA:        return L"The data is invalid.";
+    case ERROR_NOT_SUPPORTED:       return L"The request is not supported.";
+    case ERROR_INVALID_PARAMETER:   return L"The parameter is incorrect.";
+    case ERROR_DISK_FULL:           return L"There is not enough space on the disk.";
+    case ERROR_INSUFFICIENT_BUFFER: return L"The data area passed to a system call is too small.";
+    case ERROR_ALREADY_EXISTS:      return L"Cannot create a file when that file already exists.";
+    case ERROR_MORE_DATA:           return L"More data is available.";
+    case ERROR_NO_MORE_ITEMS:       return L"No more data is available.";
+    case ERROR_BADDB:               return L"The configuration registry database is corrupt.";
+    case ERROR_KEY_DELETED:         return L"Illegal operation attempted on a registry key that has been marked for deletion.";
+    case ERROR_CANCELLED:           return L"The operation was canceled by the user.";
+    case ERROR_INTERNAL_ERROR:      return L"An internal error occurred.";
+    case ERROR_TIMEOUT:             return L"This operation returned because the timeout period expired.";
+    case ERROR_UNSUPPORTED_TYPE:    return L"Data of this type is not supported.";
+    case RPC_S_SERVER_UNAVAILABLE:  return L"The RPC server is unavailable.";
+    case RPC_S_CALL_FAILED:         return L"The remote procedure call failed.";
+    default:                        return nullptr;
+    }
+}
+
+} // namespace details
+} // namespace winreg
+
+
+//------------------------------------------------------------------------------
+//                  Windows Registry API Functions
+//
+// There is no registry to call: all of them fail with ERROR_NOT_SUPPORTED.
+// WinReg calls them only when no RegBackend is installed.
+//------------------------------------------------------------------------------
+
+inline LSTATUS RegOpenKeyExW(HKEY, LPCWSTR, DWORD, REGSAM, PHKEY) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegCreateKeyExW(HKEY, LPCWSTR, DWORD, LPWSTR, DWORD, REGSAM,
+                               SECURITY_ATTRIBUTES*, PHKEY, LPDWORD) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegCloseKey(HKEY) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegConnectRegistryW(LPCWSTR, HKEY, PHKEY) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegGetValueW(HKEY, LPCWSTR, LPCWSTR, DWORD, LPDWORD, void*, LPDWORD) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegQueryValueExW(HKEY, LPCWSTR, LPDWORD, LPDWORD, BYTE*, LPDWORD) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegSetValueExW(HKEY, LPCWSTR, DWORD, DWORD, const BYTE*, DWORD) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegSetKeyValueW(HKEY, LPCWSTR, LPCWSTR, DWORD, LPCVOID, DWORD) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegQueryInfoKeyW(HKEY, LPWSTR, LPDWORD, LPDWORD, LPDWORD, LPDWORD, LPDWORD,
+                                LPDWORD, LPDWORD, LPDWORD, LPDWORD, FILETIME*) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegEnumKeyExW(HKEY, DWORD, LPWSTR, LPDWORD, LPDWORD, LPWSTR, LPDWORD, FILETIME*) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegEnumValueW(HKEY, DWORD, LPWSTR, LPDWORD, LPDWORD, LPDWORD, BYTE*, LPDWORD) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegDeleteValueW(HKEY, LPCWSTR) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegDeleteKeyExW(HKEY, LPCWSTR, REGSAM, DWORD) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegDeleteTreeW(HKEY, LPCWSTR) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegCopyTreeW(HKEY, LPCWSTR, HKEY) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegRenameKey(HKEY, LPCWSTR, LPCWSTR) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegFlushKey(HKEY) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegLoadKeyW(HKEY, LPCWSTR, LPCWSTR) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegSaveKeyW(HKEY, LPCWSTR, SECURITY_ATTRIBUTES*) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegQueryReflectionKey(HKEY, BOOL*) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegEnableReflectionKey(HKEY) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegDisableReflectionKey(HKEY) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+inline LSTATUS RegNotifyChangeKeyValue(HKEY, BOOL, DWORD, HANDLE, BOOL) noexcept
+{
+    return ERROR_NOT_SUPPORTED;
+}
+
+
+//------------------------------------------------------------------------------
+//                          Errors
+//------------------------------------------------------------------------------
+
+inline DWORD GetLastError() noexcept
+{
+    return winreg::details::t_posixLastError;
+}
+
+
+inline void SetLastError(const DWORD error) noexcept
+{
+    winreg::details::t_posixLastError = error;
+}
+
+
+inline DWORD FormatMessageW(
+    const DWORD flags,
+    [[maybe_unused]] LPCVOID source,
+    const DWORD messageId,
+    [[maybe_unused]] const DWORD languageId,
+    const LPWSTR buffer,
+    const DWORD size,
+    [[maybe_unused]] void* arguments) noexcept
+{
+    using namespace winreg::details;
+
+    const wchar_t* const message = PosixErrorMessage(messageId);
+    if (((flags & FORMAT_MESSAGE_FROM_SYSTEM) == 0) || (buffer == nullptr) || (message == nullptr))
+    {
+        return FailWithError(ERROR_NOT_SUPPORTED, DWORD{ 0 });
+    }
+
+    const size_t length = std::wcslen(message);
+    wchar_t* dest = buffer;
+    if ((flags & FORMAT_MESSAGE_ALLOCATE_BUFFER) != 0)
+    {
+        // The buffer parameter receives the allocated buffer, freed with LocalFree
+        dest = static_cast<wchar_t*>(std::malloc((length + 1) * sizeof(wchar_t)));
+        if (dest == nullptr)
+        {
+            return FailWithError(ERROR_NOT_ENOUGH_MEMORY, DWORD{ 0 });
+        }
+        *reinterpret_cast<wchar_t**>(buffer) = dest;
+    }
+    else if (size <= length)
+    {
+        return FailWithError(ERROR_INSUFFICIENT_BUFFER, DWORD{ 0 });
+    }
+
+    std::memcpy(dest, message, (length + 1) * sizeof(wchar_t));
+    return static_cast<DWORD>(length);
+}
+
+
+inline void* LocalFree(void* const memory) noexcept
+{
+    std::free(memory);
+    return nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+//                          Strings
+//------------------------------------------------------------------------------
+
+inline int LCMapStringEx(
+    [[maybe_unused]] LPCWSTR localeName,
+    const DWORD mapFlags,
+    const LPCWSTR source,
+    const int sourceLength,
+    const LPWSTR dest,
+    const int destLength,
+    [[maybe_unused]] void* versionInformation,
+    [[maybe_unused]] void* reserved,
+    [[maybe_unused]] LONG_PTR sortHandle) noexcept
+{
+    using namespace winreg::details;
+
+    if ((mapFlags != LCMAP_UPPERCASE) || (source == nullptr) || (sourceLength < 0) || (destLength < sourceLength))
+    {
+        return FailWithError(ERROR_INVALID_PARAMETER, 0);
+    }
+
+    const locale_t locale = PosixCaseMappingLocale();
+    for (int i = 0; i < sourceLength; i++)
+    {
+        const auto ch = static_cast<wint_t>(source[i]);
+        dest[i] = static_cast<wchar_t>((locale != static_cast<locale_t>(0)) ? ::towupper_l(ch, locale)
+                                                                          : std::towupper(ch));
+    }
+    return sourceLength;
+}
+
+
+inline int WideCharToMultiByte(
+    const UINT codePage,
+    [[maybe_unused]] const DWORD flags,
+    const LPCWSTR source,
+    const int sourceLength,
+    char* const dest,
+    const int destLength,
+    [[maybe_unused]] const char* defaultChar,
+    [[maybe_unused]] BOOL* usedDefaultChar) noexcept
+{
+    using namespace winreg::details;
+
+    if ((codePage != CP_UTF8) || (source == nullptr) || (sourceLength < -1))
+    {
+        return FailWithError(ERROR_INVALID_PARAMETER, 0);
+    }
+
+    try
+    {
+        // A length of -1 converts the terminating NUL too
+        const size_t length = (sourceLength == -1) ? (std::wcslen(source) + 1)
+                                                   : static_cast<size_t>(sourceLength);
+        const std::string utf8 = WideToUtf8(source, length);
+        if (utf8.length() > static_cast<size_t>((std::numeric_limits<int>::max)()))
+        {
+            return FailWithError(ERROR_ARITHMETIC_OVERFLOW, 0);
+        }
+
+        const int utf8Length = static_cast<int>(utf8.length());
+        if (destLength == 0)
+        {
+            return utf8Length;
+        }
+        if ((dest == nullptr) || (destLength < utf8Length))
+        {
+            return FailWithError(ERROR_INSUFFICIENT_BUFFER, 0);
+        }
+
+        std::memcpy(dest, utf8.data(), utf8.length());
+        return utf8Length;
+    }
+    catch (...)
+    {
+        return FailWithError(ERROR_NOT_ENOUGH_MEMORY, 0);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//                          Files
+//------------------------------------------------------------------------------
+
+inline HANDLE CreateFileW(
+    const LPCWSTR fileName,
+    const DWORD desiredAccess,
+    [[maybe_unused]] const DWORD shareMode,
+    [[maybe_unused]] SECURITY_ATTRIBUTES* securityAttributes,
+    const DWORD creationDisposition,
+    [[maybe_unused]] const DWORD flagsAndAttributes,
+    [[maybe_unused]] HANDLE templateFile) noexcept
+{
+    using namespace winreg::details;
+
+    if (fileName == nullptr)
+    {
+        return FailWithError(ERROR_INVALID_PARAMETER, INVALID_HANDLE_VALUE);
+    }
+
+    int flags = O_CLOEXEC;
+    const bool read = (desiredAccess & GENERIC_READ) != 0;
+    const bool write = (desiredAccess & GENERIC_WRITE) != 0;
+    flags |= (read && write) ? O_RDWR : (write ? O_WRONLY : O_RDONLY);
+
+    switch (creationDisposition)
+    {
+    case CREATE_NEW:        flags |= O_CREAT | O_EXCL;  break;
+    case CREATE_ALWAYS:     flags |= O_CREAT | O_TRUNC; break;
+    case OPEN_EXISTING:                                 break;
+    case OPEN_ALWAYS:       flags |= O_CREAT;           break;
+    case TRUNCATE_EXISTING: flags |= O_TRUNC;           break;
+    default:
+        return FailWithError(ERROR_INVALID_PARAMETER, INVALID_HANDLE_VALUE);
+    }
+
+    try
+    {
+        const std::string path = WideToUtf8(fileName, std::wcslen(fileName));
+        const int fd = ::open(path.c_str(), flags, 0644);
+        if (fd < 0)
+        {
+            return FailWithErrno(INVALID_HANDLE_VALUE);
+        }
+
+        try
+        {
+            return AddPosixHandle(std::make_shared<PosixFile>(fd));
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+    }
+    catch (...)
+    {
+        return FailWithError(ERROR_NOT_ENOUGH_MEMORY, INVALID_HANDLE_VALUE);
+    }
+}
+
+
+inline BOOL WriteFile(
+    const HANDLE fileHandle,
+    const LPCVOID buffer,
+    const DWORD bytesToWrite,
+    const LPDWORD bytesWritten,
+    [[maybe_unused]] void* overlapped) noexcept
+{
+    using namespace winreg::details;
+
+    const auto file = FindPosixHandle<PosixFile>(fileHandle);
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    ssize_t written = 0;
+    do
+    {
+        written = ::write(file->Fd, buffer, bytesToWrite);
+    } while ((written < 0) && (errno == EINTR));
+
+    if (written < 0)
+    {
+        return FailWithErrno(FALSE);
+    }
+    if (bytesWritten != nullptr)
+    {
+        *bytesWritten = static_cast<DWORD>(written);
+    }
+    return TRUE;
+}
+
+
+inline BOOL ReadFile(
+    const HANDLE fileHandle,
+    const LPVOID buffer,
+    const DWORD bytesToRead,
+    const LPDWORD bytesRead,
+    [[maybe_unused]] void* overlapped) noexcept
+{
+    using namespace winreg::details;
+
+    const auto file = FindPosixHandle<PosixFile>(fileHandle);
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    ssize_t read = 0;
+    do
+    {
+        read = ::read(file->Fd, buffer, bytesToRead);
+    } while ((read < 0) && (errno == EINTR));
+
+    if (read < 0)
+    {
+        return FailWithErrno(FALSE);
+    }
+    if (bytesRead != nullptr)
+    {
+        *bytesRead = static_cast<DWORD>(read);
+    }
+    return TRUE;
+}
+
+
+inline BOOL FlushFileBuffers(const HANDLE fileHandle) noexcept
+{
+    using namespace winreg::details;
+
+    const auto file = FindPosixHandle<PosixFile>(fileHandle);
+    if (!file)
+    {
+        return FALSE;
+    }
+    return (::fsync(file->Fd) == 0) ? TRUE : FailWithErrno(FALSE);
+}
+
+
+inline BOOL GetFileSizeEx(const HANDLE fileHandle, LARGE_INTEGER* const fileSize) noexcept
+{
+    using namespace winreg::details;
+
+    const auto file = FindPosixHandle<PosixFile>(fileHandle);
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    struct stat status{};
+    if (::fstat(file->Fd, &status) != 0)
+    {
+        return FailWithErrno(FALSE);
+    }
+    fileSize->QuadPart = static_cast<LONGLONG>(status.st_size);
+    return TRUE;
+}
+
+
+inline BOOL SetFilePointerEx(
+    const HANDLE fileHandle,
+    const LARGE_INTEGER distanceToMove,
+    LARGE_INTEGER* const newFilePointer,
+    const DWORD moveMethod) noexcept
+{
+    using namespace winreg::details;
+
+    const auto file = FindPosixHandle<PosixFile>(fileHandle);
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    const int whence = (moveMethod == FILE_BEGIN) ? SEEK_SET : ((moveMethod == FILE_CURRENT) ? SEEK_CUR : SEEK_END);
+    const off_t position = ::lseek(file->Fd, static_cast<off_t>(distanceToMove.QuadPart), whence);
+    if (position < 0)
+    {
+        return FailWithErrno(FALSE);
+    }
+    if (newFilePointer != nullptr)
+    {
+        newFilePointer->QuadPart = static_cast<LONGLONG>(position);
+    }
+    return TRUE;
+}
+
+
+inline BOOL SetEndOfFile(const HANDLE fileHandle) noexcept
+{
+    using namespace winreg::details;
+
+    const auto file = FindPosixHandle<PosixFile>(fileHandle);
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    const off_t position = ::lseek(file->Fd, 0, SEEK_CUR);
+    if ((position < 0) || (::ftruncate(file->Fd, position) != 0))
+    {
+        return FailWithErrno(FALSE);
+    }
+    return TRUE;
+}
+
+
+inline BOOL CloseHandle(const HANDLE handle) noexcept
+{
+    using namespace winreg::details;
+
+    // The object is destroyed out of the lock, when the last call using it returns
+    std::shared_ptr<PosixHandle> object;
+    {
+        PosixHandleTable& handles = GetPosixHandleTable();
+        std::lock_guard<std::mutex> lock{ handles.Mutex };
+        const auto it = handles.Objects.find(handle);
+        if (it == handles.Objects.end())
+        {
+            return FailWithError(ERROR_INVALID_HANDLE, FALSE);
+        }
+        object = std::move(it->second);
+        handles.Objects.erase(it);
+    }
+    return TRUE;
+}
+
+
+inline BOOL MoveFileExW(const LPCWSTR existingFileName, const LPCWSTR newFileName, const DWORD flags) noexcept
+{
+    using namespace winreg::details;
+
+    if ((existingFileName == nullptr) || (newFileName == nullptr))
+    {
+        return FailWithError(ERROR_INVALID_PARAMETER, FALSE);
+    }
+
+    try
+    {
+        const std::string source = WideToUtf8(existingFileName, std::wcslen(existingFileName));
+        const std::string dest = WideToUtf8(newFileName, std::wcslen(newFileName));
+
+        // rename replaces the destination: emulate the failure without
+        // MOVEFILE_REPLACE_EXISTING
+        struct stat status{};
+        if (((flags & MOVEFILE_REPLACE_EXISTING) == 0) && (::stat(dest.c_str(), &status) == 0))
+        {
+            return FailWithError(ERROR_ALREADY_EXISTS, FALSE);
+        }
+
+        if (::rename(source.c_str(), dest.c_str()) != 0)
+        {
+            return FailWithErrno(FALSE);
+        }
+
+        // Make the new directory entry durable before returning
+        if ((flags & MOVEFILE_WRITE_THROUGH) != 0)
+        {
+            const size_t separator = dest.rfind('/');
+            const std::string directory = (separator == std::string::npos) ? std::string{ "." }
+                : ((separator == 0) ? std::string{ "/" } : dest.substr(0, separator));
+            const int fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0)
+            {
+                ::fsync(fd);
+                ::close(fd);
+            }
+        }
+        return TRUE;
+    }
+    catch (...)
+    {
+        return FailWithError(ERROR_NOT_ENOUGH_MEMORY, FALSE);
+    }
+}
+
+
+inline BOOL DeleteFileW(const LPCWSTR fileName) noexcept
+{
+    using namespace winreg::details;
+
+    if (fileName == nullptr)
+    {
+        return FailWithError(ERROR_INVALID_PARAMETER, FALSE);
+    }
+
+    try
+    {
+        const std::string path = WideToUtf8(fileName, std::wcslen(fileName));
+        return (::unlink(path.c_str()) == 0) ? TRUE : FailWithErrno(FALSE);
+    }
+    catch (...)
+    {
+        return FailWithError(ERROR_NOT_ENOUGH_MEMORY, FALSE);
+    }
+}
+
+
+// Return $TMPDIR (or /tmp), with a trailing separator
+inline DWORD GetTempPathW(const DWORD bufferLength, const LPWSTR buffer) noexcept
+{
+    const char* directory = std::getenv("TMPDIR");
+    if ((directory == nullptr) || (*directory == '\0'))
+    {
+        directory = "/tmp";
+    }
+
+    const size_t length = std::strlen(directory);
+    const bool addSeparator = directory[length - 1] != '/';
+    const size_t pathLength = length + (addSeparator ? 1 : 0);
+    if (pathLength + 1 > bufferLength)
+    {
+        // Required size, including the terminator
+        return static_cast<DWORD>(pathLength + 1);
+    }
+
+    // Non-ASCII bytes are copied as they are
+    for (size_t i = 0; i < length; i++)
+    {
+        buffer[i] = static_cast<wchar_t>(static_cast<unsigned char>(directory[i]));
+    }
+    if (addSeparator)
+    {
+        buffer[length] = L'/';
+    }
+    buffer[pathLength] = L'\0';
+    return static_cast<DWORD>(pathLength);
+}
+
+
+//------------------------------------------------------------------------------
+//                          File Mappings
+//------------------------------------------------------------------------------
+
+inline HANDLE CreateFileMappingW(
+    const HANDLE fileHandle,
+    [[maybe_unused]] SECURITY_ATTRIBUTES* securityAttributes,
+    const DWORD protect,
+    const DWORD maximumSizeHigh,
+    const DWORD maximumSizeLow,
+    const LPCWSTR name) noexcept
+{
+    using namespace winreg::details;
+
+    // Only read-only mappings of a whole file are supported
+    if ((protect != PAGE_READONLY) || (maximumSizeHigh != 0) || (maximumSizeLow != 0) || (name != nullptr))
+    {
+        return FailWithError(ERROR_NOT_SUPPORTED, HANDLE{ nullptr });
+    }
+
+    const auto file = FindPosixHandle<PosixFile>(fileHandle);
+    if (!file)
+    {
+        return nullptr;
+    }
+
+    struct stat status{};
+    if (::fstat(file->Fd, &status) != 0)
+    {
+        return FailWithErrno(HANDLE{ nullptr });
+    }
+    if (status.st_size == 0)
+    {
+        // Like Windows, that can't map an empty file (ERROR_FILE_INVALID)
+        return FailWithError(ERROR_INVALID_DATA, HANDLE{ nullptr });
+    }
+
+    // The mapping keeps its own descriptor, so it outlives the file handle
+    const int fd = ::fcntl(file->Fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return FailWithErrno(HANDLE{ nullptr });
+    }
+
+    try
+    {
+        return AddPosixHandle(std::make_shared<PosixFileMapping>(fd, static_cast<size_t>(status.st_size)));
+    }
+    catch (...)
+    {
+        ::close(fd);
+        return FailWithError(ERROR_NOT_ENOUGH_MEMORY, HANDLE{ nullptr });
+    }
+}
+
+
+inline LPVOID MapViewOfFile(
+    const HANDLE mappingHandle,
+    const DWORD desiredAccess,
+    const DWORD fileOffsetHigh,
+    const DWORD fileOffsetLow,
+    const size_t bytesToMap) noexcept
+{
+    using namespace winreg::details;
+
+    const auto mapping = FindPosixHandle<PosixFileMapping>(mappingHandle);
+    if (!mapping)
+    {
+        return nullptr;
+    }
+
+    // Only whole-file read-only views are supported
+    if ((desiredAccess != FILE_MAP_READ) || (fileOffsetHigh != 0) || (fileOffsetLow != 0)
+        || ((bytesToMap != 0) && (bytesToMap != mapping->Size)))
+    {
+        return FailWithError(ERROR_NOT_SUPPORTED, LPVOID{ nullptr });
+    }
+
+    void* const view = ::mmap(nullptr, mapping->Size, PROT_READ, MAP_SHARED, mapping->Fd, 0);
+    if (view == MAP_FAILED)
+    {
+        return FailWithErrno(LPVOID{ nullptr });
+    }
+
+    try
+    {
+        PosixMappedViews& views = GetPosixMappedViews();
+        std::lock_guard<std::mutex> lock{ views.Mutex };
+        views.Lengths[view] = mapping->Size;
+    }
+    catch (...)
+    {
+        ::munmap(view, mapping->Size);
+        return FailWithError(ERROR_NOT_ENOUGH_MEMORY, LPVOID{ nullptr });
+    }
+    return view;
+}
+
+
+inline BOOL UnmapViewOfFile(const LPCVOID view) noexcept
+{
+    using namespace winreg::details;
+
+    size_t length = 0;
+    {
+        PosixMappedViews& views = GetPosixMappedViews();
+        std::lock_guard<std::mutex> lock{ views.Mutex };
+        const auto it = views.Lengths.find(view);
+        if (it == views.Lengths.end())
+        {
+            return FailWithError(ERROR_INVALID_PARAMETER, FALSE);
+        }
+        length = it->second;
+        views.Lengths.erase(it);
+    }
+
+    return (::munmap(const_cast<void*>(view), length) == 0) ? TRUE : FailWithErrno(FALSE);
+}
+
+
+//------------------------------------------------------------------------------
+//                          Events
+//------------------------------------------------------------------------------
+
+inline HANDLE CreateEventW(
+    [[maybe_unused]] SECURITY_ATTRIBUTES* securityAttributes,
+    const BOOL manualReset,
+    const BOOL initialState,
+    const LPCWSTR name) noexcept
+{
+    using namespace winreg::details;
+
+    if (name != nullptr)
+    {
+        return FailWithError(ERROR_NOT_SUPPORTED, HANDLE{ nullptr });
+    }
+
+    try
+    {
+        return AddPosixHandle(std::make_shared<PosixEvent>(manualReset != FALSE, initialState != FALSE));
+    }
+    catch (...)
+    {
+        return FailWithError(ERROR_NOT_ENOUGH_MEMORY, HANDLE{ nullptr });
+    }
+}
+
+
+inline BOOL SetEvent(const HANDLE eventHandle) noexcept
+{
+    const auto event = winreg::details::FindPosixHandle<winreg::details::PosixEvent>(eventHandle);
+    if (!event)
+    {
+        return FALSE;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ event->Mutex };
+        event->Signaled = true;
+    }
+
+    // An auto-reset event releases a single waiter
+    if (event->ManualReset)
+    {
+        event->Condition.notify_all();
+    }
+    else
+    {
+        event->Condition.notify_one();
+    }
+    return TRUE;
+}
+
+
+inline BOOL ResetEvent(const HANDLE eventHandle) noexcept
+{
+    const auto event = winreg::details::FindPosixHandle<winreg::details::PosixEvent>(eventHandle);
+    if (!event)
+    {
+        return FALSE;
+    }
+
+    std::lock_guard<std::mutex> lock{ event->Mutex };
+    event->Signaled = false;
+    return TRUE;
+}
+
+
+// Only events can be waited for
+inline DWORD WaitForSingleObject(const HANDLE handle, const DWORD milliseconds) noexcept
+{
+    const auto event = winreg::details::FindPosixHandle<winreg::details::PosixEvent>(handle);
+    if (!event)
+    {
+        return WAIT_FAILED;
+    }
+
+    std::unique_lock<std::mutex> lock{ event->Mutex };
+    const auto isSignaled = [&event] { return event->Signaled; };
+    if (milliseconds == INFINITE)
+    {
+        event->Condition.wait(lock, isSignaled);
+    }
+    else if (!event->Condition.wait_for(lock, std::chrono::milliseconds(milliseconds), isSignaled))
+    {
+        return WAIT_TIMEOUT;
+    }
+
+    if (!event->ManualReset)
+    {
+        event->Signaled = false;
+    }
+    return WAIT_OBJECT_0;
+}
+
+
+//------------------------------------------------------------------------------
+//                          Clocks and Identifiers
+//------------------------------------------------------------------------------
+
+// The counter is in nanoseconds, of a monotonic clock
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* const performanceCount) noexcept
+{
+    performanceCount->QuadPart = static_cast<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+    return TRUE;
+}
+
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* const frequency) noexcept
+{
+    frequency->QuadPart = 1000000000;
+    return TRUE;
+}
+
+
+inline ULONGLONG GetTickCount64() noexcept
+{
+    return static_cast<ULONGLONG>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+inline DWORD GetCurrentProcessId() noexcept
+{
+    return static_cast<DWORD>(::getpid());
+}
+
+
+inline DWORD GetCurrentThreadId() noexcept
+{
+#ifdef __linux__
+    return static_cast<DWORD>(::syscall(SYS_gettid));
+#else // __linux__
+    // A small per-thread number, unique while the process runs
+    static std::atomic<DWORD> s_nextThreadId{ 1 };
+    static thread_local const DWORD t_threadId = s_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    return t_threadId;
+#endif // __linux__
+}
+
+
+#endif // GIOVANNI_DICANIO_WINREG_WINREGPOSIX_HPP_INCLUDED
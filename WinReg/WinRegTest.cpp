@@ -11,22 +11,271 @@
 //
 //////////////////////////////////////////////////////////////////////////
 
+// Compile in the optional tracing and allocation accounting, to test them as well
+#define WINREG_ENABLE_TRACE
+#define WINREG_ENABLE_ALLOCATION_STATS
+
 #include "WinReg.hpp"   // Module to test
+#include "RegConcurrentTree.hpp"
+#include "RegLayeredView.hpp"
+#include "RegManifest.hpp"
+#include "RegMemoryBackend.hpp"
+#include "RegMap.hpp"
+#include "RegMappedTree.hpp"
+#include "RegNamePool.hpp"
+#include "RegPersistentTree.hpp"
+#include "RegRemoteServer.hpp"
+#include "RegRemoteSimulator.hpp"
+#include "RegStatistics.hpp"
+#include "RegTree.hpp"
+#include "RegTreeCloner.hpp"
+#include "RegVersionedTree.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <exception>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <cerrno>                   // errno
+#include <linux/perf_event.h>       // perf_event_attr
+#include <sys/ioctl.h>              // ioctl
+#include <sys/syscall.h>            // SYS_perf_event_open
+#include <unistd.h>                 // syscall, read, close
+#endif // __linux__
+
 
 using std::pair;
 using std::vector;
 using std::wcout;
 using std::wstring;
 
+using winreg::RegAllocationCategory;
+using winreg::RegAllocationStats;
+using winreg::RegBackendScope;
+using winreg::RegCancellationToken;
+using winreg::RegConcurrentTree;
+using winreg::RegConcurrentTreeBackend;
 using winreg::RegKey;
 using winreg::RegException;
 using winreg::RegExpected;
+using winreg::RegMultiStringSet;
+using winreg::RegNameList;
+using winreg::RegOperationLimits;
+using winreg::RegTree;
+using winreg::RegTreeBackend;
+using winreg::RegVersionedTree;
+using winreg::RegVersionedTreeBackend;
+using winreg::RegMappedTree;
+using winreg::RegJournalOptions;
+using winreg::RegPersistentTree;
+using winreg::RegPersistentTreeBackend;
+using winreg::RegRemoteClientBackend;
+using winreg::RegRemoteServer;
+using winreg::RegRemoteSimulator;
+using winreg::RegRemoteSimulatorBackend;
+using winreg::RegRemoteSimulatorOptions;
+using winreg::RegStatistics;
+using winreg::RegTrace;
+using winreg::RegTraceSpan;
+using winreg::StringComparison;
+
+
+//
+// Values loaded by the manifest test
+//
+constexpr winreg::RegManifestEntry kTestManifestEntries[] =
+{
+    { L"SOFTWARE\\GioTest", L"TestValueDword",       REG_DWORD },
+    { L"SOFTWARE\\GioTest", L"TestValueString",      REG_SZ },
+    { L"SOFTWARE\\GioTest", L"TestValueMultiString", REG_MULTI_SZ },
+};
+constexpr auto kTestManifest = winreg::MakeRegManifest(kTestManifestEntries);
+static_assert(kTestManifest.IndexOf(L"SOFTWARE\\GioTest", L"TestValueString") == 1);
+
+
+//
+// Files created by the tests, placed in the temporary directory and deleted
+// when this object goes out of scope, on every exit path
+//
+class TempTestFiles
+{
+public:
+    TempTestFiles()
+    {
+        wchar_t tempDirectory[MAX_PATH + 1]{};
+        const DWORD length = ::GetTempPathW(MAX_PATH + 1, tempDirectory);
+        if ((length == 0) || (length > MAX_PATH))
+        {
+            const LSTATUS error = (length == 0) ? static_cast<LSTATUS>(::GetLastError())
+                                                : ERROR_INSUFFICIENT_BUFFER;
+            throw RegException{ error, "GetTempPathW failed." };
+        }
+        m_directory.assign(tempDirectory, length);
+    }
+
+    ~TempTestFiles()
+    {
+        DeleteAll();
+    }
+
+    TempTestFiles(const TempTestFiles&) = delete;
+    TempTestFiles& operator=(const TempTestFiles&) = delete;
+
+    // Returns the full path of the given file in the temporary directory,
+    // deleting the files left there by a previous run
+    wstring Add(const wstring& fileName, const vector<wstring>& suffixes = { L"" })
+    {
+        const wstring path = m_directory + fileName;
+        for (const auto& suffix : suffixes)
+        {
+            m_paths.push_back(path + suffix);
+            ::DeleteFileW(m_paths.back().c_str());
+        }
+        return path;
+    }
+
+    void DeleteAll() noexcept
+    {
+        for (const auto& path : m_paths)
+        {
+            ::DeleteFileW(path.c_str());
+        }
+    }
+
+private:
+    wstring m_directory;
+    vector<wstring> m_paths;
+};
+
+
+//
+// A hardware event counter of the calling thread (e.g. cache misses), read
+// with perf_event_open on Linux. The counter may be unavailable: on other
+// systems, when perf_event_paranoid forbids it (EACCES), when there is no
+// such hardware event (ENOENT, e.g. in a VM), or on any other failure; the
+// benchmarks then print their timings without it.
+//
+class HardwareCounter
+{
+public:
+    enum class Event
+    {
+        CacheMisses,            // last level cache
+        L1DataReadMisses
+    };
+
+    explicit HardwareCounter([[maybe_unused]] const Event event)
+    {
+#ifdef __linux__
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        if (event == Event::CacheMisses)
+        {
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+        }
+        else
+        {
+            attributes.type = PERF_TYPE_HW_CACHE;
+            attributes.config = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        m_fd = static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        if (m_fd < 0)
+        {
+            const int error = errno;
+            if ((error == EACCES) || (error == EPERM))
+            {
+                m_unavailableReason = L"not permitted, see /proc/sys/kernel/perf_event_paranoid";
+            }
+            else if ((error == ENOENT) || (error == ENODEV) || (error == EOPNOTSUPP))
+            {
+                m_unavailableReason = L"no such hardware event";
+            }
+            else
+            {
+                m_unavailableReason = L"perf_event_open errno " + std::to_wstring(error);
+            }
+        }
+#endif // __linux__
+    }
+
+    ~HardwareCounter()
+    {
+#ifdef __linux__
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+#endif // __linux__
+    }
+
+    HardwareCounter(const HardwareCounter&) = delete;
+    HardwareCounter& operator=(const HardwareCounter&) = delete;
+
+    bool IsAvailable() const noexcept
+    {
+        return m_fd >= 0;
+    }
+
+    // Why the counter is unavailable
+    const wstring& UnavailableReason() const noexcept
+    {
+        return m_unavailableReason;
+    }
+
+    // Count from zero
+    void Start() noexcept
+    {
+#ifdef __linux__
+        if (m_fd >= 0)
+        {
+            ::ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ::ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif // __linux__
+    }
+
+    // Stop counting, and return the events counted since Start
+    // (0 if the counter is unavailable)
+    unsigned long long Stop() noexcept
+    {
+        unsigned long long count = 0;
+#ifdef __linux__
+        if (m_fd >= 0)
+        {
+            ::ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (::read(m_fd, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count)))
+            {
+                count = 0;
+            }
+        }
+#endif // __linux__
+        return count;
+    }
+
+private:
+    int m_fd{ -1 };
+    wstring m_unavailableReason{ L"perf_event_open is Linux only" };
+};
 
 
 //
@@ -59,6 +308,49 @@ void Test()
     }
     wcout << L'\n';
 
+    // Enumerate the same subkeys and values into flat name lists
+    RegNameList subKeyList;
+    key.EnumSubKeys(subKeyList);
+    if (subKeyList.ToVector() != subKeyNames)
+    {
+        wcout << L"RegKey::EnumSubKeys failed with RegNameList.\n";
+    }
+
+    RegNameList valueList;
+    key.EnumValues(valueList);
+    valueList.SortByName();
+    for (const auto& [valueName, valueType] : values)
+    {
+        const size_t index = valueList.Find(valueName);
+        if ((index == RegNameList::npos) || (valueList.Type(index) != valueType))
+        {
+            wcout << L"RegKey::EnumValues failed with RegNameList.\n";
+        }
+    }
+
+    // Enumerate with interned names: the same name is the same view
+    winreg::RegNamePool namePool;
+    const auto pooledValues = key.EnumValues(namePool);
+    const auto pooledValuesAgain = key.EnumValues(namePool);
+    if ((pooledValues.size() != values.size())
+        || (!pooledValues.empty() && (pooledValues[0].first.data() != pooledValuesAgain[0].first.data()))
+        || (key.EnumSubKeys(namePool).size() != subKeyNames.size())
+        || (namePool.Size() > values.size() + subKeyNames.size()))
+    {
+        wcout << L"RegKey::EnumValues failed with RegNamePool.\n";
+    }
+
+    // Interned names are case-insensitive, like registry names
+    const std::wstring_view parameters = namePool.Intern(L"Parameters");
+    if ((namePool.Intern(L"PARAMETERS").data() != parameters.data())
+        || (namePool.Find(L"parameters").data() != parameters.data())
+        || (parameters != L"Parameters")
+        || (namePool.Intern(L"Caf\u00E9").data() != namePool.Intern(L"CAF\u00C9").data())
+        || (namePool.Find(L"Parameter").data() != nullptr))
+    {
+        wcout << L"RegNamePool failed to intern names ignoring case.\n";
+    }
+
     key.Close();
 
 
@@ -241,6 +533,215 @@ void Test()
         wcout << L"RegKey::QueryValueType failed for REG_MULTI_SZ.\n";
     }
 
+    // Test the validating string getters: an embedded NUL and an unpaired surrogate
+    const wstring badUtf16 = wstring(L"Ciao") + L'\0' + L"Hi" + wchar_t{ 0xD800 };
+    key.SetStringValue(L"TestValueBadUtf16", badUtf16);
+
+    if ((key.GetStringValue(L"TestValueBadUtf16", winreg::RegStringValidation::None) != badUtf16)
+        || (key.GetStringValue(L"TestValueBadUtf16", winreg::RegStringValidation::Replace)
+            != L"Ciao\xFFFDHi\xFFFD")
+        || (key.GetStringValue(L"TestValueBadUtf16", winreg::RegStringValidation::TruncateAtNul)
+            != L"Ciao")
+        || (key.GetStringValue(L"TestValueString", winreg::RegStringValidation::Reject) != testSz))
+    {
+        wcout << L"RegKey::GetStringValue with validation failed.\n";
+    }
+
+    const auto rejectedString = key.TryGetStringValue(L"TestValueBadUtf16", winreg::RegStringValidation::Reject);
+    if (rejectedString || (rejectedString.GetError().Code() != ERROR_INVALID_DATA))
+    {
+        wcout << L"RegKey::TryGetStringValue failed to reject invalid UTF-16.\n";
+    }
+
+    key.DeleteValue(L"TestValueBadUtf16");
+
+    // Test RegMap: cached reads, and batched writes on Commit
+    {
+        winreg::RegMap<DWORD> dwordMap{ key };
+        if ((dwordMap[L"TestValueDword"] != testDw)
+            || !dwordMap.contains(L"testvaluedword")
+            || dwordMap.contains(L"TestValueString"))
+        {
+            wcout << L"RegMap lookup failed.\n";
+        }
+
+        dwordMap[L"TestMapDword"] = 42;
+        if (!dwordMap.IsDirty() || key.ContainsValue(L"TestMapDword"))
+        {
+            wcout << L"RegMap wrote before Commit.\n";
+        }
+
+        dwordMap.Commit();
+        if (key.GetDwordValue(L"TestMapDword") != 42)
+        {
+            wcout << L"RegMap::Commit failed.\n";
+        }
+
+        dwordMap.erase(L"TestMapDword");
+        dwordMap.Commit();
+        if (key.ContainsValue(L"TestMapDword"))
+        {
+            wcout << L"RegMap::erase failed.\n";
+        }
+
+        // Values written by others are seen after Refresh, also across a commit;
+        // our own committed values are not reported as changes
+        (void)dwordMap.begin();
+        key.SetDwordValue(L"TestMapOther", 7);
+        auto mapValue = dwordMap[std::wstring{ L"TestMapDword" }];
+        mapValue = 43;
+        dwordMap.Commit();
+        if (dwordMap.contains(L"TestMapOther")
+            || !dwordMap.Refresh()
+            || (dwordMap[L"TestMapOther"] != 7)
+            || (key.GetDwordValue(L"TestMapDword") != 43)
+            || dwordMap.Refresh())
+        {
+            wcout << L"RegMap::Refresh missed an outside change.\n";
+        }
+
+        // A value changed by others keeps its pending assignment
+        key.SetDwordValue(L"TestMapOther", 8);
+        dwordMap[L"TestMapDword"] = 44;
+        if (!dwordMap.Refresh() || (dwordMap[L"TestMapOther"] != 8) || (dwordMap[L"TestMapDword"] != 44))
+        {
+            wcout << L"RegMap::Refresh failed with pending changes.\n";
+        }
+
+        dwordMap.erase(L"TestMapDword");
+        dwordMap.erase(L"TestMapOther");
+        dwordMap.Commit();
+    }
+
+    // REG_EXPAND_SZ values are not part of a RegMap<wstring>,
+    // both for lookups and for iteration
+    key.SetExpandStringValue(L"TestMapExpand", L"%PATH%");
+    {
+        winreg::RegMap<wstring> stringMap{ key };
+        if (stringMap.contains(L"TestMapExpand") || !stringMap.contains(L"TestValueString"))
+        {
+            wcout << L"RegMap<wstring> lookup returned a REG_EXPAND_SZ value.\n";
+        }
+    }
+    {
+        winreg::RegMap<wstring> stringMap{ key };
+        bool foundExpand = false;
+        for (const auto& [valueName, value] : stringMap)
+        {
+            foundExpand = foundExpand || (valueName == L"TestMapExpand");
+        }
+        if (foundExpand)
+        {
+            wcout << L"RegMap<wstring> iteration returned a REG_EXPAND_SZ value.\n";
+        }
+    }
+    key.DeleteValue(L"TestMapExpand");
+
+    // Test the layered view: the first layer that has a value wins
+    RegKey{ key.Get(), L"TestLayerLow" }.SetDwordValue(L"Timeout", 10);
+    RegKey{ key.Get(), L"TestLayerLow" }.SetDwordValue(L"Retries", 3);
+    {
+        winreg::RegLayeredView layeredView{ {
+            { HKEY_CURRENT_USER, testSubKey + L"\\TestLayerHigh" },
+            { HKEY_CURRENT_USER, testSubKey + L"\\TestLayerLow" },
+        } };
+        if ((layeredView.GetValueOr<DWORD>(L"Timeout", 0) != 10)
+            || (layeredView.GetValueOr<DWORD>(L"Missing", 42) != 42))
+        {
+            wcout << L"RegLayeredView lookup failed.\n";
+        }
+
+        RegKey{ key.Get(), L"TestLayerHigh" }.SetDwordValue(L"Timeout", 20);
+        if (!layeredView.Refresh()
+            || (layeredView.GetValueOr<DWORD>(L"Timeout", 0) != 20)
+            || (layeredView.EnumValues().size() != 2)
+            || (layeredView.EnumValues(1).size() != 1))
+        {
+            wcout << L"RegLayeredView::Refresh failed.\n";
+        }
+
+        // Changes are seen right away, even within the same timer tick;
+        // without changes, nothing is read again
+        RegKey{ key.Get(), L"TestLayerLow" }.SetDwordValue(L"Retries", 4);
+        if (!layeredView.Refresh()
+            || (layeredView.GetValueOr<DWORD>(L"Retries", 0) != 4)
+            || layeredView.Refresh())
+        {
+            wcout << L"RegLayeredView::Refresh missed a change.\n";
+        }
+    }
+    key.DeleteTree(L"TestLayerHigh");
+    key.DeleteTree(L"TestLayerLow");
+
+    RegMultiStringSet multiSzSet{ StringComparison::IgnoreCase };
+    multiSzSet.Load(key, L"TestValueMultiString");
+    if ((multiSzSet.Size() != testMultiSz.size())
+        || !multiSzSet.Contains(L"hello")
+        || (multiSzSet.Count(L"CIAO") != 1)
+        || multiSzSet.Contains(L"Hola"))
+    {
+        wcout << L"RegMultiStringSet membership queries failed.\n";
+    }
+
+    if (multiSzSet.CountWithPrefix(L"H") != 2)
+    {
+        wcout << L"RegMultiStringSet::CountWithPrefix failed.\n";
+    }
+
+    // Case-insensitive queries longer than the folding buffer, and non-ASCII characters
+    key.SetMultiStringValue(L"TestValueFoldedSet", { wstring(100, L'x') + L"\u00E9", L"Caf\u00E9" });
+    RegMultiStringSet foldedSet{ StringComparison::IgnoreCase };
+    foldedSet.Load(key, L"TestValueFoldedSet");
+    if (!foldedSet.Contains(wstring(100, L'X') + L"\u00C9")
+        || foldedSet.Contains(wstring(101, L'X'))
+        || (foldedSet.Count(L"CAF\u00C9") != 1)
+        || (foldedSet.CountWithPrefix(L"cAf") != 1))
+    {
+        wcout << L"RegMultiStringSet case-insensitive queries failed.\n";
+    }
+    key.DeleteValue(L"TestValueFoldedSet");
+
+    // Test the in-place multi-string edits
+    winreg::MultiStringEditOptions dedupeOptions;
+    dedupeOptions.Dedupe = true;
+
+    key.AppendToMultiString(L"TestValueMultiString", L"Hola");
+    if (key.AppendToMultiString(L"TestValueMultiString", L"Hola", dedupeOptions))
+    {
+        wcout << L"RegKey::AppendToMultiString failed to dedupe.\n";
+    }
+
+    if (key.ReplaceInMultiString(L"TestValueMultiString", L"Hola", L"Salut") != 1)
+    {
+        wcout << L"RegKey::ReplaceInMultiString failed.\n";
+    }
+
+    if ((key.RemoveFromMultiString(L"TestValueMultiString", L"Salut") != 1)
+        || (key.GetMultiStringValue(L"TestValueMultiString") != testMultiSz))
+    {
+        wcout << L"RegKey::RemoveFromMultiString failed.\n";
+    }
+
+    // Empty strings are kept next to other strings, but a multi-string
+    // holding just one empty string can't be told apart from the empty one
+    vector<wstring> multiSzWithEmpty = testMultiSz;
+    multiSzWithEmpty.emplace_back();
+    if (!key.AppendToMultiString(L"TestValueMultiString", L"")
+        || (key.GetMultiStringValue(L"TestValueMultiString") != multiSzWithEmpty)
+        || (key.RemoveFromMultiString(L"TestValueMultiString", L"") != 1)
+        || (key.GetMultiStringValue(L"TestValueMultiString") != testMultiSz))
+    {
+        wcout << L"RegKey::AppendToMultiString failed with an empty string.\n";
+    }
+
+    key.SetMultiStringValue(L"TestValueEmptyMultiString", {});
+    if (key.TryAppendToMultiString(L"TestValueEmptyMultiString", L"").GetError().Code()
+        != ERROR_INVALID_PARAMETER)
+    {
+        wcout << L"RegKey::TryAppendToMultiString accepted a lone empty string.\n";
+    }
+    key.DeleteValue(L"TestValueEmptyMultiString");
+
     vector<BYTE> testBinary1 = key.GetBinaryValue(L"TestValueBinary");
     if (testBinary1 != testBinary)
     {
@@ -265,6 +766,30 @@ void Test()
         wcout << L"RegKey::QueryValueType failed for REG_BINARY.\n";
     }
 
+    // Test typed access to arrays of records stored as binary data
+    struct TestRecord
+    {
+        DWORD Id;
+        ULONGLONG Mask;
+    };
+    const vector<TestRecord> testRecords = { { 1, 0xFF00 }, { 2, 0x00FF } };
+
+    key.SetBinaryValueAs(L"TestValueBinaryRecords", testRecords);
+    const auto records = key.GetBinaryValueAs<TestRecord>(L"TestValueBinaryRecords");
+    if ((records.Size() != testRecords.size())
+        || (records[1].Id != 2)
+        || (records[1].Mask != 0x00FF))
+    {
+        wcout << L"RegKey::GetBinaryValueAs failed.\n";
+    }
+
+    // The binary data size is not a multiple of the record size
+    if (key.TryGetBinaryValueAs<TestRecord>(L"TestValueBinary"))
+    {
+        wcout << L"RegKey::TryGetBinaryValueAs failed to reject invalid data.\n";
+    }
+    key.DeleteValue(L"TestValueBinaryRecords");
+
     // Test the special case of zero-length binary array
     vector<BYTE> testEmptyBinary1 = key.GetBinaryValue(L"TestEmptyBinary");
     if (testEmptyBinary1 != testEmptyBinary)
@@ -285,6 +810,47 @@ void Test()
     }
 
 
+    //
+    // Test path-addressed reads and writes
+    //
+
+    if (winreg::GetDwordValue(HKEY_CURRENT_USER, testSubKey, L"TestValueDword") != testDw)
+    {
+        wcout << L"winreg::GetDwordValue failed.\n";
+    }
+
+    if (winreg::TryGetMultiStringValue(HKEY_CURRENT_USER, testSubKey, L"TestValueMultiString")
+            .GetValue() != testMultiSz)
+    {
+        wcout << L"winreg::TryGetMultiStringValue failed.\n";
+    }
+
+    key.SetStringValue(L"SubKey1", L"TestPathValueString", testSz);
+    if ((key.GetStringValue(L"SubKey1", L"TestPathValueString") != testSz)
+        || key.TryGetStringValue(L"SubKey1", L"Value_That_Does_NOT_Exist").IsValid())
+    {
+        wcout << L"RegKey::GetStringValue failed with a subkey path.\n";
+    }
+    RegKey{ key.Get(), L"SubKey1" }.DeleteValue(L"TestPathValueString");
+
+    // Test bulk loading of the values declared in a compile-time manifest
+    winreg::RegManifestValues<kTestManifest> manifestValues;
+    manifestValues.Load(HKEY_CURRENT_USER);
+    if ((manifestValues.Get<kTestManifest.IndexOf(L"SOFTWARE\\GioTest", L"TestValueDword")>() != testDw)
+        || (manifestValues.Get<1>() != testSz)
+        || (manifestValues.Get<2>() != testMultiSz))
+    {
+        wcout << L"RegManifestValues::Load failed.\n";
+    }
+
+    winreg::RegManifestValues<kTestManifest> manifestValues32;
+    if (manifestValues32.TryLoad(HKEY_CURRENT_USER, KEY_WOW64_32KEY).Failed()
+        || (manifestValues32.Get<1>() != testSz))
+    {
+        wcout << L"RegManifestValues::TryLoad with a registry view failed.\n";
+    }
+
+
     //
     // Test the ContainsValue and ContainsSubKey methods
     //
@@ -319,37 +885,1482 @@ void Test()
 
 
     //
-    // Remove some test values
+    // Test in-memory tree snapshots
     //
 
-    key.DeleteValue(L"TestValueDword");
-    key.DeleteValue(L"TestValueQword");
-    key.DeleteValue(L"TestValueString");
-    key.DeleteValue(L"TestValueExpandString");
-    key.DeleteValue(L"TestValueMultiString");
-    key.DeleteValue(L"TestValueBinary");
+    const RegTree tree = RegTree::FromKey(key);
+    if ((tree.FindValue(L"", L"TestValueDword") == nullptr) || !tree.ContainsKey(L"SubKey1"))
+    {
+        wcout << L"RegTree::FromKey failed.\n";
+    }
+    if (!RegTree::Diff(tree, RegTree::FromKey(key, RegOperationLimits{}, KEY_WOW64_32KEY)).empty())
+    {
+        wcout << L"RegTree::FromKey with a registry view failed.\n";
+    }
 
-    key.DeleteValue(L"TestTryValueDword");
-    key.DeleteValue(L"TestTryValueQword");
-    key.DeleteValue(L"TestTryValueString");
-    key.DeleteValue(L"TestTryValueExpandString");
-    key.DeleteValue(L"TestTryValueMultiString");
-    key.DeleteValue(L"TestTryValueBinary");
-}
+    RegTree modifiedTree = tree;
+    modifiedTree.DeleteValue(L"", L"TestValueDword");
+    modifiedTree.CreateKey(L"SubKey1\\NewSubKey");
 
+    const auto differences = RegTree::Diff(tree, modifiedTree);
+    if ((differences.size() != 2)
+        || (tree.FindValue(L"", L"TestValueDword") == nullptr)
+        || (tree.FindKey(L"SubKey2") != modifiedTree.FindKey(L"SubKey2")))
+    {
+        wcout << L"RegTree snapshot update or diff failed.\n";
+    }
 
-int main()
-{
-    const int kExitOk = 0;
-    const int kExitError = 1;
+    // Moving a subtree relinks it, without copying it (even with a new name)
+    RegTree movedTree = tree;
+    const RegTree::Node* const movedNode = movedTree.FindKey(L"SubKey2");
+    if (!movedTree.MoveKey(L"SubKey2", L"SubKey1\\Moved")
+        || (movedTree.FindKey(L"SubKey1\\Moved") != movedNode)
+        || movedTree.ContainsKey(L"SubKey2")
+        || !tree.ContainsKey(L"SubKey2")
+        || !movedTree.RenameKey(L"SubKey1\\Moved", L"Renamed")
+        || !movedTree.ContainsKey(L"SubKey1\\Renamed"))
+    {
+        wcout << L"RegTree::MoveKey failed.\n";
+    }
 
-    try
+    // Names longer than the inline storage, values larger than an arena chunk,
+    // and values that outlive their tree
+    RegTree::ValuePtr keptValue;
     {
-        wcout << L"=========================================\n";
-        wcout << L"*** Testing Giovanni Dicanio's WinReg ***\n";
-        wcout << L"=========================================\n\n";
+        const wstring longName = L"{1B2C3D4E-5F60-7182-93A4-B5C6D7E8F901}";
+        const vector<BYTE> largeData(100 * 1024, 0x5A);
+        RegTree arenaTree;
+        for (int index = 0; index < 1000; index++)
+        {
+            const DWORD data = static_cast<DWORD>(index);
+            arenaTree.SetValue(longName + L"\\Key" + std::to_wstring(index % 10),
+                               L"Value" + std::to_wstring(index), REG_DWORD,
+                               reinterpret_cast<const BYTE*>(&data), sizeof(data));
+        }
+        arenaTree.SetValue(longName, longName, REG_BINARY, largeData);
+        arenaTree.RenameKey(longName + L"\\Key1", longName + L"Renamed");
+
+        const RegTree::Node* const longKey = arenaTree.FindKey(longName);
+        const RegTree::Value* const largeValue = arenaTree.FindValue(longName, longName);
+        const RegTree::Value* const dwordValue = arenaTree.FindValue(longName + L"\\Key7", L"value997");
+        if ((longKey == nullptr)
+            || (longKey->SubKeys.size() != 10)
+            || (arenaTree.FindKey(longName + L"\\" + longName + L"Renamed") == nullptr)
+            || (largeValue == nullptr)
+            || (vector<BYTE>(largeValue->Data, largeValue->Data + largeValue->DataSize) != largeData)
+            || (dwordValue == nullptr)
+            || (dwordValue->Name != L"Value997")
+            || (*reinterpret_cast<const DWORD*>(dwordValue->Data) != 997))
+        {
+            wcout << L"RegTree arena storage failed.\n";
+        }
+
+        keptValue = arenaTree.FindKey(longName + L"\\Key3")->Values.front();
+    }
+    if ((keptValue->Name != L"Value103") || (keptValue->DataSize != sizeof(DWORD)))
+    {
+        wcout << L"RegTree::ValuePtr didn't keep its value alive.\n";
+    }
+
+    // Test multi-version commits with conflict detection
+    RegVersionedTree versionedTree{ tree };
+    const RegTree baseVersion = versionedTree.Snapshot();
+    if (!versionedTree.TryCommit(baseVersion, modifiedTree)
+        || versionedTree.TryCommit(baseVersion, modifiedTree)
+        || (versionedTree.CurrentVersion() != 1))
+    {
+        wcout << L"RegVersionedTree::TryCommit failed.\n";
+    }
+
+    versionedTree.Update([](RegTree& t) { t.CreateKey(L"SubKey2\\Updated"); });
+    if (!versionedTree.Snapshot().ContainsKey(L"SubKey2\\Updated")
+        || baseVersion.ContainsKey(L"SubKey2\\Updated"))
+    {
+        wcout << L"RegVersionedTree::Update failed.\n";
+    }
+
+    // Writers of different keys don't conflict: the second commit is rebased
+    const RegTree sharedBase = versionedTree.Snapshot();
+    RegTree firstWriter = sharedBase;
+    RegTree secondWriter = sharedBase;
+    RegTree thirdWriter = sharedBase;
+    firstWriter.SetValue(L"SubKey1", L"First", REG_DWORD, vector<BYTE>(sizeof(DWORD)));
+    secondWriter.SetValue(L"SubKey2", L"Second", REG_DWORD, vector<BYTE>(sizeof(DWORD)));
+    thirdWriter.SetValue(L"SubKey1", L"Third", REG_DWORD, vector<BYTE>(sizeof(DWORD)));
+    if (!versionedTree.TryCommit(sharedBase, firstWriter)
+        || !versionedTree.TryCommit(sharedBase, secondWriter)
+        || versionedTree.TryCommit(sharedBase, thirdWriter)
+        || !versionedTree.Snapshot().FindValue(L"SubKey1", L"First")
+        || !versionedTree.Snapshot().FindValue(L"SubKey2", L"Second")
+        || versionedTree.Snapshot().FindValue(L"SubKey1", L"Third"))
+    {
+        wcout << L"RegVersionedTree::TryCommit with per-key conflicts failed.\n";
+    }
+
+    // The versions replaced while a reader uses them are reclaimed after it leaves
+    const bool readerKeptItsVersion = versionedTree.Read([&versionedTree](const RegTree& readTree) {
+        for (DWORD index = 0; index < 3; index++)
+        {
+            versionedTree.Update([index](RegTree& t) {
+                t.SetValue(L"SubKey1", L"Reclaimed", REG_DWORD,
+                    vector<BYTE>(reinterpret_cast<const BYTE*>(&index),
+                                 reinterpret_cast<const BYTE*>(&index) + sizeof(index)));
+            });
+        }
+        return (versionedTree.RetiredVersionCount() >= 3)
+            && !readTree.FindValue(L"SubKey1", L"Reclaimed");
+    });
+    versionedTree.Update([](RegTree& t) { (void)t.DeleteValue(L"SubKey1", L"Reclaimed"); });
+    if (!readerKeptItsVersion || (versionedTree.RetiredVersionCount() > 1))
+    {
+        wcout << L"RegVersionedTree epoch-based reclamation failed.\n";
+    }
+
+    // Test write-ahead logged persistence, with recovery from the log and from a checkpoint
+    TempTestFiles tempFiles;
+    const wstring journalPath = tempFiles.Add(L"WinRegTestJournal",
+        { L".log", L".checkpoint", L".checkpoint.tmp" });
+    {
+        RegPersistentTree persistentTree;
+        persistentTree.Open(journalPath);
+        persistentTree.SetValue(L"SubKey1", L"Logged", REG_DWORD, { 1, 0, 0, 0 });
+        persistentTree.CreateKey(L"SubKey2\\Empty");
+    }
+    {
+        RegPersistentTree persistentTree;
+        persistentTree.Open(journalPath);
+        if ((persistentTree.Snapshot().FindValue(L"SubKey1", L"Logged") == nullptr)
+            || !persistentTree.Snapshot().ContainsKey(L"SubKey2\\Empty"))
+        {
+            wcout << L"RegPersistentTree log replay failed.\n";
+        }
+
+        persistentTree.Checkpoint();
+        persistentTree.DeleteTree(L"SubKey2");
+    }
+    {
+        RegPersistentTree persistentTree;
+        persistentTree.Open(journalPath);
+        if ((persistentTree.Snapshot().FindValue(L"SubKey1", L"Logged") == nullptr)
+            || persistentTree.Snapshot().ContainsKey(L"SubKey2"))
+        {
+            wcout << L"RegPersistentTree checkpoint recovery failed.\n";
+        }
+
+        persistentTree.RenameKey(L"SubKey1", L"Renamed");
+    }
+    {
+        RegPersistentTree persistentTree;
+        persistentTree.Open(journalPath);
+        if ((persistentTree.Snapshot().FindValue(L"Renamed", L"Logged") == nullptr)
+            || persistentTree.Snapshot().ContainsKey(L"SubKey1")
+            || (persistentTree.TryRenameKey(L"SubKey1", L"Other").Code() != ERROR_FILE_NOT_FOUND))
+        {
+            wcout << L"RegPersistentTree rename replay failed.\n";
+        }
+    }
+
+    // Test the memory-mapped store
+    const wstring storePath = tempFiles.Add(L"WinRegTestStore", { L"", L".tmp" });
+    RegMappedTree::Write(tree, storePath);
+    {
+        RegMappedTree mappedTree;
+        mappedTree.Open(storePath);
+
+        RegMappedTree::Value mappedValue;
+        if (!mappedTree.FindValue(L"", L"testvaluedword", mappedValue)
+            || (mappedValue.Type != REG_DWORD)
+            || !mappedTree.ContainsKey(L"SubKey1")
+            || !RegTree::Diff(tree, mappedTree.ToTree()).empty())
+        {
+            wcout << L"RegMappedTree lookup failed.\n";
+        }
+    }
+
+    // An entry claiming huge name lengths must be rejected, not read past the mapping
+    {
+        RegTree hugeNamesTree;
+        hugeNamesTree.CreateKey(L"HugeNames");
+        RegMappedTree::Write(hugeNamesTree, storePath);
+
+        std::fstream storeFile{ std::filesystem::path{ storePath },
+                                std::ios::in | std::ios::out | std::ios::binary };
+        const std::string storeBytes{ std::istreambuf_iterator<char>{ storeFile },
+                                      std::istreambuf_iterator<char>{} };
+        const wstring hugeName = L"HugeNames";
+        const size_t namePos = storeBytes.find(std::string(
+            reinterpret_cast<const char*>(hugeName.data()), hugeName.length() * sizeof(wchar_t)));
+
+        // The entry header (six 32-bit fields: Kind, KeyPathLength, ValueNameLength, ...)
+        // precedes the key path; a length of 2^31 wchar_ts wraps a 32-bit size to zero
+        const std::uint32_t hugeLength = 0x80000000;
+        storeFile.seekp(static_cast<std::streamoff>(namePos - 5 * sizeof(std::uint32_t)));
+        storeFile.write(reinterpret_cast<const char*>(&hugeLength), sizeof(hugeLength));
+        storeFile.close();
+
+        RegMappedTree mappedTree;
+        mappedTree.Open(storePath);
+        try
+        {
+            (void)mappedTree.ContainsKey(L"HugeNames");
+            wcout << L"RegMappedTree accepted an entry with huge name lengths.\n";
+        }
+        catch (const RegException& e)
+        {
+            if (e.code().value() != ERROR_BADDB)
+            {
+                wcout << L"RegMappedTree failed with the wrong error on huge name lengths.\n";
+            }
+        }
+    }
+    tempFiles.DeleteAll();
+
+    // Test subtree statistics, on the live key and on its snapshot
+    const RegStatistics keyStatistics = RegStatistics::Analyze(key);
+    const RegStatistics treeStatistics = RegStatistics::Analyze(tree);
+    if ((keyStatistics.KeyCount() != treeStatistics.KeyCount())
+        || (keyStatistics.ValueCount() != treeStatistics.ValueCount())
+        || keyStatistics.LargestValues().empty()
+        || keyStatistics.ToJson().empty())
+    {
+        wcout << L"RegStatistics::Analyze failed.\n";
+    }
+
+    winreg::RegStatisticsOptions statisticsOptions;
+    statisticsOptions.RegistryView = KEY_WOW64_32KEY;
+    if (RegStatistics::Analyze(key, statisticsOptions).KeyCount() != keyStatistics.KeyCount())
+    {
+        wcout << L"RegStatistics::Analyze with a registry view failed.\n";
+    }
+
+    // Test streaming clones, into an in-memory tree and into a live key
+    RegTree clonedTree;
+    const auto cloneStatistics = winreg::RegTreeCloner::Clone(key, clonedTree);
+    if (!RegTree::Diff(RegTree::FromKey(key), clonedTree).empty()
+        || (cloneStatistics.KeyCount != keyStatistics.KeyCount()))
+    {
+        wcout << L"RegTreeCloner::Clone failed with a RegTree.\n";
+    }
+    {
+        RegKey cloneKey{ HKEY_CURRENT_USER, L"SOFTWARE\\GioTestClone" };
+        winreg::RegKeyTreeWriter cloneWriter{ cloneKey, KEY_WOW64_64KEY };
+        winreg::RegCloneOptions cloneOptions;
+        cloneOptions.MaxQueuedBytes = 4096;
+        cloneOptions.RegistryView = KEY_WOW64_32KEY;
+        winreg::RegTreeCloner::Clone(key, cloneWriter, cloneOptions);
+        if (!RegTree::Diff(RegTree::FromKey(cloneKey), clonedTree).empty())
+        {
+            wcout << L"RegTreeCloner::Clone failed with a RegKeyTreeWriter.\n";
+        }
+    }
+    RegKey{ HKEY_CURRENT_USER, L"SOFTWARE" }.DeleteTree(L"GioTestClone");
+
+    // Test cancellation and deadlines of subtree operations
+    RegCancellationToken cancellation;
+    RegOperationLimits limits;
+    limits.Cancellation = &cancellation;
+
+    RegKey copyKey{ key.Get(), L"CopyOfSubKey1" };
+    key.CopyTree(L"SubKey1", copyKey, limits);
+    if (!RegTree::Diff(RegTree::FromKey(RegKey{ key.Get(), L"SubKey1" }), RegTree::FromKey(copyKey)).empty())
+    {
+        wcout << L"RegKey::CopyTree with limits failed.\n";
+    }
+    copyKey.Close();
+
+    cancellation.Cancel();
+    if (key.TryEnumSubKeys(limits).IsValid()
+        || !key.TryDeleteTree(L"CopyOfSubKey1", limits).IsCancelled()
+        || !key.ContainsSubKey(L"CopyOfSubKey1"))
+    {
+        wcout << L"Cancellation of RegKey operations failed.\n";
+    }
+
+    limits.Cancellation = nullptr;
+    limits.Deadline = std::chrono::steady_clock::now();
+    if (RegTree::TryFromKey(key, limits).IsValid())
+    {
+        wcout << L"Deadline of RegTree::TryFromKey failed.\n";
+    }
+
+    limits.Deadline = std::chrono::steady_clock::now() + std::chrono::minutes(1);
+    key.DeleteTree(L"CopyOfSubKey1", limits);
+    if (key.ContainsSubKey(L"CopyOfSubKey1"))
+    {
+        wcout << L"RegKey::DeleteTree with limits failed.\n";
+    }
+
+    // Test tracing of the registry calls
+    RegTrace::Enable();
+    const DWORD tracedDword = key.GetDwordValue(L"TestValueDword");
+    RegTrace::Disable();
+    const vector<RegTraceSpan> spans = RegTrace::CollectSpans();
+    if ((tracedDword != testDw)
+        || std::none_of(spans.begin(), spans.end(), [](const RegTraceSpan& span) {
+               return (std::string{ span.Api } == "RegGetValueW")
+                   && (span.ValueName == L"TestValueDword")
+                   && (span.Bytes == sizeof(DWORD));
+           })
+        || RegTrace::ToChromeTraceJson(spans).empty())
+    {
+        wcout << L"RegTrace failed.\n";
+    }
+    RegTrace::Clear();
+
+    // Keys opened while tracing keep their paths when tracing is enabled again,
+    // and enumeration spans report the path of the enumerated key
+    RegTrace::Enable();
+    {
+        RegKey tracedKey{ HKEY_CURRENT_USER, testSubKey, KEY_READ };
+        RegTrace::Enable();
+        RegTrace::Clear();
+        const vector<wstring> tracedSubKeys = tracedKey.EnumSubKeys();
+        RegTrace::Disable();
+        const vector<RegTraceSpan> enumSpans = RegTrace::CollectSpans();
+        if (std::none_of(enumSpans.begin(), enumSpans.end(), [](const RegTraceSpan& span) {
+                return (std::string{ span.Api } == "RegEnumKeyExW")
+                    && (span.KeyPath == L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest");
+            })
+            || tracedSubKeys.empty())
+        {
+            wcout << L"RegTrace key path of RegEnumKeyExW failed.\n";
+        }
+    }
+    RegTrace::Clear();
+
+    // Test allocation accounting: reading a string value is accounted,
+    // and enumerating into a reused RegNameList doesn't allocate
+    RegAllocationStats::Reset();
+    const wstring accountedSz = key.GetStringValue(L"TestValueString");
+    RegNameList reusedValueList;
+    key.EnumValues(reusedValueList);
+    try
+    {
+        RegAllocationStats::ExpectAtMost(0, [&] { key.EnumValues(reusedValueList); });
+    }
+    catch (const RegException&)
+    {
+        wcout << L"RegAllocationStats::ExpectAtMost failed with a reused RegNameList.\n";
+    }
+    if ((accountedSz != testSz)
+        || (RegAllocationStats::Get(RegAllocationCategory::Enumeration).Allocations == 0)
+        || (RegAllocationStats::GetTotal().Allocations < RegAllocationStats::GetForCurrentThread(
+                RegAllocationCategory::Enumeration).Allocations))
+    {
+        wcout << L"RegAllocationStats failed.\n";
+    }
+
+    // Test the sharded in-memory store, with concurrent writers on different keys,
+    // setting the change handler while they run
+    RegConcurrentTree concurrentTree;
+    std::atomic<int> changeCount{ 0 };
+    {
+        vector<std::thread> writers;
+        for (DWORD writerIndex = 0; writerIndex < 4; writerIndex++)
+        {
+            writers.emplace_back([&concurrentTree, writerIndex] {
+                const wstring keyPath = L"Writers\\Writer" + std::to_wstring(writerIndex);
+                for (DWORD index = 0; index < 100; index++)
+                {
+                    concurrentTree.SetValue(keyPath, L"Counter", REG_DWORD,
+                        vector<BYTE>(reinterpret_cast<const BYTE*>(&index),
+                                     reinterpret_cast<const BYTE*>(&index) + sizeof(index)));
+                }
+            });
+        }
+        concurrentTree.SetChangeHandler([&changeCount](std::wstring_view, bool) { changeCount++; });
+        for (auto& writer : writers)
+        {
+            writer.join();
+        }
+    }
+    const int changeCountBeforeDelete = changeCount;
+    if ((concurrentTree.EnumSubKeys(L"writers").size() != 4)
+        || !concurrentTree.FindValue(L"Writers\\Writer2", L"counter")
+        || !concurrentTree.DeleteTree(L"Writers\\Writer0")
+        || (changeCount != changeCountBeforeDelete + 1)
+        || concurrentTree.ContainsKey(L"Writers\\Writer0")
+        || (concurrentTree.KeyCount() != 5)
+        || !concurrentTree.ToTree().ContainsKey(L"Writers\\Writer3"))
+    {
+        wcout << L"RegConcurrentTree failed.\n";
+    }
+
+    // Renames copy the subtree under the new name; the shards grow with the keys
+    concurrentTree.SetValue(L"Writers\\Writer1\\Inner", L"Deep", REG_DWORD, vector<BYTE>(sizeof(DWORD)));
+    for (int index = 0; index < 1000; index++)
+    {
+        concurrentTree.CreateKey(L"Many\\Key" + std::to_wstring(index));
+    }
+    if (!concurrentTree.RenameKey(L"Writers\\Writer1", L"Renamed")
+        || concurrentTree.RenameKey(L"Writers\\Renamed", L"Writer2")
+        || !concurrentTree.RenameKey(L"Writers\\Renamed", L"RENAMED")
+        || concurrentTree.ContainsKey(L"Writers\\Writer1")
+        || !concurrentTree.FindValue(L"Writers\\renamed\\Inner", L"Deep")
+        || (concurrentTree.EnumSubKeys(L"Writers") != vector<wstring>{ L"RENAMED", L"Writer2", L"Writer3" })
+        || (concurrentTree.KeyCount() != 1007)
+        || !concurrentTree.ContainsKey(L"Many\\Key999"))
+    {
+        wcout << L"RegConcurrentTree::RenameKey failed.\n";
+    }
+
+    // Test the simulated remote registry: one batched read instead of many round trips
+    RegRemoteSimulatorOptions remoteOptions;
+    remoteOptions.RoundTripLatency = std::chrono::microseconds(100);
+    RegRemoteSimulator remote{ remoteOptions };
+    remote.Tree().SetValue(L"Remote", L"First", REG_DWORD, vector<BYTE>(sizeof(DWORD)));
+    remote.Tree().SetValue(L"Remote", L"Second", REG_DWORD, vector<BYTE>(sizeof(DWORD)));
+    const auto remoteValues = remote.TryGetValues(L"Remote", { L"First", L"Second", L"Missing" });
+    if (!remoteValues.IsValid()
+        || (remoteValues.GetValue().size() != 3)
+        || (remoteValues.GetValue()[2] != nullptr)
+        || (remote.Statistics().Requests != 1)
+        || (remote.TryWaitForChange(L"Remote", true, std::chrono::milliseconds(1)).Code() != ERROR_TIMEOUT))
+    {
+        wcout << L"RegRemoteSimulator failed.\n";
+    }
+
+    // Changes made directly on the tree wake the waiters too, and deleting
+    // a key wakes the waiters on its subkeys
+    remote.Tree().CreateKey(L"Remote\\Watched");
+    {
+        std::thread remoteWriter([&remote] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            remote.Tree().DeleteTree(L"Remote");
+        });
+        const winreg::RegResult waitResult =
+            remote.TryWaitForChange(L"Remote\\Watched", false, std::chrono::seconds(10));
+        remoteWriter.join();
+        if (waitResult.Failed())
+        {
+            wcout << L"RegRemoteSimulator::TryWaitForChange failed with a change made on Tree().\n";
+        }
+    }
+
+    // Test the batch value deletion
+    key.SetDwordValue(L"TestBatchDelete1", 1);
+    key.SetDwordValue(L"TestBatchDelete2", 2);
+    key.SetStringValue(L"TestBatchDelete3", L"Keep");
+    key.SetDwordValue(L"TestBatchDelete4", 4);
+    const auto batchResult = key.DeleteValues(vector<wstring>{ L"TestBatchDelete1", L"TestBatchMissing" });
+    if ((batchResult.DeletedCount != 1)
+        || (batchResult.Failures.size() != 1)
+        || (batchResult.Failures[0].second.Code() != ERROR_FILE_NOT_FOUND))
+    {
+        wcout << L"RegKey::DeleteValues failed.\n";
+    }
+    const auto batchIfResult = key.DeleteValuesIf([](const winreg::RegValueView& value) {
+        return (value.Name.substr(0, 15) == L"TestBatchDelete")
+            && (value.Type == REG_DWORD);
+    });
+    if (!batchIfResult.AllDeleted()
+        || (batchIfResult.DeletedCount != 2)
+        || key.ContainsValue(L"TestBatchDelete2")
+        || !key.ContainsValue(L"TestBatchDelete3"))
+    {
+        wcout << L"RegKey::DeleteValuesIf failed.\n";
+    }
+    key.DeleteValue(L"TestBatchDelete3");
+
+    // The Try overloads report failed allocations instead of throwing
+    const wstring noSubKey;
+    const winreg::RegOperationLimits noLimits;
+    const auto nothrowPredicate = [](const winreg::RegValueView&) noexcept { return false; };
+    const auto throwingPredicate = [](const winreg::RegValueView&) { return false; };
+    static_assert(noexcept(key.TryEnumValues(noLimits)));
+    static_assert(noexcept(key.TryDeleteTree(noSubKey, noLimits)));
+    static_assert(noexcept(key.TryDeleteValuesIf(nothrowPredicate)));
+    static_assert(!noexcept(key.TryDeleteValuesIf(throwingPredicate)));
+
+    // Test key rename and move
+    RegKey{ key.Get(), L"TestMoveSource\\Child" }.SetDwordValue(L"Value", 1);
+    key.RenameKey(L"TestMoveSource", L"TestMoveRenamed");
+    key.MoveKey(L"TestMoveRenamed", key, L"TestMoveParent\\TestMoveDest");
+    if (key.ContainsSubKey(L"TestMoveSource")
+        || key.ContainsSubKey(L"TestMoveRenamed")
+        || (RegKey{ key.Get(), L"TestMoveParent\\TestMoveDest\\Child" }.GetDwordValue(L"Value") != 1)
+        || (key.TryMoveKey(L"TestMoveParent", key, L"TestMoveParent\\Inner").Code() != ERROR_INVALID_PARAMETER))
+    {
+        wcout << L"RegKey::RenameKey or RegKey::MoveKey failed.\n";
+    }
+
+    // Moving onto an existing key fails, also when it is just a rename
+    RegKey{ key.Get(), L"TestMoveOther" };
+    if ((key.TryMoveKey(L"TestMoveParent", key, L"TestMoveOther").Code() != ERROR_ALREADY_EXISTS)
+        || !key.ContainsSubKey(L"TestMoveParent"))
+    {
+        wcout << L"RegKey::TryMoveKey failed with an existing destination.\n";
+    }
+
+    // Moving a key into its own subtree through another handle must fail too,
+    // leaving nothing behind
+    {
+        RegKey parentAlias{ key.Get(), L"TestMoveParent" };
+        if ((key.TryMoveKey(L"TestMoveParent", parentAlias, L"Inner\\Moved").Code() != ERROR_INVALID_PARAMETER)
+            || parentAlias.ContainsSubKey(L"Inner")
+            || !parentAlias.ContainsSubKey(L"TestMoveDest"))
+        {
+            wcout << L"RegKey::TryMoveKey failed to reject a move into its own subtree.\n";
+        }
+    }
+    key.DeleteTree(L"TestMoveOther");
+    key.DeleteTree(L"TestMoveParent");
+
+    // Test the getters with defaults for optional values
+    if ((key.GetDwordValueOr(L"TestValueDword", 0) != testDw)
+        || (key.GetDwordValueOr(L"TestMissingDword", 42) != 42)
+        || (key.GetQwordValueOr(L"TestMissingQword", 42) != 42)
+        || (key.GetStringValueOr(L"TestValueString", L"Default") != testSz)
+        || (key.GetStringValueOr(L"TestMissingString", L"Default") != L"Default")
+        || (key.GetMultiStringValueOr(L"TestMissingMultiString", testMultiSz) != testMultiSz)
+        || !key.GetBinaryValueOr(L"TestMissingBinary", {}).empty()
+        || (key.GetValueOr<DWORD>(L"TestMissingDword", 7) != 7)
+        || (key.GetValueOr<wstring>(L"TestValueString", L"") != testSz))
+    {
+        wcout << L"RegKey::GetXxxValueOr failed.\n";
+    }
+    try
+    {
+        // A value of another type is an error, not a missing value
+        (void)key.GetDwordValueOr(L"TestValueString", 0);
+        wcout << L"RegKey::GetDwordValueOr with wrong type failed.\n";
+    }
+    catch (const RegException&)
+    {
+    }
+    try
+    {
+        // A missing value costs no library allocations
+        RegAllocationStats::ExpectAtMost(0, [&] {
+            (void)key.GetDwordValueOr(L"TestMissingDword", 42);
+            (void)key.GetStringValueOr(L"TestMissingString", wstring{});
+        });
+    }
+    catch (const RegException&)
+    {
+        wcout << L"RegKey::GetXxxValueOr allocated for a missing value.\n";
+    }
+
+
+    //
+    // Remove some test values
+    //
+
+    key.DeleteValue(L"TestValueDword");
+    key.DeleteValue(L"TestValueQword");
+    key.DeleteValue(L"TestValueString");
+    key.DeleteValue(L"TestValueExpandString");
+    key.DeleteValue(L"TestValueMultiString");
+    key.DeleteValue(L"TestValueBinary");
+
+    key.DeleteValue(L"TestTryValueDword");
+    key.DeleteValue(L"TestTryValueQword");
+    key.DeleteValue(L"TestTryValueString");
+    key.DeleteValue(L"TestTryValueExpandString");
+    key.DeleteValue(L"TestTryValueMultiString");
+    key.DeleteValue(L"TestTryValueBinary");
+}
+
+
+#ifndef _WIN32
+
+//
+// The content of GioTest.reg, for the POSIX builds: there is no Windows
+// registry there, so the tests run against an in-memory registry seeded
+// with it
+//
+RegTree MakeGioTestTree()
+{
+    const wstring key = L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest";
+
+    const auto setValue = [](RegTree& tree, const wstring& keyPath, const wchar_t* name,
+                             DWORD type, const vector<BYTE>& data) {
+        tree.SetValue(keyPath, name, type, data.data(), data.size());
+    };
+    const auto stringData = [](const wstring& s) {
+        // Each string with its terminator, as stored by the registry
+        vector<BYTE> data((s.length() + 1) * sizeof(wchar_t));
+        std::memcpy(data.data(), s.c_str(), data.size());
+        return data;
+    };
+
+    RegTree tree;
+    setValue(tree, key, L"TestDword", REG_DWORD, { 0xF1, 0xDE, 0xBC, 0x0A });
+    setValue(tree, key, L"TestBinary", REG_BINARY, { 0x12, 0x34, 0x56, 0x78, 0x90, 0xA1, 0xB2, 0xC3, 0xD4, 0xEF });
+    setValue(tree, key, L"TestQword", REG_QWORD, { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x00, 0x00 });
+    setValue(tree, key, L"TestMultiSz", REG_MULTI_SZ, stringData(wstring{ L"Ciao\0Connie\0meow\0Hi\0", 20 }));
+    setValue(tree, key, L"TestString", REG_SZ, stringData(L"Connie"));
+    setValue(tree, key, L"TestExpandSz", REG_EXPAND_SZ, stringData(L"%PATH%;More\\Data"));
+    setValue(tree, key, L"TestEmptyString", REG_SZ, stringData(L""));
+    setValue(tree, key, L"TestEmptyExpandSz", REG_EXPAND_SZ, stringData(L""));
+    setValue(tree, key, L"TestEmptyMultiSz", REG_MULTI_SZ, stringData(L""));
+    setValue(tree, key, L"TestEmptyBinary", REG_BINARY, {});
+    setValue(tree, key, L"TestTryEmptyBinary", REG_BINARY, {});
+    tree.CreateKey(key + L"\\SubKey1");
+    tree.CreateKey(key + L"\\SubKey2");
+    setValue(tree, key + L"\\SubKey3_Test", L"TestDW", REG_DWORD, { 0x34, 0x12, 0x00, 0x00 });
+    return tree;
+}
+
+#endif // _WIN32
+
+
+//
+// Run RegKey code against an in-memory backend
+//
+template <typename Backend, typename... BackendArgs>
+void TestMemoryBackend(const wchar_t* const backendName, const BackendArgs&... backendArgs)
+{
+    winreg::RegBackend* const previousBackend = winreg::RegBackend::Current();
+    Backend backend{ backendArgs... };
+    {
+        const RegBackendScope backendScope{ backend };
+
+        RegKey key{ HKEY_CURRENT_USER, L"SOFTWARE\\GioTest\\Backend" };
+        key.SetDwordValue(L"Dword", 0x1234);
+        key.SetStringValue(L"String", L"Connie");
+        key.SetExpandStringValue(L"ExpandString", L"%PATH%");
+        key.SetMultiStringValue(L"MultiString", { L"Ciao", L"Connie" });
+        key.SetBinaryValue(L"Binary", { 0x11, 0x22, 0x33 });
+        RegKey{ key.Get(), L"SubKey1" };
+        RegKey{ key.Get(), L"SubKey2\\Inner" }.SetQwordValue(L"Qword", 42);
+
+        if ((key.GetDwordValue(L"Dword") != 0x1234)
+            || (key.GetStringValue(L"String") != L"Connie")
+            || (key.GetExpandStringValue(L"ExpandString", RegKey::ExpandStringOption::DontExpand) != L"%PATH%")
+            || (key.GetMultiStringValue(L"MultiString") != vector<wstring>{ L"Ciao", L"Connie" })
+            || (key.GetBinaryValue(L"Binary") != vector<BYTE>{ 0x11, 0x22, 0x33 })
+            || (key.TryGetDwordValue(L"String").GetError().Code() != ERROR_UNSUPPORTED_TYPE)
+            || (key.TryGetDwordValue(L"Missing").GetError().Code() != ERROR_FILE_NOT_FOUND)
+            || (key.EnumSubKeys() != vector<wstring>{ L"SubKey1", L"SubKey2" })
+            || (key.EnumValues().size() != 5)
+            || (key.QueryInfoKey().NumberOfValues != 5))
+        {
+            wcout << backendName << L" read/write failed.\n";
+        }
+
+        // Access rights are checked
+        RegKey readOnlyKey{ HKEY_CURRENT_USER, L"SOFTWARE\\GioTest\\Backend", KEY_READ };
+        if ((readOnlyKey.TrySetDwordValue(L"Dword", 1).Code() != ERROR_ACCESS_DENIED)
+            || (RegKey{}.TryOpen(HKEY_CURRENT_USER, L"SOFTWARE\\GioTest\\Missing").Code() != ERROR_FILE_NOT_FOUND))
+        {
+            wcout << backendName << L" access checks failed.\n";
+        }
+
+        // A synchronous notification returns at the next change of the key
+        {
+            std::thread notified([&backend, &readOnlyKey] {
+                (void)backend.NotifyChangeKeyValue(readOnlyKey.Get(), FALSE,
+                                                   REG_NOTIFY_CHANGE_LAST_SET, nullptr, FALSE);
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            key.SetDwordValue(L"Dword", 0x5678);
+            notified.join();
+        }
+
+        // Rename, move and delete through RegKey
+        key.RenameKey(L"SubKey1", L"Renamed");
+        key.MoveKey(L"SubKey2", key, L"Renamed\\Moved");
+        if (key.ContainsSubKey(L"SubKey1")
+            || key.ContainsSubKey(L"SubKey2")
+            || (RegKey{ key.Get(), L"Renamed\\Moved\\Inner" }.GetQwordValue(L"Qword") != 42)
+            || (key.TryMoveKey(L"Renamed", key, L"Renamed\\Inner").Code() != ERROR_INVALID_PARAMETER)
+            || (key.TryDeleteKey(L"Renamed", 0).Code() != ERROR_ACCESS_DENIED))
+        {
+            wcout << backendName << L" rename/move failed.\n";
+        }
+
+        key.DeleteTree(L"Renamed");
+        key.DeleteValue(L"Binary");
+        key.FlushKey();
+        key.Close();
+        readOnlyKey.Close();
+        if (backend.OpenKeyCount() != 0)
+        {
+            wcout << backendName << L" leaked key handles.\n";
+        }
+    }
+
+    // The changes went to the backend, and the previous backend (if any) is back
+    const RegTree tree = backend.Snapshot();
+    const RegTree::Value* const dword =
+        tree.FindValue(L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest\\Backend", L"Dword");
+    if ((winreg::RegBackend::Current() != previousBackend)
+        || (dword == nullptr)
+        || (dword->Type != REG_DWORD)
+        || tree.FindValue(L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest\\Backend", L"Binary")
+        || tree.ContainsKey(L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest\\Backend\\Renamed"))
+    {
+        wcout << backendName << L" snapshot failed.\n";
+    }
+}
+
+
+
+void MemoryBackendTest()
+{
+    wcout << "\n *** Testing the In-Memory Backends *** \n\n";
+
+    TestMemoryBackend<RegTreeBackend>(L"RegTreeBackend");
+    TestMemoryBackend<RegVersionedTreeBackend>(L"RegVersionedTreeBackend");
+    TestMemoryBackend<RegConcurrentTreeBackend>(L"RegConcurrentTreeBackend");
+
+    // The persistent backend: the changes survive the backend
+    TempTestFiles tempFiles;
+    const wstring journalPath = tempFiles.Add(L"WinRegTestBackendJournal",
+        { L".log", L".checkpoint", L".checkpoint.tmp" });
+    TestMemoryBackend<RegPersistentTreeBackend>(L"RegPersistentTreeBackend", journalPath);
+    {
+        RegPersistentTree persistentTree;
+        persistentTree.Open(journalPath);
+        if (!persistentTree.Snapshot().FindValue(L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest\\Backend", L"Dword"))
+        {
+            wcout << L"RegPersistentTreeBackend recovery failed.\n";
+        }
+    }
+
+    // Without automatic group commit, RegKey::FlushKey makes the changes durable
+    RegJournalOptions options;
+    options.FlushEveryOperations = 0;
+    RegPersistentTreeBackend backend{ journalPath, options };
+    {
+        const RegBackendScope backendScope{ backend };
+
+        RegKey key{ HKEY_CURRENT_USER, L"SOFTWARE\\GioTest\\Backend" };
+        key.SetDwordValue(L"Flushed", 1);
+        const bool visibleBeforeFlush = (key.GetDwordValue(L"Flushed") == 1);
+        const bool durableBeforeFlush =
+            backend.Snapshot().FindValue(L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest\\Backend", L"Flushed");
+        key.FlushKey();
+        if (!visibleBeforeFlush
+            || durableBeforeFlush
+            || !backend.Snapshot().FindValue(L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest\\Backend", L"Flushed"))
+        {
+            wcout << L"RegPersistentTreeBackend FlushKey failed.\n";
+        }
+    }
+}
+
+
+//
+// The remote registry over loopback TCP: RegKey code running against
+// RegRemoteClientBackend, and the simulated link as a backend decorator
+//
+void RemoteRegistryTest()
+{
+    wcout << "\n *** Testing the Remote Registry *** \n\n";
+
+    RegRemoteSimulatorOptions remoteOptions;
+    remoteOptions.RoundTripLatency = std::chrono::microseconds(0);
+    RegRemoteSimulator remote{ remoteOptions };
+    RegRemoteServer server{ remote };
+    RegRemoteClientBackend client{ server.Port() };
+    {
+        const RegBackendScope backendScope{ client };
+
+        RegKey key{ HKEY_CURRENT_USER, L"SOFTWARE\\GioTest\\Remote" };
+        key.SetDwordValue(L"Dword", 0x1234);
+        key.SetStringValue(L"String", L"Connie");
+        key.SetMultiStringValue(L"MultiString", { L"Ciao", L"Connie" });
+        RegKey{ key.Get(), L"SubKey1" };
+        RegKey{ key.Get(), L"SubKey2" }.SetQwordValue(L"Qword", 42);
+        key.RenameKey(L"SubKey1", L"Renamed");
+
+        if ((key.GetDwordValue(L"Dword") != 0x1234)
+            || (key.GetStringValue(L"String") != L"Connie")
+            || (key.GetMultiStringValue(L"MultiString") != vector<wstring>{ L"Ciao", L"Connie" })
+            || (key.TryGetDwordValue(L"Missing").GetError().Code() != ERROR_FILE_NOT_FOUND)
+            || (key.EnumSubKeys() != vector<wstring>{ L"Renamed", L"SubKey2" })
+            || (key.EnumValues().size() != 3)
+            || (RegKey{}.TryOpen(HKEY_CURRENT_USER, L"SOFTWARE\\GioTest\\Missing").Code() != ERROR_FILE_NOT_FOUND)
+            || !remote.Tree().FindValue(L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest\\Remote\\SubKey2", L"Qword"))
+        {
+            wcout << L"RegRemoteClientBackend read/write failed.\n";
+        }
+
+        // The changes made on the server are notified to the client
+        const HANDLE changed = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        const LSTATUS notifyResult = client.NotifyChangeKeyValue(key.Get(), FALSE,
+            REG_NOTIFY_CHANGE_LAST_SET, changed, TRUE);
+        remote.Tree().SetValue(L"HKEY_CURRENT_USER\\SOFTWARE\\GioTest\\Remote", L"Server", REG_DWORD,
+                               vector<BYTE>(sizeof(DWORD)));
+        if ((notifyResult != ERROR_SUCCESS)
+            || (::WaitForSingleObject(changed, 10000) != WAIT_OBJECT_0)
+            || !key.ContainsValue(L"Server"))
+        {
+            wcout << L"RegRemoteClientBackend change notification failed.\n";
+        }
+        ::CloseHandle(changed);
+
+        // The failures injected by the server reach RegKey
+        remoteOptions.FailureProbability = 1.0;
+        remote.SetOptions(remoteOptions);
+        const auto failedRead = key.TryGetDwordValue(L"Dword");
+        remoteOptions.FailureProbability = 0.0;
+        remote.SetOptions(remoteOptions);
+        if (failedRead.IsValid()
+            || (failedRead.GetError().Code() != RPC_S_SERVER_UNAVAILABLE)
+            || (key.GetDwordValue(L"Dword") != 0x1234))
+        {
+            wcout << L"RegRemoteClientBackend failure injection failed.\n";
+        }
+
+        // Batching: one enumeration instead of a request per value
+        constexpr int kValueCount = 50;
+        RegKey batchKey{ key.Get(), L"Batch" };
+        for (int index = 0; index < kValueCount; index++)
+        {
+            batchKey.SetDwordValue(L"Value" + std::to_wstring(index), index);
+        }
+        remote.ResetStatistics();
+        auto start = std::chrono::steady_clock::now();
+        for (int index = 0; index < kValueCount; index++)
+        {
+            (void)batchKey.GetDwordValue(L"Value" + std::to_wstring(index));
+        }
+        const std::chrono::duration<double, std::milli> singleReadTime = std::chrono::steady_clock::now() - start;
+        const ULONGLONG singleReadRequests = remote.Statistics().Requests;
+        remote.ResetStatistics();
+        start = std::chrono::steady_clock::now();
+        const auto batchValues = batchKey.EnumValues();
+        const std::chrono::duration<double, std::milli> batchReadTime = std::chrono::steady_clock::now() - start;
+        const ULONGLONG batchReadRequests = remote.Statistics().Requests;
+        wcout << L"  " << kValueCount << L" values read one by one: " << singleReadRequests << L" requests, "
+              << singleReadTime.count() << L" ms; enumerated: " << batchReadRequests << L" requests, "
+              << batchReadTime.count() << L" ms\n";
+        if ((batchValues.size() != kValueCount) || (batchReadRequests >= singleReadRequests))
+        {
+            wcout << L"RegRemoteClientBackend batching failed.\n";
+        }
+
+        // Pooling: the threads reuse the connections they open
+        vector<std::thread> readers;
+        std::atomic<int> readErrors{ 0 };
+        for (int threadIndex = 0; threadIndex < 4; threadIndex++)
+        {
+            readers.emplace_back([&batchKey, &readErrors] {
+                for (int index = 0; index < 100; index++)
+                {
+                    if (!batchKey.TryGetDwordValue(L"Value1").IsValid())
+                    {
+                        readErrors++;
+                    }
+                }
+            });
+        }
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+        wcout << L"  4 threads x 100 reads: " << client.OpenedConnectionCount()
+              << L" connections opened by the client, " << server.AcceptedConnectionCount()
+              << L" accepted by the server\n";
+        if ((readErrors != 0) || (client.OpenedConnectionCount() > 6))
+        {
+            wcout << L"RegRemoteClientBackend connection pooling failed.\n";
+        }
+
+        key.DeleteTree(L"Batch");
+        batchKey.Close();
+        key.Close();
+    }
+    if (client.OpenKeyCount() != 0)
+    {
+        wcout << L"RegRemoteClientBackend leaked key handles.\n";
+    }
+
+    // Without a server, the requests fail
+    {
+        RegRemoteClientBackend unreachable{ 1 };
+        const RegBackendScope backendScope{ unreachable };
+        if (RegKey{}.TryOpen(HKEY_CURRENT_USER, L"SOFTWARE\\GioTest").Code() != RPC_S_SERVER_UNAVAILABLE)
+        {
+            wcout << L"RegRemoteClientBackend without a server failed.\n";
+        }
+    }
+
+    // The simulated link as a decorator of any backend
+    RegTreeBackend local;
+    RegRemoteSimulatorBackend simulated{ local, remoteOptions };
+    {
+        const RegBackendScope backendScope{ simulated };
+
+        RegKey key{ HKEY_CURRENT_USER, L"SOFTWARE\\GioTest\\Remote" };
+        key.SetDwordValue(L"Dword", 0x1234);
+        simulated.ResetStatistics();
+        (void)key.EnumValues();
+        const ULONGLONG enumRequests = simulated.Statistics().Requests;
+
+        remoteOptions.FailureProbability = 1.0;
+        simulated.SetOptions(remoteOptions);
+        const auto failedRead = key.TryGetDwordValue(L"Dword");
+        key.Close();
+        remoteOptions.FailureProbability = 0.0;
+        simulated.SetOptions(remoteOptions);
+
+        if ((enumRequests == 0)
+            || failedRead.IsValid()
+            || (failedRead.GetError().Code() != RPC_S_SERVER_UNAVAILABLE)
+            || (simulated.Statistics().FailedRequests == 0)
+            || (local.OpenKeyCount() != 0))
+        {
+            wcout << L"RegRemoteSimulatorBackend failed.\n";
+        }
+    }
+}
+
+
+//
+// Run an operation on many threads for a while, print its throughput and
+// return it. The operation receives the thread index and an iteration
+// counter, and returns false if it finds a broken invariant.
+//
+template <typename Operation>
+double RunStress(const wstring& name, Operation operation, const int threadCount = 8)
+{
+    constexpr auto kDuration = std::chrono::milliseconds(500);
+
+    std::atomic<bool> stop{ false };
+    std::atomic<unsigned long long> operationCount{ 0 };
+    std::atomic<unsigned long long> failureCount{ 0 };
+
+    const auto start = std::chrono::steady_clock::now();
+
+    vector<std::thread> threads;
+    for (int threadIndex = 0; threadIndex < threadCount; threadIndex++)
+    {
+        threads.emplace_back([&, threadIndex] {
+            unsigned long long iteration = 0;
+            unsigned long long failures = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                try
+                {
+                    if (!operation(threadIndex, iteration))
+                    {
+                        failures++;
+                    }
+                }
+                catch (const RegException&)
+                {
+                    failures++;
+                }
+                iteration++;
+            }
+            operationCount += iteration;
+            failureCount += failures;
+        });
+    }
+
+    std::this_thread::sleep_for(kDuration);
+    stop = true;
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const double throughput = operationCount / elapsed.count();
+    wcout << L"  " << name << L" (" << threadCount << L" threads): "
+          << static_cast<unsigned long long>(throughput) << L" ops/s\n";
+
+    if (failureCount != 0)
+    {
+        wcout << name << L" stress test failed (" << failureCount.load() << L" errors).\n";
+    }
+    return throughput;
+}
+
+
+//
+// Run an operation on 1, 2, 4 and 8 threads, and print how its throughput
+// scales with the number of threads (up to the number of hardware threads)
+//
+template <typename Operation>
+void RunScaling(const wchar_t* const name, Operation operation)
+{
+    wcout << L"  " << name << L" scaling, on " << std::thread::hardware_concurrency()
+          << L" hardware threads:\n";
+    const double singleThreadThroughput = RunStress(name, operation, 1);
+    for (int threadCount = 2; threadCount <= 8; threadCount *= 2)
+    {
+        const double throughput = RunStress(name, operation, threadCount);
+        wcout << L"    speedup: " << (throughput / singleThreadThroughput) << L"x\n";
+    }
+}
+
+
+//
+// RegKey from many threads: shared handles, enumeration while other threads
+// change the key, and open/close churn, on the current registry (the given
+// name labels the throughput lines)
+//
+void RegKeyStress(const wstring& registryName)
+{
+    const wstring stressSubKey = L"SOFTWARE\\GioTest\\Stress";
+
+    // Delete the Stress key on every exit path, after the handles below
+    // are closed (declared first, so destroyed last)
+    struct StressKeyCleanup
+    {
+        ~StressKeyCleanup()
+        {
+            RegKey parentKey;
+            if (parentKey.TryOpen(HKEY_CURRENT_USER, L"SOFTWARE\\GioTest").IsOk())
+            {
+                (void)parentKey.TryDeleteTree(L"Stress");
+            }
+        }
+    } stressKeyCleanup;
+
+    // Many readers sharing one handle, while a thread rewrites the values.
+    // Every read must see one of the written values, never a torn one.
+    RegKey sharedKey{ HKEY_CURRENT_USER, stressSubKey };
+    sharedKey.SetDwordValue(L"Counter", 0);
+    sharedKey.SetStringValue(L"Text", L"Text0");
+
+    RegTrace::Enable();
+    RunStress(registryName + L": shared RegKey handle", [&sharedKey](int threadIndex, unsigned long long iteration) {
+        if (threadIndex == 0)
+        {
+            sharedKey.SetDwordValue(L"Counter", static_cast<DWORD>(iteration));
+            sharedKey.SetStringValue(L"Text", L"Text" + std::to_wstring(iteration));
+            return true;
+        }
+
+        const wstring text = sharedKey.GetStringValue(L"Text");
+        const auto counter = sharedKey.TryGetDwordValue(L"Counter");
+        return counter.IsValid() && (text.compare(0, 4, L"Text") == 0);
+    });
+
+    // Enumeration while two threads add and remove subkeys and values
+    RunStress(registryName + L": enumeration during mutation", [&sharedKey](int threadIndex, unsigned long long iteration) {
+        const wstring suffix = std::to_wstring(iteration % 16);
+        if (threadIndex < 2)
+        {
+            if (iteration % 2 == 0)
+            {
+                RegKey{ sharedKey.Get(), L"Child" + suffix };
+                sharedKey.SetDwordValue(L"Value" + suffix, 1);
+            }
+            else
+            {
+                (void)sharedKey.TryDeleteKey(L"Child" + suffix, KEY_WOW64_64KEY);
+                (void)sharedKey.TryDeleteValue(L"Value" + suffix);
+            }
+            return true;
+        }
+
+        const auto isChild = [](const wstring& name) { return name.compare(0, 5, L"Child") == 0; };
+        const vector<wstring> subKeys = sharedKey.EnumSubKeys();
+        if (!std::all_of(subKeys.begin(), subKeys.end(), isChild))
+        {
+            return false;
+        }
+
+        RegNameList valueNames;
+        sharedKey.EnumValues(valueNames);
+        for (size_t index = 0; index < valueNames.Size(); index++)
+        {
+            if (valueNames[index].empty())
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    // Open/close churn: create, write, move and close handles
+    RunStress(registryName + L": open/close churn", [&stressSubKey](int threadIndex, unsigned long long iteration) {
+        const wstring churnSubKey = stressSubKey + L"\\Churn" + std::to_wstring(threadIndex % 4);
+
+        RegKey key;
+        key.Create(HKEY_CURRENT_USER, churnSubKey);
+        key.SetDwordValue(L"Thread" + std::to_wstring(threadIndex), static_cast<DWORD>(iteration));
+
+        RegKey movedKey = std::move(key);
+        const DWORD value = movedKey.GetDwordValue(L"Thread" + std::to_wstring(threadIndex));
+        movedKey.Close();
+
+        RegKey readKey;
+        return readKey.TryOpen(HKEY_CURRENT_USER, churnSubKey, KEY_READ).IsOk()
+            && (value == static_cast<DWORD>(iteration));
+    });
+    RegTrace::Disable();
+    RegTrace::Clear();
+}
+
+
+//
+// Run the RegKey stress test against an in-memory backend
+//
+template <typename Backend, typename... BackendArgs>
+void StressMemoryBackend(const wchar_t* const backendName, const BackendArgs&... backendArgs)
+{
+    Backend backend{ backendArgs... };
+    {
+        const RegBackendScope backendScope{ backend };
+        RegKeyStress(backendName);
+    }
+
+    if (backend.OpenKeyCount() != 0)
+    {
+        wcout << backendName << L" leaked key handles under stress.\n";
+    }
+}
+
+
+//
+// Concurrency stress test: RegKey on the registry and on each in-memory
+// backend, and the thread-safe in-memory stores.
+//
+void StressTest()
+{
+    wcout << "\n *** Concurrency Stress Test *** \n\n";
+
+#ifdef _WIN32
+    RegKeyStress(L"Windows registry");
+#endif // _WIN32
+
+    StressMemoryBackend<RegTreeBackend>(L"RegTreeBackend");
+    StressMemoryBackend<RegVersionedTreeBackend>(L"RegVersionedTreeBackend");
+    StressMemoryBackend<RegConcurrentTreeBackend>(L"RegConcurrentTreeBackend");
+    {
+        TempTestFiles tempFiles;
+        const wstring journalPath = tempFiles.Add(L"WinRegTestStressJournal",
+            { L".log", L".checkpoint", L".checkpoint.tmp" });
+        StressMemoryBackend<RegPersistentTreeBackend>(L"RegPersistentTreeBackend", journalPath);
+    }
+
+    // The sharded in-memory store: writers, readers, enumerators and deleters
+    RegConcurrentTree tree;
+    RunStress(L"RegConcurrentTree", [&tree](int threadIndex, unsigned long long iteration) {
+        const DWORD data = static_cast<DWORD>(iteration);
+        const wstring keyPath = L"Root\\Key" + std::to_wstring(iteration % 32);
+        switch (threadIndex % 4)
+        {
+        case 0:
+            tree.SetValue(keyPath, L"Data", REG_DWORD,
+                vector<BYTE>(reinterpret_cast<const BYTE*>(&data),
+                             reinterpret_cast<const BYTE*>(&data) + sizeof(data)));
+            return true;
+
+        case 1:
+        {
+            const auto value = tree.FindValue(keyPath, L"Data");
+            return !value || (value->DataSize == sizeof(DWORD));
+        }
+
+        case 2:
+            return tree.TryEnumSubKeys(L"Root").IsValid() || !tree.ContainsKey(L"Root");
+
+        default:
+            (void)tree.DeleteTree(keyPath);
+            return true;
+        }
+    });
+
+    // Lock-free readers of the versioned tree, while a writer commits versions
+    RegVersionedTree versionedTree;
+    for (int index = 0; index < 32; index++)
+    {
+        versionedTree.Update([index](RegTree& t) {
+            t.SetValue(L"Root\\Key" + std::to_wstring(index), L"Data", REG_DWORD, vector<BYTE>(sizeof(DWORD)));
+        });
+    }
+    RunStress(L"RegVersionedTree", [&versionedTree](int threadIndex, unsigned long long iteration) {
+        const wstring keyPath = L"Root\\Key" + std::to_wstring(iteration % 32);
+        if (threadIndex == 0)
+        {
+            const DWORD data = static_cast<DWORD>(iteration);
+            versionedTree.Update([&keyPath, data](RegTree& t) {
+                t.SetValue(keyPath, L"Data", REG_DWORD,
+                    vector<BYTE>(reinterpret_cast<const BYTE*>(&data),
+                                 reinterpret_cast<const BYTE*>(&data) + sizeof(data)));
+            });
+            return true;
+        }
+
+        return versionedTree.Read([&keyPath](const RegTree& t) {
+            const RegTree::Value* const value = t.FindValue(keyPath, L"Data");
+            return (value != nullptr) && (value->DataSize == sizeof(DWORD));
+        });
+    });
+
+    // The read throughput scales with the readers, as they share no lock
+    RunScaling(L"RegVersionedTree reads", [&versionedTree](int, unsigned long long iteration) {
+        const wstring keyPath = L"Root\\Key" + std::to_wstring(iteration % 32);
+        return versionedTree.Read([&keyPath](const RegTree& t) {
+            return t.FindValue(keyPath, L"Data") != nullptr;
+        });
+    });
+
+    // Throughput of mixed workloads, by number of threads: lookups don't lock,
+    // and the writers of different keys don't wait for each other
+    RegConcurrentTree mixedTree;
+    for (int index = 0; index < 64; index++)
+    {
+        mixedTree.SetValue(L"Root\\Key" + std::to_wstring(index), L"Data", REG_DWORD, vector<BYTE>(sizeof(DWORD)));
+    }
+    const auto mixedWorkload = [&mixedTree](const unsigned long long writePercent) {
+        return [&mixedTree, writePercent](int threadIndex, unsigned long long iteration) {
+            const wstring keyPath = L"Root\\Key" + std::to_wstring((iteration * 7 + threadIndex) % 64);
+            if (iteration % 100 < writePercent)
+            {
+                const DWORD data = static_cast<DWORD>(iteration);
+                mixedTree.SetValue(keyPath, L"Data", REG_DWORD,
+                    vector<BYTE>(reinterpret_cast<const BYTE*>(&data),
+                                 reinterpret_cast<const BYTE*>(&data) + sizeof(data)));
+                return true;
+            }
+
+            const auto value = mixedTree.FindValue(keyPath, L"Data");
+            return value && (value->DataSize == sizeof(DWORD));
+        };
+    };
+    RunScaling(L"RegConcurrentTree, 10% writes", mixedWorkload(10));
+    RunScaling(L"RegConcurrentTree, 50% writes", mixedWorkload(50));
+
+    // Interning the same names from all the threads
+    winreg::RegNamePool namePool;
+    RunStress(L"RegNamePool", [&namePool](int, unsigned long long iteration) {
+        const wstring name = L"Name" + std::to_wstring(iteration % 256);
+        const auto interned = namePool.Intern(name);
+        return (interned == name) && (namePool.Find(name).data() == interned.data());
+    });
+}
+
+
+//
+// Commit latency and throughput of the write-ahead log of RegPersistentTree,
+// with group commit batches of different sizes: each batch is written and
+// flushed to disk at once
+//
+void JournalBenchmark()
+{
+    wcout << "\n *** Write-Ahead Log Benchmark *** \n\n";
+
+    using Clock = std::chrono::steady_clock;
+    using Microseconds = std::chrono::duration<double, std::micro>;
+
+    // A multiple of all the batch sizes, so that every operation gets flushed
+    constexpr size_t kOperationCount = 512;
+    const vector<BYTE> data(sizeof(DWORD));
+
+    TempTestFiles tempFiles;
+    for (const size_t batchSize : { 1, 8, 64 })
+    {
+        const wstring journalPath = tempFiles.Add(L"WinRegTestBenchmark" + std::to_wstring(batchSize),
+            { L".log", L".checkpoint", L".checkpoint.tmp" });
+
+        RegJournalOptions options;
+        options.FlushEveryOperations = batchSize;
+        RegPersistentTree persistentTree;
+        persistentTree.Open(journalPath, options);
+
+        // The time spent in each call, and the time until each operation is durable
+        // (when the last operation of its batch returns)
+        vector<double> callLatencies;
+        vector<double> durableLatencies;
+        vector<Clock::time_point> batchStarts;
+
+        const auto start = Clock::now();
+        for (size_t index = 0; index < kOperationCount; index++)
+        {
+            const auto callStart = Clock::now();
+            persistentTree.SetValue(L"Benchmark", L"Value" + std::to_wstring(index % 64), REG_DWORD, data);
+            const auto callEnd = Clock::now();
+
+            callLatencies.push_back(Microseconds(callEnd - callStart).count());
+            batchStarts.push_back(callStart);
+            if (batchStarts.size() == batchSize)
+            {
+                for (const auto& batchStart : batchStarts)
+                {
+                    durableLatencies.push_back(Microseconds(callEnd - batchStart).count());
+                }
+                batchStarts.clear();
+            }
+        }
+        const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        std::sort(callLatencies.begin(), callLatencies.end());
+        std::sort(durableLatencies.begin(), durableLatencies.end());
+        const auto percentile = [](const vector<double>& sorted, const size_t percent) {
+            return static_cast<unsigned long long>(sorted[(sorted.size() - 1) * percent / 100]);
+        };
+
+        wcout << L"  Group commit of " << batchSize << L" operations: "
+              << static_cast<unsigned long long>(kOperationCount / elapsed.count()) << L" ops/s, "
+              << L"call latency p50 " << percentile(callLatencies, 50)
+              << L" us, p99 " << percentile(callLatencies, 99)
+              << L" us; commit latency p50 " << percentile(durableLatencies, 50)
+              << L" us, p99 " << percentile(durableLatencies, 99) << L" us\n";
+
+        if ((durableLatencies.size() != kOperationCount)
+            || (persistentTree.Snapshot().FindKey(L"Benchmark")->Values.size() != 64))
+        {
+            wcout << L"RegPersistentTree group commit benchmark failed.\n";
+        }
+    }
+}
+
+
+//
+// Lookup cost of RegTree, whose keys store their subkeys in contiguous arrays
+// sorted by folded name, against a tree of std::map nodes, on a large tree:
+// the time and the cache misses per lookup (when the hardware counters are
+// available, see HardwareCounter)
+//
+void TreeLookupBenchmark()
+{
+    wcout << "\n *** Tree Lookup Benchmark *** \n\n";
+
+    using Clock = std::chrono::steady_clock;
+
+    // 65536 keys, 4 levels deep
+    constexpr int kGroupCount = 16;
+    constexpr int kSetCount = 32;
+    constexpr int kKeyCount = 128;
+    constexpr size_t kLookupCount = 200000;
+
+    // The tree layout RegTree replaces: a map of subkeys per node
+    struct MapNode
+    {
+        std::map<wstring, std::unique_ptr<MapNode>, std::less<>> SubKeys;
+        std::map<wstring, DWORD, std::less<>> Values;
+    };
+
+    RegTree tree;
+    MapNode mapRoot;
+    vector<wstring> keyPaths;
+    const vector<BYTE> data(sizeof(DWORD));
+    for (int group = 0; group < kGroupCount; group++)
+    {
+        for (int set = 0; set < kSetCount; set++)
+        {
+            for (int key = 0; key < kKeyCount; key++)
+            {
+                keyPaths.push_back(L"Benchmark\\Group" + std::to_wstring(group)
+                                   + L"\\Set" + std::to_wstring(set)
+                                   + L"\\Key" + std::to_wstring(key));
+                tree.SetValue(keyPaths.back(), L"Data", REG_DWORD, data);
+
+                MapNode* node = &mapRoot;
+                for (const wstring& name : { wstring{ L"Benchmark" },
+                                             L"Group" + std::to_wstring(group),
+                                             L"Set" + std::to_wstring(set),
+                                             L"Key" + std::to_wstring(key) })
+                {
+                    auto& child = node->SubKeys[name];
+                    if (!child)
+                    {
+                        child = std::make_unique<MapNode>();
+                    }
+                    node = child.get();
+                }
+                node->Values[L"Data"] = 0;
+            }
+        }
+    }
+
+    // The same random sequence of paths for both trees
+    vector<const wstring*> lookups;
+    std::mt19937 random{ 42 };
+    std::uniform_int_distribution<size_t> pick{ 0, keyPaths.size() - 1 };
+    for (size_t index = 0; index < kLookupCount; index++)
+    {
+        lookups.push_back(&keyPaths[pick(random)]);
+    }
+
+    const auto findInMapTree = [&mapRoot](const std::wstring_view keyPath) -> const DWORD* {
+        const MapNode* node = &mapRoot;
+        size_t start = 0;
+        while (node != nullptr)
+        {
+            const size_t end = (std::min)(keyPath.find(L'\\', start), keyPath.size());
+            const auto child = node->SubKeys.find(keyPath.substr(start, end - start));
+            node = (child != node->SubKeys.end()) ? child->second.get() : nullptr;
+            if (end == keyPath.size())
+            {
+                break;
+            }
+            start = end + 1;
+        }
+        if (node == nullptr)
+        {
+            return nullptr;
+        }
+        const auto value = node->Values.find(std::wstring_view{ L"Data" });
+        return (value != node->Values.end()) ? &value->second : nullptr;
+    };
+
+    HardwareCounter cacheMisses{ HardwareCounter::Event::CacheMisses };
+    HardwareCounter l1dReadMisses{ HardwareCounter::Event::L1DataReadMisses };
+    if (!cacheMisses.IsAvailable())
+    {
+        wcout << L"  (cache miss counters unavailable: " << cacheMisses.UnavailableReason() << L")\n";
+    }
+
+    const auto measure = [&](const wchar_t* const name, const auto& find) {
+        size_t foundCount = 0;
+        const auto start = Clock::now();
+        cacheMisses.Start();
+        l1dReadMisses.Start();
+        for (const wstring* const keyPath : lookups)
+        {
+            foundCount += (find(*keyPath) != nullptr) ? 1 : 0;
+        }
+        const unsigned long long l1dMissCount = l1dReadMisses.Stop();
+        const unsigned long long missCount = cacheMisses.Stop();
+        const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+
+        wcout << L"  " << name << L": " << static_cast<unsigned long long>(elapsed.count() / kLookupCount)
+              << L" ns/lookup";
+        if (cacheMisses.IsAvailable())
+        {
+            wcout << L", " << (static_cast<double>(missCount) / kLookupCount) << L" cache misses/lookup";
+        }
+        if (l1dReadMisses.IsAvailable())
+        {
+            wcout << L", " << (static_cast<double>(l1dMissCount) / kLookupCount) << L" L1D read misses/lookup";
+        }
+        wcout << L'\n';
+
+        if (foundCount != kLookupCount)
+        {
+            wcout << name << L" lookup benchmark failed.\n";
+        }
+    };
+
+    wcout << L"  " << keyPaths.size() << L" keys, 4 levels deep, " << kLookupCount << L" random lookups\n";
+    measure(L"RegTree", [&tree](const wstring& keyPath) { return tree.FindValue(keyPath, L"Data"); });
+    measure(L"std::map tree", findInMapTree);
+}
+
+
+int main()
+{
+    const int kExitOk = 0;
+    const int kExitError = 1;
+
+    try
+    {
+        wcout << L"=========================================\n";
+        wcout << L"*** Testing Giovanni Dicanio's WinReg ***\n";
+        wcout << L"=========================================\n\n";
+
+#ifndef _WIN32
+        RegTreeBackend testRegistry{ MakeGioTestTree() };
+        const RegBackendScope testRegistryScope{ testRegistry };
+#endif // _WIN32
 
         Test();
+        MemoryBackendTest();
+        RemoteRegistryTest();
+        StressTest();
+        JournalBenchmark();
+        TreeLookupBenchmark();
 
         wcout << L"All right!! :)\n\n";
     }